@@ -0,0 +1,261 @@
+#include "async_sink.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+std::atomic<uint64_t> next_sink_id{1};
+
+size_t round_up_pow2(size_t value) noexcept {
+    size_t result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+} // namespace
+
+/// @brief Single producer/single consumer ring. The producer is the thread which adopted the ring
+class async_sink::ring_t final {
+    const size_t mask;
+    std::unique_ptr<record_t[]> slots;
+    alignas(64) std::atomic<size_t> head{0}; // written by the background thread
+    alignas(64) std::atomic<size_t> tail{0}; // written by the producer thread
+    std::atomic_bool abandoned{false};
+
+  public:
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> truncated{0};
+
+  public:
+    explicit ring_t(size_t capacity) noexcept(false) : mask{capacity - 1}, slots{std::make_unique<record_t[]>(capacity)} {
+    }
+
+    /// @return nullptr if the ring is full
+    record_t* reserve() noexcept {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask)
+            return nullptr;
+        return &slots[t & mask];
+    }
+    /// @return count of the records after the commit
+    size_t commit() noexcept {
+        const size_t t = tail.load(std::memory_order_relaxed) + 1;
+        tail.store(t, std::memory_order_release);
+        return t - head.load(std::memory_order_acquire);
+    }
+    [[nodiscard]] size_t size() noexcept {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed);
+    }
+
+    /// @return nullptr if the ring is empty
+    const record_t* front() noexcept {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &slots[h & mask];
+    }
+    void pop() noexcept {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /// @brief The owner thread is exiting. Another thread may adopt this ring
+    void release() noexcept {
+        abandoned.store(true, std::memory_order_release);
+    }
+    bool try_adopt() noexcept {
+        bool expected = true;
+        return abandoned.compare_exchange_strong(expected, false, std::memory_order_acq_rel);
+    }
+};
+
+async_sink::async_sink(std::vector<spdlog::sink_ptr> _sinks, size_t _capacity) noexcept(false)
+    : id{next_sink_id.fetch_add(1)}, capacity{round_up_pow2(std::max<size_t>(_capacity, 2))}, high_water{capacity / 2},
+      sinks{std::move(_sinks)} {
+    worker = std::thread{&async_sink::run, this};
+}
+
+async_sink::~async_sink() noexcept {
+    {
+        std::lock_guard lck{wake_mtx};
+        stopping = true;
+    }
+    wake_cv.notify_one();
+    if (worker.joinable())
+        worker.join();
+}
+
+async_sink::ring_t* async_sink::acquire_ring() noexcept(false) {
+    struct owned_rings_t final {
+        std::vector<std::pair<uint64_t, std::shared_ptr<ring_t>>> items{};
+
+      public:
+        ~owned_rings_t() noexcept {
+            for (auto& item : items)
+                item.second->release();
+        }
+    };
+    thread_local owned_rings_t owned{};
+    for (auto& [owner, ring] : owned.items)
+        if (owner == id)
+            return ring.get();
+
+    std::shared_ptr<ring_t> ring{};
+    {
+        std::lock_guard lck{rings_mtx};
+        for (auto& candidate : rings)
+            if (candidate->try_adopt()) {
+                ring = candidate;
+                break;
+            }
+        if (ring == nullptr)
+            ring = rings.emplace_back(std::make_shared<ring_t>(capacity));
+    }
+    owned.items.emplace_back(id, ring);
+    return ring.get();
+}
+
+void async_sink::log(const spdlog::details::log_msg& msg) {
+    ring_t* ring = acquire_ring();
+    record_t* record = ring->reserve();
+    if (record == nullptr) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    record->time = msg.time;
+    record->thread_id = msg.thread_id;
+    record->source = msg.source;
+    record->level = msg.level;
+    record->name_length = static_cast<uint16_t>(std::min(msg.logger_name.size(), name_capacity));
+    std::memcpy(record->name, msg.logger_name.data(), record->name_length);
+    record->payload_length = static_cast<uint16_t>(std::min(msg.payload.size(), payload_capacity));
+    std::memcpy(record->payload, msg.payload.data(), record->payload_length);
+    if (msg.payload.size() > payload_capacity)
+        ring->truncated.fetch_add(1, std::memory_order_relaxed);
+    const size_t count = ring->commit();
+    ring->accepted.fetch_add(1, std::memory_order_relaxed);
+    if (count != high_water)
+        return; // the poll of the background thread takes it
+    // pairs with the fence in `run`. either it sees the ring filled or we see it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed) == false)
+        return;
+    // the background thread holds `wake_mtx` only between `pending` and `wait`. no I/O under it
+    {
+        std::lock_guard lck{wake_mtx};
+    }
+    wake_cv.notify_one();
+}
+
+void async_sink::flush() {
+    std::unique_lock lck{wake_mtx};
+    const uint64_t ticket = ++flush_requested;
+    wake_cv.notify_one();
+    flush_cv.wait(lck, [this, ticket]() { return flush_completed >= ticket || stopping; });
+}
+
+void async_sink::set_pattern(const std::string& pattern) {
+    std::lock_guard lck{sinks_mtx};
+    for (auto& sink : sinks)
+        sink->set_pattern(pattern);
+}
+
+void async_sink::set_formatter(std::unique_ptr<spdlog::formatter> formatter) {
+    std::lock_guard lck{sinks_mtx};
+    for (size_t i = 1; i < sinks.size(); ++i)
+        sinks[i]->set_formatter(formatter->clone());
+    if (sinks.empty() == false)
+        sinks[0]->set_formatter(std::move(formatter));
+}
+
+auto async_sink::stats() noexcept -> stats_t {
+    stats_t result{};
+    std::lock_guard lck{rings_mtx};
+    for (auto& ring : rings) {
+        result.accepted += ring->accepted.load(std::memory_order_relaxed);
+        result.dropped += ring->dropped.load(std::memory_order_relaxed);
+        result.truncated += ring->truncated.load(std::memory_order_relaxed);
+    }
+    result.written = written.load(std::memory_order_relaxed);
+    return result;
+}
+
+size_t async_sink::drain() noexcept {
+    // the producers adopt or add their rings while the records are written
+    {
+        std::lock_guard lck{rings_mtx};
+        draining.assign(rings.begin(), rings.end());
+    }
+    size_t count = 0;
+    std::lock_guard lck{sinks_mtx};
+    for (auto& ring : draining) {
+        while (const record_t* record = ring->front()) {
+            spdlog::details::log_msg msg{record->time, record->source,
+                                         spdlog::string_view_t{record->name, record->name_length}, record->level,
+                                         spdlog::string_view_t{record->payload, record->payload_length}};
+            msg.thread_id = record->thread_id;
+            for (auto& sink : sinks) {
+                if (sink->should_log(msg.level) == false)
+                    continue;
+                try {
+                    sink->log(msg);
+                } catch (...) {
+                    // there is no one to report. keep draining
+                }
+            }
+            ring->pop();
+            ++count;
+        }
+    }
+    written.fetch_add(count, std::memory_order_relaxed);
+    return count;
+}
+
+bool async_sink::filled() noexcept {
+    std::lock_guard lck{rings_mtx};
+    for (auto& ring : rings)
+        if (ring->size() >= high_water)
+            return true;
+    return false;
+}
+
+void async_sink::run() noexcept {
+    uint64_t completed = 0;
+    while (true) {
+        uint64_t requested = 0;
+        bool stop = false;
+        {
+            std::lock_guard lck{wake_mtx};
+            requested = flush_requested;
+            stop = stopping;
+        }
+        const size_t count = drain();
+        if (requested != completed || stop) {
+            {
+                std::lock_guard lck{sinks_mtx};
+                for (auto& sink : sinks) {
+                    try {
+                        sink->flush();
+                    } catch (...) {
+                    }
+                }
+            }
+            completed = requested;
+            {
+                std::lock_guard lck{wake_mtx};
+                flush_completed = completed;
+            }
+            flush_cv.notify_all();
+        }
+        if (stop)
+            return;
+        if (count)
+            continue;
+        std::unique_lock lck{wake_mtx};
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // see `log`
+        wake_cv.wait_for(lck, poll_interval,
+                         [this, completed]() { return flush_requested != completed || stopping || filled(); });
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <spdlog/sinks/sink.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Moves pattern formatting and I/O of the wrapped sinks to a background thread
+ * @details Each producer thread owns a lock-free single-producer/single-consumer ring of fixed size records.
+ *          `log` copies the already formatted payload into the ring and returns. It never blocks and never allocates
+ *          after the first call on the thread. When the ring is full the record is dropped and counted.
+ *          The background thread drains the rings and forwards the records to the wrapped sinks,
+ *          so the wrapped sinks can be single threaded ones(`_st`). No lock of the producers is held during the I/O.
+ *          The background thread polls the rings every `poll_interval`. A producer wakes it earlier only when its
+ *          ring reaches the half of the capacity, so a sparse `log` doesn't pay for the wakeup.
+ *          A flush and the destruction wake it too.
+ * @note Records of different threads are not ordered by time.
+ */
+class async_sink final : public spdlog::sinks::sink {
+  public:
+    static constexpr size_t name_capacity = 32;
+    static constexpr size_t payload_capacity = 416;
+    /// @brief The longest time a record waits in a ring which is below the high-water mark
+    static constexpr std::chrono::milliseconds poll_interval{10};
+
+    struct record_t final {
+        spdlog::log_clock::time_point time{};
+        size_t thread_id = 0;
+        spdlog::source_loc source{};
+        spdlog::level::level_enum level = spdlog::level::off;
+        uint16_t name_length = 0;
+        uint16_t payload_length = 0;
+        char name[name_capacity];
+        char payload[payload_capacity];
+    };
+
+    struct stats_t final {
+        uint64_t accepted = 0;  // pushed to the rings
+        uint64_t dropped = 0;   // rejected because the ring was full
+        uint64_t truncated = 0; // payload was longer than `payload_capacity`
+        uint64_t written = 0;   // forwarded to the wrapped sinks
+    };
+
+  private:
+    class ring_t;
+
+    const uint64_t id;
+    const size_t capacity;
+    const size_t high_water; // records in a ring which wake the background thread
+    std::vector<spdlog::sink_ptr> sinks;
+
+    std::mutex sinks_mtx{}; // `set_pattern` may race with the background thread
+    std::mutex rings_mtx{};
+    std::vector<std::shared_ptr<ring_t>> rings{};
+    std::vector<std::shared_ptr<ring_t>> draining{}; // copy of `rings` for the background thread
+
+    std::mutex wake_mtx{};
+    std::condition_variable wake_cv{};
+    std::condition_variable flush_cv{};
+    std::atomic_bool sleeping{false};
+    std::atomic_bool stopping{false};
+    uint64_t flush_requested = 0; // guarded by `wake_mtx`
+    uint64_t flush_completed = 0; // guarded by `wake_mtx`
+    std::atomic<uint64_t> written{0};
+    std::thread worker{};
+
+  public:
+    /// @param capacity records per producer thread. rounded up to power of 2
+    async_sink(std::vector<spdlog::sink_ptr> sinks, size_t capacity = 1024) noexcept(false);
+    async_sink(const async_sink&) = delete;
+    async_sink(async_sink&&) = delete;
+    async_sink& operator=(const async_sink&) = delete;
+    async_sink& operator=(async_sink&&) = delete;
+    /// @note pending records are written before the background thread exits
+    ~async_sink() noexcept;
+
+    void log(const spdlog::details::log_msg& msg) override;
+    /// @brief Wait until the records pushed before this call are written, then flush the wrapped sinks
+    void flush() override;
+    void set_pattern(const std::string& pattern) override;
+    void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override;
+
+    [[nodiscard]] stats_t stats() noexcept;
+
+  private:
+    ring_t* acquire_ring() noexcept(false);
+    size_t drain() noexcept;
+    bool filled() noexcept;
+    void run() noexcept;
+};
@@ -0,0 +1,246 @@
+#include "deinterlacer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+#include "simd.hpp"
+
+namespace {
+
+/// @brief Difference from the previous frame which is motion rather than noise
+constexpr uint8_t motion_threshold = 10;
+
+uint8_t get_distance(uint8_t lhs, uint8_t rhs) noexcept {
+    return lhs > rhs ? lhs - rhs : rhs - lhs;
+}
+
+} // namespace
+
+void interpolate_row(const uint8_t* above, const uint8_t* below, uint32_t count, uint8_t* dst) noexcept {
+    uint32_t i = 0;
+#if defined(MEDIA0_SSE2)
+    for (; i + 16 <= count; i += 16)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(above + i)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + i))));
+#elif defined(MEDIA0_NEON)
+    for (; i + 16 <= count; i += 16)
+        vst1q_u8(dst + i, vrhaddq_u8(vld1q_u8(above + i), vld1q_u8(below + i)));
+#endif
+    for (; i < count; ++i)
+        dst[i] = static_cast<uint8_t>((above[i] + below[i] + 1) >> 1);
+}
+
+void adapt_row(const field_rows_t& rows, const field_rows_t& previous, uint8_t threshold, uint32_t count,
+               uint8_t* dst) noexcept {
+    uint32_t i = 0;
+#if defined(MEDIA0_SSE2)
+    const auto load = [](const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); };
+    const auto distance = [](__m128i lhs, __m128i rhs) {
+        return _mm_or_si128(_mm_subs_epu8(lhs, rhs), _mm_subs_epu8(rhs, lhs));
+    };
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(threshold));
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        const __m128i above = load(rows.above + i);
+        const __m128i current = load(rows.current + i);
+        const __m128i below = load(rows.below + i);
+        const __m128i motion =
+            _mm_max_epu8(_mm_max_epu8(distance(above, load(previous.above + i)),
+                                      distance(current, load(previous.current + i))),
+                         distance(below, load(previous.below + i)));
+        const __m128i still = _mm_cmpeq_epi8(_mm_subs_epu8(motion, limit), zero); // motion <= threshold
+        const __m128i bob = _mm_avg_epu8(above, below);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                         _mm_or_si128(_mm_and_si128(still, current), _mm_andnot_si128(still, bob)));
+    }
+#elif defined(MEDIA0_NEON)
+    const uint8x16_t limit = vdupq_n_u8(threshold);
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t above = vld1q_u8(rows.above + i);
+        const uint8x16_t current = vld1q_u8(rows.current + i);
+        const uint8x16_t below = vld1q_u8(rows.below + i);
+        const uint8x16_t motion = vmaxq_u8(vmaxq_u8(vabdq_u8(above, vld1q_u8(previous.above + i)),
+                                                    vabdq_u8(current, vld1q_u8(previous.current + i))),
+                                           vabdq_u8(below, vld1q_u8(previous.below + i)));
+        vst1q_u8(dst + i, vbslq_u8(vcgtq_u8(motion, limit), vrhaddq_u8(above, below), current));
+    }
+#endif
+    for (; i < count; ++i) {
+        const uint8_t motion = std::max({get_distance(rows.above[i], previous.above[i]),
+                                         get_distance(rows.current[i], previous.current[i]),
+                                         get_distance(rows.below[i], previous.below[i])});
+        dst[i] = motion > threshold ? static_cast<uint8_t>((rows.above[i] + rows.below[i] + 1) >> 1)
+                                    : rows.current[i];
+    }
+}
+
+cpu_deinterlacer_t::cpu_deinterlacer_t(size_t num_threads) noexcept(false) : workers{num_threads} {
+}
+
+void cpu_deinterlacer_t::set_interlace_mode(interlace_mode_t value) noexcept {
+    interlace = value;
+}
+
+void cpu_deinterlacer_t::set_mode(deinterlace_mode_t value, bool _double_rate) noexcept {
+    mode = value;
+    double_rate = _double_rate;
+    if (is_uncompressed(input_format))
+        output_format = derive(input_format);
+}
+
+video_format_t cpu_deinterlacer_t::derive(const video_format_t& input) const noexcept {
+    video_format_t output = input;
+    if (double_rate)
+        output.fps_num *= 2; // 0 stays unknown
+    return output;
+}
+
+transform_result_t cpu_deinterlacer_t::set_input_format(const video_format_t& format) noexcept {
+    if (format.pixel != pixel_format_t::nv12 && format.pixel != pixel_format_t::i420)
+        return transform_result_t::invalid_format;
+    if (is_uncompressed(format) == false)
+        return transform_result_t::invalid_format;
+    if (format.same_layout(input_format) == false) {
+        pool = nullptr; // `process_input` makes a new one
+        previous = {};
+    }
+    input_format = format;
+    output_format = derive(format);
+    return transform_result_t::ok;
+}
+
+transform_result_t cpu_deinterlacer_t::set_output_format(const video_format_t& format) noexcept {
+    if (is_uncompressed(input_format) == false)
+        return transform_result_t::not_ready;
+    if (format.same_layout(input_format) == false)
+        return transform_result_t::invalid_format;
+    return transform_result_t::ok;
+}
+
+video_format_t cpu_deinterlacer_t::get_input_format() const noexcept {
+    return input_format;
+}
+
+video_format_t cpu_deinterlacer_t::get_output_format() const noexcept {
+    return output_format;
+}
+
+bool cpu_deinterlacer_t::is_interlaced(const video_frame_t& input) const noexcept {
+    switch (interlace) {
+    case interlace_mode_t::upper_first:
+    case interlace_mode_t::lower_first:
+        return true;
+    case interlace_mode_t::mixed:
+        return input.flags & frame_flag_interlaced;
+    case interlace_mode_t::progressive:
+    default:
+        return false;
+    }
+}
+
+transform_result_t cpu_deinterlacer_t::process_input(const video_frame_t& input) noexcept {
+    if (is_uncompressed(input_format) == false)
+        return transform_result_t::not_ready;
+    if (outputs.empty() == false)
+        return transform_result_t::not_accepting;
+    if (input.format.same_layout(input_format) == false || static_cast<bool>(input) == false)
+        return transform_result_t::invalid_format;
+    if (input.flags & frame_flag_discontinuity)
+        previous = {};
+
+    // the duration of a field
+    int64_t duration = input.duration;
+    if (duration <= 0 && input_format.fps_num)
+        duration = 10'000'000 * static_cast<int64_t>(input_format.fps_den) / input_format.fps_num;
+    const uint32_t num_fields = double_rate ? 2 : 1;
+    duration /= num_fields;
+
+    const bool interlaced = is_interlaced(input);
+    const bool top_first = interlace == interlace_mode_t::upper_first ||
+                           (interlace == interlace_mode_t::mixed && (input.flags & frame_flag_bottom_first) == 0);
+    try {
+        for (uint32_t field = 0; field < num_fields; ++field) {
+            video_frame_t& output = outputs.emplace_back();
+            if (interlaced && mode != deinterlace_mode_t::weave) {
+                output = make_field(input, field, top_first);
+                output.flags = input.flags & ~(frame_flag_interlaced | frame_flag_bottom_first);
+            } else {
+                output = input; // shares the pixels
+            }
+            output.format = output_format;
+            output.timestamp = input.timestamp + field * duration;
+            output.duration = duration;
+            if (field)
+                output.flags &= ~(frame_flag_discontinuity | frame_flag_keyframe);
+        }
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "cpu_deinterlacer_t", ex.what());
+        outputs.clear();
+        return transform_result_t::failed;
+    }
+    previous = input;
+    return transform_result_t::ok;
+}
+
+video_frame_t cpu_deinterlacer_t::make_field(const video_frame_t& input, uint32_t field, bool top_first) noexcept(
+    false) {
+    if (pool == nullptr)
+        pool = std::make_unique<frame_pool_t>(input_format);
+    video_frame_t output = pool->acquire();
+    source = &input;
+    reference = mode == deinterlace_mode_t::adaptive && previous ? &previous : nullptr;
+    target = &output;
+    kept = (top_first ? 0u : 1u) ^ field;
+    const uint32_t num_bands = (input_format.height + band_size - 1) / band_size;
+    workers.run(num_bands, [this](size_t band, size_t) { process_band(static_cast<uint32_t>(band)); });
+    source = reference = nullptr;
+    target = nullptr;
+    return output;
+}
+
+transform_result_t cpu_deinterlacer_t::process_output(video_frame_t& output) noexcept {
+    if (outputs.empty())
+        return transform_result_t::need_more_input;
+    output = std::move(outputs.front());
+    outputs.pop_front();
+    return transform_result_t::ok;
+}
+
+void cpu_deinterlacer_t::drain() noexcept {
+    previous = {}; // the next stream doesn't move from this one
+}
+
+void cpu_deinterlacer_t::flush() noexcept {
+    outputs.clear();
+    previous = {};
+}
+
+void cpu_deinterlacer_t::process_band(uint32_t band) noexcept {
+    for (uint32_t p = 0; p < get_plane_count(input_format.pixel); ++p) {
+        const uint32_t shift = p ? 1 : 0;
+        const plane_extent_t extent = get_plane_extent(input_format, p);
+        const video_plane_t& src = source->planes[p];
+        const video_plane_t& dst = target->planes[p];
+        const auto at = [](const video_plane_t& plane, uint32_t y) {
+            return plane.data + static_cast<size_t>(y) * plane.stride;
+        };
+        const uint32_t top = band * (band_size >> shift);
+        const uint32_t bottom = std::min(top + (band_size >> shift), extent.rows);
+        for (uint32_t y = top; y < bottom; ++y) {
+            // the lines of the kept field around the missing one. The edges repeat the one they have
+            const uint32_t above = y ? y - 1 : y + 1;
+            const uint32_t below = y + 1 < extent.rows ? y + 1 : y - 1;
+            if ((y & 1) == kept || above >= extent.rows || below >= extent.rows) {
+                std::memcpy(at(dst, y), at(src, y), extent.row_bytes);
+            } else if (reference == nullptr) {
+                interpolate_row(at(src, above), at(src, below), extent.row_bytes, at(dst, y));
+            } else {
+                const video_plane_t& ref = reference->planes[p];
+                adapt_row({at(src, above), at(src, y), at(src, below)}, {at(ref, above), at(ref, y), at(ref, below)},
+                          motion_threshold, extent.row_bytes, at(dst, y));
+            }
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <deque>
+
+#include "pipeline.hpp"
+#include "video_transform.hpp"
+
+/// @brief Counterpart of `MFVideoInterlaceMode` (`MF_MT_INTERLACE_MODE`)
+enum class interlace_mode_t : uint32_t {
+    progressive = 2, // MFVideoInterlace_Progressive
+    upper_first = 3, // MFVideoInterlace_FieldInterleavedUpperFirst
+    lower_first = 4, // MFVideoInterlace_FieldInterleavedLowerFirst
+    mixed = 7,       // MFVideoInterlace_MixedInterlaceOrProgressive. `frame_flag_interlaced` of each frame tells
+};
+
+enum class deinterlace_mode_t : uint32_t {
+    weave = 0,    // the fields as they are. The frames pass without a copy
+    bob = 1,      // each field alone. The missing lines are the average of the lines around them
+    adaptive = 2, // weave where the picture is still, bob where it moves
+};
+
+/// @brief The lines around a missing line of a plane
+struct field_rows_t final {
+    const uint8_t* above = nullptr;   // of the field which is kept
+    const uint8_t* current = nullptr; // of the other field. It is replaced
+    const uint8_t* below = nullptr;
+};
+
+/// @brief `dst = (above + below + 1) / 2` for each byte. The missing line of bob
+void interpolate_row(const uint8_t* above, const uint8_t* below, uint32_t count, uint8_t* dst) noexcept;
+
+/**
+ * @brief The missing line of the motion adaptive mode. A byte moves if any of `above`, `current` and `below` is
+ *        different from the `previous` frame by more than the `threshold`. It takes `interpolate_row` then.
+ *        The others keep the `current`
+ * @param count in bytes. The lines have the same length
+ */
+void adapt_row(const field_rows_t& rows, const field_rows_t& previous, uint8_t threshold, uint32_t count,
+               uint8_t* dst) noexcept;
+
+/**
+ * @brief Deinterlaces NV12 and I420 frames. Each plane is processed by rows, so the chroma of 4:2:0 takes the field
+ *        of its row like the luma. The planes are split in bands of rows and shared by the workers
+ *
+ * @code
+ * auto deinterlacer = std::make_shared<cpu_deinterlacer_t>(2);
+ * deinterlacer->set_interlace_mode(interlace_mode_t::upper_first); // MF_MT_INTERLACE_MODE of the source
+ * deinterlacer->set_mode(deinterlace_mode_t::adaptive, true);      // 1080i30 to 1080p60
+ * (void)deinterlacer->set_input_format(input_format);
+ * pipeline.add(deinterlacer, "cpu_deinterlacer_t"); // after the decoder, before the scaler
+ * @endcode
+ *
+ * @note `double_rate` makes a frame of each field. The second one is half of the duration later.
+ *       The progressive frames of the mixed content pass without a copy
+ * @note The adaptive mode holds the last input to find the motion. The first frame after `flush` or
+ *       `frame_flag_discontinuity` takes bob
+ */
+class cpu_deinterlacer_t final : public video_transform_t {
+    video_format_t input_format{};
+    video_format_t output_format{};
+    interlace_mode_t interlace = interlace_mode_t::upper_first;
+    deinterlace_mode_t mode = deinterlace_mode_t::adaptive;
+    bool double_rate = false;
+    std::unique_ptr<frame_pool_t> pool{};
+    std::deque<video_frame_t> outputs{};
+    video_frame_t previous{}; // the last input. The reference of the motion
+
+    // the frame in progress. Set before the workers are woken
+    const video_frame_t* source = nullptr;
+    const video_frame_t* reference = nullptr; // `nullptr` for bob
+    video_frame_t* target = nullptr;
+    uint32_t kept = 0; // the parity of the rows which are copied. 0 for the upper field
+    band_pool_t workers;
+
+  public:
+    /// @param num_threads 0 for `std::thread::hardware_concurrency`, 1 for no worker
+    explicit cpu_deinterlacer_t(size_t num_threads = 1) noexcept(false);
+    cpu_deinterlacer_t(const cpu_deinterlacer_t&) = delete;
+    cpu_deinterlacer_t(cpu_deinterlacer_t&&) = delete;
+    cpu_deinterlacer_t& operator=(const cpu_deinterlacer_t&) = delete;
+    cpu_deinterlacer_t& operator=(cpu_deinterlacer_t&&) = delete;
+
+    /// @note Before the first `process_input`. The default is `upper_first`
+    void set_interlace_mode(interlace_mode_t value) noexcept;
+    /**
+     * @param double_rate a frame for each field. The frame rate of the output is twice of the input
+     * @note Before the first `process_input`. The default is `adaptive` without `double_rate`
+     */
+    void set_mode(deinterlace_mode_t value, bool double_rate) noexcept;
+
+    /// @note NV12 or I420
+    transform_result_t set_input_format(const video_format_t& format) noexcept override;
+    /// @note Only the layout of the input. The frame rate follows `set_mode`
+    transform_result_t set_output_format(const video_format_t& format) noexcept override;
+    video_format_t get_input_format() const noexcept override;
+    video_format_t get_output_format() const noexcept override;
+
+    /// @return `not_accepting` while the outputs of the last input are not taken
+    transform_result_t process_input(const video_frame_t& input) noexcept override;
+    transform_result_t process_output(video_frame_t& output) noexcept override;
+    void drain() noexcept override;
+    /// @brief Discard the outputs and the reference of the motion
+    void flush() noexcept override;
+
+  private:
+    [[nodiscard]] video_format_t derive(const video_format_t& input) const noexcept;
+    [[nodiscard]] bool is_interlaced(const video_frame_t& input) const noexcept;
+    /// @throws std::bad_alloc
+    [[nodiscard]] video_frame_t make_field(const video_frame_t& input, uint32_t field, bool top_first) noexcept(false);
+    void process_band(uint32_t band) noexcept;
+};
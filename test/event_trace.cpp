@@ -0,0 +1,257 @@
+#include "event_trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+std::atomic_bool trace_active{false};
+
+namespace {
+
+struct trace_file_header_t final {
+    char magic[4]{'M', 'F', 'T', 'R'};
+    uint16_t version = 1;
+    uint16_t record_size = sizeof(trace_record_t);
+    uint32_t num_tracks = 0;
+    uint32_t reserved = 0;
+    uint64_t num_records = 0;
+};
+
+/// @brief Overwrites the oldest record when full. Only the owner thread writes
+struct trace_ring_t final {
+    std::unique_ptr<trace_record_t[]> records;
+    const size_t mask;
+    const uint32_t thread;
+    std::atomic<uint64_t> count{0};
+
+  public:
+    trace_ring_t(size_t capacity, uint32_t _thread) noexcept(false)
+        : records{std::make_unique<trace_record_t[]>(capacity)}, mask{capacity - 1}, thread{_thread} {
+    }
+};
+
+struct trace_session_t final {
+    std::mutex mtx{};
+    std::vector<std::shared_ptr<trace_ring_t>> rings{};
+    std::vector<std::string> tracks{};
+    size_t capacity = 0;
+    std::chrono::steady_clock::time_point epoch{};
+    std::atomic<uint64_t> generation{0};
+    std::atomic<uint32_t> next_thread{0};
+};
+
+trace_session_t& get_session() noexcept {
+    static trace_session_t session{};
+    return session;
+}
+
+struct thread_ring_t final {
+    std::shared_ptr<trace_ring_t> ring{};
+    uint64_t generation = 0;
+};
+thread_local thread_ring_t thread_ring{};
+
+trace_ring_t* acquire_ring(trace_session_t& session) noexcept {
+    const uint64_t generation = session.generation.load(std::memory_order_acquire);
+    if (thread_ring.ring && thread_ring.generation == generation)
+        return thread_ring.ring.get();
+    try {
+        std::lock_guard lck{session.mtx};
+        auto ring = std::make_shared<trace_ring_t>(session.capacity, session.next_thread++);
+        session.rings.emplace_back(ring);
+        thread_ring.ring = std::move(ring);
+        thread_ring.generation = generation;
+        return thread_ring.ring.get();
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+size_t round_up_pow2(size_t value) noexcept {
+    size_t result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+const char* get_name(trace_event_t kind) noexcept {
+    switch (kind) {
+    case trace_event_t::input_accepted:
+        return "input_accepted";
+    case trace_event_t::output_produced:
+        return "output_produced";
+    case trace_event_t::need_more_input:
+        return "need_more_input";
+    case trace_event_t::stream_change:
+        return "stream_change";
+    case trace_event_t::drain_begin:
+    case trace_event_t::drain_end:
+        return "drain";
+    case trace_event_t::failed:
+        return "failed";
+    case trace_event_t::input_skipped:
+        return "input_skipped";
+    default:
+        return "unknown";
+    }
+}
+
+void write_json_string(std::ostream& out, std::string_view txt) {
+    out << '"';
+    for (char c : txt) {
+        if (c == '"' || c == '\\')
+            out << '\\';
+        if (static_cast<unsigned char>(c) < 0x20)
+            continue;
+        out << c;
+    }
+    out << '"';
+}
+
+} // namespace
+
+void trace_start(size_t capacity) noexcept(false) {
+    auto& session = get_session();
+    std::lock_guard lck{session.mtx};
+    session.rings.clear();
+    session.capacity = round_up_pow2(std::max<size_t>(capacity, 2));
+    session.epoch = std::chrono::steady_clock::now();
+    session.next_thread = 0;
+    session.generation.fetch_add(1, std::memory_order_release);
+    trace_active.store(true, std::memory_order_release);
+}
+
+void trace_stop() noexcept {
+    trace_active.store(false, std::memory_order_release);
+}
+
+uint16_t trace_register_track(std::string_view name) noexcept(false) {
+    auto& session = get_session();
+    std::lock_guard lck{session.mtx};
+    auto it = std::find(session.tracks.begin(), session.tracks.end(), name);
+    if (it != session.tracks.end())
+        return static_cast<uint16_t>(it - session.tracks.begin());
+    if (session.tracks.size() == UINT16_MAX)
+        throw std::length_error{"trace_register_track"};
+    session.tracks.emplace_back(name);
+    return static_cast<uint16_t>(session.tracks.size() - 1);
+}
+
+void trace_emit(trace_event_t kind, uint16_t track, uint32_t stream, int64_t sample_time, uint32_t value) noexcept {
+    if (trace_enabled() == false)
+        return;
+    auto& session = get_session();
+    trace_ring_t* ring = acquire_ring(session);
+    if (ring == nullptr)
+        return;
+    const uint64_t index = ring->count.load(std::memory_order_relaxed);
+    trace_record_t& record = ring->records[index & ring->mask];
+    record.time = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - session.epoch).count());
+    record.sample_time = sample_time;
+    record.thread = ring->thread;
+    record.track = track;
+    record.stream = static_cast<uint8_t>(stream);
+    record.kind = kind;
+    record.value = value;
+    ring->count.store(index + 1, std::memory_order_release);
+}
+
+size_t trace_dump(std::ostream& out) noexcept(false) {
+    auto& session = get_session();
+    std::vector<trace_record_t> records{};
+    std::vector<std::string> tracks{};
+    {
+        std::lock_guard lck{session.mtx};
+        tracks = session.tracks;
+        for (const auto& ring : session.rings) {
+            const uint64_t count = ring->count.load(std::memory_order_acquire);
+            const uint64_t first = count > ring->mask ? count - ring->mask - 1 : 0;
+            for (uint64_t i = first; i < count; ++i)
+                records.emplace_back(ring->records[i & ring->mask]);
+        }
+    }
+    std::stable_sort(records.begin(), records.end(),
+                     [](const trace_record_t& lhs, const trace_record_t& rhs) { return lhs.time < rhs.time; });
+
+    trace_file_header_t header{};
+    header.num_tracks = static_cast<uint32_t>(tracks.size());
+    header.num_records = records.size();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& name : tracks) {
+        const auto length = static_cast<uint16_t>(name.length());
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(name.data(), length);
+    }
+    out.write(reinterpret_cast<const char*>(records.data()),
+              static_cast<std::streamsize>(records.size() * sizeof(trace_record_t)));
+    return records.size();
+}
+
+size_t trace_dump(const std::filesystem::path& fpath) noexcept(false) {
+    std::ofstream fout{fpath, std::ios::binary | std::ios::trunc};
+    if (fout.is_open() == false)
+        throw std::runtime_error{"failed to open the trace file"};
+    return trace_dump(fout);
+}
+
+size_t trace_to_chrome_json(std::istream& in, std::ostream& out) noexcept(false) {
+    trace_file_header_t header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, "MFTR", 4) != 0)
+        throw std::runtime_error{"not a trace file"};
+    if (header.version != 1 || header.record_size != sizeof(trace_record_t))
+        throw std::runtime_error{"unsupported trace version"};
+    std::vector<std::string> tracks(header.num_tracks);
+    for (auto& name : tracks) {
+        uint16_t length = 0;
+        in.read(reinterpret_cast<char*>(&length), sizeof(length));
+        name.resize(length);
+        in.read(name.data(), length);
+    }
+
+    // one process row per track. the threads are shown under each track
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << i << ",\"args\":{\"name\":";
+        write_json_string(out, tracks[i]);
+        out << "}}";
+        first = false;
+    }
+    size_t count = 0;
+    trace_record_t record{};
+    while (in.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        const char* phase = "i";
+        if (record.kind == trace_event_t::drain_begin)
+            phase = "B";
+        else if (record.kind == trace_event_t::drain_end)
+            phase = "E";
+        out << (first ? "" : ",") << "\n{\"name\":\"" << get_name(record.kind) << "\",\"ph\":\"" << phase
+            << "\",\"ts\":" << record.time / 1000 << '.' << (record.time % 1000) / 100 << ",\"pid\":" << record.track
+            << ",\"tid\":" << record.thread;
+        if (phase[0] == 'i')
+            out << ",\"s\":\"t\"";
+        out << ",\"args\":{\"stream\":" << static_cast<uint32_t>(record.stream)
+            << ",\"sample_time\":" << record.sample_time << ",\"value\":" << record.value << "}}";
+        first = false;
+        ++count;
+    }
+    out << "\n]}\n";
+    return count;
+}
+
+size_t trace_to_chrome_json(const std::filesystem::path& input, const std::filesystem::path& output) noexcept(false) {
+    std::ifstream fin{input, std::ios::binary};
+    if (fin.is_open() == false)
+        throw std::runtime_error{"failed to open the trace file"};
+    std::ofstream fout{output, std::ios::trunc};
+    if (fout.is_open() == false)
+        throw std::runtime_error{"failed to open the json file"};
+    return trace_to_chrome_json(fin, fout);
+}
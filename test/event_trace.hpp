@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <string_view>
+
+/**
+ * @brief Events of the `IMFTransform` processing loop
+ * @see https://docs.microsoft.com/en-us/windows/win32/medfound/basic-mft-processing-model
+ */
+enum class trace_event_t : uint8_t {
+    unknown = 0,
+    input_accepted = 1,  // ProcessInput succeeded
+    output_produced = 2, // ProcessOutput returned S_OK
+    need_more_input = 3, // MF_E_TRANSFORM_NEED_MORE_INPUT
+    stream_change = 4,   // MF_E_TRANSFORM_STREAM_CHANGE
+    drain_begin = 5,     // MFT_MESSAGE_COMMAND_DRAIN
+    drain_end = 6,       // ProcessOutput returned MF_E_TRANSFORM_NEED_MORE_INPUT after the drain
+    failed = 7,          // `value` holds the HRESULT
+    input_skipped = 8,   // QoS dropped the late input
+};
+
+/// @brief Fixed size binary record. Written as-is by `trace_dump`
+struct trace_record_t final {
+    uint64_t time = 0;        // nanoseconds since `trace_start`
+    int64_t sample_time = 0;  // unit 100-nanosecond
+    uint32_t thread = 0;      // small index assigned per thread
+    uint16_t track = 0;       // `trace_register_track`
+    uint8_t stream = 0;       // stream id of the transform
+    trace_event_t kind = trace_event_t::unknown;
+    uint32_t value = 0;       // HRESULT or event specific value
+    uint32_t reserved = 0;
+};
+static_assert(sizeof(trace_record_t) == 32);
+
+extern std::atomic_bool trace_active;
+
+/**
+ * @brief Start recording. Each thread writes to its own ring which keeps the latest `capacity` records
+ * @note Records of the previous session are discarded
+ */
+void trace_start(size_t capacity = 1 << 16) noexcept(false);
+void trace_stop() noexcept;
+
+[[nodiscard]] inline bool trace_enabled() noexcept {
+    return trace_active.load(std::memory_order_relaxed);
+}
+
+/// @return id for `trace_emit`. Same name returns the same id
+uint16_t trace_register_track(std::string_view name) noexcept(false);
+
+/// @note Costs a relaxed load when the trace is not started
+void trace_emit(trace_event_t kind, uint16_t track, uint32_t stream, int64_t sample_time,
+                uint32_t value = 0) noexcept;
+
+/**
+ * @brief Write the recorded tracks and records(sorted by time) in binary
+ * @note Call after the producer threads are finished or the trace is stopped
+ * @return count of the written records
+ */
+size_t trace_dump(std::ostream& out) noexcept(false);
+size_t trace_dump(const std::filesystem::path& fpath) noexcept(false);
+
+/**
+ * @brief Convert the output of `trace_dump` to Chrome Trace Event JSON. Perfetto can open it too
+ * @see https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+ * @throws std::runtime_error the input is not a trace file
+ */
+size_t trace_to_chrome_json(std::istream& in, std::ostream& out) noexcept(false);
+size_t trace_to_chrome_json(const std::filesystem::path& input, const std::filesystem::path& output) noexcept(false);
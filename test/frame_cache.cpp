@@ -0,0 +1,167 @@
+#include "frame_cache.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <stdexcept>
+
+frame_cache_t::frame_cache_t(size_t _budget) noexcept : budget{_budget} {
+}
+
+bool frame_cache_t::insert(uint64_t source, int64_t start, const video_frame_t& frame) noexcept(false) {
+    const size_t size = frame.size_bytes();
+    if (size > budget)
+        return false;
+    std::lock_guard lck{mtx};
+    gop_iterator_t gop{};
+    if (auto it = starts.find({source, start}); it != starts.end()) {
+        gop = it->second;
+        gops.splice(gops.begin(), gops, gop);
+    } else {
+        gop = gops.emplace(gops.begin(), gop_t{source, start});
+        starts.emplace(std::make_pair(source, start), gop);
+    }
+    // the timestamp may be in the other GOP after a seek into the middle of it
+    if (auto it = index.find({source, frame.timestamp}); it != index.end()) {
+        const gop_iterator_t owner = it->second;
+        const size_t replaced = owner->frames.at(frame.timestamp).size_bytes();
+        owner->bytes -= replaced;
+        counters.bytes -= replaced;
+        --counters.frames;
+        owner->frames.erase(frame.timestamp);
+        index.erase(it);
+        if (owner->frames.empty() && owner != gop) {
+            starts.erase({owner->source, owner->start});
+            gops.erase(owner);
+        }
+    }
+    gop->frames.emplace(frame.timestamp, frame);
+    gop->bytes += size;
+    index.emplace(std::make_pair(source, frame.timestamp), gop);
+    counters.bytes += size;
+    ++counters.frames;
+    // the least recently used GOPs go first. the GOP of this frame is the last one to go
+    while (counters.bytes > budget) {
+        const gop_iterator_t last = std::prev(gops.end());
+        counters.evicted += last->frames.size();
+        remove(last);
+    }
+    return index.count({source, frame.timestamp}) > 0;
+}
+
+bool frame_cache_t::find(uint64_t source, int64_t timestamp, video_frame_t& frame) noexcept {
+    std::lock_guard lck{mtx};
+    auto it = index.find({source, timestamp});
+    if (it == index.end()) {
+        ++counters.misses;
+        return false;
+    }
+    ++counters.hits;
+    gops.splice(gops.begin(), gops, it->second);
+    frame = it->second->frames.at(timestamp);
+    return true;
+}
+
+void frame_cache_t::remove(gop_iterator_t gop) noexcept {
+    for (const auto& [timestamp, frame] : gop->frames)
+        index.erase({gop->source, timestamp});
+    starts.erase({gop->source, gop->start});
+    counters.bytes -= gop->bytes;
+    counters.frames -= gop->frames.size();
+    gops.erase(gop);
+}
+
+void frame_cache_t::erase(uint64_t source) noexcept {
+    std::lock_guard lck{mtx};
+    for (auto it = gops.begin(); it != gops.end();) {
+        auto next = std::next(it);
+        if (it->source == source)
+            remove(it);
+        it = next;
+    }
+}
+
+void frame_cache_t::clear() noexcept {
+    std::lock_guard lck{mtx};
+    gops.clear();
+    index.clear();
+    starts.clear();
+    counters.frames = counters.bytes = 0;
+}
+
+size_t frame_cache_t::capacity() const noexcept {
+    return budget;
+}
+
+frame_cache_t::stats_t frame_cache_t::stats() const noexcept {
+    std::lock_guard lck{mtx};
+    stats_t result = counters;
+    result.gops = gops.size();
+    return result;
+}
+
+frame_cache_transform_t::frame_cache_transform_t(std::shared_ptr<frame_cache_t> _cache, uint64_t _source) noexcept(
+    false)
+    : cache{std::move(_cache)}, source{_source} {
+    if (cache == nullptr)
+        throw std::invalid_argument{"frame_cache_transform_t: nullptr"};
+}
+
+transform_result_t frame_cache_transform_t::set_input_format(const video_format_t& _format) noexcept {
+    if (is_uncompressed(_format) == false)
+        return transform_result_t::invalid_format;
+    format = _format;
+    return transform_result_t::ok;
+}
+
+transform_result_t frame_cache_transform_t::set_output_format(const video_format_t& _format) noexcept {
+    if (is_uncompressed(format) == false)
+        return transform_result_t::not_ready;
+    if (_format.same_layout(format) == false)
+        return transform_result_t::invalid_format;
+    return transform_result_t::ok;
+}
+
+video_format_t frame_cache_transform_t::get_input_format() const noexcept {
+    return format;
+}
+
+video_format_t frame_cache_transform_t::get_output_format() const noexcept {
+    return format;
+}
+
+transform_result_t frame_cache_transform_t::process_input(const video_frame_t& input) noexcept {
+    if (is_uncompressed(format) == false)
+        return transform_result_t::not_ready;
+    if (pending)
+        return transform_result_t::not_accepting;
+    if (input.keyframe() || gop == INT64_MIN)
+        gop = input.timestamp;
+    try {
+        cache->insert(source, gop, input);
+    } catch (const std::exception& ex) {
+        spdlog::warn("{}: {}", "frame_cache_transform_t", ex.what()); // the frame still goes downstream
+    }
+    pending = input;
+    return transform_result_t::ok;
+}
+
+transform_result_t frame_cache_transform_t::process_output(video_frame_t& output) noexcept {
+    if (!pending)
+        return transform_result_t::need_more_input;
+    output = std::move(pending);
+    pending = {};
+    return transform_result_t::ok;
+}
+
+void frame_cache_transform_t::drain() noexcept {
+    // no latency. the pending input is returned by the next `process_output`
+}
+
+void frame_cache_transform_t::flush() noexcept {
+    pending = {};
+    gop = INT64_MIN;
+}
+
+bool frame_cache_transform_t::is_skippable(const video_frame_t& input) noexcept {
+    return input.keyframe() == false;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "video_transform.hpp"
+
+/**
+ * @brief Decoded frames by (source, timestamp) in a byte budget. Scrubbing the same region doesn't decode again.
+ *        The frames are shared by reference count, never copied.
+ *        The eviction is LRU of the GOPs. A GOP is evicted as a whole because a frame without the GOP's other
+ *        frames still needs the decode from the keyframe
+ *
+ * @code
+ * video_frame_t frame{};
+ * if (cache.find(source, target, frame) == false) {
+ *     pipeline.seek(target); // the decoder's outputs are inserted by `frame_cache_transform_t`
+ *     // ...
+ * }
+ * @endcode
+ *
+ * @note The cached frames keep their pooled buffers. The pools allocate more while the frames are cached
+ * @note Thread safe
+ */
+class frame_cache_t final {
+  public:
+    struct stats_t final {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evicted = 0; // frames removed for the budget
+        size_t frames = 0;
+        size_t gops = 0;
+        size_t bytes = 0;
+
+      public:
+        [[nodiscard]] double hit_rate() const noexcept {
+            const size_t total = hits + misses;
+            return total ? static_cast<double>(hits) / total : 0.0;
+        }
+    };
+
+  private:
+    struct gop_t final {
+        uint64_t source = 0;
+        int64_t start = 0; // timestamp of the keyframe
+        std::map<int64_t, video_frame_t> frames{};
+        size_t bytes = 0;
+    };
+    using gop_iterator_t = std::list<gop_t>::iterator;
+
+    mutable std::mutex mtx{};
+    const size_t budget;
+    std::list<gop_t> gops{}; // the front is the most recently used
+    std::map<std::pair<uint64_t, int64_t>, gop_iterator_t> index{}; // (source, timestamp) of the frames
+    std::map<std::pair<uint64_t, int64_t>, gop_iterator_t> starts{}; // (source, start) of the GOPs
+    stats_t counters{};
+
+  public:
+    /// @param budget bytes of the frames. See `video_frame_t::size_bytes`
+    explicit frame_cache_t(size_t budget) noexcept;
+    frame_cache_t(const frame_cache_t&) = delete;
+    frame_cache_t(frame_cache_t&&) = delete;
+    frame_cache_t& operator=(const frame_cache_t&) = delete;
+    frame_cache_t& operator=(frame_cache_t&&) = delete;
+    ~frame_cache_t() noexcept = default;
+
+    /**
+     * @brief Add the frame to the GOP which starts at `gop`. The GOP becomes the most recently used
+     * @return false if the frame is not kept. The frame or its GOP is larger than the budget
+     * @note The frame of the same timestamp is replaced
+     */
+    bool insert(uint64_t source, int64_t gop, const video_frame_t& frame) noexcept(false);
+    /// @brief The GOP of the frame becomes the most recently used on hit
+    [[nodiscard]] bool find(uint64_t source, int64_t timestamp, video_frame_t& frame) noexcept;
+    /// @brief Remove the frames of the `source`. For example, the file is closed
+    void erase(uint64_t source) noexcept;
+    void clear() noexcept;
+
+    [[nodiscard]] size_t capacity() const noexcept;
+    [[nodiscard]] stats_t stats() const noexcept;
+
+  private:
+    void remove(gop_iterator_t gop) noexcept;
+};
+
+/**
+ * @brief Puts the decoder's outputs into `frame_cache_t` on the way downstream. Place it right after the decoder.
+ *        The GOP of a frame starts at the last keyframe, or the first frame after `flush` when the decoder's driver
+ *        discarded the frames before the seek target. The frames pass without copy and the formats are not changed
+ */
+class frame_cache_transform_t final : public video_transform_t {
+    const std::shared_ptr<frame_cache_t> cache;
+    const uint64_t source;
+    video_format_t format{};
+    video_frame_t pending{};
+    int64_t gop = INT64_MIN; // the start of the current GOP. INT64_MIN before the first frame
+
+  public:
+    /// @param source identifies the stream in the `cache`. For example, a hash of the file path
+    frame_cache_transform_t(std::shared_ptr<frame_cache_t> cache, uint64_t source) noexcept(false);
+
+    /// @brief Any uncompressed format. The output format is the same
+    transform_result_t set_input_format(const video_format_t& format) noexcept override;
+    /// @return `invalid_format` if the `format` is not the input format
+    transform_result_t set_output_format(const video_format_t& format) noexcept override;
+    video_format_t get_input_format() const noexcept override;
+    video_format_t get_output_format() const noexcept override;
+
+    transform_result_t process_input(const video_frame_t& input) noexcept override;
+    transform_result_t process_output(video_frame_t& output) noexcept override;
+    void drain() noexcept override;
+    /// @brief The next GOP starts at the next keyframe. For the seek
+    void flush() noexcept override;
+    /// @brief Not the keyframes. They start the GOPs
+    bool is_skippable(const video_frame_t& input) noexcept override;
+};
@@ -0,0 +1,412 @@
+#include "frame_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "simd.hpp"
+
+namespace {
+
+constexpr uint32_t group_size = 16;
+constexpr uint32_t max_tile_size = 1024;
+constexpr char magic[4]{'m', '0', 'f', 'c'};
+constexpr uint32_t version = 1;
+
+/// @brief The region of a tile in a plane. `x` and `width` in bytes
+struct tile_area_t final {
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t step = 1; // distance of the samples of the same channel
+};
+
+tile_area_t get_tile_area(const video_format_t& format, uint32_t plane, uint32_t tile_size, uint32_t tiles_x,
+                          uint32_t tiles_y, uint32_t tile_x, uint32_t tile_y) noexcept {
+    const plane_extent_t extent = get_plane_extent(format, plane);
+    const bool rgb = format.pixel == pixel_format_t::rgb32 || format.pixel == pixel_format_t::argb32;
+    const uint32_t subsample = plane ? 2 : 1;
+    tile_area_t area{};
+    area.step = rgb ? 4 : (format.pixel == pixel_format_t::nv12 && plane == 1 ? 2 : 1);
+    // the tiles of the planes cover the same pixels. the last ones take the rest of the odd sizes
+    const uint32_t tile_width = tile_size / subsample * area.step;
+    const uint32_t tile_height = tile_size / subsample;
+    area.x = tile_x * tile_width;
+    area.y = tile_y * tile_height;
+    area.width = tile_x + 1 == tiles_x ? extent.row_bytes - area.x : tile_width;
+    area.height = tile_y + 1 == tiles_y ? extent.rows - area.y : tile_height;
+    return area;
+}
+
+uint32_t get_tile_count(uint32_t length, uint32_t tile_size) noexcept {
+    return (length + tile_size - 1) / tile_size;
+}
+
+/// @brief The residuals of a row. Predicted by the row above
+void subtract_rows(const uint8_t* row, const uint8_t* above, uint8_t* residual, uint32_t width) noexcept {
+    uint32_t x = 0;
+#if defined(MEDIA0_SSE2)
+    for (; x + 16 <= width; x += 16) {
+        const __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        const __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(residual + x), _mm_sub_epi8(current, top));
+    }
+#elif defined(MEDIA0_NEON)
+    for (; x + 16 <= width; x += 16)
+        vst1q_u8(residual + x, vsubq_u8(vld1q_u8(row + x), vld1q_u8(above + x)));
+#endif
+    for (; x < width; ++x)
+        residual[x] = static_cast<uint8_t>(row[x] - above[x]);
+}
+
+void add_rows(const uint8_t* residual, const uint8_t* above, uint8_t* row, uint32_t width) noexcept {
+    uint32_t x = 0;
+#if defined(MEDIA0_SSE2)
+    for (; x + 16 <= width; x += 16) {
+        const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(residual + x));
+        const __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), _mm_add_epi8(value, top));
+    }
+#elif defined(MEDIA0_NEON)
+    for (; x + 16 <= width; x += 16)
+        vst1q_u8(row + x, vaddq_u8(vld1q_u8(residual + x), vld1q_u8(above + x)));
+#endif
+    for (; x < width; ++x)
+        row[x] = static_cast<uint8_t>(residual[x] + above[x]);
+}
+
+/// @brief Count of the bits up to the highest 1 of the bytes
+struct bit_length_t final {
+    uint8_t values[256]{};
+
+  public:
+    constexpr bit_length_t() noexcept {
+        for (uint32_t m = 1; m < 256; ++m)
+            values[m] = static_cast<uint8_t>(values[m / 2] + 1);
+    }
+};
+constexpr bit_length_t bit_length{};
+
+#if defined(MEDIA0_SSE2)
+/// @brief Transpose the 8x8 bit matrix in each 64 bit lane. The byte `i` is the row `i`, the bit `k` is the column `k`
+__m128i transpose_bits(__m128i x) noexcept {
+    __m128i t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 7)), _mm_set1_epi64x(0x00AA00AA00AA00AA));
+    x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 7)));
+    t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 14)), _mm_set1_epi64x(0x0000CCCC0000CCCC));
+    x = _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 14)));
+    t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 28)), _mm_set1_epi64x(0x00000000F0F0F0F0));
+    return _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi64(t, 28)));
+}
+#endif
+
+/**
+ * @brief Zigzag map 16 residuals and split them into bit planes. The bytes `2k` and `2k + 1` of `planes` hold the
+ *        bit `k` of the samples 0-7 and 8-15
+ * @return the width of the group. The planes above it are 0
+ */
+uint32_t pack_group(const uint8_t* residual, uint8_t planes[16]) noexcept {
+#if defined(MEDIA0_SSE2)
+    const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(residual));
+    const __m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), value);
+    const __m128i mapped = _mm_xor_si128(_mm_add_epi8(value, value), sign);
+    // the byte `k` of each lane is the plane `k` of the 8 samples. interleave the lanes
+    const __m128i bits = transpose_bits(mapped);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(planes), _mm_unpacklo_epi8(bits, _mm_srli_si128(bits, 8)));
+    // a plane is used if it has a 1 in either lane
+    const auto empty = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128())));
+    return bit_length.values[~(empty & empty >> 8) & 0xFF];
+#else
+    uint32_t bits = 0;
+    std::fill_n(planes, 16, uint8_t{0});
+    for (uint32_t i = 0; i < group_size; ++i) {
+        const uint8_t value = residual[i];
+        const auto mapped = static_cast<uint8_t>((value << 1) ^ (value & 0x80 ? 0xFF : 0x00));
+        bits |= mapped;
+        for (uint32_t k = 0; k < 8; ++k)
+            planes[2 * k + i / 8] = static_cast<uint8_t>(planes[2 * k + i / 8] | ((mapped >> k) & 1) << (i % 8));
+    }
+    return bit_length.values[bits];
+#endif
+}
+
+#if !defined(MEDIA0_SSE2)
+/// @brief The bits of a byte spread to the lowest bit of 8 bytes. Little endian order of the samples
+struct bit_spread_t final {
+    uint64_t values[256]{};
+
+  public:
+    constexpr bit_spread_t() noexcept {
+        for (uint32_t m = 0; m < 256; ++m)
+            for (uint32_t i = 0; i < 8; ++i)
+                values[m] |= static_cast<uint64_t>((m >> i) & 1) << (8 * i);
+    }
+};
+constexpr bit_spread_t bit_spread{};
+#endif
+
+/**
+ * @brief Reverse of `pack_group`. `data` has 2 bytes for each of the `width` planes
+ * @note 16 bytes of `data` are readable. The ones after the planes are ignored
+ */
+void unpack_group(const uint8_t* data, uint32_t width, uint8_t* residual) noexcept {
+#if defined(MEDIA0_SSE2)
+    const __m128i lanes = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i valid = _mm_cmplt_epi8(lanes, _mm_set1_epi8(static_cast<char>(2 * width)));
+    const __m128i bytes = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), valid);
+    // the low bytes of the planes in the first lane, the high bytes in the second
+    const __m128i low = _mm_and_si128(bytes, _mm_set1_epi16(0x00FF));
+    const __m128i mapped = transpose_bits(_mm_packus_epi16(low, _mm_srli_epi16(bytes, 8)));
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i half = _mm_and_si128(_mm_srli_epi16(mapped, 1), _mm_set1_epi8(0x7F));
+    const __m128i value = _mm_xor_si128(half, _mm_cmpeq_epi8(_mm_and_si128(mapped, one), one));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(residual), value);
+#else
+    constexpr uint64_t low_bits = 0x0101010101010101;
+    uint64_t mapped[2]{};
+    for (uint32_t k = 0; k < width; ++k) {
+        mapped[0] |= bit_spread.values[data[2 * k]] << k;
+        mapped[1] |= bit_spread.values[data[2 * k + 1]] << k;
+    }
+    for (uint32_t h = 0; h < 2; ++h) {
+        const uint64_t value = ((mapped[h] >> 1) & (low_bits * 0x7F)) ^ ((mapped[h] & low_bits) * 0xFF);
+        for (uint32_t i = 0; i < 8; ++i)
+            residual[8 * h + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+#endif
+}
+
+void encode_tile(const uint8_t* plane, uint32_t stride, const tile_area_t& area, std::vector<uint8_t>& scratch,
+                 std::vector<uint8_t>& packed, std::vector<uint8_t>& output) noexcept(false) {
+    const uint32_t groups = (area.width + group_size - 1) / group_size;
+    scratch.assign(static_cast<size_t>(groups) * group_size, 0);
+    // the worst case is 8 planes for all groups. each group writes 16 bytes and moves by its width
+    const size_t count = static_cast<size_t>(groups) * area.height;
+    if (packed.size() < (count + 1) / 2 + count * 16)
+        packed.resize((count + 1) / 2 + count * 16);
+    uint8_t* out = packed.data();
+    uint8_t* header = nullptr; // the byte of the widths of 2 groups
+    size_t index = 0;
+    for (uint32_t y = 0; y < area.height; ++y) {
+        const uint8_t* row = plane + static_cast<size_t>(area.y + y) * stride + area.x;
+        if (y == 0) {
+            // no row above in the tile. the previous sample of the channel
+            for (uint32_t x = 0; x < area.width; ++x)
+                scratch[x] = static_cast<uint8_t>(row[x] - (x >= area.step ? row[x - area.step] : 0));
+        } else {
+            subtract_rows(row, row - stride, scratch.data(), area.width);
+        }
+        for (uint32_t g = 0; g < groups; ++g, ++index) {
+            if (index % 2 == 0)
+                header = out++;
+            const uint32_t width = pack_group(scratch.data() + g * group_size, out);
+            *header = static_cast<uint8_t>(index % 2 == 0 ? width : *header | width << 4);
+            out += 2 * width;
+        }
+    }
+    output.insert(output.end(), packed.data(), out);
+}
+
+void decode_tile(const uint8_t* data, const uint8_t* end, uint8_t* plane, uint32_t stride, const tile_area_t& area,
+                 std::vector<uint8_t>& scratch) noexcept(false) {
+    const uint32_t groups = (area.width + group_size - 1) / group_size;
+    scratch.resize(static_cast<size_t>(groups) * group_size);
+    uint32_t widths = 0;
+    size_t count = 0;
+    for (uint32_t y = 0; y < area.height; ++y) {
+        for (uint32_t g = 0; g < groups; ++g, ++count) {
+            if (count % 2 == 0) {
+                if (data == end)
+                    throw std::invalid_argument{"decode_tile: broken data"};
+                widths = *data++;
+            }
+            const uint32_t width = count % 2 == 0 ? widths & 0xF : widths >> 4;
+            const auto available = static_cast<size_t>(end - data);
+            if (width > 8 || available < 2 * width)
+                throw std::invalid_argument{"decode_tile: broken data"};
+            if (available >= 16) {
+                unpack_group(data, width, scratch.data() + g * group_size);
+            } else {
+                // the last groups of the tile. don't read after the end
+                uint8_t planes[16]{};
+                std::memcpy(planes, data, 2 * width);
+                unpack_group(planes, width, scratch.data() + g * group_size);
+            }
+            data += 2 * width;
+        }
+        uint8_t* row = plane + static_cast<size_t>(area.y + y) * stride + area.x;
+        if (y == 0) {
+            for (uint32_t x = 0; x < area.width; ++x)
+                row[x] = static_cast<uint8_t>(scratch[x] + (x >= area.step ? row[x - area.step] : 0));
+        } else {
+            add_rows(scratch.data(), row - stride, row, area.width);
+        }
+    }
+    if (data != end)
+        throw std::invalid_argument{"decode_tile: broken data"};
+}
+
+void verify_layout(const compressed_frame_t& compressed, const video_frame_t& frame) noexcept(false) {
+    if (frame.format.same_layout(compressed.format) == false || frame.planes[0].data == nullptr)
+        throw std::invalid_argument{"decompress_frame: the frame doesn't match"};
+    const uint32_t count = get_plane_count(compressed.format.pixel) * compressed.tiles_x * compressed.tiles_y;
+    if (compressed.offsets.size() != count + 1 || compressed.offsets.back() != compressed.data.size())
+        throw std::invalid_argument{"decompress_frame: broken data"};
+}
+
+void decompress(const compressed_frame_t& compressed, uint32_t plane, uint32_t tile_x, uint32_t tile_y,
+                std::vector<uint8_t>& scratch, video_frame_t& frame) noexcept(false) {
+    const size_t index = (static_cast<size_t>(plane) * compressed.tiles_y + tile_y) * compressed.tiles_x + tile_x;
+    const uint32_t begin = compressed.offsets[index];
+    const uint32_t end = compressed.offsets[index + 1];
+    if (begin > end || end > compressed.data.size())
+        throw std::invalid_argument{"decompress_frame: broken data"};
+    const tile_area_t area = get_tile_area(compressed.format, plane, compressed.tile_size, compressed.tiles_x,
+                                           compressed.tiles_y, tile_x, tile_y);
+    decode_tile(compressed.data.data() + begin, compressed.data.data() + end, frame.planes[plane].data,
+                frame.planes[plane].stride, area, scratch);
+}
+
+void put(std::vector<uint8_t>& output, uint64_t value, size_t size) noexcept(false) {
+    for (size_t i = 0; i < size; ++i)
+        output.emplace_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+struct byte_reader_t final {
+    const uint8_t* data;
+    const uint8_t* end;
+
+  public:
+    uint64_t get(size_t size) noexcept(false) {
+        if (static_cast<size_t>(end - data) < size)
+            throw std::invalid_argument{"deserialize: too short"};
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; ++i)
+            value |= static_cast<uint64_t>(*data++) << (8 * i);
+        return value;
+    }
+};
+
+} // namespace
+
+size_t compressed_frame_t::size_bytes() const noexcept {
+    return data.size() + offsets.size() * sizeof(uint32_t);
+}
+
+compressed_frame_t compress_frame(const video_frame_t& frame, uint32_t tile_size) noexcept(false) {
+    const video_format_t& format = frame.format;
+    if (is_compressed(format.pixel) || get_plane_count(format.pixel) == 0 || format.width == 0 || format.height == 0)
+        throw std::invalid_argument{"compress_frame: unsupported format"};
+    if (tile_size == 0 || tile_size % group_size || tile_size > max_tile_size)
+        throw std::invalid_argument{"compress_frame: unsupported tile size"};
+    compressed_frame_t compressed{};
+    compressed.format = format;
+    compressed.timestamp = frame.timestamp;
+    compressed.duration = frame.duration;
+    compressed.flags = frame.flags;
+    compressed.tile_size = tile_size;
+    compressed.tiles_x = get_tile_count(format.width, tile_size);
+    compressed.tiles_y = get_tile_count(format.height, tile_size);
+    compressed.data.reserve(frame.size_bytes() / 2);
+    std::vector<uint8_t> scratch{};
+    std::vector<uint8_t> packed{};
+    for (uint32_t plane = 0; plane < get_plane_count(format.pixel); ++plane) {
+        for (uint32_t tile_y = 0; tile_y < compressed.tiles_y; ++tile_y) {
+            for (uint32_t tile_x = 0; tile_x < compressed.tiles_x; ++tile_x) {
+                compressed.offsets.emplace_back(static_cast<uint32_t>(compressed.data.size()));
+                const tile_area_t area =
+                    get_tile_area(format, plane, tile_size, compressed.tiles_x, compressed.tiles_y, tile_x, tile_y);
+                encode_tile(frame.planes[plane].data, frame.planes[plane].stride, area, scratch, packed,
+                            compressed.data);
+            }
+        }
+    }
+    compressed.offsets.emplace_back(static_cast<uint32_t>(compressed.data.size()));
+    compressed.data.shrink_to_fit();
+    return compressed;
+}
+
+void decompress_frame(const compressed_frame_t& compressed, video_frame_t& frame) noexcept(false) {
+    verify_layout(compressed, frame);
+    std::vector<uint8_t> scratch{};
+    for (uint32_t plane = 0; plane < get_plane_count(compressed.format.pixel); ++plane)
+        for (uint32_t tile_y = 0; tile_y < compressed.tiles_y; ++tile_y)
+            for (uint32_t tile_x = 0; tile_x < compressed.tiles_x; ++tile_x)
+                decompress(compressed, plane, tile_x, tile_y, scratch, frame);
+    frame.format.fps_num = compressed.format.fps_num;
+    frame.format.fps_den = compressed.format.fps_den;
+    frame.timestamp = compressed.timestamp;
+    frame.duration = compressed.duration;
+    frame.flags = compressed.flags;
+}
+
+void decompress_tile(const compressed_frame_t& compressed, uint32_t tile_x, uint32_t tile_y,
+                     video_frame_t& frame) noexcept(false) {
+    verify_layout(compressed, frame);
+    if (tile_x >= compressed.tiles_x || tile_y >= compressed.tiles_y)
+        throw std::invalid_argument{"decompress_tile: out of range"};
+    std::vector<uint8_t> scratch{};
+    for (uint32_t plane = 0; plane < get_plane_count(compressed.format.pixel); ++plane)
+        decompress(compressed, plane, tile_x, tile_y, scratch, frame);
+}
+
+std::vector<uint8_t> serialize(const compressed_frame_t& compressed) noexcept(false) {
+    std::vector<uint8_t> output{};
+    output.reserve(64 + compressed.size_bytes());
+    output.insert(output.end(), magic, magic + sizeof(magic));
+    put(output, version, 4);
+    put(output, static_cast<uint32_t>(compressed.format.pixel), 4);
+    put(output, compressed.format.width, 4);
+    put(output, compressed.format.height, 4);
+    put(output, compressed.format.fps_num, 4);
+    put(output, compressed.format.fps_den, 4);
+    put(output, static_cast<uint64_t>(compressed.timestamp), 8);
+    put(output, static_cast<uint64_t>(compressed.duration), 8);
+    put(output, compressed.flags, 4);
+    put(output, compressed.tile_size, 4);
+    put(output, compressed.data.size(), 4);
+    for (uint32_t offset : compressed.offsets)
+        put(output, offset, 4);
+    output.insert(output.end(), compressed.data.begin(), compressed.data.end());
+    return output;
+}
+
+compressed_frame_t deserialize(const uint8_t* data, size_t size) noexcept(false) {
+    if (size < sizeof(magic) || std::memcmp(data, magic, sizeof(magic)) != 0)
+        throw std::invalid_argument{"deserialize: unknown data"};
+    byte_reader_t reader{data + sizeof(magic), data + size};
+    if (reader.get(4) != version)
+        throw std::invalid_argument{"deserialize: unknown version"};
+    compressed_frame_t compressed{};
+    compressed.format.pixel = static_cast<pixel_format_t>(reader.get(4));
+    compressed.format.width = static_cast<uint32_t>(reader.get(4));
+    compressed.format.height = static_cast<uint32_t>(reader.get(4));
+    compressed.format.fps_num = static_cast<uint32_t>(reader.get(4));
+    compressed.format.fps_den = static_cast<uint32_t>(reader.get(4));
+    compressed.timestamp = static_cast<int64_t>(reader.get(8));
+    compressed.duration = static_cast<int64_t>(reader.get(8));
+    compressed.flags = static_cast<uint32_t>(reader.get(4));
+    compressed.tile_size = static_cast<uint32_t>(reader.get(4));
+    const auto length = static_cast<uint32_t>(reader.get(4));
+    const video_format_t& format = compressed.format;
+    if (is_compressed(format.pixel) || get_plane_count(format.pixel) == 0 || format.width == 0 ||
+        format.height == 0 || compressed.tile_size == 0 || compressed.tile_size % group_size ||
+        compressed.tile_size > max_tile_size)
+        throw std::invalid_argument{"deserialize: unsupported format"};
+    compressed.tiles_x = get_tile_count(format.width, compressed.tile_size);
+    compressed.tiles_y = get_tile_count(format.height, compressed.tile_size);
+    const size_t count = static_cast<size_t>(get_plane_count(format.pixel)) * compressed.tiles_x * compressed.tiles_y;
+    if (static_cast<size_t>(reader.end - reader.data) != (count + 1) * 4 + length)
+        throw std::invalid_argument{"deserialize: wrong length"};
+    compressed.offsets.resize(count + 1);
+    for (auto& offset : compressed.offsets) {
+        offset = static_cast<uint32_t>(reader.get(4));
+        if (offset > length)
+            throw std::invalid_argument{"deserialize: broken offsets"};
+    }
+    if (std::is_sorted(compressed.offsets.begin(), compressed.offsets.end()) == false ||
+        compressed.offsets.back() != length)
+        throw std::invalid_argument{"deserialize: broken offsets"};
+    compressed.data.assign(reader.data, reader.end);
+    return compressed;
+}
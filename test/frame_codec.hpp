@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "video_frame.hpp"
+
+/**
+ * @brief Lossless in-memory form of an uncompressed frame. For the caches and the spill files of the look-back.
+ *        Each plane is split into tiles which cover the same pixels. A tile is coded alone, so any tile can be
+ *        decoded without the others.
+ *
+ * @details A sample is predicted by the one above it. The first row of a tile uses the previous sample of the same
+ *          channel. The residuals are zigzag mapped and packed by groups of 16 as bit planes of the group's width.
+ *          A pair of the widths takes 1 byte. Flat or repeating regions cost 4 bits for 16 samples
+ *
+ * @note 1080p NV12 on one 2.1 GHz x64 core with SSE2: compress 1.5-2.3 GB/s, decompress 1.7-2.4 GB/s. About 1/5 of
+ *       `memcpy` on the same core. The group loop (the bit transpose, the width byte and the bound checks) takes most
+ *       of it. Run `[benchmark][frame_codec]` to measure.
+ */
+struct compressed_frame_t final {
+    video_format_t format{};
+    int64_t timestamp = 0;
+    int64_t duration = 0;
+    uint32_t flags = 0;
+    uint32_t tile_size = 0; // in pixels
+    uint32_t tiles_x = 0;
+    uint32_t tiles_y = 0;
+    std::vector<uint32_t> offsets{}; // of the tiles in `data`. plane, row, column order. one more for the end
+    std::vector<uint8_t> data{};
+
+  public:
+    [[nodiscard]] size_t size_bytes() const noexcept;
+};
+
+/**
+ * @param tile_size width and height of the tiles in pixels. A multiple of 16
+ * @throws std::invalid_argument the frame is compressed or empty, or the `tile_size` is not supported
+ */
+[[nodiscard]] compressed_frame_t compress_frame(const video_frame_t& frame, uint32_t tile_size = 64) noexcept(false);
+
+/**
+ * @param frame allocated with `compressed.format` by the caller. The timestamps and flags are copied too
+ * @throws std::invalid_argument the layout of the `frame` is different or the data is broken
+ */
+void decompress_frame(const compressed_frame_t& compressed, video_frame_t& frame) noexcept(false);
+
+/**
+ * @brief Decode the pixels of one tile in all planes. The others in the `frame` are not touched
+ * @throws std::invalid_argument the layout is different, the tile is out of range or the data is broken
+ */
+void decompress_tile(const compressed_frame_t& compressed, uint32_t tile_x, uint32_t tile_y,
+                     video_frame_t& frame) noexcept(false);
+
+/// @brief The bytes for a spill file. Little endian
+[[nodiscard]] std::vector<uint8_t> serialize(const compressed_frame_t& compressed) noexcept(false);
+/// @throws std::invalid_argument the bytes are not from `serialize`
+[[nodiscard]] compressed_frame_t deserialize(const uint8_t* data, size_t size) noexcept(false);
@@ -0,0 +1,179 @@
+#include "gop_decoder.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+gop_decoder_t::gop_decoder_t(factory_t _factory, size_t _num_workers, size_t _window, size_t _min_inputs) noexcept(
+    false)
+    : factory{std::move(_factory)},
+      num_workers{_num_workers ? _num_workers : std::max<size_t>(std::thread::hardware_concurrency(), 1)},
+      window{_window ? _window : 2 * num_workers}, min_inputs{_min_inputs} {
+    if (factory == nullptr)
+        throw std::invalid_argument{"gop_decoder_t: nullptr"};
+}
+
+gop_decoder_t::~gop_decoder_t() noexcept {
+    if (workers.empty())
+        return;
+    fail(transform_result_t::aborted);
+    for (auto& worker : workers)
+        worker.join();
+}
+
+size_t gop_decoder_t::worker_count() const noexcept {
+    return num_workers;
+}
+
+size_t gop_decoder_t::segment_count() const noexcept {
+    return next_sequence;
+}
+
+size_t gop_decoder_t::output_count() const noexcept {
+    return num_output.load(std::memory_order_relaxed);
+}
+
+transform_result_t gop_decoder_t::start(sink_t _sink) noexcept {
+    if (jobs)
+        return transform_result_t::not_ready;
+    sink = std::move(_sink);
+    try {
+        jobs = std::make_unique<queue_t>(window);
+        for (size_t i = 0; i < num_workers; ++i)
+            workers.emplace_back(&gop_decoder_t::run, this, i);
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "gop_decoder_t", ex.what());
+        fail(transform_result_t::failed);
+        return transform_result_t::failed;
+    }
+    return transform_result_t::ok;
+}
+
+bool gop_decoder_t::push(video_frame_t frame) noexcept(false) {
+    if (jobs == nullptr)
+        throw std::logic_error{"gop_decoder_t: not started"};
+    if (frame.keyframe() && current && current->inputs.size() >= min_inputs)
+        if (submit() == false)
+            return false;
+    if (current == nullptr)
+        current = std::make_unique<segment_t>();
+    current->inputs.emplace_back(std::move(frame));
+    return error.load() == transform_result_t::ok;
+}
+
+/// @brief Wait for the window and give the current segment to the workers
+bool gop_decoder_t::submit() noexcept(false) {
+    if (current == nullptr || current->inputs.empty())
+        return true;
+    {
+        std::unique_lock lck{mtx};
+        released.wait(lck, [this]() {
+            return error.load() != transform_result_t::ok || next_sequence - next_release < window;
+        });
+        if (error.load() != transform_result_t::ok)
+            return false;
+        current->sequence = next_sequence++;
+    }
+    return jobs->push(std::move(current));
+}
+
+transform_result_t gop_decoder_t::finish() noexcept {
+    if (jobs == nullptr)
+        return transform_result_t::not_ready;
+    try {
+        submit();
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "gop_decoder_t", ex.what());
+        fail(transform_result_t::failed);
+    }
+    current = nullptr;
+    jobs->close();
+    for (auto& worker : workers)
+        worker.join();
+    workers.clear();
+    return error.load();
+}
+
+void gop_decoder_t::fail(transform_result_t result) noexcept {
+    transform_result_t expected = transform_result_t::ok;
+    error.compare_exchange_strong(expected, result);
+    if (jobs)
+        jobs->abort();
+    {
+        std::lock_guard lck{mtx}; // the waiter of `submit` may be between its check and wait
+    }
+    released.notify_all();
+}
+
+/// @brief Keep the `segment` until the older ones are released. Then the caller releases the ready ones in order
+transform_result_t gop_decoder_t::release(std::unique_ptr<segment_t> segment) noexcept {
+    std::unique_lock lck{mtx};
+    finished.emplace(segment->sequence, std::move(segment));
+    if (releasing)
+        return transform_result_t::ok; // the other worker will take it
+    releasing = true;
+    transform_result_t result = transform_result_t::ok;
+    for (auto it = finished.find(next_release); it != finished.end(); it = finished.find(next_release)) {
+        std::unique_ptr<segment_t> ready = std::move(it->second);
+        finished.erase(it);
+        lck.unlock();
+        for (const video_frame_t& frame : ready->outputs) {
+            if (error.load() != transform_result_t::ok)
+                result = transform_result_t::aborted;
+            else if (sink)
+                result = sink(frame);
+            if (result != transform_result_t::ok)
+                break;
+            ++num_output;
+        }
+        ready = nullptr; // return the frames to the pools before the next segment is submitted
+        lck.lock();
+        ++next_release;
+        released.notify_all();
+        if (result != transform_result_t::ok)
+            break;
+    }
+    releasing = false;
+    return result;
+}
+
+void gop_decoder_t::run(size_t index) noexcept {
+    transform_result_t result = transform_result_t::ok;
+    try {
+        std::shared_ptr<video_transform_t> decoder = factory();
+        if (decoder == nullptr)
+            throw std::runtime_error{"gop_decoder_t: the factory returned nullptr"};
+        video_transform_driver_t driver{std::move(decoder), fmt::format("gop_decoder_t/{}", index)};
+        std::unique_ptr<segment_t> segment{};
+        while (result == transform_result_t::ok && jobs->pop(segment)) {
+            std::vector<video_frame_t>& outputs = segment->outputs;
+            const video_transform_driver_t::emit_t emit = [&outputs](const video_frame_t& frame) {
+                outputs.emplace_back(frame);
+                return transform_result_t::ok;
+            };
+            for (const video_frame_t& input : segment->inputs)
+                if (result = driver.process(input, emit); result != transform_result_t::ok)
+                    break;
+            // the segment ends before the next IDR. the reference frames are not needed anymore
+            if (result == transform_result_t::ok)
+                result = driver.drain(emit);
+            if (result != transform_result_t::ok)
+                break;
+            segment->inputs.clear();
+            // the decoders release in presentation order. this is for the ones which don't reorder
+            std::stable_sort(outputs.begin(), outputs.end(), [](const video_frame_t& lhs, const video_frame_t& rhs) {
+                return lhs.timestamp < rhs.timestamp;
+            });
+            result = release(std::move(segment));
+        }
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "gop_decoder_t", ex.what());
+        result = transform_result_t::failed;
+    }
+    if (result != transform_result_t::ok) {
+        if (result != transform_result_t::aborted)
+            spdlog::error("{}: {} {}", "gop_decoder_t", index, to_string(result));
+        fail(result);
+    }
+}
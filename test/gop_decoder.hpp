@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "pipeline.hpp"
+#include "video_pipeline.hpp"
+
+/**
+ * @brief Decodes a compressed stream with several decoder instances. The stream is split before each keyframe (IDR)
+ *        and the segments are decoded concurrently. The outputs are released to the sink in presentation order.
+ *
+ * @code
+ * gop_decoder_t decoder{[source_type]() { return make_h264_decoder(source_type, pixel_format_t::nv12); }, 4};
+ * decoder.start(sink);
+ * for (auto& frame : frames) // decode order. `frame_flag_keyframe` on the IDR frames
+ *     if (decoder.push(frame) == false)
+ *         break;
+ * transform_result_t result = decoder.finish();
+ * @endcode
+ *
+ * @note Each worker owns one decoder from the factory and drains it at the end of each segment.
+ *       The segments must be independent. Closed GOPs, which is the case for IDR boundaries of H.264
+ * @note Up to `window` segments can be in flight. The finished ones wait for the older ones with their outputs,
+ *       so `push` blocks until the oldest segment is released to the sink
+ */
+class gop_decoder_t final {
+  public:
+    using factory_t = std::function<std::shared_ptr<video_transform_t>()>;
+    using sink_t = std::function<transform_result_t(const video_frame_t&)>;
+
+  private:
+    struct segment_t final {
+        uint64_t sequence = 0;
+        std::vector<video_frame_t> inputs{};
+        std::vector<video_frame_t> outputs{};
+    };
+    using queue_t = bounded_queue_t<std::unique_ptr<segment_t>>;
+
+    factory_t factory;
+    const size_t num_workers;
+    const size_t window;
+    const size_t min_inputs;
+    sink_t sink{};
+    std::unique_ptr<queue_t> jobs{};
+    std::vector<std::thread> workers{};
+    std::unique_ptr<segment_t> current{};
+
+    std::mutex mtx{};
+    std::condition_variable released{};
+    std::map<uint64_t, std::unique_ptr<segment_t>> finished{}; // waiting for the older segments
+    uint64_t next_sequence = 0;
+    uint64_t next_release = 0;
+    bool releasing = false;
+    std::atomic<transform_result_t> error{transform_result_t::ok};
+    std::atomic<size_t> num_output{0};
+
+  public:
+    /**
+     * @param factory creates a decoder with the input/output formats configured. Called once on each worker
+     * @param num_workers count of the decoders. 0 for `std::thread::hardware_concurrency`
+     * @param window maximum count of the segments in flight. 0 for `2 * num_workers`
+     * @param min_inputs the keyframes before this count don't split the segment. Avoids a drain for each frame
+     *                   of the intra-only streams
+     */
+    explicit gop_decoder_t(factory_t factory, size_t num_workers = 0, size_t window = 0,
+                           size_t min_inputs = 1) noexcept(false);
+    gop_decoder_t(const gop_decoder_t&) = delete;
+    gop_decoder_t(gop_decoder_t&&) = delete;
+    gop_decoder_t& operator=(const gop_decoder_t&) = delete;
+    gop_decoder_t& operator=(gop_decoder_t&&) = delete;
+    /// @note aborts the running workers
+    ~gop_decoder_t() noexcept;
+
+    /// @param sink receives the outputs in presentation order. Called by one worker at a time. can be `nullptr`
+    [[nodiscard]] transform_result_t start(sink_t sink) noexcept;
+    /// @brief Append the frame to the current segment. A keyframe submits the previous segment to the workers
+    /// @return false if a worker failed. see `finish` for the reason
+    bool push(video_frame_t frame) noexcept(false);
+    /// @brief Submit the last segment and wait for the workers
+    /// @return the first error of the workers
+    [[nodiscard]] transform_result_t finish() noexcept;
+
+    [[nodiscard]] size_t worker_count() const noexcept;
+    [[nodiscard]] size_t segment_count() const noexcept;
+    [[nodiscard]] size_t output_count() const noexcept;
+
+  private:
+    bool submit() noexcept(false);
+    void run(size_t index) noexcept;
+    transform_result_t release(std::unique_ptr<segment_t> segment) noexcept;
+    void fail(transform_result_t result) noexcept;
+};
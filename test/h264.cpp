@@ -0,0 +1,655 @@
+#include "h264.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+#include "simd.hpp"
+
+namespace {
+
+constexpr uint8_t start_code[4]{0, 0, 0, 1};
+
+/// @see ITU-T H.264 7.3.2.1.1.1
+void skip_scaling_list(bit_reader_t& reader, uint32_t size) noexcept {
+    int32_t last_scale = 8, next_scale = 8;
+    for (uint32_t j = 0; j < size; ++j) {
+        if (next_scale != 0)
+            next_scale = (last_scale + reader.read_se() + 256) % 256;
+        last_scale = next_scale == 0 ? last_scale : next_scale;
+    }
+}
+
+/// @see ITU-T H.264 E.1.2
+void skip_hrd_parameters(bit_reader_t& reader) noexcept {
+    const uint32_t cpb_cnt = reader.read_ue() + 1;
+    reader.skip_bits(4 + 4); // bit_rate_scale, cpb_size_scale
+    for (uint32_t i = 0; i < cpb_cnt && reader.failed() == false; ++i) {
+        (void)reader.read_ue(); // bit_rate_value_minus1
+        (void)reader.read_ue(); // cpb_size_value_minus1
+        reader.skip_bits(1);    // cbr_flag
+    }
+    reader.skip_bits(5 + 5 + 5 + 5);
+}
+
+/// @see ITU-T H.264 Table E-1
+constexpr uint32_t sample_aspect_ratios[17][2]{
+    {0, 0},   {1, 1},   {12, 11}, {10, 11}, {16, 11},  {40, 33}, {24, 11}, {20, 11}, {32, 11},
+    {80, 33}, {18, 11}, {15, 11}, {64, 33}, {160, 99}, {4, 3},   {3, 2},   {2, 1},
+};
+
+/// @see ITU-T H.264 E.1.1
+void parse_vui(bit_reader_t& reader, h264_sps_t& sps) noexcept {
+    if (reader.read_bit()) { // aspect_ratio_info_present_flag
+        const uint32_t idc = reader.read_bits(8);
+        if (idc == 255) {
+            sps.sar_width = reader.read_bits(16);
+            sps.sar_height = reader.read_bits(16);
+        } else if (idc < 17) {
+            sps.sar_width = sample_aspect_ratios[idc][0];
+            sps.sar_height = sample_aspect_ratios[idc][1];
+        }
+    }
+    if (reader.read_bit())   // overscan_info_present_flag
+        reader.skip_bits(1); // overscan_appropriate_flag
+    if (reader.read_bit()) { // video_signal_type_present_flag
+        reader.skip_bits(3); // video_format
+        sps.full_range = reader.read_bit();
+        if (reader.read_bit()) { // colour_description_present_flag
+            sps.colour_primaries = reader.read_bits(8);
+            sps.transfer_characteristics = reader.read_bits(8);
+            sps.matrix_coefficients = reader.read_bits(8);
+        }
+    }
+    if (reader.read_bit()) { // chroma_loc_info_present_flag
+        (void)reader.read_ue();
+        (void)reader.read_ue();
+    }
+    sps.timing_info_present = reader.read_bit();
+    if (sps.timing_info_present) {
+        sps.num_units_in_tick = reader.read_bits(32);
+        sps.time_scale = reader.read_bits(32);
+        sps.fixed_frame_rate = reader.read_bit();
+    }
+    const bool nal_hrd = reader.read_bit();
+    if (nal_hrd)
+        skip_hrd_parameters(reader);
+    const bool vcl_hrd = reader.read_bit();
+    if (vcl_hrd)
+        skip_hrd_parameters(reader);
+    if (nal_hrd || vcl_hrd)
+        reader.skip_bits(1); // low_delay_hrd_flag
+    reader.skip_bits(1);     // pic_struct_present_flag
+    sps.bitstream_restriction = reader.read_bit();
+    if (sps.bitstream_restriction) {
+        reader.skip_bits(1);    // motion_vectors_over_pic_boundaries_flag
+        (void)reader.read_ue(); // max_bytes_per_pic_denom
+        (void)reader.read_ue(); // max_bits_per_mb_denom
+        (void)reader.read_ue(); // log2_max_mv_length_horizontal
+        (void)reader.read_ue(); // log2_max_mv_length_vertical
+        sps.max_num_reorder_frames = reader.read_ue();
+        sps.max_dec_frame_buffering = reader.read_ue();
+    }
+}
+
+/// @see ITU-T H.264 Table A-1
+uint32_t get_max_dpb_mbs(uint32_t level_idc, bool constraint_set3) noexcept {
+    switch (level_idc) {
+    case 9:
+    case 10:
+        return 396;
+    case 11:
+        return constraint_set3 ? 396 : 900; // level 1b
+    case 12:
+    case 13:
+    case 20:
+        return 2376;
+    case 21:
+        return 4752;
+    case 22:
+    case 30:
+        return 8100;
+    case 31:
+        return 18000;
+    case 32:
+        return 20480;
+    case 40:
+    case 41:
+        return 32768;
+    case 42:
+        return 34816;
+    case 50:
+        return 110400;
+    case 51:
+    case 52:
+        return 184320;
+    default:
+        return 696320; // level 6, 6.1, 6.2
+    }
+}
+
+bool has_chroma_format(uint32_t profile_idc) noexcept {
+    switch (profile_idc) {
+    case 100:
+    case 110:
+    case 122:
+    case 244:
+    case 44:
+    case 83:
+    case 86:
+    case 118:
+    case 128:
+    case 138:
+    case 139:
+    case 134:
+    case 135:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// @brief Remove the zero bytes after the NAL unit. `zero_byte` of the next start code or `trailing_zero_8bits`
+size_t trim_trailing_zeros(const uint8_t* data, size_t size) noexcept {
+    while (size > 0 && data[size - 1] == 0)
+        --size;
+    return size;
+}
+
+} // namespace
+
+const uint8_t* find_start_code(const uint8_t* begin, const uint8_t* end) noexcept {
+    const uint8_t* p = begin;
+    while (end - p >= 3) {
+#if defined(MEDIA0_SSE2)
+        // skip the blocks without 2 zeros in a row. 15 bytes each, so the pair on the boundary is in the next one
+        for (; end - p >= 16; p += 15) {
+            const auto zero = static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), //
+                                                 _mm_setzero_si128())));
+            if (zero & (zero >> 1))
+                break;
+        }
+#elif defined(MEDIA0_NEON)
+        for (; end - p >= 16; p += 15) {
+            const uint8x16_t zero = vceqq_u8(vld1q_u8(p), vdupq_n_u8(0));
+            if (vmaxvq_u8(vandq_u8(zero, vextq_u8(zero, vdupq_n_u8(0), 1))))
+                break;
+        }
+#endif
+        // check the candidate block and the tail
+        const uint8_t* limit = std::min(p + 16, end);
+        for (; p < limit && end - p >= 3; ++p)
+            if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+                return p;
+    }
+    return end;
+}
+
+void split_annexb(const uint8_t* data, size_t size, std::vector<h264_nal_t>& nals) noexcept(false) {
+    nals.clear();
+    const uint8_t* end = data + size;
+    const uint8_t* current = find_start_code(data, end);
+    while (current != end) {
+        const uint8_t* begin = current + 3;
+        current = find_start_code(begin, end);
+        if (auto length = trim_trailing_zeros(begin, current - begin); length)
+            nals.emplace_back(h264_nal_t{begin, length});
+    }
+}
+
+bool split_avcc(const uint8_t* data, size_t size, uint32_t length_size, std::vector<h264_nal_t>& nals) noexcept(
+    false) {
+    nals.clear();
+    if (length_size != 1 && length_size != 2 && length_size != 4)
+        return false;
+    size_t offset = 0;
+    while (offset + length_size <= size) {
+        size_t length = 0;
+        for (uint32_t i = 0; i < length_size; ++i)
+            length = (length << 8) | data[offset + i];
+        offset += length_size;
+        if (length > size - offset)
+            return false;
+        if (length)
+            nals.emplace_back(h264_nal_t{data + offset, length});
+        offset += length;
+    }
+    return offset == size;
+}
+
+bool avcc_to_annexb(uint8_t* data, size_t size) noexcept {
+    size_t offset = 0;
+    while (offset + 4 <= size) {
+        const size_t length = (size_t{data[offset]} << 24) | (size_t{data[offset + 1]} << 16) |
+                              (size_t{data[offset + 2]} << 8) | data[offset + 3];
+        if (length > size - offset - 4)
+            return false;
+        std::copy_n(start_code, 4, data + offset);
+        offset += 4 + length;
+    }
+    return offset == size;
+}
+
+bool avcc_to_annexb(const uint8_t* data, size_t size, uint32_t length_size, std::vector<uint8_t>& out) noexcept(
+    false) {
+    out.clear();
+    std::vector<h264_nal_t> nals{};
+    if (split_avcc(data, size, length_size, nals) == false)
+        return false;
+    out.reserve(size + nals.size() * 4);
+    for (const h264_nal_t& nal : nals) {
+        out.insert(out.end(), start_code, start_code + 4);
+        out.insert(out.end(), nal.data, nal.data + nal.size);
+    }
+    return true;
+}
+
+void annexb_to_avcc(const uint8_t* data, size_t size, std::vector<uint8_t>& out) noexcept(false) {
+    out.clear();
+    std::vector<h264_nal_t> nals{};
+    split_annexb(data, size, nals);
+    out.reserve(size + nals.size());
+    for (const h264_nal_t& nal : nals) {
+        const auto length = static_cast<uint32_t>(nal.size);
+        const uint8_t prefix[4]{static_cast<uint8_t>(length >> 24), static_cast<uint8_t>(length >> 16),
+                                static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length)};
+        out.insert(out.end(), prefix, prefix + 4);
+        out.insert(out.end(), nal.data, nal.data + nal.size);
+    }
+}
+
+void unescape_rbsp(const uint8_t* data, size_t size, std::vector<uint8_t>& out) noexcept(false) {
+    out.clear();
+    out.reserve(size);
+    size_t zeros = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const uint8_t value = data[i];
+        if (zeros >= 2 && value == 3) {
+            zeros = 0; // emulation_prevention_three_byte
+            continue;
+        }
+        zeros = value == 0 ? zeros + 1 : 0;
+        out.emplace_back(value);
+    }
+}
+
+bool bit_reader_t::more_rbsp_data() const noexcept {
+    // the position of rbsp_stop_one_bit is the last 1
+    size_t last = size_bits / 8;
+    while (last > 0 && data[last - 1] == 0)
+        --last;
+    if (last == 0)
+        return false;
+    const uint8_t tail = data[last - 1];
+    size_t stop = last * 8 - 1;
+    for (uint8_t v = tail; (v & 1) == 0; v >>= 1)
+        --stop;
+    return position < stop;
+}
+
+uint32_t h264_sps_t::width() const noexcept {
+    return width_in_mbs * 16 - crop_left - crop_right;
+}
+
+uint32_t h264_sps_t::height() const noexcept {
+    return (2 - frame_mbs_only) * height_in_map_units * 16 - crop_top - crop_bottom;
+}
+
+uint32_t h264_sps_t::reorder_depth() const noexcept {
+    if (bitstream_restriction)
+        return max_num_reorder_frames;
+    const bool constraint_set3 = constraint_flags & 0x10;
+    switch (profile_idc) {
+    case 66: // Baseline doesn't have B slices
+        return 0;
+    case 44:
+    case 86:
+    case 100:
+    case 110:
+    case 122:
+    case 244:
+        if (constraint_set3)
+            return 0; // intra profiles
+        break;
+    default:
+        break;
+    }
+    const uint32_t frame_mbs = width_in_mbs * (2 - frame_mbs_only) * height_in_map_units;
+    if (frame_mbs == 0)
+        return 16;
+    return std::min<uint32_t>(get_max_dpb_mbs(level_idc, constraint_set3) / frame_mbs, 16);
+}
+
+video_format_t h264_sps_t::to_format() const noexcept {
+    video_format_t format{pixel_format_t::h264, width(), height(), 0, 1};
+    if (timing_info_present && num_units_in_tick && time_scale) {
+        // a frame is 2 ticks
+        const uint64_t num = time_scale, den = uint64_t{2} * num_units_in_tick;
+        const uint64_t gcd = std::gcd(num, den);
+        format.fps_num = static_cast<uint32_t>(num / gcd);
+        format.fps_den = static_cast<uint32_t>(den / gcd);
+    }
+    return format;
+}
+
+bool parse_sps(const uint8_t* nal, size_t size, h264_sps_t& result) noexcept {
+    if (size < 4 || (nal[0] & 0x1F) != static_cast<uint8_t>(h264_nal_type_t::sps))
+        return false;
+    std::vector<uint8_t> rbsp{};
+    try {
+        unescape_rbsp(nal + 1, size - 1, rbsp);
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+    bit_reader_t reader{rbsp.data(), rbsp.size()};
+    h264_sps_t sps{};
+    sps.profile_idc = reader.read_bits(8);
+    sps.constraint_flags = reader.read_bits(8);
+    sps.level_idc = reader.read_bits(8);
+    sps.sps_id = reader.read_ue();
+    if (sps.sps_id > 31)
+        return false;
+    if (has_chroma_format(sps.profile_idc)) {
+        sps.chroma_format_idc = reader.read_ue();
+        if (sps.chroma_format_idc > 3)
+            return false;
+        if (sps.chroma_format_idc == 3)
+            sps.separate_colour_plane = reader.read_bit();
+        sps.bit_depth_luma = reader.read_ue() + 8;
+        sps.bit_depth_chroma = reader.read_ue() + 8;
+        if (sps.bit_depth_luma > 14 || sps.bit_depth_chroma > 14)
+            return false;
+        sps.transform_bypass = reader.read_bit();
+        sps.scaling_matrix_present = reader.read_bit();
+        if (sps.scaling_matrix_present)
+            for (uint32_t i = 0; i < (sps.chroma_format_idc != 3 ? 8u : 12u); ++i)
+                if (reader.read_bit())
+                    skip_scaling_list(reader, i < 6 ? 16 : 64);
+    }
+    sps.log2_max_frame_num = reader.read_ue() + 4;
+    if (sps.log2_max_frame_num > 16)
+        return false;
+    sps.pic_order_cnt_type = reader.read_ue();
+    if (sps.pic_order_cnt_type == 0) {
+        sps.log2_max_poc_lsb = reader.read_ue() + 4;
+        if (sps.log2_max_poc_lsb > 16)
+            return false;
+    } else if (sps.pic_order_cnt_type == 1) {
+        sps.delta_pic_order_always_zero = reader.read_bit();
+        sps.offset_for_non_ref_pic = reader.read_se();
+        sps.offset_for_top_to_bottom_field = reader.read_se();
+        sps.num_ref_frames_in_poc_cycle = reader.read_ue();
+        if (sps.num_ref_frames_in_poc_cycle > 255)
+            return false;
+        for (uint32_t i = 0; i < sps.num_ref_frames_in_poc_cycle; ++i)
+            sps.offset_for_ref_frame[i] = reader.read_se();
+    } else if (sps.pic_order_cnt_type != 2) {
+        return false;
+    }
+    sps.max_num_ref_frames = reader.read_ue();
+    sps.gaps_in_frame_num_allowed = reader.read_bit();
+    sps.width_in_mbs = reader.read_ue() + 1;
+    sps.height_in_map_units = reader.read_ue() + 1;
+    if (sps.max_num_ref_frames > 16 || sps.width_in_mbs > 1024 || sps.height_in_map_units > 1024)
+        return false;
+    sps.frame_mbs_only = reader.read_bit();
+    if (sps.frame_mbs_only == false)
+        sps.mb_adaptive_frame_field = reader.read_bit();
+    sps.direct_8x8_inference = reader.read_bit();
+    if (reader.read_bit()) { // frame_cropping_flag
+        const uint32_t chroma_array_type = sps.separate_colour_plane ? 0 : sps.chroma_format_idc;
+        const uint32_t sub_width = chroma_array_type == 1 || chroma_array_type == 2 ? 2 : 1;
+        const uint32_t sub_height = chroma_array_type == 1 ? 2 : 1;
+        const uint32_t unit_x = chroma_array_type ? sub_width : 1;
+        const uint32_t unit_y = (chroma_array_type ? sub_height : 1) * (2 - sps.frame_mbs_only);
+        sps.crop_left = reader.read_ue() * unit_x;
+        sps.crop_right = reader.read_ue() * unit_x;
+        sps.crop_top = reader.read_ue() * unit_y;
+        sps.crop_bottom = reader.read_ue() * unit_y;
+        if (sps.crop_left + sps.crop_right >= sps.width_in_mbs * 16 ||
+            sps.crop_top + sps.crop_bottom >= (2 - sps.frame_mbs_only) * sps.height_in_map_units * 16)
+            return false;
+    }
+    sps.vui_present = reader.read_bit();
+    if (sps.vui_present)
+        parse_vui(reader, sps);
+    if (reader.failed())
+        return false;
+    result = sps;
+    return true;
+}
+
+bool parse_pps(const uint8_t* nal, size_t size, h264_pps_t& result) noexcept {
+    if (size < 2 || (nal[0] & 0x1F) != static_cast<uint8_t>(h264_nal_type_t::pps))
+        return false;
+    std::vector<uint8_t> rbsp{};
+    try {
+        unescape_rbsp(nal + 1, size - 1, rbsp);
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+    bit_reader_t reader{rbsp.data(), rbsp.size()};
+    h264_pps_t pps{};
+    pps.pps_id = reader.read_ue();
+    pps.sps_id = reader.read_ue();
+    if (pps.pps_id > 255 || pps.sps_id > 31)
+        return false;
+    pps.entropy_coding_mode = reader.read_bit();
+    pps.bottom_field_pic_order_in_frame_present = reader.read_bit();
+    pps.num_slice_groups = reader.read_ue() + 1;
+    if (pps.num_slice_groups > 8)
+        return false;
+    if (pps.num_slice_groups > 1) {
+        switch (reader.read_ue()) { // slice_group_map_type
+        case 0:
+            for (uint32_t i = 0; i < pps.num_slice_groups; ++i)
+                (void)reader.read_ue(); // run_length_minus1
+            break;
+        case 2:
+            for (uint32_t i = 0; i + 1 < pps.num_slice_groups; ++i) {
+                (void)reader.read_ue(); // top_left
+                (void)reader.read_ue(); // bottom_right
+            }
+            break;
+        case 3:
+        case 4:
+        case 5:
+            reader.skip_bits(1);    // slice_group_change_direction_flag
+            (void)reader.read_ue(); // slice_group_change_rate_minus1
+            break;
+        case 6: {
+            const uint32_t count = reader.read_ue() + 1; // pic_size_in_map_units_minus1
+            uint32_t bits = 0;
+            while ((1u << bits) < pps.num_slice_groups)
+                ++bits;
+            reader.skip_bits(size_t{count} * bits);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    pps.num_ref_idx_l0_default_active = reader.read_ue() + 1;
+    pps.num_ref_idx_l1_default_active = reader.read_ue() + 1;
+    if (pps.num_ref_idx_l0_default_active > 32 || pps.num_ref_idx_l1_default_active > 32)
+        return false;
+    pps.weighted_pred = reader.read_bit();
+    pps.weighted_bipred_idc = reader.read_bits(2);
+    pps.pic_init_qp = 26 + reader.read_se();
+    pps.pic_init_qs = 26 + reader.read_se();
+    pps.chroma_qp_index_offset = reader.read_se();
+    pps.deblocking_filter_control_present = reader.read_bit();
+    pps.constrained_intra_pred = reader.read_bit();
+    pps.redundant_pic_cnt_present = reader.read_bit();
+    pps.second_chroma_qp_index_offset = pps.chroma_qp_index_offset;
+    if (reader.more_rbsp_data()) {
+        pps.transform_8x8_mode = reader.read_bit();
+        pps.scaling_matrix_present = reader.read_bit();
+        if (pps.scaling_matrix_present) // assumes 4:2:0. the SPS is not known here
+            for (uint32_t i = 0; i < 6 + 2u * pps.transform_8x8_mode; ++i)
+                if (reader.read_bit())
+                    skip_scaling_list(reader, i < 6 ? 16 : 64);
+        pps.second_chroma_qp_index_offset = reader.read_se();
+    }
+    if (reader.failed() || pps.pic_init_qp < 0 || pps.pic_init_qp > 51)
+        return false;
+    result = pps;
+    return true;
+}
+
+bool parse_avcc_config(const uint8_t* data, size_t size, h264_avcc_config_t& result) noexcept(false) {
+    if (size < 7 || data[0] != 1) // configurationVersion
+        return false;
+    h264_avcc_config_t config{};
+    config.profile_idc = data[1];
+    config.profile_compatibility = data[2];
+    config.level_idc = data[3];
+    config.length_size = (data[4] & 3) + 1;
+    if (config.length_size == 3)
+        return false;
+    size_t offset = 5;
+    auto read_sets = [data, size, &offset](uint32_t count, std::vector<std::vector<uint8_t>>& sets) {
+        for (uint32_t i = 0; i < count; ++i) {
+            if (offset + 2 > size)
+                return false;
+            const size_t length = (size_t{data[offset]} << 8) | data[offset + 1];
+            offset += 2;
+            if (length == 0 || length > size - offset)
+                return false;
+            sets.emplace_back(data + offset, data + offset + length);
+            offset += length;
+        }
+        return true;
+    };
+    if (read_sets(data[offset++] & 0x1F, config.sps) == false)
+        return false;
+    if (offset >= size || read_sets(data[offset++], config.pps) == false)
+        return false;
+    // the extension of High profiles (chroma_format, bit depth) is in the SPS too
+    result = std::move(config);
+    return true;
+}
+
+std::vector<uint8_t> to_annexb(const h264_avcc_config_t& config) noexcept(false) {
+    std::vector<uint8_t> out{};
+    for (const auto* sets : {&config.sps, &config.pps})
+        for (const auto& set : *sets) {
+            out.insert(out.end(), start_code, start_code + 4);
+            out.insert(out.end(), set.begin(), set.end());
+        }
+    return out;
+}
+
+bool probe_h264(const uint8_t* data, size_t size, h264_sps_t& sps) noexcept {
+    try {
+        if (size > 0 && data[0] == 1) {
+            h264_avcc_config_t config{};
+            if (parse_avcc_config(data, size, config) && config.sps.empty() == false)
+                return parse_sps(config.sps[0].data(), config.sps[0].size(), sps);
+        }
+        std::vector<h264_nal_t> nals{};
+        split_annexb(data, size, nals);
+        for (const h264_nal_t& nal : nals)
+            if (nal.type() == h264_nal_type_t::sps)
+                return parse_sps(nal.data, nal.size, sps);
+    } catch (const std::bad_alloc&) {
+    }
+    return false;
+}
+
+h264_stream_parser_t::h264_stream_parser_t(const video_format_t& _fallback) noexcept : fallback{_fallback} {
+}
+
+const h264_sps_t* h264_stream_parser_t::get_sps() const noexcept {
+    return has_sps ? &sps : nullptr;
+}
+
+video_format_t h264_stream_parser_t::format() const noexcept {
+    video_format_t format = has_sps ? sps.to_format() : fallback;
+    if (format.fps_num == 0) {
+        format.fps_num = fallback.fps_num ? fallback.fps_num : 30;
+        format.fps_den = fallback.fps_num ? fallback.fps_den : 1;
+    }
+    return format;
+}
+
+void h264_stream_parser_t::push(const uint8_t* data, size_t size, std::vector<video_frame_t>& frames) noexcept(false) {
+    buffer.insert(buffer.end(), data, data + size);
+    const uint8_t* begin = buffer.data();
+    const uint8_t* end = begin + buffer.size();
+    const uint8_t* current = find_start_code(begin, end);
+    if (current == end) {
+        // no start code yet. keep the bytes which can be a part of it
+        buffer.erase(buffer.begin(), buffer.end() - std::min<size_t>(buffer.size(), 2));
+        return;
+    }
+    while (true) {
+        // the bytes before `scanned` were searched in the last push
+        const uint8_t* next = find_start_code(std::max(current + 3, begin + scanned), end);
+        if (next == end)
+            break; // the last NAL unit may continue in the next push
+        if (auto length = trim_trailing_zeros(current + 3, next - current - 3); length)
+            consume(h264_nal_t{current + 3, length}, frames);
+        current = next;
+    }
+    // keep from the incomplete NAL unit
+    buffer.erase(buffer.begin(), buffer.begin() + (current - begin));
+    scanned = buffer.size() - 2;
+}
+
+void h264_stream_parser_t::flush(std::vector<video_frame_t>& frames) noexcept(false) {
+    const uint8_t* begin = buffer.data();
+    const uint8_t* end = begin + buffer.size();
+    if (const uint8_t* current = find_start_code(begin, end); current != end)
+        if (auto length = trim_trailing_zeros(current + 3, end - current - 3); length)
+            consume(h264_nal_t{current + 3, length}, frames);
+    buffer.clear();
+    scanned = 0;
+    emit(frames);
+}
+
+/// @see ITU-T H.264 7.4.1.2.3 for the first NAL unit of the next access unit
+void h264_stream_parser_t::consume(const h264_nal_t& nal, std::vector<video_frame_t>& frames) noexcept(false) {
+    const auto type = static_cast<uint32_t>(nal.type());
+    bool starts_unit = false;
+    if (nal.is_vcl()) {
+        // first_mb_in_slice is 0 for the first slice of a picture. arbitrary slice order is not considered
+        bit_reader_t reader{nal.data + 1, std::min<size_t>(nal.size - 1, 8)};
+        starts_unit = unit_has_vcl && reader.read_ue() == 0;
+    } else if (type == 6 || type == 7 || type == 8 || type == 9 || (type >= 14 && type <= 18)) {
+        starts_unit = unit_has_vcl;
+    }
+    if (starts_unit)
+        emit(frames);
+
+    if (nal.type() == h264_nal_type_t::sps) {
+        h264_sps_t parsed{};
+        if (parse_sps(nal.data, nal.size, parsed)) {
+            sps = parsed;
+            has_sps = true;
+        }
+    }
+    if (unit == nullptr)
+        unit = std::make_shared<std::vector<uint8_t>>();
+    unit->insert(unit->end(), start_code, start_code + 4);
+    unit->insert(unit->end(), nal.data, nal.data + nal.size);
+    unit_has_vcl = unit_has_vcl || nal.is_vcl();
+    unit_is_idr = unit_is_idr || nal.type() == h264_nal_type_t::idr;
+}
+
+void h264_stream_parser_t::emit(std::vector<video_frame_t>& frames) noexcept(false) {
+    if (unit == nullptr || unit_has_vcl == false)
+        return;
+    video_frame_t frame{};
+    frame.format = format();
+    frame.planes[0] = {unit->data(), static_cast<uint32_t>(unit->size())};
+    frame.timestamp = next_timestamp;
+    frame.duration = 10'000'000 * static_cast<int64_t>(frame.format.fps_den) / frame.format.fps_num;
+    frame.flags = unit_is_idr ? frame_flag_keyframe : 0u;
+    frame.storage = std::move(unit);
+    next_timestamp += frame.duration;
+    frames.emplace_back(std::move(frame));
+    unit = nullptr;
+    unit_has_vcl = false;
+    unit_is_idr = false;
+}
@@ -0,0 +1,307 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "video_frame.hpp"
+
+/// @see ITU-T H.264 Table 7-1
+enum class h264_nal_type_t : uint8_t {
+    unspecified = 0,
+    slice = 1, // non-IDR
+    slice_a = 2,
+    slice_b = 3,
+    slice_c = 4,
+    idr = 5,
+    sei = 6,
+    sps = 7,
+    pps = 8,
+    aud = 9,
+    end_of_sequence = 10,
+    end_of_stream = 11,
+    filler = 12,
+    sps_ext = 13,
+    prefix = 14,
+    subset_sps = 15,
+    slice_aux = 19,
+    slice_ext = 20,
+};
+
+/// @brief A NAL unit in the bitstream. Starts with the NAL header. The start code or the length is not included
+struct h264_nal_t final {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+  public:
+    [[nodiscard]] h264_nal_type_t type() const noexcept {
+        return static_cast<h264_nal_type_t>(data[0] & 0x1F);
+    }
+    [[nodiscard]] uint32_t ref_idc() const noexcept {
+        return (data[0] >> 5) & 3;
+    }
+    /// @brief The coded slices. Type 1 to 5
+    [[nodiscard]] bool is_vcl() const noexcept {
+        const auto t = data[0] & 0x1F;
+        return t >= 1 && t <= 5;
+    }
+};
+
+/**
+ * @brief Position of the next `00 00 01` in `[begin, end)`. Skips 15 bytes at once with SSE2/NEON
+ * @return `end` if not found
+ */
+[[nodiscard]] const uint8_t* find_start_code(const uint8_t* begin, const uint8_t* end) noexcept;
+
+/**
+ * @brief NAL units of the Annex B stream. The zero bytes before the start codes are not included
+ * @note `nals` is cleared. Keep it to reuse the capacity
+ */
+void split_annexb(const uint8_t* data, size_t size, std::vector<h264_nal_t>& nals) noexcept(false);
+
+/**
+ * @brief NAL units of the length-prefixed stream(AVCC). The sample format of MP4
+ * @param length_size 1, 2 or 4. See `h264_avcc_config_t`
+ * @return false if a length is larger than the rest
+ */
+[[nodiscard]] bool split_avcc(const uint8_t* data, size_t size, uint32_t length_size,
+                              std::vector<h264_nal_t>& nals) noexcept(false);
+
+/**
+ * @brief Replace the 4 byte lengths with the start codes. No copy
+ * @return false if a length is larger than the rest. The buffer may be partially converted
+ */
+[[nodiscard]] bool avcc_to_annexb(uint8_t* data, size_t size) noexcept;
+/// @brief For the 1/2 byte lengths which can't be converted in place. `out` is cleared
+[[nodiscard]] bool avcc_to_annexb(const uint8_t* data, size_t size, uint32_t length_size,
+                                  std::vector<uint8_t>& out) noexcept(false);
+/// @brief Annex B to 4 byte lengths. `out` is cleared
+void annexb_to_avcc(const uint8_t* data, size_t size, std::vector<uint8_t>& out) noexcept(false);
+
+/**
+ * @brief Remove the emulation prevention bytes(`00 00 03`). The result is the RBSP of the NAL unit
+ * @note `out` is cleared
+ */
+void unescape_rbsp(const uint8_t* data, size_t size, std::vector<uint8_t>& out) noexcept(false);
+
+/**
+ * @brief MSB first reader of the RBSP with Exp-Golomb codes
+ * @note Reading after the end returns 0 and sets `failed`. Check it once after the syntax structure
+ * @see ITU-T H.264 9.1
+ */
+class bit_reader_t final {
+    const uint8_t* data;
+    size_t size_bits;
+    size_t position = 0;
+    bool overrun = false;
+
+  public:
+    bit_reader_t(const uint8_t* _data, size_t size) noexcept : data{_data}, size_bits{size * 8} {
+    }
+
+    [[nodiscard]] uint32_t read_bit() noexcept {
+        if (position >= size_bits) {
+            overrun = true;
+            return 0;
+        }
+        const uint32_t bit = (data[position >> 3] >> (7 - (position & 7))) & 1;
+        ++position;
+        return bit;
+    }
+    /// @param count up to 32
+    [[nodiscard]] uint32_t read_bits(uint32_t count) noexcept {
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < count; ++i)
+            value = (value << 1) | read_bit();
+        return value;
+    }
+    /// @brief ue(v)
+    [[nodiscard]] uint32_t read_ue() noexcept {
+        uint32_t zeros = 0;
+        while (read_bit() == 0) {
+            if (overrun || ++zeros > 31) {
+                overrun = true;
+                return 0;
+            }
+        }
+        if (zeros == 0)
+            return 0;
+        return static_cast<uint32_t>((uint64_t{1} << zeros) - 1 + read_bits(zeros));
+    }
+    /// @brief se(v)
+    [[nodiscard]] int32_t read_se() noexcept {
+        const uint32_t code = read_ue();
+        return code & 1 ? static_cast<int32_t>((code + 1) / 2) : -static_cast<int32_t>(code / 2);
+    }
+    void skip_bits(size_t count) noexcept {
+        position += count;
+        if (position > size_bits) {
+            position = size_bits;
+            overrun = true;
+        }
+    }
+
+    [[nodiscard]] bool byte_aligned() const noexcept {
+        return (position & 7) == 0;
+    }
+    [[nodiscard]] size_t bits_left() const noexcept {
+        return size_bits - position;
+    }
+    [[nodiscard]] size_t bit_position() const noexcept {
+        return position;
+    }
+    /// @see ITU-T H.264 7.2 more_rbsp_data
+    [[nodiscard]] bool more_rbsp_data() const noexcept;
+    [[nodiscard]] bool failed() const noexcept {
+        return overrun;
+    }
+};
+
+/// @brief The parameters of the sequence parameter set which are needed for probing and decoding
+/// @see ITU-T H.264 7.3.2.1.1, E.1.1
+struct h264_sps_t final {
+    uint32_t profile_idc = 0;
+    uint32_t constraint_flags = 0; // constraint_set0_flag is the MSB of 8 bits
+    uint32_t level_idc = 0;
+    uint32_t sps_id = 0;
+    uint32_t chroma_format_idc = 1;
+    bool separate_colour_plane = false;
+    uint32_t bit_depth_luma = 8;
+    uint32_t bit_depth_chroma = 8;
+    bool transform_bypass = false;
+    bool scaling_matrix_present = false; // the lists are skipped
+    uint32_t log2_max_frame_num = 4;
+    uint32_t pic_order_cnt_type = 0;
+    uint32_t log2_max_poc_lsb = 4;
+    bool delta_pic_order_always_zero = false;
+    int32_t offset_for_non_ref_pic = 0;
+    int32_t offset_for_top_to_bottom_field = 0;
+    uint32_t num_ref_frames_in_poc_cycle = 0;
+    int32_t offset_for_ref_frame[256]{};
+    uint32_t max_num_ref_frames = 0;
+    bool gaps_in_frame_num_allowed = false;
+    uint32_t width_in_mbs = 0;
+    uint32_t height_in_map_units = 0;
+    bool frame_mbs_only = true;
+    bool mb_adaptive_frame_field = false;
+    bool direct_8x8_inference = false;
+    uint32_t crop_left = 0; // in samples. already multiplied by CropUnitX/Y
+    uint32_t crop_right = 0;
+    uint32_t crop_top = 0;
+    uint32_t crop_bottom = 0;
+
+    bool vui_present = false;
+    uint32_t sar_width = 0;
+    uint32_t sar_height = 0;
+    bool full_range = false;
+    uint32_t colour_primaries = 2; // unspecified
+    uint32_t transfer_characteristics = 2;
+    uint32_t matrix_coefficients = 2;
+    bool timing_info_present = false;
+    uint32_t num_units_in_tick = 0;
+    uint32_t time_scale = 0;
+    bool fixed_frame_rate = false;
+    bool bitstream_restriction = false;
+    uint32_t max_num_reorder_frames = 0;
+    uint32_t max_dec_frame_buffering = 0;
+
+  public:
+    /// @brief Size of the decoded picture after the cropping
+    [[nodiscard]] uint32_t width() const noexcept;
+    [[nodiscard]] uint32_t height() const noexcept;
+    /// @brief Frames the decoder holds before the output. `max_num_reorder_frames` or the inference of E.2.1
+    [[nodiscard]] uint32_t reorder_depth() const noexcept;
+    /// @brief `pixel_format_t::h264` with the size and the frame rate of VUI timing. 0 if not present
+    [[nodiscard]] video_format_t to_format() const noexcept;
+};
+
+/// @brief The parameters of the picture parameter set
+/// @see ITU-T H.264 7.3.2.2
+struct h264_pps_t final {
+    uint32_t pps_id = 0;
+    uint32_t sps_id = 0;
+    bool entropy_coding_mode = false; // CABAC
+    bool bottom_field_pic_order_in_frame_present = false;
+    uint32_t num_slice_groups = 1;
+    uint32_t num_ref_idx_l0_default_active = 1;
+    uint32_t num_ref_idx_l1_default_active = 1;
+    bool weighted_pred = false;
+    uint32_t weighted_bipred_idc = 0;
+    int32_t pic_init_qp = 26;
+    int32_t pic_init_qs = 26;
+    int32_t chroma_qp_index_offset = 0;
+    bool deblocking_filter_control_present = false;
+    bool constrained_intra_pred = false;
+    bool redundant_pic_cnt_present = false;
+    bool transform_8x8_mode = false;
+    bool scaling_matrix_present = false; // the lists are skipped
+    int32_t second_chroma_qp_index_offset = 0;
+};
+
+/**
+ * @param nal the NAL unit with the header. The emulation prevention bytes are removed here
+ * @return false if the syntax is broken or not supported
+ */
+[[nodiscard]] bool parse_sps(const uint8_t* nal, size_t size, h264_sps_t& sps) noexcept;
+[[nodiscard]] bool parse_pps(const uint8_t* nal, size_t size, h264_pps_t& pps) noexcept;
+
+/**
+ * @brief AVCDecoderConfigurationRecord('avcC' box of MP4)
+ * @see ISO/IEC 14496-15 5.3.3.1
+ */
+struct h264_avcc_config_t final {
+    uint32_t profile_idc = 0;
+    uint32_t profile_compatibility = 0;
+    uint32_t level_idc = 0;
+    uint32_t length_size = 4; // lengthSizeMinusOne + 1
+    std::vector<std::vector<uint8_t>> sps{};
+    std::vector<std::vector<uint8_t>> pps{};
+};
+
+[[nodiscard]] bool parse_avcc_config(const uint8_t* data, size_t size, h264_avcc_config_t& config) noexcept(false);
+/// @brief SPS and PPS with the start codes. The form of `MF_MT_MPEG_SEQUENCE_HEADER` for `MFVideoFormat_H264`
+[[nodiscard]] std::vector<uint8_t> to_annexb(const h264_avcc_config_t& config) noexcept(false);
+
+/**
+ * @brief Find the first SPS in the Annex B or the avcC record and parse it. For the probing without a decoder
+ * @return false if there is no valid SPS
+ */
+[[nodiscard]] bool probe_h264(const uint8_t* data, size_t size, h264_sps_t& sps) noexcept;
+
+/**
+ * @brief Splits a raw H.264 elementary stream(Annex B) into the access units. The input can be pushed in pieces.
+ *        Each access unit becomes a `video_frame_t` of `pixel_format_t::h264`.
+ *        IDR ones have `frame_flag_keyframe`.
+ *
+ * @note The elementary stream has no timestamps. They are assigned in decode order with the frame rate of
+ *       VUI timing or the `fallback` format. The decoders output in presentation order with their own reorder
+ * @see ITU-T H.264 7.4.1.2.3
+ */
+class h264_stream_parser_t final {
+    const video_format_t fallback;
+    std::vector<uint8_t> buffer{}; // not parsed yet
+    size_t scanned = 0;            // no start code in `buffer` before this. except the first one
+    std::shared_ptr<std::vector<uint8_t>> unit{};
+    bool unit_has_vcl = false;
+    bool unit_is_idr = false;
+    h264_sps_t sps{};
+    bool has_sps = false;
+    int64_t next_timestamp = 0;
+
+  public:
+    /// @param fallback the frame rate when VUI doesn't have the timing
+    explicit h264_stream_parser_t(const video_format_t& fallback = {pixel_format_t::h264, 0, 0, 30, 1}) noexcept;
+
+    /// @brief Append the data. The complete access units are added to the `frames`
+    void push(const uint8_t* data, size_t size, std::vector<video_frame_t>& frames) noexcept(false);
+    /// @brief The end of the stream. The last access unit is added to the `frames`
+    void flush(std::vector<video_frame_t>& frames) noexcept(false);
+
+    /// @return the last SPS. `nullptr` if not found yet
+    [[nodiscard]] const h264_sps_t* get_sps() const noexcept;
+    [[nodiscard]] video_format_t format() const noexcept;
+
+  private:
+    void consume(const h264_nal_t& nal, std::vector<video_frame_t>& frames) noexcept(false);
+    void emit(std::vector<video_frame_t>& frames) noexcept(false);
+};
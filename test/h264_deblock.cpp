@@ -0,0 +1,179 @@
+#include <cstdlib>
+
+#include "h264_kernels.hpp"
+#include "h264_slice.hpp"
+
+namespace {
+
+/// @brief alpha' and beta' of Table 8-16 for indexA/indexB
+constexpr uint8_t alpha_table[52]{0,  0,  0,  0,  0,  0,  0,  0,  0,   0,   0,   0,   0,   0,   0,   0,   4,   4,
+                                  5,  6,  7,  8,  9,  10, 12, 13, 15,  17,  20,  22,  25,  28,  32,  36,  40,  45,
+                                  50, 56, 63, 71, 80, 90, 101, 113, 127, 144, 162, 182, 203, 226, 255, 255};
+constexpr uint8_t beta_table[52]{0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  0,  0,  0,  0,  2,  2,
+                                 2, 3, 3, 3, 3, 4, 4, 4, 6,  6,  7,  7,  8,  8,  9,  9,  10, 10,
+                                 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18};
+/// @brief tC0' of Table 8-17 for bS 1 to 3
+constexpr int8_t tc0_table[52][3]{
+    {0, 0, 0},   {0, 0, 0},   {0, 0, 0},   {0, 0, 0},   {0, 0, 0},    {0, 0, 0},    {0, 0, 0},    {0, 0, 0},
+    {0, 0, 0},   {0, 0, 0},   {0, 0, 0},   {0, 0, 0},   {0, 0, 0},    {0, 0, 0},    {0, 0, 0},    {0, 0, 0},
+    {0, 0, 0},   {0, 0, 1},   {0, 0, 1},   {0, 0, 1},   {0, 0, 1},    {0, 1, 1},    {0, 1, 1},    {1, 1, 1},
+    {1, 1, 1},   {1, 1, 1},   {1, 1, 1},   {1, 1, 2},   {1, 1, 2},    {1, 1, 2},    {1, 1, 2},    {1, 2, 3},
+    {1, 2, 3},   {2, 2, 3},   {2, 2, 4},   {2, 3, 4},   {2, 3, 4},    {3, 3, 5},    {3, 4, 6},    {3, 4, 6},
+    {4, 5, 7},   {4, 5, 8},   {4, 6, 9},   {5, 7, 10},  {6, 8, 11},   {6, 8, 13},   {7, 10, 14},  {8, 11, 16},
+    {9, 12, 18}, {10, 13, 20}, {11, 15, 23}, {13, 17, 25}};
+
+/// @brief QPc of Table 8-15
+constexpr uint8_t chroma_qp_table[52]{0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15, 16, 17,
+                                      18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 29, 30, 31, 32, 32, 33,
+                                      34, 34, 35, 35, 36, 36, 37, 37, 37, 38, 38, 38, 39, 39, 39, 39};
+
+int32_t clip3(int32_t lower, int32_t upper, int32_t value) noexcept {
+    return value < lower ? lower : (value > upper ? upper : value);
+}
+
+bool mv_differs(const int16_t* a, const int16_t* b) noexcept {
+    return std::abs(a[0] - b[0]) >= 4 || std::abs(a[1] - b[1]) >= 4;
+}
+
+/// @brief The conditions of bS 1 in 8.7.2.1. The pictures are compared with their ids, not the indices
+bool motion_differs(const h264_motion_t& p, const h264_motion_t& q) noexcept {
+    const uint32_t count_p = (p.ref_id[0] != 0) + (p.ref_id[1] != 0);
+    const uint32_t count_q = (q.ref_id[0] != 0) + (q.ref_id[1] != 0);
+    if (count_p != count_q)
+        return true;
+    if (count_p == 1) {
+        const uint32_t list_p = p.ref_id[0] ? 0 : 1, list_q = q.ref_id[0] ? 0 : 1;
+        return p.ref_id[list_p] != q.ref_id[list_q] || mv_differs(p.mv[list_p], q.mv[list_q]);
+    }
+    const bool same_set = (p.ref_id[0] == q.ref_id[0] && p.ref_id[1] == q.ref_id[1]) ||
+                          (p.ref_id[0] == q.ref_id[1] && p.ref_id[1] == q.ref_id[0]);
+    if (same_set == false)
+        return true;
+    const bool straight = mv_differs(p.mv[0], q.mv[0]) || mv_differs(p.mv[1], q.mv[1]);
+    const bool crossed = mv_differs(p.mv[0], q.mv[1]) || mv_differs(p.mv[1], q.mv[0]);
+    if (p.ref_id[0] != p.ref_id[1])
+        return p.ref_id[0] == q.ref_id[0] ? straight : crossed;
+    return straight && crossed;
+}
+
+/// @brief Filters the edges of a macroblock. 8.7
+class macroblock_filter_t final {
+    const h264_picture_context_t& context;
+    const h264_picture_t& picture;
+    const uint32_t mb_x;
+    const uint32_t mb_y;
+    const h264_mb_t& mb;
+    const h264_slice_t& slice;
+    const uint32_t stride4x4;
+
+  public:
+    macroblock_filter_t(const h264_picture_context_t& _context, uint32_t x, uint32_t y) noexcept
+        : context{_context}, picture{*_context.picture}, mb_x{x}, mb_y{y},
+          mb{_context.mbs[y * _context.width_in_mbs + x]}, slice{*_context.slices[mb.slice]},
+          stride4x4{_context.width_in_mbs * 4} {
+    }
+
+    void filter() noexcept {
+        const uint32_t idc = slice.header.disable_deblocking_filter_idc;
+        if (idc == 1)
+            return;
+        const uint32_t addr = mb_y * context.width_in_mbs + mb_x;
+        const h264_mb_t* left = mb_x > 0 ? &context.mbs[addr - 1] : nullptr;
+        const h264_mb_t* top = mb_y > 0 ? &context.mbs[addr - context.width_in_mbs] : nullptr;
+        if (idc == 2) {
+            if (left && left->slice != mb.slice)
+                left = nullptr;
+            if (top && top->slice != mb.slice)
+                top = nullptr;
+        }
+        for (uint32_t pass = 0; pass < 2; ++pass) {
+            const uint32_t vertical = 1 - pass;
+            const h264_mb_t* neighbor = vertical ? left : top;
+            for (uint32_t edge = neighbor ? 0 : 1; edge < 4; ++edge) {
+                int32_t bs[4]{};
+                const h264_mb_t& p = edge ? mb : *neighbor;
+                if (boundary_strength(vertical, edge, p, bs) == false)
+                    continue;
+                filter_luma(vertical, edge, p, bs);
+                if ((edge & 1) == 0)
+                    filter_chroma(vertical, edge, p, bs);
+            }
+        }
+    }
+
+  private:
+    /// @return false if all bS are 0
+    bool boundary_strength(uint32_t vertical, uint32_t edge, const h264_mb_t& p, int32_t* bs) const noexcept {
+        if ((mb.type & mb_intra) || (p.type & mb_intra)) {
+            bs[0] = bs[1] = bs[2] = bs[3] = edge ? 3 : 4;
+            return true;
+        }
+        bool any = false;
+        for (uint32_t i = 0; i < 4; ++i) {
+            // the 4x4 blocks of q0 and p0 in the picture
+            const uint32_t qx = mb_x * 4 + (vertical ? edge : i), qy = mb_y * 4 + (vertical ? i : edge);
+            const uint32_t px = vertical ? qx - 1 : qx, py = vertical ? qy : qy - 1;
+            if (mb.nz[0][(qy & 3) * 4 + (qx & 3)] || p.nz[0][(py & 3) * 4 + (px & 3)])
+                bs[i] = 2;
+            else
+                bs[i] = motion_differs(picture.motion[py * stride4x4 + px], picture.motion[qy * stride4x4 + qx]);
+            any |= bs[i] != 0;
+        }
+        return any;
+    }
+
+    void filter_luma(uint32_t vertical, uint32_t edge, const h264_mb_t& p, const int32_t* bs) const noexcept {
+        const video_frame_t& frame = picture.frame;
+        const auto stride = static_cast<ptrdiff_t>(frame.planes[0].stride);
+        uint8_t* pix = frame.planes[0].data + mb_y * 16 * stride + mb_x * 16 +
+                       (vertical ? edge * 4 : edge * 4 * stride);
+        const int32_t qp = (p.qp + mb.qp + 1) >> 1;
+        const int32_t index_a = clip3(0, 51, qp + slice.header.filter_offset_a);
+        const int32_t index_b = clip3(0, 51, qp + slice.header.filter_offset_b);
+        const int32_t alpha = alpha_table[index_a], beta = beta_table[index_b];
+        const ptrdiff_t across = vertical ? 1 : stride, along = vertical ? stride : 1;
+        if (bs[0] == 4)
+            return h264_deblock_luma_intra(pix, across, along, alpha, beta);
+        int8_t tc0[4]{};
+        for (uint32_t i = 0; i < 4; ++i)
+            tc0[i] = bs[i] ? tc0_table[index_a][bs[i] - 1] : int8_t{-1};
+        h264_deblock_luma(pix, across, along, alpha, beta, tc0);
+    }
+
+    void filter_chroma(uint32_t vertical, uint32_t edge, const h264_mb_t& p, const int32_t* bs) const noexcept {
+        const video_frame_t& frame = picture.frame;
+        const h264_pps_t& pps = *slice.pps;
+        const int32_t offsets[2]{pps.chroma_qp_index_offset, pps.second_chroma_qp_index_offset};
+        for (uint32_t plane = 1; plane < 3; ++plane) {
+            const auto stride = static_cast<ptrdiff_t>(frame.planes[plane].stride);
+            uint8_t* pix = frame.planes[plane].data + mb_y * 8 * stride + mb_x * 8 +
+                           (vertical ? edge * 2 : edge * 2 * stride);
+            const int32_t offset = offsets[plane - 1];
+            const int32_t qp = (chroma_qp_table[clip3(0, 51, p.qp + offset)] +
+                                chroma_qp_table[clip3(0, 51, mb.qp + offset)] + 1) >>
+                               1;
+            const int32_t index_a = clip3(0, 51, qp + slice.header.filter_offset_a);
+            const int32_t index_b = clip3(0, 51, qp + slice.header.filter_offset_b);
+            const int32_t alpha = alpha_table[index_a], beta = beta_table[index_b];
+            const ptrdiff_t across = vertical ? 1 : stride, along = vertical ? stride : 1;
+            if (bs[0] == 4) {
+                h264_deblock_chroma_intra(pix, across, along, alpha, beta);
+                continue;
+            }
+            int8_t tc0[4]{};
+            for (uint32_t i = 0; i < 4; ++i)
+                tc0[i] = bs[i] ? tc0_table[index_a][bs[i] - 1] : int8_t{-1};
+            h264_deblock_chroma(pix, across, along, alpha, beta, tc0);
+        }
+    }
+};
+
+} // namespace
+
+void h264_deblock_picture(h264_picture_context_t& context) noexcept {
+    // the vertical edges and then the horizontal ones for each macroblock in the raster order
+    for (uint32_t y = 0; y < context.height_in_mbs; ++y)
+        for (uint32_t x = 0; x < context.width_in_mbs; ++x)
+            if (context.mbs[y * context.width_in_mbs + x].slice < context.slices.size()) // not concealed
+                macroblock_filter_t{context, x, y}.filter();
+}
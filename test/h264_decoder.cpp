@@ -0,0 +1,986 @@
+#include "h264_decoder.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+#include "h264.hpp"
+#include "h264_slice.hpp"
+#include "pipeline.hpp"
+#include "video_kernels.hpp"
+
+namespace {
+
+/// @brief `h264_mb_t::slice` of the macroblocks which no slice has decoded
+constexpr uint16_t missing_slice = UINT16_MAX;
+
+/// @brief A picture to output or the size change before the next ones
+struct output_t final {
+    video_frame_t frame{};
+    bool change = false;
+    video_format_t format{};
+};
+
+bool starts_with_start_code(const uint8_t* data, size_t size) noexcept {
+    if (size < 4 || data[0] != 0 || data[1] != 0)
+        return false;
+    return data[2] == 1 || (data[2] == 0 && data[3] == 1);
+}
+
+/// @brief The first slice of a new picture. 7.4.1.2.4
+bool is_new_picture(const h264_slice_header_t& prev, const h264_slice_header_t& next,
+                    const h264_sps_t& sps) noexcept {
+    if (next.first_mb == 0 || next.frame_num != prev.frame_num || next.pps_id != prev.pps_id)
+        return true;
+    if ((next.nal_ref_idc == 0) != (prev.nal_ref_idc == 0) || next.is_idr() != prev.is_idr())
+        return true;
+    if (next.is_idr() && next.idr_pic_id != prev.idr_pic_id)
+        return true;
+    if (sps.pic_order_cnt_type == 0)
+        return next.poc_lsb != prev.poc_lsb || next.delta_poc_bottom != prev.delta_poc_bottom;
+    if (sps.pic_order_cnt_type == 1)
+        return next.delta_poc[0] != prev.delta_poc[0] || next.delta_poc[1] != prev.delta_poc[1];
+    return false;
+}
+
+/// @brief The same decoded picture size and cropping
+bool same_size(const h264_sps_t& lhs, const h264_sps_t& rhs) noexcept {
+    return lhs.width_in_mbs == rhs.width_in_mbs && lhs.height_in_map_units == rhs.height_in_map_units &&
+           lhs.crop_left == rhs.crop_left && lhs.crop_right == rhs.crop_right && lhs.crop_top == rhs.crop_top &&
+           lhs.crop_bottom == rhs.crop_bottom;
+}
+
+} // namespace
+
+struct cpu_h264_decoder_t::state_t final {
+    video_format_t input_format{};
+    video_format_t output_format{};
+    video_format_t announced{}; // the output format after the queued size changes
+    std::shared_ptr<frame_pool_t> output_pool{};
+    std::unique_ptr<frame_pool_t> convert_pool{};
+    uint32_t length_size = 4;
+    bool avcc = false; // from the avcC record. the start codes are guessed without it
+
+    h264_parameter_sets_t sets{};
+    std::shared_ptr<const h264_sps_t> sps{}; // of the last picture
+    std::unique_ptr<frame_pool_t> picture_pool{};
+    std::vector<std::unique_ptr<h264_picture_t>> pictures{}; // the DPB and the free ones
+    h264_picture_t* current = nullptr;
+    h264_picture_context_t context{};
+    std::vector<std::unique_ptr<h264_slice_t>> slices{}; // `slice_count` of the current picture. reused
+    size_t slice_count = 0;
+    std::vector<h264_nal_t> nals{};
+    uint32_t next_id = 1;
+    bool wait_for_recovery = false;
+    video_frame_t last_reference{}; // the pixels of the inferred frames for the gaps of frame_num
+
+    // 8.2.1 and 8.2.5
+    int32_t prev_poc_msb = 0;
+    int32_t prev_poc_lsb = 0;
+    int32_t prev_frame_num_offset = 0;
+    uint32_t prev_frame_num = 0;
+    uint32_t prev_ref_frame_num = 0;
+    int32_t poc_msb = 0;
+    int32_t frame_num_offset = 0;
+    int32_t top_poc = 0;
+    int32_t bottom_poc = 0;
+    uint32_t max_long_term_frame_idx = 0; // MaxLongTermFrameIdx + 1. 0 for "no long-term frame indices"
+
+    std::priority_queue<int64_t, std::vector<int64_t>, std::greater<>> timestamps{};
+    std::deque<output_t> outputs{};
+
+    band_pool_t pool;
+    std::vector<std::unique_ptr<h264_slice_decoder_t>> decoders{}; // one for each thread of `pool`
+
+  public:
+    explicit state_t(size_t num_threads) noexcept(false);
+    state_t(const state_t&) = delete;
+    state_t(state_t&&) = delete;
+    state_t& operator=(const state_t&) = delete;
+    state_t& operator=(state_t&&) = delete;
+
+    bool add_parameter_sets(const uint8_t* data, size_t size) noexcept(false);
+    transform_result_t decode(const video_frame_t& input) noexcept(false);
+    void finish_picture() noexcept(false);
+    void drain() noexcept(false);
+    void reset() noexcept;
+    video_frame_t make_output(const video_frame_t& frame) noexcept(false);
+
+  private:
+    bool add_parameter_set(const h264_nal_t& nal) noexcept(false);
+    transform_result_t add_slice(const h264_nal_t& nal, const video_frame_t& input) noexcept(false);
+    transform_result_t start_picture(const h264_slice_t& slice, const video_frame_t& input) noexcept(false);
+    void activate(const std::shared_ptr<const h264_sps_t>& next) noexcept(false);
+    void fill_frame_num_gap(const h264_slice_header_t& header) noexcept(false);
+    void compute_poc(const h264_slice_header_t& header) noexcept;
+    h264_picture_t* acquire_picture() noexcept(false);
+    void release_unused() noexcept;
+
+    int32_t pic_num(const h264_picture_t& picture, uint32_t frame_num) const noexcept;
+    void build_ref_lists(h264_slice_t& slice) noexcept(false);
+    void modify_ref_list(const h264_slice_t& slice, uint32_t list, std::vector<h264_picture_t*>& refs) const
+        noexcept(false);
+    void mark_references(h264_picture_t& picture, const h264_slice_header_t& header) noexcept;
+    void sliding_window(const h264_picture_t& picture) noexcept;
+
+    void bump(bool all) noexcept(false);
+    void output(h264_picture_t& picture) noexcept(false);
+
+    void decode_slices() noexcept;
+    void conceal() noexcept;
+};
+
+cpu_h264_decoder_t::state_t::state_t(size_t num_threads) noexcept(false) : pool{num_threads} {
+    for (size_t i = 0; i < pool.size(); ++i)
+        decoders.emplace_back(std::make_unique<h264_slice_decoder_t>());
+}
+
+bool cpu_h264_decoder_t::state_t::add_parameter_sets(const uint8_t* data, size_t size) noexcept(false) {
+    std::vector<h264_nal_t> units{};
+    if (size > 0 && data[0] == 1) {
+        h264_avcc_config_t config{};
+        if (parse_avcc_config(data, size, config) == false)
+            return false;
+        length_size = config.length_size;
+        avcc = true;
+        bool found = false;
+        for (const auto* list : {&config.sps, &config.pps})
+            for (const auto& unit : *list)
+                found |= unit.empty() == false && add_parameter_set(h264_nal_t{unit.data(), unit.size()});
+        return found;
+    }
+    split_annexb(data, size, units);
+    bool found = false;
+    for (const auto& unit : units)
+        found |= add_parameter_set(unit);
+    return found;
+}
+
+bool cpu_h264_decoder_t::state_t::add_parameter_set(const h264_nal_t& nal) noexcept(false) {
+    if (nal.size == 0)
+        return false;
+    if (nal.type() == h264_nal_type_t::sps) {
+        auto parsed = std::make_shared<h264_sps_t>();
+        if (parse_sps(nal.data, nal.size, *parsed) == false) {
+            spdlog::warn("{}: {}", "cpu_h264_decoder_t", "skipped a broken SPS");
+            return false;
+        }
+        sets.sps[parsed->sps_id] = std::move(parsed);
+        return true;
+    }
+    if (nal.type() == h264_nal_type_t::pps) {
+        auto parsed = std::make_shared<h264_pps_t>();
+        if (parse_pps(nal.data, nal.size, *parsed) == false) {
+            spdlog::warn("{}: {}", "cpu_h264_decoder_t", "skipped a broken PPS");
+            return false;
+        }
+        sets.pps[parsed->pps_id] = std::move(parsed);
+        return true;
+    }
+    return false;
+}
+
+transform_result_t cpu_h264_decoder_t::state_t::decode(const video_frame_t& input) noexcept(false) {
+    const uint8_t* data = input.planes[0].data;
+    const size_t size = input.planes[0].stride;
+    // a length prefix like 00 00 01 xx is also a start code. the record tells which one
+    if (avcc == false && starts_with_start_code(data, size)) {
+        split_annexb(data, size, nals);
+    } else if (split_avcc(data, size, length_size, nals) == false) {
+        spdlog::warn("{}: {}", "cpu_h264_decoder_t", "skipped a broken sample");
+        return transform_result_t::ok;
+    }
+    for (const h264_nal_t& nal : nals) {
+        if (nal.size == 0)
+            continue;
+        switch (nal.type()) {
+        case h264_nal_type_t::sps:
+        case h264_nal_type_t::pps:
+            add_parameter_set(nal);
+            break;
+        case h264_nal_type_t::slice:
+        case h264_nal_type_t::idr:
+            if (auto result = add_slice(nal, input); result != transform_result_t::ok)
+                return result;
+            break;
+        case h264_nal_type_t::aud:
+        case h264_nal_type_t::end_of_sequence:
+        case h264_nal_type_t::end_of_stream:
+            if (current)
+                finish_picture();
+            break;
+        default:
+            break;
+        }
+    }
+    // the inputs are access units
+    if (current)
+        finish_picture();
+    return transform_result_t::ok;
+}
+
+transform_result_t cpu_h264_decoder_t::state_t::add_slice(const h264_nal_t& nal, const video_frame_t& input) noexcept(
+    false) {
+    if (slice_count == slices.size())
+        slices.emplace_back(std::make_unique<h264_slice_t>());
+    h264_slice_t& slice = *slices[slice_count];
+    unescape_rbsp(nal.data, nal.size, slice.rbsp);
+    slice.rbsp_size = slice.rbsp.size();
+    slice.rbsp.resize(slice.rbsp_size + h264_slice_padding, 0);
+    if (parse_slice_header(slice.rbsp.data(), slice.rbsp_size, sets, slice.header, slice.sps, slice.pps) == false) {
+        // the supported streams don't reach here unless broken
+        if ((slice.sps && h264_is_supported(*slice.sps) == false) ||
+            (slice.pps && h264_is_supported(*slice.pps) == false)) {
+            spdlog::error("{}: {}", "cpu_h264_decoder_t", "the stream uses the features out of the scope");
+            return transform_result_t::invalid_format;
+        }
+        spdlog::warn("{}: {}", "cpu_h264_decoder_t", "skipped a broken slice header");
+        return transform_result_t::ok;
+    }
+    if (wait_for_recovery) {
+        if (slice.header.is_idr() == false && slice.header.slice_type != h264_slice_type_t::i)
+            return transform_result_t::ok;
+        wait_for_recovery = false;
+    }
+    if (current && is_new_picture(slices[0]->header, slice.header, *slices[0]->sps)) {
+        const size_t index = slice_count;
+        finish_picture();
+        std::swap(slices[0], slices[index]);
+    }
+    h264_slice_t& added = *slices[slice_count];
+    if (current == nullptr)
+        if (auto result = start_picture(added, input); result != transform_result_t::ok)
+            return result;
+    if (added.header.first_mb >= context.mbs.size())
+        return transform_result_t::ok;
+    added.index = static_cast<uint16_t>(slice_count);
+    build_ref_lists(added);
+    context.slices.emplace_back(&added);
+    ++slice_count;
+    return transform_result_t::ok;
+}
+
+transform_result_t cpu_h264_decoder_t::state_t::start_picture(const h264_slice_t& slice,
+                                                              const video_frame_t& input) noexcept(false) {
+    const h264_slice_header_t& header = slice.header;
+    activate(slice.sps);
+    if (header.is_idr()) {
+        // C.4.4. the prior pictures are output. no_output_of_prior_pics_flag is not followed
+        bump(true);
+        for (auto& picture : pictures)
+            picture->short_term = picture->long_term = false;
+        release_unused();
+    } else {
+        fill_frame_num_gap(header);
+    }
+    compute_poc(header);
+
+    h264_picture_t* picture = acquire_picture();
+    picture->poc = std::min(top_poc, bottom_poc);
+    picture->frame_num = header.frame_num;
+    picture->idr = header.is_idr();
+    picture->timestamp = input.timestamp;
+    picture->duration = input.duration;
+    timestamps.push(input.timestamp);
+    context.picture = picture;
+    context.slices.clear();
+    for (auto& mb : context.mbs)
+        mb.slice = missing_slice;
+    current = picture;
+    return transform_result_t::ok;
+}
+
+/// @brief Change the size of the pictures. The pictures of the previous size are output
+void cpu_h264_decoder_t::state_t::activate(const std::shared_ptr<const h264_sps_t>& next) noexcept(false) {
+    const bool same = sps && same_size(*sps, *next);
+    sps = next;
+    if (same)
+        return;
+    bump(true);
+    for (auto& picture : pictures)
+        picture->short_term = picture->long_term = false;
+    release_unused();
+    pictures.clear();
+    last_reference = video_frame_t{};
+    const video_format_t format{pixel_format_t::i420, next->width_in_mbs * 16, next->height_in_map_units * 16};
+    const size_t max_idle = next->max_num_ref_frames + next->reorder_depth() + 2;
+    picture_pool = std::make_unique<frame_pool_t>(format, max_idle);
+    context.width_in_mbs = next->width_in_mbs;
+    context.height_in_mbs = next->height_in_map_units;
+    context.mbs.assign(static_cast<size_t>(context.width_in_mbs) * context.height_in_mbs, h264_mb_t{});
+
+    video_format_t changed = announced;
+    changed.width = next->width();
+    changed.height = next->height();
+    if (changed.fps_num == 0) {
+        const video_format_t timing = next->to_format();
+        changed.fps_num = timing.fps_num;
+        changed.fps_den = timing.fps_den;
+    }
+    if (changed != announced) {
+        announced = changed;
+        outputs.emplace_back(output_t{video_frame_t{}, true, changed});
+    }
+}
+
+/// @brief 8.2.5.2. The frames for the missing frame_num are marked as short-term without the pixels
+void cpu_h264_decoder_t::state_t::fill_frame_num_gap(const h264_slice_header_t& header) noexcept(false) {
+    const uint32_t max_frame_num = 1u << sps->log2_max_frame_num;
+    if (header.frame_num == prev_ref_frame_num || header.frame_num == (prev_ref_frame_num + 1) % max_frame_num)
+        return;
+    if (static_cast<bool>(last_reference) == false) {
+        prev_ref_frame_num = header.frame_num; // after flush. nothing to refer
+        return;
+    }
+    uint32_t unused = (prev_ref_frame_num + 1) % max_frame_num;
+    // the older ones leave the sliding window anyway
+    const uint32_t gap = (header.frame_num + max_frame_num - unused) % max_frame_num;
+    if (gap > sps->max_num_ref_frames)
+        unused = (header.frame_num + max_frame_num - sps->max_num_ref_frames) % max_frame_num;
+    while (unused != header.frame_num) {
+        h264_picture_t* picture = acquire_picture();
+        picture->frame = last_reference;
+        picture->frame_num = unused;
+        picture->non_existing = true;
+        picture->needed_for_output = false;
+        std::fill(picture->motion.begin(), picture->motion.end(), h264_motion_t{});
+        std::fill(picture->intra.begin(), picture->intra.end(), uint8_t{1});
+        sliding_window(*picture);
+        picture->short_term = true;
+        prev_frame_num = prev_ref_frame_num = unused;
+        unused = (unused + 1) % max_frame_num;
+    }
+}
+
+/// @brief 8.2.1 for the frames
+void cpu_h264_decoder_t::state_t::compute_poc(const h264_slice_header_t& header) noexcept {
+    const uint32_t max_frame_num = 1u << sps->log2_max_frame_num;
+    if (sps->pic_order_cnt_type == 0) {
+        if (header.is_idr())
+            prev_poc_msb = prev_poc_lsb = 0;
+        const auto max_lsb = static_cast<int32_t>(1u << sps->log2_max_poc_lsb);
+        const auto lsb = static_cast<int32_t>(header.poc_lsb);
+        poc_msb = prev_poc_msb;
+        if (lsb < prev_poc_lsb && prev_poc_lsb - lsb >= max_lsb / 2)
+            poc_msb = prev_poc_msb + max_lsb;
+        else if (lsb > prev_poc_lsb && lsb - prev_poc_lsb > max_lsb / 2)
+            poc_msb = prev_poc_msb - max_lsb;
+        top_poc = poc_msb + lsb;
+        bottom_poc = top_poc + header.delta_poc_bottom;
+        return;
+    }
+    if (header.is_idr())
+        frame_num_offset = 0;
+    else if (prev_frame_num > header.frame_num)
+        frame_num_offset = prev_frame_num_offset + static_cast<int32_t>(max_frame_num);
+    else
+        frame_num_offset = prev_frame_num_offset;
+    const auto frame_num = static_cast<int32_t>(header.frame_num);
+    if (sps->pic_order_cnt_type == 2) {
+        int32_t poc = 0;
+        if (header.is_idr() == false)
+            poc = header.nal_ref_idc == 0 ? 2 * (frame_num_offset + frame_num) - 1 : 2 * (frame_num_offset + frame_num);
+        top_poc = bottom_poc = poc;
+        return;
+    }
+    const auto cycle = static_cast<int32_t>(sps->num_ref_frames_in_poc_cycle);
+    int32_t abs_frame_num = cycle != 0 ? frame_num_offset + frame_num : 0;
+    if (header.nal_ref_idc == 0 && abs_frame_num > 0)
+        --abs_frame_num;
+    int32_t expected = 0;
+    if (abs_frame_num > 0) {
+        int32_t delta_per_cycle = 0;
+        for (int32_t i = 0; i < cycle; ++i)
+            delta_per_cycle += sps->offset_for_ref_frame[i];
+        const int32_t count = (abs_frame_num - 1) / cycle, in_cycle = (abs_frame_num - 1) % cycle;
+        expected = count * delta_per_cycle;
+        for (int32_t i = 0; i <= in_cycle; ++i)
+            expected += sps->offset_for_ref_frame[i];
+    }
+    if (header.nal_ref_idc == 0)
+        expected += sps->offset_for_non_ref_pic;
+    top_poc = expected + header.delta_poc[0];
+    bottom_poc = top_poc + sps->offset_for_top_to_bottom_field + header.delta_poc[1];
+}
+
+h264_picture_t* cpu_h264_decoder_t::state_t::acquire_picture() noexcept(false) {
+    h264_picture_t* picture = nullptr;
+    for (auto& candidate : pictures) {
+        if (candidate.get() != current && candidate->is_reference() == false && candidate->needed_for_output == false) {
+            picture = candidate.get();
+            break;
+        }
+    }
+    if (picture == nullptr)
+        picture = pictures.emplace_back(std::make_unique<h264_picture_t>()).get();
+    std::vector<h264_motion_t> motion = std::move(picture->motion);
+    std::vector<uint8_t> intra = std::move(picture->intra);
+    *picture = h264_picture_t{};
+    const size_t blocks = static_cast<size_t>(context.width_in_mbs) * context.height_in_mbs * 16;
+    motion.resize(blocks);
+    intra.resize(blocks / 16);
+    picture->motion = std::move(motion);
+    picture->intra = std::move(intra);
+    picture->frame = picture_pool->acquire();
+    picture->id = next_id++;
+    if (next_id == 0)
+        next_id = 1;
+    return picture;
+}
+
+/// @brief The pictures which are neither referenced nor waiting for the output give the buffers back
+void cpu_h264_decoder_t::state_t::release_unused() noexcept {
+    for (auto& picture : pictures)
+        if (picture.get() != current && picture->is_reference() == false && picture->needed_for_output == false)
+            picture->frame = video_frame_t{};
+}
+
+/// @brief PicNum of the short-term frames and LongTermPicNum of the long-term ones. 8.2.4.1
+int32_t cpu_h264_decoder_t::state_t::pic_num(const h264_picture_t& picture, uint32_t frame_num) const noexcept {
+    if (picture.long_term)
+        return static_cast<int32_t>(picture.long_term_frame_idx);
+    const auto max_frame_num = static_cast<int32_t>(1u << sps->log2_max_frame_num);
+    const auto value = static_cast<int32_t>(picture.frame_num);
+    return picture.frame_num > frame_num ? value - max_frame_num : value;
+}
+
+/// @brief 8.2.4.2 and 8.2.4.3. The missing entries are replaced to conceal the errors
+void cpu_h264_decoder_t::state_t::build_ref_lists(h264_slice_t& slice) noexcept(false) {
+    const h264_slice_header_t& header = slice.header;
+    std::memset(slice.ref_list, 0, sizeof(slice.ref_list));
+    if (header.slice_type == h264_slice_type_t::i)
+        return;
+    std::vector<h264_picture_t*> short_terms{}, long_terms{};
+    for (auto& picture : pictures) {
+        if (picture.get() == current)
+            continue;
+        if (picture->short_term)
+            short_terms.emplace_back(picture.get());
+        else if (picture->long_term)
+            long_terms.emplace_back(picture.get());
+    }
+    std::sort(long_terms.begin(), long_terms.end(), [](const h264_picture_t* lhs, const h264_picture_t* rhs) {
+        return lhs->long_term_frame_idx < rhs->long_term_frame_idx;
+    });
+    std::vector<h264_picture_t*> lists[2]{};
+    if (header.slice_type == h264_slice_type_t::p) {
+        std::sort(short_terms.begin(), short_terms.end(), [this, &header](const auto* lhs, const auto* rhs) {
+            return pic_num(*lhs, header.frame_num) > pic_num(*rhs, header.frame_num);
+        });
+        lists[0] = short_terms;
+        lists[0].insert(lists[0].end(), long_terms.begin(), long_terms.end());
+    } else {
+        const int32_t poc = current->poc;
+        std::vector<h264_picture_t*> before{}, after{};
+        for (auto* picture : short_terms)
+            (picture->poc < poc ? before : after).emplace_back(picture);
+        std::sort(before.begin(), before.end(), [](const auto* lhs, const auto* rhs) { return lhs->poc > rhs->poc; });
+        std::sort(after.begin(), after.end(), [](const auto* lhs, const auto* rhs) { return lhs->poc < rhs->poc; });
+        lists[0] = before;
+        lists[0].insert(lists[0].end(), after.begin(), after.end());
+        lists[0].insert(lists[0].end(), long_terms.begin(), long_terms.end());
+        lists[1] = after;
+        lists[1].insert(lists[1].end(), before.begin(), before.end());
+        lists[1].insert(lists[1].end(), long_terms.begin(), long_terms.end());
+        if (lists[1].size() > 1 && lists[0] == lists[1])
+            std::swap(lists[1][0], lists[1][1]);
+    }
+    h264_picture_t* fallback = short_terms.empty() ? (long_terms.empty() ? current : long_terms[0]) : short_terms[0];
+    for (uint32_t list = 0; list < 2; ++list) {
+        const uint32_t count = header.num_ref_idx_active[list];
+        if (count == 0)
+            continue;
+        std::vector<h264_picture_t*>& refs = lists[list];
+        refs.resize(count, nullptr);
+        modify_ref_list(slice, list, refs);
+        for (uint32_t i = 0; i < count; ++i) {
+            slice.ref_list[list][i] = refs[i] ? refs[i] : (refs[0] ? refs[0] : fallback);
+            if (refs[i] == nullptr)
+                spdlog::warn("{}: {} {} of the list {}", "cpu_h264_decoder_t", "missing reference", i, list);
+        }
+    }
+}
+
+void cpu_h264_decoder_t::state_t::modify_ref_list(const h264_slice_t& slice, uint32_t list,
+                                                  std::vector<h264_picture_t*>& refs) const noexcept(false) {
+    const h264_slice_header_t& header = slice.header;
+    if (header.modifications[list].empty())
+        return;
+    const auto count = static_cast<uint32_t>(refs.size());
+    refs.resize(count + 1, nullptr);
+    const auto max_pic_num = static_cast<int32_t>(1u << sps->log2_max_frame_num);
+    const auto curr_pic_num = static_cast<int32_t>(header.frame_num);
+    int32_t pred = curr_pic_num;
+    uint32_t index = 0;
+    for (const auto& [idc, value] : header.modifications[list]) {
+        if (index >= count)
+            break;
+        std::function<bool(const h264_picture_t*)> match{};
+        if (idc < 2) {
+            const auto diff = static_cast<int32_t>(value) + 1;
+            int32_t no_wrap = idc == 0 ? pred - diff : pred + diff;
+            if (no_wrap < 0)
+                no_wrap += max_pic_num;
+            else if (no_wrap >= max_pic_num)
+                no_wrap -= max_pic_num;
+            pred = no_wrap;
+            const int32_t target = no_wrap > curr_pic_num ? no_wrap - max_pic_num : no_wrap;
+            match = [this, target, &header](const h264_picture_t* picture) {
+                return picture && picture->short_term && pic_num(*picture, header.frame_num) == target;
+            };
+        } else {
+            match = [value = value](const h264_picture_t* picture) {
+                return picture && picture->long_term && picture->long_term_frame_idx == value;
+            };
+        }
+        h264_picture_t* found = nullptr;
+        for (const auto& picture : pictures)
+            if (picture.get() != current && match(picture.get()))
+                found = picture.get();
+        for (uint32_t i = count; i > index; --i)
+            refs[i] = refs[i - 1];
+        refs[index++] = found;
+        uint32_t kept = index;
+        for (uint32_t i = index; i <= count; ++i)
+            if (match(refs[i]) == false)
+                refs[kept++] = refs[i];
+    }
+    refs.resize(count);
+}
+
+/// @brief 8.2.5.3
+void cpu_h264_decoder_t::state_t::sliding_window(const h264_picture_t& picture) noexcept {
+    const uint32_t max_refs = std::max<uint32_t>(sps->max_num_ref_frames, 1);
+    while (true) {
+        uint32_t count = 0;
+        h264_picture_t* oldest = nullptr;
+        for (auto& candidate : pictures) {
+            if (candidate.get() == &picture || candidate->is_reference() == false)
+                continue;
+            ++count;
+            if (candidate->short_term &&
+                (oldest == nullptr || pic_num(*candidate, picture.frame_num) < pic_num(*oldest, picture.frame_num)))
+                oldest = candidate.get();
+        }
+        if (count < max_refs || oldest == nullptr)
+            return;
+        oldest->short_term = false;
+    }
+}
+
+/// @brief 8.2.5.1 after the picture is decoded
+void cpu_h264_decoder_t::state_t::mark_references(h264_picture_t& picture, const h264_slice_header_t& header) noexcept {
+    if (header.is_idr()) {
+        for (auto& other : pictures)
+            if (other.get() != &picture)
+                other->short_term = other->long_term = false;
+        if (header.long_term_reference) {
+            picture.long_term = true;
+            picture.long_term_frame_idx = 0;
+            max_long_term_frame_idx = 1;
+        } else {
+            picture.short_term = true;
+            max_long_term_frame_idx = 0;
+        }
+        return;
+    }
+    if (header.adaptive_ref_pic_marking == false) {
+        sliding_window(picture);
+        picture.short_term = true;
+        return;
+    }
+    const auto curr_pic_num = static_cast<int32_t>(header.frame_num);
+    const auto release_long_term = [this, &picture](uint32_t index) {
+        for (auto& other : pictures)
+            if (other.get() != &picture && other->long_term && other->long_term_frame_idx == index)
+                other->long_term = false;
+    };
+    bool long_term = false;
+    for (const h264_mmco_t& mmco : header.mmcos) {
+        switch (mmco.operation) {
+        case 1:
+        case 3: {
+            const int32_t target = curr_pic_num - static_cast<int32_t>(mmco.difference_of_pic_nums);
+            for (auto& other : pictures) {
+                if (other.get() == &picture || other->short_term == false ||
+                    pic_num(*other, header.frame_num) != target)
+                    continue;
+                if (mmco.operation == 3) {
+                    release_long_term(mmco.long_term_frame_idx);
+                    other->long_term = true;
+                    other->long_term_frame_idx = mmco.long_term_frame_idx;
+                }
+                other->short_term = false;
+            }
+            break;
+        }
+        case 2:
+            for (auto& other : pictures)
+                if (other.get() != &picture && other->long_term &&
+                    other->long_term_frame_idx == mmco.long_term_pic_num)
+                    other->long_term = false;
+            break;
+        case 4:
+            max_long_term_frame_idx = mmco.max_long_term_frame_idx_plus1;
+            for (auto& other : pictures)
+                if (other.get() != &picture && other->long_term &&
+                    other->long_term_frame_idx + 1 > max_long_term_frame_idx)
+                    other->long_term = false;
+            break;
+        case 5:
+            for (auto& other : pictures)
+                if (other.get() != &picture)
+                    other->short_term = other->long_term = false;
+            max_long_term_frame_idx = 0;
+            picture.mmco5 = true;
+            break;
+        case 6:
+            release_long_term(mmco.long_term_frame_idx);
+            picture.long_term = true;
+            picture.long_term_frame_idx = mmco.long_term_frame_idx;
+            long_term = true;
+            break;
+        default:
+            break;
+        }
+    }
+    if (long_term == false)
+        picture.short_term = true;
+}
+
+void cpu_h264_decoder_t::state_t::finish_picture() noexcept(false) {
+    decode_slices();
+    conceal();
+    h264_deblock_picture(context);
+
+    h264_picture_t& picture = *current;
+    const h264_slice_header_t& header = slices[0]->header;
+    const bool reference = header.nal_ref_idc != 0;
+    if (reference) {
+        mark_references(picture, header);
+        last_reference = picture.frame;
+    }
+    if (picture.mmco5) {
+        // 8.2.1. the picture is treated as frame_num 0 and POC 0 by the next ones
+        const int32_t poc = std::min(top_poc, bottom_poc);
+        top_poc -= poc;
+        bottom_poc -= poc;
+        picture.poc = 0;
+        picture.frame_num = 0;
+        bump(true);
+    }
+    if (sps->pic_order_cnt_type == 0) {
+        if (reference) {
+            prev_poc_msb = picture.mmco5 ? 0 : poc_msb;
+            prev_poc_lsb = picture.mmco5 ? top_poc : static_cast<int32_t>(header.poc_lsb);
+        }
+    } else {
+        prev_frame_num_offset = picture.mmco5 ? 0 : frame_num_offset;
+    }
+    prev_frame_num = picture.frame_num;
+    if (reference)
+        prev_ref_frame_num = picture.frame_num;
+
+    current = nullptr;
+    slice_count = 0;
+    context.slices.clear();
+    picture.needed_for_output = true;
+    bump(false);
+    release_unused();
+}
+
+void cpu_h264_decoder_t::state_t::drain() noexcept(false) {
+    if (current)
+        finish_picture();
+    bump(true);
+    release_unused();
+}
+
+/// @brief Discard everything but the parameter sets and the worker threads
+void cpu_h264_decoder_t::state_t::reset() noexcept {
+    current = nullptr;
+    slice_count = 0;
+    context.slices.clear();
+    for (auto& picture : pictures) {
+        picture->short_term = picture->long_term = picture->needed_for_output = false;
+        picture->frame = video_frame_t{};
+    }
+    last_reference = video_frame_t{};
+    timestamps = {};
+    // the size changes stay. they have to reach the consumer
+    outputs.erase(std::remove_if(outputs.begin(), outputs.end(), [](const output_t& item) { return !item.change; }),
+                  outputs.end());
+    prev_poc_msb = prev_poc_lsb = prev_frame_num_offset = 0;
+    prev_frame_num = prev_ref_frame_num = 0;
+    max_long_term_frame_idx = 0;
+    wait_for_recovery = true;
+}
+
+/// @brief C.4.5.3. Output the pictures in POC order while more than `reorder_depth` are waiting
+void cpu_h264_decoder_t::state_t::bump(bool all) noexcept(false) {
+    const size_t depth = all ? 0 : sps->reorder_depth();
+    while (true) {
+        size_t waiting = 0;
+        h264_picture_t* first = nullptr;
+        for (auto& picture : pictures) {
+            if (picture->needed_for_output == false)
+                continue;
+            ++waiting;
+            if (first == nullptr || picture->poc < first->poc)
+                first = picture.get();
+        }
+        if (waiting <= depth || first == nullptr)
+            return;
+        output(*first);
+    }
+}
+
+void cpu_h264_decoder_t::state_t::output(h264_picture_t& picture) noexcept(false) {
+    picture.needed_for_output = false;
+    video_frame_t frame = crop_frame(picture.frame, video_rect_t{sps->crop_left, sps->crop_top, announced.width,
+                                                                 announced.height});
+    frame.format.fps_num = announced.fps_num;
+    frame.format.fps_den = announced.fps_den;
+    // the smallest timestamp for the decode order timestamps. same as the picture's for the presentation order ones
+    frame.timestamp = picture.timestamp;
+    if (timestamps.empty() == false) {
+        frame.timestamp = timestamps.top();
+        timestamps.pop();
+    }
+    frame.duration = picture.duration;
+    frame.flags = picture.idr ? static_cast<uint32_t>(frame_flag_keyframe) : 0u;
+    outputs.emplace_back(output_t{std::move(frame), false, {}});
+}
+
+/// @brief The frame for the consumer. Converted or copied into the pooled buffers if needed
+video_frame_t cpu_h264_decoder_t::state_t::make_output(const video_frame_t& frame) noexcept(false) {
+    if (output_pool == nullptr && output_format.pixel == pixel_format_t::i420)
+        return frame;
+    video_frame_t result{};
+    if (output_pool) {
+        result = output_pool->acquire();
+    } else {
+        if (convert_pool == nullptr)
+            convert_pool = std::make_unique<frame_pool_t>(output_format);
+        else if (convert_pool->format() != output_format)
+            convert_pool->reset(output_format);
+        result = convert_pool->acquire();
+    }
+    if (result.format.pixel == frame.format.pixel)
+        copy_frame(frame, result);
+    else
+        convert_frame(frame, result);
+    result.timestamp = frame.timestamp;
+    result.duration = frame.duration;
+    result.flags = frame.flags;
+    return result;
+}
+
+void cpu_h264_decoder_t::state_t::decode_slices() noexcept {
+    pool.run(context.slices.size(), [this](size_t i, size_t thread) {
+        if (decoders[thread]->decode(*context.slices[i], context) == false)
+            spdlog::warn("{}: slice {} of the frame_num {} is broken", "cpu_h264_decoder_t", i,
+                         context.slices[i]->header.frame_num);
+    });
+}
+
+/// @brief The macroblocks which no slice has reached. Copy the first reference or fill with gray
+void cpu_h264_decoder_t::state_t::conceal() noexcept {
+    const h264_picture_t* source = nullptr;
+    for (const auto& picture : pictures)
+        if (picture.get() != current && picture->is_reference() && static_cast<bool>(picture->frame))
+            source = picture.get();
+    if (context.slices.empty() == false && context.slices[0]->ref_list[0][0])
+        source = context.slices[0]->ref_list[0][0];
+    if (source == current)
+        source = nullptr;
+    size_t count = 0;
+    const uint32_t width = context.width_in_mbs;
+    for (uint32_t addr = 0; addr < context.mbs.size(); ++addr) {
+        h264_mb_t& mb = context.mbs[addr];
+        if (mb.slice != missing_slice)
+            continue;
+        ++count;
+        mb = h264_mb_t{};
+        mb.slice = missing_slice;
+        const uint32_t x = addr % width, y = addr / width;
+        for (uint32_t plane = 0; plane < 3; ++plane) {
+            const uint32_t size = plane ? 8 : 16;
+            const video_plane_t& dst = current->frame.planes[plane];
+            for (uint32_t row = 0; row < size; ++row) {
+                uint8_t* line = dst.data + (y * size + row) * dst.stride + x * size;
+                const size_t offset = (y * size + row) * dst.stride + x * size;
+                if (source)
+                    std::memcpy(line, source->frame.planes[plane].data + offset, size);
+                else
+                    std::memset(line, 128, size);
+            }
+        }
+        current->intra[addr] = 0;
+        for (uint32_t row = 0; row < 4; ++row)
+            std::fill_n(current->motion.begin() + (y * 4 + row) * width * 4 + x * 4, 4, h264_motion_t{});
+    }
+    if (count)
+        spdlog::warn("{}: concealed {} macroblocks", "cpu_h264_decoder_t", count);
+}
+
+cpu_h264_decoder_t::cpu_h264_decoder_t(size_t num_threads) noexcept(false)
+    : state{std::make_unique<state_t>(num_threads)} {
+}
+
+cpu_h264_decoder_t::~cpu_h264_decoder_t() noexcept = default;
+
+transform_result_t cpu_h264_decoder_t::set_input_format(const video_format_t& format) noexcept {
+    if (format.pixel != pixel_format_t::h264)
+        return transform_result_t::invalid_format;
+    state->input_format = format;
+    state->output_format.width = format.width;
+    state->output_format.height = format.height;
+    state->output_format.fps_num = format.fps_num;
+    state->output_format.fps_den = format.fps_den;
+    state->announced = state->output_format;
+    return transform_result_t::ok;
+}
+
+transform_result_t cpu_h264_decoder_t::set_output_format(const video_format_t& format) noexcept {
+    if (format.pixel != pixel_format_t::i420 && format.pixel != pixel_format_t::nv12)
+        return transform_result_t::invalid_format;
+    if (state->input_format.pixel != pixel_format_t::h264)
+        return transform_result_t::not_ready;
+    state->output_format.pixel = format.pixel;
+    state->announced.pixel = format.pixel;
+    for (auto& item : state->outputs)
+        item.format.pixel = format.pixel;
+    if (state->output_pool && state->output_format.width)
+        state->output_pool->reset(state->output_format);
+    return transform_result_t::ok;
+}
+
+video_format_t cpu_h264_decoder_t::get_input_format() const noexcept {
+    return state->input_format;
+}
+
+video_format_t cpu_h264_decoder_t::get_output_format() const noexcept {
+    return state->output_format;
+}
+
+transform_result_t cpu_h264_decoder_t::process_input(const video_frame_t& input) noexcept {
+    if (state->output_format.pixel == pixel_format_t::unknown)
+        return transform_result_t::not_ready;
+    if (state->outputs.empty() == false)
+        return transform_result_t::not_accepting;
+    if (input.planes[0].data == nullptr)
+        return transform_result_t::ok;
+    try {
+        return state->decode(input);
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "cpu_h264_decoder_t", ex.what());
+        state->reset();
+        return transform_result_t::failed;
+    }
+}
+
+transform_result_t cpu_h264_decoder_t::process_output(video_frame_t& output) noexcept {
+    if (state->outputs.empty())
+        return transform_result_t::need_more_input;
+    output_t& item = state->outputs.front();
+    try {
+        if (item.change) {
+            state->output_format = item.format;
+            if (state->output_pool)
+                state->output_pool->reset(item.format);
+            state->outputs.pop_front();
+            return transform_result_t::stream_change;
+        }
+        output = state->make_output(item.frame);
+        state->outputs.pop_front();
+        return transform_result_t::ok;
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "cpu_h264_decoder_t", ex.what());
+        state->outputs.pop_front();
+        return transform_result_t::failed;
+    }
+}
+
+void cpu_h264_decoder_t::drain() noexcept {
+    try {
+        state->drain();
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "cpu_h264_decoder_t", ex.what());
+        state->reset();
+    }
+}
+
+void cpu_h264_decoder_t::flush() noexcept {
+    state->reset();
+}
+
+bool cpu_h264_decoder_t::is_skippable(const video_frame_t& input) noexcept {
+    const uint8_t* data = input.planes[0].data;
+    const size_t size = input.planes[0].stride;
+    if (data == nullptr)
+        return true;
+    try {
+        std::vector<h264_nal_t>& nals = state->nals; // reused by the next `decode`
+        if (state->avcc == false && starts_with_start_code(data, size))
+            split_annexb(data, size, nals);
+        else if (split_avcc(data, size, state->length_size, nals) == false)
+            return false;
+        bool found = false;
+        for (const h264_nal_t& nal : nals) {
+            if (nal.size == 0 || nal.is_vcl() == false)
+                continue;
+            if (nal.ref_idc() != 0)
+                return false;
+            found = true;
+        }
+        return found;
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "cpu_h264_decoder_t", ex.what());
+        return false;
+    }
+}
+
+transform_result_t cpu_h264_decoder_t::set_parameter_sets(const uint8_t* data, size_t size) noexcept {
+    if (data == nullptr || size == 0)
+        return transform_result_t::invalid_format;
+    try {
+        return state->add_parameter_sets(data, size) ? transform_result_t::ok : transform_result_t::invalid_format;
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "cpu_h264_decoder_t", ex.what());
+        return transform_result_t::failed;
+    }
+}
+
+void cpu_h264_decoder_t::set_output_pool(std::shared_ptr<frame_pool_t> pool) noexcept {
+    state->output_pool = std::move(pool);
+    if (state->output_pool == nullptr || state->output_format.width == 0)
+        return;
+    try {
+        state->output_pool->reset(state->output_format);
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "cpu_h264_decoder_t", ex.what());
+        state->output_pool = nullptr;
+    }
+}
+
+std::shared_ptr<cpu_h264_decoder_t> make_cpu_h264_decoder(const uint8_t* header, size_t size, pixel_format_t pixel,
+                                                          size_t num_threads) noexcept(false) {
+    h264_sps_t sps{};
+    if (probe_h264(header, size, sps) == false || h264_is_supported(sps) == false)
+        throw std::invalid_argument{"make_cpu_h264_decoder: no supported SPS"};
+    auto decoder = std::make_shared<cpu_h264_decoder_t>(num_threads);
+    if (decoder->set_parameter_sets(header, size) != transform_result_t::ok)
+        throw std::invalid_argument{"make_cpu_h264_decoder: set_parameter_sets"};
+    if (decoder->set_input_format(sps.to_format()) != transform_result_t::ok)
+        throw std::invalid_argument{"make_cpu_h264_decoder: set_input_format"};
+    if (decoder->set_output_format(video_format_t{pixel}) != transform_result_t::ok)
+        throw std::invalid_argument{"make_cpu_h264_decoder: set_output_format"};
+    return decoder;
+}
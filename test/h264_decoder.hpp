@@ -0,0 +1,78 @@
+#pragma once
+#include <memory>
+
+#include "video_transform.hpp"
+
+/**
+ * @brief Portable software H.264 decoder. The CPU backend of `video_transform_t` next to `h264_decoder_t` of MF.
+ *        Constrained Baseline and Main profile progressive streams. 4:2:0, 8 bit, CAVLC and CABAC, P and B slices,
+ *        weighted prediction. No interlace, 8x8 transform, scaling matrix, slice group(FMO) or data partitioning
+ *
+ * @code
+ * auto decoder = make_cpu_h264_decoder(avcc.data(), avcc.size(), pixel_format_t::nv12, 4);
+ * decoder->set_output_pool(pool); // optional. the outputs are written to the caller's buffers
+ * video_transform_driver_t driver{decoder, "cpu_h264_decoder_t"};
+ * for (auto& sample : samples) // AVCC or Annex B access units in decode order
+ *     driver.process(sample, consume);
+ * driver.drain(consume);
+ * @endcode
+ *
+ * @note The inputs are access units. The outputs come in presentation order when the DPB bumps them.
+ *       The timestamps are sorted again, so the decode order timestamps of `h264_stream_parser_t` work too
+ * @note The slices of a picture are decoded concurrently by `num_threads` workers. The deblocking runs after them
+ * @note i420 outputs share the decoded picture when no output pool is set. The others are converted or copied
+ */
+class cpu_h264_decoder_t final : public video_transform_t {
+    struct state_t;
+    std::unique_ptr<state_t> state;
+
+  public:
+    /// @param num_threads workers for the slices. 0 for `std::thread::hardware_concurrency`, 1 for no worker
+    explicit cpu_h264_decoder_t(size_t num_threads = 1) noexcept(false);
+    cpu_h264_decoder_t(const cpu_h264_decoder_t&) = delete;
+    cpu_h264_decoder_t(cpu_h264_decoder_t&&) = delete;
+    cpu_h264_decoder_t& operator=(const cpu_h264_decoder_t&) = delete;
+    cpu_h264_decoder_t& operator=(cpu_h264_decoder_t&&) = delete;
+    ~cpu_h264_decoder_t() noexcept;
+
+    /// @brief `pixel_format_t::h264`. The size is replaced by the one of SPS
+    transform_result_t set_input_format(const video_format_t& format) noexcept override;
+    /// @brief `pixel_format_t::i420` or `pixel_format_t::nv12`. The size follows the stream
+    transform_result_t set_output_format(const video_format_t& format) noexcept override;
+    video_format_t get_input_format() const noexcept override;
+    video_format_t get_output_format() const noexcept override;
+
+    /// @return `not_accepting` while the outputs are waiting, `invalid_format` for the unsupported streams
+    transform_result_t process_input(const video_frame_t& input) noexcept override;
+    /// @return `stream_change` once when the size of the stream is changed. The outputs after it have the new one
+    transform_result_t process_output(video_frame_t& output) noexcept override;
+    /// @brief Decode the last picture and release all pictures in the DPB. The next input continues the stream
+    void drain() noexcept override;
+    /// @brief Discard all pictures. The pictures before the next IDR or I slice are skipped
+    void flush() noexcept override;
+    /// @brief The access units without a reference slice (`nal_ref_idc` 0). The B frames of the most encoders
+    bool is_skippable(const video_frame_t& input) noexcept override;
+
+    /**
+     * @brief SPS and PPS out of band. The avcC record(`MF_MT_USER_DATA`) or Annex B(`MF_MT_MPEG_SEQUENCE_HEADER`).
+     *        The length size of avcC is used for the AVCC inputs
+     * @return `invalid_format` if no parameter set is found
+     */
+    [[nodiscard]] transform_result_t set_parameter_sets(const uint8_t* data, size_t size) noexcept;
+
+    /**
+     * @brief The outputs are written into the frames of the `pool` instead of the decoder's own buffers.
+     *        The pool is reset to the output format
+     * @note `nullptr` to stop
+     */
+    void set_output_pool(std::shared_ptr<frame_pool_t> pool) noexcept;
+};
+
+/**
+ * @brief `cpu_h264_decoder_t` with the input/output formats configured. Can be the factory of `gop_decoder_t`
+ * @param header the avcC record or Annex B SPS/PPS
+ * @throws std::invalid_argument the header doesn't have a supported SPS
+ */
+[[nodiscard]] std::shared_ptr<cpu_h264_decoder_t> make_cpu_h264_decoder(const uint8_t* header, size_t size,
+                                                                        pixel_format_t pixel,
+                                                                        size_t num_threads = 1) noexcept(false);
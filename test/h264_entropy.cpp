@@ -0,0 +1,571 @@
+#include "h264_entropy.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+const uint8_t h264_cabac_range_lps[64][4]{
+    {128, 176, 208, 240}, {128, 167, 197, 227}, {128, 158, 187, 216}, {123, 150, 178, 205}, {116, 142, 169, 195},
+    {111, 135, 160, 185}, {105, 128, 152, 175}, {100, 122, 144, 166}, {95, 116, 137, 158}, {90, 110, 130, 150},
+    {85, 104, 123, 142}, {81, 99, 117, 135}, {77, 94, 111, 128}, {73, 89, 105, 122}, {69, 85, 100, 116},
+    {66, 80, 95, 110}, {62, 76, 90, 104}, {59, 72, 86, 99}, {56, 69, 81, 94}, {53, 65, 77, 89}, {51, 62, 73, 85},
+    {48, 59, 69, 80}, {46, 56, 66, 76}, {43, 53, 63, 72}, {41, 50, 59, 69}, {39, 48, 56, 65}, {37, 45, 54, 62},
+    {35, 43, 51, 59}, {33, 41, 48, 56}, {32, 39, 46, 53}, {30, 37, 43, 50}, {29, 35, 41, 48}, {27, 33, 39, 45},
+    {26, 31, 37, 43}, {24, 30, 35, 41}, {23, 28, 33, 39}, {22, 27, 32, 37}, {21, 26, 30, 35}, {20, 24, 29, 33},
+    {19, 23, 27, 31}, {18, 22, 26, 30}, {17, 21, 25, 28}, {16, 20, 23, 27}, {15, 19, 22, 25}, {14, 18, 21, 24},
+    {14, 17, 20, 23}, {13, 16, 19, 22}, {12, 15, 18, 21}, {12, 14, 17, 20}, {11, 14, 16, 19}, {11, 13, 15, 18},
+    {10, 12, 15, 17}, {10, 12, 14, 16}, {9, 11, 13, 15}, {9, 11, 12, 14}, {8, 10, 12, 14}, {8, 9, 11, 13},
+    {7, 9, 11, 12}, {7, 9, 10, 12}, {7, 8, 10, 11}, {6, 8, 9, 11}, {6, 7, 9, 10}, {6, 7, 8, 9}, {2, 2, 2, 2},
+};
+
+const uint8_t h264_cabac_next_lps[64]{
+    0,  0,  1,  2,  2,  4,  4,  5,  6,  7,  8,  9,  9,  11, 11, 12, 13, 13, 15, 15, 16, 16,
+    18, 18, 19, 19, 21, 21, 22, 22, 23, 24, 24, 25, 26, 26, 27, 27, 28, 29, 29, 30, 30, 30,
+    31, 32, 32, 33, 33, 33, 34, 34, 35, 35, 35, 36, 36, 36, 37, 37, 37, 38, 38, 63,
+};
+
+namespace {
+
+/// @brief (m, n) of Table 9-12 to 9-23 for ctxIdx 0 to 275. The I slices and cabac_init_idc 0 to 2
+constexpr int8_t cabac_init_values[4][h264_cabac_context_count][2]{
+    {
+        // I slices
+        {20, -15}, {2, 54}, {3, 74}, {20, -15}, {2, 54}, {3, 74},
+        {-28, 127}, {-23, 104}, {-6, 53}, {-1, 54}, {7, 51}, {0, 0},
+        {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0},
+        {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0},
+        {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0},
+        {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0},
+        {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0},
+        {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0},
+        {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0},
+        {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0},
+        {0, 41}, {0, 63}, {0, 63}, {0, 63}, {-9, 83}, {4, 86},
+        {0, 97}, {-7, 72}, {13, 41}, {3, 62}, {0, 11}, {1, 55},
+        {0, 69}, {-17, 127}, {-13, 102}, {0, 82}, {-7, 74}, {-21, 107},
+        {-27, 127}, {-31, 127}, {-24, 127}, {-18, 95}, {-27, 127}, {-21, 114},
+        {-30, 127}, {-17, 123}, {-12, 115}, {-16, 122}, {-11, 115}, {-12, 63},
+        {-2, 68}, {-15, 84}, {-13, 104}, {-3, 70}, {-8, 93}, {-10, 90},
+        {-30, 127}, {-1, 74}, {-6, 97}, {-7, 91}, {-20, 127}, {-4, 56},
+        {-5, 82}, {-7, 76}, {-22, 125}, {-7, 93}, {-11, 87}, {-3, 77},
+        {-5, 71}, {-4, 63}, {-4, 68}, {-12, 84}, {-7, 62}, {-7, 65},
+        {8, 61}, {5, 56}, {-2, 66}, {1, 64}, {0, 61}, {-2, 78},
+        {1, 50}, {7, 52}, {10, 35}, {0, 44}, {11, 38}, {1, 45},
+        {0, 46}, {5, 44}, {31, 17}, {1, 51}, {7, 50}, {28, 19},
+        {16, 33}, {14, 62}, {-13, 108}, {-15, 100}, {-13, 101}, {-13, 91},
+        {-12, 94}, {-10, 88}, {-16, 84}, {-10, 86}, {-7, 83}, {-13, 87},
+        {-19, 94}, {1, 70}, {0, 72}, {-5, 74}, {18, 59}, {-8, 102},
+        {-15, 100}, {0, 95}, {-4, 75}, {2, 72}, {-11, 75}, {-3, 71},
+        {15, 46}, {-13, 69}, {0, 62}, {0, 65}, {21, 37}, {-15, 72},
+        {9, 57}, {16, 54}, {0, 62}, {12, 72}, {24, 0}, {15, 9},
+        {8, 25}, {13, 18}, {15, 9}, {13, 19}, {10, 37}, {12, 18},
+        {6, 29}, {20, 33}, {15, 30}, {4, 45}, {1, 58}, {0, 62},
+        {7, 61}, {12, 38}, {11, 45}, {15, 39}, {11, 42}, {13, 44},
+        {16, 45}, {12, 41}, {10, 49}, {30, 34}, {18, 42}, {10, 55},
+        {17, 51}, {17, 46}, {0, 89}, {26, -19}, {22, -17}, {26, -17},
+        {30, -25}, {28, -20}, {33, -23}, {37, -27}, {33, -23}, {40, -28},
+        {38, -17}, {33, -11}, {40, -15}, {41, -6}, {38, 1}, {41, 17},
+        {30, -6}, {27, 3}, {26, 22}, {37, -16}, {35, -4}, {38, -8},
+        {38, -3}, {37, 3}, {38, 5}, {42, 0}, {35, 16}, {39, 22},
+        {14, 48}, {27, 37}, {21, 60}, {12, 68}, {2, 97}, {-3, 71},
+        {-6, 42}, {-5, 50}, {-3, 54}, {-2, 62}, {0, 58}, {1, 63},
+        {-2, 72}, {-1, 74}, {-9, 91}, {-5, 67}, {-5, 27}, {-3, 39},
+        {-2, 44}, {0, 46}, {-16, 64}, {-8, 68}, {-10, 78}, {-6, 77},
+        {-10, 86}, {-12, 92}, {-15, 55}, {-10, 60}, {-6, 62}, {-4, 65},
+        {-12, 73}, {-8, 76}, {-7, 80}, {-9, 88}, {-17, 110}, {-11, 97},
+        {-20, 84}, {-11, 79}, {-6, 73}, {-4, 74}, {-13, 86}, {-13, 96},
+        {-11, 97}, {-19, 117}, {-8, 78}, {-5, 33}, {-4, 48}, {-2, 53},
+        {-3, 62}, {-13, 71}, {-10, 79}, {-12, 86}, {-13, 90}, {-14, 97},
+    },
+    {
+        // cabac_init_idc 0
+        {20, -15}, {2, 54}, {3, 74}, {20, -15}, {2, 54}, {3, 74},
+        {-28, 127}, {-23, 104}, {-6, 53}, {-1, 54}, {7, 51}, {23, 33},
+        {23, 2}, {21, 0}, {1, 9}, {0, 49}, {-37, 118}, {5, 57},
+        {-13, 78}, {-11, 65}, {1, 62}, {12, 49}, {-4, 73}, {17, 50},
+        {18, 64}, {9, 43}, {29, 0}, {26, 67}, {16, 90}, {9, 104},
+        {-46, 127}, {-20, 104}, {1, 67}, {-13, 78}, {-11, 65}, {1, 62},
+        {-6, 86}, {-17, 95}, {-6, 61}, {9, 45}, {-3, 69}, {-6, 81},
+        {-11, 96}, {6, 55}, {7, 67}, {-5, 86}, {2, 88}, {0, 58},
+        {-3, 76}, {-10, 94}, {5, 54}, {4, 69}, {-3, 81}, {0, 88},
+        {-7, 67}, {-5, 74}, {-4, 74}, {-5, 80}, {-7, 72}, {1, 58},
+        {0, 41}, {0, 63}, {0, 63}, {0, 63}, {-9, 83}, {4, 86},
+        {0, 97}, {-7, 72}, {13, 41}, {3, 62}, {0, 45}, {-4, 78},
+        {-3, 96}, {-27, 126}, {-28, 98}, {-25, 101}, {-23, 67}, {-28, 82},
+        {-20, 94}, {-16, 83}, {-22, 110}, {-21, 91}, {-18, 102}, {-13, 93},
+        {-29, 127}, {-7, 92}, {-5, 89}, {-7, 96}, {-13, 108}, {-3, 46},
+        {-1, 65}, {-1, 57}, {-9, 93}, {-3, 74}, {-9, 92}, {-8, 87},
+        {-23, 126}, {5, 54}, {6, 60}, {6, 59}, {6, 69}, {-1, 48},
+        {0, 68}, {-4, 69}, {-8, 88}, {-2, 85}, {-6, 78}, {-1, 75},
+        {-7, 77}, {2, 54}, {5, 50}, {-3, 68}, {1, 50}, {6, 42},
+        {-4, 81}, {1, 63}, {-4, 70}, {0, 67}, {2, 57}, {-2, 76},
+        {11, 35}, {4, 64}, {1, 61}, {11, 35}, {18, 25}, {12, 24},
+        {13, 29}, {13, 36}, {-10, 93}, {-7, 73}, {-2, 73}, {13, 46},
+        {9, 49}, {-7, 100}, {9, 53}, {2, 53}, {5, 53}, {-2, 61},
+        {0, 56}, {0, 56}, {-13, 63}, {-5, 60}, {-1, 62}, {4, 57},
+        {-6, 69}, {4, 57}, {14, 39}, {4, 51}, {13, 68}, {3, 64},
+        {1, 61}, {9, 63}, {7, 50}, {16, 39}, {5, 44}, {4, 52},
+        {11, 48}, {-5, 60}, {-1, 59}, {0, 59}, {22, 33}, {5, 44},
+        {14, 43}, {-1, 78}, {0, 60}, {9, 69}, {11, 28}, {2, 40},
+        {3, 44}, {0, 49}, {0, 46}, {2, 44}, {2, 51}, {0, 47},
+        {4, 39}, {2, 62}, {6, 46}, {0, 54}, {3, 54}, {2, 58},
+        {4, 63}, {6, 51}, {6, 57}, {7, 53}, {6, 52}, {6, 55},
+        {11, 45}, {14, 36}, {8, 53}, {-1, 82}, {7, 55}, {-3, 78},
+        {15, 46}, {22, 31}, {-1, 84}, {25, 7}, {30, -7}, {28, 3},
+        {28, 4}, {32, 0}, {34, -1}, {30, 6}, {30, 6}, {32, 9},
+        {31, 19}, {26, 27}, {26, 30}, {37, 20}, {28, 34}, {17, 70},
+        {1, 67}, {5, 59}, {9, 67}, {16, 30}, {18, 32}, {18, 35},
+        {22, 29}, {24, 31}, {23, 38}, {18, 43}, {20, 41}, {11, 63},
+        {9, 59}, {9, 64}, {-1, 94}, {-2, 89}, {-9, 108}, {-6, 76},
+        {-2, 44}, {0, 45}, {0, 52}, {-3, 64}, {-2, 59}, {-4, 70},
+        {-4, 75}, {-8, 82}, {-17, 102}, {-9, 77}, {3, 24}, {0, 42},
+        {0, 48}, {0, 55}, {-6, 59}, {-7, 71}, {-12, 83}, {-11, 87},
+        {-30, 119}, {1, 58}, {-3, 29}, {-1, 36}, {1, 38}, {2, 43},
+        {-6, 55}, {0, 58}, {0, 64}, {-3, 74}, {-10, 90}, {0, 70},
+        {-4, 29}, {5, 31}, {7, 42}, {1, 59}, {-2, 58}, {-3, 72},
+        {-3, 81}, {-11, 97}, {0, 58}, {8, 5}, {10, 14}, {14, 18},
+        {13, 27}, {2, 40}, {0, 58}, {-3, 70}, {-6, 79}, {-8, 85},
+    },
+    {
+        // cabac_init_idc 1
+        {20, -15}, {2, 54}, {3, 74}, {20, -15}, {2, 54}, {3, 74},
+        {-28, 127}, {-23, 104}, {-6, 53}, {-1, 54}, {7, 51}, {22, 25},
+        {34, 0}, {16, 0}, {-2, 9}, {4, 41}, {-29, 118}, {2, 65},
+        {-6, 71}, {-13, 79}, {5, 52}, {9, 50}, {-3, 70}, {10, 54},
+        {26, 34}, {19, 22}, {40, 0}, {57, 2}, {41, 36}, {26, 69},
+        {-45, 127}, {-15, 101}, {-4, 76}, {-6, 71}, {-13, 79}, {5, 52},
+        {6, 69}, {-13, 90}, {0, 52}, {8, 43}, {-2, 69}, {-5, 82},
+        {-10, 96}, {2, 59}, {2, 75}, {-3, 87}, {-3, 100}, {1, 56},
+        {-3, 74}, {-6, 85}, {0, 59}, {-3, 81}, {-7, 86}, {-5, 95},
+        {-1, 66}, {-1, 77}, {1, 70}, {-2, 86}, {-5, 72}, {0, 61},
+        {0, 41}, {0, 63}, {0, 63}, {0, 63}, {-9, 83}, {4, 86},
+        {0, 97}, {-7, 72}, {13, 41}, {3, 62}, {13, 15}, {7, 51},
+        {2, 80}, {-39, 127}, {-18, 91}, {-17, 96}, {-26, 81}, {-35, 98},
+        {-24, 102}, {-23, 97}, {-27, 119}, {-24, 99}, {-21, 110}, {-18, 102},
+        {-36, 127}, {0, 80}, {-5, 89}, {-7, 94}, {-4, 92}, {0, 39},
+        {0, 65}, {-15, 84}, {-35, 127}, {-2, 73}, {-12, 104}, {-9, 91},
+        {-31, 127}, {3, 55}, {7, 56}, {7, 55}, {8, 61}, {-3, 53},
+        {0, 68}, {-7, 74}, {-9, 88}, {-13, 103}, {-13, 91}, {-9, 89},
+        {-14, 92}, {-8, 76}, {-12, 87}, {-23, 110}, {-24, 105}, {-10, 78},
+        {-20, 112}, {-17, 99}, {-78, 127}, {-70, 127}, {-50, 127}, {-46, 127},
+        {-4, 66}, {-5, 78}, {-4, 71}, {-8, 72}, {2, 59}, {-1, 55},
+        {-7, 70}, {-6, 75}, {-8, 89}, {-34, 119}, {-3, 75}, {32, 20},
+        {30, 22}, {-44, 127}, {0, 54}, {-5, 61}, {0, 58}, {-1, 60},
+        {-3, 61}, {-8, 67}, {-25, 84}, {-14, 74}, {-5, 65}, {5, 52},
+        {2, 57}, {0, 61}, {-9, 69}, {-11, 70}, {18, 55}, {-4, 71},
+        {0, 58}, {7, 61}, {9, 41}, {18, 25}, {9, 32}, {5, 43},
+        {9, 47}, {0, 44}, {0, 51}, {2, 46}, {19, 38}, {-4, 66},
+        {15, 38}, {12, 42}, {9, 34}, {0, 89}, {4, 45}, {10, 28},
+        {10, 31}, {33, -11}, {52, -43}, {18, 15}, {28, 0}, {35, -22},
+        {38, -25}, {34, 0}, {39, -18}, {32, -12}, {102, -94}, {0, 0},
+        {56, -15}, {33, -4}, {29, 10}, {37, -5}, {51, -29}, {39, -9},
+        {52, -34}, {69, -58}, {67, -63}, {44, -5}, {32, 7}, {55, -29},
+        {32, 1}, {0, 0}, {27, 36}, {33, -25}, {34, -30}, {36, -28},
+        {38, -28}, {38, -27}, {34, -18}, {35, -16}, {34, -14}, {32, -8},
+        {37, -6}, {35, 0}, {30, 10}, {28, 18}, {26, 25}, {29, 41},
+        {0, 75}, {2, 72}, {8, 77}, {14, 35}, {18, 31}, {17, 35},
+        {21, 30}, {17, 45}, {20, 42}, {18, 45}, {27, 26}, {16, 54},
+        {7, 66}, {16, 56}, {11, 73}, {10, 67}, {-10, 116}, {-23, 112},
+        {-15, 71}, {-7, 61}, {0, 53}, {-5, 66}, {-11, 77}, {-9, 80},
+        {-9, 84}, {-10, 87}, {-34, 127}, {-21, 101}, {-3, 39}, {-5, 53},
+        {-7, 61}, {-11, 75}, {-15, 77}, {-17, 91}, {-25, 107}, {-25, 111},
+        {-28, 122}, {-11, 76}, {-10, 44}, {-10, 52}, {-10, 57}, {-9, 58},
+        {-16, 72}, {-7, 69}, {-4, 69}, {-5, 74}, {-9, 86}, {2, 66},
+        {-9, 34}, {1, 32}, {11, 31}, {5, 52}, {-2, 55}, {-2, 67},
+        {0, 73}, {-8, 89}, {3, 52}, {7, 4}, {10, 8}, {17, 8},
+        {16, 19}, {3, 37}, {-1, 61}, {-5, 73}, {-1, 70}, {-4, 78},
+    },
+    {
+        // cabac_init_idc 2
+        {20, -15}, {2, 54}, {3, 74}, {20, -15}, {2, 54}, {3, 74},
+        {-28, 127}, {-23, 104}, {-6, 53}, {-1, 54}, {7, 51}, {29, 16},
+        {25, 0}, {14, 0}, {-10, 51}, {-3, 62}, {-27, 99}, {26, 16},
+        {-4, 85}, {-24, 102}, {5, 57}, {6, 57}, {-17, 73}, {14, 57},
+        {20, 40}, {20, 10}, {29, 0}, {54, 0}, {37, 42}, {12, 97},
+        {-32, 127}, {-22, 117}, {-2, 74}, {-4, 85}, {-24, 102}, {5, 57},
+        {-6, 93}, {-14, 88}, {-6, 44}, {4, 55}, {-11, 89}, {-15, 103},
+        {-21, 116}, {19, 57}, {20, 58}, {4, 84}, {6, 96}, {1, 63},
+        {-5, 85}, {-13, 106}, {5, 63}, {6, 75}, {-3, 90}, {-1, 101},
+        {3, 55}, {-4, 79}, {-2, 75}, {-12, 97}, {-7, 50}, {1, 60},
+        {0, 41}, {0, 63}, {0, 63}, {0, 63}, {-9, 83}, {4, 86},
+        {0, 97}, {-7, 72}, {13, 41}, {3, 62}, {7, 34}, {-9, 88},
+        {-20, 127}, {-36, 127}, {-17, 91}, {-14, 95}, {-25, 84}, {-25, 86},
+        {-12, 89}, {-17, 91}, {-31, 127}, {-14, 76}, {-18, 103}, {-13, 90},
+        {-37, 127}, {11, 80}, {5, 76}, {2, 84}, {5, 78}, {-6, 55},
+        {4, 61}, {-14, 83}, {-37, 127}, {-5, 79}, {-11, 104}, {-11, 91},
+        {-30, 127}, {0, 65}, {-2, 79}, {0, 72}, {-4, 92}, {-6, 56},
+        {3, 68}, {-8, 71}, {-13, 98}, {-4, 86}, {-12, 88}, {-5, 82},
+        {-3, 72}, {-4, 67}, {-8, 72}, {-16, 89}, {-9, 69}, {-1, 59},
+        {5, 66}, {4, 57}, {-4, 71}, {-2, 71}, {2, 58}, {-1, 74},
+        {-4, 44}, {-1, 69}, {0, 62}, {-7, 51}, {-4, 47}, {-6, 42},
+        {-3, 41}, {-6, 53}, {8, 76}, {-9, 78}, {-11, 83}, {9, 52},
+        {0, 67}, {-5, 90}, {1, 67}, {-15, 72}, {-5, 75}, {-8, 80},
+        {-21, 83}, {-21, 64}, {-13, 31}, {-25, 64}, {-29, 94}, {9, 75},
+        {17, 63}, {-8, 74}, {-5, 35}, {-2, 27}, {13, 91}, {3, 65},
+        {-7, 69}, {8, 77}, {-10, 66}, {3, 62}, {-3, 68}, {-20, 81},
+        {0, 30}, {1, 7}, {-3, 23}, {-21, 74}, {16, 66}, {-23, 124},
+        {17, 37}, {44, -18}, {50, -34}, {-22, 127}, {4, 39}, {0, 42},
+        {7, 34}, {11, 29}, {8, 31}, {6, 37}, {7, 42}, {3, 40},
+        {8, 33}, {13, 43}, {13, 36}, {4, 47}, {3, 55}, {2, 58},
+        {6, 60}, {8, 44}, {11, 44}, {14, 42}, {7, 48}, {4, 56},
+        {4, 52}, {13, 37}, {9, 49}, {19, 58}, {10, 48}, {12, 45},
+        {0, 69}, {20, 33}, {8, 63}, {35, -18}, {33, -25}, {28, -3},
+        {24, 10}, {27, 0}, {34, -14}, {52, -44}, {39, -24}, {19, 17},
+        {31, 25}, {36, 29}, {24, 33}, {34, 15}, {30, 20}, {22, 73},
+        {20, 34}, {19, 31}, {27, 44}, {19, 16}, {15, 36}, {15, 36},
+        {21, 28}, {25, 21}, {30, 20}, {31, 12}, {27, 16}, {24, 42},
+        {0, 93}, {14, 56}, {15, 57}, {26, 38}, {-24, 127}, {-24, 115},
+        {-22, 82}, {-9, 62}, {0, 53}, {0, 59}, {-14, 85}, {-13, 89},
+        {-13, 94}, {-11, 92}, {-29, 127}, {-21, 100}, {-14, 57}, {-12, 67},
+        {-11, 71}, {-10, 77}, {-21, 85}, {-16, 88}, {-23, 104}, {-15, 98},
+        {-37, 127}, {-10, 82}, {-8, 48}, {-8, 61}, {-8, 66}, {-7, 70},
+        {-14, 75}, {-10, 79}, {-9, 83}, {-12, 92}, {-18, 108}, {-4, 79},
+        {-22, 69}, {-16, 75}, {-2, 58}, {1, 58}, {-13, 78}, {-9, 83},
+        {-4, 81}, {-13, 99}, {-13, 81}, {-6, 38}, {-13, 62}, {-6, 58},
+        {-2, 59}, {-16, 73}, {-10, 76}, {-13, 86}, {-9, 83}, {-10, 87},
+    },
+};
+
+/// @brief coeff_token of Table 9-5. [nC range][TotalCoeff * 4 + TrailingOnes]. 0 length for the invalid pairs
+constexpr uint8_t coeff_token_length[4][68]{
+    {
+        1, 0, 0, 0, 6, 2, 0, 0, 8, 6, 3, 0, 9, 8, 7, 5, 10, 9, 8, 6, 11, 10, 9, 7, 13, 11, 10, 8, 13, 13, 11, 9, 13,
+        13, 13, 10, 14, 14, 13, 11, 14, 14, 14, 13, 15, 15, 14, 14, 15, 15, 15, 14, 16, 15, 15, 15, 16, 16, 16, 15, 16,
+        16, 16, 16, 16, 16, 16, 16,
+    },
+    {
+        2, 0, 0, 0, 6, 2, 0, 0, 6, 5, 3, 0, 7, 6, 6, 4, 8, 6, 6, 4, 8, 7, 7, 5, 9, 8, 8, 6, 11, 9, 9, 6, 11, 11, 11, 7,
+        12, 11, 11, 9, 12, 12, 12, 11, 12, 12, 12, 11, 13, 13, 13, 12, 13, 13, 13, 13, 13, 14, 13, 13, 14, 14, 14, 13,
+        14, 14, 14, 14,
+    },
+    {
+        4, 0, 0, 0, 6, 4, 0, 0, 6, 5, 4, 0, 6, 5, 5, 4, 7, 5, 5, 4, 7, 5, 5, 4, 7, 6, 6, 4, 7, 6, 6, 4, 8, 7, 7, 5, 8,
+        8, 7, 6, 9, 8, 8, 7, 9, 9, 8, 8, 9, 9, 9, 8, 10, 9, 9, 9, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+    },
+    {
+        6, 0, 0, 0, 6, 6, 0, 0, 6, 6, 6, 0, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    },
+};
+constexpr uint8_t coeff_token_bits[4][68]{
+    {
+        1, 0, 0, 0, 5, 1, 0, 0, 7, 4, 1, 0, 7, 6, 5, 3, 7, 6, 5, 3, 7, 6, 5, 4, 15, 6, 5, 4, 11, 14, 5, 4, 8, 10, 13,
+        4, 15, 14, 9, 4, 11, 10, 13, 12, 15, 14, 9, 12, 11, 10, 13, 8, 15, 1, 9, 12, 11, 14, 13, 8, 7, 10, 9, 12, 4, 6,
+        5, 8,
+    },
+    {
+        3, 0, 0, 0, 11, 2, 0, 0, 7, 7, 3, 0, 7, 10, 9, 5, 7, 6, 5, 4, 4, 6, 5, 6, 7, 6, 5, 8, 15, 6, 5, 4, 11, 14, 13,
+        4, 15, 10, 9, 4, 11, 14, 13, 12, 8, 10, 9, 8, 15, 14, 13, 12, 11, 10, 9, 12, 7, 11, 6, 8, 9, 8, 10, 1, 7, 6, 5,
+        4,
+    },
+    {
+        15, 0, 0, 0, 15, 14, 0, 0, 11, 15, 13, 0, 8, 12, 14, 12, 15, 10, 11, 11, 11, 8, 9, 10, 9, 14, 13, 9, 8, 10, 9,
+        8, 15, 14, 13, 13, 11, 14, 10, 12, 15, 10, 13, 12, 11, 14, 9, 12, 8, 10, 13, 8, 13, 7, 9, 12, 9, 12, 11, 10, 5,
+        8, 7, 6, 1, 4, 3, 2,
+    },
+    {
+        3, 0, 0, 0, 0, 1, 0, 0, 4, 5, 6, 0, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26,
+        27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54,
+        55, 56, 57, 58, 59, 60, 61, 62, 63,
+    },
+};
+/// @brief total_zeros of Table 9-7, 9-8. [TotalCoeff - 1][total_zeros]
+constexpr uint8_t total_zeros_length[15][16]{
+    {1, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 9},
+    {3, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 6, 6, 6, 6, 0},
+    {4, 3, 3, 3, 4, 4, 3, 3, 4, 5, 5, 6, 5, 6, 0, 0},
+    {5, 3, 4, 4, 3, 3, 3, 4, 3, 4, 5, 5, 5, 0, 0, 0},
+    {4, 4, 4, 3, 3, 3, 3, 3, 4, 5, 4, 5, 0, 0, 0, 0},
+    {6, 5, 3, 3, 3, 3, 3, 3, 4, 3, 6, 0, 0, 0, 0, 0},
+    {6, 5, 3, 3, 3, 2, 3, 4, 3, 6, 0, 0, 0, 0, 0, 0},
+    {6, 4, 5, 3, 2, 2, 3, 3, 6, 0, 0, 0, 0, 0, 0, 0},
+    {6, 6, 4, 2, 2, 3, 2, 5, 0, 0, 0, 0, 0, 0, 0, 0},
+    {5, 5, 3, 2, 2, 2, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {4, 4, 3, 3, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {4, 4, 2, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 3, 1, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {2, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+};
+constexpr uint8_t total_zeros_bits[15][16]{
+    {1, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 1},
+    {7, 6, 5, 4, 3, 5, 4, 3, 2, 3, 2, 3, 2, 1, 0, 0},
+    {5, 7, 6, 5, 4, 3, 4, 3, 2, 3, 2, 1, 1, 0, 0, 0},
+    {3, 7, 5, 4, 6, 5, 4, 3, 3, 2, 2, 1, 0, 0, 0, 0},
+    {5, 4, 3, 7, 6, 5, 4, 3, 2, 1, 1, 0, 0, 0, 0, 0},
+    {1, 1, 7, 6, 5, 4, 3, 2, 1, 1, 0, 0, 0, 0, 0, 0},
+    {1, 1, 5, 4, 3, 3, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0},
+    {1, 1, 1, 3, 3, 2, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 0, 1, 3, 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 0, 1, 3, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 2, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+};
+/// @brief run_before of Table 9-10. [Min(zerosLeft, 7) - 1][run_before]
+constexpr uint8_t run_before_length[7][16]{
+    {1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {2, 2, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {2, 2, 2, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {2, 2, 3, 3, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {2, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 3, 3, 3, 3, 3, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0},
+};
+constexpr uint8_t run_before_bits[7][16]{
+    {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 2, 3, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 0, 1, 3, 2, 5, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {7, 6, 5, 4, 3, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0},
+};
+
+/// @brief coeff_token of Table 9-5 for nC -1. [TotalCoeff * 4 + TrailingOnes]
+constexpr uint8_t chroma_dc_coeff_token_length[20]{2, 0, 0, 0, 6, 1, 0, 0, 6, 6, 3, 0, 6, 7, 7, 6, 6, 8, 8, 7};
+constexpr uint8_t chroma_dc_coeff_token_bits[20]{1, 0, 0, 0, 7, 1, 0, 0, 4, 6, 1, 0, 3, 3, 2, 5, 2, 3, 2, 0};
+/// @brief total_zeros of Table 9-9 (a) for the chroma DC. [TotalCoeff - 1][total_zeros]
+constexpr uint8_t chroma_dc_total_zeros_length[3][4]{{1, 2, 3, 3}, {1, 2, 2, 0}, {1, 1, 0, 0}};
+constexpr uint8_t chroma_dc_total_zeros_bits[3][4]{{1, 1, 1, 0}, {1, 1, 0, 0}, {1, 0, 0, 0}};
+
+/**
+ * @brief Multi-level lookup of the variable length codes. The first `root_bits` are looked up at once,
+ *        the longer codes continue in the sub tables
+ */
+class vlc_table_t final {
+    struct entry_t final {
+        int16_t value = 0;  // symbol. offset of the sub table if `length` < 0
+        int8_t length = 0;  // bits of the code. -(bits of the sub table) for the sub tables. 0 for invalid
+    };
+    std::vector<entry_t> entries{};
+    uint32_t root_bits = 0;
+
+  public:
+    /// @param lengths 0 for the unused symbols
+    vlc_table_t(const uint8_t* lengths, const uint8_t* bits, size_t count, uint32_t _root_bits) noexcept(false)
+        : root_bits{_root_bits} {
+        entries.resize(size_t{1} << root_bits);
+        build(0, root_bits, 0, 0, lengths, bits, count);
+    }
+
+    /// @return the symbol. -1 if the code is invalid
+    [[nodiscard]] int32_t decode(h264_slice_reader_t& reader) const noexcept {
+        uint32_t offset = 0;
+        uint32_t width = root_bits;
+        while (true) {
+            const entry_t& entry = entries[offset + reader.peek_bits(width)];
+            if (entry.length > 0) {
+                reader.skip_bits(static_cast<uint32_t>(entry.length));
+                return entry.value;
+            }
+            if (entry.length == 0)
+                return -1;
+            reader.skip_bits(width);
+            offset = static_cast<uint32_t>(entry.value);
+            width = static_cast<uint32_t>(-entry.length);
+        }
+    }
+
+  private:
+    void build(size_t offset, uint32_t width, uint32_t prefix, uint32_t prefix_length, const uint8_t* lengths,
+               const uint8_t* bits, size_t count) noexcept(false) {
+        std::vector<uint32_t> sub_widths(size_t{1} << width);
+        for (size_t symbol = 0; symbol < count; ++symbol) {
+            const uint32_t length = lengths[symbol];
+            if (length <= prefix_length || static_cast<uint32_t>(bits[symbol] >> (length - prefix_length)) != prefix)
+                continue;
+            const uint32_t rest = length - prefix_length;
+            const uint32_t code = bits[symbol] & ((1u << rest) - 1);
+            if (rest <= width) {
+                const uint32_t first = code << (width - rest);
+                for (uint32_t i = 0; i < (1u << (width - rest)); ++i)
+                    entries[offset + first + i] = {static_cast<int16_t>(symbol), static_cast<int8_t>(rest)};
+            } else {
+                const uint32_t index = code >> (rest - width);
+                sub_widths[index] = std::max(sub_widths[index], rest - width);
+            }
+        }
+        for (uint32_t index = 0; index < (1u << width); ++index) {
+            if (sub_widths[index] == 0)
+                continue;
+            const size_t sub_offset = entries.size();
+            entries.resize(sub_offset + (size_t{1} << sub_widths[index]));
+            entries[offset + index] = {static_cast<int16_t>(sub_offset), static_cast<int8_t>(-sub_widths[index])};
+            build(sub_offset, sub_widths[index], (prefix << width) | index, prefix_length + width, lengths, bits,
+                  count);
+        }
+    }
+};
+
+/// @brief All tables of 9.2. Built once
+struct cavlc_tables_t final {
+    std::vector<vlc_table_t> coeff_token{};
+    std::vector<vlc_table_t> total_zeros{};
+    std::vector<vlc_table_t> chroma_dc_total_zeros{};
+    std::vector<vlc_table_t> run_before{};
+
+  public:
+    cavlc_tables_t() noexcept(false) {
+        for (size_t i = 0; i < 4; ++i)
+            coeff_token.emplace_back(coeff_token_length[i], coeff_token_bits[i], 68, 8);
+        coeff_token.emplace_back(chroma_dc_coeff_token_length, chroma_dc_coeff_token_bits, 20, 8);
+        for (size_t i = 0; i < 15; ++i)
+            total_zeros.emplace_back(total_zeros_length[i], total_zeros_bits[i], 16, 9);
+        for (size_t i = 0; i < 3; ++i)
+            chroma_dc_total_zeros.emplace_back(chroma_dc_total_zeros_length[i], chroma_dc_total_zeros_bits[i], 4, 3);
+        for (size_t i = 0; i < 7; ++i)
+            run_before.emplace_back(run_before_length[i], run_before_bits[i], 16, 11);
+    }
+};
+
+const cavlc_tables_t& get_cavlc_tables() noexcept(false) {
+    static const cavlc_tables_t tables{};
+    return tables;
+}
+
+/// @brief Table 9-5 column of the nC
+size_t coeff_token_table(int32_t nc) noexcept {
+    if (nc < 0)
+        return 4;
+    if (nc < 2)
+        return 0;
+    if (nc < 4)
+        return 1;
+    return nc < 8 ? 2 : 3;
+}
+
+} // namespace
+
+void h264_cabac_init_contexts(uint8_t* states, uint32_t init_idc, int32_t slice_qp) noexcept {
+    const int32_t qp = slice_qp < 0 ? 0 : (slice_qp > 51 ? 51 : slice_qp);
+    for (size_t i = 0; i < h264_cabac_context_count; ++i) {
+        const int32_t m = cabac_init_values[init_idc][i][0], n = cabac_init_values[init_idc][i][1];
+        int32_t state = ((m * qp) >> 4) + n;
+        state = state < 1 ? 1 : (state > 126 ? 126 : state);
+        states[i] = static_cast<uint8_t>(state <= 63 ? (63 - state) << 1 : ((state - 64) << 1) | 1);
+    }
+}
+
+int32_t h264_read_residual_cavlc(h264_slice_reader_t& reader, int32_t nc, uint32_t max_coeff,
+                                 int16_t* levels) noexcept {
+    const cavlc_tables_t& tables = get_cavlc_tables();
+    std::fill(levels, levels + max_coeff, int16_t{0});
+    const int32_t token = tables.coeff_token[coeff_token_table(nc)].decode(reader);
+    if (token < 0)
+        return -1;
+    const auto total = static_cast<uint32_t>(token >> 2), trailing_ones = static_cast<uint32_t>(token & 3);
+    if (total == 0)
+        return 0;
+    if (total > max_coeff)
+        return -1;
+
+    int32_t values[16]{};
+    uint32_t suffix_length = total > 10 && trailing_ones < 3 ? 1 : 0;
+    for (uint32_t i = 0; i < total; ++i) {
+        if (i < trailing_ones) {
+            values[i] = reader.read_bit() ? -1 : 1;
+            continue;
+        }
+        uint32_t prefix = 0;
+        while (reader.read_bit() == 0) // level_prefix
+            if (++prefix > 32 || reader.failed())
+                return -1;
+        int32_t code = static_cast<int32_t>(std::min(prefix, 15u) << suffix_length);
+        const uint32_t suffix_size =
+            prefix == 14 && suffix_length == 0 ? 4 : (prefix >= 15 ? prefix - 3 : suffix_length);
+        if (suffix_size)
+            code += static_cast<int32_t>(reader.read_bits(suffix_size));
+        if (prefix >= 15 && suffix_length == 0)
+            code += 15;
+        if (prefix >= 16)
+            code += (1 << (prefix - 3)) - 4096;
+        if (i == trailing_ones && trailing_ones < 3)
+            code += 2;
+        values[i] = code % 2 == 0 ? (code + 2) >> 1 : (-code - 1) >> 1;
+        if (suffix_length == 0)
+            suffix_length = 1;
+        if (std::abs(values[i]) > (3 << (suffix_length - 1)) && suffix_length < 6)
+            ++suffix_length;
+    }
+
+    int32_t zeros_left = 0;
+    if (total < max_coeff) {
+        zeros_left = nc < 0 ? tables.chroma_dc_total_zeros[total - 1].decode(reader)
+                            : tables.total_zeros[total - 1].decode(reader);
+        if (zeros_left < 0 || zeros_left + total > max_coeff)
+            return -1;
+    }
+    int32_t position = static_cast<int32_t>(total) + zeros_left; // after the highest one
+    for (uint32_t i = 0; i < total; ++i) {
+        int32_t run = 0;
+        if (i + 1 < total && zeros_left > 0) {
+            run = tables.run_before[std::min(zeros_left, 7) - 1].decode(reader);
+            if (run < 0 || run > zeros_left)
+                return -1;
+        } else if (i + 1 == total) {
+            run = zeros_left;
+        }
+        zeros_left -= run;
+        position -= 1;
+        levels[position] = static_cast<int16_t>(values[i]);
+        position -= run;
+    }
+    return reader.failed() ? -1 : static_cast<int32_t>(total);
+}
+
+uint32_t h264_read_residual_cabac(h264_cabac_t& cabac, uint8_t* states, h264_block_cat_t cat, uint32_t max_coeff,
+                                  int16_t* levels) noexcept {
+    // ctxBlockCatOffset of Table 9-40
+    constexpr uint32_t map_offsets[5]{0, 15, 29, 44, 47};
+    constexpr uint32_t level_offsets[5]{0, 10, 20, 30, 39};
+    const auto index = static_cast<uint32_t>(cat);
+    uint8_t* significant = states + 105 + map_offsets[index];
+    uint8_t* last = states + 166 + map_offsets[index];
+    uint8_t* level = states + 227 + level_offsets[index];
+    const bool chroma_dc = cat == h264_block_cat_t::chroma_dc;
+
+    std::fill(levels, levels + max_coeff, int16_t{0});
+    uint8_t positions[16]{};
+    uint32_t count = 0;
+    uint32_t i = 0;
+    for (; i + 1 < max_coeff; ++i) {
+        const uint32_t ctx = chroma_dc ? std::min(i, 2u) : i;
+        if (cabac.decode(significant[ctx])) {
+            positions[count++] = static_cast<uint8_t>(i);
+            if (cabac.decode(last[ctx]))
+                break;
+        }
+    }
+    if (i + 1 == max_coeff) // the last one is significant without the flags
+        positions[count++] = static_cast<uint8_t>(i);
+
+    uint32_t num_eq1 = 0, num_gt1 = 0;
+    const uint32_t gt1_limit = chroma_dc ? 3 : 4;
+    for (uint32_t k = count; k-- > 0;) {
+        int32_t value = 1;
+        if (cabac.decode(level[num_gt1 ? 0 : std::min(4u, 1 + num_eq1)])) {
+            uint8_t& state = level[5 + std::min(gt1_limit, num_gt1)];
+            uint32_t prefix = 1;
+            while (prefix < 14 && cabac.decode(state))
+                ++prefix;
+            uint32_t minus1 = prefix;
+            if (prefix == 14) { // UEG0 suffix
+                uint32_t order = 0;
+                while (cabac.decode_bypass() && order < 24)
+                    minus1 += 1u << order++;
+                while (order--)
+                    minus1 += cabac.decode_bypass() << order;
+            }
+            value = static_cast<int32_t>(minus1) + 1;
+        }
+        levels[positions[k]] = static_cast<int16_t>(cabac.decode_bypass() ? -value : value);
+        if (value == 1)
+            ++num_eq1;
+        else
+            ++num_gt1;
+    }
+    return count;
+}
@@ -0,0 +1,246 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+/**
+ * @brief Entropy decoding of the slice data for `cpu_h264_decoder_t`. CAVLC and CABAC
+ * @see ITU-T H.264 9.2, 9.3
+ */
+
+/// @brief Bytes after the end of the slice data which `h264_slice_reader_t` may load. They must be zero
+constexpr size_t h264_slice_padding = 8;
+
+/**
+ * @brief MSB first reader of the slice data. Loads 8 bytes at once unlike `bit_reader_t`
+ * @note The buffer must have `h264_slice_padding` bytes after the end. Reading after the end returns zeros
+ */
+class h264_slice_reader_t final {
+    const uint8_t* data = nullptr;
+    size_t size_bits = 0;
+    size_t position = 0;
+
+  public:
+    h264_slice_reader_t() noexcept = default;
+    h264_slice_reader_t(const uint8_t* _data, size_t size) noexcept : data{_data}, size_bits{size * 8} {
+    }
+
+    /// @param count up to 32
+    [[nodiscard]] uint32_t peek_bits(uint32_t count) const noexcept {
+        if (count == 0)
+            return 0;
+        const size_t offset = std::min(position, size_bits) >> 3;
+        uint64_t cache = 0;
+        std::memcpy(&cache, data + offset, sizeof(cache));
+        cache = to_big_endian(cache) << (position & 7);
+        return static_cast<uint32_t>(cache >> (64 - count));
+    }
+    void skip_bits(uint32_t count) noexcept {
+        position += count;
+    }
+    [[nodiscard]] uint32_t read_bits(uint32_t count) noexcept {
+        const uint32_t value = peek_bits(count);
+        position += count;
+        return value;
+    }
+    [[nodiscard]] uint32_t read_bit() noexcept {
+        return read_bits(1);
+    }
+    /// @brief ue(v) up to 2^31 - 2
+    [[nodiscard]] uint32_t read_ue() noexcept {
+        const uint32_t bits = peek_bits(32);
+        if (bits == 0) {
+            position += 32; // broken. `failed` tells it
+            return 0;
+        }
+        uint32_t zeros = 0;
+        while ((bits & (0x80000000u >> zeros)) == 0)
+            ++zeros;
+        if (zeros < 16) {
+            position += 2 * zeros + 1;
+            return (bits >> (31 - 2 * zeros)) - 1;
+        }
+        position += zeros + 1;
+        return static_cast<uint32_t>((uint64_t{1} << zeros) - 1 + read_bits(zeros));
+    }
+    /// @brief se(v)
+    [[nodiscard]] int32_t read_se() noexcept {
+        const uint32_t code = read_ue();
+        return code & 1 ? static_cast<int32_t>((code + 1) / 2) : -static_cast<int32_t>(code / 2);
+    }
+    /// @brief te(v) with the range larger than 0
+    [[nodiscard]] uint32_t read_te(uint32_t range) noexcept {
+        return range == 1 ? 1 - read_bit() : read_ue();
+    }
+
+    void align() noexcept {
+        position = (position + 7) & ~size_t{7};
+    }
+    [[nodiscard]] size_t bit_position() const noexcept {
+        return position;
+    }
+    /// @brief The byte at the position. Call `align` first
+    [[nodiscard]] const uint8_t* current() const noexcept {
+        return data + std::min(position, size_bits) / 8;
+    }
+    [[nodiscard]] const uint8_t* end() const noexcept {
+        return data + size_bits / 8;
+    }
+    [[nodiscard]] bool failed() const noexcept {
+        return position > size_bits;
+    }
+
+  private:
+    static uint64_t to_big_endian(uint64_t value) noexcept {
+#if defined(_MSC_VER)
+        return _byteswap_uint64(value);
+#else
+        return __builtin_bswap64(value);
+#endif
+    }
+};
+
+/// @brief rangeTabLPS of Table 9-44. [pStateIdx][qCodIRangeIdx]
+extern const uint8_t h264_cabac_range_lps[64][4];
+/// @brief transIdxLPS of Table 9-45
+extern const uint8_t h264_cabac_next_lps[64];
+
+/// @brief Context variables of ctxIdx 0 to 275. `pStateIdx << 1 | valMPS`
+constexpr size_t h264_cabac_context_count = 276;
+
+/**
+ * @brief Initialize the context variables. 9.3.1.1
+ * @param init_idc 0 for the I slices, `cabac_init_idc + 1` for the others
+ */
+void h264_cabac_init_contexts(uint8_t* states, uint32_t init_idc, int32_t slice_qp) noexcept;
+
+/**
+ * @brief Arithmetic decoding engine of 9.3.3.2. The offset keeps 7 bits more than `codIOffset` to read by bytes
+ */
+class h264_cabac_t final {
+    const uint8_t* current = nullptr;
+    const uint8_t* begin = nullptr;
+    const uint8_t* last = nullptr;
+    uint32_t range = 510;
+    uint32_t value = 0;
+    int32_t bits_needed = 8;
+
+  public:
+    /// @brief 9.3.1.2. `data` is the first byte of the CABAC data
+    void init(const uint8_t* data, const uint8_t* end) noexcept {
+        begin = current = data;
+        last = end;
+        range = 510;
+        value = 0;
+        bits_needed = 8;
+        for (int i = 0; i < 2; ++i) {
+            value <<= 8;
+            if (current < last)
+                value |= *current++;
+            bits_needed -= 8;
+        }
+    }
+
+    [[nodiscard]] uint32_t decode(uint8_t& state) noexcept {
+        const uint32_t mps = state & 1;
+        const uint32_t index = state >> 1;
+        const uint32_t lps = h264_cabac_range_lps[index][(range >> 6) & 3];
+        range -= lps;
+        const uint32_t scaled = range << 7;
+        if (value < scaled) {
+            state = static_cast<uint8_t>(((index < 62 ? index + 1 : index) << 1) | mps);
+            if (scaled < (256u << 7)) {
+                range <<= 1;
+                value <<= 1;
+                if (++bits_needed == 0)
+                    fetch();
+            }
+            return mps;
+        }
+        value -= scaled;
+        uint32_t shift = 0;
+        while ((lps << shift) < 256)
+            ++shift;
+        value <<= shift;
+        range = lps << shift;
+        state = static_cast<uint8_t>((h264_cabac_next_lps[index] << 1) | (index == 0 ? 1 - mps : mps));
+        bits_needed += static_cast<int32_t>(shift);
+        if (bits_needed >= 0) {
+            if (current < last)
+                value |= static_cast<uint32_t>(*current++) << bits_needed;
+            bits_needed -= 8;
+        }
+        return 1 - mps;
+    }
+
+    [[nodiscard]] uint32_t decode_bypass() noexcept {
+        value <<= 1;
+        if (++bits_needed >= 0)
+            fetch();
+        const uint32_t scaled = range << 7;
+        if (value >= scaled) {
+            value -= scaled;
+            return 1;
+        }
+        return 0;
+    }
+
+    /// @brief end_of_slice_flag and the I_PCM bin. No renormalization for 1
+    [[nodiscard]] uint32_t decode_terminate() noexcept {
+        range -= 2;
+        const uint32_t scaled = range << 7;
+        if (value >= scaled)
+            return 1;
+        if (scaled < (256u << 7)) {
+            range <<= 1;
+            value <<= 1;
+            if (++bits_needed == 0)
+                fetch();
+        }
+        return 0;
+    }
+
+    /// @brief The first byte after the bits which 9.3.3.2 has read. Where `pcm_sample_luma` starts after I_PCM
+    [[nodiscard]] const uint8_t* aligned_position() const noexcept {
+        const auto bits = static_cast<int64_t>(current - begin) * 8 + bits_needed + 1;
+        return begin + (bits + 7) / 8;
+    }
+
+  private:
+    void fetch() noexcept {
+        bits_needed = -8;
+        if (current < last)
+            value |= *current++;
+    }
+};
+
+/**
+ * @brief coeff_token, total_zeros, run_before and the levels of 9.2
+ * @param nc nC of 9.2.1. -1 for the chroma DC
+ * @param levels coefficients in the scan order. `max_coeff` elements are written
+ * @return TotalCoeff. -1 if the syntax is broken
+ */
+[[nodiscard]] int32_t h264_read_residual_cavlc(h264_slice_reader_t& reader, int32_t nc, uint32_t max_coeff,
+                                               int16_t* levels) noexcept;
+
+/// @brief ctxBlockCat of Table 9-42
+enum class h264_block_cat_t : uint32_t {
+    luma_dc = 0, // Intra16x16DCLevel
+    luma_ac = 1, // Intra16x16ACLevel
+    luma_4x4 = 2,
+    chroma_dc = 3,
+    chroma_ac = 4,
+};
+
+/**
+ * @brief significant_coeff_flag, last_significant_coeff_flag and coeff_abs_level_minus1 of 7.3.5.3.3.
+ *        The coded_block_flag is decoded by the caller
+ * @param levels coefficients in the scan order. `max_coeff` elements are written
+ * @return count of the non-zero coefficients
+ */
+[[nodiscard]] uint32_t h264_read_residual_cabac(h264_cabac_t& cabac, uint8_t* states, h264_block_cat_t cat,
+                                                uint32_t max_coeff, int16_t* levels) noexcept;
@@ -0,0 +1,792 @@
+#include "h264_kernels.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "simd.hpp"
+
+namespace {
+
+uint8_t clip_u8(int32_t value) noexcept {
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+int32_t clip3(int32_t lower, int32_t upper, int32_t value) noexcept {
+    return value < lower ? lower : (value > upper ? upper : value);
+}
+
+/// @brief 6-tap filter (1, -5, 20, 20, -5, 1) without the rounding
+int32_t tap6(const uint8_t* p, ptrdiff_t step) noexcept {
+    return p[-2 * step] - 5 * p[-step] + 20 * p[0] + 20 * p[step] - 5 * p[2 * step] + p[3 * step];
+}
+
+/// @brief Half sample positions of a block. `b` horizontal, `h` vertical, `j` center
+void luma_half_h(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                 uint32_t height) noexcept {
+    for (uint32_t y = 0; y < height; ++y, dst += dst_stride, src += src_stride) {
+        uint32_t x = 0;
+#if defined(MEDIA0_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i c5 = _mm_set1_epi16(5), c20 = _mm_set1_epi16(20), c16 = _mm_set1_epi16(16);
+        for (; x + 8 <= width; x += 8) {
+            const auto load = [src, x, zero](int32_t offset) {
+                return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x + offset)), zero);
+            };
+            const __m128i outer = _mm_add_epi16(load(-2), load(3));
+            const __m128i mid = _mm_add_epi16(load(-1), load(2));
+            const __m128i inner = _mm_add_epi16(load(0), load(1));
+            __m128i sum = _mm_add_epi16(_mm_sub_epi16(outer, _mm_mullo_epi16(mid, c5)), _mm_mullo_epi16(inner, c20));
+            sum = _mm_srai_epi16(_mm_add_epi16(sum, c16), 5);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(sum, sum));
+        }
+#endif
+        for (; x < width; ++x)
+            dst[x] = clip_u8((tap6(src + x, 1) + 16) >> 5);
+    }
+}
+
+void luma_half_v(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                 uint32_t height) noexcept {
+    const auto step = static_cast<ptrdiff_t>(src_stride);
+    for (uint32_t y = 0; y < height; ++y, dst += dst_stride, src += src_stride) {
+        uint32_t x = 0;
+#if defined(MEDIA0_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i c5 = _mm_set1_epi16(5), c20 = _mm_set1_epi16(20), c16 = _mm_set1_epi16(16);
+        for (; x + 8 <= width; x += 8) {
+            const auto load = [src, x, step, zero](ptrdiff_t row) {
+                return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x + row * step)),
+                                         zero);
+            };
+            const __m128i outer = _mm_add_epi16(load(-2), load(3));
+            const __m128i mid = _mm_add_epi16(load(-1), load(2));
+            const __m128i inner = _mm_add_epi16(load(0), load(1));
+            __m128i sum = _mm_add_epi16(_mm_sub_epi16(outer, _mm_mullo_epi16(mid, c5)), _mm_mullo_epi16(inner, c20));
+            sum = _mm_srai_epi16(_mm_add_epi16(sum, c16), 5);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(sum, sum));
+        }
+#endif
+        for (; x < width; ++x)
+            dst[x] = clip_u8((tap6(src + x, step) + 16) >> 5);
+    }
+}
+
+void luma_half_hv(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                  uint32_t height) noexcept {
+    // the intermediate values of the horizontal filter for the rows -2 to height+2
+    int16_t temp[21 * 16];
+    const uint8_t* row = src - 2 * src_stride;
+    for (uint32_t y = 0; y < height + 5; ++y, row += src_stride)
+        for (uint32_t x = 0; x < width; ++x)
+            temp[y * 16 + x] = static_cast<int16_t>(tap6(row + x, 1));
+    for (uint32_t y = 0; y < height; ++y, dst += dst_stride) {
+        const int16_t* t = temp + (y + 2) * 16;
+        uint32_t x = 0;
+#if defined(MEDIA0_SSE2)
+        // 32 bit sums. (a + f) - 5 (b + e) + 20 (c + d) with madd of the interleaved pairs
+        const __m128i k1 = _mm_set_epi16(1, 1, 1, 1, 1, 1, 1, 1);
+        const __m128i k5 = _mm_set1_epi16(-5), k20 = _mm_set1_epi16(20);
+        const __m128i round = _mm_set1_epi32(512);
+        for (; x + 8 <= width; x += 8) {
+            const auto load = [t, x](int32_t r) {
+                return _mm_loadu_si128(reinterpret_cast<const __m128i*>(t + x + r * 16));
+            };
+            const __m128i a = load(-2), b = load(-1), c = load(0), d = load(1), e = load(2), f = load(3);
+            const auto sum = [&](auto unpack) {
+                __m128i s = _mm_madd_epi16(unpack(a, f), k1);
+                s = _mm_add_epi32(s, _mm_madd_epi16(unpack(b, e), k5));
+                s = _mm_add_epi32(s, _mm_madd_epi16(unpack(c, d), k20));
+                return _mm_srai_epi32(_mm_add_epi32(s, round), 10);
+            };
+            const __m128i lo = sum([](__m128i l, __m128i r) { return _mm_unpacklo_epi16(l, r); });
+            const __m128i hi = sum([](__m128i l, __m128i r) { return _mm_unpackhi_epi16(l, r); });
+            const __m128i packed = _mm_packs_epi32(lo, hi);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(packed, packed));
+        }
+#endif
+        for (; x < width; ++x) {
+            const int16_t* c = t + x;
+            const int32_t sum = c[-32] - 5 * c[-16] + 20 * c[0] + 20 * c[16] - 5 * c[32] + c[48];
+            dst[x] = clip_u8((sum + 512) >> 10);
+        }
+    }
+}
+
+void copy_block(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                uint32_t height) noexcept {
+    for (uint32_t y = 0; y < height; ++y, dst += dst_stride, src += src_stride)
+        std::memcpy(dst, src, width);
+}
+
+/// @brief `dst = (a + b + 1) >> 1`
+void average_block(uint8_t* dst, size_t dst_stride, const uint8_t* a, size_t a_stride, const uint8_t* b,
+                   size_t b_stride, uint32_t width, uint32_t height) noexcept {
+    for (uint32_t y = 0; y < height; ++y, dst += dst_stride, a += a_stride, b += b_stride) {
+        uint32_t x = 0;
+#if defined(MEDIA0_SSE2)
+        for (; x + 16 <= width; x += 16)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x),
+                             _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x)),
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x))));
+        for (; x + 8 <= width; x += 8)
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x),
+                             _mm_avg_epu8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + x)),
+                                          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + x))));
+#endif
+        for (; x < width; ++x)
+            dst[x] = static_cast<uint8_t>((a[x] + b[x] + 1) >> 1);
+    }
+}
+
+#if defined(MEDIA0_SSE2)
+/// @brief 8 samples of a row as 16 bit lanes
+__m128i load_row(const uint8_t* p) noexcept {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+
+void store_row(uint8_t* p, __m128i value) noexcept {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(value, value));
+}
+
+__m128i abs_diff(__m128i a, __m128i b) noexcept {
+    return _mm_max_epi16(_mm_sub_epi16(a, b), _mm_sub_epi16(b, a));
+}
+
+/// @brief `mask ? a : b` for each lane
+__m128i select(__m128i mask, __m128i a, __m128i b) noexcept {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/// @brief filterSamplesFlag of 8.7.2.2 for 8 samples
+__m128i filter_mask(__m128i p1, __m128i p0, __m128i q0, __m128i q1, int32_t alpha, int32_t beta) noexcept {
+    const __m128i a = _mm_set1_epi16(static_cast<int16_t>(alpha)), b = _mm_set1_epi16(static_cast<int16_t>(beta));
+    return _mm_and_si128(_mm_cmplt_epi16(abs_diff(p0, q0), a),
+                         _mm_and_si128(_mm_cmplt_epi16(abs_diff(p1, p0), b), _mm_cmplt_epi16(abs_diff(q1, q0), b)));
+}
+
+/// @brief Clip3(-t, t, ((q0 - p0) << 2 + (p1 - q1) + 4) >> 3) of 8.7.2.3
+__m128i filter_delta(__m128i p1, __m128i p0, __m128i q0, __m128i q1, __m128i t) noexcept {
+    const __m128i sum = _mm_add_epi16(_mm_slli_epi16(_mm_sub_epi16(q0, p0), 2), _mm_sub_epi16(p1, q1));
+    const __m128i delta = _mm_srai_epi16(_mm_add_epi16(sum, _mm_set1_epi16(4)), 3);
+    return _mm_min_epi16(_mm_max_epi16(delta, _mm_sub_epi16(_mm_setzero_si128(), t)), t);
+}
+
+/// @brief The horizontal luma edges with bS < 4. 8 samples. -1 of `tc` skips the lane
+void deblock_luma_rows(uint8_t* pix, ptrdiff_t stride, __m128i tc, int32_t alpha, int32_t beta) noexcept {
+    const __m128i p2 = load_row(pix - 3 * stride), p1 = load_row(pix - 2 * stride), p0 = load_row(pix - stride);
+    const __m128i q0 = load_row(pix), q1 = load_row(pix + stride), q2 = load_row(pix + 2 * stride);
+    const __m128i b = _mm_set1_epi16(static_cast<int16_t>(beta));
+    const __m128i enabled = _mm_cmpgt_epi16(tc, _mm_set1_epi16(-1));
+    const __m128i mask = _mm_and_si128(filter_mask(p1, p0, q0, q1, alpha, beta), enabled);
+    const __m128i ap = _mm_and_si128(mask, _mm_cmplt_epi16(abs_diff(p2, p0), b));
+    const __m128i aq = _mm_and_si128(mask, _mm_cmplt_epi16(abs_diff(q2, q0), b));
+    // the masks are -1 for the true lanes
+    const __m128i delta = filter_delta(p1, p0, q0, q1, _mm_sub_epi16(_mm_sub_epi16(tc, ap), aq));
+    const __m128i average = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(p0, q0), _mm_set1_epi16(1)), 1);
+    const __m128i negative = _mm_sub_epi16(_mm_setzero_si128(), tc);
+    const auto side = [average, negative, tc](__m128i x2, __m128i x1) {
+        const __m128i value = _mm_srai_epi16(_mm_sub_epi16(_mm_add_epi16(x2, average), _mm_slli_epi16(x1, 1)), 1);
+        return _mm_add_epi16(x1, _mm_min_epi16(_mm_max_epi16(value, negative), tc));
+    };
+    store_row(pix - 2 * stride, select(ap, side(p2, p1), p1));
+    store_row(pix - stride, select(mask, _mm_add_epi16(p0, delta), p0));
+    store_row(pix, select(mask, _mm_sub_epi16(q0, delta), q0));
+    store_row(pix + stride, select(aq, side(q2, q1), q1));
+}
+
+/// @brief The horizontal luma edges with bS 4. 8 samples
+void deblock_luma_intra_rows(uint8_t* pix, ptrdiff_t stride, int32_t alpha, int32_t beta) noexcept {
+    const __m128i p3 = load_row(pix - 4 * stride), p2 = load_row(pix - 3 * stride);
+    const __m128i p1 = load_row(pix - 2 * stride), p0 = load_row(pix - stride);
+    const __m128i q0 = load_row(pix), q1 = load_row(pix + stride);
+    const __m128i q2 = load_row(pix + 2 * stride), q3 = load_row(pix + 3 * stride);
+    const __m128i b = _mm_set1_epi16(static_cast<int16_t>(beta));
+    const __m128i mask = filter_mask(p1, p0, q0, q1, alpha, beta);
+    const __m128i strong =
+        _mm_and_si128(mask, _mm_cmplt_epi16(abs_diff(p0, q0), _mm_set1_epi16(static_cast<int16_t>((alpha >> 2) + 2))));
+    const __m128i two = _mm_set1_epi16(2), four = _mm_set1_epi16(4);
+    // p and q are symmetric. (x3, x2, x1, x0) is the side to filter, (y0, y1) the other side
+    const auto filter = [&](uint8_t* row, ptrdiff_t step, __m128i x3, __m128i x2, __m128i x1, __m128i x0, __m128i y0,
+                            __m128i y1) {
+        const __m128i apply = _mm_and_si128(strong, _mm_cmplt_epi16(abs_diff(x2, x0), b));
+        const __m128i x0y0 = _mm_add_epi16(x0, y0);
+        // (x2 + 2 * x1 + 2 * x0 + 2 * y0 + y1 + 4) >> 3
+        const __m128i s0 = _mm_add_epi16(_mm_add_epi16(x2, y1), _mm_slli_epi16(_mm_add_epi16(x1, x0y0), 1));
+        const __m128i strong0 = _mm_srai_epi16(_mm_add_epi16(s0, four), 3);
+        const __m128i strong1 = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(_mm_add_epi16(x2, x1), x0y0), two), 2);
+        // (2 * x3 + 3 * x2 + x1 + x0 + y0 + 4) >> 3
+        const __m128i s2 =
+            _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(x3, x2), 1), x2), _mm_add_epi16(x1, x0y0));
+        const __m128i strong2 = _mm_srai_epi16(_mm_add_epi16(s2, four), 3);
+        // (2 * x1 + x0 + y1 + 2) >> 2
+        const __m128i w0 = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(x1, 1), x0), _mm_add_epi16(y1, two));
+        const __m128i weak0 = _mm_srai_epi16(w0, 2);
+        store_row(row, select(mask, select(apply, strong0, weak0), x0));
+        store_row(row + step, select(apply, strong1, x1));
+        store_row(row + 2 * step, select(apply, strong2, x2));
+    };
+    filter(pix - stride, -stride, p3, p2, p1, p0, q0, q1);
+    filter(pix, stride, q3, q2, q1, q0, p0, p1);
+}
+
+/// @brief The horizontal chroma edges. 8 samples. `tc` is ignored for bS 4
+void deblock_chroma_rows(uint8_t* pix, ptrdiff_t stride, __m128i tc, int32_t alpha, int32_t beta, bool intra) noexcept {
+    const __m128i p1 = load_row(pix - 2 * stride), p0 = load_row(pix - stride);
+    const __m128i q0 = load_row(pix), q1 = load_row(pix + stride);
+    __m128i mask = filter_mask(p1, p0, q0, q1, alpha, beta);
+    if (intra) {
+        const __m128i two = _mm_set1_epi16(2);
+        // (2 * x1 + x0 + y1 + 2) >> 2
+        const auto filter = [two](__m128i x1, __m128i x0, __m128i y1) {
+            return _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(x1, 1), x0), _mm_add_epi16(y1, two)), 2);
+        };
+        const __m128i p = filter(p1, p0, q1), q = filter(q1, q0, p1);
+        store_row(pix - stride, select(mask, p, p0));
+        store_row(pix, select(mask, q, q0));
+        return;
+    }
+    mask = _mm_and_si128(mask, _mm_cmpgt_epi16(tc, _mm_set1_epi16(-1)));
+    const __m128i delta = filter_delta(p1, p0, q0, q1, _mm_add_epi16(tc, _mm_set1_epi16(1)));
+    store_row(pix - stride, select(mask, _mm_add_epi16(p0, delta), p0));
+    store_row(pix, select(mask, _mm_sub_epi16(q0, delta), q0));
+}
+#endif
+
+} // namespace
+
+void h264_idct4x4_add(uint8_t* dst, size_t stride, int16_t* block) noexcept {
+#if defined(MEDIA0_SSE2)
+    // 32 bit lanes like the scalar path, so the streams out of the 16 bit range of 8.5.12.2 give the same result
+    const auto transpose = [](__m128i& a, __m128i& b, __m128i& c, __m128i& d) {
+        const __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpacklo_epi32(c, d);
+        const __m128i t2 = _mm_unpackhi_epi32(a, b), t3 = _mm_unpackhi_epi32(c, d);
+        a = _mm_unpacklo_epi64(t0, t1), b = _mm_unpackhi_epi64(t0, t1);
+        c = _mm_unpacklo_epi64(t2, t3), d = _mm_unpackhi_epi64(t2, t3);
+    };
+    // the butterfly of 8.5.12.2 on the lanes. x0..x3 are the inputs of each 1-D transform
+    const auto butterfly = [](__m128i& x0, __m128i& x1, __m128i& x2, __m128i& x3) {
+        const __m128i e0 = _mm_add_epi32(x0, x2), e1 = _mm_sub_epi32(x0, x2);
+        const __m128i e2 = _mm_sub_epi32(_mm_srai_epi32(x1, 1), x3), e3 = _mm_add_epi32(x1, _mm_srai_epi32(x3, 1));
+        x0 = _mm_add_epi32(e0, e3), x1 = _mm_add_epi32(e1, e2);
+        x2 = _mm_sub_epi32(e1, e2), x3 = _mm_sub_epi32(e0, e3);
+    };
+    const auto load = [block](int i) {
+        const __m128i row = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block + i * 4));
+        return _mm_srai_epi32(_mm_unpacklo_epi16(row, row), 16);
+    };
+    __m128i r0 = load(0), r1 = load(1), r2 = load(2), r3 = load(3);
+    transpose(r0, r1, r2, r3); // the lanes are the rows
+    butterfly(r0, r1, r2, r3);
+    transpose(r0, r1, r2, r3); // the lanes are the columns
+    butterfly(r0, r1, r2, r3);
+    const __m128i bias = _mm_set1_epi32(32);
+    const auto residual = [bias](__m128i lhs, __m128i rhs) {
+        return _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(lhs, bias), 6),
+                               _mm_srai_epi32(_mm_add_epi32(rhs, bias), 6));
+    };
+    const __m128i zero = _mm_setzero_si128();
+    const auto add_rows = [stride, zero](uint8_t* pix, __m128i values) {
+        int32_t top = 0, bottom = 0;
+        std::memcpy(&top, pix, 4);
+        std::memcpy(&bottom, pix + stride, 4);
+        const __m128i pixels =
+            _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(top), _mm_cvtsi32_si128(bottom)), zero);
+        const __m128i sum = _mm_packus_epi16(_mm_adds_epi16(pixels, values), zero);
+        top = _mm_cvtsi128_si32(sum);
+        bottom = _mm_cvtsi128_si32(_mm_srli_si128(sum, 4));
+        std::memcpy(pix, &top, 4);
+        std::memcpy(pix + stride, &bottom, 4);
+    };
+    add_rows(dst, residual(r0, r1));
+    add_rows(dst + 2 * stride, residual(r2, r3));
+#else
+    int32_t temp[16];
+    for (int i = 0; i < 4; ++i) { // rows
+        const int16_t* d = block + i * 4;
+        const int32_t e0 = d[0] + d[2], e1 = d[0] - d[2];
+        const int32_t e2 = (d[1] >> 1) - d[3], e3 = d[1] + (d[3] >> 1);
+        temp[i * 4 + 0] = e0 + e3;
+        temp[i * 4 + 1] = e1 + e2;
+        temp[i * 4 + 2] = e1 - e2;
+        temp[i * 4 + 3] = e0 - e3;
+    }
+    for (int j = 0; j < 4; ++j) { // columns
+        const int32_t* f = temp + j;
+        const int32_t g0 = f[0] + f[8], g1 = f[0] - f[8];
+        const int32_t g2 = (f[4] >> 1) - f[12], g3 = f[4] + (f[12] >> 1);
+        const int32_t r[4]{g0 + g3, g1 + g2, g1 - g2, g0 - g3};
+        for (int i = 0; i < 4; ++i)
+            dst[i * stride + j] = clip_u8(dst[i * stride + j] + ((r[i] + 32) >> 6));
+    }
+#endif
+    std::memset(block, 0, 16 * sizeof(int16_t));
+}
+
+void h264_idct4x4_dc_add(uint8_t* dst, size_t stride, int16_t* block) noexcept {
+    const int32_t dc = (block[0] + 32) >> 6;
+    block[0] = 0;
+#if defined(MEDIA0_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i value = _mm_set1_epi16(static_cast<int16_t>(dc));
+    for (int i = 0; i < 4; ++i, dst += stride) {
+        int32_t pixels = 0;
+        std::memcpy(&pixels, dst, 4);
+        const __m128i sum = _mm_add_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixels), zero), value);
+        pixels = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+        std::memcpy(dst, &pixels, 4);
+    }
+#else
+    for (int i = 0; i < 4; ++i, dst += stride)
+        for (int j = 0; j < 4; ++j)
+            dst[j] = clip_u8(dst[j] + dc);
+#endif
+}
+
+void h264_mc_luma(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                  uint32_t height, uint32_t dx, uint32_t dy) noexcept {
+    // the positions of Figure 8-4. the quarter ones are the average of the 2 nearest
+    uint8_t half0[16 * 16], half1[16 * 16];
+    const auto next_row = static_cast<ptrdiff_t>(src_stride);
+    switch (dy * 4 + dx) {
+    case 0: // G
+        return copy_block(dst, dst_stride, src, src_stride, width, height);
+    case 1: // a
+        luma_half_h(half0, 16, src, src_stride, width, height);
+        return average_block(dst, dst_stride, src, src_stride, half0, 16, width, height);
+    case 2: // b
+        return luma_half_h(dst, dst_stride, src, src_stride, width, height);
+    case 3: // c
+        luma_half_h(half0, 16, src, src_stride, width, height);
+        return average_block(dst, dst_stride, src + 1, src_stride, half0, 16, width, height);
+    case 4: // d
+        luma_half_v(half0, 16, src, src_stride, width, height);
+        return average_block(dst, dst_stride, src, src_stride, half0, 16, width, height);
+    case 8: // h
+        return luma_half_v(dst, dst_stride, src, src_stride, width, height);
+    case 12: // n
+        luma_half_v(half0, 16, src, src_stride, width, height);
+        return average_block(dst, dst_stride, src + next_row, src_stride, half0, 16, width, height);
+    case 5: // e = (b + h + 1) >> 1
+        luma_half_h(half0, 16, src, src_stride, width, height);
+        luma_half_v(half1, 16, src, src_stride, width, height);
+        break;
+    case 7: // g = (b + m + 1) >> 1
+        luma_half_h(half0, 16, src, src_stride, width, height);
+        luma_half_v(half1, 16, src + 1, src_stride, width, height);
+        break;
+    case 13: // p = (h + s + 1) >> 1
+        luma_half_v(half0, 16, src, src_stride, width, height);
+        luma_half_h(half1, 16, src + next_row, src_stride, width, height);
+        break;
+    case 15: // r = (m + s + 1) >> 1
+        luma_half_v(half0, 16, src + 1, src_stride, width, height);
+        luma_half_h(half1, 16, src + next_row, src_stride, width, height);
+        break;
+    case 10: // j
+        return luma_half_hv(dst, dst_stride, src, src_stride, width, height);
+    case 6: // f = (b + j + 1) >> 1
+        luma_half_hv(half0, 16, src, src_stride, width, height);
+        luma_half_h(half1, 16, src, src_stride, width, height);
+        break;
+    case 14: // q = (j + s + 1) >> 1
+        luma_half_hv(half0, 16, src, src_stride, width, height);
+        luma_half_h(half1, 16, src + next_row, src_stride, width, height);
+        break;
+    case 9: // i = (h + j + 1) >> 1
+        luma_half_hv(half0, 16, src, src_stride, width, height);
+        luma_half_v(half1, 16, src, src_stride, width, height);
+        break;
+    case 11: // k = (j + m + 1) >> 1
+        luma_half_hv(half0, 16, src, src_stride, width, height);
+        luma_half_v(half1, 16, src + 1, src_stride, width, height);
+        break;
+    default:
+        return;
+    }
+    average_block(dst, dst_stride, half0, 16, half1, 16, width, height);
+}
+
+void h264_mc_chroma(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                    uint32_t height, uint32_t dx, uint32_t dy) noexcept {
+    if (dx == 0 && dy == 0)
+        return copy_block(dst, dst_stride, src, src_stride, width, height);
+    const int32_t a = (8 - dx) * (8 - dy), b = dx * (8 - dy), c = (8 - dx) * dy, d = dx * dy;
+    for (uint32_t y = 0; y < height; ++y, dst += dst_stride, src += src_stride) {
+        const uint8_t* next = src + src_stride;
+        uint32_t x = 0;
+#if defined(MEDIA0_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i wa = _mm_set1_epi16(static_cast<int16_t>(a)), wb = _mm_set1_epi16(static_cast<int16_t>(b));
+        const __m128i wc = _mm_set1_epi16(static_cast<int16_t>(c)), wd = _mm_set1_epi16(static_cast<int16_t>(d));
+        for (; x + 8 <= width; x += 8) {
+            const auto load = [zero](const uint8_t* p) {
+                return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+            };
+            __m128i sum = _mm_add_epi16(_mm_mullo_epi16(load(src + x), wa), _mm_mullo_epi16(load(src + x + 1), wb));
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(load(next + x), wc));
+            sum = _mm_add_epi16(sum, _mm_mullo_epi16(load(next + x + 1), wd));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(32)), 6);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(sum, sum));
+        }
+#endif
+        for (; x < width; ++x)
+            dst[x] = static_cast<uint8_t>((a * src[x] + b * src[x + 1] + c * next[x] + d * next[x + 1] + 32) >> 6);
+    }
+}
+
+void h264_average(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                  uint32_t height) noexcept {
+    average_block(dst, dst_stride, dst, dst_stride, src, src_stride, width, height);
+}
+
+void h264_weight(uint8_t* dst, size_t stride, uint32_t width, uint32_t height, uint32_t log2_denom, int32_t weight,
+                 int32_t offset) noexcept {
+    const int32_t round = log2_denom ? 1 << (log2_denom - 1) : 0;
+    for (uint32_t y = 0; y < height; ++y, dst += stride)
+        for (uint32_t x = 0; x < width; ++x)
+            dst[x] = clip_u8(((dst[x] * weight + round) >> log2_denom) + offset);
+}
+
+void h264_biweight(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                   uint32_t height, uint32_t log2_denom, int32_t weight0, int32_t weight1, int32_t offset) noexcept {
+    const int32_t round = 1 << log2_denom;
+    for (uint32_t y = 0; y < height; ++y, dst += dst_stride, src += src_stride)
+        for (uint32_t x = 0; x < width; ++x)
+            dst[x] = clip_u8(((dst[x] * weight0 + src[x] * weight1 + round) >> (log2_denom + 1)) + offset);
+}
+
+void h264_deblock_luma(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int32_t alpha, int32_t beta,
+                       const int8_t tc0[4]) noexcept {
+#if defined(MEDIA0_SSE2)
+    if (along == 1) {
+        for (int half = 0; half < 2; ++half) {
+            const int16_t lo = tc0[2 * half], hi = tc0[2 * half + 1];
+            deblock_luma_rows(pix + 8 * half, across, _mm_set_epi16(hi, hi, hi, hi, lo, lo, lo, lo), alpha, beta);
+        }
+        return;
+    }
+#endif
+    for (int i = 0; i < 16; ++i, pix += along) {
+        const int32_t tc = tc0[i / 4];
+        if (tc < 0)
+            continue;
+        const int32_t p0 = pix[-across], p1 = pix[-2 * across], p2 = pix[-3 * across];
+        const int32_t q0 = pix[0], q1 = pix[across], q2 = pix[2 * across];
+        if (std::abs(p0 - q0) >= alpha || std::abs(p1 - p0) >= beta || std::abs(q1 - q0) >= beta)
+            continue;
+        const bool ap = std::abs(p2 - p0) < beta, aq = std::abs(q2 - q0) < beta;
+        const int32_t t = tc + ap + aq;
+        const int32_t delta = clip3(-t, t, (((q0 - p0) * 4) + (p1 - q1) + 4) >> 3);
+        pix[-across] = clip_u8(p0 + delta);
+        pix[0] = clip_u8(q0 - delta);
+        if (ap)
+            pix[-2 * across] = static_cast<uint8_t>(p1 + clip3(-tc, tc, (p2 + ((p0 + q0 + 1) >> 1) - (p1 * 2)) >> 1));
+        if (aq)
+            pix[across] = static_cast<uint8_t>(q1 + clip3(-tc, tc, (q2 + ((p0 + q0 + 1) >> 1) - (q1 * 2)) >> 1));
+    }
+}
+
+void h264_deblock_luma_intra(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int32_t alpha, int32_t beta) noexcept {
+#if defined(MEDIA0_SSE2)
+    if (along == 1) {
+        deblock_luma_intra_rows(pix, across, alpha, beta);
+        deblock_luma_intra_rows(pix + 8, across, alpha, beta);
+        return;
+    }
+#endif
+    for (int i = 0; i < 16; ++i, pix += along) {
+        const int32_t p0 = pix[-across], p1 = pix[-2 * across], p2 = pix[-3 * across], p3 = pix[-4 * across];
+        const int32_t q0 = pix[0], q1 = pix[across], q2 = pix[2 * across], q3 = pix[3 * across];
+        if (std::abs(p0 - q0) >= alpha || std::abs(p1 - p0) >= beta || std::abs(q1 - q0) >= beta)
+            continue;
+        const bool strong = std::abs(p0 - q0) < ((alpha >> 2) + 2);
+        if (strong && std::abs(p2 - p0) < beta) {
+            pix[-across] = static_cast<uint8_t>((p2 + 2 * p1 + 2 * p0 + 2 * q0 + q1 + 4) >> 3);
+            pix[-2 * across] = static_cast<uint8_t>((p2 + p1 + p0 + q0 + 2) >> 2);
+            pix[-3 * across] = static_cast<uint8_t>((2 * p3 + 3 * p2 + p1 + p0 + q0 + 4) >> 3);
+        } else {
+            pix[-across] = static_cast<uint8_t>((2 * p1 + p0 + q1 + 2) >> 2);
+        }
+        if (strong && std::abs(q2 - q0) < beta) {
+            pix[0] = static_cast<uint8_t>((p1 + 2 * p0 + 2 * q0 + 2 * q1 + q2 + 4) >> 3);
+            pix[across] = static_cast<uint8_t>((p0 + q0 + q1 + q2 + 2) >> 2);
+            pix[2 * across] = static_cast<uint8_t>((2 * q3 + 3 * q2 + q1 + q0 + p0 + 4) >> 3);
+        } else {
+            pix[0] = static_cast<uint8_t>((2 * q1 + q0 + p1 + 2) >> 2);
+        }
+    }
+}
+
+void h264_deblock_chroma(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int32_t alpha, int32_t beta,
+                         const int8_t tc0[4]) noexcept {
+#if defined(MEDIA0_SSE2)
+    if (along == 1) {
+        const __m128i tc = _mm_set_epi16(tc0[3], tc0[3], tc0[2], tc0[2], tc0[1], tc0[1], tc0[0], tc0[0]);
+        return deblock_chroma_rows(pix, across, tc, alpha, beta, false);
+    }
+#endif
+    for (int i = 0; i < 8; ++i, pix += along) {
+        const int32_t tc = tc0[i / 2];
+        if (tc < 0)
+            continue;
+        const int32_t p0 = pix[-across], p1 = pix[-2 * across];
+        const int32_t q0 = pix[0], q1 = pix[across];
+        if (std::abs(p0 - q0) >= alpha || std::abs(p1 - p0) >= beta || std::abs(q1 - q0) >= beta)
+            continue;
+        const int32_t t = tc + 1;
+        const int32_t delta = clip3(-t, t, (((q0 - p0) * 4) + (p1 - q1) + 4) >> 3);
+        pix[-across] = clip_u8(p0 + delta);
+        pix[0] = clip_u8(q0 - delta);
+    }
+}
+
+void h264_deblock_chroma_intra(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int32_t alpha,
+                               int32_t beta) noexcept {
+#if defined(MEDIA0_SSE2)
+    if (along == 1)
+        return deblock_chroma_rows(pix, across, _mm_setzero_si128(), alpha, beta, true);
+#endif
+    for (int i = 0; i < 8; ++i, pix += along) {
+        const int32_t p0 = pix[-across], p1 = pix[-2 * across];
+        const int32_t q0 = pix[0], q1 = pix[across];
+        if (std::abs(p0 - q0) >= alpha || std::abs(p1 - p0) >= beta || std::abs(q1 - q0) >= beta)
+            continue;
+        pix[-across] = static_cast<uint8_t>((2 * p1 + p0 + q1 + 2) >> 2);
+        pix[0] = static_cast<uint8_t>((2 * q1 + q0 + p1 + 2) >> 2);
+    }
+}
+
+void h264_predict_4x4(uint8_t* dst, size_t stride, uint32_t mode, uint32_t available) noexcept {
+    // p[-1, -1] and p[0..7, -1] in `top` from the index 1, p[-1, 0..3] in `left`. 128 if not available
+    int32_t top[9], left[4];
+    const uint8_t* above = dst - stride;
+    top[0] = available & h264_top_left ? above[-1] : 128;
+    for (int x = 0; x < 4; ++x)
+        top[1 + x] = available & h264_top ? above[x] : 128;
+    for (int x = 4; x < 8; ++x)
+        top[1 + x] = available & h264_top_right ? above[x] : top[4];
+    for (int y = 0; y < 4; ++y)
+        left[y] = available & h264_left ? dst[y * stride - 1] : 128;
+    const int32_t* t = top + 1;
+    // the edge of Figure 8-7 from p[-1, 3] to p[7, -1]. `edge[4]` is p[-1, -1]
+    const int32_t edge[12]{left[3], left[2], left[1], left[0], top[0], t[0], t[1], t[2], t[3], t[4], t[5], t[6]};
+    const int32_t* e = edge + 4;
+    const auto set = [dst, stride](int x, int y, int32_t value) {
+        dst[y * stride + x] = static_cast<uint8_t>(value);
+    };
+    const auto l = [&left, &top](int y) { return y < 0 ? top[0] : left[std::min(y, 3)]; };
+    switch (mode) {
+    case 0: // Vertical
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 4; ++x)
+                set(x, y, t[x]);
+        break;
+    case 1: // Horizontal
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 4; ++x)
+                set(x, y, left[y]);
+        break;
+    case 2: { // DC
+        int32_t dc = 128;
+        const bool has_top = available & h264_top, has_left = available & h264_left;
+        if (has_top && has_left)
+            dc = (t[0] + t[1] + t[2] + t[3] + left[0] + left[1] + left[2] + left[3] + 4) >> 3;
+        else if (has_left)
+            dc = (left[0] + left[1] + left[2] + left[3] + 2) >> 2;
+        else if (has_top)
+            dc = (t[0] + t[1] + t[2] + t[3] + 2) >> 2;
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 4; ++x)
+                set(x, y, dc);
+        break;
+    }
+    case 3: // Diagonal_Down_Left
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 4; ++x)
+                set(x, y,
+                    x == 3 && y == 3 ? (t[6] + 3 * t[7] + 2) >> 2
+                                     : (t[x + y] + 2 * t[x + y + 1] + t[x + y + 2] + 2) >> 2);
+        break;
+    case 4: // Diagonal_Down_Right
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 4; ++x) {
+                const int32_t k = x - y; // along the edge
+                set(x, y, (e[k - 1] + 2 * e[k] + e[k + 1] + 2) >> 2);
+            }
+        break;
+    case 5: // Vertical_Right
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 4; ++x) {
+                const int32_t z = 2 * x - y;
+                int32_t value = 0;
+                if (z >= 0 && (z & 1) == 0)
+                    value = (e[x - (y >> 1)] + e[x - (y >> 1) + 1] + 1) >> 1;
+                else if (z >= 0)
+                    value = (e[x - (y >> 1) - 1] + 2 * e[x - (y >> 1)] + e[x - (y >> 1) + 1] + 2) >> 2;
+                else if (z == -1)
+                    value = (left[0] + 2 * top[0] + t[0] + 2) >> 2;
+                else
+                    value = (l(y - 1) + 2 * l(y - 2) + l(y - 3) + 2) >> 2;
+                set(x, y, value);
+            }
+        break;
+    case 6: // Horizontal_Down
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 4; ++x) {
+                const int32_t z = 2 * y - x;
+                int32_t value = 0;
+                if (z >= 0 && (z & 1) == 0)
+                    value = (e[-(y - (x >> 1))] + e[-(y - (x >> 1)) - 1] + 1) >> 1;
+                else if (z >= 0)
+                    value = (e[-(y - (x >> 1)) + 1] + 2 * e[-(y - (x >> 1))] + e[-(y - (x >> 1)) - 1] + 2) >> 2;
+                else if (z == -1)
+                    value = (left[0] + 2 * top[0] + t[0] + 2) >> 2;
+                else
+                    value = (e[x] + 2 * e[x - 1] + e[x - 2] + 2) >> 2;
+                set(x, y, value);
+            }
+        break;
+    case 7: // Vertical_Left
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 4; ++x) {
+                const int32_t i = x + (y >> 1);
+                set(x, y, y & 1 ? (t[i] + 2 * t[i + 1] + t[i + 2] + 2) >> 2 : (t[i] + t[i + 1] + 1) >> 1);
+            }
+        break;
+    case 8: // Horizontal_Up
+        for (int y = 0; y < 4; ++y)
+            for (int x = 0; x < 4; ++x) {
+                const int32_t z = x + 2 * y;
+                int32_t value = left[3];
+                if (z < 5 && (z & 1) == 0)
+                    value = (l(y + (x >> 1)) + l(y + (x >> 1) + 1) + 1) >> 1;
+                else if (z < 5)
+                    value = (l(y + (x >> 1)) + 2 * l(y + (x >> 1) + 1) + l(y + (x >> 1) + 2) + 2) >> 2;
+                else if (z == 5)
+                    value = (left[2] + 3 * left[3] + 2) >> 2;
+                set(x, y, value);
+            }
+        break;
+    default:
+        break;
+    }
+}
+
+namespace {
+
+/// @brief Intra_16x16 and the chroma prediction share the modes except the DC
+void predict_plane(uint8_t* dst, size_t stride, uint32_t size, uint32_t available, int32_t scale) noexcept {
+    if ((available & (h264_left | h264_top | h264_top_left)) != (h264_left | h264_top | h264_top_left))
+        return;
+    const uint8_t* above = dst - stride;
+    const auto half = static_cast<int32_t>(size / 2);
+    const auto left = [dst, stride](int32_t y) { return dst[y * static_cast<ptrdiff_t>(stride) - 1]; };
+    int32_t h = 0, v = 0;
+    for (int32_t i = 0; i < half; ++i) {
+        h += (i + 1) * (above[half + i] - above[half - 2 - i]);
+        v += (i + 1) * (left(half + i) - left(half - 2 - i));
+    }
+    const int32_t a = 16 * (left(static_cast<int32_t>(size) - 1) + above[size - 1]);
+    const int32_t b = (scale * h + 32) >> 6, c = (scale * v + 32) >> 6;
+    for (int32_t y = 0; y < static_cast<int32_t>(size); ++y)
+        for (int32_t x = 0; x < static_cast<int32_t>(size); ++x)
+            dst[y * stride + x] = clip_u8((a + b * (x - half + 1) + c * (y - half + 1) + 16) >> 5);
+}
+
+void predict_vertical(uint8_t* dst, size_t stride, uint32_t size) noexcept {
+    for (uint32_t y = 0; y < size; ++y)
+        std::memcpy(dst + y * stride, dst - stride, size);
+}
+
+void predict_horizontal(uint8_t* dst, size_t stride, uint32_t size) noexcept {
+    for (uint32_t y = 0; y < size; ++y)
+        std::memset(dst + y * stride, dst[y * stride - 1], size);
+}
+
+} // namespace
+
+void h264_predict_16x16(uint8_t* dst, size_t stride, uint32_t mode, uint32_t available) noexcept {
+    switch (mode) {
+    case 0:
+        if (available & h264_top)
+            predict_vertical(dst, stride, 16);
+        break;
+    case 1:
+        if (available & h264_left)
+            predict_horizontal(dst, stride, 16);
+        break;
+    case 2: {
+        int32_t sum = 0, count = 0;
+        if (available & h264_top) {
+            for (int x = 0; x < 16; ++x)
+                sum += dst[x - static_cast<ptrdiff_t>(stride)];
+            count += 16;
+        }
+        if (available & h264_left) {
+            for (size_t y = 0; y < 16; ++y)
+                sum += dst[y * stride - 1];
+            count += 16;
+        }
+        const int32_t dc = count ? (sum + count / 2) / count : 128;
+        for (size_t y = 0; y < 16; ++y)
+            std::memset(dst + y * stride, dc, 16);
+        break;
+    }
+    case 3:
+        predict_plane(dst, stride, 16, available, 5);
+        break;
+    default:
+        break;
+    }
+}
+
+void h264_predict_chroma(uint8_t* dst, size_t stride, uint32_t mode, uint32_t available) noexcept {
+    switch (mode) {
+    case 0: // DC for each 4x4. 8.3.4.1 to 8.3.4.3
+        for (uint32_t by = 0; by < 2; ++by)
+            for (uint32_t bx = 0; bx < 2; ++bx) {
+                uint8_t* block = dst + 4 * by * stride + 4 * bx;
+                int32_t top = -1, left = -1;
+                if (available & h264_top) {
+                    top = 0;
+                    for (int x = 0; x < 4; ++x)
+                        top += block[x - static_cast<ptrdiff_t>(4 * by * stride + stride)];
+                }
+                if (available & h264_left) {
+                    left = 0;
+                    for (size_t y = 0; y < 4; ++y)
+                        left += block[y * stride - 1 - 4 * bx];
+                }
+                // the corner blocks use both. (1, 0) prefers the top and (0, 1) prefers the left
+                int32_t dc = 128;
+                const bool corner = bx == by;
+                if (corner && top >= 0 && left >= 0)
+                    dc = (top + left + 4) >> 3;
+                else if (bx == 1 && by == 0 && top >= 0)
+                    dc = (top + 2) >> 2;
+                else if (bx == 0 && by == 1 && left >= 0)
+                    dc = (left + 2) >> 2;
+                else if (left >= 0)
+                    dc = (left + 2) >> 2;
+                else if (top >= 0)
+                    dc = (top + 2) >> 2;
+                for (size_t y = 0; y < 4; ++y)
+                    std::memset(block + y * stride, dc, 4);
+            }
+        break;
+    case 1:
+        if (available & h264_left)
+            predict_horizontal(dst, stride, 8);
+        break;
+    case 2:
+        if (available & h264_top)
+            predict_vertical(dst, stride, 8);
+        break;
+    case 3:
+        predict_plane(dst, stride, 8, available, 34);
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Pixel kernels of `cpu_h264_decoder_t`. 8 bit samples.
+ *        The hot ones (inverse transform, 6-tap interpolation, averaging, deblocking) have SSE2 paths.
+ * @see ITU-T H.264 8.3, 8.4.2.2, 8.5.12, 8.7
+ */
+
+/// @brief Neighbors of a block for the intra prediction. The samples of the others are not read
+enum h264_neighbor_t : uint32_t {
+    h264_left = 1 << 0,
+    h264_top = 1 << 1,
+    h264_top_left = 1 << 2,
+    h264_top_right = 1 << 3,
+};
+
+/// @brief Intra_4x4 prediction of 8.3.1.2. `mode` is Intra4x4PredMode, `available` is `h264_neighbor_t`
+void h264_predict_4x4(uint8_t* dst, size_t stride, uint32_t mode, uint32_t available) noexcept;
+/// @brief Intra_16x16 prediction of 8.3.3
+void h264_predict_16x16(uint8_t* dst, size_t stride, uint32_t mode, uint32_t available) noexcept;
+/// @brief Intra chroma prediction of 8.3.4 for a 8x8 block. `mode` is intra_chroma_pred_mode
+void h264_predict_chroma(uint8_t* dst, size_t stride, uint32_t mode, uint32_t available) noexcept;
+
+/// @brief Inverse 4x4 transform and add the residual to the prediction in `dst`. The `block` is cleared
+void h264_idct4x4_add(uint8_t* dst, size_t stride, int16_t* block) noexcept;
+/// @brief Same as `h264_idct4x4_add` for the blocks which have the DC coefficient only
+void h264_idct4x4_dc_add(uint8_t* dst, size_t stride, int16_t* block) noexcept;
+
+/**
+ * @brief Luma sample interpolation of 8.4.2.2.1
+ * @param src the integer sample position. 2 rows/columns before and 3 after the block must be readable
+ * @param dx quarter sample fraction. 0 to 3
+ */
+void h264_mc_luma(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                  uint32_t height, uint32_t dx, uint32_t dy) noexcept;
+/**
+ * @brief Chroma sample interpolation of 8.4.2.2.2. 1 row/column after the block must be readable
+ * @param dx 1/8 sample fraction. 0 to 7
+ */
+void h264_mc_chroma(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                    uint32_t height, uint32_t dx, uint32_t dy) noexcept;
+
+/// @brief Default weighted prediction of the bi-predicted blocks. `dst = (dst + src + 1) >> 1`
+void h264_average(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                  uint32_t height) noexcept;
+/// @brief Explicit weighted prediction of the uni-predicted blocks in place. 8.4.2.3.2
+void h264_weight(uint8_t* dst, size_t stride, uint32_t width, uint32_t height, uint32_t log2_denom,
+                 int32_t weight, int32_t offset) noexcept;
+/// @brief Weighted prediction of the bi-predicted blocks. `dst` is the L0 prediction and becomes the result
+void h264_biweight(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride, uint32_t width,
+                   uint32_t height, uint32_t log2_denom, int32_t weight0, int32_t weight1, int32_t offset) noexcept;
+
+/**
+ * @brief Filter a luma edge of 16 samples with bS < 4
+ * @param pix the first q0 sample
+ * @param across distance of the samples across the edge. 1 for the vertical edges, the stride for the horizontal ones
+ * @param along distance of the samples along the edge
+ * @param tc0 for each 4 samples. -1 for bS 0
+ */
+void h264_deblock_luma(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int32_t alpha, int32_t beta,
+                       const int8_t tc0[4]) noexcept;
+/// @brief Filter a luma edge of 16 samples with bS 4
+void h264_deblock_luma_intra(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int32_t alpha, int32_t beta) noexcept;
+/// @brief Filter a chroma edge of 8 samples with bS < 4. `tc0` for each 2 samples
+void h264_deblock_chroma(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int32_t alpha, int32_t beta,
+                         const int8_t tc0[4]) noexcept;
+/// @brief Filter a chroma edge of 8 samples with bS 4
+void h264_deblock_chroma_intra(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int32_t alpha,
+                               int32_t beta) noexcept;
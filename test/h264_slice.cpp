@@ -0,0 +1,1540 @@
+#include "h264_slice.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "h264_kernels.hpp"
+
+bool h264_slice_header_t::has_mmco5() const noexcept {
+    return std::any_of(mmcos.begin(), mmcos.end(), [](const h264_mmco_t& mmco) { return mmco.operation == 5; });
+}
+
+bool h264_is_supported(const h264_sps_t& sps) noexcept {
+    return sps.chroma_format_idc == 1 && sps.bit_depth_luma == 8 && sps.bit_depth_chroma == 8 &&
+           sps.frame_mbs_only && !sps.transform_bypass && !sps.scaling_matrix_present && sps.width_in_mbs > 0 &&
+           sps.height_in_map_units > 0;
+}
+
+bool h264_is_supported(const h264_pps_t& pps) noexcept {
+    return pps.num_slice_groups == 1 && !pps.redundant_pic_cnt_present && !pps.transform_8x8_mode &&
+           !pps.scaling_matrix_present && pps.weighted_bipred_idc < 3;
+}
+
+namespace {
+
+bool parse_pred_weight_table(bit_reader_t& reader, h264_slice_header_t& header) noexcept {
+    header.luma_log2_weight_denom = reader.read_ue();
+    header.chroma_log2_weight_denom = reader.read_ue();
+    if (header.luma_log2_weight_denom > 7 || header.chroma_log2_weight_denom > 7)
+        return false;
+    const uint32_t lists = header.slice_type == h264_slice_type_t::b ? 2 : 1;
+    for (uint32_t list = 0; list < lists; ++list) {
+        for (uint32_t i = 0; i < header.num_ref_idx_active[list]; ++i) {
+            h264_weight_t& weight = header.weights[list][i];
+            weight.luma_weight = 1 << header.luma_log2_weight_denom;
+            weight.chroma_weight[0] = weight.chroma_weight[1] = 1 << header.chroma_log2_weight_denom;
+            if (reader.read_bit()) {
+                weight.luma_weight = reader.read_se();
+                weight.luma_offset = reader.read_se();
+            }
+            if (reader.read_bit()) {
+                for (uint32_t j = 0; j < 2; ++j) {
+                    weight.chroma_weight[j] = reader.read_se();
+                    weight.chroma_offset[j] = reader.read_se();
+                }
+            }
+        }
+    }
+    header.explicit_weights = true;
+    return true;
+}
+
+bool parse_dec_ref_pic_marking(bit_reader_t& reader, h264_slice_header_t& header) noexcept(false) {
+    if (header.is_idr()) {
+        header.no_output_of_prior_pics = reader.read_bit();
+        header.long_term_reference = reader.read_bit();
+        return true;
+    }
+    header.adaptive_ref_pic_marking = reader.read_bit();
+    if (header.adaptive_ref_pic_marking == false)
+        return true;
+    while (true) {
+        h264_mmco_t mmco{};
+        mmco.operation = reader.read_ue();
+        if (mmco.operation == 0)
+            return true;
+        if (mmco.operation > 6 || header.mmcos.size() > 66 || reader.failed())
+            return false;
+        if (mmco.operation == 1 || mmco.operation == 3)
+            mmco.difference_of_pic_nums = reader.read_ue() + 1;
+        if (mmco.operation == 2)
+            mmco.long_term_pic_num = reader.read_ue();
+        if (mmco.operation == 3 || mmco.operation == 6)
+            mmco.long_term_frame_idx = reader.read_ue();
+        if (mmco.operation == 4)
+            mmco.max_long_term_frame_idx_plus1 = reader.read_ue();
+        header.mmcos.emplace_back(mmco);
+    }
+}
+
+} // namespace
+
+bool parse_slice_header(const uint8_t* rbsp, size_t size, const h264_parameter_sets_t& sets,
+                        h264_slice_header_t& header, std::shared_ptr<const h264_sps_t>& sps,
+                        std::shared_ptr<const h264_pps_t>& pps) noexcept(false) {
+    bit_reader_t reader{rbsp, size};
+    header = h264_slice_header_t{};
+    const uint32_t nal_header = reader.read_bits(8);
+    header.nal_type = static_cast<h264_nal_type_t>(nal_header & 0x1F);
+    header.nal_ref_idc = (nal_header >> 5) & 3;
+    header.first_mb = reader.read_ue();
+    const uint32_t slice_type = reader.read_ue();
+    if (slice_type > 9)
+        return false;
+    header.slice_type = static_cast<h264_slice_type_t>(slice_type % 5);
+    header.pps_id = reader.read_ue();
+    if (header.pps_id >= 256 || sets.pps[header.pps_id] == nullptr)
+        return false;
+    pps = sets.pps[header.pps_id];
+    sps = sets.sps[pps->sps_id];
+    if (sps == nullptr || h264_is_supported(*sps) == false || h264_is_supported(*pps) == false)
+        return false;
+    // SP and SI need the switching pictures decoding process
+    if (header.slice_type == h264_slice_type_t::sp || header.slice_type == h264_slice_type_t::si)
+        return false;
+    if (header.first_mb >= sps->width_in_mbs * sps->height_in_map_units)
+        return false;
+    header.frame_num = reader.read_bits(sps->log2_max_frame_num);
+    if (header.is_idr())
+        header.idr_pic_id = reader.read_ue();
+    if (sps->pic_order_cnt_type == 0) {
+        header.poc_lsb = reader.read_bits(sps->log2_max_poc_lsb);
+        if (pps->bottom_field_pic_order_in_frame_present)
+            header.delta_poc_bottom = reader.read_se();
+    }
+    if (sps->pic_order_cnt_type == 1 && sps->delta_pic_order_always_zero == false) {
+        header.delta_poc[0] = reader.read_se();
+        if (pps->bottom_field_pic_order_in_frame_present)
+            header.delta_poc[1] = reader.read_se();
+    }
+    const bool is_b = header.slice_type == h264_slice_type_t::b;
+    if (is_b)
+        header.direct_spatial_mv_pred = reader.read_bit();
+    if (header.slice_type != h264_slice_type_t::i) {
+        header.num_ref_idx_active[0] = pps->num_ref_idx_l0_default_active;
+        header.num_ref_idx_active[1] = is_b ? pps->num_ref_idx_l1_default_active : 0;
+        if (reader.read_bit()) { // num_ref_idx_active_override_flag
+            header.num_ref_idx_active[0] = reader.read_ue() + 1;
+            if (is_b)
+                header.num_ref_idx_active[1] = reader.read_ue() + 1;
+        }
+        if (header.num_ref_idx_active[0] > 32 || header.num_ref_idx_active[1] > 32)
+            return false;
+        // ref_pic_list_modification
+        for (uint32_t list = 0; list < (is_b ? 2u : 1u); ++list) {
+            if (reader.read_bit() == 0)
+                continue;
+            while (true) {
+                const uint32_t idc = reader.read_ue();
+                if (idc == 3)
+                    break;
+                if (idc > 3 || header.modifications[list].size() > 32 || reader.failed())
+                    return false;
+                header.modifications[list].emplace_back(idc, reader.read_ue());
+            }
+        }
+    }
+    if ((pps->weighted_pred && header.slice_type == h264_slice_type_t::p) ||
+        (pps->weighted_bipred_idc == 1 && is_b)) {
+        if (parse_pred_weight_table(reader, header) == false)
+            return false;
+    }
+    if (header.nal_ref_idc != 0 && parse_dec_ref_pic_marking(reader, header) == false)
+        return false;
+    if (pps->entropy_coding_mode && header.slice_type != h264_slice_type_t::i) {
+        header.cabac_init_idc = reader.read_ue();
+        if (header.cabac_init_idc > 2)
+            return false;
+    }
+    header.slice_qp = pps->pic_init_qp + reader.read_se();
+    if (header.slice_qp < 0 || header.slice_qp > 51)
+        return false;
+    if (pps->deblocking_filter_control_present) {
+        header.disable_deblocking_filter_idc = reader.read_ue();
+        if (header.disable_deblocking_filter_idc > 2)
+            return false;
+        if (header.disable_deblocking_filter_idc != 1) {
+            header.filter_offset_a = reader.read_se() * 2;
+            header.filter_offset_b = reader.read_se() * 2;
+            if (std::abs(header.filter_offset_a) > 12 || std::abs(header.filter_offset_b) > 12)
+                return false;
+        }
+    }
+    if (reader.failed())
+        return false;
+    header.data_offset = reader.bit_position();
+    return true;
+}
+
+namespace {
+
+/// @brief luma4x4BlkIdx to the position in 4x4 blocks. 6.4.3
+constexpr uint8_t block_x[16]{0, 1, 0, 1, 2, 3, 2, 3, 0, 1, 0, 1, 2, 3, 2, 3};
+constexpr uint8_t block_y[16]{0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 3, 3, 2, 2, 3, 3};
+/// @brief The position in the raster order to luma4x4BlkIdx
+constexpr uint8_t block_index[16]{0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15};
+/// @brief Zig-zag scan of the 4x4 blocks. 8.5.6
+constexpr uint8_t zigzag[16]{0, 1, 4, 8, 5, 2, 3, 6, 9, 12, 13, 10, 7, 11, 14, 15};
+
+/// @brief normAdjust4x4 of 8.5.9. The columns for (even, even), (odd, odd) and the others
+constexpr int32_t dequant_values[6][3]{{10, 16, 13}, {11, 18, 14}, {13, 20, 16},
+                                       {14, 23, 18}, {16, 25, 20}, {18, 29, 23}};
+constexpr uint8_t dequant_class[16]{0, 2, 0, 2, 2, 1, 2, 1, 0, 2, 0, 2, 2, 1, 2, 1};
+
+/// @brief QPc of Table 8-15
+constexpr uint8_t chroma_qp_table[52]{0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15, 16, 17,
+                                      18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 29, 30, 31, 32, 32, 33,
+                                      34, 34, 35, 35, 36, 36, 37, 37, 37, 38, 38, 38, 39, 39, 39, 39};
+
+/// @brief coded_block_pattern of me(v). Table 9-4. [codeNum][Intra_4x4, Inter]
+constexpr uint8_t golomb_to_cbp[48][2]{
+    {47, 0},  {31, 16}, {15, 1},  {0, 2},   {23, 4},  {27, 8},  {29, 32}, {30, 3},  {7, 5},   {11, 10},
+    {13, 12}, {14, 15}, {39, 47}, {43, 7},  {45, 11}, {46, 13}, {16, 14}, {3, 6},   {5, 9},   {10, 31},
+    {12, 35}, {19, 37}, {21, 42}, {26, 44}, {28, 33}, {35, 34}, {37, 36}, {42, 40}, {44, 39}, {1, 43},
+    {2, 45},  {4, 46},  {8, 17},  {17, 18}, {18, 20}, {20, 24}, {24, 19}, {6, 21},  {9, 26},  {22, 28},
+    {25, 23}, {32, 27}, {33, 29}, {34, 30}, {36, 22}, {40, 25}, {38, 38}, {41, 41}};
+
+enum partition_shape_t : uint8_t {
+    shape_16x16 = 0,
+    shape_16x8 = 1,
+    shape_8x16 = 2,
+    shape_8x8 = 3,
+};
+
+/// @brief The shape and predFlagLX(1 for L0, 2 for L1, 3 for Bi) of the partitions. Table 7-13, 7-14
+struct partition_mode_t final {
+    uint8_t shape;
+    uint8_t pred[2];
+};
+constexpr partition_mode_t p_mb_modes[5]{
+    {shape_16x16, {1, 0}}, {shape_16x8, {1, 1}}, {shape_8x16, {1, 1}}, {shape_8x8, {0, 0}}, {shape_8x8, {0, 0}}};
+constexpr partition_mode_t b_mb_modes[23]{
+    {shape_8x8, {0, 0}},  {shape_16x16, {1, 0}}, {shape_16x16, {2, 0}}, {shape_16x16, {3, 0}}, {shape_16x8, {1, 1}},
+    {shape_8x16, {1, 1}}, {shape_16x8, {2, 2}},  {shape_8x16, {2, 2}},  {shape_16x8, {1, 2}},  {shape_8x16, {1, 2}},
+    {shape_16x8, {2, 1}}, {shape_8x16, {2, 1}},  {shape_16x8, {1, 3}},  {shape_8x16, {1, 3}},  {shape_16x8, {2, 3}},
+    {shape_8x16, {2, 3}}, {shape_16x8, {3, 1}},  {shape_8x16, {3, 1}},  {shape_16x8, {3, 2}},  {shape_8x16, {3, 2}},
+    {shape_16x8, {3, 3}}, {shape_8x16, {3, 3}},  {shape_8x8, {0, 0}}};
+
+/// @brief The shape(0: 8x8, 1: 8x4, 2: 4x8, 3: 4x4) and predFlagLX of the sub-macroblocks. Table 7-17, 7-18
+struct sub_mode_t final {
+    uint8_t shape;
+    uint8_t pred;
+};
+constexpr sub_mode_t b_sub_modes[13]{{0, 0}, {0, 1}, {0, 2}, {0, 3}, {1, 1}, {2, 1}, {1, 2},
+                                     {2, 2}, {1, 3}, {2, 3}, {3, 1}, {3, 2}, {3, 3}};
+
+/// @brief The caches of the macroblock and its neighbors. (x, y) of the 4x4 blocks is at `12 + x + 8 * y`
+constexpr int32_t cache_index(int32_t x, int32_t y) noexcept {
+    return 12 + x + 8 * y;
+}
+constexpr int8_t ref_unavailable = -2;
+constexpr uint8_t nz_unavailable = 0x40;
+
+int32_t clip3(int32_t lower, int32_t upper, int32_t value) noexcept {
+    return value < lower ? lower : (value > upper ? upper : value);
+}
+
+int32_t median(int32_t a, int32_t b, int32_t c) noexcept {
+    return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+} // namespace
+
+struct h264_slice_decoder_t::state_t final {
+    const h264_slice_t* slice = nullptr;
+    const h264_slice_header_t* header = nullptr;
+    const h264_pps_t* pps = nullptr;
+    h264_picture_context_t* context = nullptr;
+    h264_picture_t* picture = nullptr;
+    bool cabac_mode = false;
+    bool is_b = false;
+    bool is_i = false;
+    h264_slice_reader_t reader{};
+    size_t stop_position = 0; // rbsp_stop_one_bit for more_rbsp_data
+    h264_cabac_t cabac{};
+    uint8_t states[h264_cabac_context_count]{};
+    int32_t qp = 0;
+    bool last_dqp_nonzero = false;
+    int32_t dist_scale[32]{}; // DistScaleFactor of the temporal direct. 9999 for the long-term or td == 0
+    int16_t implicit_weights[32][32]{};
+
+    // the macroblock
+    uint32_t mb_addr = 0;
+    uint32_t mb_x = 0;
+    uint32_t mb_y = 0;
+    h264_mb_t* mb = nullptr;
+    const h264_mb_t* left = nullptr; // A
+    const h264_mb_t* top = nullptr;  // B
+    const h264_mb_t* top_left = nullptr;
+    const h264_mb_t* top_right = nullptr;
+    uint32_t intra16x16_mode = 0;
+    uint8_t sub_types[4]{};
+
+    int8_t ref[2][40]{};
+    int16_t mv[2][40][2]{};
+    uint8_t mvd[2][40][2]{};
+    uint8_t direct[40]{};
+    int8_t intra_modes[40]{};
+    uint8_t nz[3][40]{};
+    // spatial direct. refIdxL0/L1 and the mv predictions of 8.4.1.2.2
+    int8_t direct_ref[2]{};
+    int16_t direct_mv[2][2]{};
+    bool direct_ready = false;
+
+    alignas(16) int16_t coeffs[3][16][16]{}; // [plane][4x4 in the raster order][coefficient in the raster order]
+    int16_t levels[16]{};
+    alignas(16) uint8_t prediction[3][16 * 16]{};
+    uint8_t edge[21 * 21]{};
+
+  public:
+    bool decode(const h264_slice_t& _slice, h264_picture_context_t& _context) noexcept;
+
+  private:
+    void setup_weights() noexcept;
+    bool more_rbsp_data() const noexcept {
+        return reader.bit_position() < stop_position;
+    }
+
+    void start_mb(uint32_t addr) noexcept;
+    void fill_caches() noexcept;
+    void finish_mb() noexcept;
+    bool decode_skip() noexcept;
+    bool decode_mb() noexcept;
+    bool parse_mb() noexcept;
+    bool decode_intra_type(uint32_t type) noexcept;
+    bool decode_pcm() noexcept;
+    bool decode_inter(const partition_mode_t& mode, bool ref0) noexcept;
+    bool decode_residual(uint32_t cbp) noexcept;
+    bool read_block(h264_block_cat_t cat, uint32_t plane, uint32_t index, uint32_t max_coeff) noexcept;
+
+    // syntax elements
+    uint32_t read_mb_type() noexcept;
+    uint32_t read_intra_type(uint32_t offset) noexcept;
+    uint32_t read_sub_type() noexcept;
+    bool read_skip_flag() noexcept;
+    int32_t read_ref_idx(uint32_t list, int32_t index) noexcept;
+    int32_t read_mvd(uint32_t list, int32_t index, uint32_t component) noexcept;
+    uint32_t read_chroma_pred_mode() noexcept;
+    uint32_t read_cbp() noexcept;
+    int32_t read_qp_delta() noexcept;
+    bool read_coded_block_flag(h264_block_cat_t cat, uint32_t plane, int32_t index) noexcept;
+
+    // motion vectors
+    void predict_mv(uint32_t list, int32_t index, int32_t width, int32_t ref_idx, uint32_t shape,
+                    int16_t* mvp) const noexcept;
+    void predict_p_skip() noexcept;
+    void predict_direct(uint32_t block8x8) noexcept;
+    void predict_direct_spatial(uint32_t block8x8) noexcept;
+    void predict_direct_temporal(uint32_t block8x8) noexcept;
+    void fill_motion(uint32_t list, int32_t index, int32_t width, int32_t height, int32_t ref_idx,
+                     const int16_t* mv) noexcept;
+
+    // reconstruction
+    void reconstruct() noexcept;
+    void reconstruct_intra() noexcept;
+    void reconstruct_inter() noexcept;
+    void predict_block(int32_t x, int32_t y, int32_t width, int32_t height) noexcept;
+    void mc_luma(const h264_picture_t& ref, int32_t x, int32_t y, const int16_t* mv, int32_t width, int32_t height,
+                 uint8_t* dst, size_t stride) noexcept;
+    void mc_chroma(const h264_picture_t& ref, uint32_t plane, int32_t x, int32_t y, const int16_t* mv, int32_t width,
+                   int32_t height, uint8_t* dst, size_t stride) noexcept;
+    void add_residual_luma() noexcept;
+    void add_residual_chroma() noexcept;
+    uint32_t intra_neighbors(bool has_left, bool has_top, bool has_top_left, bool has_top_right) const noexcept;
+};
+
+bool h264_slice_decoder_t::state_t::decode(const h264_slice_t& _slice, h264_picture_context_t& _context) noexcept {
+    slice = &_slice;
+    header = &_slice.header;
+    pps = _slice.pps.get();
+    context = &_context;
+    picture = _context.picture;
+    cabac_mode = pps->entropy_coding_mode;
+    is_b = header->slice_type == h264_slice_type_t::b;
+    is_i = header->slice_type == h264_slice_type_t::i;
+    qp = header->slice_qp;
+    last_dqp_nonzero = false;
+    reader = h264_slice_reader_t{slice->rbsp.data(), slice->rbsp_size};
+    reader.skip_bits(static_cast<uint32_t>(header->data_offset));
+    stop_position = 0;
+    for (size_t i = slice->rbsp_size; i > 0; --i) {
+        const uint8_t value = slice->rbsp[i - 1];
+        if (value == 0)
+            continue;
+        uint32_t trailing = 0;
+        while ((value & (1u << trailing)) == 0)
+            ++trailing;
+        stop_position = i * 8 - trailing - 1;
+        break;
+    }
+    if (cabac_mode) {
+        reader.align(); // cabac_alignment_one_bit
+        cabac.init(reader.current(), reader.end());
+        h264_cabac_init_contexts(states, is_i ? 0 : header->cabac_init_idc + 1, header->slice_qp);
+    }
+    if (is_b)
+        setup_weights();
+    std::memset(coeffs, 0, sizeof(coeffs));
+
+    const uint32_t mb_count = context->width_in_mbs * context->height_in_mbs;
+    uint32_t addr = header->first_mb;
+    if (cabac_mode) {
+        while (true) {
+            if (addr >= mb_count)
+                return false;
+            start_mb(addr++);
+            const bool skip = is_i == false && read_skip_flag();
+            if ((skip ? decode_skip() : decode_mb()) == false)
+                return false;
+            if (cabac.decode_terminate()) // end_of_slice_flag
+                return true;
+        }
+    }
+    while (true) {
+        if (is_i == false) {
+            const uint32_t skip_run = reader.read_ue();
+            if (skip_run > mb_count - addr)
+                return false;
+            for (uint32_t i = 0; i < skip_run; ++i) {
+                start_mb(addr++);
+                if (decode_skip() == false)
+                    return false;
+            }
+            if (skip_run > 0 && more_rbsp_data() == false)
+                return true;
+        }
+        if (addr >= mb_count)
+            return false;
+        start_mb(addr++);
+        if (decode_mb() == false || reader.failed())
+            return false;
+        if (more_rbsp_data() == false)
+            return true;
+    }
+}
+
+/// @brief DistScaleFactor of 8.4.1.2.3 and the implicit weights of 8.4.2.3.1
+void h264_slice_decoder_t::state_t::setup_weights() noexcept {
+    const auto scale = [this](const h264_picture_t* ref0, const h264_picture_t* ref1) {
+        const int32_t tb = clip3(-128, 127, picture->poc - ref0->poc);
+        const int32_t td = clip3(-128, 127, ref1->poc - ref0->poc);
+        if (td == 0 || ref0->long_term)
+            return 9999;
+        const int32_t tx = (16384 + std::abs(td / 2)) / td;
+        return clip3(-1024, 1023, (tb * tx + 32) >> 6);
+    };
+    const h264_picture_t* col = slice->ref_list[1][0];
+    for (uint32_t i = 0; i < header->num_ref_idx_active[0]; ++i)
+        dist_scale[i] = scale(slice->ref_list[0][i], col);
+    if (pps->weighted_bipred_idc != 2)
+        return;
+    for (uint32_t i = 0; i < header->num_ref_idx_active[0]; ++i) {
+        for (uint32_t j = 0; j < header->num_ref_idx_active[1]; ++j) {
+            const h264_picture_t* ref1 = slice->ref_list[1][j];
+            const int32_t factor = ref1->long_term ? 9999 : scale(slice->ref_list[0][i], ref1);
+            implicit_weights[i][j] =
+                static_cast<int16_t>(factor == 9999 || (factor >> 2) < -64 || (factor >> 2) > 128 ? 32 : factor >> 2);
+        }
+    }
+}
+
+void h264_slice_decoder_t::state_t::start_mb(uint32_t addr) noexcept {
+    const uint32_t width = context->width_in_mbs;
+    mb_addr = addr;
+    mb_x = addr % width;
+    mb_y = addr / width;
+    mb = &context->mbs[addr];
+    *mb = h264_mb_t{};
+    mb->slice = slice->index;
+    const auto neighbor = [this](bool inside, uint32_t n) -> const h264_mb_t* {
+        // no ASO. the macroblocks from `first_mb` are of this slice
+        return inside && n >= header->first_mb ? &context->mbs[n] : nullptr;
+    };
+    left = neighbor(mb_x > 0, addr - 1);
+    top = neighbor(mb_y > 0, addr - width);
+    top_left = neighbor(mb_x > 0 && mb_y > 0, addr - width - 1);
+    top_right = neighbor(mb_x + 1 < width && mb_y > 0, addr - width + 1);
+    fill_caches();
+}
+
+void h264_slice_decoder_t::state_t::fill_caches() noexcept {
+    const bool constrained = pps->constrained_intra_pred;
+    std::memset(nz, nz_unavailable, sizeof(nz));
+    std::memset(intra_modes, -1, sizeof(intra_modes));
+    for (int32_t i = 0; i < 4; ++i) {
+        if (top) {
+            nz[0][cache_index(i, -1)] = top->nz[0][12 + i];
+            intra_modes[cache_index(i, -1)] = constrained && (top->type & mb_inter) ? -1 : top->intra_modes[12 + i];
+        }
+        if (left) {
+            nz[0][cache_index(-1, i)] = left->nz[0][3 + 4 * i];
+            intra_modes[cache_index(-1, i)] =
+                constrained && (left->type & mb_inter) ? -1 : left->intra_modes[3 + 4 * i];
+        }
+    }
+    for (uint32_t plane = 1; plane < 3; ++plane) {
+        for (int32_t i = 0; i < 2; ++i) {
+            if (top)
+                nz[plane][cache_index(i, -1)] = top->nz[plane][2 + i];
+            if (left)
+                nz[plane][cache_index(-1, i)] = left->nz[plane][1 + 2 * i];
+        }
+    }
+    for (int32_t i = 0; i < 16; ++i) {
+        nz[0][cache_index(i & 3, i >> 2)] = 0;
+        intra_modes[cache_index(i & 3, i >> 2)] = 2;
+    }
+    for (uint32_t plane = 1; plane < 3; ++plane)
+        for (int32_t i = 0; i < 4; ++i)
+            nz[plane][cache_index(i & 1, i >> 1)] = 0;
+    direct_ready = false;
+    if (is_i)
+        return;
+
+    std::memset(ref, ref_unavailable, sizeof(ref));
+    std::memset(mv, 0, sizeof(mv));
+    std::memset(mvd, 0, sizeof(mvd));
+    std::memset(direct, 0, sizeof(direct));
+    const uint32_t stride = context->width_in_mbs * 4;
+    const auto motion = [this, stride](int32_t x, int32_t y) -> const h264_motion_t& {
+        return picture->motion[static_cast<size_t>(static_cast<int32_t>(mb_y * 4) + y) * stride +
+                               static_cast<size_t>(static_cast<int32_t>(mb_x * 4) + x)];
+    };
+    const uint32_t lists = is_b ? 2 : 1;
+    for (uint32_t list = 0; list < lists; ++list) {
+        const auto load = [&](int32_t index, const h264_mb_t* n, int32_t x, int32_t y, int32_t nx, int32_t ny) {
+            const h264_motion_t& m = motion(x, y);
+            ref[list][index] = m.ref_idx[list];
+            mv[list][index][0] = m.mv[list][0];
+            mv[list][index][1] = m.mv[list][1];
+            const int32_t i = (ny & 3) * 4 + (nx & 3);
+            mvd[list][index][0] = n->mvd[list][i][0];
+            mvd[list][index][1] = n->mvd[list][i][1];
+            direct[index] = (n->direct >> ((ny & 2) + ((nx & 3) >> 1))) & 1;
+        };
+        for (int32_t i = 0; i < 4; ++i) {
+            if (top)
+                load(cache_index(i, -1), top, i, -1, i, 3);
+            if (left)
+                load(cache_index(-1, i), left, -1, i, 3, i);
+        }
+        if (top_left)
+            load(cache_index(-1, -1), top_left, -1, -1, 3, 3);
+        if (top_right)
+            load(cache_index(4, -1), top_right, 4, -1, 0, 3);
+    }
+}
+
+void h264_slice_decoder_t::state_t::finish_mb() noexcept {
+    for (int32_t i = 0; i < 16; ++i) {
+        const int32_t index = cache_index(i & 3, i >> 2);
+        mb->nz[0][i] = nz[0][index];
+        mb->intra_modes[i] = intra_modes[index];
+    }
+    for (uint32_t plane = 1; plane < 3; ++plane)
+        for (int32_t i = 0; i < 4; ++i)
+            mb->nz[plane][i] = nz[plane][cache_index(i & 1, i >> 1)];
+    picture->intra[mb_addr] = (mb->type & mb_intra) != 0;
+
+    const uint32_t stride = context->width_in_mbs * 4;
+    h264_motion_t* motion = picture->motion.data() + static_cast<size_t>(mb_y) * 4 * stride + mb_x * 4;
+    for (int32_t y = 0; y < 4; ++y, motion += stride) {
+        for (int32_t x = 0; x < 4; ++x) {
+            h264_motion_t& m = motion[x];
+            m = h264_motion_t{};
+            if (mb->type & mb_intra)
+                continue;
+            const int32_t index = cache_index(x, y);
+            for (uint32_t list = 0; list < (is_b ? 2u : 1u); ++list) {
+                const int32_t ref_idx = ref[list][index];
+                mb->mvd[list][y * 4 + x][0] = mvd[list][index][0];
+                mb->mvd[list][y * 4 + x][1] = mvd[list][index][1];
+                if (ref_idx < 0)
+                    continue;
+                m.ref_idx[list] = static_cast<int8_t>(ref_idx);
+                m.ref_id[list] = slice->ref_list[list][ref_idx]->id;
+                m.mv[list][0] = mv[list][index][0];
+                m.mv[list][1] = mv[list][index][1];
+            }
+        }
+    }
+}
+
+bool h264_slice_decoder_t::state_t::decode_skip() noexcept {
+    mb->qp = static_cast<int8_t>(qp);
+    last_dqp_nonzero = false;
+    if (is_b) {
+        mb->type = mb_skip | mb_direct | mb_inter;
+        mb->direct = 0xF;
+        for (uint32_t i = 0; i < 4; ++i)
+            predict_direct(i);
+    } else {
+        mb->type = mb_skip | mb_inter;
+        predict_p_skip();
+    }
+    reconstruct();
+    finish_mb();
+    return true;
+}
+
+bool h264_slice_decoder_t::state_t::decode_mb() noexcept {
+    if (parse_mb() == false)
+        return false;
+    if ((mb->type & mb_pcm) == 0)
+        reconstruct();
+    finish_mb();
+    return true;
+}
+
+bool h264_slice_decoder_t::state_t::parse_mb() noexcept {
+    const uint32_t type = read_mb_type();
+    if (is_i)
+        return decode_intra_type(type);
+    if (is_b) {
+        if (type >= 23)
+            return decode_intra_type(type - 23);
+        if (type == 0) { // B_Direct_16x16
+            mb->type = mb_direct | mb_inter;
+            mb->direct = 0xF;
+            for (uint32_t i = 0; i < 4; ++i)
+                predict_direct(i);
+            const uint32_t cbp = read_cbp();
+            if (cbp == UINT32_MAX)
+                return false;
+            return decode_residual(cbp);
+        }
+        return decode_inter(b_mb_modes[type], false);
+    }
+    if (type >= 5)
+        return decode_intra_type(type - 5);
+    return decode_inter(p_mb_modes[type], type == 4);
+}
+
+uint32_t h264_slice_decoder_t::state_t::intra_neighbors(bool has_left, bool has_top, bool has_top_left,
+                                                        bool has_top_right) const noexcept {
+    return (has_left ? h264_left : 0u) | (has_top ? h264_top : 0u) | (has_top_left ? h264_top_left : 0u) |
+           (has_top_right ? h264_top_right : 0u);
+}
+
+bool h264_slice_decoder_t::state_t::decode_intra_type(uint32_t type) noexcept {
+    if (type > 25)
+        return false;
+    if (type == 25)
+        return decode_pcm();
+    uint32_t cbp = 0;
+    if (type == 0) {
+        mb->type = mb_intra4x4;
+        for (uint32_t i = 0; i < 16; ++i) {
+            const int32_t index = cache_index(block_x[i], block_y[i]);
+            const int32_t a = intra_modes[index - 1], b = intra_modes[index - 8];
+            const int32_t predicted = a < 0 || b < 0 ? 2 : std::min(a, b);
+            bool use_predicted = false;
+            uint32_t remaining = 0;
+            if (cabac_mode) {
+                use_predicted = cabac.decode(states[68]);
+                if (use_predicted == false) {
+                    remaining = cabac.decode(states[69]);
+                    remaining |= cabac.decode(states[69]) << 1;
+                    remaining |= cabac.decode(states[69]) << 2;
+                }
+            } else {
+                use_predicted = reader.read_bit();
+                if (use_predicted == false)
+                    remaining = reader.read_bits(3);
+            }
+            const auto rem = static_cast<int32_t>(remaining);
+            intra_modes[index] = static_cast<int8_t>(use_predicted ? predicted : (rem < predicted ? rem : rem + 1));
+        }
+    } else {
+        mb->type = mb_intra16x16;
+        intra16x16_mode = (type - 1) % 4;
+        cbp = (((type - 1) / 4) % 3) << 4 | (type >= 13 ? 15 : 0);
+    }
+    mb->chroma_pred_mode = static_cast<uint8_t>(read_chroma_pred_mode());
+    if (mb->chroma_pred_mode > 3)
+        return false;
+    if (type == 0) {
+        cbp = read_cbp();
+        if (cbp == UINT32_MAX)
+            return false;
+    }
+    return decode_residual(cbp);
+}
+
+bool h264_slice_decoder_t::state_t::decode_pcm() noexcept {
+    const uint8_t* samples = nullptr;
+    if (cabac_mode) {
+        samples = cabac.aligned_position();
+    } else {
+        reader.align();
+        samples = reader.current();
+    }
+    const uint8_t* end = slice->rbsp.data() + slice->rbsp_size;
+    if (samples + 384 > end)
+        return false;
+    const video_frame_t& frame = picture->frame;
+    for (uint32_t y = 0; y < 16; ++y, samples += 16)
+        std::memcpy(frame.planes[0].data + (mb_y * 16 + y) * frame.planes[0].stride + mb_x * 16, samples, 16);
+    for (uint32_t plane = 1; plane < 3; ++plane)
+        for (uint32_t y = 0; y < 8; ++y, samples += 8)
+            std::memcpy(frame.planes[plane].data + (mb_y * 8 + y) * frame.planes[plane].stride + mb_x * 8, samples, 8);
+    if (cabac_mode)
+        cabac.init(samples, end);
+    else
+        reader.skip_bits(384 * 8);
+    mb->type = mb_pcm;
+    mb->qp = 0;
+    mb->cbp = 0x2F;
+    mb->cbf_dc = 7;
+    last_dqp_nonzero = false;
+    for (uint32_t plane = 0; plane < 3; ++plane)
+        for (int32_t i = 0; i < 16; ++i)
+            nz[plane][cache_index(i & 3, i >> 2)] = 16;
+    return true;
+}
+
+bool h264_slice_decoder_t::state_t::decode_inter(const partition_mode_t& mode, bool ref0) noexcept {
+    mb->type = mb_inter;
+    const uint32_t lists = is_b ? 2 : 1;
+    if (mode.shape == shape_8x8) {
+        sub_mode_t modes[4]{};
+        for (uint32_t i = 0; i < 4; ++i) {
+            sub_types[i] = static_cast<uint8_t>(read_sub_type());
+            if (sub_types[i] > (is_b ? 12 : 3))
+                return false;
+            modes[i] = is_b ? b_sub_modes[sub_types[i]] : sub_mode_t{sub_types[i], 1};
+        }
+        for (uint32_t i = 0; i < 4; ++i) {
+            if (is_b && sub_types[i] == 0) {
+                mb->direct |= 1 << i;
+                predict_direct(i);
+            }
+        }
+        for (uint32_t list = 0; list < lists; ++list) {
+            for (uint32_t i = 0; i < 4; ++i) {
+                if (is_b && sub_types[i] == 0)
+                    continue;
+                const int32_t index = cache_index((i & 1) * 2, (i >> 1) * 2);
+                int32_t ref_idx = -1;
+                if (modes[i].pred & (1 << list)) {
+                    ref_idx = 0;
+                    if (header->num_ref_idx_active[list] > 1 && ref0 == false)
+                        ref_idx = read_ref_idx(list, index);
+                    if (ref_idx < 0 || ref_idx >= static_cast<int32_t>(header->num_ref_idx_active[list]))
+                        return false;
+                }
+                for (int32_t y = 0; y < 2; ++y)
+                    for (int32_t x = 0; x < 2; ++x)
+                        ref[list][index + x + 8 * y] = static_cast<int8_t>(ref_idx);
+            }
+        }
+        for (uint32_t list = 0; list < lists; ++list) {
+            for (uint32_t i = 0; i < 4; ++i) {
+                if (is_b && sub_types[i] == 0)
+                    continue;
+                const int32_t base = cache_index((i & 1) * 2, (i >> 1) * 2);
+                const int32_t ref_idx = ref[list][base];
+                const uint32_t shape = modes[i].shape;
+                const int32_t width = shape & 2 ? 1 : 2, height = shape & 1 ? 1 : 2;
+                for (int32_t y = 0; y < 2; y += height) {
+                    for (int32_t x = 0; x < 2; x += width) {
+                        const int32_t index = base + x + 8 * y;
+                        int16_t mvp[2]{};
+                        if (ref_idx >= 0) {
+                            predict_mv(list, index, width, ref_idx, shape_16x16, mvp);
+                            for (uint32_t c = 0; c < 2; ++c) {
+                                const int32_t delta = read_mvd(list, index, c);
+                                mvp[c] = static_cast<int16_t>(mvp[c] + delta);
+                                const auto amvd = static_cast<uint8_t>(std::min(std::abs(delta), 64));
+                                for (int32_t j = 0; j < height; ++j)
+                                    for (int32_t k = 0; k < width; ++k)
+                                        mvd[list][index + k + 8 * j][c] = amvd;
+                            }
+                        }
+                        fill_motion(list, index, width, height, ref_idx, mvp);
+                    }
+                }
+            }
+        }
+    } else {
+        const int32_t count = mode.shape == shape_16x16 ? 1 : 2;
+        const int32_t width = mode.shape == shape_8x16 ? 2 : 4, height = mode.shape == shape_16x8 ? 2 : 4;
+        const auto part_index = [&mode](int32_t part) {
+            return mode.shape == shape_16x8 ? cache_index(0, 2 * part) : cache_index(2 * part, 0);
+        };
+        for (uint32_t list = 0; list < lists; ++list) {
+            for (int32_t part = 0; part < count; ++part) {
+                const int32_t index = part_index(part);
+                int32_t ref_idx = -1;
+                if (mode.pred[part] & (1 << list)) {
+                    ref_idx = 0;
+                    if (header->num_ref_idx_active[list] > 1)
+                        ref_idx = read_ref_idx(list, index);
+                    if (ref_idx < 0 || ref_idx >= static_cast<int32_t>(header->num_ref_idx_active[list]))
+                        return false;
+                }
+                for (int32_t y = 0; y < height; ++y)
+                    for (int32_t x = 0; x < width; ++x)
+                        ref[list][index + x + 8 * y] = static_cast<int8_t>(ref_idx);
+            }
+        }
+        for (uint32_t list = 0; list < lists; ++list) {
+            for (int32_t part = 0; part < count; ++part) {
+                const int32_t index = part_index(part);
+                const int32_t ref_idx = ref[list][index];
+                int16_t mvp[2]{};
+                if (ref_idx >= 0) {
+                    const uint32_t shape = mode.shape == shape_16x16 ? shape_16x16 : mode.shape * 2 - 1 + part;
+                    predict_mv(list, index, width, ref_idx, shape, mvp);
+                    for (uint32_t c = 0; c < 2; ++c) {
+                        const int32_t delta = read_mvd(list, index, c);
+                        mvp[c] = static_cast<int16_t>(mvp[c] + delta);
+                        const auto amvd = static_cast<uint8_t>(std::min(std::abs(delta), 64));
+                        for (int32_t y = 0; y < height; ++y)
+                            for (int32_t x = 0; x < width; ++x)
+                                mvd[list][index + x + 8 * y][c] = amvd;
+                    }
+                }
+                fill_motion(list, index, width, height, ref_idx, mvp);
+            }
+        }
+    }
+    const uint32_t cbp = read_cbp();
+    if (cbp == UINT32_MAX)
+        return false;
+    return decode_residual(cbp);
+}
+
+bool h264_slice_decoder_t::state_t::decode_residual(uint32_t cbp) noexcept {
+    mb->cbp = static_cast<uint8_t>(cbp);
+    const bool intra16x16 = mb->type & mb_intra16x16;
+    if (cbp == 0 && intra16x16 == false) {
+        last_dqp_nonzero = false;
+    } else {
+        const int32_t delta = read_qp_delta();
+        if (delta < -26 || delta > 25)
+            return false;
+        last_dqp_nonzero = delta != 0;
+        qp = (qp + delta + 52) % 52;
+    }
+    mb->qp = static_cast<int8_t>(qp);
+
+    if (intra16x16) {
+        if (read_block(h264_block_cat_t::luma_dc, 0, 0, 16) == false)
+            return false;
+        // 8.5.10. the Hadamard transform and the scaling of Intra16x16DCLevel
+        int32_t c[16]{};
+        for (uint32_t i = 0; i < 16; ++i)
+            c[zigzag[i]] = levels[i];
+        int32_t f[16]{};
+        for (uint32_t i = 0; i < 4; ++i) {
+            const int32_t* r = c + 4 * i;
+            f[4 * i + 0] = r[0] + r[1] + r[2] + r[3];
+            f[4 * i + 1] = r[0] + r[1] - r[2] - r[3];
+            f[4 * i + 2] = r[0] - r[1] - r[2] + r[3];
+            f[4 * i + 3] = r[0] - r[1] + r[2] - r[3];
+        }
+        const int32_t scale = dequant_values[qp % 6][0] * 16, shift = qp / 6;
+        for (uint32_t j = 0; j < 4; ++j) {
+            const int32_t col[4]{f[j], f[4 + j], f[8 + j], f[12 + j]};
+            const int32_t g[4]{col[0] + col[1] + col[2] + col[3], col[0] + col[1] - col[2] - col[3],
+                               col[0] - col[1] - col[2] + col[3], col[0] - col[1] + col[2] - col[3]};
+            for (uint32_t i = 0; i < 4; ++i) {
+                const int32_t value = shift >= 6 ? g[i] * scale * (1 << (shift - 6))
+                                                 : (g[i] * scale + (1 << (5 - shift))) >> (6 - shift);
+                coeffs[0][4 * i + j][0] = static_cast<int16_t>(value);
+            }
+        }
+    }
+    // the 4x4 blocks in the order of luma4x4BlkIdx
+    for (uint32_t i = 0; i < 16; ++i) {
+        if ((cbp >> (i / 4) & 1) == 0)
+            continue;
+        const uint32_t raster = block_y[i] * 4 + block_x[i];
+        const bool ok = intra16x16 ? read_block(h264_block_cat_t::luma_ac, 0, raster, 15)
+                                   : read_block(h264_block_cat_t::luma_4x4, 0, raster, 16);
+        if (ok == false)
+            return false;
+    }
+    const uint32_t chroma = cbp >> 4;
+    if (chroma == 0)
+        return true;
+    int32_t dc[2][4]{};
+    for (uint32_t plane = 1; plane < 3; ++plane) {
+        if (read_block(h264_block_cat_t::chroma_dc, plane, 0, 4) == false)
+            return false;
+        for (uint32_t i = 0; i < 4; ++i)
+            dc[plane - 1][i] = levels[i];
+    }
+    const int32_t offsets[2]{pps->chroma_qp_index_offset, pps->second_chroma_qp_index_offset};
+    for (uint32_t plane = 1; plane < 3; ++plane) {
+        // 8.5.11. 2x2 transform and the scaling
+        const int32_t* c = dc[plane - 1];
+        const int32_t qpc = chroma_qp_table[clip3(0, 51, qp + offsets[plane - 1])];
+        const int32_t scale = dequant_values[qpc % 6][0] * 16;
+        const int32_t f[4]{c[0] + c[1] + c[2] + c[3], c[0] - c[1] + c[2] - c[3], c[0] + c[1] - c[2] - c[3],
+                           c[0] - c[1] - c[2] + c[3]};
+        for (uint32_t i = 0; i < 4; ++i)
+            coeffs[plane][i][0] = static_cast<int16_t>((f[i] * scale * (1 << (qpc / 6))) >> 5);
+    }
+    if (chroma < 2)
+        return true;
+    for (uint32_t plane = 1; plane < 3; ++plane)
+        for (uint32_t i = 0; i < 4; ++i)
+            if (read_block(h264_block_cat_t::chroma_ac, plane, i, 15) == false)
+                return false;
+    return true;
+}
+
+/// @brief Read a residual block and scale the coefficients into `coeffs`. The DC blocks are left in `levels`
+bool h264_slice_decoder_t::state_t::read_block(h264_block_cat_t cat, uint32_t plane, uint32_t index,
+                                               uint32_t max_coeff) noexcept {
+    const bool is_chroma = plane > 0;
+    const bool is_dc = cat == h264_block_cat_t::luma_dc || cat == h264_block_cat_t::chroma_dc;
+    const int32_t cache = is_dc ? cache_index(0, 0)
+                                : (is_chroma ? cache_index(index & 1, index >> 1) : cache_index(index & 3, index >> 2));
+    std::memset(levels, 0, sizeof(levels));
+    uint32_t count = 0;
+    if (cabac_mode) {
+        if (read_coded_block_flag(cat, plane, cache)) {
+            count = h264_read_residual_cabac(cabac, states, cat, max_coeff, levels);
+            if (is_dc)
+                mb->cbf_dc |= 1 << plane;
+        }
+    } else {
+        int32_t nc = -1;
+        if (cat != h264_block_cat_t::chroma_dc) {
+            const uint8_t a = nz[plane][cache - 1], b = nz[plane][cache - 8];
+            if (a != nz_unavailable && b != nz_unavailable)
+                nc = (a + b + 1) >> 1;
+            else if (a != nz_unavailable)
+                nc = a;
+            else if (b != nz_unavailable)
+                nc = b;
+            else
+                nc = 0;
+        }
+        const int32_t total = h264_read_residual_cavlc(reader, nc, max_coeff, levels);
+        if (total < 0)
+            return false;
+        count = static_cast<uint32_t>(total);
+    }
+    if (is_dc)
+        return true;
+    nz[plane][cache] = static_cast<uint8_t>(count);
+    if (count == 0)
+        return true;
+    const int32_t chroma_offset = plane == 1 ? pps->chroma_qp_index_offset : pps->second_chroma_qp_index_offset;
+    const int32_t block_qp = is_chroma ? chroma_qp_table[clip3(0, 51, qp + chroma_offset)] : qp;
+    const int32_t* scale = dequant_values[block_qp % 6];
+    const int32_t shift = block_qp / 6;
+    const uint32_t first = max_coeff == 15 ? 1 : 0;
+    int16_t* block = coeffs[plane][index];
+    for (uint32_t i = 0; i < max_coeff; ++i) {
+        const uint32_t position = zigzag[i + first];
+        block[position] = static_cast<int16_t>(levels[i] * scale[dequant_class[position]] * (1 << shift));
+    }
+    return true;
+}
+
+uint32_t h264_slice_decoder_t::state_t::read_mb_type() noexcept {
+    if (cabac_mode == false)
+        return reader.read_ue();
+    if (is_i) {
+        const uint32_t ctx = (left && (left->type & mb_intra4x4) == 0) + (top && (top->type & mb_intra4x4) == 0);
+        if (cabac.decode(states[3 + ctx]) == 0)
+            return 0;
+        return read_intra_type(3);
+    }
+    if (is_b) {
+        // 9.3.3.1.1.3 and the binarization of Table 9-37
+        const uint32_t ctx = (left && (left->type & mb_direct) == 0) + (top && (top->type & mb_direct) == 0);
+        if (cabac.decode(states[27 + ctx]) == 0)
+            return 0; // B_Direct_16x16
+        if (cabac.decode(states[27 + 3]) == 0)
+            return 1 + cabac.decode(states[27 + 5]); // B_L0_16x16, B_L1_16x16
+        uint32_t bits = cabac.decode(states[27 + 4]) << 3;
+        bits |= cabac.decode(states[27 + 5]) << 2;
+        bits |= cabac.decode(states[27 + 5]) << 1;
+        bits |= cabac.decode(states[27 + 5]);
+        if (bits < 8)
+            return bits + 3; // B_Bi_16x16 to B_L1_L1_8x16
+        if (bits == 13)
+            return 23 + read_intra_type(32);
+        if (bits == 14)
+            return 11; // B_L1_L0_8x16
+        if (bits == 15)
+            return 22; // B_8x8
+        bits = (bits << 1) | cabac.decode(states[27 + 5]);
+        return bits - 4; // B_L1_L0_16x8 to B_Bi_Bi_8x16
+    }
+    if (cabac.decode(states[14]) == 0) {
+        if (cabac.decode(states[15]) == 0)
+            return 3 * cabac.decode(states[16]); // P_L0_16x16, P_8x8
+        return 2 - cabac.decode(states[17]);     // P_L0_L0_8x16, P_L0_L0_16x8
+    }
+    return 5 + read_intra_type(17);
+}
+
+/// @brief The bins of the intra mb_type after the first one
+uint32_t h264_slice_decoder_t::state_t::read_intra_type(uint32_t offset) noexcept {
+    if (offset != 3 && cabac.decode(states[offset]) == 0)
+        return 0; // I_NxN
+    if (cabac.decode_terminate())
+        return 25; // I_PCM
+    const bool intra_slice = offset == 3;
+    uint8_t* state = states + (intra_slice ? 5 : offset);
+    uint32_t type = 1 + 12 * cabac.decode(state[1]);
+    if (cabac.decode(state[2]))
+        type += 4 + 4 * cabac.decode(state[2 + intra_slice]);
+    type += 2 * cabac.decode(state[3 + intra_slice]);
+    type += cabac.decode(state[3 + 2 * intra_slice]);
+    return type;
+}
+
+uint32_t h264_slice_decoder_t::state_t::read_sub_type() noexcept {
+    if (cabac_mode == false)
+        return reader.read_ue();
+    if (is_b == false) {
+        if (cabac.decode(states[21]))
+            return 0;
+        if (cabac.decode(states[22]) == 0)
+            return 1;
+        return cabac.decode(states[23]) ? 2 : 3;
+    }
+    if (cabac.decode(states[36]) == 0)
+        return 0; // B_Direct_8x8
+    if (cabac.decode(states[37]) == 0)
+        return 1 + cabac.decode(states[39]);
+    uint32_t type = 3;
+    if (cabac.decode(states[38])) {
+        if (cabac.decode(states[39]))
+            return 11 + cabac.decode(states[39]);
+        type += 4;
+    }
+    type += 2 * cabac.decode(states[39]);
+    type += cabac.decode(states[39]);
+    return type;
+}
+
+bool h264_slice_decoder_t::state_t::read_skip_flag() noexcept {
+    const uint32_t ctx = (left && (left->type & mb_skip) == 0) + (top && (top->type & mb_skip) == 0);
+    return cabac.decode(states[(is_b ? 24 : 11) + ctx]);
+}
+
+int32_t h264_slice_decoder_t::state_t::read_ref_idx(uint32_t list, int32_t index) noexcept {
+    const uint32_t range = header->num_ref_idx_active[list] - 1;
+    if (cabac_mode == false)
+        return static_cast<int32_t>(reader.read_te(range));
+    const auto cond = [this, list](int32_t n) { return ref[list][n] > 0 && direct[n] == 0; };
+    uint32_t ctx = cond(index - 1) + 2 * cond(index - 8);
+    int32_t value = 0;
+    while (cabac.decode(states[54 + ctx])) {
+        if (++value > 32)
+            return -1;
+        ctx = value == 1 ? 4 : 5;
+    }
+    return value;
+}
+
+int32_t h264_slice_decoder_t::state_t::read_mvd(uint32_t list, int32_t index, uint32_t component) noexcept {
+    if (cabac_mode == false)
+        return reader.read_se();
+    const uint32_t offset = component == 0 ? 40 : 47;
+    const uint32_t sum = mvd[list][index - 1][component] + mvd[list][index - 8][component];
+    uint32_t ctx = sum < 3 ? 0 : (sum > 32 ? 2 : 1);
+    if (cabac.decode(states[offset + ctx]) == 0)
+        return 0;
+    // UEG3 with signedValFlag = 1 and uCoff = 9
+    int32_t value = 1;
+    ctx = 3;
+    while (value < 9 && cabac.decode(states[offset + ctx])) {
+        ++value;
+        if (ctx < 6)
+            ++ctx;
+    }
+    if (value >= 9) {
+        uint32_t k = 3;
+        while (cabac.decode_bypass()) {
+            value += 1 << k;
+            if (++k > 24)
+                return 0;
+        }
+        while (k--)
+            value += static_cast<int32_t>(cabac.decode_bypass() << k);
+    }
+    return cabac.decode_bypass() ? -value : value;
+}
+
+uint32_t h264_slice_decoder_t::state_t::read_chroma_pred_mode() noexcept {
+    if (cabac_mode == false)
+        return reader.read_ue();
+    const auto cond = [](const h264_mb_t* n) {
+        return n && (n->type & (mb_intra4x4 | mb_intra16x16)) && n->chroma_pred_mode != 0;
+    };
+    const uint32_t ctx = cond(left) + cond(top);
+    if (cabac.decode(states[64 + ctx]) == 0)
+        return 0;
+    if (cabac.decode(states[67]) == 0)
+        return 1;
+    return cabac.decode(states[67]) ? 3 : 2;
+}
+
+/// @return UINT32_MAX if broken
+uint32_t h264_slice_decoder_t::state_t::read_cbp() noexcept {
+    if (cabac_mode == false) {
+        const uint32_t code = reader.read_ue();
+        if (code >= 48)
+            return UINT32_MAX;
+        return golomb_to_cbp[code][(mb->type & mb_intra4x4) ? 0 : 1];
+    }
+    // the neighbors which are not available count as coded. 9.3.3.1.1.4
+    const uint32_t left_cbp = left ? left->cbp : 0x0F;
+    const uint32_t top_cbp = top ? top->cbp : 0x0F;
+    uint32_t cbp = 0;
+    for (uint32_t i = 0; i < 4; ++i) {
+        const uint32_t a = i & 1 ? cbp >> (i - 1) : left_cbp >> (i + 1);
+        const uint32_t b = i & 2 ? cbp >> (i - 2) : top_cbp >> (i + 2);
+        const uint32_t ctx = ((a & 1) == 0) + 2 * ((b & 1) == 0);
+        cbp |= cabac.decode(states[73 + ctx]) << i;
+    }
+    const uint32_t a = left ? (left->cbp >> 4) : 0, b = top ? (top->cbp >> 4) : 0;
+    if (cabac.decode(states[77 + (a > 0) + 2 * (b > 0)]) == 0)
+        return cbp;
+    return cbp | (cabac.decode(states[77 + 4 + (a == 2) + 2 * (b == 2)]) ? 0x20 : 0x10);
+}
+
+int32_t h264_slice_decoder_t::state_t::read_qp_delta() noexcept {
+    if (cabac_mode == false)
+        return reader.read_se();
+    if (cabac.decode(states[60 + last_dqp_nonzero]) == 0)
+        return 0;
+    int32_t value = 1;
+    uint32_t ctx = 2;
+    while (cabac.decode(states[60 + ctx])) {
+        ctx = 3;
+        if (++value > 52)
+            return 99;
+    }
+    return value & 1 ? (value + 1) / 2 : -((value + 1) / 2);
+}
+
+bool h264_slice_decoder_t::state_t::read_coded_block_flag(h264_block_cat_t cat, uint32_t plane,
+                                                          int32_t index) noexcept {
+    // 9.3.3.1.1.9. the unavailable neighbors count as coded for the intra macroblocks
+    const bool intra = mb->type & mb_intra;
+    uint32_t a = 0, b = 0;
+    if (cat == h264_block_cat_t::luma_dc || cat == h264_block_cat_t::chroma_dc) {
+        a = left ? (left->cbf_dc >> plane) & 1 : intra;
+        b = top ? (top->cbf_dc >> plane) & 1 : intra;
+    } else {
+        const uint8_t na = nz[plane][index - 1], nb = nz[plane][index - 8];
+        a = na == nz_unavailable ? intra : na != 0;
+        b = nb == nz_unavailable ? intra : nb != 0;
+    }
+    constexpr uint32_t offsets[5]{0, 4, 8, 12, 16};
+    return cabac.decode(states[85 + offsets[static_cast<uint32_t>(cat)] + a + 2 * b]);
+}
+
+/// @brief 8.4.1.3. `shape` is `shape_16x16` for the median, or 1 to 4 for the partitions of 16x8/8x16
+void h264_slice_decoder_t::state_t::predict_mv(uint32_t list, int32_t index, int32_t width, int32_t ref_idx,
+                                               uint32_t shape, int16_t* mvp) const noexcept {
+    const int32_t a = index - 1, b = index - 8;
+    int32_t c = index - 8 + width;
+    // C after the current partition in the decoding order is not available. 6.4.11.7
+    if (ref[list][c] == ref_unavailable || c == cache_index(2, 0) || c == cache_index(2, 2))
+        c = index - 9;
+    const int8_t* r = ref[list];
+    const auto copy = [mvp, this, list](int32_t n) {
+        mvp[0] = mv[list][n][0];
+        mvp[1] = mv[list][n][1];
+    };
+    switch (shape) {
+    case 1: // 16x8 upper
+        if (r[b] == ref_idx)
+            return copy(b);
+        break;
+    case 2: // 16x8 lower
+        if (r[a] == ref_idx)
+            return copy(a);
+        break;
+    case 3: // 8x16 left
+        if (r[a] == ref_idx)
+            return copy(a);
+        break;
+    case 4: // 8x16 right
+        if (r[c] == ref_idx)
+            return copy(c);
+        break;
+    default:
+        break;
+    }
+    if (r[b] == ref_unavailable && r[c] == ref_unavailable && r[a] != ref_unavailable)
+        return copy(a);
+    const int32_t matches = (r[a] == ref_idx) + (r[b] == ref_idx) + (r[c] == ref_idx);
+    if (matches == 1)
+        return copy(r[a] == ref_idx ? a : (r[b] == ref_idx ? b : c));
+    for (uint32_t i = 0; i < 2; ++i)
+        mvp[i] = static_cast<int16_t>(median(mv[list][a][i], mv[list][b][i], mv[list][c][i]));
+}
+
+/// @brief 8.4.1.1
+void h264_slice_decoder_t::state_t::predict_p_skip() noexcept {
+    const int32_t index = cache_index(0, 0);
+    const int32_t a = index - 1, b = index - 8;
+    int16_t mvp[2]{};
+    const auto zero = [this](int32_t n) { return ref[0][n] == 0 && mv[0][n][0] == 0 && mv[0][n][1] == 0; };
+    if (ref[0][a] != ref_unavailable && ref[0][b] != ref_unavailable && zero(a) == false && zero(b) == false)
+        predict_mv(0, index, 4, 0, shape_16x16, mvp);
+    fill_motion(0, index, 4, 4, 0, mvp);
+}
+
+void h264_slice_decoder_t::state_t::predict_direct(uint32_t block8x8) noexcept {
+    if (header->direct_spatial_mv_pred)
+        predict_direct_spatial(block8x8);
+    else
+        predict_direct_temporal(block8x8);
+    const int32_t index = cache_index((block8x8 & 1) * 2, (block8x8 >> 1) * 2);
+    for (int32_t y = 0; y < 2; ++y) {
+        for (int32_t x = 0; x < 2; ++x) {
+            direct[index + x + 8 * y] = 1;
+            std::memset(mvd[0][index + x + 8 * y], 0, 2);
+            std::memset(mvd[1][index + x + 8 * y], 0, 2);
+        }
+    }
+}
+
+/// @brief 8.4.1.2.2
+void h264_slice_decoder_t::state_t::predict_direct_spatial(uint32_t block8x8) noexcept {
+    if (direct_ready == false) {
+        // the neighbors of the whole macroblock. before any partition of the macroblock is filled
+        const int32_t index = cache_index(0, 0);
+        for (uint32_t list = 0; list < 2; ++list) {
+            const int8_t* r = ref[list];
+            const int32_t c = r[index - 4] == ref_unavailable ? index - 9 : index - 4;
+            const auto min_positive = [](int32_t x, int32_t y) {
+                return x >= 0 && y >= 0 ? std::min(x, y) : std::max(x, y);
+            };
+            const int32_t nearest = min_positive(r[index - 1], min_positive(r[index - 8], r[c]));
+            direct_ref[list] = static_cast<int8_t>(std::max(-1, nearest));
+        }
+        direct_mv[0][0] = direct_mv[0][1] = direct_mv[1][0] = direct_mv[1][1] = 0;
+        if (direct_ref[0] < 0 && direct_ref[1] < 0) {
+            direct_ref[0] = direct_ref[1] = 0;
+        } else {
+            for (uint32_t list = 0; list < 2; ++list)
+                if (direct_ref[list] >= 0)
+                    predict_mv(list, index, 4, direct_ref[list], shape_16x16, direct_mv[list]);
+        }
+        direct_ready = true;
+    }
+    const h264_picture_t* col = slice->ref_list[1][0];
+    const bool col_short_term = col->long_term == false;
+    const uint32_t stride = context->width_in_mbs * 4;
+    const bool inference = slice->sps->direct_8x8_inference;
+    for (int32_t y = 0; y < 2; ++y) {
+        for (int32_t x = 0; x < 2; ++x) {
+            const int32_t bx = static_cast<int32_t>(block8x8 & 1) * 2 + x;
+            const int32_t by = static_cast<int32_t>(block8x8 >> 1) * 2 + y;
+            const int32_t cx = inference ? (bx >> 1) * 3 : bx, cy = inference ? (by >> 1) * 3 : by;
+            const h264_motion_t& m = col->motion[(mb_y * 4 + cy) * stride + mb_x * 4 + cx];
+            // colZeroFlag. the mv of L1 is used when L0 is not
+            const uint32_t col_list = m.ref_idx[0] >= 0 ? 0 : 1;
+            const bool col_zero = col_short_term && m.ref_idx[col_list] == 0 && std::abs(m.mv[col_list][0]) <= 1 &&
+                                  std::abs(m.mv[col_list][1]) <= 1;
+            const int32_t index = cache_index(bx, by);
+            for (uint32_t list = 0; list < 2; ++list) {
+                ref[list][index] = direct_ref[list];
+                const bool zero = direct_ref[list] < 0 || (direct_ref[list] == 0 && col_zero);
+                mv[list][index][0] = zero ? 0 : direct_mv[list][0];
+                mv[list][index][1] = zero ? 0 : direct_mv[list][1];
+            }
+        }
+    }
+}
+
+/// @brief 8.4.1.2.3
+void h264_slice_decoder_t::state_t::predict_direct_temporal(uint32_t block8x8) noexcept {
+    const h264_picture_t* col = slice->ref_list[1][0];
+    const uint32_t stride = context->width_in_mbs * 4;
+    const bool inference = slice->sps->direct_8x8_inference;
+    for (int32_t y = 0; y < 2; ++y) {
+        for (int32_t x = 0; x < 2; ++x) {
+            const int32_t bx = static_cast<int32_t>(block8x8 & 1) * 2 + x;
+            const int32_t by = static_cast<int32_t>(block8x8 >> 1) * 2 + y;
+            const int32_t cx = inference ? (bx >> 1) * 3 : bx, cy = inference ? (by >> 1) * 3 : by;
+            const h264_motion_t& m = col->motion[(mb_y * 4 + cy) * stride + mb_x * 4 + cx];
+            int32_t ref_idx = 0;
+            int32_t mv_col[2]{};
+            const uint32_t col_list = m.ref_idx[0] >= 0 ? 0 : 1;
+            if (m.ref_idx[col_list] >= 0) {
+                mv_col[0] = m.mv[col_list][0];
+                mv_col[1] = m.mv[col_list][1];
+                // the lowest index of L0 which refers the picture of refIdxCol
+                for (uint32_t i = 0; i < header->num_ref_idx_active[0]; ++i) {
+                    if (slice->ref_list[0][i]->id == m.ref_id[col_list]) {
+                        ref_idx = static_cast<int32_t>(i);
+                        break;
+                    }
+                }
+            }
+            const int32_t index = cache_index(bx, by);
+            ref[0][index] = static_cast<int8_t>(ref_idx);
+            ref[1][index] = 0;
+            const int32_t factor = dist_scale[ref_idx];
+            for (uint32_t c = 0; c < 2; ++c) {
+                const int32_t l0 = factor == 9999 ? mv_col[c] : (factor * mv_col[c] + 128) >> 8;
+                mv[0][index][c] = static_cast<int16_t>(l0);
+                mv[1][index][c] = static_cast<int16_t>(factor == 9999 ? 0 : l0 - mv_col[c]);
+            }
+        }
+    }
+}
+
+void h264_slice_decoder_t::state_t::fill_motion(uint32_t list, int32_t index, int32_t width, int32_t height,
+                                                int32_t ref_idx, const int16_t* value) noexcept {
+    for (int32_t y = 0; y < height; ++y) {
+        for (int32_t x = 0; x < width; ++x) {
+            ref[list][index + x + 8 * y] = static_cast<int8_t>(ref_idx);
+            mv[list][index + x + 8 * y][0] = value[0];
+            mv[list][index + x + 8 * y][1] = value[1];
+        }
+    }
+}
+
+void h264_slice_decoder_t::state_t::reconstruct() noexcept {
+    if (mb->type & mb_intra)
+        reconstruct_intra();
+    else
+        reconstruct_inter();
+}
+
+void h264_slice_decoder_t::state_t::reconstruct_intra() noexcept {
+    const video_frame_t& frame = picture->frame;
+    const size_t stride = frame.planes[0].stride;
+    uint8_t* luma = frame.planes[0].data + mb_y * 16 * stride + mb_x * 16;
+    const auto usable = [this](const h264_mb_t* n) {
+        return n && (pps->constrained_intra_pred == false || (n->type & mb_intra));
+    };
+    const bool has_left = usable(left), has_top = usable(top);
+    const bool has_top_left = usable(top_left), has_top_right = usable(top_right);
+    if (mb->type & mb_intra4x4) {
+        for (uint32_t i = 0; i < 16; ++i) {
+            const uint32_t x = block_x[i], y = block_y[i];
+            const uint32_t raster = y * 4 + x;
+            // the top-right block is available if decoded before in the macroblock. 6.4.11.4
+            bool top_right_ok = false;
+            if (y == 0)
+                top_right_ok = x < 3 ? has_top : has_top_right;
+            else
+                top_right_ok = x < 3 && block_index[(y - 1) * 4 + x + 1] < i;
+            const bool top_left_ok =
+                x > 0 && y > 0 ? true : (x == 0 && y == 0 ? has_top_left : (x == 0 ? has_left : has_top));
+            uint8_t* dst = luma + y * 4 * stride + x * 4;
+            h264_predict_4x4(dst, stride, static_cast<uint32_t>(intra_modes[cache_index(x, y)]),
+                             intra_neighbors(x > 0 || has_left, y > 0 || has_top, top_left_ok, top_right_ok));
+            if (nz[0][cache_index(x, y)])
+                h264_idct4x4_add(dst, stride, coeffs[0][raster]);
+        }
+    } else {
+        h264_predict_16x16(luma, stride, intra16x16_mode, intra_neighbors(has_left, has_top, has_top_left, false));
+        add_residual_luma();
+    }
+    for (uint32_t plane = 1; plane < 3; ++plane) {
+        const size_t chroma_stride = frame.planes[plane].stride;
+        h264_predict_chroma(frame.planes[plane].data + mb_y * 8 * chroma_stride + mb_x * 8, chroma_stride,
+                            mb->chroma_pred_mode, intra_neighbors(has_left, has_top, has_top_left, false));
+    }
+    add_residual_chroma();
+}
+
+void h264_slice_decoder_t::state_t::add_residual_luma() noexcept {
+    const video_frame_t& frame = picture->frame;
+    const size_t stride = frame.planes[0].stride;
+    uint8_t* luma = frame.planes[0].data + mb_y * 16 * stride + mb_x * 16;
+    const bool intra16x16 = mb->type & mb_intra16x16;
+    for (uint32_t i = 0; i < 16; ++i) {
+        const uint32_t x = i & 3, y = i >> 2;
+        uint8_t* dst = luma + y * 4 * stride + x * 4;
+        if (nz[0][cache_index(x, y)])
+            h264_idct4x4_add(dst, stride, coeffs[0][i]);
+        else if (intra16x16 && coeffs[0][i][0])
+            h264_idct4x4_dc_add(dst, stride, coeffs[0][i]);
+    }
+}
+
+void h264_slice_decoder_t::state_t::add_residual_chroma() noexcept {
+    if ((mb->cbp >> 4) == 0)
+        return;
+    const video_frame_t& frame = picture->frame;
+    for (uint32_t plane = 1; plane < 3; ++plane) {
+        const size_t stride = frame.planes[plane].stride;
+        uint8_t* base = frame.planes[plane].data + mb_y * 8 * stride + mb_x * 8;
+        for (uint32_t i = 0; i < 4; ++i) {
+            uint8_t* dst = base + (i >> 1) * 4 * stride + (i & 1) * 4;
+            if (nz[plane][cache_index(i & 1, i >> 1)])
+                h264_idct4x4_add(dst, stride, coeffs[plane][i]);
+            else if (coeffs[plane][i][0])
+                h264_idct4x4_dc_add(dst, stride, coeffs[plane][i]);
+        }
+    }
+}
+
+void h264_slice_decoder_t::state_t::reconstruct_inter() noexcept {
+    // the largest blocks which share the motion. the result doesn't depend on the size
+    const auto same = [this](int32_t a, int32_t b) {
+        for (uint32_t list = 0; list < 2; ++list) {
+            if (ref[list][a] != ref[list][b])
+                return false;
+            if (ref[list][a] >= 0 && (mv[list][a][0] != mv[list][b][0] || mv[list][a][1] != mv[list][b][1]))
+                return false;
+        }
+        return true;
+    };
+    if (is_b == false)
+        for (int32_t y = 0; y < 4; ++y)
+            std::memset(ref[1] + cache_index(0, y), -1, 4);
+    bool uniform = true;
+    for (int32_t i = 1; i < 16 && uniform; ++i)
+        uniform = same(cache_index(0, 0), cache_index(i & 3, i >> 2));
+    if (uniform) {
+        predict_block(0, 0, 4, 4);
+    } else {
+        for (int32_t i = 0; i < 4; ++i) {
+            const int32_t x = (i & 1) * 2, y = (i >> 1) * 2;
+            const int32_t index = cache_index(x, y);
+            if (same(index, index + 1) && same(index, index + 8) && same(index, index + 9)) {
+                predict_block(x, y, 2, 2);
+                continue;
+            }
+            for (int32_t j = 0; j < 4; ++j)
+                predict_block(x + (j & 1), y + (j >> 1), 1, 1);
+        }
+    }
+    add_residual_luma();
+    add_residual_chroma();
+}
+
+/// @brief Inter prediction and the weighted prediction of 8.4.2 for the blocks of (x, y) in 4x4 units
+void h264_slice_decoder_t::state_t::predict_block(int32_t x, int32_t y, int32_t width, int32_t height) noexcept {
+    const int32_t index = cache_index(x, y);
+    const int32_t ref0 = ref[0][index], ref1 = ref[1][index];
+    const video_frame_t& frame = picture->frame;
+    const int32_t px = static_cast<int32_t>(mb_x) * 16 + x * 4, py = static_cast<int32_t>(mb_y) * 16 + y * 4;
+    const int32_t w = width * 4, h = height * 4;
+    uint8_t* dst[3]{};
+    size_t strides[3]{};
+    for (uint32_t plane = 0; plane < 3; ++plane) {
+        strides[plane] = frame.planes[plane].stride;
+        const int32_t shift = plane ? 1 : 0;
+        dst[plane] = frame.planes[plane].data + static_cast<size_t>(py >> shift) * strides[plane] + (px >> shift);
+    }
+    const auto predict = [&](uint32_t list, int32_t ref_idx, uint8_t* const* out, const size_t* out_strides) {
+        const h264_picture_t& reference = *slice->ref_list[list][ref_idx];
+        const int16_t* vector = mv[list][index];
+        mc_luma(reference, px, py, vector, w, h, out[0], out_strides[0]);
+        for (uint32_t plane = 1; plane < 3; ++plane)
+            mc_chroma(reference, plane, px / 2, py / 2, vector, w / 2, h / 2, out[plane], out_strides[plane]);
+    };
+    if (ref0 >= 0 && ref1 >= 0) {
+        uint8_t* temp[3]{prediction[0], prediction[1], prediction[2]};
+        const size_t temp_strides[3]{16, 16, 16};
+        predict(0, ref0, dst, strides);
+        predict(1, ref1, temp, temp_strides);
+        if (header->explicit_weights) {
+            const h264_weight_t& w0 = header->weights[0][ref0];
+            const h264_weight_t& w1 = header->weights[1][ref1];
+            h264_biweight(dst[0], strides[0], temp[0], 16, w, h, header->luma_log2_weight_denom, w0.luma_weight,
+                          w1.luma_weight, (w0.luma_offset + w1.luma_offset + 1) >> 1);
+            for (uint32_t c = 0; c < 2; ++c)
+                h264_biweight(dst[1 + c], strides[1 + c], temp[1 + c], 16, w / 2, h / 2,
+                              header->chroma_log2_weight_denom, w0.chroma_weight[c], w1.chroma_weight[c],
+                              (w0.chroma_offset[c] + w1.chroma_offset[c] + 1) >> 1);
+        } else if (pps->weighted_bipred_idc == 2) {
+            const int32_t w1 = implicit_weights[ref0][ref1];
+            h264_biweight(dst[0], strides[0], temp[0], 16, w, h, 5, 64 - w1, w1, 0);
+            for (uint32_t c = 1; c < 3; ++c)
+                h264_biweight(dst[c], strides[c], temp[c], 16, w / 2, h / 2, 5, 64 - w1, w1, 0);
+        } else {
+            h264_average(dst[0], strides[0], temp[0], 16, w, h);
+            for (uint32_t c = 1; c < 3; ++c)
+                h264_average(dst[c], strides[c], temp[c], 16, w / 2, h / 2);
+        }
+        return;
+    }
+    const uint32_t list = ref0 >= 0 ? 0 : 1;
+    const int32_t ref_idx = ref0 >= 0 ? ref0 : ref1;
+    if (ref_idx < 0)
+        return;
+    predict(list, ref_idx, dst, strides);
+    if (header->explicit_weights) {
+        const h264_weight_t& weight = header->weights[list][ref_idx];
+        h264_weight(dst[0], strides[0], w, h, header->luma_log2_weight_denom, weight.luma_weight, weight.luma_offset);
+        for (uint32_t c = 0; c < 2; ++c)
+            h264_weight(dst[1 + c], strides[1 + c], w / 2, h / 2, header->chroma_log2_weight_denom,
+                        weight.chroma_weight[c], weight.chroma_offset[c]);
+    }
+}
+
+void h264_slice_decoder_t::state_t::mc_luma(const h264_picture_t& reference, int32_t x, int32_t y,
+                                            const int16_t* vector, int32_t width, int32_t height, uint8_t* dst,
+                                            size_t stride) noexcept {
+    const video_frame_t& frame = reference.frame;
+    const auto plane_width = static_cast<int32_t>(frame.format.width);
+    const auto plane_height = static_cast<int32_t>(frame.format.height);
+    const int32_t sx = x + (vector[0] >> 2), sy = y + (vector[1] >> 2);
+    const size_t src_stride = frame.planes[0].stride;
+    const uint8_t* src = frame.planes[0].data;
+    if (sx - 2 < 0 || sy - 2 < 0 || sx + width + 3 > plane_width || sy + height + 3 > plane_height) {
+        // the samples outside of the picture repeat the edges. 8.4.2.2.1
+        for (int32_t j = 0; j < height + 5; ++j) {
+            const uint8_t* row = src + static_cast<size_t>(clip3(0, plane_height - 1, sy - 2 + j)) * src_stride;
+            for (int32_t i = 0; i < width + 5; ++i)
+                edge[j * 21 + i] = row[clip3(0, plane_width - 1, sx - 2 + i)];
+        }
+        return h264_mc_luma(dst, stride, edge + 2 * 21 + 2, 21, width, height, vector[0] & 3, vector[1] & 3);
+    }
+    h264_mc_luma(dst, stride, src + static_cast<size_t>(sy) * src_stride + sx, src_stride, width, height,
+                 vector[0] & 3, vector[1] & 3);
+}
+
+void h264_slice_decoder_t::state_t::mc_chroma(const h264_picture_t& reference, uint32_t plane, int32_t x, int32_t y,
+                                              const int16_t* vector, int32_t width, int32_t height, uint8_t* dst,
+                                              size_t stride) noexcept {
+    const video_frame_t& frame = reference.frame;
+    const auto plane_width = static_cast<int32_t>(frame.format.width / 2);
+    const auto plane_height = static_cast<int32_t>(frame.format.height / 2);
+    const int32_t sx = x + (vector[0] >> 3), sy = y + (vector[1] >> 3);
+    const size_t src_stride = frame.planes[plane].stride;
+    const uint8_t* src = frame.planes[plane].data;
+    if (sx < 0 || sy < 0 || sx + width + 1 > plane_width || sy + height + 1 > plane_height) {
+        for (int32_t j = 0; j < height + 1; ++j) {
+            const uint8_t* row = src + static_cast<size_t>(clip3(0, plane_height - 1, sy + j)) * src_stride;
+            for (int32_t i = 0; i < width + 1; ++i)
+                edge[j * 21 + i] = row[clip3(0, plane_width - 1, sx + i)];
+        }
+        return h264_mc_chroma(dst, stride, edge, 21, width, height, vector[0] & 7, vector[1] & 7);
+    }
+    h264_mc_chroma(dst, stride, src + static_cast<size_t>(sy) * src_stride + sx, src_stride, width, height,
+                   vector[0] & 7, vector[1] & 7);
+}
+
+h264_slice_decoder_t::h264_slice_decoder_t() noexcept(false) : state{std::make_unique<state_t>()} {
+}
+
+h264_slice_decoder_t::~h264_slice_decoder_t() noexcept = default;
+
+bool h264_slice_decoder_t::decode(const h264_slice_t& slice, h264_picture_context_t& context) noexcept {
+    return state->decode(slice, context);
+}
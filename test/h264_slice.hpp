@@ -0,0 +1,193 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "h264.hpp"
+#include "h264_entropy.hpp"
+
+/**
+ * @brief Internals of `cpu_h264_decoder_t`. The slice header, the macroblock layer, the reconstruction and
+ *        the deblocking of the progressive 4:2:0 8 bit streams without the 8x8 transform
+ * @see ITU-T H.264 7.3.3, 7.3.4, 8.3 to 8.7
+ */
+
+/// @brief Motion of a 4x4 block. Kept with the picture for the direct prediction and the deblocking
+struct h264_motion_t final {
+    int16_t mv[2][2]{};
+    int8_t ref_idx[2]{-1, -1};
+    uint32_t ref_id[2]{}; // `h264_picture_t::id` of the reference picture. 0 if the list is not used
+};
+
+/// @brief A decoded picture in the DPB
+struct h264_picture_t final {
+    video_frame_t frame{}; // i420 of the whole macroblocks. the cropping is applied to the outputs
+    uint32_t id = 0;       // unique in the decoder. 0 is not used
+    int32_t poc = 0;       // PicOrderCnt. Min(TopFieldOrderCnt, BottomFieldOrderCnt)
+    uint32_t frame_num = 0;
+    int32_t frame_num_wrap = 0; // PicNum of the short-term references
+    uint32_t long_term_frame_idx = 0;
+    bool short_term = false;
+    bool long_term = false;
+    bool needed_for_output = false;
+    bool non_existing = false; // inferred for a gap of frame_num. 8.2.5.2
+    bool idr = false;
+    bool mmco5 = false;
+    int64_t timestamp = 0;
+    int64_t duration = 0;
+    std::vector<h264_motion_t> motion{}; // 4x4 blocks in the raster order
+    std::vector<uint8_t> intra{};        // 1 for the intra macroblocks
+
+  public:
+    [[nodiscard]] bool is_reference() const noexcept {
+        return short_term || long_term;
+    }
+};
+
+enum class h264_slice_type_t : uint32_t {
+    p = 0,
+    b = 1,
+    i = 2,
+    sp = 3,
+    si = 4,
+};
+
+/// @brief pred_weight_table of 7.3.3.2 for one reference. The defaults are filled when not present
+struct h264_weight_t final {
+    int32_t luma_weight = 0;
+    int32_t luma_offset = 0;
+    int32_t chroma_weight[2]{};
+    int32_t chroma_offset[2]{};
+};
+
+/// @see ITU-T H.264 7.3.3.3
+struct h264_mmco_t final {
+    uint32_t operation = 0;
+    uint32_t difference_of_pic_nums = 0; // difference_of_pic_nums_minus1 + 1
+    uint32_t long_term_pic_num = 0;
+    uint32_t long_term_frame_idx = 0;
+    uint32_t max_long_term_frame_idx_plus1 = 0;
+};
+
+/// @see ITU-T H.264 7.3.3
+struct h264_slice_header_t final {
+    h264_nal_type_t nal_type = h264_nal_type_t::slice;
+    uint32_t nal_ref_idc = 0;
+    uint32_t first_mb = 0;
+    h264_slice_type_t slice_type = h264_slice_type_t::i;
+    uint32_t pps_id = 0;
+    uint32_t frame_num = 0;
+    uint32_t idr_pic_id = 0;
+    uint32_t poc_lsb = 0;
+    int32_t delta_poc_bottom = 0;
+    int32_t delta_poc[2]{};
+    bool direct_spatial_mv_pred = false;
+    uint32_t num_ref_idx_active[2]{};
+    std::vector<std::pair<uint32_t, uint32_t>> modifications[2]{}; // modification_of_pic_nums_idc and its value
+    uint32_t luma_log2_weight_denom = 0;
+    uint32_t chroma_log2_weight_denom = 0;
+    bool explicit_weights = false;
+    h264_weight_t weights[2][32]{};
+    bool no_output_of_prior_pics = false;
+    bool long_term_reference = false;
+    bool adaptive_ref_pic_marking = false;
+    std::vector<h264_mmco_t> mmcos{};
+    uint32_t cabac_init_idc = 0;
+    int32_t slice_qp = 26;
+    uint32_t disable_deblocking_filter_idc = 0;
+    int32_t filter_offset_a = 0; // slice_alpha_c0_offset_div2 << 1
+    int32_t filter_offset_b = 0;
+    size_t data_offset = 0; // bits of the header in the RBSP
+
+  public:
+    [[nodiscard]] bool is_idr() const noexcept {
+        return nal_type == h264_nal_type_t::idr;
+    }
+    [[nodiscard]] bool has_mmco5() const noexcept;
+};
+
+/// @brief The parameter sets by their ids. The slices keep the ones they refer
+struct h264_parameter_sets_t final {
+    std::shared_ptr<const h264_sps_t> sps[32]{};
+    std::shared_ptr<const h264_pps_t> pps[256]{};
+};
+
+/**
+ * @brief Parse the slice header of the RBSP. The parameter sets are resolved with `sets`
+ * @return false if the syntax is broken or uses the features out of the scope. See `h264_is_supported`
+ */
+[[nodiscard]] bool parse_slice_header(const uint8_t* rbsp, size_t size, const h264_parameter_sets_t& sets,
+                                      h264_slice_header_t& header, std::shared_ptr<const h264_sps_t>& sps,
+                                      std::shared_ptr<const h264_pps_t>& pps) noexcept(false);
+
+/// @brief Progressive, 4:2:0, 8 bit, no 8x8 transform/scaling matrix/slice group/redundant picture
+[[nodiscard]] bool h264_is_supported(const h264_sps_t& sps) noexcept;
+[[nodiscard]] bool h264_is_supported(const h264_pps_t& pps) noexcept;
+
+/// @brief A slice which is ready to decode. The reference lists are built by the decoder
+struct h264_slice_t final {
+    h264_slice_header_t header{};
+    std::shared_ptr<const h264_sps_t> sps{};
+    std::shared_ptr<const h264_pps_t> pps{};
+    std::vector<uint8_t> rbsp{}; // with `h264_slice_padding` zeros
+    size_t rbsp_size = 0;
+    h264_picture_t* ref_list[2][32]{}; // `num_ref_idx_active` entries are not null
+    uint16_t index = 0;                 // in the picture
+};
+
+/// @brief Per macroblock state of the picture being decoded. For the neighbors and the deblocking
+struct h264_mb_t final {
+    uint32_t type = 0;  // `h264_mb_flags_t`
+    uint16_t slice = 0; // `h264_slice_t::index`
+    int8_t qp = 0;      // QPY. 0 for I_PCM
+    uint8_t cbp = 0;    // CodedBlockPatternLuma in the bits 0 to 3, CodedBlockPatternChroma in the bits 4 and 5
+    uint8_t cbf_dc = 0; // coded_block_flag of the DC blocks. the bit 0 for luma, 1 for Cb, 2 for Cr
+    uint8_t chroma_pred_mode = 0;
+    uint8_t direct = 0;     // the bit of each 8x8 predicted with the direct mode
+    int8_t intra_modes[16]{}; // Intra4x4PredMode in the raster order. 2(DC) for the other macroblocks
+    uint8_t nz[3][16]{};      // total coefficients of the 4x4 blocks in the raster order. 2x2 for the chroma
+    uint8_t mvd[2][16][2]{};  // absolute mvd. capped
+};
+
+enum h264_mb_flags_t : uint32_t {
+    mb_intra4x4 = 1 << 0,
+    mb_intra16x16 = 1 << 1,
+    mb_pcm = 1 << 2,
+    mb_skip = 1 << 3,
+    mb_direct = 1 << 4, // B_Skip, B_Direct_16x16
+    mb_inter = 1 << 5,
+    mb_intra = mb_intra4x4 | mb_intra16x16 | mb_pcm,
+};
+
+/// @brief The picture being decoded. The slices write their macroblocks and the deblocking reads all
+struct h264_picture_context_t final {
+    h264_picture_t* picture = nullptr;
+    uint32_t width_in_mbs = 0;
+    uint32_t height_in_mbs = 0;
+    std::vector<h264_mb_t> mbs{};
+    std::vector<const h264_slice_t*> slices{};
+};
+
+/**
+ * @brief Decodes the macroblocks of slices. One instance for each thread. The scratch memory is reused
+ * @note The slices of a picture can be decoded by different instances at the same time
+ */
+class h264_slice_decoder_t final {
+    struct state_t;
+    std::unique_ptr<state_t> state;
+
+  public:
+    h264_slice_decoder_t() noexcept(false);
+    h264_slice_decoder_t(const h264_slice_decoder_t&) = delete;
+    h264_slice_decoder_t(h264_slice_decoder_t&&) = delete;
+    h264_slice_decoder_t& operator=(const h264_slice_decoder_t&) = delete;
+    h264_slice_decoder_t& operator=(h264_slice_decoder_t&&) = delete;
+    ~h264_slice_decoder_t() noexcept;
+
+    /// @return false if the slice data is broken. The macroblocks before the error are kept
+    [[nodiscard]] bool decode(const h264_slice_t& slice, h264_picture_context_t& context) noexcept;
+};
+
+/// @brief Deblocking filter of 8.7 for the whole picture after all slices are decoded
+void h264_deblock_picture(h264_picture_context_t& context) noexcept;
@@ -0,0 +1,406 @@
+#include "mf_pipeline.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+#include "event_trace.hpp"
+
+namespace {
+
+/// @brief The samples of both types fit in the same buffers
+bool same_layout(IMFMediaType* lhs, IMFMediaType* rhs) noexcept {
+    GUID lsubtype{}, rsubtype{};
+    UINT64 lsize = 0, rsize = 0;
+    if (FAILED(lhs->GetGUID(MF_MT_SUBTYPE, &lsubtype)) || FAILED(rhs->GetGUID(MF_MT_SUBTYPE, &rsubtype)))
+        return false;
+    if (FAILED(lhs->GetUINT64(MF_MT_FRAME_SIZE, &lsize)) || FAILED(rhs->GetUINT64(MF_MT_FRAME_SIZE, &rsize)))
+        return false;
+    return lsubtype == rsubtype && lsize == rsize;
+}
+
+} // namespace
+
+mf_transform_driver_t::mf_transform_driver_t(winrt::com_ptr<IMFTransform> _transform, std::string_view name) noexcept(
+    false)
+    : transform{std::move(_transform)}, track{trace_register_track(name)} {
+    if (transform == nullptr)
+        winrt::throw_hresult(E_POINTER);
+}
+
+void mf_transform_driver_t::reuse(winrt::com_ptr<IMFSample> sample) noexcept {
+    reuse_sample = std::move(sample);
+}
+
+IMFTransform* mf_transform_driver_t::get() const noexcept {
+    return transform.get();
+}
+
+const mf_transform_info_t& mf_transform_driver_t::get_info() const noexcept {
+    return info;
+}
+
+IMFMediaType* mf_transform_driver_t::get_output_type() const noexcept {
+    return output_type.get();
+}
+
+size_t mf_transform_driver_t::input_count() const noexcept {
+    return num_input.load(std::memory_order_relaxed);
+}
+
+size_t mf_transform_driver_t::output_count() const noexcept {
+    return num_output.load(std::memory_order_relaxed);
+}
+
+size_t mf_transform_driver_t::discarded_count() const noexcept {
+    return num_discarded.load(std::memory_order_relaxed);
+}
+
+HRESULT mf_transform_driver_t::start(DWORD _pool_size) noexcept {
+    try {
+        info.from(transform.get());
+    } catch (const winrt::hresult_error& ex) {
+        return ex.code();
+    }
+    istream = info.input_stream_ids[0];
+    ostream = info.output_stream_ids[0];
+    pool_size = _pool_size;
+    type_changed = false;
+    output_type = nullptr;
+    if (auto hr = transform->GetOutputCurrentType(ostream, output_type.put()); FAILED(hr))
+        return hr;
+    if (auto hr = reset_allocator(); FAILED(hr))
+        return hr;
+    if (auto hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL); FAILED(hr))
+        return hr;
+    return transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL);
+}
+
+/// @note `MFCreateVideoSampleAllocatorEx` recycles the samples when the consumers release them.
+///       It can't serve the compressed types. Then the samples are allocated for each output
+HRESULT mf_transform_driver_t::reset_allocator() noexcept {
+    if (allocator)
+        allocator->UninitializeSampleAllocator();
+    allocator = nullptr;
+    if (reuse_sample || info.output_provide_sample())
+        return S_OK;
+    if (auto hr = MFCreateVideoSampleAllocatorEx(IID_PPV_ARGS(allocator.put())); FAILED(hr))
+        return hr;
+    if (auto hr = allocator->InitializeSampleAllocatorEx(1, pool_size, nullptr, output_type.get()); FAILED(hr)) {
+        spdlog::debug("{}: {:#08x}", "InitializeSampleAllocatorEx", static_cast<uint32_t>(hr));
+        allocator = nullptr;
+    }
+    return S_OK;
+}
+
+HRESULT mf_transform_driver_t::make_output(winrt::com_ptr<IMFSample>& sample) noexcept {
+    if (reuse_sample) {
+        sample = reuse_sample;
+        return S_OK;
+    }
+    if (allocator) {
+        switch (auto hr = allocator->AllocateSample(sample.put())) {
+        case S_OK:
+            return S_OK;
+        case MF_E_SAMPLEALLOCATOR_EMPTY:
+            break; // every sample is in flight. allocate one more
+        default:
+            return hr;
+        }
+    }
+    return create_single_buffer_sample(sample.put(), info.output_info.cbSize);
+}
+
+/// @brief Select the available output type of the same subtype and refresh the stream info.
+///        The samples of the allocator are kept if they fit the new type
+HRESULT mf_transform_driver_t::renegotiate() noexcept {
+    GUID subtype{};
+    if (auto hr = output_type->GetGUID(MF_MT_SUBTYPE, &subtype); FAILED(hr))
+        return hr;
+    winrt::com_ptr<IMFMediaType> selected{};
+    if (auto hr = renegotiate_output(transform.get(), ostream, subtype, selected.put()); FAILED(hr))
+        return hr;
+    const bool resized = same_layout(output_type.get(), selected.get()) == false;
+    output_type = selected;
+    try {
+        info.from(transform.get());
+    } catch (const winrt::hresult_error& ex) {
+        return ex.code();
+    }
+    if (resized == false)
+        return S_OK;
+    type_changed = true;
+    return reset_allocator();
+}
+
+/**
+ * @brief The previous stage changed its output type. The outputs of the old type go first, then the input type is
+ *        replaced. The current output type is kept if the transform accepts it, like the scaler of the fixed size
+ */
+HRESULT mf_transform_driver_t::change_input(IMFMediaType* input_type, const emit_t& emit) noexcept {
+    if (auto hr = transform->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, NULL); FAILED(hr))
+        return hr;
+    if (auto hr = pull(emit, true); FAILED(hr))
+        return hr;
+    if (auto hr = transform->SetInputType(istream, input_type, 0); FAILED(hr))
+        return hr;
+    trace_emit(trace_event_t::stream_change, track, istream, 0);
+    if (SUCCEEDED(transform->SetOutputType(ostream, output_type.get(), 0))) {
+        try {
+            info.from(transform.get());
+        } catch (const winrt::hresult_error& ex) {
+            return ex.code();
+        }
+    } else if (auto hr = renegotiate(); FAILED(hr)) {
+        return hr;
+    }
+    return transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL);
+}
+
+HRESULT mf_transform_driver_t::pull(const emit_t& emit, bool draining) noexcept {
+    const bool provide_sample = info.output_provide_sample() && reuse_sample == nullptr;
+    while (true) {
+        winrt::com_ptr<IMFSample> sample{};
+        if (provide_sample == false)
+            if (auto hr = make_output(sample); FAILED(hr))
+                return hr;
+        MFT_OUTPUT_DATA_BUFFER output{};
+        output.dwStreamID = ostream;
+        output.pSample = sample.get();
+        DWORD status = 0;
+        const HRESULT hr = transform->ProcessOutput(0, 1, &output, &status);
+        if (output.pEvents)
+            output.pEvents->Release();
+        if (provide_sample && output.pSample)
+            sample.attach(output.pSample);
+        LONGLONG sample_time = 0;
+        switch (hr) {
+        case S_OK:
+            if (discard_until != LLONG_MIN) {
+                // the frames between the sync sample and the seek target. the duration may be unknown
+                LONGLONG duration = 0;
+                sample->GetSampleTime(&sample_time);
+                sample->GetSampleDuration(&duration);
+                if (sample_time + std::max<LONGLONG>(duration, 1) <= discard_until) {
+                    ++num_discarded;
+                    continue;
+                }
+                discard_until = LLONG_MIN;
+            }
+            ++num_output;
+            // the recycled samples may have the type of the last change
+            sample->DeleteItem(media0_sample_media_type);
+            if (type_changed) {
+                if (auto ec = sample->SetUnknown(media0_sample_media_type, output_type.get()); FAILED(ec))
+                    return ec;
+                type_changed = false;
+            }
+            sample->GetSampleTime(&sample_time);
+            trace_emit(trace_event_t::output_produced, track, ostream, sample_time);
+            if (auto ec = emit ? emit(sample.get()) : S_OK; FAILED(ec))
+                return ec;
+            continue;
+        case MF_E_TRANSFORM_NEED_MORE_INPUT:
+            trace_emit(draining ? trace_event_t::drain_end : trace_event_t::need_more_input, track, ostream, 0);
+            return S_OK;
+        case MF_E_TRANSFORM_STREAM_CHANGE:
+            trace_emit(trace_event_t::stream_change, track, ostream, 0, status);
+            spdlog::debug("stream changed: {:#08x}", status);
+            if (auto ec = renegotiate(); FAILED(ec))
+                return ec;
+            continue;
+        default:
+            trace_emit(trace_event_t::failed, track, ostream, 0, static_cast<uint32_t>(hr));
+            return hr;
+        }
+    }
+}
+
+HRESULT mf_transform_driver_t::process(IMFSample* input, const emit_t& emit) noexcept {
+    // the transforms may copy the attributes to their outputs. remove the type before `ProcessInput`
+    if (winrt::com_ptr<IMFMediaType> input_type{};
+        SUCCEEDED(input->GetUnknown(media0_sample_media_type, IID_PPV_ARGS(input_type.put())))) {
+        input->DeleteItem(media0_sample_media_type);
+        if (auto hr = change_input(input_type.get(), emit); FAILED(hr))
+            return hr;
+    }
+    LONGLONG sample_time = 0;
+    input->GetSampleTime(&sample_time);
+    if (auto hr = transform->ProcessInput(istream, input, 0); FAILED(hr)) {
+        trace_emit(trace_event_t::failed, track, istream, sample_time, static_cast<uint32_t>(hr));
+        return hr;
+    }
+    ++num_input;
+    trace_emit(trace_event_t::input_accepted, track, istream, sample_time);
+    return pull(emit, false);
+}
+
+HRESULT mf_transform_driver_t::drain(const emit_t& emit) noexcept {
+    if (auto hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, NULL); FAILED(hr))
+        return hr;
+    if (auto hr = transform->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, NULL); FAILED(hr))
+        return hr;
+    trace_emit(trace_event_t::drain_begin, track, ostream, 0);
+    // some transforms may not process after drain.
+    return pull(emit, true);
+}
+
+HRESULT mf_transform_driver_t::flush(LONGLONG target) noexcept {
+    if (auto hr = transform->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, NULL); FAILED(hr))
+        return hr;
+    discard_until = target;
+    return S_OK;
+}
+
+mf_pipeline_t::mf_pipeline_t(size_t _capacity) noexcept : capacity{_capacity ? _capacity : 1} {
+}
+
+mf_pipeline_t::~mf_pipeline_t() noexcept {
+    if (workers.empty())
+        return;
+    fail(E_ABORT);
+    for (auto& worker : workers)
+        worker.join();
+}
+
+mf_transform_driver_t& mf_pipeline_t::add(winrt::com_ptr<IMFTransform> transform, std::string_view name) noexcept(
+    false) {
+    if (workers.empty() == false)
+        winrt::throw_hresult(MF_E_INVALIDREQUEST);
+    return *stages.emplace_back(std::make_unique<mf_transform_driver_t>(std::move(transform), name));
+}
+
+size_t mf_pipeline_t::size() const noexcept {
+    return stages.size();
+}
+
+mf_transform_driver_t& mf_pipeline_t::stage(size_t index) const noexcept(false) {
+    return *stages.at(index);
+}
+
+HRESULT mf_pipeline_t::start(sink_t sink) noexcept {
+    if (stages.empty() || workers.empty() == false)
+        return MF_E_INVALIDREQUEST;
+    // samples in flight: the queue in front of the next stage, the one in processing, the one in emit
+    const auto pool_size = static_cast<DWORD>(capacity + 2);
+    for (auto& stage : stages)
+        if (auto hr = stage->start(pool_size); FAILED(hr))
+            return hr;
+    try {
+        for (size_t i = 0; i < stages.size(); ++i)
+            queues.emplace_back(std::make_unique<queue_t>(capacity));
+        for (size_t i = 0; i < stages.size(); ++i)
+            workers.emplace_back(&mf_pipeline_t::run, this, i, sink);
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "mf_pipeline_t", ex.what());
+        fail(E_OUTOFMEMORY);
+        return E_OUTOFMEMORY;
+    }
+    return S_OK;
+}
+
+bool mf_pipeline_t::push(winrt::com_ptr<IMFSample> sample) noexcept(false) {
+    if (queues.empty())
+        winrt::throw_hresult(MF_E_INVALIDREQUEST);
+    return queues.front()->push(std::move(sample));
+}
+
+HRESULT mf_pipeline_t::seek(LONGLONG target) noexcept(false) {
+    if (queues.empty())
+        winrt::throw_hresult(MF_E_INVALIDREQUEST);
+    // the samples before the marker are discarded stage by stage. see `flush`
+    winrt::com_ptr<IMFSample> marker{};
+    winrt::check_hresult(MFCreateSample(marker.put()));
+    winrt::check_hresult(marker->SetSampleTime(target));
+    winrt::check_hresult(marker->SetUINT64(media0_sample_seek_marker, static_cast<UINT64>(target)));
+    std::unique_lock lck{seek_mtx};
+    const uint64_t ticket = ++seeks_requested;
+    lck.unlock();
+    queues.front()->clear();
+    if (queues.front()->push(std::move(marker)) == false)
+        return error.load();
+    lck.lock();
+    seek_done.wait(lck, [this, ticket]() { return seeks_completed >= ticket || FAILED(error.load()); });
+    return error.load();
+}
+
+/// @brief The marker reached the stage. Flush it and pass the marker to the next queue without the older samples
+HRESULT mf_pipeline_t::flush(size_t index, IMFSample* marker) noexcept(false) {
+    LONGLONG target = 0;
+    marker->GetSampleTime(&target);
+    if (auto hr = stages[index]->flush(target); FAILED(hr))
+        return hr;
+    if (index + 1 < queues.size()) {
+        queues[index + 1]->clear();
+        winrt::com_ptr<IMFSample> item{};
+        item.copy_from(marker);
+        return queues[index + 1]->push(std::move(item)) ? S_OK : E_ABORT;
+    }
+    {
+        std::lock_guard lck{seek_mtx};
+        ++seeks_completed;
+    }
+    seek_done.notify_all();
+    return S_OK;
+}
+
+HRESULT mf_pipeline_t::finish() noexcept {
+    if (queues.empty())
+        return MF_E_INVALIDREQUEST;
+    queues.front()->close();
+    for (auto& worker : workers)
+        worker.join();
+    workers.clear();
+    return error.load();
+}
+
+void mf_pipeline_t::fail(HRESULT hr) noexcept {
+    HRESULT expected = S_OK;
+    error.compare_exchange_strong(expected, hr);
+    for (auto& queue : queues)
+        queue->abort();
+    {
+        std::lock_guard lck{seek_mtx}; // wakes `seek`
+    }
+    seek_done.notify_all();
+}
+
+void mf_pipeline_t::run(size_t index, sink_t sink) noexcept {
+    winrt::init_apartment();
+    mf_transform_driver_t& driver = *stages[index];
+    queue_t& input = *queues[index];
+    queue_t* output = index + 1 < queues.size() ? queues[index + 1].get() : nullptr;
+    const mf_transform_driver_t::emit_t emit = [output, &sink](IMFSample* sample) -> HRESULT {
+        if (output == nullptr)
+            return sink ? sink(sample) : S_OK;
+        winrt::com_ptr<IMFSample> item{};
+        item.copy_from(sample);
+        return output->push(std::move(item)) ? S_OK : E_ABORT;
+    };
+    HRESULT hr = S_OK;
+    try {
+        winrt::com_ptr<IMFSample> sample{};
+        while (SUCCEEDED(hr) && input.pop(sample)) {
+            if (sample->GetItem(media0_sample_seek_marker, nullptr) == S_OK)
+                hr = flush(index, sample.get());
+            else
+                hr = driver.process(sample.get(), emit);
+            sample = nullptr;
+        }
+        // the input was closed by the previous stage. check the reason
+        if (SUCCEEDED(hr) && error.load() == S_OK)
+            hr = driver.drain(emit);
+    } catch (const winrt::hresult_error& ex) {
+        hr = ex.code();
+    } catch (const std::exception&) {
+        hr = E_FAIL;
+    }
+    if (FAILED(hr) && hr != E_ABORT) {
+        spdlog::error("{}: {:#08x} {}", "mf_pipeline_t", static_cast<uint32_t>(hr),
+                      winrt::to_string(winrt::hresult_error{hr}.message()));
+        fail(hr);
+    }
+    if (output)
+        output->close();
+    winrt::uninit_apartment();
+}
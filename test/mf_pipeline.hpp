@@ -0,0 +1,168 @@
+#pragma once
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "mf_transform.hpp"
+#include "pipeline.hpp"
+
+/**
+ * @brief `IUnknown` attribute of the sample. The `IMFMediaType` of the output when it was changed by STREAM_CHANGE.
+ *        Set on the first sample of the new type, so the next `mf_transform_driver_t` changes its input type in place
+ */
+// {8B5A3F4E-2C1D-4E7A-9F60-3D2B1C0A5E71}
+inline constexpr GUID media0_sample_media_type = {
+    0x8b5a3f4e, 0x2c1d, 0x4e7a, {0x9f, 0x60, 0x3d, 0x2b, 0x1c, 0x0a, 0x5e, 0x71}};
+
+/// @brief UINT64 attribute of the sample which carries `mf_pipeline_t::seek` through the queues. The sample time is
+///        the target
+// {4E0C2B7A-91D3-4F58-A6E2-7B1D5C3F9A04}
+inline constexpr GUID media0_sample_seek_marker = {
+    0x4e0c2b7a, 0x91d3, 0x4f58, {0xa6, 0xe2, 0x7b, 0x1d, 0x5c, 0x3f, 0x9a, 0x04}};
+
+/**
+ * @brief Drives an `IMFTransform` through the basic processing model.
+ *        START_OF_STREAM/BEGIN_STREAMING, ProcessInput, ProcessOutput until NEED_MORE_INPUT,
+ *        renegotiation on STREAM_CHANGE, END_OF_STREAM/DRAIN
+ * @note The input/output types must be configured before `start`
+ * @note The stream changes are handled in place. The new output type travels with the next sample and
+ *       the sample allocator is reset only if the frame size or the subtype is changed
+ * @see https://docs.microsoft.com/en-us/windows/win32/medfound/basic-mft-processing-model
+ * @see https://docs.microsoft.com/en-us/windows/win32/medfound/handling-stream-changes
+ */
+class mf_transform_driver_t final {
+  public:
+    using emit_t = std::function<HRESULT(IMFSample*)>;
+
+  private:
+    winrt::com_ptr<IMFTransform> transform;
+    winrt::com_ptr<IMFMediaType> output_type{};
+    winrt::com_ptr<IMFVideoSampleAllocatorEx> allocator{};
+    winrt::com_ptr<IMFSample> reuse_sample{};
+    mf_transform_info_t info{};
+    DWORD istream = 0;
+    DWORD ostream = 0;
+    DWORD pool_size = 0;
+    uint16_t track = 0;
+    bool type_changed = false; // attach `output_type` to the next output
+    std::atomic<size_t> num_input{0};
+    std::atomic<size_t> num_output{0};
+    std::atomic<size_t> num_discarded{0};
+    LONGLONG discard_until = LLONG_MIN; // the outputs which end before this are not emitted
+
+  public:
+    mf_transform_driver_t(winrt::com_ptr<IMFTransform> transform, std::string_view name) noexcept(false);
+    mf_transform_driver_t(const mf_transform_driver_t&) = delete;
+    mf_transform_driver_t(mf_transform_driver_t&&) = delete;
+    mf_transform_driver_t& operator=(const mf_transform_driver_t&) = delete;
+    mf_transform_driver_t& operator=(mf_transform_driver_t&&) = delete;
+    ~mf_transform_driver_t() noexcept = default;
+
+    /// @brief Write every output to the `sample`. The consumer must be done with it before the next output
+    void reuse(winrt::com_ptr<IMFSample> sample) noexcept;
+
+    /// @param pool_size maximum count of output samples in flight
+    [[nodiscard]] HRESULT start(DWORD pool_size) noexcept;
+    /// @brief `ProcessInput` and forward all available outputs to `emit`
+    [[nodiscard]] HRESULT process(IMFSample* input, const emit_t& emit) noexcept;
+    /// @brief Notify the end of stream and forward the leftovers to `emit`
+    [[nodiscard]] HRESULT drain(const emit_t& emit) noexcept;
+    /**
+     * @brief `MFT_MESSAGE_COMMAND_FLUSH` for a seek. The transform, its types and the sample allocator are kept
+     * @param target the outputs before it are discarded without `emit`. The frames from the sync sample to the target
+     */
+    [[nodiscard]] HRESULT flush(LONGLONG target = LLONG_MIN) noexcept;
+
+    [[nodiscard]] IMFTransform* get() const noexcept;
+    [[nodiscard]] const mf_transform_info_t& get_info() const noexcept;
+    /// @brief The current output type. Changed by STREAM_CHANGE
+    [[nodiscard]] IMFMediaType* get_output_type() const noexcept;
+    [[nodiscard]] size_t input_count() const noexcept;
+    [[nodiscard]] size_t output_count() const noexcept;
+    /// @brief The outputs discarded after `flush`
+    [[nodiscard]] size_t discarded_count() const noexcept;
+
+  private:
+    HRESULT make_output(winrt::com_ptr<IMFSample>& sample) noexcept;
+    HRESULT reset_allocator() noexcept;
+    HRESULT renegotiate() noexcept;
+    HRESULT change_input(IMFMediaType* input_type, const emit_t& emit) noexcept;
+    HRESULT pull(const emit_t& emit, bool draining) noexcept;
+};
+
+/**
+ * @brief Chain of `mf_transform_driver_t`. Each stage runs on its own thread with a bounded queue in front of it,
+ *        so decode/convert/crop are pipelined across cores
+ * @code
+ * mf_pipeline_t pipeline{};
+ * pipeline.add(decoder.transform, "h264_decoder_t");
+ * pipeline.add(converter.transform, "color_converter_t");
+ * pipeline.start(sink);
+ * for (auto sample : read_samples(reader, stream))
+ *     if (pipeline.push(sample) == false)
+ *         break;
+ * HRESULT hr = pipeline.finish();
+ * @endcode
+ * @code
+ * // scrub without rebuilding the transforms
+ * pipeline.seek(target);
+ * seek_reader(reader, target); // the reader restarts at the sync sample before the target
+ * @endcode
+ */
+class mf_pipeline_t final {
+  public:
+    using sink_t = std::function<HRESULT(IMFSample*)>;
+    using queue_t = bounded_queue_t<winrt::com_ptr<IMFSample>>;
+
+  private:
+    const size_t capacity;
+    std::vector<std::unique_ptr<mf_transform_driver_t>> stages{};
+    std::vector<std::unique_ptr<queue_t>> queues{}; // `queues[i]` is the input of `stages[i]`
+    std::vector<std::thread> workers{};
+    std::atomic<HRESULT> error{S_OK};
+    std::mutex seek_mtx{};
+    std::condition_variable seek_done{};
+    uint64_t seeks_requested = 0;
+    uint64_t seeks_completed = 0; // the marker passed the last stage
+
+  public:
+    /// @param capacity length of the queue between the stages
+    explicit mf_pipeline_t(size_t capacity = 4) noexcept;
+    mf_pipeline_t(const mf_pipeline_t&) = delete;
+    mf_pipeline_t(mf_pipeline_t&&) = delete;
+    mf_pipeline_t& operator=(const mf_pipeline_t&) = delete;
+    mf_pipeline_t& operator=(mf_pipeline_t&&) = delete;
+    /// @note aborts the running stages
+    ~mf_pipeline_t() noexcept;
+
+    mf_transform_driver_t& add(winrt::com_ptr<IMFTransform> transform, std::string_view name) noexcept(false);
+    [[nodiscard]] size_t size() const noexcept;
+    [[nodiscard]] mf_transform_driver_t& stage(size_t index) const noexcept(false);
+
+    /// @param sink receives the outputs of the last stage. can be `nullptr`
+    [[nodiscard]] HRESULT start(sink_t sink) noexcept;
+    /// @return false if a stage failed. see `finish` for the reason
+    bool push(winrt::com_ptr<IMFSample> sample) noexcept(false);
+    /**
+     * @brief Discard the samples in flight and flush each stage in order. The transforms and the allocators are kept.
+     *        Push from the sync sample at or before the `target` next. The first stage discards its outputs before
+     *        the `target`, so the color conversion and the scaling don't run for them
+     * @note Call from the thread of `push`. Returns when all stages are flushed
+     * @see video_pipeline_t::seek
+     */
+    [[nodiscard]] HRESULT seek(LONGLONG target) noexcept(false);
+    /// @brief Drain the stages in order and wait for the workers
+    /// @return the first error of the stages
+    [[nodiscard]] HRESULT finish() noexcept;
+
+  private:
+    void run(size_t index, sink_t sink) noexcept;
+    HRESULT flush(size_t index, IMFSample* marker) noexcept(false);
+    void fail(HRESULT hr) noexcept;
+};
@@ -10,6 +10,9 @@
 #include <spdlog/spdlog.h>
 #include <wmcodecdsp.h>
 
+#include <cstring>
+#include <vector>
+
 winrt::com_ptr<IMFMediaType> make_video_type(const GUID& subtype) noexcept(false) {
     winrt::com_ptr<IMFMediaType> output{};
     if (auto hr = MFCreateMediaType(output.put()); FAILED(hr))
@@ -21,6 +24,44 @@ winrt::com_ptr<IMFMediaType> make_video_type(const GUID& subtype) noexcept(false
     return output;
 }
 
+HRESULT create_single_buffer_sample(IMFSample** output, DWORD bufsz) {
+    if (auto hr = MFCreateSample(output); FAILED(hr))
+        return hr;
+    winrt::com_ptr<IMFMediaBuffer> buffer{};
+    if (auto hr = MFCreateMemoryBuffer(bufsz, buffer.put()); FAILED(hr))
+        return hr;
+    // GetMaxLength will be length of the available memory location
+    // GetCurrentLength will be 0
+    IMFSample* sample = *output;
+    return sample->AddBuffer(buffer.get());
+}
+
+HRESULT renegotiate_output(IMFTransform* transform, DWORD ostream, const GUID& subtype,
+                           IMFMediaType** output) noexcept {
+    winrt::com_ptr<IMFMediaType> selected{};
+    for (DWORD i = 0;; ++i) {
+        winrt::com_ptr<IMFMediaType> available{};
+        if (auto hr = transform->GetOutputAvailableType(ostream, i, available.put()); FAILED(hr)) {
+            if (hr == MF_E_NO_MORE_TYPES)
+                break;
+            return hr;
+        }
+        if (selected == nullptr)
+            selected = available; // fallback to the most preferred one
+        GUID candidate{};
+        if (SUCCEEDED(available->GetGUID(MF_MT_SUBTYPE, &candidate)) && IsEqualGUID(candidate, subtype)) {
+            selected = available;
+            break;
+        }
+    }
+    if (selected == nullptr)
+        return MF_E_INVALIDMEDIATYPE;
+    if (auto hr = transform->SetOutputType(ostream, selected.get(), 0); FAILED(hr))
+        return hr;
+    selected.copy_to(output);
+    return S_OK;
+}
+
 void mf_transform_info_t::from(IMFTransform* transform) noexcept(false) {
     if (auto hr = transform->GetStreamCount(&num_input, &num_output); FAILED(hr))
         winrt::throw_hresult(hr);
@@ -38,6 +79,21 @@ void mf_transform_info_t::from(IMFTransform* transform) noexcept(false) {
         winrt::throw_hresult(hr);
 }
 
+void mf_transform_info_t::from(const negotiation_entry_t& entry) noexcept {
+    num_input = entry.num_input;
+    num_output = entry.num_output;
+    input_stream_ids[0] = entry.input_stream_id;
+    output_stream_ids[0] = entry.output_stream_id;
+    input_info.hnsMaxLatency = entry.input_max_latency;
+    input_info.dwFlags = entry.input_flags;
+    input_info.cbSize = entry.input_size;
+    input_info.cbMaxLookahead = entry.input_lookahead;
+    input_info.cbAlignment = entry.input_alignment;
+    output_info.dwFlags = entry.output_flags;
+    output_info.cbSize = entry.output_size;
+    output_info.cbAlignment = entry.output_alignment;
+}
+
 bool mf_transform_info_t::output_provide_sample() const noexcept {
     bool flag0 = output_info.dwFlags & MFT_OUTPUT_STREAM_PROVIDES_SAMPLES;
     bool flag1 = output_info.dwFlags & MFT_OUTPUT_STREAM_CAN_PROVIDE_SAMPLES;
@@ -62,10 +118,22 @@ bool h264_decoder_t::support(IMFMediaType* source_type) const noexcept {
     GUID subtype{};
     if FAILED (source_type->GetGUID(MF_MT_SUBTYPE, &subtype))
         return false;
-    return IsEqualGUID(subtype, MFVideoFormat_H264);
+    if (IsEqualGUID(subtype, MFVideoFormat_H264) == false && IsEqualGUID(subtype, MFVideoFormat_H264_ES) == false)
+        return false;
+    // reject the streams the decoder can't handle before it fails in the middle
+    UINT32 size = 0;
+    if (FAILED(source_type->GetBlobSize(MF_MT_MPEG_SEQUENCE_HEADER, &size)) || size == 0)
+        return true;
+    std::vector<uint8_t> blob(size);
+    if FAILED (source_type->GetBlob(MF_MT_MPEG_SEQUENCE_HEADER, blob.data(), size, &size))
+        return false;
+    h264_sps_t sps{};
+    if (probe_h264(blob.data(), size, sps) == false)
+        return false;
+    return sps.chroma_format_idc == 1 && sps.bit_depth_luma == 8 && sps.bit_depth_chroma == 8;
 }
 
-void h264_decoder_t::configure_acceleration(IMFTransform* transform) {
+void h264_decoder_t::configure_acceleration(IMFTransform* transform, uint32_t num_threads) {
     winrt::com_ptr<IMFAttributes> attrs{};
     if (auto hr = transform->GetAttributes(attrs.put()); FAILED(hr))
         return spdlog::error("{}: {:#08x}", "Failed to get IMFAttributes of the IMFTransform", hr);
@@ -73,10 +141,18 @@ void h264_decoder_t::configure_acceleration(IMFTransform* transform) {
         spdlog::error("{}: {:#08x}", "CODECAPI_AVDecVideoAcceleration_H264", hr);
     if (auto hr = attrs->SetUINT32(CODECAPI_AVLowLatencyMode, TRUE); FAILED(hr))
         spdlog::error("{}: {:#08x}", "CODECAPI_AVLowLatencyMode", hr);
-    if (auto hr = attrs->SetUINT32(CODECAPI_AVDecNumWorkerThreads, 1); FAILED(hr))
+    if (auto hr = attrs->SetUINT32(CODECAPI_AVDecNumWorkerThreads, num_threads); FAILED(hr))
         spdlog::error("{}: {:#08x}", "CODECAPI_AVDecNumWorkerThreads", hr);
 }
 
+void h264_decoder_t::configure_thumbnail(IMFTransform* transform) {
+    winrt::com_ptr<IMFAttributes> attrs{};
+    if (auto hr = transform->GetAttributes(attrs.put()); FAILED(hr))
+        return spdlog::error("{}: {:#08x}", "Failed to get IMFAttributes of the IMFTransform", hr);
+    if (auto hr = attrs->SetUINT32(CODECAPI_AVDecVideoThumbnailGenerationMode, TRUE); FAILED(hr))
+        spdlog::error("{}: {:#08x}", "CODECAPI_AVDecVideoThumbnailGenerationMode", hr);
+}
+
 color_converter_t::color_converter_t(const GUID& clsid) noexcept(false) {
     winrt::com_ptr<IUnknown> unknown{};
     if (auto hr = CoCreateInstance(clsid, nullptr, CLSCTX_ALL, IID_PPV_ARGS(unknown.put())); FAILED(hr))
@@ -186,3 +262,163 @@ HRESULT sample_processor_t::set_mirror_rotation(MF_VIDEO_PROCESSOR_MIRROR mirror
         return hr;
     return control->SetRotation(rotation);
 }
+
+static_assert(sizeof(mf_transform_key_t) == 3 * sizeof(GUID) + 4 * sizeof(UINT64), "memcmp needs no padding");
+
+bool mf_transform_key_t::operator<(const mf_transform_key_t& rhs) const noexcept {
+    return std::memcmp(this, &rhs, sizeof(mf_transform_key_t)) < 0;
+}
+
+bool mf_transform_key_t::operator==(const mf_transform_key_t& rhs) const noexcept {
+    return std::memcmp(this, &rhs, sizeof(mf_transform_key_t)) == 0;
+}
+
+/// @see https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+UINT64 hash_blob(IMFAttributes* attrs, const GUID& key) noexcept {
+    UINT8* blob = nullptr;
+    UINT32 length = 0;
+    if (FAILED(attrs->GetAllocatedBlob(key, &blob, &length)))
+        return 0;
+    UINT64 hash = 0xcbf29ce484222325;
+    for (UINT32 i = 0; i < length; ++i)
+        hash = (hash ^ blob[i]) * 0x100000001b3;
+    CoTaskMemFree(blob);
+    return hash;
+}
+
+mf_transform_key_t make_transform_key(const GUID& clsid, IMFMediaType* input, IMFMediaType* output) noexcept {
+    mf_transform_key_t key{};
+    key.clsid = clsid;
+    if (input) {
+        input->GetGUID(MF_MT_SUBTYPE, &key.input_subtype);
+        input->GetUINT64(MF_MT_FRAME_SIZE, &key.input_size);
+        input->GetUINT64(MF_MT_FRAME_RATE, &key.input_rate);
+        key.input_header = hash_blob(input, MF_MT_MPEG_SEQUENCE_HEADER);
+    }
+    if (output) {
+        output->GetGUID(MF_MT_SUBTYPE, &key.output_subtype);
+        output->GetUINT64(MF_MT_FRAME_SIZE, &key.output_size);
+    }
+    return key;
+}
+
+bool reset_transform(winrt::com_ptr<IMFTransform>& transform) noexcept {
+    if (transform == nullptr)
+        return false;
+    if (auto hr = transform->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, NULL); FAILED(hr)) {
+        spdlog::warn("{}: {:#08x}", "MFT_MESSAGE_COMMAND_FLUSH", static_cast<uint32_t>(hr));
+        return false;
+    }
+    // the next user sends BEGIN_STREAMING again
+    transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_STREAMING, NULL);
+    return true;
+}
+
+mf_transform_pool_t::lease_t acquire_transform(mf_transform_pool_t& pool, const GUID& clsid, IMFMediaType* input,
+                                               IMFMediaType* output,
+                                               const std::function<winrt::com_ptr<IMFTransform>()>& create) noexcept(
+    false) {
+    return pool.acquire(make_transform_key(clsid, input, output), [&]() {
+        winrt::com_ptr<IMFTransform> transform = create();
+        if (transform == nullptr)
+            winrt::throw_hresult(E_POINTER);
+        if (input)
+            winrt::check_hresult(transform->SetInputType(0, input, 0));
+        if (output)
+            winrt::check_hresult(transform->SetOutputType(0, output, 0));
+        return transform;
+    });
+}
+
+std::string to_guid_string(const GUID& guid) noexcept;
+
+std::string describe_type(IMFMediaType* media_type) noexcept(false) {
+    GUID subtype{};
+    if (auto hr = media_type->GetGUID(MF_MT_SUBTYPE, &subtype); FAILED(hr))
+        winrt::throw_hresult(hr);
+    UINT32 width = 0, height = 0, num = 0, den = 0;
+    MFGetAttributeSize(media_type, MF_MT_FRAME_SIZE, &width, &height);
+    MFGetAttributeRatio(media_type, MF_MT_FRAME_RATE, &num, &den);
+    UINT32 aspect_num = 0, aspect_den = 0;
+    MFGetAttributeRatio(media_type, MF_MT_PIXEL_ASPECT_RATIO, &aspect_num, &aspect_den);
+    const UINT32 interlace = MFGetAttributeUINT32(media_type, MF_MT_INTERLACE_MODE, MFVideoInterlace_Unknown);
+    const auto stride = static_cast<INT32>(MFGetAttributeUINT32(media_type, MF_MT_DEFAULT_STRIDE, 0));
+    const UINT32 range = MFGetAttributeUINT32(media_type, MF_MT_VIDEO_NOMINAL_RANGE, MFNominalRange_Unknown);
+    const UINT32 profile = MFGetAttributeUINT32(media_type, MF_MT_MPEG2_PROFILE, 0);
+    return fmt::format("{} {}x{} {}/{} {} stride={} par={}:{} range={} profile={} {:016x}", to_guid_string(subtype),
+                       width, height, num, den, interlace, stride, aspect_num, aspect_den, range, profile,
+                       hash_blob(media_type, MF_MT_MPEG_SEQUENCE_HEADER));
+}
+
+bool is_type_rejection(HRESULT hr) noexcept {
+    return hr == MF_E_INVALIDMEDIATYPE || hr == MF_E_INVALIDTYPE;
+}
+
+negotiation_entry_t to_negotiation_entry(const mf_transform_info_t& info) noexcept {
+    negotiation_entry_t entry{};
+    entry.num_input = info.num_input;
+    entry.num_output = info.num_output;
+    entry.input_stream_id = info.input_stream_ids[0];
+    entry.output_stream_id = info.output_stream_ids[0];
+    entry.input_max_latency = info.input_info.hnsMaxLatency;
+    entry.input_flags = info.input_info.dwFlags;
+    entry.input_size = info.input_info.cbSize;
+    entry.input_lookahead = info.input_info.cbMaxLookahead;
+    entry.input_alignment = info.input_info.cbAlignment;
+    entry.output_flags = info.output_info.dwFlags;
+    entry.output_size = info.output_info.cbSize;
+    entry.output_alignment = info.output_info.cbAlignment;
+    return entry;
+}
+
+HRESULT negotiate_types(negotiation_cache_t& cache, const GUID& clsid, IMFTransform* transform, IMFMediaType* input,
+                        IMFMediaType* output, mf_transform_info_t& info) noexcept {
+    try {
+        const negotiation_key_t key{to_guid_string(clsid), describe_type(input),
+                                    output ? describe_type(output) : std::string{}};
+        auto cached = cache.find(key);
+        if (cached && cached->result != negotiation_result_t::accepted) {
+            if (is_type_rejection(cached->error))
+                return cached->error;
+            cached.reset(); // the file of an older version may have the other errors. try again
+        }
+        DWORD istream = 0, ostream = 0;
+        if (cached) {
+            istream = cached->input_stream_id;
+            ostream = cached->output_stream_id;
+        } else {
+            transform->GetStreamIDs(1, &istream, 1, &ostream); // E_NOTIMPL for the most. then 0
+        }
+
+        // the other errors are transient (E_OUTOFMEMORY) or about the state of the transform
+        // (MF_E_TRANSFORM_TYPE_NOT_SET, MF_E_NOTACCEPTING). they say nothing about the types
+        negotiation_entry_t rejected{};
+        if (auto hr = transform->SetInputType(istream, input, 0); FAILED(hr)) {
+            rejected.result = negotiation_result_t::input_rejected;
+            rejected.error = hr;
+            if (is_type_rejection(hr))
+                cache.record(key, rejected);
+            return hr;
+        }
+        if (output)
+            if (auto hr = transform->SetOutputType(ostream, output, 0); FAILED(hr)) {
+                rejected.result = negotiation_result_t::output_rejected;
+                rejected.error = hr;
+                if (is_type_rejection(hr))
+                    cache.record(key, rejected);
+                return hr;
+            }
+        if (cached) {
+            info.from(*cached);
+            return S_OK;
+        }
+        info.from(transform);
+        cache.record(key, to_negotiation_entry(info));
+        return S_OK;
+    } catch (const winrt::hresult_error& ex) {
+        return ex.code();
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "negotiate_types", ex.what());
+        return E_FAIL;
+    }
+}
@@ -7,6 +7,22 @@
 
 #include <winrt/Windows.Foundation.h>
 
+#include <functional>
+#include <string>
+
+#include "h264.hpp"
+#include "negotiation_cache.hpp"
+#include "transform_pool.hpp"
+
+/// @see https://docs.microsoft.com/en-us/windows/win32/api/mfobjects/nn-mfobjects-imfmediabuffer
+HRESULT create_single_buffer_sample(IMFSample** output, DWORD bufsz);
+
+/**
+ * @brief Select the available output type of the `subtype` and set it. The most preferred one if not found
+ * @see https://docs.microsoft.com/en-us/windows/win32/medfound/handling-stream-changes
+ */
+HRESULT renegotiate_output(IMFTransform* transform, DWORD ostream, const GUID& subtype, IMFMediaType** output) noexcept;
+
 struct mf_transform_info_t final {
     DWORD num_input = 0;
     DWORD num_output = 0;
@@ -18,6 +34,8 @@ struct mf_transform_info_t final {
   public:
     /// @todo check flags related to sample/buffer constraint
     void from(IMFTransform* transform) noexcept(false);
+    /// @brief The stream info recorded by `negotiate_types`
+    void from(const negotiation_entry_t& entry) noexcept;
 
     /// @see MFT_OUTPUT_STREAM_PROVIDES_SAMPLES
     /// @see MFT_OUTPUT_STREAM_CAN_PROVIDE_SAMPLES
@@ -25,8 +43,8 @@ struct mf_transform_info_t final {
 };
 
 /**
- * @brief `IMFTransform` owner for `MFVideoFormat_H264`
- * @todo Support `MFVideoFormat_H264_ES`, `MFVideoFormat_H264_HDCP`
+ * @brief `IMFTransform` owner for `MFVideoFormat_H264`, `MFVideoFormat_H264_ES`
+ * @todo Support `MFVideoFormat_H264_HDCP`
  * @see https://docs.microsoft.com/en-us/windows/win32/medfound/h-264-video-decoder
  * @see https://docs.microsoft.com/en-us/windows/win32/medfound/basic-mft-processing-model
  */
@@ -38,11 +56,21 @@ struct h264_decoder_t final {
     explicit h264_decoder_t(const GUID& clsid) noexcept(false);
     h264_decoder_t() noexcept(false);
 
+    /// @brief The subtype and the SPS in `MF_MT_MPEG_SEQUENCE_HEADER`. 4:2:0 8 bit only
     [[nodiscard]] bool support(IMFMediaType* source_type) const noexcept;
 
   public:
-    /// @see https://docs.microsoft.com/en-us/windows/win32/medfound/h-264-video-decoder#transform-attributes
-    static void configure_acceleration(IMFTransform* transform);
+    /**
+     * @see https://docs.microsoft.com/en-us/windows/win32/medfound/h-264-video-decoder#transform-attributes
+     * @param num_threads `CODECAPI_AVDecNumWorkerThreads`. 1 because `gop_decoder_t` scales with the instances
+     */
+    static void configure_acceleration(IMFTransform* transform, uint32_t num_threads = 1);
+    /**
+     * @brief `CODECAPI_AVDecVideoThumbnailGenerationMode`. The decoder outputs the keyframes only
+     * @see thumbnail_decoder_t
+     * @see https://docs.microsoft.com/en-us/windows/win32/directshow/avdecvideothumbnailgenerationmode
+     */
+    static void configure_thumbnail(IMFTransform* transform);
 };
 
 /// @see CLSID_CColorConvertDMO
@@ -91,3 +119,73 @@ struct sample_processor_t {
     [[nodiscard]] HRESULT set_mirror_rotation(MF_VIDEO_PROCESSOR_MIRROR mirror,
                                               MF_VIDEO_PROCESSOR_ROTATION rotation) noexcept;
 };
+
+/**
+ * @brief What an `IMFTransform` is configured for. The key of `mf_transform_pool_t`
+ * @note `MF_MT_MPEG_SEQUENCE_HEADER` is hashed. The decoders with different SPS/PPS are not mixed
+ */
+struct mf_transform_key_t final {
+    GUID clsid{};
+    GUID input_subtype{};
+    GUID output_subtype{};
+    UINT64 input_size = 0; // MF_MT_FRAME_SIZE
+    UINT64 input_rate = 0; // MF_MT_FRAME_RATE
+    UINT64 output_size = 0;
+    UINT64 input_header = 0;
+
+  public:
+    [[nodiscard]] bool operator<(const mf_transform_key_t& rhs) const noexcept;
+    [[nodiscard]] bool operator==(const mf_transform_key_t& rhs) const noexcept;
+};
+
+[[nodiscard]] mf_transform_key_t make_transform_key(const GUID& clsid, IMFMediaType* input,
+                                                    IMFMediaType* output) noexcept;
+
+/**
+ * @brief Ready transforms by CLSID and types. Saves `CoCreateInstance` and the negotiation for the short streams
+ * @code
+ * mf_transform_pool_t pool{reset_transform};
+ * auto lease = acquire_transform(pool, CLSID_CColorConvertDMO, input, output,
+ *                                []() { return color_converter_t{}.transform; });
+ * mf_pipeline_t pipeline{};
+ * pipeline.add(lease.get(), "color_converter_t");
+ * // ... the lease must outlive the pipeline
+ * @endcode
+ */
+using mf_transform_pool_t = transform_pool_t<mf_transform_key_t, winrt::com_ptr<IMFTransform>>;
+
+/// @brief `MFT_MESSAGE_COMMAND_FLUSH` and `MFT_MESSAGE_NOTIFY_END_STREAMING`. The types are kept
+bool reset_transform(winrt::com_ptr<IMFTransform>& transform) noexcept;
+
+/**
+ * @brief Reuse the idle transform of the same key. Otherwise `create` and set the types
+ * @param create returns a new transform of the `clsid`. For example, `h264_decoder_t{}.transform`
+ */
+[[nodiscard]] mf_transform_pool_t::lease_t acquire_transform(
+    mf_transform_pool_t& pool, const GUID& clsid, IMFMediaType* input, IMFMediaType* output,
+    const std::function<winrt::com_ptr<IMFTransform>()>& create) noexcept(false);
+
+/**
+ * @brief Canonical text of the type for `negotiation_key_t`
+ * @details The attributes which decide the acceptance of the video types. `MF_MT_SUBTYPE`, `MF_MT_FRAME_SIZE`,
+ *          `MF_MT_FRAME_RATE`, `MF_MT_INTERLACE_MODE`, `MF_MT_DEFAULT_STRIDE`, `MF_MT_PIXEL_ASPECT_RATIO`,
+ *          `MF_MT_VIDEO_NOMINAL_RANGE`, `MF_MT_MPEG2_PROFILE` and the hash of `MF_MT_MPEG_SEQUENCE_HEADER`.
+ *          The others (for example `MF_MT_YUV_MATRIX`, `MF_MT_AVG_BITRATE`) are not in the key.
+ *          The types which differ only in them share the entry
+ */
+[[nodiscard]] std::string describe_type(IMFMediaType* media_type) noexcept(false);
+
+/// @brief The `SetInputType`/`SetOutputType` errors which reject the type itself. Only these are cached
+[[nodiscard]] bool is_type_rejection(HRESULT hr) noexcept;
+
+[[nodiscard]] negotiation_entry_t to_negotiation_entry(const mf_transform_info_t& info) noexcept;
+
+/**
+ * @brief `SetInputType` and `SetOutputType` with the `cache`.
+ *        The rejected pair returns the recorded error without the calls. The accepted one skips `GetStreamInfo`.
+ *        Only `is_type_rejection` errors are recorded. The others are returned and the next call tries again
+ * @param output can be `nullptr` for the transforms which select the output with the input
+ * @param info the stream info after the negotiation
+ */
+[[nodiscard]] HRESULT negotiate_types(negotiation_cache_t& cache, const GUID& clsid, IMFTransform* transform,
+                                      IMFMediaType* input, IMFMediaType* output, mf_transform_info_t& info) noexcept;
@@ -0,0 +1,462 @@
+#include "mf_video_transform.hpp"
+
+#include <propvarutil.h>
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char mf_native_type = 0;
+
+transform_result_t to_result(HRESULT hr, const char* fname) noexcept {
+    switch (hr) {
+    case S_OK:
+        return transform_result_t::ok;
+    case MF_E_TRANSFORM_NEED_MORE_INPUT:
+        return transform_result_t::need_more_input;
+    case MF_E_TRANSFORM_STREAM_CHANGE:
+        return transform_result_t::stream_change;
+    case MF_E_NOTACCEPTING:
+        return transform_result_t::not_accepting;
+    case MF_E_INVALIDMEDIATYPE:
+    case MF_E_INVALIDTYPE:
+        return transform_result_t::invalid_format;
+    case MF_E_TRANSFORM_TYPE_NOT_SET:
+        return transform_result_t::not_ready;
+    case E_ABORT:
+        return transform_result_t::aborted;
+    default:
+        spdlog::error("{}: {:#08x} {}", fname, static_cast<uint32_t>(hr),
+                      winrt::to_string(winrt::hresult_error{hr}.message()));
+        return transform_result_t::failed;
+    }
+}
+
+/// @brief Keeps the buffer locked while the `video_frame_t` copies are alive
+struct locked_sample_t final {
+    winrt::com_ptr<IMFSample> sample{};
+    winrt::com_ptr<IMFMediaBuffer> buffer{}; // locked with `Lock`
+    winrt::com_ptr<IMF2DBuffer> buffer2d{};  // locked with `Lock2D`
+
+  public:
+    ~locked_sample_t() noexcept {
+        if (buffer2d)
+            buffer2d->Unlock2D();
+        if (buffer)
+            buffer->Unlock();
+    }
+};
+
+} // namespace
+
+pixel_format_t to_pixel_format(const GUID& subtype) noexcept {
+    if (IsEqualGUID(subtype, MFVideoFormat_NV12))
+        return pixel_format_t::nv12;
+    if (IsEqualGUID(subtype, MFVideoFormat_I420) || IsEqualGUID(subtype, MFVideoFormat_IYUV))
+        return pixel_format_t::i420;
+    if (IsEqualGUID(subtype, MFVideoFormat_RGB32))
+        return pixel_format_t::rgb32;
+    if (IsEqualGUID(subtype, MFVideoFormat_ARGB32))
+        return pixel_format_t::argb32;
+    if (IsEqualGUID(subtype, MFVideoFormat_H264) || IsEqualGUID(subtype, MFVideoFormat_H264_ES))
+        return pixel_format_t::h264;
+    return pixel_format_t::unknown;
+}
+
+GUID to_subtype(pixel_format_t pixel) noexcept {
+    switch (pixel) {
+    case pixel_format_t::nv12:
+        return MFVideoFormat_NV12;
+    case pixel_format_t::i420:
+        return MFVideoFormat_I420;
+    case pixel_format_t::rgb32:
+        return MFVideoFormat_RGB32;
+    case pixel_format_t::argb32:
+        return MFVideoFormat_ARGB32;
+    case pixel_format_t::h264:
+        return MFVideoFormat_H264;
+    default:
+        return GUID_NULL;
+    }
+}
+
+video_format_t to_video_format(IMFMediaType* media_type) noexcept {
+    video_format_t format{};
+    GUID subtype{};
+    if (FAILED(media_type->GetGUID(MF_MT_SUBTYPE, &subtype)))
+        return format;
+    format.pixel = to_pixel_format(subtype);
+    MFGetAttributeSize(media_type, MF_MT_FRAME_SIZE, &format.width, &format.height);
+    if (FAILED(MFGetAttributeRatio(media_type, MF_MT_FRAME_RATE, &format.fps_num, &format.fps_den))) {
+        format.fps_num = 0;
+        format.fps_den = 1;
+    }
+    return format;
+}
+
+winrt::com_ptr<IMFMediaType> make_media_type(const video_format_t& format) noexcept(false) {
+    const GUID subtype = to_subtype(format.pixel);
+    if (IsEqualGUID(subtype, GUID_NULL))
+        winrt::throw_hresult(MF_E_INVALIDMEDIATYPE);
+    winrt::com_ptr<IMFMediaType> output{};
+    winrt::check_hresult(MFCreateMediaType(output.put()));
+    winrt::check_hresult(output->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
+    winrt::check_hresult(output->SetGUID(MF_MT_SUBTYPE, subtype));
+    winrt::check_hresult(output->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
+    if (format.width && format.height)
+        winrt::check_hresult(MFSetAttributeSize(output.get(), MF_MT_FRAME_SIZE, format.width, format.height));
+    if (format.fps_num)
+        winrt::check_hresult(MFSetAttributeRatio(output.get(), MF_MT_FRAME_RATE, format.fps_num, format.fps_den));
+    if (is_compressed(format.pixel) == false)
+        winrt::check_hresult(output->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE));
+    return output;
+}
+
+winrt::com_ptr<IMFMediaType> make_h264_type(const uint8_t* header, size_t size) noexcept(false) {
+    h264_sps_t sps{};
+    if (probe_h264(header, size, sps) == false)
+        winrt::throw_hresult(MF_E_INVALIDMEDIATYPE);
+    auto output = make_media_type(sps.to_format());
+    std::vector<uint8_t> blob{};
+    if (h264_avcc_config_t config{}; parse_avcc_config(header, size, config))
+        blob = to_annexb(config);
+    else
+        blob.assign(header, header + size);
+    winrt::check_hresult(output->SetBlob(MF_MT_MPEG_SEQUENCE_HEADER, blob.data(), static_cast<UINT32>(blob.size())));
+    winrt::check_hresult(output->SetUINT32(MF_MT_MPEG2_PROFILE, sps.profile_idc));
+    winrt::check_hresult(output->SetUINT32(MF_MT_MPEG2_LEVEL, sps.level_idc));
+    if (sps.sar_width && sps.sar_height)
+        winrt::check_hresult(
+            MFSetAttributeRatio(output.get(), MF_MT_PIXEL_ASPECT_RATIO, sps.sar_width, sps.sar_height));
+    if (sps.frame_mbs_only == false)
+        winrt::check_hresult(output->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_MixedInterlaceOrProgressive));
+    return output;
+}
+
+const void* get_mf_native_type() noexcept {
+    return &mf_native_type;
+}
+
+HRESULT make_video_frame(IMFSample* sample, const video_format_t& format, video_frame_t& frame) noexcept {
+    if (sample == nullptr)
+        return E_POINTER;
+    try {
+        auto locked = std::make_shared<locked_sample_t>();
+        locked->sample.copy_from(sample);
+        winrt::com_ptr<IMFMediaBuffer> buffer{};
+        // no copy for the samples with 1 buffer
+        if (auto hr = sample->ConvertToContiguousBuffer(buffer.put()); FAILED(hr))
+            return hr;
+        BYTE* base = nullptr;
+        LONG pitch = 0;
+        DWORD length = 0;
+        if (auto hr = buffer->GetCurrentLength(&length); FAILED(hr))
+            return hr;
+        if (auto buffer2d = buffer.try_as<IMF2DBuffer>(); buffer2d && is_compressed(format.pixel) == false) {
+            if (auto hr = buffer2d->Lock2D(&base, &pitch); FAILED(hr))
+                return hr;
+            locked->buffer2d = std::move(buffer2d);
+            if (pitch < 0)
+                return MF_E_UNSUPPORTED_FORMAT; // bottom-up RGB
+        } else {
+            DWORD capacity = 0;
+            if (auto hr = buffer->Lock(&base, &capacity, &length); FAILED(hr))
+                return hr;
+            locked->buffer = std::move(buffer);
+            pitch = static_cast<LONG>(get_plane_extent(format, 0).row_bytes); // default stride
+        }
+
+        video_frame_t result{};
+        result.format = format;
+        const auto stride = static_cast<uint32_t>(pitch);
+        switch (format.pixel) {
+        case pixel_format_t::nv12:
+            result.planes[0] = {base, stride};
+            result.planes[1] = {base + static_cast<size_t>(stride) * format.height, stride};
+            break;
+        case pixel_format_t::i420:
+            result.planes[0] = {base, stride};
+            result.planes[1] = {base + static_cast<size_t>(stride) * format.height, stride / 2};
+            result.planes[2] = {result.planes[1].data + static_cast<size_t>(stride / 2) * ((format.height + 1) / 2),
+                                stride / 2};
+            break;
+        case pixel_format_t::rgb32:
+        case pixel_format_t::argb32:
+            result.planes[0] = {base, stride};
+            break;
+        case pixel_format_t::h264:
+            result.planes[0] = {base, length};
+            break;
+        default:
+            return MF_E_INVALIDMEDIATYPE;
+        }
+        sample->GetSampleTime(&result.timestamp);
+        sample->GetSampleDuration(&result.duration);
+        if (MFGetAttributeUINT32(sample, MFSampleExtension_CleanPoint, FALSE))
+            result.flags |= frame_flag_keyframe;
+        if (MFGetAttributeUINT32(sample, MFSampleExtension_Discontinuity, FALSE))
+            result.flags |= frame_flag_discontinuity;
+        if (MFGetAttributeUINT32(sample, MFSampleExtension_Interlaced, FALSE))
+            result.flags |= frame_flag_interlaced;
+        if (MFGetAttributeUINT32(sample, MFSampleExtension_BottomFieldFirst, FALSE))
+            result.flags |= frame_flag_bottom_first;
+        result.native = sample;
+        result.native_type = get_mf_native_type();
+        result.storage = std::move(locked);
+        frame = std::move(result);
+        return S_OK;
+    } catch (const std::bad_alloc&) {
+        return E_OUTOFMEMORY;
+    }
+}
+
+HRESULT make_sample(const video_frame_t& frame, IMFSample** sample) noexcept {
+    if (frame.native_type == get_mf_native_type() && frame.native) {
+        auto native = static_cast<IMFSample*>(frame.native);
+        native->AddRef();
+        *sample = native;
+        return S_OK;
+    }
+    const bool compressed = is_compressed(frame.format.pixel);
+    DWORD size = 0;
+    if (compressed)
+        size = frame.planes[0].stride;
+    else
+        for (uint32_t i = 0; i < get_plane_count(frame.format.pixel); ++i) {
+            const plane_extent_t extent = get_plane_extent(frame.format, i);
+            size += extent.row_bytes * extent.rows;
+        }
+    if (size == 0)
+        return E_INVALIDARG;
+
+    winrt::com_ptr<IMFSample> output{};
+    if (auto hr = create_single_buffer_sample(output.put(), size); FAILED(hr))
+        return hr;
+    winrt::com_ptr<IMFMediaBuffer> buffer{};
+    if (auto hr = output->GetBufferByIndex(0, buffer.put()); FAILED(hr))
+        return hr;
+    BYTE* dst = nullptr;
+    if (auto hr = buffer->Lock(&dst, nullptr, nullptr); FAILED(hr))
+        return hr;
+    if (compressed) {
+        std::memcpy(dst, frame.planes[0].data, size);
+    } else {
+        // the planes are packed with the default stride
+        for (uint32_t i = 0; i < get_plane_count(frame.format.pixel); ++i) {
+            const plane_extent_t extent = get_plane_extent(frame.format, i);
+            MFCopyImage(dst, extent.row_bytes, frame.planes[i].data, frame.planes[i].stride, extent.row_bytes,
+                        extent.rows);
+            dst += extent.row_bytes * extent.rows;
+        }
+    }
+    buffer->Unlock();
+    if (auto hr = buffer->SetCurrentLength(size); FAILED(hr))
+        return hr;
+    output->SetSampleTime(frame.timestamp);
+    output->SetSampleDuration(frame.duration);
+    if (frame.flags & frame_flag_keyframe)
+        output->SetUINT32(MFSampleExtension_CleanPoint, TRUE);
+    if (frame.flags & frame_flag_discontinuity)
+        output->SetUINT32(MFSampleExtension_Discontinuity, TRUE);
+    if (frame.flags & frame_flag_interlaced)
+        output->SetUINT32(MFSampleExtension_Interlaced, TRUE);
+    if (frame.flags & frame_flag_bottom_first)
+        output->SetUINT32(MFSampleExtension_BottomFieldFirst, TRUE);
+    *sample = output.detach();
+    return S_OK;
+}
+
+HRESULT seek_reader(IMFSourceReader* reader, LONGLONG position) noexcept {
+    PROPVARIANT var{};
+    if (auto hr = InitPropVariantFromInt64(position, &var); FAILED(hr))
+        return hr;
+    const HRESULT hr = reader->SetCurrentPosition(GUID_NULL, var);
+    PropVariantClear(&var);
+    return hr;
+}
+
+HRESULT read_keyframe(IMFSourceReader* reader, DWORD stream, LONGLONG position, const video_format_t& format,
+                      video_frame_t& frame) noexcept {
+    if (auto hr = seek_reader(reader, position); FAILED(hr))
+        return hr;
+    while (true) {
+        DWORD index = 0, flags = 0;
+        LONGLONG timestamp = 0;
+        winrt::com_ptr<IMFSample> sample{};
+        if (auto hr = reader->ReadSample(stream, 0, &index, &flags, &timestamp, sample.put()); FAILED(hr))
+            return hr;
+        if (flags & MF_SOURCE_READERF_ENDOFSTREAM)
+            return S_FALSE;
+        // probably MF_SOURCE_READERF_STREAMTICK
+        if (sample == nullptr)
+            continue;
+        // the seek may stop at the keyframe before the `position`
+        if (timestamp < position || MFGetAttributeUINT32(sample.get(), MFSampleExtension_CleanPoint, FALSE) == FALSE)
+            continue;
+        sample->SetSampleTime(timestamp);
+        return make_video_frame(sample.get(), format, frame);
+    }
+}
+
+mf_video_transform_t::mf_video_transform_t(winrt::com_ptr<IMFTransform> _transform) noexcept(false)
+    : transform{std::move(_transform)} {
+    if (transform == nullptr)
+        winrt::throw_hresult(E_POINTER);
+    // some transform might not implement this. then the ids are 0
+    transform->GetStreamIDs(1, info.input_stream_ids, 1, info.output_stream_ids);
+}
+
+mf_video_transform_t::~mf_video_transform_t() noexcept {
+    if (streaming)
+        transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_STREAMING, NULL);
+}
+
+IMFTransform* mf_video_transform_t::get() const noexcept {
+    return transform.get();
+}
+
+transform_result_t mf_video_transform_t::set_input_type(IMFMediaType* media_type) noexcept {
+    if (auto hr = transform->SetInputType(info.input_stream_ids[0], media_type, 0); FAILED(hr))
+        return to_result(hr, "SetInputType");
+    input_format = to_video_format(media_type);
+    // some transforms select the output type with the input
+    winrt::com_ptr<IMFMediaType> current{};
+    if (SUCCEEDED(transform->GetOutputCurrentType(info.output_stream_ids[0], current.put())))
+        output_format = to_video_format(current.get());
+    else
+        output_format = {}; // cleared by the new input. `video_transform_driver_t` sets it again
+    return transform_result_t::ok;
+}
+
+transform_result_t mf_video_transform_t::set_output_type(IMFMediaType* media_type) noexcept {
+    if (auto hr = transform->SetOutputType(info.output_stream_ids[0], media_type, 0); FAILED(hr))
+        return to_result(hr, "SetOutputType");
+    output_format = to_video_format(media_type);
+    return transform_result_t::ok;
+}
+
+transform_result_t mf_video_transform_t::set_input_format(const video_format_t& format) noexcept {
+    try {
+        return set_input_type(make_media_type(format).get());
+    } catch (const winrt::hresult_error& ex) {
+        return to_result(ex.code(), "make_media_type");
+    }
+}
+
+transform_result_t mf_video_transform_t::set_output_format(const video_format_t& format) noexcept {
+    try {
+        return set_output_type(make_media_type(format).get());
+    } catch (const winrt::hresult_error& ex) {
+        return to_result(ex.code(), "make_media_type");
+    }
+}
+
+video_format_t mf_video_transform_t::get_input_format() const noexcept {
+    return input_format;
+}
+
+video_format_t mf_video_transform_t::get_output_format() const noexcept {
+    return output_format;
+}
+
+transform_result_t mf_video_transform_t::begin_streaming() noexcept {
+    try {
+        info.from(transform.get());
+    } catch (const winrt::hresult_error& ex) {
+        return to_result(ex.code(), "GetStreamInfo");
+    }
+    if (auto hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL); FAILED(hr))
+        return to_result(hr, "ProcessMessage");
+    if (auto hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL); FAILED(hr))
+        return to_result(hr, "ProcessMessage");
+    streaming = true;
+    return transform_result_t::ok;
+}
+
+/// @see mf_transform_driver_t::renegotiate
+transform_result_t mf_video_transform_t::renegotiate() noexcept {
+    winrt::com_ptr<IMFMediaType> selected{};
+    if (auto hr = renegotiate_output(transform.get(), info.output_stream_ids[0], to_subtype(output_format.pixel),
+                                     selected.put());
+        FAILED(hr))
+        return to_result(hr, "renegotiate_output");
+    output_format = to_video_format(selected.get());
+    try {
+        info.from(transform.get());
+    } catch (const winrt::hresult_error& ex) {
+        return to_result(ex.code(), "GetStreamInfo");
+    }
+    return transform_result_t::stream_change;
+}
+
+transform_result_t mf_video_transform_t::process_input(const video_frame_t& input) noexcept {
+    if (streaming == false)
+        if (auto result = begin_streaming(); result != transform_result_t::ok)
+            return result;
+    if (drained) {
+        // the transforms like `h264_decoder_t` can continue after the drain. `gop_decoder_t` relies on it
+        if (auto hr = transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL); FAILED(hr))
+            return to_result(hr, "ProcessMessage");
+        drained = false;
+    }
+    winrt::com_ptr<IMFSample> sample{};
+    if (auto hr = make_sample(input, sample.put()); FAILED(hr))
+        return to_result(hr, "make_sample");
+    return to_result(transform->ProcessInput(info.input_stream_ids[0], sample.get(), 0), "ProcessInput");
+}
+
+transform_result_t mf_video_transform_t::process_output(video_frame_t& output) noexcept {
+    if (streaming == false)
+        return transform_result_t::need_more_input;
+    const bool provide_sample = info.output_provide_sample();
+    winrt::com_ptr<IMFSample> sample{};
+    if (provide_sample == false)
+        if (auto hr = create_single_buffer_sample(sample.put(), info.output_info.cbSize); FAILED(hr))
+            return to_result(hr, "create_single_buffer_sample");
+    MFT_OUTPUT_DATA_BUFFER buffer{};
+    buffer.dwStreamID = info.output_stream_ids[0];
+    buffer.pSample = sample.get();
+    DWORD status = 0;
+    const HRESULT hr = transform->ProcessOutput(0, 1, &buffer, &status);
+    if (buffer.pEvents)
+        buffer.pEvents->Release();
+    if (provide_sample && buffer.pSample)
+        sample.attach(buffer.pSample);
+    switch (hr) {
+    case S_OK:
+        return to_result(make_video_frame(sample.get(), output_format, output), "make_video_frame");
+    case MF_E_TRANSFORM_STREAM_CHANGE:
+        return renegotiate();
+    default:
+        return to_result(hr, "ProcessOutput");
+    }
+}
+
+void mf_video_transform_t::drain() noexcept {
+    if (streaming == false)
+        return;
+    transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, NULL);
+    transform->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, NULL);
+    drained = true;
+}
+
+void mf_video_transform_t::flush() noexcept {
+    transform->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, NULL);
+}
+
+std::shared_ptr<mf_video_transform_t> make_h264_decoder(IMFMediaType* source_type, pixel_format_t pixel) noexcept(
+    false) {
+    h264_decoder_t decoder{};
+    if (decoder.support(source_type) == false)
+        winrt::throw_hresult(MF_E_INVALIDMEDIATYPE);
+    auto transform = std::make_shared<mf_video_transform_t>(decoder.transform);
+    if (auto result = transform->set_input_type(source_type); result != transform_result_t::ok)
+        winrt::throw_hresult(MF_E_INVALIDMEDIATYPE);
+    winrt::com_ptr<IMFMediaType> output{};
+    winrt::check_hresult(renegotiate_output(decoder.transform.get(), 0, to_subtype(pixel), output.put()));
+    if (auto result = transform->set_output_type(output.get()); result != transform_result_t::ok)
+        winrt::throw_hresult(MF_E_INVALIDMEDIATYPE);
+    return transform;
+}
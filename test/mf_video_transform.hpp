@@ -0,0 +1,98 @@
+#pragma once
+#include <mfreadwrite.h>
+
+#include "mf_transform.hpp"
+#include "video_transform.hpp"
+
+/// @return `pixel_format_t::unknown` if the subtype is not supported
+[[nodiscard]] pixel_format_t to_pixel_format(const GUID& subtype) noexcept;
+/// @return `GUID_NULL` if the pixel format is unknown
+[[nodiscard]] GUID to_subtype(pixel_format_t pixel) noexcept;
+
+/// @brief Read `MF_MT_SUBTYPE`, `MF_MT_FRAME_SIZE`, `MF_MT_FRAME_RATE`
+[[nodiscard]] video_format_t to_video_format(IMFMediaType* media_type) noexcept;
+winrt::com_ptr<IMFMediaType> make_media_type(const video_format_t& format) noexcept(false);
+/**
+ * @brief `MFVideoFormat_H264` type from the parameter sets. For the raw elementary streams without a source reader
+ * @param header SPS/PPS in Annex B or the avcC record. It becomes `MF_MT_MPEG_SEQUENCE_HEADER` in Annex B
+ * @throws winrt::hresult_error `MF_E_INVALIDMEDIATYPE` if there is no valid SPS
+ * @see h264_stream_parser_t
+ */
+winrt::com_ptr<IMFMediaType> make_h264_type(const uint8_t* header, size_t size) noexcept(false);
+
+/// @brief `video_frame_t::native_type` of the frames from the MF backend. Their `native` is `IMFSample*`
+[[nodiscard]] const void* get_mf_native_type() noexcept;
+
+/**
+ * @brief Wrap the `IMFSample` without copy. The buffer stays locked until the last copy of the frame is released
+ * @param format layout of the buffer. Usually the current output type of the transform
+ */
+[[nodiscard]] HRESULT make_video_frame(IMFSample* sample, const video_format_t& format, video_frame_t& frame) noexcept;
+
+/// @brief Reuse the `IMFSample` of the MF backend. The other frames are copied into a new sample
+[[nodiscard]] HRESULT make_sample(const video_frame_t& frame, IMFSample** sample) noexcept;
+
+/**
+ * @brief `SetCurrentPosition` of the source reader. The next `ReadSample` starts at the sync sample at or before
+ *        the `position`. The reader and its decoder are kept
+ */
+[[nodiscard]] HRESULT seek_reader(IMFSourceReader* reader, LONGLONG position) noexcept;
+
+/**
+ * @brief Seek to the `position` and read the first keyframe at or after it. The samples before it are not returned.
+ *        With `thumbnail_decoder_t::next_position`, the samples between the thumbnails are skipped by the seek
+ * @param format the current type of the `stream`. See `to_video_format`
+ * @return S_FALSE if the stream ended
+ */
+[[nodiscard]] HRESULT read_keyframe(IMFSourceReader* reader, DWORD stream, LONGLONG position,
+                                    const video_format_t& format, video_frame_t& frame) noexcept;
+
+/**
+ * @brief Media Foundation backend of `video_transform_t`.
+ *        `h264_decoder_t`, `color_converter_t`, `sample_cropper_t`, `sample_processor_t` can join `video_pipeline_t`
+ * @note The outputs hold the locked `IMFSample`. The next MF stage takes the sample without copy.
+ *       The workers of `video_pipeline_t` don't initialize COM. They run in the implicit MTA of the process
+ */
+class mf_video_transform_t final : public video_transform_t {
+    winrt::com_ptr<IMFTransform> transform;
+    mf_transform_info_t info{};
+    video_format_t input_format{};
+    video_format_t output_format{};
+    bool streaming = false;
+    bool drained = false; // the next input starts a new segment of the stream
+
+  public:
+    explicit mf_video_transform_t(winrt::com_ptr<IMFTransform> transform) noexcept(false);
+    mf_video_transform_t(const mf_video_transform_t&) = delete;
+    mf_video_transform_t(mf_video_transform_t&&) = delete;
+    mf_video_transform_t& operator=(const mf_video_transform_t&) = delete;
+    mf_video_transform_t& operator=(mf_video_transform_t&&) = delete;
+    ~mf_video_transform_t() noexcept;
+
+    transform_result_t set_input_format(const video_format_t& format) noexcept override;
+    transform_result_t set_output_format(const video_format_t& format) noexcept override;
+    video_format_t get_input_format() const noexcept override;
+    video_format_t get_output_format() const noexcept override;
+
+    transform_result_t process_input(const video_frame_t& input) noexcept override;
+    transform_result_t process_output(video_frame_t& output) noexcept override;
+    void drain() noexcept override;
+    void flush() noexcept override;
+
+    /// @brief For the types `video_format_t` can't describe. For example, the source type of `h264_decoder_t`
+    [[nodiscard]] transform_result_t set_input_type(IMFMediaType* media_type) noexcept;
+    [[nodiscard]] transform_result_t set_output_type(IMFMediaType* media_type) noexcept;
+    [[nodiscard]] IMFTransform* get() const noexcept;
+
+  private:
+    transform_result_t begin_streaming() noexcept;
+    transform_result_t renegotiate() noexcept;
+};
+
+/**
+ * @brief `h264_decoder_t` in `mf_video_transform_t`. Can be the factory of `gop_decoder_t`
+ * @param source_type the current type of the source stream. `MFVideoFormat_H264`
+ * @param pixel subtype of the output. The most preferred one of the decoder if not available
+ */
+[[nodiscard]] std::shared_ptr<mf_video_transform_t> make_h264_decoder(IMFMediaType* source_type,
+                                                                      pixel_format_t pixel) noexcept(false);
@@ -0,0 +1,200 @@
+#include "mosaic.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+bool is_yuv(pixel_format_t pixel) noexcept {
+    return pixel == pixel_format_t::nv12 || pixel == pixel_format_t::i420;
+}
+
+uint32_t get_channels(pixel_format_t pixel, uint32_t plane) noexcept {
+    if (is_yuv(pixel) == false)
+        return 4;
+    return pixel == pixel_format_t::nv12 && plane == 1 ? 2 : 1;
+}
+
+void fill_row(uint8_t* dst, uint32_t width, const uint8_t* value, uint32_t channels) noexcept {
+    if (channels == 1)
+        return static_cast<void>(std::memset(dst, value[0], width));
+    for (uint32_t x = 0; x < width; ++x, dst += channels)
+        std::memcpy(dst, value, channels);
+}
+
+} // namespace
+
+mosaic_compositor_t::mosaic_compositor_t(const mosaic_options_t& _options, size_t num_threads) noexcept(false)
+    : options{_options}, pool{num_threads} {
+    const pixel_format_t pixel = options.format.pixel;
+    if (is_yuv(pixel) == false && pixel != pixel_format_t::rgb32 && pixel != pixel_format_t::argb32)
+        throw std::invalid_argument{"mosaic_compositor_t: unsupported format"};
+    if (is_yuv(pixel) && options.border % 2)
+        throw std::invalid_argument{"mosaic_compositor_t: the border must be even for YUV"};
+    if (options.columns == 0 || options.rows == 0)
+        throw std::invalid_argument{"mosaic_compositor_t: empty grid"};
+    const uint64_t borders_x = static_cast<uint64_t>(options.columns + 1) * options.border;
+    const uint64_t borders_y = static_cast<uint64_t>(options.rows + 1) * options.border;
+    if (borders_x >= options.format.width || borders_y >= options.format.height)
+        throw std::invalid_argument{"mosaic_compositor_t: the border is too large"};
+    // the origins of the YUV cells are even, so their chroma starts at a sample
+    uint32_t width = static_cast<uint32_t>((options.format.width - borders_x) / options.columns);
+    uint32_t height = static_cast<uint32_t>((options.format.height - borders_y) / options.rows);
+    if (is_yuv(pixel)) {
+        width &= ~1u;
+        height &= ~1u;
+    }
+    if (width == 0 || height == 0)
+        throw std::invalid_argument{"mosaic_compositor_t: empty cells"};
+    cells.resize(static_cast<size_t>(options.columns) * options.rows);
+    for (uint32_t row = 0; row < options.rows; ++row)
+        for (uint32_t column = 0; column < options.columns; ++column)
+            cells[row * options.columns + column].rect = {options.border + column * (width + options.border),
+                                                          options.border + row * (height + options.border), width,
+                                                          height};
+
+    // BT.601 limited range like `convert_frame`
+    const int32_t r = options.color[0], g = options.color[1], b = options.color[2];
+    const auto y = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    const auto u = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    const auto v = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    if (is_yuv(pixel)) {
+        fill[0][0] = y;
+        fill[1][0] = u;
+        fill[1][1] = v; // the V of NV12
+        fill[2][0] = v;
+    } else {
+        fill[0][0] = options.color[2];
+        fill[0][1] = options.color[1];
+        fill[0][2] = options.color[0];
+        fill[0][3] = 0xFF;
+    }
+    canvas = allocate_frame(options.format);
+    for (uint32_t p = 0; p < get_plane_count(pixel); ++p) {
+        const plane_extent_t extent = get_plane_extent(options.format, p);
+        const uint32_t channels = get_channels(pixel, p);
+        for (uint32_t row = 0; row < extent.rows; ++row)
+            fill_row(canvas.planes[p].data + static_cast<size_t>(row) * canvas.planes[p].stride,
+                     extent.row_bytes / channels, fill[p], channels);
+    }
+}
+
+const mosaic_options_t& mosaic_compositor_t::get_options() const noexcept {
+    return options;
+}
+
+size_t mosaic_compositor_t::cell_count() const noexcept {
+    return cells.size();
+}
+
+video_rect_t mosaic_compositor_t::get_cell(size_t index) const noexcept(false) {
+    return cells.at(index).rect;
+}
+
+void mosaic_compositor_t::update(size_t index, const video_frame_t& input) noexcept(false) {
+    cell_t& cell = cells.at(index);
+    if (input.format.pixel != options.format.pixel)
+        throw std::invalid_argument{"mosaic_compositor_t: the pixel format must be the one of the output"};
+    if (input.format.width == 0 || input.format.height == 0 || static_cast<bool>(input) == false)
+        throw std::invalid_argument{"mosaic_compositor_t: empty frame"};
+    const bool pending = static_cast<bool>(cell.input);
+    if (pending == false && cell.drawn == input.planes[0].data && cell.drawn_timestamp == input.timestamp)
+        return;
+    cell.input = input;
+    cell.dirty = true;
+}
+
+void mosaic_compositor_t::clear(size_t index) noexcept(false) {
+    cell_t& cell = cells.at(index);
+    cell.input = video_frame_t{};
+    cell.drawn = nullptr;
+    cell.dirty = true;
+}
+
+video_frame_t mosaic_compositor_t::compose() noexcept(false) {
+    jobs.clear();
+    num_drawn = 0;
+    for (uint32_t i = 0; i < cells.size(); ++i) {
+        cell_t& cell = cells[i];
+        if (cell.dirty == false)
+            continue;
+        ++num_drawn;
+        if (cell.input && cell.filtered.same_layout(cell.input.format) == false) {
+            for (uint32_t p = 0; p < 2 && p < get_plane_count(options.format.pixel); ++p) {
+                const plane_extent_t from = get_plane_extent(cell.input.format, p);
+                const plane_extent_t to =
+                    get_plane_extent({options.format.pixel, cell.rect.width, cell.rect.height}, p);
+                const uint32_t channels = get_channels(options.format.pixel, p);
+                make_scale_filter(from.row_bytes / channels, to.row_bytes / channels, cell.fx[p]);
+                make_scale_filter(from.rows, to.rows, cell.fy[p]);
+            }
+            cell.filtered = cell.input.format;
+        }
+        for (uint32_t band = 0; band * band_size < cell.rect.height; ++band)
+            jobs.emplace_back(job_t{i, band});
+    }
+    if (jobs.empty())
+        return canvas;
+
+    // copy on write. the consumers of the last output keep it as it was
+    if (canvas.storage.use_count() > 1) {
+        video_frame_t next = allocate_frame(options.format);
+        for (uint32_t p = 0; p < get_plane_count(options.format.pixel); ++p) {
+            const plane_extent_t extent = get_plane_extent(options.format, p);
+            for (uint32_t row = 0; row < extent.rows; ++row)
+                std::memcpy(next.planes[p].data + static_cast<size_t>(row) * next.planes[p].stride,
+                            canvas.planes[p].data + static_cast<size_t>(row) * canvas.planes[p].stride,
+                            extent.row_bytes);
+        }
+        canvas = std::move(next);
+    }
+
+    pool.run(jobs.size(), [this](size_t i, size_t) { draw(jobs[i]); });
+
+    for (cell_t& cell : cells) {
+        if (cell.dirty == false)
+            continue;
+        if (cell.input) {
+            timestamp = std::max(timestamp, cell.input.timestamp);
+            cell.drawn = cell.input.planes[0].data;
+            cell.drawn_timestamp = cell.input.timestamp;
+        }
+        cell.input = video_frame_t{}; // back to the pool of the decoder
+        cell.dirty = false;
+    }
+    canvas.timestamp = timestamp;
+    return canvas;
+}
+
+size_t mosaic_compositor_t::drawn_count() const noexcept {
+    return num_drawn;
+}
+
+void mosaic_compositor_t::draw(const job_t& job) noexcept {
+    const cell_t& cell = cells[job.cell];
+    const pixel_format_t pixel = options.format.pixel;
+    for (uint32_t p = 0; p < get_plane_count(pixel); ++p) {
+        const uint32_t shift = p && is_yuv(pixel) ? 1 : 0;
+        const uint32_t channels = get_channels(pixel, p);
+        const plane_extent_t to = get_plane_extent({pixel, cell.rect.width, cell.rect.height}, p);
+        const uint32_t stride = canvas.planes[p].stride;
+        uint8_t* dst = canvas.planes[p].data + static_cast<size_t>(cell.rect.y >> shift) * stride +
+                       static_cast<size_t>(cell.rect.x >> shift) * channels;
+        const uint32_t top = job.band * (band_size >> shift);
+        const uint32_t bottom = std::min(top + (band_size >> shift), to.rows);
+        if (static_cast<bool>(cell.input) == false) {
+            for (uint32_t y = top; y < bottom; ++y)
+                fill_row(dst + static_cast<size_t>(y) * stride, to.row_bytes / channels, fill[p], channels);
+            continue;
+        }
+        const video_plane_t& src = cell.input.planes[p];
+        const scale_filter_t& fx = cell.fx[p ? 1 : 0];
+        const scale_filter_t& fy = cell.fy[p ? 1 : 0];
+        for (uint32_t y = top; y < bottom; ++y) {
+            const uint8_t* row0 = src.data + static_cast<size_t>(fy.indices[y]) * src.stride;
+            const uint8_t* row1 = fy.weights[y] ? row0 + src.stride : row0;
+            scale_row(row0, row1, fy.weights[y], fx, channels, dst + static_cast<size_t>(y) * stride);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "pipeline.hpp"
+#include "video_kernels.hpp"
+
+/// @brief Grid of the output. The cells have the same size and are separated by the `border`
+struct mosaic_options_t final {
+    video_format_t format{}; // of the output. NV12, I420, RGB32 or ARGB32
+    uint32_t columns = 1;
+    uint32_t rows = 1;
+    uint32_t border = 0;       // pixels between the cells and around them. Even for YUV
+    uint8_t color[3]{0, 0, 0}; // R, G, B of the border and the empty cells
+};
+
+/**
+ * @brief Tiles many streams into one frame. Each input is scaled into its cell of the output directly, like
+ *        `scale_frame` into a crop of it. Only the cells which got a new input or were cleared are drawn again.
+ *        The cells are split in bands of rows and shared by the workers, so one large cell also runs in parallel
+ *
+ * @code
+ * mosaic_options_t options{};
+ * options.format = {pixel_format_t::nv12, 1920, 1080, 30, 1};
+ * options.columns = options.rows = 4;
+ * options.border = 4;
+ * mosaic_compositor_t mosaic{options, 0};
+ * mosaic.update(2, frame); // the streams which made a frame since the last `compose`
+ * video_frame_t wall = mosaic.compose();
+ * @endcode
+ *
+ * @note The inputs must have the pixel format of the output. Use `convert_frame` before for the others
+ * @note The output is written in place. If it is still shared when `compose` is called, the next one is a copy.
+ *       So the consumers never see a partial update
+ */
+class mosaic_compositor_t final {
+    struct cell_t final {
+        video_rect_t rect{};
+        video_frame_t input{};     // waiting for `compose`. Released after it is drawn
+        video_format_t filtered{}; // the filters are made for it
+        scale_filter_t fx[2]{};    // luma, chroma
+        scale_filter_t fy[2]{};
+        const uint8_t* drawn = nullptr; // the last input drawn and its timestamp
+        int64_t drawn_timestamp = 0;
+        bool dirty = false;
+    };
+    struct job_t final {
+        uint32_t cell = 0;
+        uint32_t band = 0;
+    };
+
+    const mosaic_options_t options;
+    uint8_t fill[3][4]{}; // the `color` in each plane
+    std::vector<cell_t> cells{};
+    video_frame_t canvas{};
+    int64_t timestamp = 0; // the latest of the inputs
+    size_t num_drawn = 0;
+    std::vector<job_t> jobs{};
+    band_pool_t pool;
+
+  public:
+    /**
+     * @param num_threads 0 for `std::thread::hardware_concurrency`, 1 for no worker
+     * @throws std::invalid_argument the format is not supported or the cells are empty
+     */
+    explicit mosaic_compositor_t(const mosaic_options_t& options, size_t num_threads = 1) noexcept(false);
+    mosaic_compositor_t(const mosaic_compositor_t&) = delete;
+    mosaic_compositor_t(mosaic_compositor_t&&) = delete;
+    mosaic_compositor_t& operator=(const mosaic_compositor_t&) = delete;
+    mosaic_compositor_t& operator=(mosaic_compositor_t&&) = delete;
+
+    [[nodiscard]] const mosaic_options_t& get_options() const noexcept;
+    [[nodiscard]] size_t cell_count() const noexcept;
+    /// @brief Where the cell is in the output. Row major
+    [[nodiscard]] video_rect_t get_cell(size_t index) const noexcept(false);
+
+    /**
+     * @brief Draw the `input` in the cell with the next `compose`. The same frame as the last one is ignored
+     * @throws std::invalid_argument the pixel format is not the one of the output or the frame is empty
+     * @throws std::out_of_range
+     */
+    void update(size_t index, const video_frame_t& input) noexcept(false);
+    /// @brief Fill the cell with the `color` with the next `compose`. For the streams which ended
+    void clear(size_t index) noexcept(false);
+
+    /// @return the output. The cells without updates keep their pixels
+    [[nodiscard]] video_frame_t compose() noexcept(false);
+    /// @brief Count of the cells drawn by the last `compose`
+    [[nodiscard]] size_t drawn_count() const noexcept;
+
+  private:
+    void draw(const job_t& job) noexcept;
+};
@@ -0,0 +1,129 @@
+#include "negotiation_cache.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr auto cache_magic = "media0-negotiation";
+constexpr uint32_t cache_version = 2; // 2: the `describe_type` keys have the stride, aspect ratio, range and profile
+
+void write_entry(std::ostream& out, const negotiation_key_t& key, const negotiation_entry_t& entry) {
+    out << std::quoted(key.transform) << ' ' << std::quoted(key.input) << ' ' << std::quoted(key.output) << ' '
+        << static_cast<uint32_t>(entry.result) << ' ' << entry.error << ' ' << entry.num_input << ' '
+        << entry.num_output << ' ' << entry.input_stream_id << ' ' << entry.output_stream_id << ' '
+        << entry.input_max_latency << ' ' << entry.input_flags << ' ' << entry.input_size << ' '
+        << entry.input_lookahead << ' ' << entry.input_alignment << ' ' << entry.output_flags << ' '
+        << entry.output_size << ' ' << entry.output_alignment << '\n';
+}
+
+bool read_entry(const std::string& line, negotiation_key_t& key, negotiation_entry_t& entry) {
+    std::istringstream in{line};
+    uint32_t result = 0;
+    in >> std::quoted(key.transform) >> std::quoted(key.input) >> std::quoted(key.output) >> result >> entry.error >>
+        entry.num_input >> entry.num_output >> entry.input_stream_id >> entry.output_stream_id >>
+        entry.input_max_latency >> entry.input_flags >> entry.input_size >> entry.input_lookahead >>
+        entry.input_alignment >> entry.output_flags >> entry.output_size >> entry.output_alignment;
+    if (in.fail() || result > static_cast<uint32_t>(negotiation_result_t::output_rejected))
+        return false;
+    entry.result = static_cast<negotiation_result_t>(result);
+    return true;
+}
+
+} // namespace
+
+negotiation_cache_t::negotiation_cache_t(std::string _environment) noexcept : environment{std::move(_environment)} {
+}
+
+std::optional<negotiation_entry_t> negotiation_cache_t::find(const negotiation_key_t& key) const noexcept {
+    std::lock_guard lck{mtx};
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        ++counters.misses;
+        return std::nullopt;
+    }
+    ++counters.hits;
+    return it->second;
+}
+
+void negotiation_cache_t::record(const negotiation_key_t& key, const negotiation_entry_t& entry) noexcept(false) {
+    std::lock_guard lck{mtx};
+    entries[key] = entry;
+    modified = true;
+}
+
+void negotiation_cache_t::clear() noexcept {
+    std::lock_guard lck{mtx};
+    modified = modified || entries.empty() == false;
+    entries.clear();
+}
+
+negotiation_cache_t::stats_t negotiation_cache_t::stats() const noexcept {
+    std::lock_guard lck{mtx};
+    stats_t result = counters;
+    result.size = entries.size();
+    return result;
+}
+
+bool negotiation_cache_t::dirty() const noexcept {
+    std::lock_guard lck{mtx};
+    return modified;
+}
+
+size_t negotiation_cache_t::load(const std::filesystem::path& fpath) noexcept(false) {
+    std::ifstream fin{fpath};
+    if (fin.is_open() == false)
+        return 0;
+    std::string line{};
+    std::getline(fin, line);
+    std::istringstream header{line};
+    std::string magic{}, env{};
+    uint32_t version = 0;
+    header >> magic >> version >> std::quoted(env);
+    if (header.fail() || magic != cache_magic)
+        throw std::runtime_error{"negotiation_cache_t: not a negotiation cache"};
+    if (version != cache_version || env != environment) {
+        spdlog::info("{}: {} is for \"{}\". ignored", "negotiation_cache_t", fpath.string(), env);
+        return 0;
+    }
+
+    size_t count = 0;
+    std::lock_guard lck{mtx};
+    while (std::getline(fin, line)) {
+        if (line.empty())
+            continue;
+        negotiation_key_t key{};
+        negotiation_entry_t entry{};
+        if (read_entry(line, key, entry) == false) {
+            spdlog::warn("{}: {}", "negotiation_cache_t", "skipped a broken entry");
+            continue;
+        }
+        entries[std::move(key)] = entry;
+        ++count;
+    }
+    // the entries of the file are saved already. the `record`s before this are not
+    return count;
+}
+
+void negotiation_cache_t::save(const std::filesystem::path& fpath) noexcept(false) {
+    auto temp = fpath;
+    temp += ".tmp";
+    {
+        std::ofstream fout{temp, std::ios::trunc};
+        if (fout.is_open() == false)
+            throw std::runtime_error{"negotiation_cache_t: failed to open " + temp.string()};
+        fout << cache_magic << ' ' << cache_version << ' ' << std::quoted(environment) << '\n';
+        std::lock_guard lck{mtx};
+        for (const auto& [key, entry] : entries)
+            write_entry(fout, key, entry);
+        fout.flush();
+        if (fout.fail())
+            throw std::runtime_error{"negotiation_cache_t: failed to write " + temp.string()};
+        modified = false;
+    }
+    std::filesystem::rename(temp, fpath);
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+
+/// @brief A transform class and the descriptions of the types offered to it
+struct negotiation_key_t final {
+    std::string transform{}; // CLSID of the transform
+    std::string input{};     // see `describe_type`
+    std::string output{};
+
+  public:
+    [[nodiscard]] bool operator<(const negotiation_key_t& rhs) const noexcept {
+        return std::tie(transform, input, output) < std::tie(rhs.transform, rhs.input, rhs.output);
+    }
+};
+
+enum class negotiation_result_t : uint32_t {
+    accepted = 0,
+    input_rejected = 1,  // `SetInputType` failed
+    output_rejected = 2, // `SetInputType` succeeded, `SetOutputType` failed
+};
+
+/**
+ * @brief Result of the negotiation and the stream info after it
+ * @see mf_transform_info_t
+ */
+struct negotiation_entry_t final {
+    negotiation_result_t result = negotiation_result_t::accepted;
+    int32_t error = 0; // HRESULT of the rejection
+    uint32_t num_input = 0;
+    uint32_t num_output = 0;
+    uint32_t input_stream_id = 0;
+    uint32_t output_stream_id = 0;
+    int64_t input_max_latency = 0;
+    uint32_t input_flags = 0;
+    uint32_t input_size = 0;
+    uint32_t input_lookahead = 0;
+    uint32_t input_alignment = 0;
+    uint32_t output_flags = 0;
+    uint32_t output_size = 0;
+    uint32_t output_alignment = 0;
+};
+
+/**
+ * @brief Remembers which types a transform class accepts, so the trial and error of `SetInputType`/`SetOutputType`
+ *        happens once. Can be saved to a file and loaded by the next process.
+ *
+ * @note The file starts with the `environment` of the cache. The entries of the other environment are not loaded.
+ *       Use the OS build and the driver version so an update invalidates the file
+ */
+class negotiation_cache_t final {
+  public:
+    struct stats_t final {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t size = 0;
+    };
+
+  private:
+    const std::string environment;
+    mutable std::mutex mtx{};
+    std::map<negotiation_key_t, negotiation_entry_t> entries{};
+    mutable stats_t counters{};
+    bool modified = false;
+
+  public:
+    explicit negotiation_cache_t(std::string environment = {}) noexcept;
+    negotiation_cache_t(const negotiation_cache_t&) = delete;
+    negotiation_cache_t(negotiation_cache_t&&) = delete;
+    negotiation_cache_t& operator=(const negotiation_cache_t&) = delete;
+    negotiation_cache_t& operator=(negotiation_cache_t&&) = delete;
+    ~negotiation_cache_t() noexcept = default;
+
+    [[nodiscard]] std::optional<negotiation_entry_t> find(const negotiation_key_t& key) const noexcept;
+    /// @brief Add or replace the entry
+    void record(const negotiation_key_t& key, const negotiation_entry_t& entry) noexcept(false);
+    void clear() noexcept;
+
+    [[nodiscard]] stats_t stats() const noexcept;
+    /// @return true if `record` or `clear` changed the entries after the last `save`. `load` doesn't change it
+    [[nodiscard]] bool dirty() const noexcept;
+
+    /**
+     * @brief Merge the entries of the file. The missing file is not an error
+     * @return count of the loaded entries. 0 if the environment is different
+     * @throws std::runtime_error the file is not a negotiation cache
+     */
+    size_t load(const std::filesystem::path& fpath) noexcept(false);
+    /// @brief Write to a temporary file and rename it, so a crash doesn't leave a broken file
+    void save(const std::filesystem::path& fpath) noexcept(false);
+};
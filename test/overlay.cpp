@@ -0,0 +1,286 @@
+#include "overlay.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "simd.hpp"
+
+namespace {
+
+uint8_t div255(uint32_t value) noexcept {
+    value += 128;
+    return static_cast<uint8_t>((value + (value >> 8)) >> 8);
+}
+
+/// @brief The smallest rectangle with both. `{}` is empty
+video_rect_t unite(const video_rect_t& lhs, const video_rect_t& rhs) noexcept {
+    if (lhs.width == 0 || lhs.height == 0)
+        return rhs;
+    if (rhs.width == 0 || rhs.height == 0)
+        return lhs;
+    const uint32_t x = std::min(lhs.x, rhs.x);
+    const uint32_t y = std::min(lhs.y, rhs.y);
+    return {x, y, std::max(lhs.x + lhs.width, rhs.x + rhs.width) - x,
+            std::max(lhs.y + lhs.height, rhs.y + rhs.height) - y};
+}
+
+void copy_pixels(const video_frame_t& image, const video_rect_t& region, std::vector<uint8_t>& pixels) noexcept {
+    const size_t row_bytes = static_cast<size_t>(image.format.width) * 4;
+    for (uint32_t y = region.y; y < region.y + region.height; ++y)
+        std::memcpy(pixels.data() + y * row_bytes + region.x * 4,
+                    image.planes[0].data + static_cast<size_t>(y) * image.planes[0].stride + region.x * 4,
+                    static_cast<size_t>(region.width) * 4);
+}
+
+} // namespace
+
+void blend_row(const uint8_t* src, const uint8_t* alpha, uint32_t count, uint8_t* dst) noexcept {
+    uint32_t i = 0;
+#if defined(MEDIA0_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(128);
+    for (; i + 16 <= count; i += 16) {
+        const __m128i inverse = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + i)),
+                                              _mm_set1_epi8(-1)); // 255 - alpha
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i low = _mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), _mm_unpacklo_epi8(inverse, zero)), half);
+        __m128i high = _mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), _mm_unpackhi_epi8(inverse, zero)), half);
+        low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+        high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+        const __m128i color = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_adds_epu8(color, _mm_packus_epi16(low, high)));
+    }
+#elif defined(MEDIA0_NEON)
+    const uint16x8_t half = vdupq_n_u16(128);
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t inverse = vmvnq_u8(vld1q_u8(alpha + i));
+        const uint8x16_t pixels = vld1q_u8(dst + i);
+        uint16x8_t low = vaddq_u16(vmull_u8(vget_low_u8(pixels), vget_low_u8(inverse)), half);
+        uint16x8_t high = vaddq_u16(vmull_u8(vget_high_u8(pixels), vget_high_u8(inverse)), half);
+        low = vaddq_u16(low, vshrq_n_u16(low, 8));
+        high = vaddq_u16(high, vshrq_n_u16(high, 8));
+        const uint8x16_t scaled = vcombine_u8(vshrn_n_u16(low, 8), vshrn_n_u16(high, 8));
+        vst1q_u8(dst + i, vqaddq_u8(vld1q_u8(src + i), scaled));
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = static_cast<uint8_t>(std::min<uint32_t>(src[i] + div255(dst[i] * (255u - alpha[i])), 255));
+}
+
+uint32_t cpu_overlay_t::add_layer(const video_frame_t& image, uint32_t x, uint32_t y) noexcept(false) {
+    if (image.format.pixel != pixel_format_t::argb32 || is_uncompressed(image.format) == false ||
+        static_cast<bool>(image) == false)
+        throw std::invalid_argument{"cpu_overlay_t: the layer must be ARGB32"};
+    layer_t layer{};
+    layer.x = x;
+    layer.y = y;
+    layer.width = image.format.width;
+    layer.height = image.format.height;
+    layer.pixels.resize(static_cast<size_t>(layer.width) * layer.height * 4);
+    copy_pixels(image, {0, 0, layer.width, layer.height}, layer.pixels);
+    std::lock_guard lck{mtx};
+    layer.id = next_id++;
+    layers.emplace_back(std::move(layer));
+    return layers.back().id;
+}
+
+void cpu_overlay_t::update_layer(uint32_t id, const video_frame_t& image, video_rect_t dirty) noexcept(false) {
+    std::lock_guard lck{mtx};
+    layer_t& layer = find(id);
+    if (image.format.pixel != pixel_format_t::argb32 || image.format.width != layer.width ||
+        image.format.height != layer.height || static_cast<bool>(image) == false)
+        throw std::invalid_argument{"cpu_overlay_t: the image must be ARGB32 of the size of the layer"};
+    dirty = clip_region(image.format, dirty);
+    if (dirty.width == 0)
+        return;
+    copy_pixels(image, dirty, layer.pixels);
+    layer.dirty = unite(layer.dirty, dirty);
+}
+
+void cpu_overlay_t::update_layer(uint32_t id, const video_frame_t& image) noexcept(false) {
+    update_layer(id, image, {0, 0, image.format.width, image.format.height});
+}
+
+void cpu_overlay_t::move_layer(uint32_t id, uint32_t x, uint32_t y) noexcept(false) {
+    std::lock_guard lck{mtx};
+    layer_t& layer = find(id);
+    layer.x = x;
+    layer.y = y;
+}
+
+void cpu_overlay_t::remove_layer(uint32_t id) noexcept(false) {
+    std::lock_guard lck{mtx};
+    const layer_t& layer = find(id);
+    layers.erase(layers.begin() + (&layer - layers.data()));
+}
+
+size_t cpu_overlay_t::layer_count() noexcept {
+    std::lock_guard lck{mtx};
+    return layers.size();
+}
+
+void cpu_overlay_t::set_in_place(bool enable) noexcept {
+    std::lock_guard lck{mtx};
+    in_place = enable;
+}
+
+cpu_overlay_t::layer_t& cpu_overlay_t::find(uint32_t id) noexcept(false) {
+    for (layer_t& layer : layers)
+        if (layer.id == id)
+            return layer;
+    throw std::out_of_range{"cpu_overlay_t: unknown layer"};
+}
+
+video_format_t cpu_overlay_t::derive(const video_format_t& input) const noexcept {
+    return input;
+}
+
+bool cpu_overlay_t::verify(const video_format_t& input, const video_format_t& output) const noexcept {
+    const pixel_format_t pixel = input.pixel;
+    if (pixel != pixel_format_t::nv12 && pixel != pixel_format_t::rgb32 && pixel != pixel_format_t::argb32)
+        return false;
+    return input.same_layout(output);
+}
+
+video_frame_t cpu_overlay_t::run(const video_frame_t& input) noexcept(false) {
+    std::lock_guard lck{mtx};
+    if (layers.empty())
+        return input;
+    video_frame_t output = input;
+    if (in_place == false) {
+        output = acquire();
+        for (uint32_t p = 0; p < get_plane_count(input.format.pixel); ++p) {
+            const plane_extent_t extent = get_plane_extent(input.format, p);
+            for (uint32_t row = 0; row < extent.rows; ++row)
+                std::memcpy(output.planes[p].data + static_cast<size_t>(row) * output.planes[p].stride,
+                            input.planes[p].data + static_cast<size_t>(row) * input.planes[p].stride,
+                            extent.row_bytes);
+        }
+    }
+    for (layer_t& layer : layers) {
+        prepare(layer, input.format.pixel);
+        blend(layer, output);
+    }
+    return output;
+}
+
+/// @brief Convert the dirty region of the layer to the planes of `pixel` and find the spans of its rows again
+void cpu_overlay_t::prepare(layer_t& layer, pixel_format_t pixel) noexcept(false) {
+    const bool yuv = pixel == pixel_format_t::nv12;
+    if (pixel == pixel_format_t::argb32)
+        pixel = pixel_format_t::rgb32; // the alpha of the frame is blended like the colors
+    if (layer.cached != pixel) {
+        const video_format_t format{pixel, layer.width, layer.height};
+        for (uint32_t p = 0; p < 2; ++p) {
+            const plane_extent_t extent = get_plane_extent(format, p);
+            plane_cache_t& plane = layer.planes[p];
+            plane.row_bytes = extent.row_bytes;
+            plane.rows = extent.rows;
+            plane.color.assign(static_cast<size_t>(extent.row_bytes) * extent.rows, 0);
+            plane.alpha.assign(plane.color.size(), 0);
+            plane.spans.assign(static_cast<size_t>(extent.rows) * 2, 0);
+        }
+        layer.cached = pixel;
+        layer.dirty = {0, 0, layer.width, layer.height};
+    }
+    video_rect_t dirty = layer.dirty;
+    if (dirty.width == 0 || dirty.height == 0)
+        return;
+    layer.dirty = {};
+    if (yuv) {
+        // the whole 2x2 blocks of the chroma
+        const uint32_t right = std::min((dirty.x + dirty.width + 1) & ~1u, layer.width);
+        const uint32_t bottom = std::min((dirty.y + dirty.height + 1) & ~1u, layer.height);
+        dirty.x &= ~1u;
+        dirty.y &= ~1u;
+        dirty.width = right - dirty.x;
+        dirty.height = bottom - dirty.y;
+    }
+
+    const uint8_t* pixels = layer.pixels.data();
+    const size_t stride = static_cast<size_t>(layer.width) * 4;
+    plane_cache_t& luma = layer.planes[0];
+    for (uint32_t y = dirty.y; y < dirty.y + dirty.height; ++y) {
+        const uint8_t* in = pixels + y * stride;
+        uint8_t* color = luma.color.data() + static_cast<size_t>(y) * luma.row_bytes;
+        uint8_t* alpha = luma.alpha.data() + static_cast<size_t>(y) * luma.row_bytes;
+        for (uint32_t x = dirty.x; x < dirty.x + dirty.width; ++x) {
+            const uint8_t* bgra = in + x * 4;
+            if (yuv) {
+                // the premultiplied color keeps the offset of the black in the alpha
+                color[x] = static_cast<uint8_t>(((66 * bgra[2] + 129 * bgra[1] + 25 * bgra[0] + 128) >> 8) +
+                                                (16 * bgra[3] + 127) / 255);
+                alpha[x] = bgra[3];
+            } else {
+                std::memcpy(color + x * 4, bgra, 4);
+                std::memset(alpha + x * 4, bgra[3], 4);
+            }
+        }
+    }
+    if (yuv) {
+        plane_cache_t& chroma = layer.planes[1];
+        for (uint32_t y = dirty.y / 2; y < (dirty.y + dirty.height + 1) / 2; ++y) {
+            const uint8_t* row0 = pixels + static_cast<size_t>(2 * y) * stride;
+            const uint8_t* row1 = pixels + static_cast<size_t>(std::min(2 * y + 1, layer.height - 1)) * stride;
+            uint8_t* color = chroma.color.data() + static_cast<size_t>(y) * chroma.row_bytes;
+            uint8_t* alpha = chroma.alpha.data() + static_cast<size_t>(y) * chroma.row_bytes;
+            for (uint32_t x = dirty.x / 2; x < (dirty.x + dirty.width + 1) / 2; ++x) {
+                const uint32_t x0 = 2 * x * 4;
+                const uint32_t x1 = std::min(2 * x + 1, layer.width - 1) * 4;
+                int32_t bgra[4]{};
+                for (uint32_t c = 0; c < 4; ++c)
+                    bgra[c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4;
+                const int32_t offset = (128 * bgra[3] + 127) / 255;
+                const int32_t u = ((-38 * bgra[2] - 74 * bgra[1] + 112 * bgra[0] + 128) >> 8) + offset;
+                const int32_t v = ((112 * bgra[2] - 94 * bgra[1] - 18 * bgra[0] + 128) >> 8) + offset;
+                color[2 * x] = static_cast<uint8_t>(std::clamp(u, 0, 255));
+                color[2 * x + 1] = static_cast<uint8_t>(std::clamp(v, 0, 255));
+                alpha[2 * x] = alpha[2 * x + 1] = static_cast<uint8_t>(bgra[3]);
+            }
+        }
+    }
+
+    for (uint32_t p = 0; p < (yuv ? 2u : 1u); ++p) {
+        plane_cache_t& plane = layer.planes[p];
+        const uint32_t top = p ? dirty.y / 2 : dirty.y;
+        const uint32_t bottom = p ? (dirty.y + dirty.height + 1) / 2 : dirty.y + dirty.height;
+        for (uint32_t y = top; y < bottom; ++y) {
+            const uint8_t* alpha = plane.alpha.data() + static_cast<size_t>(y) * plane.row_bytes;
+            uint32_t begin = 0;
+            uint32_t end = plane.row_bytes;
+            while (begin < end && alpha[begin] == 0)
+                ++begin;
+            while (end > begin && alpha[end - 1] == 0)
+                --end;
+            plane.spans[2 * y] = begin;
+            plane.spans[2 * y + 1] = end;
+        }
+    }
+}
+
+void cpu_overlay_t::blend(const layer_t& layer, video_frame_t& frame) noexcept {
+    const bool yuv = frame.format.pixel == pixel_format_t::nv12;
+    const uint32_t x = yuv ? layer.x & ~1u : layer.x;
+    const uint32_t y = yuv ? layer.y & ~1u : layer.y;
+    for (uint32_t p = 0; p < (yuv ? 2u : 1u); ++p) {
+        const plane_cache_t& plane = layer.planes[p];
+        const plane_extent_t extent = get_plane_extent(frame.format, p);
+        // NV12 has the same bytes per row in both planes
+        const uint32_t left = yuv ? x : x * 4;
+        const uint32_t top = p ? y / 2 : y;
+        if (left >= extent.row_bytes)
+            return;
+        for (uint32_t row = 0; row < plane.rows && top + row < extent.rows; ++row) {
+            const uint32_t begin = plane.spans[2 * row];
+            const uint32_t end = std::min(plane.spans[2 * row + 1], extent.row_bytes - left);
+            if (begin >= end)
+                continue;
+            const size_t offset = static_cast<size_t>(row) * plane.row_bytes + begin;
+            blend_row(plane.color.data() + offset, plane.alpha.data() + offset, end - begin,
+                      frame.planes[p].data + static_cast<size_t>(top + row) * frame.planes[p].stride + left + begin);
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <mutex>
+#include <vector>
+
+#include "video_transform.hpp"
+
+/**
+ * @brief `dst = src + dst * (255 - alpha) / 255` for each byte, rounded to nearest. The premultiplied "over"
+ * @param count in bytes. `src`, `alpha` and `dst` have the same length
+ */
+void blend_row(const uint8_t* src, const uint8_t* alpha, uint32_t count, uint8_t* dst) noexcept;
+
+/**
+ * @brief Burns premultiplied ARGB32 layers (timestamps, boxes, logos) into RGB32, ARGB32 or NV12 frames.
+ *        Each layer is converted to the pixel format of the frames once and cached with the spans of its rows
+ *        which are not transparent. Only those spans of the frame are blended, so the cost follows the area of the
+ *        overlays, not the one of the frame. `update_layer` converts only its dirty rectangle again
+ *
+ * @code
+ * auto overlay = std::make_shared<cpu_overlay_t>();
+ * const uint32_t logo = overlay->add_layer(logo_image, 16, 16);
+ * const uint32_t clock = overlay->add_layer(clock_image, 16, 1000);
+ * pipeline.add(overlay, "cpu_overlay_t");
+ * // on the timer
+ * draw_seconds(clock_image);
+ * overlay->update_layer(clock, clock_image, seconds_rect);
+ * @endcode
+ *
+ * @note The layers may be changed while the frames are processed. YUV uses BT.601 limited range like
+ *       `convert_frame`. For NV12 the positions are rounded down to even and the chroma takes the average of 2x2
+ */
+class cpu_overlay_t final : public cpu_transform_t {
+    /// @brief A plane of the converted layer. `color` and `alpha` have a byte for each byte of the plane
+    struct plane_cache_t final {
+        uint32_t row_bytes = 0;
+        uint32_t rows = 0;
+        std::vector<uint8_t> color{};
+        std::vector<uint8_t> alpha{};
+        std::vector<uint32_t> spans{}; // begin, end of the bytes which are not transparent in each row
+    };
+    struct layer_t final {
+        uint32_t id = 0;
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> pixels{}; // the premultiplied B, G, R, A
+        pixel_format_t cached = pixel_format_t::unknown;
+        video_rect_t dirty{}; // of the cache
+        plane_cache_t planes[2]{};
+    };
+
+    std::mutex mtx{};
+    std::vector<layer_t> layers{}; // in the order of drawing
+    uint32_t next_id = 1;
+    bool in_place = false;
+
+  public:
+    /**
+     * @param image premultiplied ARGB32. The pixels are copied
+     * @return the id of the layer. It is drawn over the ones added before
+     * @throws std::invalid_argument the image is not ARGB32
+     */
+    [[nodiscard]] uint32_t add_layer(const video_frame_t& image, uint32_t x, uint32_t y) noexcept(false);
+    /**
+     * @brief Copy the `dirty` region of the `image`. The rest of the layer keeps its pixels
+     * @param image the size of the layer
+     * @throws std::invalid_argument the image is not the one of the layer
+     * @throws std::out_of_range the `id` is unknown
+     */
+    void update_layer(uint32_t id, const video_frame_t& image, video_rect_t dirty) noexcept(false);
+    /// @brief `update_layer` for the whole image
+    void update_layer(uint32_t id, const video_frame_t& image) noexcept(false);
+    void move_layer(uint32_t id, uint32_t x, uint32_t y) noexcept(false);
+    void remove_layer(uint32_t id) noexcept(false);
+    [[nodiscard]] size_t layer_count() noexcept;
+
+    /**
+     * @brief Blend into the inputs instead of a copy of them. Then nothing but the overlays is touched
+     * @note Only when no one else reads the inputs. Not for the outputs of a decoder, they are its references
+     */
+    void set_in_place(bool enable) noexcept;
+
+  protected:
+    video_format_t derive(const video_format_t& input) const noexcept override;
+    bool verify(const video_format_t& input, const video_format_t& output) const noexcept override;
+    video_frame_t run(const video_frame_t& input) noexcept(false) override;
+
+  private:
+    layer_t& find(uint32_t id) noexcept(false);
+    static void prepare(layer_t& layer, pixel_format_t pixel) noexcept(false);
+    static void blend(const layer_t& layer, video_frame_t& frame) noexcept;
+};
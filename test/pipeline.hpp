@@ -0,0 +1,194 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Blocking FIFO between the pipeline stages. `push` waits while the queue is full (back-pressure)
+ * @note The storage is allocated once in the constructor
+ */
+template <typename T>
+class bounded_queue_t final {
+    std::mutex mtx{};
+    std::condition_variable readable{};
+    std::condition_variable writable{};
+    std::vector<T> items;
+    size_t head = 0;
+    size_t count = 0;
+    bool closed = false;
+
+  public:
+    explicit bounded_queue_t(size_t capacity) noexcept(false) : items(capacity ? capacity : 1) {
+    }
+    bounded_queue_t(const bounded_queue_t&) = delete;
+    bounded_queue_t(bounded_queue_t&&) = delete;
+    bounded_queue_t& operator=(const bounded_queue_t&) = delete;
+    bounded_queue_t& operator=(bounded_queue_t&&) = delete;
+    ~bounded_queue_t() noexcept = default;
+
+    /// @return false if the queue is closed
+    bool push(T item) noexcept(false) {
+        std::unique_lock lck{mtx};
+        writable.wait(lck, [this]() { return closed || count < items.size(); });
+        if (closed)
+            return false;
+        items[(head + count) % items.size()] = std::move(item);
+        ++count;
+        lck.unlock();
+        readable.notify_one();
+        return true;
+    }
+
+    /// @return false if the queue is closed and empty
+    bool pop(T& item) noexcept(false) {
+        std::unique_lock lck{mtx};
+        readable.wait(lck, [this]() { return closed || count > 0; });
+        if (count == 0)
+            return false;
+        item = std::move(items[head]);
+        items[head] = T{};
+        head = (head + 1) % items.size();
+        --count;
+        lck.unlock();
+        writable.notify_one();
+        return true;
+    }
+
+    /// @brief Reject the next `push`. `pop` returns the remaining items
+    void close() noexcept {
+        {
+            std::lock_guard lck{mtx};
+            closed = true;
+        }
+        readable.notify_all();
+        writable.notify_all();
+    }
+
+    /// @brief `close` and discard the remaining items
+    void abort() noexcept(false) {
+        {
+            std::lock_guard lck{mtx};
+            closed = true;
+            for (; count; --count, head = (head + 1) % items.size())
+                items[head] = T{};
+        }
+        readable.notify_all();
+        writable.notify_all();
+    }
+
+    /// @brief Discard the remaining items. The queue stays open
+    void clear() noexcept(false) {
+        {
+            std::lock_guard lck{mtx};
+            for (; count; --count, head = (head + 1) % items.size())
+                items[head] = T{};
+        }
+        writable.notify_all();
+    }
+
+    [[nodiscard]] size_t size() noexcept {
+        std::lock_guard lck{mtx};
+        return count;
+    }
+    [[nodiscard]] size_t capacity() const noexcept {
+        return items.size();
+    }
+};
+
+/// @brief Rows of the first plane in a band of `band_pool_t`. The chroma planes take half of them
+constexpr uint32_t band_size = 32;
+
+/**
+ * @brief Workers which share the items of a job with the caller. The items are taken in order by the first free
+ *        thread, so a slow item doesn't hold the others. `run` returns when all items are done
+ * @note `run` must not be called concurrently. The work must not throw
+ */
+class band_pool_t final {
+  public:
+    /// @param item index in `[0, count)`. @param thread 0 for the caller, `[1, size())` for the workers
+    using work_t = std::function<void(size_t item, size_t thread)>;
+
+  private:
+    std::vector<std::thread> workers{};
+    std::mutex mtx{};
+    std::condition_variable wake{};
+    std::condition_variable done{};
+    uint64_t generation = 0;
+    size_t busy = 0;
+    bool stopping = false;
+    // the job in progress. Set before the workers are woken
+    const work_t* work = nullptr;
+    size_t count = 0;
+    std::atomic<size_t> next{0};
+
+  public:
+    /// @param num_threads 0 for `std::thread::hardware_concurrency`, 1 for no worker. The caller is one of them
+    explicit band_pool_t(size_t num_threads) noexcept(false) {
+        const size_t total = num_threads ? num_threads : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        for (size_t i = 1; i < total; ++i)
+            workers.emplace_back(&band_pool_t::run_worker, this, i);
+    }
+    band_pool_t(const band_pool_t&) = delete;
+    band_pool_t(band_pool_t&&) = delete;
+    band_pool_t& operator=(const band_pool_t&) = delete;
+    band_pool_t& operator=(band_pool_t&&) = delete;
+    ~band_pool_t() noexcept {
+        {
+            std::lock_guard lck{mtx};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    /// @return the threads which run the items, with the caller
+    [[nodiscard]] size_t size() const noexcept {
+        return workers.size() + 1;
+    }
+
+    /// @brief `fn(item, thread)` for each item in `[0, items)`
+    void run(size_t items, const work_t& fn) noexcept {
+        work = &fn;
+        count = items;
+        next.store(0);
+        if (workers.empty() || items < 2)
+            return run_items(0);
+        {
+            std::lock_guard lck{mtx};
+            ++generation;
+            busy = workers.size();
+        }
+        wake.notify_all();
+        run_items(0);
+        std::unique_lock lck{mtx};
+        done.wait(lck, [this]() { return busy == 0; });
+    }
+
+  private:
+    void run_worker(size_t thread) noexcept {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock lck{mtx};
+                wake.wait(lck, [this, seen]() { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            run_items(thread);
+            std::lock_guard lck{mtx};
+            if (--busy == 0)
+                done.notify_one();
+        }
+    }
+    void run_items(size_t thread) noexcept {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+            (*work)(i, thread);
+    }
+};
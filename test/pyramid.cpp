@@ -0,0 +1,158 @@
+#include "pyramid.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "simd.hpp"
+
+namespace {
+
+uint32_t get_channels(pixel_format_t pixel, uint32_t plane) noexcept {
+    if (pixel == pixel_format_t::rgb32 || pixel == pixel_format_t::argb32)
+        return 4;
+    return pixel == pixel_format_t::nv12 && plane == 1 ? 2 : 1;
+}
+
+uint8_t average(uint32_t lhs, uint32_t rhs) noexcept {
+    return static_cast<uint8_t>((lhs + rhs + 1) >> 1);
+}
+
+#if defined(MEDIA0_SSE2)
+/// @brief Average of the neighbor pixels in 32 bytes. 16 bytes of the half width
+__m128i halve_pixels(__m128i lhs, __m128i rhs, uint32_t channels) noexcept {
+    switch (channels) {
+    case 1: {
+        const __m128i mask = _mm_set1_epi16(0x00FF);
+        const __m128i low = _mm_avg_epu8(_mm_and_si128(lhs, mask), _mm_srli_epi16(lhs, 8));
+        const __m128i high = _mm_avg_epu8(_mm_and_si128(rhs, mask), _mm_srli_epi16(rhs, 8));
+        return _mm_packus_epi16(low, high);
+    }
+    case 2: {
+        const __m128i mask = _mm_set1_epi32(0xFFFF);
+        __m128i low = _mm_avg_epu8(_mm_and_si128(lhs, mask), _mm_srli_epi32(lhs, 16));
+        __m128i high = _mm_avg_epu8(_mm_and_si128(rhs, mask), _mm_srli_epi32(rhs, 16));
+        // no `packus_epi32` in SSE2. sign extend, so the signed saturation keeps the bits
+        low = _mm_srai_epi32(_mm_slli_epi32(low, 16), 16);
+        high = _mm_srai_epi32(_mm_slli_epi32(high, 16), 16);
+        return _mm_packs_epi32(low, high);
+    }
+    default: {
+        const __m128i mask = _mm_set_epi32(0, -1, 0, -1);
+        const __m128i low = _mm_avg_epu8(_mm_and_si128(lhs, mask), _mm_srli_epi64(lhs, 32));
+        const __m128i high = _mm_avg_epu8(_mm_and_si128(rhs, mask), _mm_srli_epi64(rhs, 32));
+        return _mm_unpacklo_epi64(_mm_shuffle_epi32(low, _MM_SHUFFLE(3, 1, 2, 0)),
+                                  _mm_shuffle_epi32(high, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    }
+}
+#endif
+
+} // namespace
+
+void halve_row(const uint8_t* src0, const uint8_t* src1, uint32_t src_width, uint32_t channels,
+               uint8_t* dst) noexcept {
+    const uint32_t dst_width = (src_width + 1) / 2;
+    uint32_t x = 0; // in the bytes of `dst`
+#if defined(MEDIA0_SSE2)
+    // the pairs in the row. the last pixel of the odd widths is in the scalar path
+    const uint32_t paired = src_width / 2 * channels;
+    for (; x + 16 <= paired; x += 16) {
+        const auto* top = reinterpret_cast<const __m128i*>(src0 + 2 * x);
+        const auto* bottom = reinterpret_cast<const __m128i*>(src1 + 2 * x);
+        const __m128i lhs = _mm_avg_epu8(_mm_loadu_si128(top), _mm_loadu_si128(bottom));
+        const __m128i rhs = _mm_avg_epu8(_mm_loadu_si128(top + 1), _mm_loadu_si128(bottom + 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), halve_pixels(lhs, rhs, channels));
+    }
+#endif
+    for (uint32_t i = x / channels; i < dst_width; ++i) {
+        const uint32_t x0 = 2 * i * channels;
+        const uint32_t x1 = std::min(2 * i + 1, src_width - 1) * channels;
+        for (uint32_t c = 0; c < channels; ++c)
+            dst[i * channels + c] =
+                average(average(src0[x0 + c], src1[x0 + c]), average(src0[x1 + c], src1[x1 + c]));
+    }
+}
+
+video_format_t get_octave_format(const video_format_t& format, uint32_t level) noexcept {
+    video_format_t result = format;
+    for (uint32_t i = 0; i < level; ++i) {
+        result.width = (result.width + 1) / 2;
+        result.height = (result.height + 1) / 2;
+    }
+    return result;
+}
+
+pyramid_generator_t::pyramid_generator_t(uint32_t levels, size_t _max_idle) noexcept(false)
+    : num_levels{levels}, max_idle{_max_idle} {
+    if (levels == 0 || levels > 8)
+        throw std::invalid_argument{"pyramid_generator_t: levels must be 1 to 8"};
+    pools.resize(levels); // made with the first format
+}
+
+uint32_t pyramid_generator_t::levels() const noexcept {
+    return num_levels;
+}
+
+frame_pool_t::stats_t pyramid_generator_t::stats(uint32_t level) const noexcept(false) {
+    if (level == 0)
+        throw std::out_of_range{"pyramid_generator_t: level starts from 1"};
+    const auto& pool = pools.at(level - 1);
+    return pool ? pool->stats() : frame_pool_t::stats_t{};
+}
+
+void pyramid_generator_t::generate(const video_frame_t& input, std::vector<video_frame_t>& outputs) noexcept(false) {
+    const pixel_format_t pixel = input.format.pixel;
+    if (pixel != pixel_format_t::nv12 && pixel != pixel_format_t::i420 && pixel != pixel_format_t::rgb32 &&
+        pixel != pixel_format_t::argb32)
+        throw std::invalid_argument{"pyramid_generator_t: unsupported format"};
+    if (input.format.width == 0 || input.format.height == 0 || static_cast<bool>(input) == false)
+        throw std::invalid_argument{"pyramid_generator_t: empty frame"};
+    if (format.same_layout(input.format) == false) {
+        for (uint32_t i = 0; i < num_levels; ++i) {
+            const video_format_t octave = get_octave_format(input.format, i + 1);
+            if (pools[i])
+                pools[i]->reset(octave);
+            else
+                pools[i] = std::make_unique<frame_pool_t>(octave, max_idle);
+        }
+        format = input.format;
+    }
+    outputs.clear();
+    for (uint32_t i = 0; i < num_levels; ++i) {
+        video_frame_t& output = outputs.emplace_back(pools[i]->acquire());
+        output.format = get_octave_format(input.format, i + 1);
+        output.timestamp = input.timestamp;
+        output.duration = input.duration;
+        output.flags = input.flags;
+    }
+
+    for (uint32_t p = 0; p < get_plane_count(pixel); ++p) {
+        const uint32_t channels = get_channels(pixel, p);
+        // the previous level of `outputs[i]`
+        auto source = [&input, &outputs, p](uint32_t level) -> const video_plane_t& {
+            return level ? outputs[level - 1].planes[p] : input.planes[p];
+        };
+        auto make_row = [&](uint32_t level, uint32_t row) {
+            const video_plane_t& from = source(level);
+            const plane_extent_t extent = get_plane_extent(level ? outputs[level - 1].format : input.format, p);
+            const uint8_t* src0 = from.data + static_cast<size_t>(2 * row) * from.stride;
+            const uint8_t* src1 = 2 * row + 1 < extent.rows ? src0 + from.stride : src0;
+            video_plane_t& to = outputs[level].planes[p];
+            halve_row(src0, src1, extent.row_bytes / channels, channels,
+                      to.data + static_cast<size_t>(row) * to.stride);
+        };
+        const uint32_t rows = get_plane_extent(outputs[0].format, p).rows;
+        for (uint32_t row = 0; row < rows; ++row) {
+            make_row(0, row);
+            // the next levels while the rows are in the cache
+            uint32_t made = row;
+            for (uint32_t level = 1; level < num_levels; ++level) {
+                const uint32_t count = get_plane_extent(outputs[level - 1].format, p).rows;
+                if (made % 2 == 0 && made + 1 != count)
+                    break;
+                made /= 2;
+                make_row(level, made);
+            }
+        }
+    }
+}
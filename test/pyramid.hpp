@@ -0,0 +1,62 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "video_frame.hpp"
+
+/// @brief The size of the octave `level`. 1 for 1/2. The odd sizes are rounded up
+[[nodiscard]] video_format_t get_octave_format(const video_format_t& format, uint32_t level) noexcept;
+
+/**
+ * @brief Makes the 1/2, 1/4, 1/8 ... proxies of the frames in one read of the source.
+ *        Each level is made from the previous one by a 2x2 box filter. A row of a level is made as soon as
+ *        its 2 rows of the previous level are ready, so they are read again while they are in the cache.
+ *        At exactly 1/2, the bilinear filter at the pixel centers is the same 2x2 box
+ *
+ * @code
+ * pyramid_generator_t pyramid{3};
+ * std::vector<video_frame_t> levels{};
+ * pyramid.generate(frame, levels); // 1/2, 1/4, 1/8
+ * @endcode
+ *
+ * @note NV12, I420, RGB32 and ARGB32. The outputs are from the pools of the levels
+ * @note The box is the average of the vertical averages. Both are rounded up like `_mm_avg_epu8`
+ */
+class pyramid_generator_t final {
+    const uint32_t num_levels;
+    const size_t max_idle;
+    video_format_t format{}; // of the input
+    std::vector<std::unique_ptr<frame_pool_t>> pools{};
+
+  public:
+    /**
+     * @param levels count of the octaves. 1 to 8
+     * @param max_idle of the pool of each level
+     * @throws std::invalid_argument the `levels` is out of range
+     */
+    explicit pyramid_generator_t(uint32_t levels, size_t max_idle = 4) noexcept(false);
+    pyramid_generator_t(const pyramid_generator_t&) = delete;
+    pyramid_generator_t(pyramid_generator_t&&) = delete;
+    pyramid_generator_t& operator=(const pyramid_generator_t&) = delete;
+    pyramid_generator_t& operator=(pyramid_generator_t&&) = delete;
+    ~pyramid_generator_t() noexcept = default;
+
+    [[nodiscard]] uint32_t levels() const noexcept;
+
+    /**
+     * @param outputs replaced with the levels. `outputs[0]` is 1/2. The timestamps and flags are copied
+     * @throws std::invalid_argument the format is not supported
+     */
+    void generate(const video_frame_t& input, std::vector<video_frame_t>& outputs) noexcept(false);
+
+    /// @brief The pool of the octave `level`. 1 for 1/2
+    [[nodiscard]] frame_pool_t::stats_t stats(uint32_t level) const noexcept(false);
+};
+
+/**
+ * @brief Halve one row of a plane. `src0` and `src1` are the 2 rows. The same one for the last of the odd heights
+ * @param channels bytes per pixel. 1, 2 or 4
+ * @param src_width in pixels. The last one of the odd widths is paired with itself
+ */
+void halve_row(const uint8_t* src0, const uint8_t* src1, uint32_t src_width, uint32_t channels,
+               uint8_t* dst) noexcept;
@@ -0,0 +1,139 @@
+#include "rate_converter.hpp"
+
+transform_result_t cpu_rate_converter_t::set_frame_rate(uint32_t fps_num, uint32_t fps_den) noexcept {
+    if (is_uncompressed(input_format) == false)
+        return transform_result_t::not_ready;
+    if (fps_den == 0)
+        return transform_result_t::invalid_format;
+    video_format_t format = input_format;
+    format.fps_num = fps_num;
+    format.fps_den = fps_den;
+    return set_output_format(format);
+}
+
+transform_result_t cpu_rate_converter_t::set_input_format(const video_format_t& format) noexcept {
+    if (is_uncompressed(format) == false)
+        return transform_result_t::invalid_format;
+    const bool configured = output_format.pixel != pixel_format_t::unknown;
+    input_format = format;
+    video_format_t output = format;
+    if (configured) {
+        output.fps_num = output_format.fps_num; // keep the rate of `set_output_format`
+        output.fps_den = output_format.fps_den;
+    }
+    output_format = output;
+    return transform_result_t::ok;
+}
+
+transform_result_t cpu_rate_converter_t::set_output_format(const video_format_t& format) noexcept {
+    if (is_uncompressed(input_format) == false)
+        return transform_result_t::not_ready;
+    if (format.same_layout(input_format) == false || format.fps_den == 0)
+        return transform_result_t::invalid_format;
+    if (format.fps_num != output_format.fps_num || format.fps_den != output_format.fps_den)
+        flush(); // the grid of the old rate
+    output_format = format;
+    return transform_result_t::ok;
+}
+
+video_format_t cpu_rate_converter_t::get_input_format() const noexcept {
+    return input_format;
+}
+
+video_format_t cpu_rate_converter_t::get_output_format() const noexcept {
+    return output_format;
+}
+
+int64_t cpu_rate_converter_t::get_slot_time(int64_t slot) const noexcept {
+    // from the origin each time, so the rounding doesn't accumulate. `slot * 10'000'000 * fps_den` overflows after
+    // 9.2e8 slots for 30000/1001 (356 days), so the `fps_den` is multiplied after the division by `fps_num`
+    const int64_t time = slot * 10'000'000;
+    const int64_t quotient = time / output_format.fps_num;
+    const uint64_t remainder = static_cast<uint64_t>(time % output_format.fps_num) * output_format.fps_den;
+    return origin + quotient * output_format.fps_den + static_cast<int64_t>(remainder / output_format.fps_num);
+}
+
+void cpu_rate_converter_t::emit_until(int64_t end) noexcept {
+    const int64_t duration = get_slot_time(1) - get_slot_time(0);
+    for (int64_t time = get_slot_time(next_slot); time < end; time = get_slot_time(++next_slot)) {
+        video_frame_t& output = outputs.emplace_back(held);
+        output.timestamp = time;
+        output.duration = duration;
+        if (held_emitted++) {
+            output.flags &= ~(frame_flag_discontinuity | frame_flag_keyframe);
+            ++num_repeated;
+        }
+    }
+}
+
+void cpu_rate_converter_t::release() noexcept {
+    if (held && held_emitted == 0)
+        ++num_dropped;
+    held = {};
+    held_emitted = 0;
+}
+
+transform_result_t cpu_rate_converter_t::process_input(const video_frame_t& input) noexcept {
+    if (is_uncompressed(input_format) == false)
+        return transform_result_t::not_ready;
+    if (outputs.empty() == false)
+        return transform_result_t::not_accepting;
+    if (input.format.same_layout(input_format) == false)
+        return transform_result_t::invalid_format;
+    if (output_format.fps_num == 0) {
+        outputs.emplace_back(input);
+        return transform_result_t::ok;
+    }
+    if (held && (input.timestamp < held.timestamp || (input.flags & frame_flag_discontinuity))) {
+        drain(); // the last one takes its own slots, then a new grid
+        started = false;
+    }
+    if (started == false) {
+        origin = input.timestamp;
+        next_slot = 0;
+        started = true;
+    }
+    if (held) {
+        // the slots up to the midpoint are nearer to the held one. It takes the tie
+        emit_until(held.timestamp + (input.timestamp - held.timestamp) / 2 + 1);
+        release();
+    }
+    held = input;
+    return transform_result_t::ok;
+}
+
+transform_result_t cpu_rate_converter_t::process_output(video_frame_t& output) noexcept {
+    if (outputs.empty())
+        return transform_result_t::need_more_input;
+    output = std::move(outputs.front());
+    outputs.pop_front();
+    return transform_result_t::ok;
+}
+
+void cpu_rate_converter_t::drain() noexcept {
+    if (!held)
+        return;
+    // the end of the last input. The period of the input or 1 slot if the duration is unknown
+    int64_t duration = held.duration;
+    if (duration <= 0 && input_format.fps_num)
+        duration = 10'000'000 * static_cast<int64_t>(input_format.fps_den) / input_format.fps_num;
+    if (duration <= 0)
+        duration = get_slot_time(next_slot + 1) - get_slot_time(next_slot);
+    emit_until(held.timestamp + duration);
+    release();
+}
+
+void cpu_rate_converter_t::flush() noexcept {
+    outputs.clear();
+    held = {};
+    held_emitted = 0;
+    started = false;
+}
+
+size_t cpu_rate_converter_t::dropped_count() const noexcept {
+    return num_dropped;
+}
+
+size_t cpu_rate_converter_t::repeated_count() const noexcept {
+    return num_repeated;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <deque>
+
+#include "video_transform.hpp"
+
+/**
+ * @brief Enforces the frame rate of the output format (`MF_MT_FRAME_RATE`). The outputs are on the grid of
+ *        `fps_den / fps_num` from the first input. Each slot of the grid takes the input which is nearest to it
+ *        (the earlier one for a tie), so the inputs between the slots are dropped and a slot without an input
+ *        repeats the last one.
+ *        The repeated frames share the pixels. Only their timestamps are new
+ *
+ * @code
+ * auto rate = std::make_shared<cpu_rate_converter_t>();
+ * (void)rate->set_input_format(input_format);
+ * (void)rate->set_frame_rate(15, 1);
+ * pipeline.add(rate, "cpu_rate_converter_t"); // before the converter and the scaler. They run for 15 fps
+ * pipeline.add(converter, "cpu_converter_t");
+ * @endcode
+ *
+ * @note One input of latency. The output for a slot is known when the next input shows it is nearer.
+ *       A timestamp which goes back or `frame_flag_discontinuity` starts a new grid. `fps_num` 0 passes the inputs
+ */
+class cpu_rate_converter_t final : public video_transform_t {
+    video_format_t input_format{};
+    video_format_t output_format{};
+    std::deque<video_frame_t> outputs{};
+    video_frame_t held{}; // the last input. It is the candidate of the next slots
+    size_t held_emitted = 0;
+    int64_t origin = 0; // the timestamp of the slot 0
+    int64_t next_slot = 0;
+    bool started = false; // the grid has the origin
+    size_t num_dropped = 0;
+    size_t num_repeated = 0;
+
+  public:
+    /// @brief `set_output_format` with the frame rate of the input format
+    [[nodiscard]] transform_result_t set_frame_rate(uint32_t fps_num, uint32_t fps_den) noexcept;
+
+    transform_result_t set_input_format(const video_format_t& format) noexcept override;
+    /// @note Only the frame rate may be different from the input
+    transform_result_t set_output_format(const video_format_t& format) noexcept override;
+    video_format_t get_input_format() const noexcept override;
+    video_format_t get_output_format() const noexcept override;
+
+    /// @return `not_accepting` while the outputs of the last input are not taken
+    transform_result_t process_input(const video_frame_t& input) noexcept override;
+    transform_result_t process_output(video_frame_t& output) noexcept override;
+    /// @brief The last input fills the slots until its end. The grid is kept for the next inputs
+    void drain() noexcept override;
+    /// @brief Discard the last input and start a new grid with the next one
+    void flush() noexcept override;
+
+    /// @brief The inputs which were not used for any slot
+    [[nodiscard]] size_t dropped_count() const noexcept;
+    /// @brief The outputs which repeat an input
+    [[nodiscard]] size_t repeated_count() const noexcept;
+
+  private:
+    [[nodiscard]] int64_t get_slot_time(int64_t slot) const noexcept;
+    /// @brief `held` for the slots before `end`
+    void emit_until(int64_t end) noexcept;
+    /// @brief Count the `held` which is replaced
+    void release() noexcept;
+};
@@ -0,0 +1,138 @@
+#include "reorder_buffer.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "h264.hpp"
+
+namespace {
+
+/// @brief `std::push_heap` makes a max-heap. The smallest timestamp is the top with this order
+struct later_t final {
+    template <typename T>
+    bool operator()(const T& lhs, const T& rhs) const noexcept {
+        if (lhs.frame.timestamp != rhs.frame.timestamp)
+            return lhs.frame.timestamp > rhs.frame.timestamp;
+        return lhs.sequence > rhs.sequence;
+    }
+};
+
+} // namespace
+
+reorder_buffer_t::reorder_buffer_t(uint32_t _depth) noexcept(false) : depth{_depth} {
+    heap.reserve(depth + 1);
+}
+
+bool reorder_buffer_t::push(const video_frame_t& frame, int64_t composition_offset) noexcept {
+    if (heap.size() > depth)
+        return false;
+    draining = false;
+    entry_t& entry = heap.emplace_back(entry_t{frame, sequence++}); // no allocation. the capacity is reserved
+    entry.frame.timestamp += composition_offset;
+    std::push_heap(heap.begin(), heap.end(), later_t{});
+    return true;
+}
+
+bool reorder_buffer_t::pop(video_frame_t& output) noexcept {
+    // the top is the next frame in presentation order when `depth` frames are behind it
+    const bool ready = heap.size() > depth || (draining && heap.empty() == false);
+    if (has_last == false) {
+        if (ready == false)
+            return false;
+        pop_heap(last);
+        has_last = true;
+        return pop(output);
+    }
+    if (ready == false) {
+        if (draining == false)
+            return false;
+        output = std::move(last);
+        has_last = false;
+        return true;
+    }
+    output = std::move(last);
+    if (const int64_t next = heap.front().frame.timestamp; next > output.timestamp)
+        output.duration = next - output.timestamp;
+    pop_heap(last);
+    return true;
+}
+
+void reorder_buffer_t::pop_heap(video_frame_t& output) noexcept {
+    std::pop_heap(heap.begin(), heap.end(), later_t{});
+    output = std::move(heap.back().frame);
+    heap.pop_back();
+}
+
+void reorder_buffer_t::drain() noexcept {
+    draining = true;
+}
+
+void reorder_buffer_t::clear() noexcept {
+    heap.clear();
+    last = {};
+    has_last = false;
+    draining = false;
+}
+
+size_t reorder_buffer_t::size() const noexcept {
+    return heap.size() + (has_last ? 1 : 0);
+}
+
+size_t reorder_buffer_t::capacity() const noexcept {
+    return depth + 2;
+}
+
+reorder_transform_t::reorder_transform_t(uint32_t depth) noexcept(false) : buffer{depth} {
+}
+
+transform_result_t reorder_transform_t::set_input_format(const video_format_t& _format) noexcept {
+    if (_format.pixel == pixel_format_t::unknown)
+        return transform_result_t::invalid_format;
+    format = _format;
+    return transform_result_t::ok;
+}
+
+transform_result_t reorder_transform_t::set_output_format(const video_format_t& _format) noexcept {
+    if (format.pixel == pixel_format_t::unknown)
+        return transform_result_t::not_ready;
+    if (_format.same_layout(format) == false)
+        return transform_result_t::invalid_format;
+    return transform_result_t::ok;
+}
+
+video_format_t reorder_transform_t::get_input_format() const noexcept {
+    return format;
+}
+
+video_format_t reorder_transform_t::get_output_format() const noexcept {
+    return format;
+}
+
+transform_result_t reorder_transform_t::process_input(const video_frame_t& input) noexcept {
+    if (format.pixel == pixel_format_t::unknown)
+        return transform_result_t::not_ready;
+    if (buffer.push(input) == false)
+        return transform_result_t::not_accepting;
+    return transform_result_t::ok;
+}
+
+transform_result_t reorder_transform_t::process_output(video_frame_t& output) noexcept {
+    if (buffer.pop(output) == false)
+        return transform_result_t::need_more_input;
+    return transform_result_t::ok;
+}
+
+void reorder_transform_t::drain() noexcept {
+    buffer.drain();
+}
+
+void reorder_transform_t::flush() noexcept {
+    buffer.clear();
+}
+
+std::shared_ptr<reorder_transform_t> make_reorder_transform(const uint8_t* header, size_t size) noexcept(false) {
+    h264_sps_t sps{};
+    if (probe_h264(header, size, sps) == false)
+        throw std::invalid_argument{"no SPS in the header"};
+    return std::make_shared<reorder_transform_t>(sps.reorder_depth());
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "video_transform.hpp"
+
+/**
+ * @brief Sorts the frames of decode order into presentation order. The timestamps must be the presentation ones,
+ *        or the decode timestamps with their composition offsets(`ctts` of MP4)
+ *
+ * @code
+ * reorder_buffer_t buffer{sps.reorder_depth()};
+ * for (auto& frame : frames) { // decode order
+ *     buffer.push(frame, composition_offset);
+ *     video_frame_t output{};
+ *     while (buffer.pop(output))
+ *         consume(output);
+ * }
+ * buffer.drain();
+ * // pop until false
+ * @endcode
+ *
+ * @note The storage is a min-heap of `depth + 1` frames allocated in the constructor.
+ *       One more frame is held until the next timestamp is known, so the durations are the exact distances
+ * @note The frames of the same timestamp keep their order
+ */
+class reorder_buffer_t final {
+    struct entry_t final {
+        video_frame_t frame{};
+        uint64_t sequence = 0;
+    };
+    std::vector<entry_t> heap{};
+    const size_t depth;
+    uint64_t sequence = 0;
+    video_frame_t last{}; // popped from the heap. waits for the next timestamp
+    bool has_last = false;
+    bool draining = false;
+
+  public:
+    /// @param depth frames which can precede a frame in decode order and follow it in presentation order.
+    ///              `h264_sps_t::reorder_depth`
+    explicit reorder_buffer_t(uint32_t depth) noexcept(false);
+
+    /**
+     * @param composition_offset added to the timestamp of the frame
+     * @return false if the buffer is full. `pop` until false and push again
+     */
+    [[nodiscard]] bool push(const video_frame_t& frame, int64_t composition_offset = 0) noexcept;
+    /// @return false if the next frame in presentation order is not known yet
+    [[nodiscard]] bool pop(video_frame_t& output) noexcept;
+
+    /// @brief The end of the stream. `pop` returns all frames. The next `push` continues the stream
+    void drain() noexcept;
+    /// @brief Discard all frames
+    void clear() noexcept;
+
+    [[nodiscard]] size_t size() const noexcept;
+    [[nodiscard]] size_t capacity() const noexcept;
+
+  private:
+    void pop_heap(video_frame_t& output) noexcept;
+};
+
+/**
+ * @brief `reorder_buffer_t` as a stage of `video_pipeline_t`. For the decoders which keep the decode order, or
+ *        the sources which give the frames in decode order. The formats are not changed
+ */
+class reorder_transform_t final : public video_transform_t {
+    video_format_t format{};
+    reorder_buffer_t buffer;
+
+  public:
+    explicit reorder_transform_t(uint32_t depth) noexcept(false);
+
+    /// @brief Any format. The output format is the same
+    transform_result_t set_input_format(const video_format_t& format) noexcept override;
+    /// @return `invalid_format` if the `format` is not the input format
+    transform_result_t set_output_format(const video_format_t& format) noexcept override;
+    video_format_t get_input_format() const noexcept override;
+    video_format_t get_output_format() const noexcept override;
+
+    /// @return `not_accepting` while the buffer is full
+    transform_result_t process_input(const video_frame_t& input) noexcept override;
+    transform_result_t process_output(video_frame_t& output) noexcept override;
+    void drain() noexcept override;
+    void flush() noexcept override;
+};
+
+/**
+ * @brief `reorder_transform_t` with the reorder depth of the SPS
+ * @param header the avcC record or Annex B SPS/PPS
+ * @throws std::invalid_argument the header doesn't have a valid SPS
+ */
+[[nodiscard]] std::shared_ptr<reorder_transform_t> make_reorder_transform(const uint8_t* header,
+                                                                          size_t size) noexcept(false);
@@ -0,0 +1,93 @@
+#include "roi_extractor.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+bool is_yuv(pixel_format_t pixel) noexcept {
+    return pixel == pixel_format_t::nv12 || pixel == pixel_format_t::i420;
+}
+
+} // namespace
+
+roi_extractor_t::roi_extractor_t(size_t num_threads) noexcept(false) : pool{num_threads} {
+}
+
+roi_batch_t roi_extractor_t::extract(const video_frame_t& frame, const video_rect_t* regions, size_t count,
+                                     uint32_t width, uint32_t height) noexcept(false) {
+    const pixel_format_t pixel = frame.format.pixel;
+    if (is_compressed(pixel) || get_plane_count(pixel) == 0 || static_cast<bool>(frame) == false)
+        throw std::invalid_argument{"roi_extractor_t: unsupported format"};
+    if (width == 0 || height == 0 || (is_yuv(pixel) && (width % 2 || height % 2)))
+        throw std::invalid_argument{"roi_extractor_t: unsupported size"};
+    roi_batch_t batch{};
+    if (count == 0)
+        return batch;
+
+    // the crops are the bands of a tall frame. the chroma rows of the even heights don't cross them
+    batch.frame = allocate_frame({pixel, width, static_cast<uint32_t>(height * count), frame.format.fps_num,
+                                  frame.format.fps_den});
+    batch.frame.timestamp = frame.timestamp;
+    batch.frame.duration = frame.duration;
+    batch.frame.flags = frame.flags;
+    num_planes = get_plane_count(pixel);
+    jobs.resize(num_planes * count);
+    batch.crops.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const video_rect_t region = clip_region(frame.format, regions[i]);
+        if (region.width == 0)
+            throw std::invalid_argument{"roi_extractor_t: empty region"};
+        const video_frame_t view = crop_frame(frame, region);
+        video_frame_t& crop = batch.crops.emplace_back(batch.frame);
+        crop.format.height = height;
+        for (uint32_t p = 0; p < num_planes; ++p) {
+            const plane_extent_t to = get_plane_extent(crop.format, p);
+            crop.planes[p].data += static_cast<size_t>(to.rows) * i * crop.planes[p].stride;
+
+            const plane_extent_t from = get_plane_extent(view.format, p);
+            const uint32_t channels = is_yuv(pixel) ? (p > 0 && pixel == pixel_format_t::nv12 ? 2 : 1) : 4;
+            plane_job_t& job = jobs[p * count + i];
+            job.src = view.planes[p].data;
+            job.src_stride = view.planes[p].stride;
+            job.src_y = p ? region.y / 2 : region.y;
+            job.dst = crop.planes[p].data;
+            job.dst_stride = crop.planes[p].stride;
+            job.channels = channels;
+            make_scale_filter(from.row_bytes / channels, to.row_bytes / channels, job.fx);
+            make_scale_filter(from.rows, to.rows, job.fy);
+        }
+    }
+    const uint32_t num_bands = (frame.format.height + band_size - 1) / band_size;
+    pool.run(num_bands, [this](size_t band, size_t) { run_band(static_cast<uint32_t>(band)); });
+    return batch;
+}
+
+/**
+ * @brief Each crop row is written by the band which has its top source row. The source rows of a band are read
+ *        by all crops over it before the next band
+ */
+void roi_extractor_t::run_band(uint32_t band) noexcept {
+    const size_t count = num_planes ? jobs.size() / num_planes : 0;
+    for (uint32_t p = 0; p < num_planes; ++p) {
+        // the chroma planes have half of the rows
+        const uint32_t rows = p ? band_size / 2 : band_size;
+        const uint32_t top = band * rows;
+        const uint32_t bottom = top + rows;
+        for (size_t i = 0; i < count; ++i) {
+            const plane_job_t& job = jobs[p * count + i];
+            const std::vector<uint32_t>& indices = job.fy.indices;
+            // the rows of the crop which start in the band. `indices` are sorted
+            const uint32_t begin = std::max(top, job.src_y) - job.src_y;
+            const uint32_t end = std::max(bottom, job.src_y) - job.src_y;
+            const auto first = std::lower_bound(indices.begin(), indices.end(), begin);
+            const auto last = std::lower_bound(first, indices.end(), end);
+            for (auto it = first; it != last; ++it) {
+                const auto y = static_cast<size_t>(it - indices.begin());
+                const uint8_t* row0 = job.src + static_cast<size_t>(*it) * job.src_stride;
+                const uint8_t* row1 = job.fy.weights[y] ? row0 + job.src_stride : row0;
+                scale_row(row0, row1, job.fy.weights[y], job.fx, job.channels, job.dst + y * job.dst_stride);
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "pipeline.hpp"
+#include "video_kernels.hpp"
+
+/// @brief The crops of one frame in one buffer
+struct roi_batch_t final {
+    /// @brief All crops stacked vertically in the order of the regions. For RGB32 it is N x height x width x 4
+    video_frame_t frame{};
+    /// @brief Views of `frame`. They share its `storage`
+    std::vector<video_frame_t> crops{};
+};
+
+/**
+ * @brief Crops many regions of a frame and resizes them to one size, like `crop_frame` then `scale_frame` for each.
+ *        The source is walked by bands of rows. Every crop which reads the band writes its rows then, so the
+ *        overlapping boxes of a detector read the source rows from the cache. The bands are shared by the workers
+ *
+ * @code
+ * roi_extractor_t extractor{0};
+ * roi_batch_t batch = extractor.extract(frame, boxes.data(), boxes.size(), 128, 128);
+ * classify(batch.frame); // or batch.crops[i]
+ * @endcode
+ *
+ * @note The regions are clipped by `clip_region`. The pixel format of the crops is the one of the frame
+ */
+class roi_extractor_t final {
+    /// @brief A region in one plane and the filters from it to the crop
+    struct plane_job_t final {
+        const uint8_t* src = nullptr; // the top-left of the region
+        uint32_t src_stride = 0;
+        uint32_t src_y = 0; // the first row of the region in the plane
+        uint8_t* dst = nullptr;
+        uint32_t dst_stride = 0;
+        uint32_t channels = 1;
+        scale_filter_t fx{};
+        scale_filter_t fy{};
+    };
+
+    std::vector<plane_job_t> jobs{}; // plane, region order
+    uint32_t num_planes = 0;
+    band_pool_t pool;
+
+  public:
+    /// @param num_threads 0 for `std::thread::hardware_concurrency`, 1 for no worker
+    explicit roi_extractor_t(size_t num_threads = 1) noexcept(false);
+    roi_extractor_t(const roi_extractor_t&) = delete;
+    roi_extractor_t(roi_extractor_t&&) = delete;
+    roi_extractor_t& operator=(const roi_extractor_t&) = delete;
+    roi_extractor_t& operator=(roi_extractor_t&&) = delete;
+
+    /**
+     * @param width size of the crops. Even numbers for the YUV formats
+     * @throws std::invalid_argument the frame is compressed, the size is odd for YUV or a region is out of the frame
+     */
+    [[nodiscard]] roi_batch_t extract(const video_frame_t& frame, const video_rect_t* regions, size_t count,
+                                      uint32_t width, uint32_t height) noexcept(false);
+
+  private:
+    void run_band(uint32_t band) noexcept;
+};
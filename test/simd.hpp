@@ -0,0 +1,13 @@
+#pragma once
+/**
+ * @brief Instruction set detection for the hand-written kernels.
+ * @details SSE2 is the baseline of x64 (both MSVC and GCC/Clang), NEON is the baseline of arm64.
+ *          Every kernel must keep a scalar path for the other targets.
+ */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MEDIA0_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define MEDIA0_NEON 1
+#include <arm_neon.h>
+#endif
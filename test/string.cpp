@@ -4,37 +4,7 @@
 #include <spdlog/spdlog.h>
 #include <system_error>
 
-std::string w2mb(std::wstring_view in) noexcept(false) {
-    std::string out{};
-    out.reserve(MB_CUR_MAX * in.length());
-    mbstate_t state{};
-    for (wchar_t wc : in) {
-        size_t len = 0;
-        char mb[8]{}; // ensure null-terminated for UTF-8 (maximum 4 byte)
-        if (auto ec = wcrtomb_s(&len, mb, wc, &state))
-            throw std::system_error{ec, std::system_category(), "wcrtomb_s"};
-        out += std::string_view{mb, len};
-    }
-    return out;
-}
-
-std::wstring mb2w(std::string_view in) noexcept(false) {
-    std::wstring out{};
-    out.reserve(in.length());
-    const char* ptr = in.data();
-    const char* const end = in.data() + in.length();
-    mbstate_t state{};
-    wchar_t wc{};
-    while (size_t len = mbrtowc(&wc, ptr, end - ptr, &state)) {
-        if (len == static_cast<size_t>(-1)) // bad encoding
-            throw std::system_error{errno, std::system_category(), "mbrtowc"};
-        if (len == static_cast<size_t>(-2)) // valid but incomplete
-            break;                          // nothing to do more
-        out.push_back(wc);
-        ptr += len; // advance [1...n]
-    }
-    return out;
-}
+#include "unicode.hpp"
 
 std::string to_hex_string(HRESULT hr) noexcept {
     return fmt::format("{:#08x}", static_cast<uint32_t>(hr));
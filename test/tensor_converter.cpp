@@ -0,0 +1,325 @@
+#include "tensor_converter.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "simd.hpp"
+
+namespace {
+
+/// @brief The source of a color channel. `step` is the distance of the samples in a row
+struct channel_source_t final {
+    const uint8_t* data;
+    uint32_t stride;
+    uint32_t step;
+};
+
+/// @brief Round to nearest even. The overflow becomes infinity
+uint16_t to_half(float value) noexcept {
+    uint32_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const uint32_t magnitude = bits & 0x7FFFFFFF;
+    if (magnitude >= 0x7F800000) // infinity or NaN
+        return static_cast<uint16_t>(sign | (magnitude > 0x7F800000 ? 0x7E00 : 0x7C00));
+    if (magnitude >= 0x477FF000) // rounds to 65520 or more
+        return static_cast<uint16_t>(sign | 0x7C00);
+    if (magnitude < 0x38800000) { // subnormal half
+        if (magnitude < 0x33000000)
+            return sign;
+        const uint32_t exponent = magnitude >> 23;
+        const uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+        const uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    const uint32_t remainder = magnitude & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        ++half;
+    return static_cast<uint16_t>(sign | half);
+}
+
+/**
+ * @brief Bilinear filter aligned at the pixel centers like `scale_plane`.
+ *        The next sample is `index + 1` if the weight is not 0, so the last one is never passed
+ */
+void make_filter(uint32_t src_length, uint32_t dst_length, std::vector<uint32_t>& indices,
+                 std::vector<float>& weights) noexcept(false) {
+    indices.resize(dst_length);
+    weights.resize(dst_length);
+    const double ratio = static_cast<double>(src_length) / dst_length;
+    for (uint32_t i = 0; i < dst_length; ++i) {
+        const double position = std::max((i + 0.5) * ratio - 0.5, 0.0);
+        auto index = static_cast<uint32_t>(position);
+        auto weight = static_cast<float>(position - index);
+        if (index >= src_length - 1) {
+            index = src_length - 1;
+            weight = 0;
+        }
+        indices[i] = index;
+        weights[i] = weight;
+    }
+}
+
+void resample_row(const uint8_t* row, uint32_t step, const std::vector<uint32_t>& indices,
+                  const std::vector<float>& weights, float* output) noexcept {
+    for (size_t x = 0; x < indices.size(); ++x) {
+        const uint8_t* sample = row + static_cast<size_t>(indices[x]) * step;
+        const float weight = weights[x];
+        const float left = sample[0];
+        const float right = weight != 0 ? sample[step] : left;
+        output[x] = left + (right - left) * weight;
+    }
+}
+
+void blend_rows(const float* top, const float* bottom, float weight, float* output, uint32_t width) noexcept {
+    uint32_t x = 0;
+#if defined(MEDIA0_SSE2)
+    const __m128 w = _mm_set1_ps(weight);
+    for (; x + 4 <= width; x += 4) {
+        const __m128 a = _mm_loadu_ps(top + x);
+        const __m128 b = _mm_loadu_ps(bottom + x);
+        _mm_storeu_ps(output + x, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), w)));
+    }
+#elif defined(MEDIA0_NEON)
+    const float32x4_t w = vdupq_n_f32(weight);
+    for (; x + 4 <= width; x += 4) {
+        const float32x4_t a = vld1q_f32(top + x);
+        vst1q_f32(output + x, vmlaq_f32(a, vsubq_f32(vld1q_f32(bottom + x), a), w));
+    }
+#endif
+    for (; x < width; ++x)
+        output[x] = top[x] + (bottom[x] - top[x]) * weight;
+}
+
+/// @brief BT.601 limited range with the coefficients of `convert_frame`. R, G, B are clamped to [0, 255]
+void convert_yuv(float* y_r, float* u_g, float* v_b, uint32_t width) noexcept {
+    constexpr float y_scale = 298 / 256.0f, u_to_b = 516 / 256.0f, u_to_g = 100 / 256.0f, v_to_g = 208 / 256.0f,
+                    v_to_r = 409 / 256.0f;
+    uint32_t x = 0;
+#if defined(MEDIA0_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 full = _mm_set1_ps(255.0f);
+    for (; x + 4 <= width; x += 4) {
+        const __m128 c = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(y_r + x), _mm_set1_ps(16.0f)), _mm_set1_ps(y_scale));
+        const __m128 d = _mm_sub_ps(_mm_loadu_ps(u_g + x), _mm_set1_ps(128.0f));
+        const __m128 e = _mm_sub_ps(_mm_loadu_ps(v_b + x), _mm_set1_ps(128.0f));
+        const __m128 r = _mm_add_ps(c, _mm_mul_ps(e, _mm_set1_ps(v_to_r)));
+        const __m128 g =
+            _mm_sub_ps(c, _mm_add_ps(_mm_mul_ps(d, _mm_set1_ps(u_to_g)), _mm_mul_ps(e, _mm_set1_ps(v_to_g))));
+        const __m128 b = _mm_add_ps(c, _mm_mul_ps(d, _mm_set1_ps(u_to_b)));
+        _mm_storeu_ps(y_r + x, _mm_min_ps(_mm_max_ps(r, zero), full));
+        _mm_storeu_ps(u_g + x, _mm_min_ps(_mm_max_ps(g, zero), full));
+        _mm_storeu_ps(v_b + x, _mm_min_ps(_mm_max_ps(b, zero), full));
+    }
+#endif
+    for (; x < width; ++x) {
+        const float c = (y_r[x] - 16) * y_scale;
+        const float d = u_g[x] - 128;
+        const float e = v_b[x] - 128;
+        y_r[x] = std::clamp(c + e * v_to_r, 0.0f, 255.0f);
+        u_g[x] = std::clamp(c - d * u_to_g - e * v_to_g, 0.0f, 255.0f);
+        v_b[x] = std::clamp(c + d * u_to_b, 0.0f, 255.0f);
+    }
+}
+
+void normalize(const float* input, float scale, float bias, float* output, uint32_t width) noexcept {
+    uint32_t x = 0;
+#if defined(MEDIA0_SSE2)
+    const __m128 s = _mm_set1_ps(scale);
+    const __m128 b = _mm_set1_ps(bias);
+    for (; x + 4 <= width; x += 4)
+        _mm_storeu_ps(output + x, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(input + x), s), b));
+#elif defined(MEDIA0_NEON)
+    const float32x4_t b = vdupq_n_f32(bias);
+    for (; x + 4 <= width; x += 4)
+        vst1q_f32(output + x, vmlaq_n_f32(b, vld1q_f32(input + x), scale));
+#endif
+    for (; x < width; ++x)
+        output[x] = input[x] * scale + bias;
+}
+
+} // namespace
+
+video_rect_t get_tensor_region(const video_format_t& format, const tensor_options_t& options) noexcept {
+    video_rect_t region{0, 0, options.width, options.height};
+    if (options.letterbox == false || format.width == 0 || format.height == 0)
+        return region;
+    const uint64_t width = format.width;
+    const uint64_t height = format.height;
+    if (options.width * height <= options.height * width)
+        region.height = static_cast<uint32_t>((height * options.width + width / 2) / width);
+    else
+        region.width = static_cast<uint32_t>((width * options.height + height / 2) / height);
+    region.width = std::clamp(region.width, 1u, options.width);
+    region.height = std::clamp(region.height, 1u, options.height);
+    region.x = (options.width - region.width) / 2;
+    region.y = (options.height - region.height) / 2;
+    return region;
+}
+
+tensor_converter_t::tensor_converter_t(const tensor_options_t& _options) noexcept(false) : options{_options} {
+    if (options.width == 0 || options.height == 0)
+        throw std::invalid_argument{"tensor_converter_t: empty size"};
+    for (uint32_t c = 0; c < 3; ++c) {
+        if ((options.std[c] > 0) == false)
+            throw std::invalid_argument{"tensor_converter_t: std must be positive"};
+        scale[c] = 1.0f / (255.0f * options.std[c]);
+        bias[c] = -options.mean[c] / options.std[c];
+    }
+    // 2 source rows and 1 tensor row for each channel. The rows of the source are not wider than the tensor
+    buffer.resize(static_cast<size_t>(options.width) * 9);
+}
+
+const tensor_options_t& tensor_converter_t::get_options() const noexcept {
+    return options;
+}
+
+size_t tensor_converter_t::count() const noexcept {
+    return static_cast<size_t>(options.width) * options.height * 3;
+}
+
+size_t tensor_converter_t::size_bytes() const noexcept {
+    return count() * (options.type == tensor_type_t::float32 ? sizeof(float) : sizeof(uint16_t));
+}
+
+void tensor_converter_t::prepare(const video_format_t& _format) noexcept(false) {
+    if (format.same_layout(_format))
+        return;
+    region = get_tensor_region(_format, options);
+    make_filter(_format.width, region.width, luma_x.indices, luma_x.weights);
+    make_filter(_format.height, region.height, luma_y.indices, luma_y.weights);
+    make_filter((_format.width + 1) / 2, region.width, chroma_x.indices, chroma_x.weights);
+    make_filter((_format.height + 1) / 2, region.height, chroma_y.indices, chroma_y.weights);
+    format = _format;
+}
+
+void tensor_converter_t::convert(const video_frame_t& frame, void* tensor) noexcept(false) {
+    const pixel_format_t pixel = frame.format.pixel;
+    if (is_compressed(pixel) || get_plane_count(pixel) == 0 || frame.format.width == 0 || frame.format.height == 0 ||
+        frame.planes[0].data == nullptr)
+        throw std::invalid_argument{"tensor_converter_t: unsupported frame"};
+    prepare(frame.format);
+
+    const bool yuv = pixel == pixel_format_t::nv12 || pixel == pixel_format_t::i420;
+    const video_plane_t* planes = frame.planes;
+    // Y, U, V or R, G, B
+    channel_source_t sources[3]{};
+    switch (pixel) {
+    case pixel_format_t::nv12:
+        sources[0] = {planes[0].data, planes[0].stride, 1};
+        sources[1] = {planes[1].data, planes[1].stride, 2};
+        sources[2] = {planes[1].data + 1, planes[1].stride, 2};
+        break;
+    case pixel_format_t::i420:
+        sources[0] = {planes[0].data, planes[0].stride, 1};
+        sources[1] = {planes[1].data, planes[1].stride, 1};
+        sources[2] = {planes[2].data, planes[2].stride, 1};
+        break;
+    default: // B, G, R, X in memory
+        for (uint32_t c = 0; c < 3; ++c)
+            sources[c] = {planes[0].data + 2 - c, planes[0].stride, 4};
+        break;
+    }
+
+    const uint32_t width = options.width;
+    const uint32_t height = options.height;
+    float* slots[3][2]{};
+    int64_t cached[3][2]{};
+    float* lines[3]{};
+    for (uint32_t c = 0; c < 3; ++c) {
+        slots[c][0] = buffer.data() + static_cast<size_t>(width) * (2 * c);
+        slots[c][1] = buffer.data() + static_cast<size_t>(width) * (2 * c + 1);
+        cached[c][0] = cached[c][1] = -1;
+        lines[c] = buffer.data() + static_cast<size_t>(width) * (6 + c);
+    }
+    // the tensor channel `t` takes R, G, B or B, G, R
+    uint32_t order[3]{0, 1, 2};
+    if (options.bgr)
+        order[0] = 2, order[2] = 0;
+    float fills[3]{};
+    for (uint32_t t = 0; t < 3; ++t)
+        fills[t] = options.fill[order[t]] * scale[t] + bias[t];
+
+    const bool direct = options.layout == tensor_layout_t::chw && options.type == tensor_type_t::float32;
+    auto* values = static_cast<float*>(tensor);
+    auto* halves = static_cast<uint16_t*>(tensor);
+    for (uint32_t y = 0; y < height; ++y) {
+        float* outputs[3]{};
+        for (uint32_t t = 0; t < 3; ++t)
+            outputs[t] = direct ? values + (static_cast<size_t>(t) * height + y) * width : lines[t];
+        if (y < region.y || y >= region.y + region.height) {
+            for (uint32_t t = 0; t < 3; ++t)
+                std::fill_n(outputs[t], width, fills[t]);
+        } else {
+            const uint32_t ry = y - region.y;
+            float* colors[3]{}; // R, G, B after the conversion
+            for (uint32_t c = 0; c < 3; ++c) {
+                const bool chroma = yuv && c > 0;
+                const filter_t& fx = chroma ? chroma_x : luma_x;
+                const filter_t& fy = chroma ? chroma_y : luma_y;
+                const channel_source_t& source = sources[c];
+                const uint32_t i0 = fy.indices[ry];
+                const float weight = fy.weights[ry];
+                const uint32_t i1 = weight != 0 ? i0 + 1 : i0;
+                // the rows move forward. the bottom one of the last tensor row is the top one of this
+                if (cached[c][1] == i0 && cached[c][0] != i0) {
+                    std::swap(slots[c][0], slots[c][1]);
+                    std::swap(cached[c][0], cached[c][1]);
+                }
+                for (uint32_t k = 0; k < (weight != 0 ? 2u : 1u); ++k) {
+                    const uint32_t index = k ? i1 : i0;
+                    if (cached[c][k] == index)
+                        continue;
+                    resample_row(source.data + static_cast<size_t>(index) * source.stride, source.step, fx.indices,
+                                 fx.weights, slots[c][k]);
+                    cached[c][k] = index;
+                }
+                // the blended row goes to the middle of the line. the margins are filled after the conversion
+                colors[c] = lines[c] + region.x;
+                blend_rows(slots[c][0], slots[c][weight != 0 ? 1 : 0], weight, colors[c], region.width);
+            }
+            if (yuv)
+                convert_yuv(colors[0], colors[1], colors[2], region.width);
+            for (uint32_t t = 0; t < 3; ++t) {
+                // in place if the output is not the tensor. `order` is a permutation, so each line is used once
+                float* output = direct ? outputs[t] : lines[order[t]];
+                normalize(colors[order[t]], scale[t], bias[t], output + region.x, region.width);
+                std::fill_n(output, region.x, fills[t]);
+                std::fill(output + region.x + region.width, output + width, fills[t]);
+                outputs[t] = output;
+            }
+        }
+        if (direct)
+            continue;
+        // the other layouts and types from the lines
+        if (options.layout == tensor_layout_t::chw) {
+            for (uint32_t t = 0; t < 3; ++t) {
+                uint16_t* output = halves + (static_cast<size_t>(t) * height + y) * width;
+                for (uint32_t x = 0; x < width; ++x)
+                    output[x] = to_half(outputs[t][x]);
+            }
+        } else if (options.type == tensor_type_t::float32) {
+            float* output = values + static_cast<size_t>(y) * width * 3;
+            for (uint32_t x = 0; x < width; ++x, output += 3)
+                output[0] = outputs[0][x], output[1] = outputs[1][x], output[2] = outputs[2][x];
+        } else {
+            uint16_t* output = halves + static_cast<size_t>(y) * width * 3;
+            for (uint32_t x = 0; x < width; ++x, output += 3)
+                output[0] = to_half(outputs[0][x]), output[1] = to_half(outputs[1][x]),
+                output[2] = to_half(outputs[2][x]);
+        }
+    }
+}
+
+void tensor_converter_t::convert(const video_frame_t* frames, size_t count, void* tensor) noexcept(false) {
+    auto* output = static_cast<uint8_t*>(tensor);
+    for (size_t i = 0; i < count; ++i, output += size_bytes())
+        convert(frames[i], output);
+}
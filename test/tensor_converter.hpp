@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "video_frame.hpp"
+
+/// @brief Memory order of a tensor. `chw` keeps each channel as a plane, `hwc` interleaves them like RGB32
+enum class tensor_layout_t : uint32_t {
+    chw = 0,
+    hwc = 1,
+};
+
+enum class tensor_type_t : uint32_t {
+    float32 = 0,
+    float16 = 1, // IEEE 754 binary16. Rounded to nearest even
+};
+
+/**
+ * @brief The input of a vision model.
+ *        Each value is `(sample / 255 - mean[c]) / std[c]` where the sample is the 8 bit R, G or B
+ */
+struct tensor_options_t final {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    tensor_layout_t layout = tensor_layout_t::chw;
+    tensor_type_t type = tensor_type_t::float32;
+    bool bgr = false; // the channel order. R, G, B if false
+    float mean[3]{0.0f, 0.0f, 0.0f};
+    float std[3]{1.0f, 1.0f, 1.0f};
+    /// @brief Keep the aspect ratio and fill the rest with `fill`. Otherwise the frame is stretched to the tensor
+    bool letterbox = false;
+    uint8_t fill[3]{0, 0, 0}; // R, G, B before the normalization
+};
+
+/// @brief Where the frame is placed in the tensor. The whole tensor if not `letterbox`. Centered otherwise
+[[nodiscard]] video_rect_t get_tensor_region(const video_format_t& format, const tensor_options_t& options) noexcept;
+
+/**
+ * @brief Fused preprocessing for the CPU inference. Bilinear resize, color conversion, normalization and
+ *        the layout change are done in one pass from NV12, I420 or RGB32 without intermediate frames.
+ *        The horizontal filter runs once per source row, the rest once per tensor row
+ *
+ * @code
+ * tensor_options_t options{};
+ * options.width = options.height = 224;
+ * std::copy_n(imagenet_mean, 3, options.mean);
+ * std::copy_n(imagenet_std, 3, options.std);
+ * tensor_converter_t converter{options};
+ * std::vector<float> batch(converter.count() * frames.size());
+ * converter.convert(frames.data(), frames.size(), batch.data()); // N x 3 x 224 x 224
+ * @endcode
+ *
+ * @note YUV uses BT.601 limited range like `convert_frame`. Resizing before the conversion
+ *       differs from `convert_frame` then `scale_frame` by a few steps of the 8 bit samples
+ */
+class tensor_converter_t final {
+    /// @brief Source sample and weight of the next one for each destination sample
+    struct filter_t final {
+        std::vector<uint32_t> indices{};
+        std::vector<float> weights{};
+    };
+
+    const tensor_options_t options;
+    float scale[3]{}; // per channel of the tensor
+    float bias[3]{};
+    video_format_t format{}; // the filters are made for it
+    video_rect_t region{};
+    filter_t luma_x{}, luma_y{}, chroma_x{}, chroma_y{};
+    std::vector<float> buffer{};
+
+  public:
+    /// @throws std::invalid_argument the size is 0 or a `std` is not positive
+    explicit tensor_converter_t(const tensor_options_t& options) noexcept(false);
+    tensor_converter_t(const tensor_converter_t&) = delete;
+    tensor_converter_t(tensor_converter_t&&) = delete;
+    tensor_converter_t& operator=(const tensor_converter_t&) = delete;
+    tensor_converter_t& operator=(tensor_converter_t&&) = delete;
+    ~tensor_converter_t() noexcept = default;
+
+    [[nodiscard]] const tensor_options_t& get_options() const noexcept;
+    /// @brief Count of the values for 1 frame. 3 x height x width
+    [[nodiscard]] size_t count() const noexcept;
+    [[nodiscard]] size_t size_bytes() const noexcept;
+
+    /**
+     * @param tensor `size_bytes` for the frame. `float` or `uint16_t` by `tensor_options_t::type`
+     * @throws std::invalid_argument the frame is compressed or empty
+     */
+    void convert(const video_frame_t& frame, void* tensor) noexcept(false);
+    /// @brief Batch of the frames in NCHW or NHWC. The formats of the frames may be different
+    void convert(const video_frame_t* frames, size_t count, void* tensor) noexcept(false);
+
+  private:
+    void prepare(const video_format_t& format) noexcept(false);
+};
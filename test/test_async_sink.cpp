@@ -0,0 +1,182 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+#include "async_sink.hpp"
+
+namespace {
+
+/// @brief Counts the records and remembers the thread which wrote them
+class counting_sink final : public spdlog::sinks::base_sink<spdlog::details::null_mutex> {
+  public:
+    size_t count = 0;
+    std::thread::id writer{};
+    std::string last{};
+
+  protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override {
+        ++count;
+        writer = std::this_thread::get_id();
+        last.assign(msg.payload.data(), msg.payload.size());
+    }
+    void flush_() override {
+    }
+};
+
+/// @brief Holds the background thread in `log` until `open`. A console which can't keep up
+class blocking_sink final : public spdlog::sinks::base_sink<spdlog::details::null_mutex> {
+    std::mutex mtx{};
+    std::condition_variable cv{};
+    bool opened = false;
+
+  public:
+    std::atomic_bool entered{false};
+
+    void open() {
+        {
+            std::lock_guard lck{mtx};
+            opened = true;
+        }
+        cv.notify_all();
+    }
+
+  protected:
+    void sink_it_(const spdlog::details::log_msg&) override {
+        entered = true;
+        std::unique_lock lck{mtx};
+        cv.wait(lck, [this]() { return opened; });
+    }
+    void flush_() override {
+    }
+};
+
+#if defined(NDEBUG)
+/// @brief Bound of `log` per record. The formatting of the logger and the copy, no syscall
+constexpr int64_t max_latency = 1000;
+#else
+constexpr int64_t max_latency = 2500; // spdlog and fmt without the optimization
+#endif
+
+} // namespace
+
+TEST_CASE("async_sink", "[async_sink]") {
+    auto counter = std::make_shared<counting_sink>();
+
+    SECTION("background write") {
+        auto sink = std::make_shared<async_sink>(std::vector<spdlog::sink_ptr>{counter});
+        spdlog::logger logger{"test", sink};
+        logger.info("{}: {:#08x}", "ProcessOutput", 0xC00D6D72);
+        logger.flush();
+        REQUIRE(counter->count == 1);
+        REQUIRE(counter->last == "ProcessOutput: 0xc00d6d72");
+        REQUIRE(counter->writer != std::this_thread::get_id());
+    }
+    SECTION("drop when full") {
+        auto sink = std::make_shared<async_sink>(std::vector<spdlog::sink_ptr>{counter}, 16);
+        spdlog::logger logger{"test", sink};
+        constexpr size_t count = 4096;
+        for (size_t i = 0; i < count; ++i)
+            logger.info("{}", i);
+        logger.flush();
+        const auto stats = sink->stats();
+        REQUIRE(stats.accepted + stats.dropped == count);
+        REQUIRE(stats.written == stats.accepted);
+        REQUIRE(counter->count == stats.written);
+    }
+    SECTION("multiple producers") {
+        // a ring of exited thread can be adopted with pending records. keep enough capacity for the test
+        auto sink = std::make_shared<async_sink>(std::vector<spdlog::sink_ptr>{counter}, 4096);
+        spdlog::logger logger{"test", sink};
+        std::vector<std::thread> threads{};
+        for (auto t = 0; t < 4; ++t)
+            threads.emplace_back([&logger]() {
+                for (auto i = 0; i < 1000; ++i)
+                    logger.info("{}", i);
+            });
+        for (auto& t : threads)
+            t.join();
+        logger.flush();
+        REQUIRE(counter->count == 4000);
+        REQUIRE(sink->stats().dropped == 0);
+    }
+    SECTION("truncate long payload") {
+        auto sink = std::make_shared<async_sink>(std::vector<spdlog::sink_ptr>{counter});
+        spdlog::logger logger{"test", sink};
+        logger.warn("{}", std::string(2 * async_sink::payload_capacity, 'x'));
+        logger.flush();
+        REQUIRE(counter->last.size() == async_sink::payload_capacity);
+        REQUIRE(sink->stats().truncated == 1);
+    }
+    SECTION("the first log of a thread doesn't wait for the I/O") {
+        auto blocking = std::make_shared<blocking_sink>();
+        auto sink = std::make_shared<async_sink>(std::vector<spdlog::sink_ptr>{blocking});
+        spdlog::logger logger{"test", sink};
+        logger.info("{}", "stuck in the console");
+        while (blocking->entered == false)
+            std::this_thread::yield();
+        // a new ring and the stats while the background thread is in `log` of the wrapped sink
+        auto producer = std::async(std::launch::async, [&logger, &sink]() {
+            logger.info("{}", "from another thread");
+            return sink->stats();
+        });
+        const bool finished = producer.wait_for(std::chrono::seconds{5}) == std::future_status::ready;
+        blocking->open();
+        REQUIRE(finished);
+        REQUIRE(producer.get().accepted == 2);
+        logger.flush();
+        REQUIRE(sink->stats().written == 2);
+    }
+    SECTION("a record is written without a flush") {
+        auto sink = std::make_shared<async_sink>(std::vector<spdlog::sink_ptr>{counter});
+        spdlog::logger logger{"test", sink};
+        for (auto i = 0; i < 10; ++i) {
+            logger.info("{}", i);
+            // below the high-water mark. the poll of the background thread takes it
+            const auto due = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+            while (sink->stats().written != static_cast<uint64_t>(i + 1) && std::chrono::steady_clock::now() < due)
+                std::this_thread::yield();
+            REQUIRE(sink->stats().written == static_cast<uint64_t>(i + 1));
+        }
+    }
+    SECTION("log latency") {
+        auto sink = std::make_shared<async_sink>(std::vector<spdlog::sink_ptr>{counter}, 1 << 16);
+        spdlog::logger logger{"test", sink};
+        constexpr size_t count = 10000;
+        logger.info("{}", "the first log of the thread allocates the ring");
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i)
+            logger.info("{}: {}", "ProcessInput", i);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        logger.flush();
+        REQUIRE(counter->count == count + 1);
+        const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / count;
+        spdlog::info("async_sink: {} ns/record", latency);
+        REQUIRE(latency < max_latency);
+    }
+    SECTION("sparse log latency") {
+        auto sink = std::make_shared<async_sink>(std::vector<spdlog::sink_ptr>{counter});
+        spdlog::logger logger{"test", sink};
+        constexpr size_t count = 200;
+        logger.info("{}", "the first log of the thread allocates the ring");
+        std::chrono::nanoseconds elapsed{};
+        for (size_t i = 0; i < count; ++i) {
+            // the background thread drains the ring and sleeps between the records
+            std::this_thread::sleep_for(std::chrono::microseconds{100});
+            const auto start = std::chrono::steady_clock::now();
+            logger.info("{}: {}", "ProcessInput", i);
+            elapsed += std::chrono::steady_clock::now() - start;
+        }
+        logger.flush();
+        REQUIRE(counter->count == count + 1);
+        const auto latency = elapsed.count() / count;
+        spdlog::info("async_sink: {} ns/record with the sleeping background thread", latency);
+        // the caches are cold after the sleep. a futex call for each record takes a few microseconds more
+        REQUIRE(latency < 2 * max_latency);
+    }
+}
@@ -0,0 +1,3 @@
+/// @brief Entry of the portable tests. `media0` uses CppUnitTest on Windows, this one runs everywhere
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
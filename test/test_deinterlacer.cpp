@@ -0,0 +1,214 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "deinterlacer.hpp"
+#include "test_frames.hpp"
+
+namespace {
+
+video_frame_t make_frame(const video_format_t& format, uint32_t seed) {
+    video_frame_t frame = make_noise_frame(format, seed);
+    frame.duration = 333'667;
+    return frame;
+}
+
+/// @brief The luma of the upper field is 100 and the lower one 20, like the edge of a moving object
+video_frame_t make_combed(const video_format_t& format) {
+    video_frame_t frame = allocate_frame(format);
+    for (uint32_t p = 0; p < get_plane_count(format.pixel); ++p) {
+        const plane_extent_t extent = get_plane_extent(format, p);
+        for (uint32_t y = 0; y < extent.rows; ++y)
+            std::memset(frame.planes[p].data + static_cast<size_t>(y) * frame.planes[p].stride,
+                        p ? 128 : (y % 2 ? 20 : 100), extent.row_bytes);
+    }
+    return frame;
+}
+
+const uint8_t* at(const video_frame_t& frame, uint32_t plane, uint32_t y) {
+    return frame.planes[plane].data + static_cast<size_t>(y) * frame.planes[plane].stride;
+}
+
+std::vector<video_frame_t> process(cpu_deinterlacer_t& deinterlacer, const video_frame_t& input) {
+    REQUIRE(deinterlacer.process_input(input) == transform_result_t::ok);
+    std::vector<video_frame_t> outputs{};
+    video_frame_t output{};
+    while (deinterlacer.process_output(output) == transform_result_t::ok)
+        outputs.emplace_back(output);
+    return outputs;
+}
+
+/// @brief The rows of the `kept` parity are copied and the others are the average of the rows around them
+void require_bob(const video_frame_t& input, const video_frame_t& output, uint32_t kept) {
+    for (uint32_t p = 0; p < get_plane_count(input.format.pixel); ++p) {
+        const plane_extent_t extent = get_plane_extent(input.format, p);
+        std::vector<uint8_t> expected(extent.row_bytes);
+        for (uint32_t y = 0; y < extent.rows; ++y) {
+            if ((y & 1) == kept) {
+                REQUIRE(std::memcmp(at(output, p, y), at(input, p, y), extent.row_bytes) == 0);
+                continue;
+            }
+            const uint32_t above = y ? y - 1 : y + 1;
+            const uint32_t below = y + 1 < extent.rows ? y + 1 : y - 1;
+            interpolate_row(at(input, p, above), at(input, p, below), extent.row_bytes, expected.data());
+            REQUIRE(std::memcmp(at(output, p, y), expected.data(), extent.row_bytes) == 0);
+        }
+    }
+}
+
+} // namespace
+
+TEST_CASE("interpolate_row, adapt_row", "[deinterlacer]") {
+    constexpr uint32_t count = 100;
+    std::vector<uint8_t> lines[6]{};
+    uint32_t seed = 5;
+    for (auto& line : lines) {
+        line.resize(count);
+        for (auto& value : line)
+            value = next_random(seed);
+    }
+    // the previous frame is near the current one. Some bytes are on the threshold
+    for (uint32_t i = 0; i < count; ++i)
+        for (uint32_t l = 3; l < 6; ++l)
+            lines[l][i] = static_cast<uint8_t>(std::clamp(lines[l - 3][i] + static_cast<int>(i % 25) - 12, 0, 255));
+    const field_rows_t rows{lines[0].data(), lines[1].data(), lines[2].data()};
+    const field_rows_t previous{lines[3].data(), lines[4].data(), lines[5].data()};
+
+    std::vector<uint8_t> bob(count), adaptive(count);
+    interpolate_row(rows.above, rows.below, count, bob.data());
+    adapt_row(rows, previous, 10, count, adaptive.data());
+    uint32_t num_moving = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        REQUIRE(bob[i] == (lines[0][i] + lines[2][i] + 1) / 2);
+        int motion = 0;
+        for (uint32_t l = 0; l < 3; ++l)
+            motion = std::max(motion, std::abs(lines[l][i] - lines[l + 3][i]));
+        REQUIRE(adaptive[i] == (motion > 10 ? bob[i] : lines[1][i]));
+        num_moving += motion > 10;
+    }
+    REQUIRE(num_moving > 0);
+    REQUIRE(num_moving < count);
+}
+
+TEST_CASE("cpu_deinterlacer_t", "[deinterlacer]") {
+    const video_format_t format{pixel_format_t::nv12, 96, 70, 30000, 1001};
+    cpu_deinterlacer_t deinterlacer{};
+    REQUIRE(deinterlacer.set_input_format({pixel_format_t::rgb32, 96, 70}) == transform_result_t::invalid_format);
+
+    SECTION("bob") {
+        deinterlacer.set_mode(deinterlace_mode_t::bob, false);
+        REQUIRE(deinterlacer.set_input_format(format) == transform_result_t::ok);
+        REQUIRE(deinterlacer.get_output_format() == format);
+        const video_frame_t input = make_frame(format, 1);
+        const std::vector<video_frame_t> outputs = process(deinterlacer, input);
+        REQUIRE(outputs.size() == 1);
+        require_bob(input, outputs[0], 0);
+        REQUIRE(outputs[0].duration == input.duration);
+    }
+    SECTION("bob of the lower field first, double rate") {
+        deinterlacer.set_interlace_mode(interlace_mode_t::lower_first);
+        deinterlacer.set_mode(deinterlace_mode_t::bob, true);
+        REQUIRE(deinterlacer.set_input_format({pixel_format_t::i420, 96, 70, 25, 1}) == transform_result_t::ok);
+        REQUIRE(deinterlacer.get_output_format().fps_num == 50);
+        video_frame_t input = make_frame(deinterlacer.get_input_format(), 2);
+        input.timestamp = 1000;
+        input.duration = 400'000;
+        input.flags = frame_flag_keyframe;
+        const std::vector<video_frame_t> outputs = process(deinterlacer, input);
+        REQUIRE(outputs.size() == 2);
+        require_bob(input, outputs[0], 1);
+        require_bob(input, outputs[1], 0);
+        REQUIRE(outputs[0].timestamp == 1000);
+        REQUIRE(outputs[1].timestamp == 201'000);
+        REQUIRE(outputs[1].duration == 200'000);
+        REQUIRE(outputs[0].flags == frame_flag_keyframe);
+        REQUIRE(outputs[1].flags == 0);
+        REQUIRE(outputs[1].format.fps_num == 50);
+    }
+    SECTION("weave") {
+        deinterlacer.set_mode(deinterlace_mode_t::weave, true);
+        REQUIRE(deinterlacer.set_input_format(format) == transform_result_t::ok);
+        const video_frame_t input = make_frame(format, 3);
+        const std::vector<video_frame_t> outputs = process(deinterlacer, input);
+        REQUIRE(outputs.size() == 2);
+        for (const video_frame_t& output : outputs)
+            REQUIRE(output.planes[0].data == input.planes[0].data);
+        REQUIRE(outputs[1].timestamp == input.timestamp + input.duration / 2);
+    }
+    SECTION("adaptive") {
+        REQUIRE(deinterlacer.set_input_format(format) == transform_result_t::ok);
+        const video_frame_t first = make_combed(format);
+        require_bob(first, process(deinterlacer, first)[0], 0); // nothing to compare
+        // still. The fields are woven
+        const video_frame_t second = make_combed(format);
+        REQUIRE(same_pixels(second, process(deinterlacer, second)[0]));
+        // a block of the upper field moves. The missing rows next to it are interpolated
+        video_frame_t third = make_combed(format);
+        for (uint32_t y = 20; y < 30; y += 2)
+            std::memset(third.planes[0].data + static_cast<size_t>(y) * third.planes[0].stride + 32, 200, 16);
+        const video_frame_t output = process(deinterlacer, third)[0];
+        for (uint32_t y = 0; y < format.height; ++y)
+            for (uint32_t x = 0; x < format.width; ++x) {
+                const uint8_t actual = at(output, 0, y)[x];
+                if (y % 2 == 0 || x < 32 || x >= 48 || y < 19 || y > 29)
+                    REQUIRE(actual == at(third, 0, y)[x]);
+                else
+                    REQUIRE(actual == (at(third, 0, y - 1)[x] + at(third, 0, y + 1)[x] + 1) / 2);
+            }
+        REQUIRE(std::memcmp(at(output, 1, 10), at(third, 1, 10), format.width) == 0);
+
+        SECTION("flush") {
+            deinterlacer.flush();
+            require_bob(third, process(deinterlacer, third)[0], 0);
+        }
+        SECTION("discontinuity") {
+            third.flags = frame_flag_discontinuity;
+            require_bob(third, process(deinterlacer, third)[0], 0);
+        }
+    }
+    SECTION("mixed") {
+        deinterlacer.set_interlace_mode(interlace_mode_t::mixed);
+        deinterlacer.set_mode(deinterlace_mode_t::bob, false);
+        REQUIRE(deinterlacer.set_input_format(format) == transform_result_t::ok);
+        const video_frame_t progressive = make_frame(format, 5);
+        REQUIRE(process(deinterlacer, progressive)[0].planes[0].data == progressive.planes[0].data);
+        video_frame_t interlaced = make_frame(format, 6);
+        interlaced.flags = frame_flag_interlaced | frame_flag_bottom_first;
+        const video_frame_t output = process(deinterlacer, interlaced)[0];
+        require_bob(interlaced, output, 1);
+        REQUIRE(output.flags == 0);
+    }
+    SECTION("not accepting") {
+        REQUIRE(deinterlacer.set_input_format(format) == transform_result_t::ok);
+        const video_frame_t input = make_frame(format, 7);
+        REQUIRE(deinterlacer.process_input(input) == transform_result_t::ok);
+        REQUIRE(deinterlacer.process_input(input) == transform_result_t::not_accepting);
+        deinterlacer.flush();
+        video_frame_t output{};
+        REQUIRE(deinterlacer.process_output(output) == transform_result_t::need_more_input);
+    }
+}
+
+TEST_CASE("cpu_deinterlacer_t with workers", "[deinterlacer]") {
+    const video_format_t format{pixel_format_t::nv12, 320, 240, 30, 1};
+    cpu_deinterlacer_t single{1};
+    cpu_deinterlacer_t multiple{3};
+    for (cpu_deinterlacer_t* deinterlacer : {&single, &multiple}) {
+        deinterlacer->set_mode(deinterlace_mode_t::adaptive, true);
+        REQUIRE(deinterlacer->set_input_format(format) == transform_result_t::ok);
+    }
+    for (uint32_t i = 0; i < 3; ++i) {
+        video_frame_t input = make_frame(format, 8 + i % 2);
+        input.timestamp = i * 333'333;
+        const std::vector<video_frame_t> expected = process(single, input);
+        const std::vector<video_frame_t> actual = process(multiple, input);
+        REQUIRE(actual.size() == 2);
+        for (size_t f = 0; f < actual.size(); ++f) {
+            REQUIRE(same_pixels(actual[f], expected[f]));
+            REQUIRE(actual[f].timestamp == expected[f].timestamp);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#include <catch2/catch.hpp>
+
+#include <sstream>
+#include <thread>
+
+#include "event_trace.hpp"
+
+namespace {
+
+/// @brief The module may be tracing. Start a new session at the end if it was
+class trace_guard_t final {
+    const bool previous = trace_enabled();
+
+  public:
+    ~trace_guard_t() noexcept(false) {
+        if (previous)
+            trace_start();
+        else
+            trace_stop();
+    }
+};
+
+} // namespace
+
+TEST_CASE("event_trace", "[event_trace]") {
+    const trace_guard_t guard{};
+
+    SECTION("disabled emit") {
+        trace_start(16);
+        trace_stop();
+        trace_emit(trace_event_t::input_accepted, 0, 0, 0);
+        std::stringstream buf{};
+        REQUIRE(trace_dump(buf) == 0);
+    }
+    SECTION("ring keeps latest") {
+        trace_start(16);
+        const uint16_t track = trace_register_track("h264_decoder_t");
+        for (int64_t i = 0; i < 100; ++i)
+            trace_emit(trace_event_t::input_accepted, track, 0, i);
+        std::stringstream buf{};
+        REQUIRE(trace_dump(buf) == 16);
+    }
+    SECTION("register track") {
+        const uint16_t track0 = trace_register_track("color_converter_t");
+        const uint16_t track1 = trace_register_track("sample_cropper_t");
+        REQUIRE(track0 != track1);
+        REQUIRE(track0 == trace_register_track("color_converter_t"));
+    }
+    SECTION("chrome json") {
+        trace_start(64);
+        const uint16_t track = trace_register_track("sample_processor_t");
+        std::thread worker{[track]() {
+            trace_emit(trace_event_t::input_accepted, track, 0, 333333);
+            trace_emit(trace_event_t::need_more_input, track, 0, 333333);
+        }};
+        worker.join();
+        trace_emit(trace_event_t::drain_begin, track, 0, 0);
+        trace_emit(trace_event_t::drain_end, track, 0, 0);
+
+        std::stringstream binary{};
+        REQUIRE(trace_dump(binary) == 4);
+        std::stringstream json{};
+        REQUIRE(trace_to_chrome_json(binary, json) == 4);
+        const std::string txt = json.str();
+        REQUIRE(txt.find("\"sample_processor_t\"") != std::string::npos);
+        REQUIRE(txt.find("\"need_more_input\"") != std::string::npos);
+        REQUIRE(txt.find("\"ph\":\"B\"") != std::string::npos);
+        REQUIRE(txt.find("\"ph\":\"E\"") != std::string::npos);
+    }
+    SECTION("chrome json of invalid input") {
+        std::stringstream binary{"not a trace"};
+        std::stringstream json{};
+        REQUIRE_THROWS_AS(trace_to_chrome_json(binary, json), std::runtime_error);
+    }
+}
@@ -0,0 +1,111 @@
+#include <catch2/catch.hpp>
+
+#include "frame_cache.hpp"
+#include "video_pipeline.hpp"
+
+namespace {
+
+const video_format_t format{pixel_format_t::i420, 16, 16};
+
+/// @brief Frames of 1000 units. Every 4th one is a keyframe
+video_frame_t make_frame(int64_t index) {
+    video_frame_t frame = allocate_frame(format);
+    frame.timestamp = index * 1000;
+    frame.duration = 1000;
+    frame.flags = index % 4 == 0 ? frame_flag_keyframe : 0u;
+    return frame;
+}
+
+} // namespace
+
+TEST_CASE("frame_cache_t", "[frame_cache]") {
+    const size_t frame_size = make_frame(0).size_bytes();
+    frame_cache_t cache{frame_size * 8}; // 2 GOPs
+
+    SECTION("shared without copy") {
+        const video_frame_t frame = make_frame(0);
+        REQUIRE(cache.insert(1, 0, frame));
+        video_frame_t found{};
+        REQUIRE(cache.find(1, 0, found));
+        REQUIRE(found.planes[0].data == frame.planes[0].data);
+        REQUIRE(found.storage == frame.storage);
+        REQUIRE_FALSE(cache.find(1, 1000, found));
+        REQUIRE_FALSE(cache.find(2, 0, found)); // the other source
+        const auto stats = cache.stats();
+        REQUIRE(stats.hits == 1);
+        REQUIRE(stats.misses == 2);
+        REQUIRE(stats.bytes == frame_size);
+    }
+    SECTION("GOP is evicted together") {
+        for (int64_t i = 0; i < 12; ++i)
+            REQUIRE(cache.insert(1, i / 4 * 4000, make_frame(i)));
+        auto stats = cache.stats();
+        REQUIRE(stats.gops == 2);
+        REQUIRE(stats.frames == 8);
+        REQUIRE(stats.evicted == 4);
+        REQUIRE(stats.bytes <= cache.capacity());
+        video_frame_t found{};
+        for (int64_t i = 0; i < 4; ++i)
+            REQUIRE_FALSE(cache.find(1, i * 1000, found));
+        for (int64_t i = 4; i < 12; ++i)
+            REQUIRE(cache.find(1, i * 1000, found));
+    }
+    SECTION("least recently used") {
+        for (int64_t i = 0; i < 8; ++i)
+            REQUIRE(cache.insert(1, i / 4 * 4000, make_frame(i)));
+        video_frame_t found{};
+        REQUIRE(cache.find(1, 2000, found)); // the first GOP is used again
+        REQUIRE(cache.insert(1, 8000, make_frame(8)));
+        REQUIRE(cache.find(1, 0, found));
+        REQUIRE_FALSE(cache.find(1, 4000, found)); // the second GOP was evicted
+        REQUIRE(cache.stats().evicted == 4);
+    }
+    SECTION("larger than the budget") {
+        frame_cache_t small{frame_size - 1};
+        REQUIRE_FALSE(small.insert(1, 0, make_frame(0)));
+        frame_cache_t one{frame_size * 2};
+        REQUIRE(one.insert(1, 0, make_frame(0)));
+        REQUIRE(one.insert(1, 0, make_frame(1)));
+        REQUIRE_FALSE(one.insert(1, 0, make_frame(2))); // the GOP itself doesn't fit
+        REQUIRE(one.stats().frames == 0);
+    }
+    SECTION("replace and erase") {
+        REQUIRE(cache.insert(1, 0, make_frame(0)));
+        REQUIRE(cache.insert(1, 0, make_frame(0)));
+        REQUIRE(cache.insert(2, 0, make_frame(0)));
+        REQUIRE(cache.stats().frames == 2);
+        cache.erase(1);
+        video_frame_t found{};
+        REQUIRE_FALSE(cache.find(1, 0, found));
+        REQUIRE(cache.find(2, 0, found));
+        cache.clear();
+        REQUIRE(cache.stats().bytes == 0);
+        REQUIRE(cache.stats().gops == 0);
+    }
+}
+
+TEST_CASE("frame_cache_transform_t", "[frame_cache]") {
+    auto cache = std::make_shared<frame_cache_t>(1 << 20);
+    auto transform = std::make_shared<frame_cache_transform_t>(cache, 7);
+    REQUIRE(transform->set_input_format(format) == transform_result_t::ok);
+    REQUIRE(transform->set_output_format(format) == transform_result_t::ok);
+    video_transform_driver_t driver{transform, "frame_cache_transform_t"};
+    size_t count = 0;
+    const video_transform_driver_t::emit_t emit = [&count](const video_frame_t&) {
+        ++count;
+        return transform_result_t::ok;
+    };
+    for (int64_t i = 0; i < 6; ++i)
+        REQUIRE(driver.process(make_frame(i), emit) == transform_result_t::ok);
+    // a seek. the first output is not a keyframe
+    driver.flush(9000);
+    for (int64_t i = 9; i < 11; ++i)
+        REQUIRE(driver.process(make_frame(i), emit) == transform_result_t::ok);
+    REQUIRE(driver.drain(emit) == transform_result_t::ok);
+    REQUIRE(count == 8);
+    const auto stats = cache->stats();
+    REQUIRE(stats.frames == 8);
+    REQUIRE(stats.gops == 3); // 0, 4000, 9000
+    video_frame_t found{};
+    REQUIRE(cache->find(7, 10000, found));
+}
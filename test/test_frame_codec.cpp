@@ -0,0 +1,202 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+#include "frame_codec.hpp"
+#include "test_frames.hpp"
+
+namespace {
+
+/// @brief Smooth gradients with a little noise. Like the natural video, but deterministic
+video_frame_t make_frame(const video_format_t& format) {
+    video_frame_t frame = allocate_frame(format);
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < get_plane_count(format.pixel); ++i) {
+        const plane_extent_t extent = get_plane_extent(format, i);
+        for (uint32_t y = 0; y < extent.rows; ++y) {
+            uint8_t* row = frame.planes[i].data + static_cast<size_t>(y) * frame.planes[i].stride;
+            for (uint32_t x = 0; x < extent.row_bytes; ++x) {
+                seed = seed * 1664525 + 1013904223;
+                row[x] = static_cast<uint8_t>(x / 2 + y + (seed >> 30));
+            }
+        }
+    }
+    frame.timestamp = 3000;
+    frame.duration = 333;
+    frame.flags = frame_flag_keyframe;
+    return frame;
+}
+
+} // namespace
+
+TEST_CASE("compress_frame", "[frame_codec]") {
+    SECTION("round trip") {
+        const auto pixel = GENERATE(pixel_format_t::i420, pixel_format_t::nv12, pixel_format_t::rgb32);
+        const auto tile_size = GENERATE(16u, 64u);
+        const video_format_t format{pixel, 133, 71};
+        const video_frame_t frame = make_frame(format);
+        const compressed_frame_t compressed = compress_frame(frame, tile_size);
+        REQUIRE(compressed.tiles_x == (133 + tile_size - 1) / tile_size);
+        REQUIRE(compressed.tiles_y == (71 + tile_size - 1) / tile_size);
+        REQUIRE(compressed.size_bytes() < frame.size_bytes());
+        video_frame_t output = allocate_frame(format);
+        decompress_frame(compressed, output);
+        REQUIRE(same_pixels(frame, output));
+        REQUIRE(output.timestamp == frame.timestamp);
+        REQUIRE(output.duration == frame.duration);
+        REQUIRE(output.flags == frame.flags);
+    }
+    SECTION("random pixels") {
+        const video_format_t format{pixel_format_t::i420, 64, 32};
+        const video_frame_t frame = make_noise_frame(format, 7);
+        const compressed_frame_t compressed = compress_frame(frame);
+        video_frame_t output = allocate_frame(format);
+        decompress_frame(compressed, output);
+        REQUIRE(same_pixels(frame, output));
+    }
+    SECTION("stable format") {
+        // the bytes of the scalar and the SIMD paths are same. FNV-1a of the `serialize` output
+        const auto [pixel, size, hash] = GENERATE(table<pixel_format_t, size_t, uint64_t>({
+            {pixel_format_t::i420, 8902, 0xee3d6f3f4cd7e870},
+            {pixel_format_t::nv12, 8530, 0xac12ff29bba2a775},
+            {pixel_format_t::rgb32, 19781, 0xa4b555315de839ef},
+        }));
+        video_frame_t frame = make_frame({pixel, 133, 71});
+        uint32_t seed = 7; // wide groups in the corner
+        for (uint32_t y = 0; y < 20; ++y)
+            for (uint32_t x = 0; x < 60; ++x)
+                frame.planes[0].data[y * frame.planes[0].stride + x] = next_random(seed);
+        const std::vector<uint8_t> bytes = serialize(compress_frame(frame, 32));
+        uint64_t value = 14695981039346656037u;
+        for (uint8_t b : bytes)
+            value = (value ^ b) * 1099511628211u;
+        REQUIRE(bytes.size() == size);
+        REQUIRE(value == hash);
+    }
+    SECTION("flat frame") {
+        const video_format_t format{pixel_format_t::nv12, 256, 144};
+        video_frame_t frame = allocate_frame(format);
+        std::memset(frame.planes[0].data, 16, static_cast<size_t>(frame.planes[0].stride) * 144);
+        std::memset(frame.planes[1].data, 128, static_cast<size_t>(frame.planes[1].stride) * 72);
+        const compressed_frame_t compressed = compress_frame(frame);
+        REQUIRE(compressed.size_bytes() * 20 < frame.size_bytes());
+        video_frame_t output = allocate_frame(format);
+        decompress_frame(compressed, output);
+        REQUIRE(same_pixels(frame, output));
+    }
+    SECTION("gradient ratio") {
+        const video_format_t format{pixel_format_t::i420, 320, 240};
+        const video_frame_t frame = make_frame(format);
+        const compressed_frame_t compressed = compress_frame(frame);
+        REQUIRE(compressed.size_bytes() * 2 < frame.size_bytes());
+    }
+    SECTION("unsupported") {
+        video_frame_t frame = make_frame({pixel_format_t::i420, 32, 32});
+        REQUIRE_THROWS_AS(compress_frame(frame, 24), std::invalid_argument);
+        REQUIRE_THROWS_AS(compress_frame(frame, 0), std::invalid_argument);
+        REQUIRE_THROWS_AS(compress_frame(video_frame_t{}), std::invalid_argument);
+    }
+}
+
+TEST_CASE("decompress_tile", "[frame_codec]") {
+    const video_format_t format{pixel_format_t::i420, 100, 50};
+    const video_frame_t frame = make_frame(format);
+    const compressed_frame_t compressed = compress_frame(frame, 32);
+    REQUIRE(compressed.tiles_x == 4);
+    REQUIRE(compressed.tiles_y == 2);
+
+    SECTION("other tiles are not touched") {
+        video_frame_t output = allocate_frame(format);
+        for (uint32_t i = 0; i < 3; ++i)
+            std::memset(output.planes[i].data, 0xEE,
+                        static_cast<size_t>(output.planes[i].stride) * get_plane_extent(format, i).rows);
+        decompress_tile(compressed, 3, 1, output); // the last one. 4x18 pixels
+        for (uint32_t y = 0; y < 50; ++y) {
+            for (uint32_t x = 0; x < 100; ++x) {
+                const uint8_t value = output.planes[0].data[y * output.planes[0].stride + x];
+                if (x >= 96 && y >= 32)
+                    REQUIRE(value == frame.planes[0].data[y * frame.planes[0].stride + x]);
+                else
+                    REQUIRE(value == 0xEE);
+            }
+        }
+        const uint8_t u = output.planes[1].data[16 * output.planes[1].stride + 48];
+        REQUIRE(u == frame.planes[1].data[16 * frame.planes[1].stride + 48]);
+    }
+    SECTION("all tiles") {
+        video_frame_t output = allocate_frame(format);
+        for (uint32_t y = 0; y < compressed.tiles_y; ++y)
+            for (uint32_t x = 0; x < compressed.tiles_x; ++x)
+                decompress_tile(compressed, x, y, output);
+        REQUIRE(same_pixels(frame, output));
+    }
+    SECTION("out of range") {
+        video_frame_t output = allocate_frame(format);
+        REQUIRE_THROWS_AS(decompress_tile(compressed, 4, 0, output), std::invalid_argument);
+        video_frame_t other = allocate_frame({pixel_format_t::nv12, 100, 50});
+        REQUIRE_THROWS_AS(decompress_tile(compressed, 0, 0, other), std::invalid_argument);
+    }
+}
+
+TEST_CASE("serialize compressed_frame_t", "[frame_codec]") {
+    const video_format_t format{pixel_format_t::argb32, 48, 40, 30, 1};
+    const video_frame_t frame = make_frame(format);
+    const compressed_frame_t compressed = compress_frame(frame, 32);
+    const std::vector<uint8_t> bytes = serialize(compressed);
+
+    SECTION("round trip") {
+        const compressed_frame_t loaded = deserialize(bytes.data(), bytes.size());
+        REQUIRE(loaded.format == format);
+        REQUIRE(loaded.timestamp == compressed.timestamp);
+        REQUIRE(loaded.offsets == compressed.offsets);
+        REQUIRE(loaded.data == compressed.data);
+        video_frame_t output = allocate_frame(format);
+        decompress_frame(loaded, output);
+        REQUIRE(same_pixels(frame, output));
+    }
+    SECTION("truncated") {
+        REQUIRE_THROWS_AS(deserialize(bytes.data(), bytes.size() - 1), std::invalid_argument);
+        REQUIRE_THROWS_AS(deserialize(bytes.data(), 3), std::invalid_argument);
+    }
+    SECTION("broken data") {
+        compressed_frame_t broken = compressed;
+        broken.data[broken.offsets[1] - 1] ^= 0xFF; // the last plane of the first tile
+        broken.data[0] = 0x99;                       // the widths can't be more than 8
+        video_frame_t output = allocate_frame(format);
+        REQUIRE_THROWS_AS(decompress_frame(broken, output), std::invalid_argument);
+        std::vector<uint8_t> changed = bytes;
+        changed[0] = 'x';
+        REQUIRE_THROWS_AS(deserialize(changed.data(), changed.size()), std::invalid_argument);
+    }
+}
+
+/// @note Not in the default run. Run `[benchmark]` with an optimized build
+TEST_CASE("compress_frame speed", "[.][benchmark][frame_codec]") {
+    const video_format_t format{pixel_format_t::nv12, 1920, 1080};
+    const bool noisy = GENERATE(true, false);
+    video_frame_t frame = make_frame(format);
+    if (noisy == false)
+        for (uint32_t i = 0; i < 2; ++i)
+            for (uint32_t y = 0; y < get_plane_extent(format, i).rows; ++y)
+                for (uint32_t x = 0; x < get_plane_extent(format, i).row_bytes; ++x)
+                    frame.planes[i].data[y * frame.planes[i].stride + x] = static_cast<uint8_t>(x / 8 + y / 4);
+    video_frame_t output = allocate_frame(format);
+    constexpr size_t repeat = 50;
+    compressed_frame_t compressed{};
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat; ++i)
+        compressed = compress_frame(frame);
+    const auto t1 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat; ++i)
+        decompress_frame(compressed, output);
+    const auto t2 = std::chrono::steady_clock::now();
+    REQUIRE(same_pixels(frame, output));
+    const double bytes = static_cast<double>(frame.size_bytes()) * repeat;
+    const double compress_rate = bytes / std::chrono::duration<double, std::nano>(t1 - t0).count();
+    const double decompress_rate = bytes / std::chrono::duration<double, std::nano>(t2 - t1).count();
+    spdlog::info("compress_frame: {}, {:.2f} GB/s, {:.2f} GB/s, {:.1f}x", noisy ? "noisy" : "gradient", compress_rate,
+                 decompress_rate, static_cast<double>(frame.size_bytes()) / compressed.size_bytes());
+}
@@ -0,0 +1,32 @@
+#include "test_frames.hpp"
+
+#include <cstring>
+
+uint8_t next_random(uint32_t& seed) noexcept {
+    return static_cast<uint8_t>((seed = seed * 1664525 + 1013904223) >> 24);
+}
+
+video_frame_t make_noise_frame(const video_format_t& format, uint32_t seed) noexcept(false) {
+    video_frame_t frame = allocate_frame(format);
+    for (uint32_t i = 0; i < get_plane_count(format.pixel); ++i) {
+        const plane_extent_t extent = get_plane_extent(format, i);
+        for (uint32_t y = 0; y < extent.rows; ++y)
+            for (uint32_t x = 0; x < extent.row_bytes; ++x)
+                frame.planes[i].data[static_cast<size_t>(y) * frame.planes[i].stride + x] = next_random(seed);
+    }
+    return frame;
+}
+
+bool same_pixels(const video_frame_t& lhs, const video_frame_t& rhs) noexcept {
+    if (lhs.format.same_layout(rhs.format) == false)
+        return false;
+    for (uint32_t i = 0; i < get_plane_count(lhs.format.pixel); ++i) {
+        const plane_extent_t extent = get_plane_extent(lhs.format, i);
+        for (uint32_t y = 0; y < extent.rows; ++y)
+            if (std::memcmp(lhs.planes[i].data + static_cast<size_t>(y) * lhs.planes[i].stride,
+                            rhs.planes[i].data + static_cast<size_t>(y) * rhs.planes[i].stride,
+                            extent.row_bytes) != 0)
+                return false;
+    }
+    return true;
+}
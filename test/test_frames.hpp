@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+
+#include "video_frame.hpp"
+
+/// @brief The next byte of the LCG noise of the tests
+uint8_t next_random(uint32_t& seed) noexcept;
+
+/// @brief Allocate a frame and fill all planes with the noise of the `seed`. Same `seed`, same pixels
+video_frame_t make_noise_frame(const video_format_t& format, uint32_t seed) noexcept(false);
+
+/// @brief Same layout and same bytes in the rows of all planes. The padding after the rows is not compared
+bool same_pixels(const video_frame_t& lhs, const video_frame_t& rhs) noexcept;
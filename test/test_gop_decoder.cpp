@@ -0,0 +1,179 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "gop_decoder.hpp"
+
+namespace {
+
+/**
+ * @brief Stands in for a decoder. Reorders the outputs with a small delay like the streams with B-frames.
+ *        Fails if a segment doesn't start with a keyframe, which means the split was wrong
+ */
+class fake_decoder_t final : public video_transform_t {
+    video_format_t input_format{pixel_format_t::h264, 32, 16, 30, 1};
+    video_format_t output_format{pixel_format_t::nv12, 32, 16, 30, 1};
+    frame_pool_t pool{output_format};
+    std::vector<int64_t> pending{}; // timestamps of the inputs
+    bool started = false;
+
+  public:
+    transform_result_t set_input_format(const video_format_t&) noexcept override {
+        return transform_result_t::ok;
+    }
+    transform_result_t set_output_format(const video_format_t&) noexcept override {
+        return transform_result_t::ok;
+    }
+    video_format_t get_input_format() const noexcept override {
+        return input_format;
+    }
+    video_format_t get_output_format() const noexcept override {
+        return output_format;
+    }
+
+    transform_result_t process_input(const video_frame_t& input) noexcept override {
+        if (started == false && input.keyframe() == false)
+            return transform_result_t::failed;
+        started = true;
+        if (pending.size() > 2)
+            return transform_result_t::not_accepting;
+        // the workers should finish out of order
+        std::this_thread::sleep_for(std::chrono::microseconds{(input.timestamp / 10) % 3 * 200});
+        pending.emplace_back(input.timestamp);
+        return transform_result_t::ok;
+    }
+
+    transform_result_t process_output(video_frame_t& output) noexcept override {
+        if (pending.empty() || (started && pending.size() < 3))
+            return transform_result_t::need_more_input;
+        auto it = std::min_element(pending.begin(), pending.end());
+        output = pool.acquire();
+        output.timestamp = *it;
+        pending.erase(it);
+        return transform_result_t::ok;
+    }
+
+    void drain() noexcept override {
+        started = false; // release all. the next segment starts with a keyframe
+    }
+    void flush() noexcept override {
+        pending.clear();
+    }
+};
+
+/// @brief Decode order of the GOPs `I P B B P B B ...`. The timestamps are in frames * 10
+std::vector<video_frame_t> make_stream(size_t num_gops, size_t gop_length) {
+    std::vector<video_frame_t> frames{};
+    int64_t base = 0;
+    for (size_t g = 0; g < num_gops; ++g) {
+        std::vector<int64_t> order{0};
+        for (size_t i = 1; i + 2 < gop_length; i += 3) {
+            order.emplace_back(i + 2);
+            order.emplace_back(i);
+            order.emplace_back(i + 1);
+        }
+        while (order.size() < gop_length)
+            order.emplace_back(order.size());
+        for (int64_t index : order) {
+            video_frame_t frame{};
+            frame.format = {pixel_format_t::h264, 32, 16, 30, 1};
+            frame.timestamp = (base + index) * 10;
+            frame.flags = index == 0 ? frame_flag_keyframe : 0u;
+            frames.emplace_back(frame);
+        }
+        base += static_cast<int64_t>(gop_length);
+    }
+    return frames;
+}
+
+} // namespace
+
+TEST_CASE("gop_decoder_t", "[gop_decoder]") {
+    std::atomic<size_t> num_decoders{0};
+    const gop_decoder_t::factory_t factory = [&num_decoders]() {
+        ++num_decoders;
+        return std::make_shared<fake_decoder_t>();
+    };
+
+    SECTION("presentation order") {
+        const auto frames = make_stream(12, 10);
+        gop_decoder_t decoder{factory, 4, 3};
+        std::vector<int64_t> timestamps{};
+        REQUIRE(decoder.start([&timestamps](const video_frame_t& frame) {
+            timestamps.emplace_back(frame.timestamp);
+            return transform_result_t::ok;
+        }) == transform_result_t::ok);
+        for (const auto& frame : frames)
+            REQUIRE(decoder.push(frame));
+        REQUIRE(decoder.finish() == transform_result_t::ok);
+        REQUIRE(num_decoders == 4);
+        REQUIRE(decoder.segment_count() == 12);
+        REQUIRE(decoder.output_count() == frames.size());
+        REQUIRE(timestamps.size() == frames.size());
+        for (size_t i = 0; i < timestamps.size(); ++i)
+            REQUIRE(timestamps[i] == static_cast<int64_t>(i * 10));
+    }
+
+    SECTION("window") {
+        const auto frames = make_stream(16, 4);
+        std::mutex mtx{};
+        std::set<int64_t> seen{};
+        gop_decoder_t decoder{factory, 3, 2};
+        REQUIRE(decoder.start([&](const video_frame_t& frame) {
+            std::lock_guard lck{mtx};
+            seen.emplace(frame.timestamp);
+            return transform_result_t::ok;
+        }) == transform_result_t::ok);
+        for (size_t i = 0; i < frames.size(); ++i) {
+            REQUIRE(decoder.push(frames[i]));
+            // the producer can't be more than `window` segments ahead of the sink
+            const auto segment = static_cast<int64_t>(decoder.segment_count());
+            std::lock_guard lck{mtx};
+            REQUIRE(static_cast<int64_t>(seen.size()) >= (segment - 2) * 4);
+        }
+        REQUIRE(decoder.finish() == transform_result_t::ok);
+        REQUIRE(seen.size() == frames.size());
+    }
+
+    SECTION("min inputs") {
+        const auto frames = make_stream(12, 1); // intra-only
+        gop_decoder_t decoder{factory, 2, 0, 4};
+        REQUIRE(decoder.start(nullptr) == transform_result_t::ok);
+        for (const auto& frame : frames)
+            REQUIRE(decoder.push(frame));
+        REQUIRE(decoder.finish() == transform_result_t::ok);
+        REQUIRE(decoder.segment_count() == 3);
+        REQUIRE(decoder.output_count() == 12);
+    }
+
+    SECTION("split without keyframe fails") {
+        auto frames = make_stream(4, 6);
+        frames.erase(frames.begin()); // the first segment starts with a P-frame
+        gop_decoder_t decoder{factory, 2};
+        REQUIRE(decoder.start(nullptr) == transform_result_t::ok);
+        for (const auto& frame : frames)
+            if (decoder.push(frame) == false)
+                break;
+        REQUIRE(decoder.finish() == transform_result_t::failed);
+    }
+
+    SECTION("sink failure stops the workers") {
+        const auto frames = make_stream(20, 5);
+        gop_decoder_t decoder{factory, 2, 2};
+        size_t count = 0;
+        REQUIRE(decoder.start([&count](const video_frame_t&) {
+            return ++count < 7 ? transform_result_t::ok : transform_result_t::aborted;
+        }) == transform_result_t::ok);
+        bool accepted = true;
+        for (const auto& frame : frames)
+            if (accepted = decoder.push(frame); accepted == false)
+                break;
+        REQUIRE(accepted == false);
+        REQUIRE(decoder.finish() == transform_result_t::aborted);
+        REQUIRE(count == 7);
+    }
+}
@@ -0,0 +1,397 @@
+#include <catch2/catch.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "h264.hpp"
+
+namespace {
+
+std::vector<uint8_t> from_hex(const std::string& text) {
+    std::vector<uint8_t> bytes{};
+    for (size_t i = 0; i + 1 < text.size(); i += 2)
+        bytes.emplace_back(static_cast<uint8_t>(std::stoul(text.substr(i, 2), nullptr, 16)));
+    return bytes;
+}
+
+/// @brief avcC of assets/test-sample-0.mp4. Main profile, 1280x720
+const std::string sample_avcc = "014d001fffe10024274d001f97602802dd80a240000003004000000f3a100078880001e22def7be0ed0e"
+                                "189c01000528eebc8000";
+
+/// @brief Writes the syntax elements for the generated parameter sets
+class bit_writer_t final {
+    std::vector<uint8_t> bytes{};
+    uint32_t bits = 0;
+
+  public:
+    void put(uint32_t value, uint32_t count) {
+        for (uint32_t i = count; i > 0; --i) {
+            if (bits % 8 == 0)
+                bytes.emplace_back(0);
+            bytes.back() |= ((value >> (i - 1)) & 1) << (7 - bits % 8);
+            ++bits;
+        }
+    }
+    void ue(uint32_t value) {
+        const uint64_t code = uint64_t{value} + 1;
+        uint32_t length = 0;
+        while ((code >> length) > 1)
+            ++length;
+        put(0, length);
+        put(static_cast<uint32_t>(code), length + 1);
+    }
+    void se(int32_t value) {
+        ue(value > 0 ? 2 * value - 1 : -2 * value);
+    }
+    /// @brief rbsp_trailing_bits and the emulation prevention
+    std::vector<uint8_t> finish(uint8_t header) {
+        put(1, 1);
+        while (bits % 8)
+            put(0, 1);
+        std::vector<uint8_t> nal{header};
+        size_t zeros = 0;
+        for (uint8_t value : bytes) {
+            if (zeros >= 2 && value <= 3) {
+                nal.emplace_back(3);
+                zeros = 0;
+            }
+            zeros = value == 0 ? zeros + 1 : 0;
+            nal.emplace_back(value);
+        }
+        return nal;
+    }
+};
+
+/// @brief High profile 1920x1080 with the cropping, 29.97 fps and the bitstream restriction
+std::vector<uint8_t> make_sps(uint32_t max_num_reorder_frames) {
+    bit_writer_t writer{};
+    writer.put(100, 8); // profile_idc
+    writer.put(0, 8);
+    writer.put(40, 8); // level_idc
+    writer.ue(0);      // sps_id
+    writer.ue(1);      // chroma_format_idc
+    writer.ue(0);      // bit_depth_luma_minus8
+    writer.ue(0);
+    writer.put(0, 1); // qpprime_y_zero_transform_bypass_flag
+    writer.put(1, 1); // seq_scaling_matrix_present_flag
+    for (uint32_t i = 0; i < 8; ++i) {
+        writer.put(i == 0, 1); // only the first list
+        if (i == 0)
+            for (int32_t delta : {0, 0, 0, -8}) // nextScale becomes 0. the rest is not coded
+                writer.se(delta);
+    }
+    writer.ue(0); // log2_max_frame_num_minus4
+    writer.ue(1); // pic_order_cnt_type
+    writer.put(0, 1);
+    writer.se(-2);
+    writer.se(0);
+    writer.ue(2);
+    writer.se(4);
+    writer.se(-4);
+    writer.ue(4);     // max_num_ref_frames
+    writer.put(0, 1); // gaps_in_frame_num_value_allowed_flag
+    writer.ue(119);   // pic_width_in_mbs_minus1
+    writer.ue(67);    // pic_height_in_map_units_minus1
+    writer.put(1, 1); // frame_mbs_only_flag
+    writer.put(1, 1); // direct_8x8_inference_flag
+    writer.put(1, 1); // frame_cropping_flag
+    writer.ue(0);
+    writer.ue(0);
+    writer.ue(0);
+    writer.ue(4);     // 8 lines
+    writer.put(1, 1); // vui_parameters_present_flag
+    writer.put(1, 1); // aspect_ratio_info_present_flag
+    writer.put(255, 8);
+    writer.put(4, 16);
+    writer.put(3, 16);
+    writer.put(0, 1); // overscan_info_present_flag
+    writer.put(1, 1); // video_signal_type_present_flag
+    writer.put(5, 3);
+    writer.put(1, 1); // video_full_range_flag
+    writer.put(1, 1);
+    writer.put(1, 8);
+    writer.put(1, 8);
+    writer.put(1, 8);
+    writer.put(0, 1); // chroma_loc_info_present_flag
+    writer.put(1, 1); // timing_info_present_flag
+    writer.put(1001, 32);
+    writer.put(60000, 32);
+    writer.put(1, 1);
+    writer.put(1, 1); // nal_hrd_parameters_present_flag
+    writer.ue(0);     // cpb_cnt_minus1
+    writer.put(0, 4);
+    writer.put(0, 4);
+    writer.ue(1000);
+    writer.ue(1000);
+    writer.put(0, 1);
+    writer.put(23, 5);
+    writer.put(23, 5);
+    writer.put(23, 5);
+    writer.put(24, 5);
+    writer.put(0, 1); // vcl_hrd_parameters_present_flag
+    writer.put(0, 1); // low_delay_hrd_flag
+    writer.put(0, 1); // pic_struct_present_flag
+    writer.put(1, 1); // bitstream_restriction_flag
+    writer.put(1, 1);
+    writer.ue(2);
+    writer.ue(1);
+    writer.ue(16);
+    writer.ue(16);
+    writer.ue(max_num_reorder_frames);
+    writer.ue(4);
+    return writer.finish(0x67);
+}
+
+/// @brief With the slice groups and the High profile extension
+std::vector<uint8_t> make_pps() {
+    bit_writer_t writer{};
+    writer.ue(3); // pps_id
+    writer.ue(0);
+    writer.put(1, 1); // entropy_coding_mode_flag
+    writer.put(0, 1);
+    writer.ue(1); // num_slice_groups_minus1
+    writer.ue(6); // slice_group_map_type
+    writer.ue(9); // pic_size_in_map_units_minus1
+    writer.put(0b1010101010, 10);
+    writer.ue(2);
+    writer.ue(0);
+    writer.put(1, 1);
+    writer.put(2, 2);
+    writer.se(-3); // pic_init_qp_minus26
+    writer.se(0);
+    writer.se(-2); // chroma_qp_index_offset
+    writer.put(1, 1);
+    writer.put(0, 1);
+    writer.put(0, 1);
+    writer.put(1, 1); // transform_8x8_mode_flag
+    writer.put(0, 1); // pic_scaling_matrix_present_flag
+    writer.se(1);     // second_chroma_qp_index_offset
+    return writer.finish(0x68);
+}
+
+const uint8_t* find_start_code_scalar(const uint8_t* begin, const uint8_t* end) {
+    for (const uint8_t* p = begin; end - p >= 3; ++p)
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+            return p;
+    return end;
+}
+
+void append(std::vector<uint8_t>& stream, uint8_t header, size_t size, uint8_t fill = 0x80) {
+    stream.insert(stream.end(), {0, 0, 0, 1, header});
+    stream.insert(stream.end(), size, fill);
+}
+
+} // namespace
+
+TEST_CASE("find_start_code", "[h264]") {
+    SECTION("block boundaries") {
+        for (size_t position = 0; position < 64; ++position) {
+            std::vector<uint8_t> bytes(67, 0xFF);
+            bytes[position] = bytes[position + 1] = 0;
+            bytes[position + 2] = 1;
+            REQUIRE(find_start_code(bytes.data(), bytes.data() + bytes.size()) == bytes.data() + position);
+        }
+    }
+    SECTION("same as scalar") {
+        std::mt19937 random{7};
+        std::vector<uint8_t> bytes(4096);
+        for (auto& value : bytes)
+            value = random() % 4 ? static_cast<uint8_t>(random()) : 0; // many zeros
+        const uint8_t* end = bytes.data() + bytes.size();
+        for (const uint8_t* p = bytes.data(); p != end;) {
+            const uint8_t* expected = find_start_code_scalar(p, end);
+            REQUIRE(find_start_code(p, end) == expected);
+            p = expected == end ? end : expected + 1;
+        }
+    }
+    SECTION("not found") {
+        const std::vector<uint8_t> bytes(100, 0);
+        REQUIRE(find_start_code(bytes.data(), bytes.data() + bytes.size()) == bytes.data() + bytes.size());
+        REQUIRE(find_start_code(bytes.data(), bytes.data() + 2) == bytes.data() + 2);
+    }
+}
+
+TEST_CASE("AVCC and Annex B", "[h264]") {
+    std::vector<uint8_t> annexb{};
+    append(annexb, 0x67, 10);
+    append(annexb, 0x68, 3);
+    append(annexb, 0x65, 300);
+    annexb.insert(annexb.begin(), 0); // zero_byte before the first start code
+
+    std::vector<h264_nal_t> nals{};
+    split_annexb(annexb.data(), annexb.size(), nals);
+    REQUIRE(nals.size() == 3);
+    REQUIRE(nals[0].type() == h264_nal_type_t::sps);
+    REQUIRE(nals[1].size == 4);
+    REQUIRE(nals[2].type() == h264_nal_type_t::idr);
+    REQUIRE(nals[2].is_vcl());
+    REQUIRE(nals[2].ref_idc() == 3);
+
+    std::vector<uint8_t> avcc{};
+    annexb_to_avcc(annexb.data(), annexb.size(), avcc);
+    REQUIRE(avcc.size() == annexb.size() - 1);
+    REQUIRE(split_avcc(avcc.data(), avcc.size(), 4, nals));
+    REQUIRE(nals.size() == 3);
+    REQUIRE(nals[2].size == 301);
+
+    SECTION("in place") {
+        REQUIRE(avcc_to_annexb(avcc.data(), avcc.size()));
+        REQUIRE(std::equal(avcc.begin(), avcc.end(), annexb.begin() + 1));
+    }
+    SECTION("2 byte lengths") {
+        std::vector<uint8_t> short_avcc{0, 2, 0x09, 0xF0, 0, 3, 0x41, 0x9A, 0x00};
+        std::vector<uint8_t> out{};
+        REQUIRE(avcc_to_annexb(short_avcc.data(), short_avcc.size(), 2, out));
+        REQUIRE(out == std::vector<uint8_t>{0, 0, 0, 1, 0x09, 0xF0, 0, 0, 0, 1, 0x41, 0x9A, 0x00});
+    }
+    SECTION("truncated") {
+        avcc[3] += 1;
+        REQUIRE_FALSE(split_avcc(avcc.data(), avcc.size(), 4, nals));
+        REQUIRE_FALSE(avcc_to_annexb(avcc.data(), avcc.size()));
+        REQUIRE_FALSE(split_avcc(avcc.data(), avcc.size(), 3, nals));
+    }
+}
+
+TEST_CASE("unescape_rbsp", "[h264]") {
+    const std::vector<uint8_t> escaped{0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03};
+    std::vector<uint8_t> rbsp{};
+    unescape_rbsp(escaped.data(), escaped.size(), rbsp);
+    REQUIRE(rbsp == std::vector<uint8_t>{0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00});
+}
+
+TEST_CASE("bit_reader_t", "[h264]") {
+    // 1 | 010 | 011 | 00100 | 00101 | 1 (stop bit) -> ue 0, 1, 2, 3 and se -2
+    const uint8_t bytes[]{0b10100110, 0b01000010, 0b11000000};
+    bit_reader_t reader{bytes, sizeof(bytes)};
+    REQUIRE(reader.read_ue() == 0);
+    REQUIRE(reader.read_ue() == 1);
+    REQUIRE(reader.read_ue() == 2);
+    REQUIRE(reader.read_ue() == 3);
+    REQUIRE(reader.more_rbsp_data());
+    REQUIRE(reader.read_se() == -2);
+    REQUIRE_FALSE(reader.more_rbsp_data());
+    REQUIRE_FALSE(reader.failed());
+    reader.skip_bits(7);
+    REQUIRE(reader.read_bit() == 0);
+    REQUIRE(reader.failed());
+}
+
+TEST_CASE("parse_sps", "[h264]") {
+    SECTION("sample") {
+        const auto bytes = from_hex(sample_avcc);
+        h264_avcc_config_t config{};
+        REQUIRE(parse_avcc_config(bytes.data(), bytes.size(), config));
+        REQUIRE(config.profile_idc == 77);
+        REQUIRE(config.level_idc == 31);
+        REQUIRE(config.length_size == 4);
+        REQUIRE(config.sps.size() == 1);
+        REQUIRE(config.pps.size() == 1);
+        REQUIRE(config.sps[0].size() == 36);
+
+        h264_sps_t sps{};
+        REQUIRE(parse_sps(config.sps[0].data(), config.sps[0].size(), sps));
+        REQUIRE(sps.profile_idc == 77);
+        REQUIRE(sps.width() == 1280);
+        REQUIRE(sps.height() == 720);
+        REQUIRE(sps.chroma_format_idc == 1);
+        REQUIRE(sps.frame_mbs_only);
+        REQUIRE(sps.vui_present);
+
+        h264_pps_t pps{};
+        REQUIRE(parse_pps(config.pps[0].data(), config.pps[0].size(), pps));
+        REQUIRE(pps.pps_id == 0);
+        REQUIRE(pps.sps_id == 0);
+        REQUIRE(pps.entropy_coding_mode);
+
+        const auto annexb = to_annexb(config);
+        REQUIRE(annexb.size() == 4 + 36 + 4 + 5);
+        h264_sps_t probed{};
+        REQUIRE(probe_h264(annexb.data(), annexb.size(), probed));
+        REQUIRE(probed.width() == 1280);
+        REQUIRE(probe_h264(bytes.data(), bytes.size(), probed));
+        REQUIRE(probed.height() == 720);
+    }
+    SECTION("generated") {
+        const auto nal = make_sps(2);
+        h264_sps_t sps{};
+        REQUIRE(parse_sps(nal.data(), nal.size(), sps));
+        REQUIRE(sps.profile_idc == 100);
+        REQUIRE(sps.scaling_matrix_present);
+        REQUIRE(sps.pic_order_cnt_type == 1);
+        REQUIRE(sps.num_ref_frames_in_poc_cycle == 2);
+        REQUIRE(sps.offset_for_non_ref_pic == -2);
+        REQUIRE(sps.offset_for_ref_frame[1] == -4);
+        REQUIRE(sps.width() == 1920);
+        REQUIRE(sps.height() == 1080);
+        REQUIRE(sps.sar_width == 4);
+        REQUIRE(sps.sar_height == 3);
+        REQUIRE(sps.full_range);
+        REQUIRE(sps.matrix_coefficients == 1);
+        REQUIRE(sps.reorder_depth() == 2);
+        const auto format = sps.to_format();
+        REQUIRE(format.pixel == pixel_format_t::h264);
+        REQUIRE(format.fps_num == 30000);
+        REQUIRE(format.fps_den == 1001);
+    }
+    SECTION("truncated") {
+        auto nal = make_sps(2);
+        nal.resize(nal.size() - 4);
+        h264_sps_t sps{};
+        REQUIRE_FALSE(parse_sps(nal.data(), nal.size(), sps));
+        REQUIRE_FALSE(parse_sps(nal.data(), 3, sps));
+        nal[0] = 0x68;
+        REQUIRE_FALSE(parse_sps(nal.data(), nal.size(), sps));
+    }
+}
+
+TEST_CASE("parse_pps", "[h264]") {
+    const auto nal = make_pps();
+    h264_pps_t pps{};
+    REQUIRE(parse_pps(nal.data(), nal.size(), pps));
+    REQUIRE(pps.pps_id == 3);
+    REQUIRE(pps.num_slice_groups == 2);
+    REQUIRE(pps.num_ref_idx_l0_default_active == 3);
+    REQUIRE(pps.weighted_pred);
+    REQUIRE(pps.weighted_bipred_idc == 2);
+    REQUIRE(pps.pic_init_qp == 23);
+    REQUIRE(pps.chroma_qp_index_offset == -2);
+    REQUIRE(pps.transform_8x8_mode);
+    REQUIRE(pps.second_chroma_qp_index_offset == 1);
+}
+
+TEST_CASE("h264_stream_parser_t", "[h264]") {
+    // SPS PPS IDR(2 slices) | P | AUD P | B
+    std::vector<uint8_t> stream{};
+    const auto sps = make_sps(1);
+    stream.insert(stream.end(), {0, 0, 0, 1});
+    stream.insert(stream.end(), sps.begin(), sps.end());
+    append(stream, 0x68, 4);
+    append(stream, 0x65, 100, 0x88); // first_mb_in_slice 0
+    append(stream, 0x65, 100, 0x40); // first_mb_in_slice 1
+    append(stream, 0x41, 50, 0x88);
+    append(stream, 0x09, 1, 0xF0);
+    append(stream, 0x41, 50, 0x88);
+    append(stream, 0x01, 20, 0x88);
+
+    for (size_t piece : {size_t{1}, size_t{7}, size_t{64}, stream.size()}) {
+        h264_stream_parser_t parser{};
+        std::vector<video_frame_t> frames{};
+        for (size_t offset = 0; offset < stream.size(); offset += piece)
+            parser.push(stream.data() + offset, std::min(piece, stream.size() - offset), frames);
+        REQUIRE(frames.size() == 2); // the last NAL unit may continue. the access unit before it waits
+        parser.flush(frames);
+        REQUIRE(frames.size() == 4);
+
+        REQUIRE(parser.get_sps() != nullptr);
+        REQUIRE(frames[0].keyframe());
+        REQUIRE_FALSE(frames[1].keyframe());
+        REQUIRE(frames[0].format.width == 1920);
+        REQUIRE(frames[0].planes[0].stride == 4 + sps.size() + (4 + 5) + 2 * (4 + 101));
+        REQUIRE(frames[1].planes[0].stride == 4 + 51);
+        REQUIRE(frames[2].planes[0].stride == 4 + 2 + 4 + 51);
+        REQUIRE(frames[3].planes[0].data[4] == 0x01);
+        REQUIRE(frames[2].timestamp == 2 * frames[3].duration);
+        REQUIRE(frames[3].duration == int64_t{10'000'000} * 1001 / 30000);
+    }
+}
@@ -0,0 +1,552 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "h264_decoder.hpp"
+#include "h264_kernels.hpp"
+#include "video_pipeline.hpp"
+
+namespace {
+
+std::vector<uint8_t> from_hex(const std::string& text) {
+    std::vector<uint8_t> bytes{};
+    for (size_t i = 0; i + 1 < text.size(); i += 2)
+        bytes.emplace_back(static_cast<uint8_t>(std::stoul(text.substr(i, 2), nullptr, 16)));
+    return bytes;
+}
+
+/// @brief An AVCC access unit of the generated streams. The SEI are removed
+struct sample_t final {
+    int64_t timestamp = 0;
+    bool keyframe = false;
+    std::string hex{};
+};
+
+/// @brief x264, 40x24 Main profile. CABAC, 2 B frames, temporal direct, weighted prediction on a fade.
+///        IDR every 4 frames
+const std::string cabac_avcc = "014d400affe10017674d400ae99af2cb0800000300080000030190789129c001000568eae3cb20";
+const std::vector<sample_t> cabac_samples{
+    {0, 1, "000000ea65888400cf404debb75ddb64aba0d624cf632c43453fcbd04cf4b32fcbb9fd44481faa3df684405353a2e1a8edf4"
+           "01a1a3a1e00b0cd5b491f8c73112666fa7c2c016bd067a1d826963d46ba332df99e69ac54347574086a16b7b0f5f725fee64"
+           "174ef54aa97f3dfae611243be1b6da268ff60c36b99abb1fe5ffb23d597bb6a0c26b0a714635e051399c33de98e9d3eb65a8"
+           "7dcc6574eb758f58ed3ee160b42eecf525075d13df6c7b98e78c0b3a7fd98e9c6432181a6eb637a6cbf484e72728b9707bbf"
+           "c3d04968f10e372e9459a6258865daaaed7c89976bd3a075b0b86aea42263b692883ecac885d"},
+    {1024, 0, "00000088419a24c73c0cc18809003081682c8cffdfe1a8ef2545140a5e97327a12c1174e55e0e9dfa99eadf5816973ca7c78"
+              "30d6559b4ff5a65ae7fededb8cd99f0bc70a0ac1b60fdf4a73503bd40e771ff6e0bd70e68aadc7824e3c464b4b9e24d1f7b4"
+              "37a16dbd210fba46b3ae9a043c47b8c66c73d7dbc740cd3eda0d88dfad44a70dc55672fc16659d18"},
+    {512, 0, "00000047019e427210fffe9f8d5a0855f653ee22e491b4b6e06a37a1a533597b3a36dff9e255a39dd8a567deaf8394deb5e1"
+             "a8056bfff416b98c111f140e7d5ee3985f301e66b0dd8bc539"},
+    {1536, 0, "0000005d419a4693c21086431e0e8740fc170340420e86011dffccf45735f603de675954d473821cbcec3e8e4b2d672be6ed"
+              "f9e088fa245c2d82b07657b2e734cf43a3d59e200dff9aa233e0fe0be044433a776961e88f3c7e178ec0828124c380"},
+    {2048, 1, "000000bd658882002bffb0331093c120f717fd8c4fa9f4d760071c512328a0eafe3b7dbb0a4273c14982032ee5d982ccb956"
+              "7fbc5dbdace3bb432310ff0e229b15b057be74204c6cd0e5ddb0b65b0e97e82222f21a77f9ec56243efedc7638b9754c29a4"
+              "b737927a1c9a0531bb3d5866788ff0b63d55d20e0f1dc403e344f023ddb7a45fad8416bdb6edade39364b15b0a38caffb82c"
+              "12678371dc909beec791556c4a5f9e8bea5ec7a318c92e88eb41fac93e6c7f52ffbebb7ac04ddf4d375b9f"},
+    {3584, 0, "0000007e419a26d8843fd7e577aadaf593c8ad5979f1f78ca9331ea336790cc0468995bc3b2556cef1d2cf88ce8802fcbf81"
+              "847b090118adce653f874896ced14bab6400e7f9322ec11cbb9d29ac0b11cfc02a024cb3944454464c25892f9b6cc83f9b6a"
+              "8da358c9ed5435ca3655dc316ae76e2450510c267f6b20e12bbacc000ab3"},
+    {2560, 0, "00000051019e427210fff8901ed38f1c47e4495b0862103e78402901c19a850dc3175318cc30d1e6ff2721980ed1a41dfdc7"
+              "2b1b9a88c5ffa63088e19eef0dded3dd216bfd53ccd22503cf179bbca10daaa0eee8e1"},
+    {3072, 0, "0000002d019e447210fffe39d00fbec3fb50237955b0d06537341608f5cb7c8a5b6dbb0002dd4b890de9f7555fcd41a03d"},
+};
+/// @brief FNV-1a of the I420 outputs of libavcodec for `cabac_samples` in the presentation order
+constexpr uint32_t cabac_hashes[]{0x5cecfd0e, 0x584bdca1, 0x1b019eab, 0x93d9462e,
+                                  0x9e5bb201, 0xe1f9e9d3, 0xd5b1f5b1, 0x45af7be2};
+
+/// @brief FNV-1a of the I420 outputs of libavcodec for assets/test-sample-0.mp4 in the presentation order.
+///        1280x720 Main profile, 64 frames in 3 GOPs with B frames
+constexpr uint32_t asset_hashes[]{0x003783e9, 0x838651d2, 0x85f7f3c0, 0x8d7c96cd, 0x1344988e, 0x7e8a951c,
+                                   0xad3e1bea, 0x55431cf1, 0x0a60eed6, 0x94eb4169, 0x889a56b6, 0xe6d1eb03,
+                                   0xa3307090, 0x8fbb0c13, 0x5629e185, 0xbd90a544, 0xcd2c33e8, 0x6b4fbe91,
+                                   0x2b2b7c85, 0x7b756741, 0x412cbcd2, 0x47fe3131, 0x22e30d81, 0x2a815163,
+                                   0x3605e22b, 0xec5c0bde, 0x8da9786a, 0x34ff4554, 0x73530e4f, 0x723ce717,
+                                   0x29051c45, 0x8224b525, 0xa0847451, 0x9bb0e69b, 0x62b9f646, 0xb4ce47cc,
+                                   0xd7615349, 0x7458ef1a, 0xd98c5d7a, 0xa16c737e, 0x700fe0b8, 0x69198f23,
+                                   0xe09b3552, 0xc4444e27, 0xa0a2b6c8, 0x4426c06d, 0x28e6238d, 0x220ee4fc,
+                                   0xc2847c37, 0xf8b8cb83, 0xe6da5982, 0xec8fb7ff, 0xb552daf1, 0x618ac8a8,
+                                   0x87ba8681, 0xe970ce90, 0xd892a4e3, 0x020d1a58, 0x9d333fdb, 0x18d867a4,
+                                   0x83cb3bc0, 0x6195bbf8, 0x824b975e, 0x9fb85c8b};
+
+/// @brief x264, 32x32 Constrained Baseline profile. CAVLC, 2 slices for each picture
+const std::string cavlc_avcc = "0142c00affe100156742c00ada25a1000003000100000300320f1226a001000568ce0f2c80";
+const std::vector<sample_t> cavlc_samples{
+    {0, 1, "0000006865888419f823d7c55fe0e972a84aeea0db4ce46823d182be8b04097a04a903ee07b00010221002004bb62b09343a"
+           "a89f84950e98862885b1c879300f1984338c86fdd0a9c3f87e40c1b83ae603d4249685008310100f0d01002c7949f264627c"
+           "824f55d23f20ae630000006b656221067ecefa8720f9986e3dcb79690961094b25bd07a6ee20946636c184300340d0306020"
+           "ee135d8b68fc409a24f1d15b478af3dd9bc9fe87dce9958938ec459627f28f1f61dedfcbedb0ad1851e3ccd1ff06ec3b037e"
+           "1d837e1ff1a61ff0339e3fe0dd43feafc7fc18"},
+    {512, 0, "0000003a419a206797c2d126083942b54b27690ae045020b922af4e9a9d3a906b1b76bd9f1d6433439c7da6e7718031c0693"
+             "270261354d86230252d901c00000001b4166881de82c244a047525a78fb960afb49cddf260d721e0a63b80"},
+    {1024, 0, "00000027419a4077b30d1c8395c960b1405a0edb913b6e44f70ccd47470500c68cfa4f94e0b6d1cd382dc000000034416690"
+              "19e5f0d0908a152c15d8e691aafef9f5ca0fc86c7b2044a306e4fb3e5d664c6ab335fbed00409d1252c0470b9252c04940"},
+    {1536, 0, "0000002b419a6077a0924342b5aaeaa32208529355377511d990f1a1e932793199d6a30515b35279810cb359ac0878000000"
+              "254166981de8c2f0fdf71cca15bd62e04f1a2bc8ff28be321fed0bb8d2f88bee3500146b2d7e"},
+    {2048, 0, "00000017419a8021f09093c160a01c05cfa3fa7fe08b3789f1c7b0000000154166a0087c2870471f5f9d0d56ca093672f058"
+              "a179"},
+};
+constexpr uint32_t cavlc_hashes[]{0xcc4af0b7, 0x987a28ba, 0xbc8d951e, 0xf62d2589, 0xc3d984f5};
+
+/// @brief The samples as `video_frame_t`. The `bytes` must outlive the frames
+std::vector<video_frame_t> make_inputs(const std::vector<sample_t>& samples, std::vector<std::vector<uint8_t>>& bytes) {
+    std::vector<video_frame_t> inputs{};
+    for (const sample_t& sample : samples) {
+        auto& data = bytes.emplace_back(from_hex(sample.hex));
+        video_frame_t input{};
+        input.format.pixel = pixel_format_t::h264;
+        input.planes[0] = {data.data(), static_cast<uint32_t>(data.size())};
+        input.timestamp = sample.timestamp;
+        input.duration = 512;
+        input.flags = sample.keyframe ? frame_flag_keyframe : 0u;
+        inputs.emplace_back(input);
+    }
+    return inputs;
+}
+
+/// @brief FNV-1a of the planes in the I420 order. The chroma of NV12 is deinterleaved
+uint32_t hash_frame(const video_frame_t& frame) {
+    uint32_t hash = 2166136261u;
+    const auto add = [&hash](uint8_t value) { hash = (hash ^ value) * 16777619u; };
+    const uint32_t width = frame.format.width, height = frame.format.height;
+    for (uint32_t y = 0; y < height; ++y)
+        for (uint32_t x = 0; x < width; ++x)
+            add(frame.planes[0].data[y * frame.planes[0].stride + x]);
+    for (uint32_t c = 0; c < 2; ++c) {
+        for (uint32_t y = 0; y < height / 2; ++y) {
+            for (uint32_t x = 0; x < width / 2; ++x) {
+                if (frame.format.pixel == pixel_format_t::nv12)
+                    add(frame.planes[1].data[y * frame.planes[1].stride + 2 * x + c]);
+                else
+                    add(frame.planes[1 + c].data[y * frame.planes[1 + c].stride + x]);
+            }
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief The video track of a progressive MP4 file. Reads the sample tables only, enough for the test assets.
+ * @see ISO/IEC 14496-12 8.6, 8.7
+ */
+class mp4_track_t final {
+  public:
+    std::vector<uint8_t> file{};
+    std::vector<uint8_t> avcc{};
+    std::vector<video_frame_t> samples{}; // decode order. `planes[0]` points into the `file`
+
+  private:
+    struct box_t final {
+        const uint8_t* data = nullptr; // after the header
+        size_t size = 0;
+    };
+
+    static uint32_t read32(const uint8_t* p) noexcept {
+        return uint32_t{p[0]} << 24 | uint32_t{p[1]} << 16 | uint32_t{p[2]} << 8 | p[3];
+    }
+    static uint64_t read64(const uint8_t* p) noexcept {
+        return uint64_t{read32(p)} << 32 | read32(p + 4);
+    }
+    /// @brief The first child of the `type`. `offset` skips the fields before the children
+    static box_t find(box_t parent, const char* type, size_t offset = 0) {
+        for (size_t i = offset; i + 8 <= parent.size;) {
+            uint64_t size = read32(parent.data + i);
+            size_t header = 8;
+            if (size == 1)
+                size = read64(parent.data + i + 8), header = 16;
+            else if (size == 0)
+                size = parent.size - i;
+            if (size < header || i + size > parent.size)
+                break;
+            if (std::equal(type, type + 4, parent.data + i + 4))
+                return {parent.data + i + header, static_cast<size_t>(size - header)};
+            i += static_cast<size_t>(size);
+        }
+        return {};
+    }
+    /// @brief The entries of a full box with `entry_count`
+    static const uint8_t* entries(box_t box, uint32_t& count) {
+        count = box.size >= 8 ? read32(box.data + 4) : 0;
+        return box.data + 8;
+    }
+
+  public:
+    explicit mp4_track_t(const char* fpath) noexcept(false) {
+        std::ifstream fin{fpath, std::ios::binary};
+        if (fin.is_open() == false)
+            throw std::runtime_error{std::string{"mp4_track_t: can't open "} + fpath};
+        file.assign(std::istreambuf_iterator<char>{fin}, std::istreambuf_iterator<char>{});
+        const box_t moov = find({file.data(), file.size()}, "moov");
+        for (size_t i = 0; i + 8 <= moov.size;) {
+            const box_t trak = find({moov.data + i, moov.size - i}, "trak");
+            if (trak.data == nullptr)
+                break;
+            i = static_cast<size_t>(trak.data + trak.size - moov.data);
+            const box_t mdia = find(trak, "mdia");
+            const box_t hdlr = find(mdia, "hdlr");
+            if (hdlr.size < 12 || std::equal(hdlr.data + 8, hdlr.data + 12, "vide") == false)
+                continue;
+            read_samples(find(find(mdia, "minf"), "stbl"));
+            return;
+        }
+        throw std::runtime_error{"mp4_track_t: no video track"};
+    }
+
+  private:
+    void read_samples(box_t stbl) noexcept(false) {
+        const box_t avc1 = find(find(stbl, "stsd"), "avc1", 8);
+        const box_t avcc_box = find(avc1, "avcC", 78); // after VisualSampleEntry
+        avcc.assign(avcc_box.data, avcc_box.data + avcc_box.size);
+        // sizes
+        const box_t stsz = find(stbl, "stsz");
+        const uint32_t fixed_size = read32(stsz.data + 4);
+        const uint32_t count = read32(stsz.data + 8);
+        samples.resize(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            samples[i].format.pixel = pixel_format_t::h264;
+            samples[i].planes[0].stride = fixed_size ? fixed_size : read32(stsz.data + 12 + 4 * i);
+        }
+        // offsets. the chunks of `stsc` run until the next entry
+        std::vector<uint64_t> chunks{};
+        if (const box_t stco = find(stbl, "stco"); stco.data) {
+            uint32_t n = 0;
+            for (const uint8_t* p = entries(stco, n); n--; p += 4)
+                chunks.emplace_back(read32(p));
+        } else {
+            uint32_t n = 0;
+            for (const uint8_t* p = entries(find(stbl, "co64"), n); n--; p += 8)
+                chunks.emplace_back(read64(p));
+        }
+        uint32_t num_entries = 0;
+        const uint8_t* stsc = entries(find(stbl, "stsc"), num_entries);
+        for (uint32_t e = 0, index = 0; e < num_entries; ++e) {
+            const uint32_t first = read32(stsc + 12 * e) - 1;
+            const uint32_t last =
+                e + 1 < num_entries ? read32(stsc + 12 * (e + 1)) - 1 : static_cast<uint32_t>(chunks.size());
+            for (uint32_t chunk = first; chunk < last; ++chunk) {
+                uint64_t offset = chunks.at(chunk);
+                for (uint32_t k = 0; k < read32(stsc + 12 * e + 4) && index < count; ++k, ++index) {
+                    if (offset + samples[index].planes[0].stride > file.size())
+                        throw std::runtime_error{"mp4_track_t: sample out of the file"};
+                    samples[index].planes[0].data = file.data() + offset;
+                    offset += samples[index].planes[0].stride;
+                }
+            }
+        }
+        // timestamps. decode time with the composition offsets
+        uint32_t n = 0;
+        int64_t dts = 0;
+        size_t index = 0;
+        for (const uint8_t* p = entries(find(stbl, "stts"), n); n--; p += 8)
+            for (uint32_t k = 0; k < read32(p) && index < count; ++k, dts += read32(p + 4))
+                samples[index++].timestamp = dts;
+        index = 0;
+        if (const box_t ctts = find(stbl, "ctts"); ctts.data)
+            for (const uint8_t* p = entries(ctts, n); n--; p += 8)
+                for (uint32_t k = 0; k < read32(p) && index < count; ++k) // version 1 offsets are signed
+                    samples[index++].timestamp += static_cast<int32_t>(read32(p + 4));
+        if (const box_t stss = find(stbl, "stss"); stss.data) {
+            for (const uint8_t* p = entries(stss, n); n--; p += 4)
+                if (read32(p) - 1 < count)
+                    samples[read32(p) - 1].flags = frame_flag_keyframe;
+        } else {
+            for (auto& sample : samples)
+                sample.flags = frame_flag_keyframe;
+        }
+    }
+};
+
+class decode_test_t final {
+    std::vector<std::vector<uint8_t>> bytes{};
+
+  public:
+    std::shared_ptr<cpu_h264_decoder_t> decoder;
+    std::vector<video_frame_t> inputs{};
+    std::vector<video_frame_t> outputs{};
+    video_transform_driver_t::emit_t emit;
+
+  public:
+    decode_test_t(const std::string& avcc, const std::vector<sample_t>& samples, pixel_format_t pixel,
+                  size_t num_threads = 1)
+        : decoder{make_cpu_h264_decoder(from_hex(avcc).data(), avcc.size() / 2, pixel, num_threads)},
+          inputs{make_inputs(samples, bytes)}, emit{[this](const video_frame_t& frame) {
+              outputs.emplace_back(frame);
+              return transform_result_t::ok;
+          }} {
+    }
+
+    std::vector<uint32_t> hashes() const {
+        std::vector<uint32_t> values{};
+        for (const auto& frame : outputs)
+            values.emplace_back(hash_frame(frame));
+        return values;
+    }
+};
+
+} // namespace
+
+TEST_CASE("cpu_h264_decoder_t", "[h264_decoder]") {
+    SECTION("CABAC, B slices and weighted prediction") {
+        decode_test_t test{cabac_avcc, cabac_samples, pixel_format_t::i420};
+        video_transform_driver_t driver{test.decoder, "cpu_h264_decoder_t"};
+        for (const auto& input : test.inputs)
+            REQUIRE(driver.process(input, test.emit) == transform_result_t::ok);
+        REQUIRE(driver.drain(test.emit) == transform_result_t::ok);
+        REQUIRE(test.hashes() == std::vector<uint32_t>(std::begin(cabac_hashes), std::end(cabac_hashes)));
+        for (size_t i = 0; i < test.outputs.size(); ++i) {
+            const video_frame_t& frame = test.outputs[i];
+            REQUIRE(frame.timestamp == static_cast<int64_t>(i) * 512);
+            REQUIRE(frame.keyframe() == (i % 4 == 0));
+            REQUIRE(frame.format.width == 40);
+            REQUIRE(frame.format.height == 24);
+        }
+    }
+    SECTION("CAVLC with slices") {
+        for (size_t num_threads : {1, 2, 4}) {
+            decode_test_t test{cavlc_avcc, cavlc_samples, pixel_format_t::i420, num_threads};
+            video_transform_driver_t driver{test.decoder, "cpu_h264_decoder_t"};
+            for (const auto& input : test.inputs)
+                REQUIRE(driver.process(input, test.emit) == transform_result_t::ok);
+            REQUIRE(driver.drain(test.emit) == transform_result_t::ok);
+            REQUIRE(test.hashes() == std::vector<uint32_t>(std::begin(cavlc_hashes), std::end(cavlc_hashes)));
+        }
+    }
+    SECTION("NV12 into the output pool") {
+        decode_test_t test{cabac_avcc, cabac_samples, pixel_format_t::nv12};
+        auto pool = std::make_shared<frame_pool_t>(video_format_t{pixel_format_t::nv12, 16, 16}, 4);
+        test.decoder->set_output_pool(pool);
+        REQUIRE(pool->format().width == 40);
+        video_transform_driver_t driver{test.decoder, "cpu_h264_decoder_t"};
+        for (const auto& input : test.inputs)
+            REQUIRE(driver.process(input, test.emit) == transform_result_t::ok);
+        REQUIRE(driver.drain(test.emit) == transform_result_t::ok);
+        REQUIRE(test.hashes() == std::vector<uint32_t>(std::begin(cabac_hashes), std::end(cabac_hashes)));
+        REQUIRE(test.outputs[0].format.pixel == pixel_format_t::nv12);
+        REQUIRE(pool->stats().allocated == test.outputs.size()); // all outputs are kept by the test
+    }
+    SECTION("flush waits for the IDR") {
+        decode_test_t test{cabac_avcc, cabac_samples, pixel_format_t::i420};
+        video_transform_driver_t driver{test.decoder, "cpu_h264_decoder_t"};
+        REQUIRE(driver.process(test.inputs[0], test.emit) == transform_result_t::ok);
+        test.decoder->flush();
+        test.outputs.clear();
+        // the P and B frames before the next IDR are skipped
+        for (size_t i = 1; i < test.inputs.size(); ++i)
+            REQUIRE(driver.process(test.inputs[i], test.emit) == transform_result_t::ok);
+        REQUIRE(driver.drain(test.emit) == transform_result_t::ok);
+        REQUIRE(test.hashes() == std::vector<uint32_t>(std::begin(cabac_hashes) + 4, std::end(cabac_hashes)));
+    }
+    SECTION("drain keeps the references") {
+        decode_test_t test{cabac_avcc, cabac_samples, pixel_format_t::i420};
+        video_transform_driver_t driver{test.decoder, "cpu_h264_decoder_t"};
+        // the decode order is I P B B I P B B. drain before the last B frames
+        for (size_t i = 0; i < 6; ++i)
+            REQUIRE(driver.process(test.inputs[i], test.emit) == transform_result_t::ok);
+        REQUIRE(driver.drain(test.emit) == transform_result_t::ok);
+        REQUIRE(test.outputs.size() == 6);
+        for (size_t i = 6; i < test.inputs.size(); ++i)
+            REQUIRE(driver.process(test.inputs[i], test.emit) == transform_result_t::ok);
+        REQUIRE(driver.drain(test.emit) == transform_result_t::ok);
+        const auto hashes = test.hashes();
+        REQUIRE(hashes.size() == 8);
+        REQUIRE(hashes[6] == cabac_hashes[5]);
+        REQUIRE(hashes[7] == cabac_hashes[6]);
+    }
+    SECTION("not accepting while the outputs wait") {
+        decode_test_t test{cavlc_avcc, cavlc_samples, pixel_format_t::i420};
+        REQUIRE(test.decoder->process_input(test.inputs[0]) == transform_result_t::ok);
+        REQUIRE(test.decoder->process_input(test.inputs[1]) == transform_result_t::not_accepting);
+        video_frame_t output{};
+        REQUIRE(test.decoder->process_output(output) == transform_result_t::ok);
+        REQUIRE(hash_frame(output) == cavlc_hashes[0]);
+        REQUIRE(test.decoder->process_output(output) == transform_result_t::need_more_input);
+        REQUIRE(test.decoder->process_input(test.inputs[1]) == transform_result_t::ok);
+    }
+    SECTION("the size comes from SPS") {
+        cpu_h264_decoder_t decoder{};
+        REQUIRE(decoder.set_output_format(video_format_t{pixel_format_t::i420}) == transform_result_t::not_ready);
+        REQUIRE(decoder.set_input_format(video_format_t{pixel_format_t::h264}) == transform_result_t::ok);
+        REQUIRE(decoder.set_output_format(video_format_t{pixel_format_t::i420}) == transform_result_t::ok);
+        const auto avcc = from_hex(cavlc_avcc);
+        REQUIRE(decoder.set_parameter_sets(avcc.data(), avcc.size()) == transform_result_t::ok);
+        std::vector<std::vector<uint8_t>> bytes{};
+        const auto inputs = make_inputs(cavlc_samples, bytes);
+        REQUIRE(decoder.process_input(inputs[0]) == transform_result_t::ok);
+        video_frame_t output{};
+        REQUIRE(decoder.process_output(output) == transform_result_t::stream_change);
+        REQUIRE(decoder.get_output_format().width == 32);
+        REQUIRE(decoder.get_output_format().height == 32);
+        REQUIRE(decoder.process_output(output) == transform_result_t::ok);
+        REQUIRE(hash_frame(output) == cavlc_hashes[0]);
+    }
+    SECTION("seek in video_pipeline_t") {
+        decode_test_t test{cabac_avcc, cabac_samples, pixel_format_t::i420};
+        auto converter = std::make_shared<cpu_converter_t>();
+        REQUIRE(converter->set_input_format(test.decoder->get_output_format()) == transform_result_t::ok);
+        REQUIRE(converter->set_output_format({pixel_format_t::rgb32, 40, 24}) == transform_result_t::ok);
+        video_pipeline_t pipeline{2};
+        pipeline.add(test.decoder, "cpu_h264_decoder_t");
+        pipeline.add(converter, "cpu_converter_t");
+        std::mutex mtx{};
+        std::vector<int64_t> timestamps{};
+        REQUIRE(pipeline.start([&mtx, &timestamps](const video_frame_t& frame) {
+            std::lock_guard lck{mtx};
+            timestamps.emplace_back(frame.timestamp);
+            return transform_result_t::ok;
+        }) == transform_result_t::ok);
+        for (const auto& input : test.inputs)
+            REQUIRE(pipeline.push(input));
+        // the sync sample before 2560 is the IDR of 2048. the decode order is 2048, 3584, 2560, 3072
+        REQUIRE(pipeline.seek(2560) == transform_result_t::ok);
+        const size_t converted = pipeline.stage(1).input_count();
+        {
+            std::lock_guard lck{mtx};
+            timestamps.clear();
+        }
+        for (size_t i = 4; i < test.inputs.size(); ++i)
+            REQUIRE(pipeline.push(test.inputs[i]));
+        REQUIRE(pipeline.finish() == transform_result_t::ok);
+        REQUIRE(timestamps == std::vector<int64_t>{2560, 3072, 3584});
+        REQUIRE(pipeline.stage(0).discarded_count() == 1);
+        REQUIRE(pipeline.stage(1).input_count() - converted == 3); // the discarded one is not converted
+    }
+    SECTION("QoS skips the pictures which are not referenced") {
+        decode_test_t test{cabac_avcc, cabac_samples, pixel_format_t::i420};
+        video_transform_driver_t driver{test.decoder, "cpu_h264_decoder_t"};
+        // every input is late. only the B frames of 512, 2560 and 3072 can be skipped
+        for (const auto& input : test.inputs)
+            if (driver.drop_late(input, false) == false)
+                REQUIRE(driver.process(input, test.emit) == transform_result_t::ok);
+        REQUIRE(driver.drain(test.emit) == transform_result_t::ok);
+        REQUIRE(driver.late_count() == 8);
+        REQUIRE(driver.skipped_count() == 3);
+        REQUIRE(test.outputs.size() == 5);
+        for (const auto& output : test.outputs) {
+            REQUIRE(output.timestamp != 512);
+            REQUIRE(hash_frame(output) == cabac_hashes[output.timestamp / 512]);
+        }
+    }
+    SECTION("QoS waits for the keyframe after a stale reference") {
+        decode_test_t test{cabac_avcc, cabac_samples, pixel_format_t::i420};
+        video_transform_driver_t driver{test.decoder, "cpu_h264_decoder_t"};
+        REQUIRE(driver.process(test.inputs[0], test.emit) == transform_result_t::ok);
+        REQUIRE(driver.drop_late(test.inputs[1], false) == false);
+        REQUIRE(driver.drop_late(test.inputs[1], true)); // the P frame is too late. the decoder is flushed
+        test.outputs.clear();
+        for (size_t i = 2; i < test.inputs.size(); ++i)
+            REQUIRE(driver.process(test.inputs[i], test.emit) == transform_result_t::ok);
+        REQUIRE(driver.drain(test.emit) == transform_result_t::ok);
+        REQUIRE(driver.skipped_count() == 3); // 1024, 512 and 1536 before the IDR of 2048
+        REQUIRE(test.hashes() == std::vector<uint32_t>(std::begin(cabac_hashes) + 4, std::end(cabac_hashes)));
+    }
+    SECTION("broken header") {
+        const uint8_t header[]{0x01, 0x4d, 0x00};
+        REQUIRE_THROWS_AS(make_cpu_h264_decoder(header, sizeof(header), pixel_format_t::i420),
+                          std::invalid_argument);
+        REQUIRE_THROWS_AS(make_cpu_h264_decoder(header, sizeof(header), pixel_format_t::i420),
+                          std::invalid_argument);
+    }
+}
+
+TEST_CASE("cpu_h264_decoder_t with test-sample-0.mp4", "[h264_decoder]") {
+    const mp4_track_t track{"test-sample-0.mp4"};
+    REQUIRE(track.samples.size() == std::size(asset_hashes));
+    std::vector<video_frame_t> outputs{};
+    const video_transform_driver_t::emit_t emit = [&outputs](const video_frame_t& frame) {
+        outputs.emplace_back(frame);
+        return transform_result_t::ok;
+    };
+    auto decoder = make_cpu_h264_decoder(track.avcc.data(), track.avcc.size(), pixel_format_t::i420, 2);
+    video_transform_driver_t driver{decoder, "cpu_h264_decoder_t"};
+    for (const auto& sample : track.samples)
+        REQUIRE(driver.process(sample, emit) == transform_result_t::ok);
+    REQUIRE(driver.drain(emit) == transform_result_t::ok);
+    REQUIRE(outputs.size() == track.samples.size());
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        const video_frame_t& frame = outputs[i];
+        REQUIRE(frame.format.width == 1280);
+        REQUIRE(frame.format.height == 720);
+        REQUIRE(hash_frame(frame) == asset_hashes[i]);
+        if (i)
+            REQUIRE(frame.timestamp > outputs[i - 1].timestamp);
+    }
+}
+
+TEST_CASE("h264_idct4x4_add", "[h264_decoder]") {
+    // 8.5.12.2 in 32 bit. the SIMD path must match it even out of the 16 bit range of the conformant streams
+    std::mt19937 random{11};
+    for (int range : {64, 2048, 32767}) {
+        std::uniform_int_distribution<int> coefficient{-range, range};
+        std::uniform_int_distribution<int> sample{0, 255};
+        for (int n = 0; n < 200; ++n) {
+            int16_t block[16]{};
+            uint8_t pixels[4 * 8]{}, expected[4 * 8]{};
+            for (auto& value : block)
+                value = static_cast<int16_t>(coefficient(random));
+            for (size_t i = 0; i < sizeof(pixels); ++i)
+                pixels[i] = expected[i] = static_cast<uint8_t>(sample(random));
+            int32_t temp[16]{};
+            for (int i = 0; i < 4; ++i) {
+                const int16_t* d = block + i * 4;
+                const int32_t e0 = d[0] + d[2], e1 = d[0] - d[2];
+                const int32_t e2 = (d[1] >> 1) - d[3], e3 = d[1] + (d[3] >> 1);
+                temp[i * 4 + 0] = e0 + e3, temp[i * 4 + 1] = e1 + e2;
+                temp[i * 4 + 2] = e1 - e2, temp[i * 4 + 3] = e0 - e3;
+            }
+            for (int j = 0; j < 4; ++j) {
+                const int32_t* f = temp + j;
+                const int32_t g0 = f[0] + f[8], g1 = f[0] - f[8];
+                const int32_t g2 = (f[4] >> 1) - f[12], g3 = f[4] + (f[12] >> 1);
+                const int32_t r[4]{g0 + g3, g1 + g2, g1 - g2, g0 - g3};
+                for (int i = 0; i < 4; ++i)
+                    expected[i * 8 + j] =
+                        static_cast<uint8_t>(std::clamp(expected[i * 8 + j] + ((r[i] + 32) >> 6), 0, 255));
+            }
+            h264_idct4x4_add(pixels, 8, block);
+            REQUIRE(std::equal(std::begin(pixels), std::end(pixels), std::begin(expected)));
+            REQUIRE(std::all_of(std::begin(block), std::end(block), [](int16_t value) { return value == 0; }));
+        }
+    }
+}
+
+TEST_CASE("h264 deblocking kernels", "[h264_decoder]") {
+    // the horizontal edges use the SIMD paths. the vertical ones are scalar. same result for the transposed samples
+    std::mt19937 random{7};
+    std::uniform_int_distribution<int> noise{96, 120};
+    uint8_t rows[16 * 16]{}, columns[16 * 16]{};
+    for (size_t y = 0; y < 16; ++y)
+        for (size_t x = 0; x < 16; ++x)
+            rows[y * 16 + x] = columns[x * 16 + y] = static_cast<uint8_t>(noise(random));
+    const auto same = [&rows, &columns]() {
+        for (size_t y = 0; y < 16; ++y)
+            for (size_t x = 0; x < 16; ++x)
+                if (rows[y * 16 + x] != columns[x * 16 + y])
+                    return false;
+        return true;
+    };
+    const int8_t tc0[4]{0, 1, 3, -1};
+    SECTION("luma") {
+        h264_deblock_luma(rows + 8 * 16, 16, 1, 255, 18, tc0);
+        h264_deblock_luma(columns + 8, 1, 16, 255, 18, tc0);
+        REQUIRE(same());
+    }
+    SECTION("luma intra") {
+        h264_deblock_luma_intra(rows + 8 * 16, 16, 1, 255, 18);
+        h264_deblock_luma_intra(columns + 8, 1, 16, 255, 18);
+        REQUIRE(same());
+        h264_deblock_luma_intra(rows + 8 * 16, 16, 1, 40, 18); // the weak filter
+        h264_deblock_luma_intra(columns + 8, 1, 16, 40, 18);
+        REQUIRE(same());
+    }
+    SECTION("chroma") {
+        h264_deblock_chroma(rows + 8 * 16, 16, 1, 255, 18, tc0);
+        h264_deblock_chroma(columns + 8, 1, 16, 255, 18, tc0);
+        h264_deblock_chroma_intra(rows + 4 * 16, 16, 1, 255, 18);
+        h264_deblock_chroma_intra(columns + 4, 1, 16, 255, 18);
+        REQUIRE(same());
+    }
+}
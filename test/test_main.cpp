@@ -13,12 +13,14 @@
 #include <winrt/windows.foundation.h> // namespace winrt::Windows::Foundation
 #include <winrt/windows.system.h>     // namespace winrt::Windows::System
 
+#include "async_sink.hpp"
+#include "event_trace.hpp"
+#include "unicode.hpp"
+
 // #include "winrt/WinRTComponent.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
-std::string w2mb(std::wstring_view in) noexcept(false);
-
 bool has_env(const char* key) noexcept {
     size_t len = 0;
     char buf[40]{};
@@ -52,6 +54,7 @@ class vstest_sink final : public spdlog::sinks::sink {
     }
 };
 
+/// @note Console I/O and `Logger::WriteMessage` are done by the background thread of `async_sink`
 auto make_logger(const char* name, FILE* fout) noexcept(false) {
     spdlog::sink_ptr sink0 = [fout]() -> spdlog::sink_ptr {
         using mutex_t = spdlog::details::console_nullmutex;
@@ -61,7 +64,8 @@ auto make_logger(const char* name, FILE* fout) noexcept(false) {
         return std::make_shared<sink_t>(fout);
     }();
     spdlog::sink_ptr sink1 = std::make_shared<vstest_sink>();
-    return std::make_shared<spdlog::logger>(name, spdlog::sinks_init_list{sink0, sink1});
+    auto sink = std::make_shared<async_sink>(std::vector<spdlog::sink_ptr>{sink0, sink1});
+    return std::make_shared<spdlog::logger>(name, std::move(sink));
 }
 
 /**
@@ -81,6 +85,9 @@ TEST_MODULE_INITIALIZE(Initialize) {
         winrt::init_apartment(winrt::apartment_type::single_threaded);
     }
     winrt::check_hresult(MFStartup(MF_VERSION, MFSTARTUP_FULL));
+    // record the processing loops. see `TEST_MODULE_CLEANUP`
+    if (has_env("MEDIA0_TRACE"))
+        trace_start();
     spdlog::info("C++/WinRT:");
     spdlog::info("  version: {:s}", CPPWINRT_VERSION); // WINRT_version
     // spdlog::info("Windows Media Foundation:");
@@ -89,8 +96,15 @@ TEST_MODULE_INITIALIZE(Initialize) {
 }
 
 TEST_MODULE_CLEANUP(Cleanup) {
+    if (trace_enabled()) {
+        trace_stop();
+        size_t count = trace_dump("media0.trace");
+        trace_to_chrome_json("media0.trace", "media0.trace.json");
+        spdlog::info("trace: {} records", count);
+    }
     MFShutdown();
     winrt::uninit_apartment();
+    spdlog::default_logger()->flush();
 }
 
 using std::experimental::coroutine_handle;
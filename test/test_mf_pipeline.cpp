@@ -0,0 +1,62 @@
+#include <CppUnitTest.h>
+
+#include <thread>
+
+#include "pipeline.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+class bounded_queue_test_case : public TestClass<bounded_queue_test_case> {
+  public:
+    TEST_METHOD(test_fifo) {
+        bounded_queue_t<int> queue{3};
+        Assert::IsTrue(queue.push(1));
+        Assert::IsTrue(queue.push(2));
+        Assert::IsTrue(queue.push(3));
+        Assert::AreEqual<size_t>(queue.size(), 3);
+        int value = 0;
+        Assert::IsTrue(queue.pop(value));
+        Assert::AreEqual(value, 1);
+        Assert::IsTrue(queue.push(4)); // wrap around
+        for (int expected : {2, 3, 4}) {
+            Assert::IsTrue(queue.pop(value));
+            Assert::AreEqual(value, expected);
+        }
+    }
+
+    TEST_METHOD(test_close_drains_remaining) {
+        bounded_queue_t<int> queue{2};
+        Assert::IsTrue(queue.push(7));
+        queue.close();
+        Assert::IsFalse(queue.push(8));
+        int value = 0;
+        Assert::IsTrue(queue.pop(value));
+        Assert::AreEqual(value, 7);
+        Assert::IsFalse(queue.pop(value));
+    }
+
+    TEST_METHOD(test_abort_discards) {
+        bounded_queue_t<std::shared_ptr<int>> queue{2};
+        auto item = std::make_shared<int>(1);
+        Assert::IsTrue(queue.push(item));
+        queue.abort();
+        Assert::AreEqual<long>(item.use_count(), 1);
+        std::shared_ptr<int> value{};
+        Assert::IsFalse(queue.pop(value));
+    }
+
+    TEST_METHOD(test_back_pressure) {
+        bounded_queue_t<int> queue{1};
+        Assert::IsTrue(queue.push(0));
+        std::thread producer{[&queue]() {
+            for (int i = 1; i < 100; ++i)
+                queue.push(i); // blocks until the consumer pops
+            queue.close();
+        }};
+        int value = 0, expected = 0;
+        while (queue.pop(value))
+            Assert::AreEqual(value, expected++);
+        producer.join();
+        Assert::AreEqual(expected, 100);
+    }
+};
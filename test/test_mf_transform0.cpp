@@ -13,12 +13,13 @@
 #include <spdlog/common.h>
 #include <spdlog/spdlog.h>
 
-#include "mf_transform.hpp"
+#include "mf_pipeline.hpp"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 void print(IMFMediaType* media_type) noexcept;
 std::string to_mf_string(const GUID& guid) noexcept;
+std::string to_guid_string(const GUID& guid) noexcept;
 
 void report_error(HRESULT hr, const char* fname, const spdlog::source_loc& loc) noexcept {
     winrt::hresult_error ex{hr};
@@ -128,17 +129,15 @@ winrt::com_ptr<IMFMediaType> make_video_type(IMFMediaType* input, const GUID& su
     return output;
 }
 
-/// @see https://docs.microsoft.com/en-us/windows/win32/api/mfobjects/nn-mfobjects-imfmediabuffer
-HRESULT create_single_buffer_sample(IMFSample** output, DWORD bufsz) {
-    if (auto hr = MFCreateSample(output); FAILED(hr))
+/// @brief Feed the samples of the reader to the pipeline until the end of stream
+HRESULT consume_samples(winrt::com_ptr<IMFSourceReaderEx> reader, mf_pipeline_t& pipeline,
+                        mf_pipeline_t::sink_t sink = nullptr) {
+    if (auto hr = pipeline.start(std::move(sink)); FAILED(hr))
         return hr;
-    winrt::com_ptr<IMFMediaBuffer> buffer{};
-    if (auto hr = MFCreateMemoryBuffer(bufsz, buffer.put()); FAILED(hr))
-        return hr;
-    // GetMaxLength will be length of the available memory location
-    // GetCurrentLength will be 0
-    IMFSample* sample = *output;
-    return sample->AddBuffer(buffer.get());
+    for (auto sample : read_samples(reader, static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM)))
+        if (pipeline.push(sample) == false)
+            break;
+    return pipeline.finish();
 }
 
 /// @see https://docs.microsoft.com/en-us/windows/win32/api/evr/nc-evr-mfcreatevideosamplefromsurface
@@ -403,112 +402,6 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         Assert::AreEqual(consume(reader, istream, num_frame), S_OK);
     }
 
-    static void consume_samples0(DWORD istream, DWORD ostream, winrt::com_ptr<IMFSourceReaderEx> source_reader,
-                                 winrt::com_ptr<IMFTransform> transform, //
-                                 winrt::com_ptr<IMFSample> output_sample) {
-        DWORD status = 0;
-        Assert::AreEqual(transform->GetInputStatus(istream, &status), S_OK);
-        Assert::AreEqual<DWORD>(status, MFT_INPUT_STATUS_ACCEPT_DATA);
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL), S_OK);
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL), S_OK);
-
-        size_t output_count = 0;
-        for (auto input_sample : read_samples(source_reader, static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM))) {
-            if (auto hr = transform->ProcessInput(istream, input_sample.get(), 0); FAILED(hr)) {
-                spdlog::warn("failed: {}", "ProcessInput");
-                return Assert::Fail(winrt::hresult_error{hr}.message().c_str());
-            }
-
-            MFT_OUTPUT_DATA_BUFFER output{};
-            output.dwStreamID = ostream;
-            output.pSample = output_sample.get();
-            switch (auto hr = transform->ProcessOutput(0, 1, &output, &status); hr) {
-            case S_OK:
-                ++output_count;
-                continue;
-            case MF_E_TRANSFORM_NEED_MORE_INPUT:
-                continue;
-            case MF_E_TRANSFORM_STREAM_CHANGE:
-                spdlog::debug("stream changed: {:#08x}", status);
-                [[fallthrough]];
-            default:
-                spdlog::warn("failed: {}", "ProcessOutput");
-                return Assert::Fail(winrt::hresult_error{hr}.message().c_str());
-            }
-        }
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, NULL), S_OK);
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, NULL), S_OK);
-        Assert::AreNotEqual<size_t>(output_count, 0);
-        output_count = 0;
-        bool output_available = true;
-        while (output_available) {
-            MFT_OUTPUT_DATA_BUFFER output{};
-            output.dwStreamID = ostream;
-            output.pSample = output_sample.get();
-            switch (auto hr = transform->ProcessOutput(0, 1, &output, &status); hr) {
-            case S_OK:
-                ++output_count;
-                continue;
-            case MF_E_TRANSFORM_NEED_MORE_INPUT:
-                output_available = false;
-                continue;
-            case MF_E_TRANSFORM_STREAM_CHANGE:
-                spdlog::debug("stream changed: {:#08x}", status);
-                [[fallthrough]];
-            default:
-                spdlog::warn("failed: {}", "ProcessOutput");
-                return Assert::Fail(winrt::hresult_error{hr}.message().c_str());
-            }
-        }
-        // some transforms may not process after drain.
-        // in the case, output_count == 0.
-    };
-
-    /// @brief Consume function for `IMFTransform` that doesn't have leftover after drain
-    /// @see CLSID_CResizerDMO
-    /// @see CLSID_VideoProcessorMFT
-    void consume_samples1(DWORD istream, DWORD ostream, winrt::com_ptr<IMFSourceReaderEx> source_reader,
-                          winrt::com_ptr<IMFTransform> transform, //
-                          winrt::com_ptr<IMFSample> output_sample) {
-        size_t input_count = 0;
-        size_t output_count = 0;
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL), S_OK);
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL), S_OK);
-        DWORD status = 0;
-        for (auto input_sample : read_samples(source_reader, static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM))) {
-            ++input_count;
-            if (auto hr = transform->ProcessInput(istream, input_sample.get(), 0); FAILED(hr)) {
-                spdlog::warn("failed: {}", "ProcessInput");
-                return Assert::Fail(winrt::hresult_error{hr}.message().c_str());
-            }
-            bool output_available = true;
-            while (output_available) {
-                MFT_OUTPUT_DATA_BUFFER output{};
-                output.dwStreamID = ostream;
-                output.pSample = output_sample.get();
-                switch (auto hr = transform->ProcessOutput(0, 1, &output, &status); hr) {
-                case S_OK:
-                    ++output_count;
-                    continue;
-                case MF_E_TRANSFORM_NEED_MORE_INPUT:
-                    output_available = false;
-                    continue;
-                case MF_E_TRANSFORM_STREAM_CHANGE:
-                    [[fallthrough]];
-                default:
-                    spdlog::warn("failed: {}", "ProcessOutput");
-                    return Assert::Fail(winrt::hresult_error{hr}.message().c_str());
-                }
-            }
-        }
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, NULL), S_OK);
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, NULL), S_OK);
-        // CLSID_CResizerDMO won't have leftover
-        // CLSID_VideoProcessorMFT won't have leftover
-        Assert::IsTrue(output_count);
-        Assert::IsTrue(input_count == output_count);
-    };
-
     /// @see https://docs.microsoft.com/en-us/windows/win32/medfound/h-264-video-decoder
     /// @see https://docs.microsoft.com/en-us/windows/win32/medfound/basic-mft-processing-model
     TEST_METHOD(test_CMSH264DecoderMFT_RGB32) {
@@ -535,6 +428,64 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         // we can't consume the samples because there is no transform
     }
 
+    /// @brief The second stream doesn't repeat the rejected `SetOutputType` of `test_CMSH264DecoderMFT_RGB32`
+    TEST_METHOD(test_CMSH264DecoderMFT_negotiation_cache) {
+        const auto fpath = std::filesystem::temp_directory_path() / "media0-negotiation.txt";
+        winrt::com_ptr<IMFMediaType> rgb32 = make_video_type(source_type.get(), MFVideoFormat_RGB32);
+        winrt::com_ptr<IMFMediaType> nv12 = make_video_type(source_type.get(), MFVideoFormat_NV12);
+        {
+            negotiation_cache_t cache{};
+            h264_decoder_t decoder{};
+            mf_transform_info_t info{};
+            Assert::AreEqual(negotiate_types(cache, CLSID_CMSH264DecoderMFT, decoder.transform.get(),
+                                             source_type.get(), rgb32.get(), info),
+                             MF_E_INVALIDMEDIATYPE);
+            Assert::AreEqual(negotiate_types(cache, CLSID_CMSH264DecoderMFT, decoder.transform.get(),
+                                             source_type.get(), nv12.get(), info),
+                             S_OK);
+            cache.save(fpath);
+        }
+        negotiation_cache_t cache{};
+        Assert::AreEqual<size_t>(cache.load(fpath), 2);
+        h264_decoder_t decoder{};
+        mf_transform_info_t info{};
+        Assert::AreEqual(negotiate_types(cache, CLSID_CMSH264DecoderMFT, decoder.transform.get(), source_type.get(),
+                                         rgb32.get(), info),
+                         MF_E_INVALIDMEDIATYPE);
+        // no SetInputType for the rejected pair
+        winrt::com_ptr<IMFMediaType> current{};
+        Assert::AreEqual(decoder.transform->GetInputCurrentType(0, current.put()), MF_E_TRANSFORM_TYPE_NOT_SET);
+        Assert::AreEqual(negotiate_types(cache, CLSID_CMSH264DecoderMFT, decoder.transform.get(), source_type.get(),
+                                         nv12.get(), info),
+                         S_OK);
+        Assert::AreNotEqual<DWORD>(info.output_info.cbSize, 0);
+        Assert::AreEqual<size_t>(cache.stats().hits, 2);
+        std::filesystem::remove(fpath);
+    }
+
+    /// @brief The errors which are not about the types must not poison the cache
+    TEST_METHOD(test_CMSH264DecoderMFT_negotiation_cache_transient) {
+        Assert::IsTrue(is_type_rejection(MF_E_INVALIDMEDIATYPE));
+        Assert::IsFalse(is_type_rejection(E_OUTOFMEMORY));
+        Assert::IsFalse(is_type_rejection(MF_E_TRANSFORM_TYPE_NOT_SET));
+        Assert::IsFalse(is_type_rejection(MF_E_NOTACCEPTING));
+
+        winrt::com_ptr<IMFMediaType> nv12 = make_video_type(source_type.get(), MFVideoFormat_NV12);
+        const negotiation_key_t key{to_guid_string(CLSID_CMSH264DecoderMFT), describe_type(source_type.get()),
+                                    describe_type(nv12.get())};
+        negotiation_entry_t failed{};
+        failed.result = negotiation_result_t::output_rejected;
+        failed.error = E_OUTOFMEMORY; // like the file of an older version
+        negotiation_cache_t cache{};
+        cache.record(key, failed);
+        h264_decoder_t decoder{};
+        mf_transform_info_t info{};
+        Assert::AreEqual(negotiate_types(cache, CLSID_CMSH264DecoderMFT, decoder.transform.get(), source_type.get(),
+                                         nv12.get(), info),
+                         S_OK);
+        Assert::IsTrue(cache.find(key)->result == negotiation_result_t::accepted);
+    }
+
     // for Asynchronous MFT
     // @todo https://docs.microsoft.com/en-us/windows/win32/medfound/basic-mft-processing-model#get-buffer-requirements
     // @see https://docs.microsoft.com/en-us/windows/win32/medfound/basic-mft-processing-model#process-data
@@ -549,9 +500,6 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
 
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-
         const DWORD istream = info.input_stream_ids[0];
         const DWORD ostream = info.output_stream_ids[0];
         winrt::com_ptr<IMFMediaType> input = source_type;
@@ -559,7 +507,10 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         auto output_type = make_video_type(input.get(), MFVideoFormat_NV12);
         Assert::AreEqual(transform->SetOutputType(ostream, output_type.get(), 0), S_OK);
 
-        consume_samples0(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "h264_decoder_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
     }
 
     TEST_METHOD(test_CMSH264DecoderMFT_I420) {
@@ -573,9 +524,6 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
 
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-
         const DWORD istream = info.input_stream_ids[0];
         const DWORD ostream = info.output_stream_ids[0];
         winrt::com_ptr<IMFMediaType> input = source_type;
@@ -583,7 +531,10 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         auto output_type = make_video_type(input.get(), MFVideoFormat_I420);
         Assert::AreEqual(transform->SetOutputType(ostream, output_type.get(), 0), S_OK);
 
-        consume_samples0(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "h264_decoder_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
     }
 
     /// @see https://docs.microsoft.com/en-us/windows/win32/medfound/basic-mft-processing-model
@@ -604,9 +555,10 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
 
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-        consume_samples0(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "color_converter_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
     }
 
     TEST_METHOD(test_CColorConvertDMO_RGB32_IYUV) {
@@ -623,9 +575,10 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
 
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-        consume_samples0(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "color_converter_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
     }
 
     /// @todo Try with Texture2D buffer
@@ -643,9 +596,41 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
 
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-        consume_samples0(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "color_converter_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
+    }
+
+    /// @brief The second `acquire_transform` takes the flushed transform without `CoCreateInstance` and `SetInputType`
+    TEST_METHOD(test_CColorConvertDMO_pool) {
+        Assert::AreEqual(set_subtype(MFVideoFormat_NV12), S_OK);
+        auto output_type = make_video_type(source_type.get(), MFVideoFormat_RGB32);
+        size_t num_created = 0;
+        auto create = [&num_created]() {
+            ++num_created;
+            return color_converter_t{}.transform;
+        };
+        mf_transform_pool_t pool{reset_transform};
+        IMFTransform* first = nullptr;
+        {
+            auto lease = acquire_transform(pool, CLSID_CColorConvertDMO, source_type.get(), output_type.get(), create);
+            first = lease.get().get();
+            mf_pipeline_t pipeline{};
+            pipeline.add(lease.get(), "color_converter_t");
+            Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        }
+        auto lease = acquire_transform(pool, CLSID_CColorConvertDMO, source_type.get(), output_type.get(), create);
+        Assert::IsTrue(lease.get().get() == first);
+        Assert::AreEqual<size_t>(num_created, 1);
+        winrt::com_ptr<IMFMediaType> current{};
+        Assert::AreEqual(lease.get()->GetOutputCurrentType(0, current.put()), S_OK);
+
+        // the other output type is a different key
+        auto i420_type = make_video_type(source_type.get(), MFVideoFormat_I420);
+        auto other = acquire_transform(pool, CLSID_CColorConvertDMO, source_type.get(), i420_type.get(), create);
+        Assert::AreEqual<size_t>(num_created, 2);
+        Assert::AreEqual<size_t>(pool.stats().hits, 1);
     }
 
     /// @todo Try with Texture2D buffer
@@ -663,9 +648,10 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
 
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-        consume_samples0(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "color_converter_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
     }
 
     TEST_METHOD(test_CColorConvertDMO_I420_RGB565) {
@@ -682,9 +668,10 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
 
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-        consume_samples0(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "color_converter_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
     }
 
     /// @see https://docs.microsoft.com/en-us/windows/win32/medfound/basic-mft-processing-model
@@ -721,11 +708,12 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         mf_transform_info_t info{};
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-        constexpr auto istream = 0;
-        constexpr auto ostream = 0;
-        consume_samples1(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "sample_cropper_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        // CLSID_CResizerDMO, CLSID_VideoProcessorMFT won't have leftover
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
+        Assert::AreEqual(stage.input_count(), stage.output_count());
     }
 
     TEST_METHOD(test_CResizerDMO_I420) {
@@ -742,11 +730,12 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         mf_transform_info_t info{};
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-        constexpr auto istream = 0;
-        constexpr auto ostream = 0;
-        consume_samples1(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "sample_cropper_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        // CLSID_CResizerDMO, CLSID_VideoProcessorMFT won't have leftover
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
+        Assert::AreEqual(stage.input_count(), stage.output_count());
     }
 
     /// @see https://docs.microsoft.com/en-us/windows/win32/medfound/video-processor-mft#remarks
@@ -783,12 +772,12 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
 
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-
-        constexpr auto istream = 0;
-        constexpr auto ostream = 0;
-        consume_samples1(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "sample_processor_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        // CLSID_CResizerDMO, CLSID_VideoProcessorMFT won't have leftover
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
+        Assert::AreEqual(stage.input_count(), stage.output_count());
     }
 
     TEST_METHOD(test_VideoProcessorMFT_vertical_normal) {
@@ -809,12 +798,12 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
 
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-
-        constexpr auto istream = 0;
-        constexpr auto ostream = 0;
-        consume_samples1(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "sample_processor_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        // CLSID_CResizerDMO, CLSID_VideoProcessorMFT won't have leftover
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
+        Assert::AreEqual(stage.input_count(), stage.output_count());
     }
 
     TEST_METHOD(test_VideoProcessorMFT_scale_0) {
@@ -832,12 +821,12 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
 
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
-
-        constexpr auto istream = 0;
-        constexpr auto ostream = 0;
-        consume_samples1(istream, ostream, reader, transform, output_sample);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "sample_processor_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        // CLSID_CResizerDMO, CLSID_VideoProcessorMFT won't have leftover
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
+        Assert::AreEqual(stage.input_count(), stage.output_count());
     }
 
     TEST_METHOD(test_VideoProcessorMFT_scale_1) {
@@ -854,12 +843,45 @@ class video_reader_test_case : public TestClass<video_reader_test_case> {
         info.from(transform.get());
         Assert::IsFalse(info.output_provide_sample());
 
-        winrt::com_ptr<IMFSample> output_sample{};
-        Assert::AreEqual(create_single_buffer_sample(output_sample.put(), info.output_info.cbSize), S_OK);
+        mf_pipeline_t pipeline{};
+        mf_transform_driver_t& stage = pipeline.add(transform, "sample_processor_t");
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        // CLSID_CResizerDMO, CLSID_VideoProcessorMFT won't have leftover
+        Assert::AreNotEqual<size_t>(stage.output_count(), 0);
+        Assert::AreEqual(stage.input_count(), stage.output_count());
+    }
 
-        constexpr auto istream = 0;
-        constexpr auto ostream = 0;
-        consume_samples1(istream, ostream, reader, transform, output_sample);
+    /// @brief decode -> convert -> crop. Each stage runs on its own thread
+    TEST_METHOD(test_pipeline_decode_convert_crop) {
+        h264_decoder_t decoder{};
+        Assert::IsTrue(decoder.support(source_type.get()));
+        Assert::AreEqual(decoder.transform->SetInputType(0, source_type.get(), 0), S_OK);
+        auto decoded_type = make_video_type(source_type.get(), MFVideoFormat_NV12);
+        Assert::AreEqual(decoder.transform->SetOutputType(0, decoded_type.get(), 0), S_OK);
+
+        color_converter_t converter{};
+        winrt::com_ptr<IMFMediaType> nv12{};
+        Assert::AreEqual(decoder.transform->GetOutputCurrentType(0, nv12.put()), S_OK);
+        Assert::AreEqual(converter.transform->SetInputType(0, nv12.get(), 0), S_OK);
+        auto rgb32 = make_video_type(nv12.get(), MFVideoFormat_RGB32);
+        Assert::AreEqual(converter.transform->SetOutputType(0, rgb32.get(), 0), S_OK);
+
+        sample_cropper_t cropper{};
+        Assert::AreEqual(cropper.crop(rgb32.get(), RECT{0, 0, 256, 256}), S_OK);
+
+        mf_pipeline_t pipeline{4};
+        pipeline.add(decoder.transform, "h264_decoder_t");
+        pipeline.add(converter.transform, "color_converter_t");
+        pipeline.add(cropper.transform, "sample_cropper_t");
+        size_t count = 0;
+        auto sink = [&count](IMFSample*) -> HRESULT {
+            ++count;
+            return S_OK;
+        };
+        Assert::AreEqual(consume_samples(reader, pipeline, sink), S_OK);
+        Assert::AreNotEqual<size_t>(count, 0);
+        Assert::AreEqual(count, pipeline.stage(2).output_count());
+        Assert::AreEqual(pipeline.stage(0).output_count(), pipeline.stage(1).input_count());
     }
 };
 
@@ -927,46 +949,6 @@ class rgba32_texture_buffer_test_case : public TestClass<rgba32_texture_buffer_t
         return reader->SetCurrentMediaType(video_stream, nullptr, source_type.get());
     }
 
-    void consume_samples(winrt::com_ptr<IMFSourceReaderEx> source_reader, //
-                         winrt::com_ptr<IMFTransform> transform,          //
-                         const mf_transform_info_t& info,                 //
-                         winrt::com_ptr<IMFSample> output_sample) {
-        const DWORD istream = info.input_stream_ids[0];
-        const DWORD ostream = info.output_stream_ids[0];
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL), S_OK);
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL), S_OK);
-        DWORD status = 0;
-        size_t output_count = 0;
-        for (auto input_sample : read_samples(source_reader, static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM))) {
-            if (auto hr = transform->ProcessInput(istream, input_sample.get(), 0); FAILED(hr)) {
-                spdlog::warn("failed: {}", "ProcessInput");
-                return Assert::Fail(winrt::hresult_error{hr}.message().c_str());
-            }
-            bool output_available = true;
-            while (output_available) {
-                MFT_OUTPUT_DATA_BUFFER output{};
-                output.dwStreamID = ostream;
-                output.pSample = output_sample.get();
-                switch (auto hr = transform->ProcessOutput(0, 1, &output, &status); hr) {
-                case S_OK:
-                    ++output_count;
-                    continue;
-                case MF_E_TRANSFORM_NEED_MORE_INPUT:
-                    output_available = false;
-                    continue;
-                case MF_E_TRANSFORM_STREAM_CHANGE:
-                    [[fallthrough]];
-                default:
-                    spdlog::warn("failed: {}", "ProcessOutput");
-                    return Assert::Fail(winrt::hresult_error{hr}.message().c_str());
-                }
-            }
-        }
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, NULL), S_OK);
-        Assert::AreEqual(transform->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, NULL), S_OK);
-        Assert::IsTrue(output_count);
-    };
-
     TEST_METHOD(test_crop) {
         Assert::AreEqual(open("test-sample-0.mp4"), S_OK);
         Assert::AreEqual(set_subtype(MFVideoFormat_RGB32), S_OK);
@@ -980,7 +962,10 @@ class rgba32_texture_buffer_test_case : public TestClass<rgba32_texture_buffer_t
         Assert::IsFalse(info.output_provide_sample());
         Assert::AreEqual<DWORD>(info.output_info.cbSize, dst.right * dst.bottom * 4);
 
-        consume_samples(reader, cropper.transform, info, sample);
+        mf_pipeline_t pipeline{};
+        pipeline.add(cropper.transform, "sample_cropper_t").reuse(sample);
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        Assert::AreNotEqual<size_t>(pipeline.stage(0).output_count(), 0);
     }
 
     TEST_METHOD(test_downscale) {
@@ -996,6 +981,9 @@ class rgba32_texture_buffer_test_case : public TestClass<rgba32_texture_buffer_t
         Assert::IsFalse(info.output_provide_sample());
         Assert::AreEqual<DWORD>(info.output_info.cbSize, dst.right * dst.bottom * 4);
 
-        consume_samples(reader, resizer.transform, info, sample);
+        mf_pipeline_t pipeline{};
+        pipeline.add(resizer.transform, "sample_processor_t").reuse(sample);
+        Assert::AreEqual(consume_samples(reader, pipeline), S_OK);
+        Assert::AreNotEqual<size_t>(pipeline.stage(0).output_count(), 0);
     }
 };
@@ -0,0 +1,199 @@
+#include <CppUnitTest.h>
+
+#include <mfapi.h>
+#include <mfreadwrite.h>
+#include <winrt/Windows.Foundation.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "gop_decoder.hpp"
+#include "mf_video_transform.hpp"
+#include "thumbnail.hpp"
+#include "video_pipeline.hpp"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+class mf_video_transform_test_case : public TestClass<mf_video_transform_test_case> {
+    static constexpr video_format_t nv12{pixel_format_t::nv12, 64, 48, 30, 1};
+
+  public:
+    static video_frame_t make_frame(const video_format_t& format) {
+        video_frame_t frame = allocate_frame(format);
+        for (uint32_t i = 0; i < get_plane_count(format.pixel); ++i) {
+            const plane_extent_t extent = get_plane_extent(format, i);
+            for (uint32_t y = 0; y < extent.rows; ++y)
+                for (uint32_t x = 0; x < extent.row_bytes; ++x)
+                    frame.planes[i].data[y * frame.planes[i].stride + x] =
+                        static_cast<uint8_t>(i ? 112 + x % 32 : 16 + (x + y) * 2);
+        }
+        return frame;
+    }
+
+    TEST_METHOD(test_media_type_round_trip) {
+        auto media_type = make_media_type(nv12);
+        Assert::IsTrue(to_video_format(media_type.get()) == nv12);
+        Assert::IsTrue(to_pixel_format(MFVideoFormat_IYUV) == pixel_format_t::i420);
+        Assert::IsTrue(IsEqualGUID(to_subtype(pixel_format_t::unknown), GUID_NULL));
+    }
+
+    TEST_METHOD(test_sample_round_trip) {
+        video_frame_t frame = make_frame(nv12);
+        frame.timestamp = 333'333;
+        frame.flags = frame_flag_keyframe;
+        winrt::com_ptr<IMFSample> sample{};
+        Assert::AreEqual(make_sample(frame, sample.put()), S_OK);
+        video_frame_t wrapped{};
+        Assert::AreEqual(make_video_frame(sample.get(), nv12, wrapped), S_OK);
+        Assert::AreEqual<int64_t>(wrapped.timestamp, 333'333);
+        Assert::IsTrue(wrapped.keyframe());
+        Assert::AreEqual(wrapped.planes[1].data[3], frame.planes[1].data[3]);
+        // the next MF stage takes the same sample
+        winrt::com_ptr<IMFSample> reused{};
+        Assert::AreEqual(make_sample(wrapped, reused.put()), S_OK);
+        Assert::IsTrue(reused.get() == sample.get());
+    }
+
+    /// @brief `CLSID_CColorConvertDMO` and `cpu_converter_t` should be close
+    TEST_METHOD(test_color_converter_backend) {
+        color_converter_t converter{};
+        mf_video_transform_t backend{converter.transform};
+        const video_format_t rgb32{pixel_format_t::rgb32, 64, 48, 30, 1};
+        Assert::IsTrue(backend.set_input_format(nv12) == transform_result_t::ok);
+        Assert::IsTrue(backend.set_output_format(rgb32) == transform_result_t::ok);
+
+        video_frame_t input = make_frame(nv12);
+        Assert::IsTrue(backend.process_input(input) == transform_result_t::ok);
+        video_frame_t output{};
+        Assert::IsTrue(backend.process_output(output) == transform_result_t::ok);
+        Assert::IsTrue(output.format.same_layout(rgb32));
+
+        video_frame_t expected = allocate_frame(rgb32);
+        convert_frame(input, expected);
+        for (uint32_t y = 0; y < rgb32.height; ++y)
+            for (uint32_t x = 0; x < rgb32.width * 4; x += 4)
+                for (uint32_t c = 0; c < 3; ++c)
+                    Assert::IsTrue(std::abs(output.planes[0].data[y * output.planes[0].stride + x + c] -
+                                            expected.planes[0].data[y * expected.planes[0].stride + x + c]) <= 3);
+    }
+
+    TEST_METHOD(test_pipeline_with_cpu_stages) {
+        color_converter_t converter{};
+        auto backend = std::make_shared<mf_video_transform_t>(converter.transform);
+        const video_format_t rgb32{pixel_format_t::rgb32, 64, 48, 30, 1};
+        Assert::IsTrue(backend->set_input_format(nv12) == transform_result_t::ok);
+        Assert::IsTrue(backend->set_output_format(rgb32) == transform_result_t::ok);
+        auto scaler = std::make_shared<cpu_scaler_t>();
+        Assert::IsTrue(scaler->set_input_format(rgb32) == transform_result_t::ok);
+        Assert::IsTrue(scaler->set_size(32, 24) == transform_result_t::ok);
+
+        video_pipeline_t pipeline{};
+        pipeline.add(backend, "color_converter_t");
+        pipeline.add(scaler, "cpu_scaler_t");
+        size_t count = 0;
+        Assert::IsTrue(pipeline.start([&count](const video_frame_t& frame) {
+            count += frame.format.width == 32;
+            return transform_result_t::ok;
+        }) == transform_result_t::ok);
+        for (int64_t i = 0; i < 10; ++i) {
+            video_frame_t frame = make_frame(nv12);
+            frame.timestamp = i * 333'333;
+            Assert::IsTrue(pipeline.push(frame));
+        }
+        Assert::IsTrue(pipeline.finish() == transform_result_t::ok);
+        Assert::AreEqual<size_t>(count, 10);
+    }
+
+    /// @brief Split `test-sample-0.mp4` at the IDR frames and decode with 2 `h264_decoder_t`
+    TEST_METHOD(test_gop_decoder) {
+        winrt::com_ptr<IMFSourceReader> reader{};
+        Assert::AreEqual(MFCreateSourceReaderFromURL(L"test-sample-0.mp4", nullptr, reader.put()), S_OK);
+        const auto stream = static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM);
+        winrt::com_ptr<IMFMediaType> source_type{};
+        Assert::AreEqual(reader->GetNativeMediaType(stream, 0, source_type.put()), S_OK);
+        Assert::AreEqual(reader->SetCurrentMediaType(stream, nullptr, source_type.get()), S_OK);
+        const video_format_t source_format = to_video_format(source_type.get());
+        Assert::IsTrue(source_format.pixel == pixel_format_t::h264);
+
+        gop_decoder_t decoder{[source_type]() { return make_h264_decoder(source_type.get(), pixel_format_t::nv12); },
+                              2};
+        std::vector<int64_t> timestamps{};
+        Assert::IsTrue(decoder.start([&timestamps](const video_frame_t& frame) {
+            timestamps.emplace_back(frame.timestamp);
+            return transform_result_t::ok;
+        }) == transform_result_t::ok);
+        size_t num_input = 0;
+        while (true) {
+            DWORD index = 0, flags = 0;
+            LONGLONG timestamp = 0;
+            winrt::com_ptr<IMFSample> sample{};
+            Assert::AreEqual(reader->ReadSample(stream, 0, &index, &flags, &timestamp, sample.put()), S_OK);
+            if (flags & MF_SOURCE_READERF_ENDOFSTREAM)
+                break;
+            if (sample == nullptr)
+                continue;
+            video_frame_t frame{};
+            Assert::AreEqual(make_video_frame(sample.get(), source_format, frame), S_OK);
+            Assert::IsTrue(decoder.push(std::move(frame)));
+            ++num_input;
+        }
+        Assert::IsTrue(decoder.finish() == transform_result_t::ok);
+        Assert::AreNotEqual<size_t>(decoder.segment_count(), 0);
+        Assert::AreEqual(timestamps.size(), num_input);
+        Assert::IsTrue(std::is_sorted(timestamps.begin(), timestamps.end()));
+    }
+
+    /// @brief Seek to the keyframes of `test-sample-0.mp4` and decode them at 160x160 at most
+    TEST_METHOD(test_thumbnail_decoder) {
+        winrt::com_ptr<IMFSourceReader> reader{};
+        Assert::AreEqual(MFCreateSourceReaderFromURL(L"test-sample-0.mp4", nullptr, reader.put()), S_OK);
+        const auto stream = static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM);
+        winrt::com_ptr<IMFMediaType> source_type{};
+        Assert::AreEqual(reader->GetNativeMediaType(stream, 0, source_type.put()), S_OK);
+        Assert::AreEqual(reader->SetCurrentMediaType(stream, nullptr, source_type.get()), S_OK);
+        const video_format_t source_format = to_video_format(source_type.get());
+
+        auto decoder = make_h264_decoder(source_type.get(), pixel_format_t::nv12);
+        h264_decoder_t::configure_thumbnail(decoder->get());
+        thumbnail_decoder_t thumbnails{decoder, 10'000'000, 160, 160};
+        std::vector<video_frame_t> outputs{};
+        video_frame_t frame{};
+        while (read_keyframe(reader.get(), stream, thumbnails.next_position(), source_format, frame) == S_OK) {
+            Assert::IsTrue(frame.keyframe());
+            Assert::IsTrue(thumbnails.process(frame, [&outputs](const video_frame_t& output) {
+                outputs.emplace_back(output);
+                return transform_result_t::ok;
+            }) == transform_result_t::ok);
+        }
+        Assert::AreNotEqual<size_t>(outputs.size(), 0);
+        Assert::AreEqual<size_t>(thumbnails.skipped_count(), 0);
+        for (const auto& output : outputs)
+            Assert::IsTrue(output.format.width <= 160 && output.format.height <= 160);
+    }
+
+    /// @brief The type from the parameter sets should be same with the one of the source reader
+    TEST_METHOD(test_make_h264_type) {
+        winrt::com_ptr<IMFSourceReader> reader{};
+        Assert::AreEqual(MFCreateSourceReaderFromURL(L"test-sample-0.mp4", nullptr, reader.put()), S_OK);
+        const auto stream = static_cast<DWORD>(MF_SOURCE_READER_FIRST_VIDEO_STREAM);
+        winrt::com_ptr<IMFMediaType> source_type{};
+        Assert::AreEqual(reader->GetNativeMediaType(stream, 0, source_type.put()), S_OK);
+        UINT8* blob = nullptr;
+        UINT32 size = 0;
+        Assert::AreEqual(source_type->GetAllocatedBlob(MF_MT_MPEG_SEQUENCE_HEADER, &blob, &size), S_OK);
+        const std::vector<uint8_t> header{blob, blob + size};
+        CoTaskMemFree(blob);
+
+        h264_sps_t sps{};
+        Assert::IsTrue(probe_h264(header.data(), header.size(), sps));
+        auto media_type = make_h264_type(header.data(), header.size());
+        const video_format_t format = to_video_format(media_type.get());
+        const video_format_t source_format = to_video_format(source_type.get());
+        Assert::AreEqual(format.width, source_format.width);
+        Assert::AreEqual(format.height, source_format.height);
+        Assert::AreEqual(format.width, sps.width());
+        Assert::IsTrue(h264_decoder_t{}.support(media_type.get()));
+        Assert::IsTrue(make_h264_decoder(media_type.get(), pixel_format_t::nv12) != nullptr);
+    }
+};
@@ -0,0 +1,112 @@
+#include <catch2/catch.hpp>
+
+#include <cstring>
+#include <stdexcept>
+
+#include "mosaic.hpp"
+#include "test_frames.hpp"
+
+namespace {
+
+/// @brief The cell scaled by `scale_frame`
+video_frame_t make_expected(const video_frame_t& input, video_rect_t cell) {
+    video_frame_t expected = allocate_frame({input.format.pixel, cell.width, cell.height});
+    scale_frame(input, expected);
+    return expected;
+}
+
+} // namespace
+
+TEST_CASE("mosaic_compositor_t", "[mosaic]") {
+    mosaic_options_t options{};
+    options.columns = 3;
+    options.rows = 2;
+    options.border = 4;
+    options.color[0] = 255; // red
+
+    SECTION("same as scale_frame into the cells") {
+        const auto pixel = GENERATE(pixel_format_t::i420, pixel_format_t::nv12, pixel_format_t::rgb32);
+        const auto num_threads = GENERATE(1u, 4u);
+        options.format = {pixel, 320, 180, 30, 1};
+        mosaic_compositor_t mosaic{options, num_threads};
+        REQUIRE(mosaic.cell_count() == 6);
+        const video_rect_t cell = mosaic.get_cell(4);
+        REQUIRE(cell.x == 4 + 1 * (cell.width + 4));
+        REQUIRE(cell.y == 4 + 1 * (cell.height + 4));
+        REQUIRE(cell.width == (pixel == pixel_format_t::rgb32 ? 101 : 100)); // even for YUV
+        REQUIRE(cell.height == 84);
+        REQUIRE_THROWS_AS(mosaic.get_cell(6), std::out_of_range);
+
+        std::vector<video_frame_t> inputs{};
+        for (uint32_t i = 0; i < 5; ++i) { // the last cell stays empty
+            video_frame_t& input = inputs.emplace_back(make_noise_frame({pixel, 96 + 64 * i, 54 + 36 * i}, i + 1));
+            input.timestamp = 1000 * i;
+            mosaic.update(i, input);
+        }
+        const video_frame_t output = mosaic.compose();
+        REQUIRE(mosaic.drawn_count() == 5);
+        REQUIRE(output.format == options.format);
+        REQUIRE(output.timestamp == 4000);
+        for (uint32_t i = 0; i < 5; ++i)
+            REQUIRE(same_pixels(crop_frame(output, mosaic.get_cell(i)), make_expected(inputs[i], mosaic.get_cell(i))));
+
+        // the border and the empty cell are red
+        video_frame_t red = allocate_frame({pixel_format_t::rgb32, 320, 180});
+        for (uint32_t y = 0; y < 180; ++y)
+            for (uint32_t x = 0; x < 320; ++x)
+                std::memcpy(red.planes[0].data + y * red.planes[0].stride + x * 4, "\x00\x00\xFF\xFF", 4);
+        video_frame_t fill = allocate_frame(options.format);
+        convert_frame(red, fill);
+        REQUIRE(same_pixels(crop_frame(output, mosaic.get_cell(5)), crop_frame(fill, mosaic.get_cell(5))));
+        REQUIRE(same_pixels(crop_frame(output, {0, 0, 320, 4}), crop_frame(fill, {0, 0, 320, 4})));
+        REQUIRE(same_pixels(crop_frame(output, {316, 0, 4, 180}), crop_frame(fill, {316, 0, 4, 180})));
+    }
+    SECTION("only the updated cells are drawn") {
+        options.format = {pixel_format_t::nv12, 320, 180, 30, 1};
+        mosaic_compositor_t mosaic{options, 2};
+        const video_frame_t first = make_noise_frame({pixel_format_t::nv12, 640, 360}, 1);
+        const video_frame_t second = make_noise_frame({pixel_format_t::nv12, 640, 360}, 2);
+        mosaic.update(0, first);
+        mosaic.update(1, second);
+        video_frame_t output = mosaic.compose();
+        REQUIRE(mosaic.drawn_count() == 2);
+        const uint8_t* pixels = output.planes[0].data;
+        output = video_frame_t{};
+
+        // the same frame again is not drawn. the output is not shared, so it is written in place
+        mosaic.update(0, first);
+        output = mosaic.compose();
+        REQUIRE(mosaic.drawn_count() == 0);
+        REQUIRE(output.planes[0].data == pixels);
+
+        // the previous output is kept by the consumer. the next one is a copy with the new cell
+        const video_frame_t previous = output;
+        const video_frame_t third = make_noise_frame({pixel_format_t::nv12, 320, 240}, 3);
+        mosaic.update(1, third);
+        output = mosaic.compose();
+        REQUIRE(mosaic.drawn_count() == 1);
+        REQUIRE(output.planes[0].data != previous.planes[0].data);
+        REQUIRE(same_pixels(crop_frame(previous, mosaic.get_cell(1)), make_expected(second, mosaic.get_cell(1))));
+        REQUIRE(same_pixels(crop_frame(output, mosaic.get_cell(1)), make_expected(third, mosaic.get_cell(1))));
+        REQUIRE(same_pixels(crop_frame(output, mosaic.get_cell(0)), make_expected(first, mosaic.get_cell(0))));
+
+        mosaic.clear(0);
+        output = mosaic.compose();
+        REQUIRE(mosaic.drawn_count() == 1);
+        REQUIRE(same_pixels(crop_frame(output, mosaic.get_cell(0)), crop_frame(output, mosaic.get_cell(5))));
+    }
+    SECTION("invalid arguments") {
+        options.format = {pixel_format_t::nv12, 320, 180, 30, 1};
+        options.border = 3;
+        REQUIRE_THROWS_AS(mosaic_compositor_t{options}, std::invalid_argument);
+        options.border = 80;
+        REQUIRE_THROWS_AS(mosaic_compositor_t{options}, std::invalid_argument);
+        options.border = 2;
+        options.format.pixel = pixel_format_t::h264;
+        REQUIRE_THROWS_AS(mosaic_compositor_t{options}, std::invalid_argument);
+        options.format.pixel = pixel_format_t::nv12;
+        mosaic_compositor_t mosaic{options};
+        REQUIRE_THROWS_AS(mosaic.update(0, make_noise_frame({pixel_format_t::i420, 64, 64}, 1)), std::invalid_argument);
+        REQUIRE_THROWS_AS(mosaic.update(6, make_noise_frame({pixel_format_t::nv12, 64, 64}, 1)), std::out_of_range);
+    }
+}
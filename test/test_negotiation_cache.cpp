@@ -0,0 +1,126 @@
+#include <catch2/catch.hpp>
+
+#include <fstream>
+
+#include "negotiation_cache.hpp"
+
+namespace {
+
+const negotiation_key_t decoder_rgb32{"62CE7E72-4C71-4D20-B15D-452831A87D9D", "H264 1280x720 30/1 2 00000000deadbeef",
+                                      "RGB32 1280x720 30/1 2 0000000000000000"};
+const negotiation_key_t decoder_nv12{"62CE7E72-4C71-4D20-B15D-452831A87D9D", "H264 1280x720 30/1 2 00000000deadbeef",
+                                     "NV12 1280x720 30/1 2 0000000000000000"};
+
+negotiation_entry_t make_accepted() {
+    negotiation_entry_t entry{};
+    entry.num_input = entry.num_output = 1;
+    entry.input_max_latency = -1;
+    entry.input_flags = 7;
+    entry.input_alignment = 16;
+    entry.output_flags = 0x100;
+    entry.output_size = 1280 * 720 * 3 / 2;
+    return entry;
+}
+
+} // namespace
+
+TEST_CASE("negotiation_cache_t", "[negotiation_cache]") {
+    const auto fpath = std::filesystem::temp_directory_path() / "media0-negotiation-test.txt";
+    std::filesystem::remove(fpath);
+
+    negotiation_entry_t rejected{};
+    rejected.result = negotiation_result_t::output_rejected;
+    rejected.error = static_cast<int32_t>(0xC00D36B4); // MF_E_INVALIDMEDIATYPE
+
+    SECTION("find and record") {
+        negotiation_cache_t cache{};
+        REQUIRE_FALSE(cache.find(decoder_rgb32));
+        cache.record(decoder_rgb32, rejected);
+        REQUIRE(cache.dirty());
+        auto entry = cache.find(decoder_rgb32);
+        REQUIRE(entry);
+        REQUIRE(entry->result == negotiation_result_t::output_rejected);
+        REQUIRE(entry->error == rejected.error);
+        REQUIRE_FALSE(cache.find(decoder_nv12));
+        const auto stats = cache.stats();
+        REQUIRE(stats.hits == 1);
+        REQUIRE(stats.misses == 2);
+        REQUIRE(stats.size == 1);
+    }
+
+    SECTION("save and load") {
+        {
+            negotiation_cache_t cache{"10.0.22621 driver 31.0"};
+            cache.record(decoder_rgb32, rejected);
+            cache.record(decoder_nv12, make_accepted());
+            cache.save(fpath);
+            REQUIRE_FALSE(cache.dirty());
+        }
+        negotiation_cache_t cache{"10.0.22621 driver 31.0"};
+        REQUIRE(cache.load(fpath) == 2);
+        auto entry = cache.find(decoder_nv12);
+        REQUIRE(entry);
+        const auto expected = make_accepted();
+        REQUIRE(entry->result == negotiation_result_t::accepted);
+        REQUIRE(entry->input_max_latency == -1);
+        REQUIRE(entry->input_flags == expected.input_flags);
+        REQUIRE(entry->output_size == expected.output_size);
+        REQUIRE(cache.find(decoder_rgb32)->error == rejected.error);
+        REQUIRE_FALSE(cache.dirty());
+    }
+
+    SECTION("record before load") {
+        {
+            negotiation_cache_t cache{"driver 31"};
+            cache.record(decoder_nv12, make_accepted());
+            cache.save(fpath);
+        }
+        negotiation_cache_t cache{"driver 31"};
+        cache.record(decoder_rgb32, rejected);
+        REQUIRE(cache.load(fpath) == 1);
+        REQUIRE(cache.dirty()); // the file doesn't have `decoder_rgb32`
+        cache.save(fpath);
+        REQUIRE_FALSE(cache.dirty());
+    }
+
+    SECTION("other environment is ignored") {
+        {
+            negotiation_cache_t cache{"driver 30"};
+            cache.record(decoder_nv12, make_accepted());
+            cache.save(fpath);
+        }
+        negotiation_cache_t cache{"driver 31"};
+        REQUIRE(cache.load(fpath) == 0);
+        REQUIRE(cache.stats().size == 0);
+    }
+
+    SECTION("other version is ignored") {
+        {
+            std::ofstream fout{fpath};
+            fout << "media0-negotiation 1 \"\"\n";
+            // the keys of the version 1 have no stride, aspect ratio, range and profile
+            fout << "\"62CE7E72-4C71-4D20-B15D-452831A87D9D\" \"H264 1280x720 30/1 2 00000000deadbeef\" "
+                    "\"NV12 1280x720 30/1 2 0000000000000000\" 0 0 1 1 0 0 -1 7 0 0 16 256 1382400 0\n";
+        }
+        negotiation_cache_t cache{};
+        REQUIRE(cache.load(fpath) == 0);
+        REQUIRE(cache.stats().size == 0);
+    }
+
+    SECTION("missing and broken files") {
+        negotiation_cache_t cache{};
+        REQUIRE(cache.load(fpath) == 0);
+        {
+            std::ofstream fout{fpath};
+            fout << "not a cache\n";
+        }
+        REQUIRE_THROWS_AS(cache.load(fpath), std::runtime_error);
+        {
+            std::ofstream fout{fpath};
+            fout << "media0-negotiation 2 \"\"\n";
+            fout << "\"broken\" 1\n";
+        }
+        REQUIRE(cache.load(fpath) == 0);
+    }
+    std::filesystem::remove(fpath);
+}
@@ -0,0 +1,149 @@
+#include <catch2/catch.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "overlay.hpp"
+#include "test_frames.hpp"
+
+namespace {
+
+/// @brief Premultiplied ARGB32 of one color. The left half has the `alpha`, the right half is transparent
+video_frame_t make_layer(uint32_t width, uint32_t height, const uint8_t (&rgb)[3], uint8_t alpha) {
+    video_frame_t image = allocate_frame({pixel_format_t::argb32, width, height});
+    for (uint32_t y = 0; y < height; ++y)
+        for (uint32_t x = 0; x < width; ++x) {
+            uint8_t* bgra = image.planes[0].data + y * image.planes[0].stride + x * 4;
+            const uint32_t a = x < width / 2 ? alpha : 0;
+            bgra[0] = static_cast<uint8_t>((rgb[2] * a + 127) / 255);
+            bgra[1] = static_cast<uint8_t>((rgb[1] * a + 127) / 255);
+            bgra[2] = static_cast<uint8_t>((rgb[0] * a + 127) / 255);
+            bgra[3] = static_cast<uint8_t>(a);
+        }
+    return image;
+}
+
+video_frame_t process(cpu_overlay_t& overlay, const video_frame_t& input) {
+    REQUIRE(overlay.process_input(input) == transform_result_t::ok);
+    video_frame_t output{};
+    REQUIRE(overlay.process_output(output) == transform_result_t::ok);
+    return output;
+}
+
+const uint8_t* at(const video_frame_t& frame, uint32_t plane, uint32_t x, uint32_t y) {
+    return frame.planes[plane].data + static_cast<size_t>(y) * frame.planes[plane].stride + x;
+}
+
+} // namespace
+
+TEST_CASE("blend_row", "[overlay]") {
+    std::vector<uint8_t> src(100), alpha(100), dst(100);
+    uint32_t seed = 3;
+    for (size_t i = 0; i < dst.size(); ++i) {
+        alpha[i] = next_random(seed);
+        src[i] = static_cast<uint8_t>(next_random(seed) * alpha[i] / 255);
+        dst[i] = next_random(seed);
+    }
+    alpha[0] = 0;
+    alpha[1] = 255;
+    std::vector<uint8_t> expected(dst.size());
+    for (size_t i = 0; i < dst.size(); ++i)
+        expected[i] =
+            static_cast<uint8_t>(std::min<long>(src[i] + std::lround(dst[i] * (255 - alpha[i]) / 255.0), 255));
+    blend_row(src.data(), alpha.data(), static_cast<uint32_t>(dst.size()), dst.data());
+    REQUIRE(dst == expected);
+}
+
+TEST_CASE("cpu_overlay_t", "[overlay]") {
+    const uint8_t red[3]{255, 0, 0};
+    const uint8_t blue[3]{0, 0, 255};
+    cpu_overlay_t overlay{};
+
+    SECTION("rgb32") {
+        const video_frame_t input = make_noise_frame({pixel_format_t::rgb32, 160, 90}, 5);
+        REQUIRE(overlay.set_input_format(input.format) == transform_result_t::ok);
+        const video_frame_t image = make_layer(40, 20, red, 128);
+        (void)overlay.add_layer(image, 130, 80); // clipped by the frame
+        const video_frame_t output = process(overlay, input);
+        REQUIRE(output.planes[0].data != input.planes[0].data);
+        for (uint32_t y = 0; y < 90; ++y)
+            for (uint32_t x = 0; x < 160; ++x) {
+                const uint8_t* before = at(input, 0, x * 4, y);
+                const uint8_t* after = at(output, 0, x * 4, y);
+                if (x < 130 || y < 80 || x >= 150) {
+                    REQUIRE(std::memcmp(before, after, 4) == 0);
+                    continue;
+                }
+                const uint8_t* bgra = at(image, 0, (x - 130) * 4, y - 80);
+                for (uint32_t c = 0; c < 4; ++c)
+                    REQUIRE(after[c] == bgra[c] + std::lround(before[c] * 127 / 255.0));
+            }
+    }
+    SECTION("nv12") {
+        const video_frame_t input = make_noise_frame({pixel_format_t::nv12, 160, 90}, 5);
+        REQUIRE(overlay.set_input_format(input.format) == transform_result_t::ok);
+        (void)overlay.add_layer(make_layer(64, 16, red, 255), 33, 41); // at 32, 40
+        const video_frame_t output = process(overlay, input);
+
+        // the opaque half is the red of `convert_frame`
+        video_frame_t rgb = allocate_frame({pixel_format_t::rgb32, 2, 2});
+        for (uint32_t i = 0; i < 4; ++i)
+            std::memcpy(rgb.planes[0].data + (i / 2) * rgb.planes[0].stride + (i % 2) * 4, "\x00\x00\xFF\xFF", 4);
+        video_frame_t yuv = allocate_frame({pixel_format_t::nv12, 2, 2});
+        convert_frame(rgb, yuv);
+        for (uint32_t y = 0; y < 90; ++y)
+            for (uint32_t x = 0; x < 160; ++x) {
+                const bool inside = x >= 32 && x < 64 && y >= 40 && y < 56;
+                REQUIRE(*at(output, 0, x, y) == (inside ? yuv.planes[0].data[0] : *at(input, 0, x, y)));
+                if (x % 2 == 0 && y % 2 == 0) {
+                    REQUIRE(*at(output, 1, x, y / 2) == (inside ? yuv.planes[1].data[0] : *at(input, 1, x, y / 2)));
+                    REQUIRE(*at(output, 1, x + 1, y / 2) ==
+                            (inside ? yuv.planes[1].data[1] : *at(input, 1, x + 1, y / 2)));
+                }
+            }
+    }
+    SECTION("dirty rectangle") {
+        const video_frame_t input = make_noise_frame({pixel_format_t::rgb32, 64, 64}, 5);
+        REQUIRE(overlay.set_input_format(input.format) == transform_result_t::ok);
+        video_frame_t image = make_layer(32, 8, red, 255);
+        const uint32_t id = overlay.add_layer(image, 0, 0);
+        (void)process(overlay, input);
+
+        // the whole image is blue. only the first 8 pixels are declared
+        const video_frame_t update = make_layer(32, 8, blue, 255);
+        overlay.update_layer(id, update, {0, 0, 8, 8});
+        const video_frame_t output = process(overlay, input);
+        REQUIRE(std::memcmp(at(output, 0, 4 * 4, 4), "\xFF\x00\x00\xFF", 4) == 0);
+        REQUIRE(std::memcmp(at(output, 0, 12 * 4, 4), "\x00\x00\xFF\xFF", 4) == 0);
+        REQUIRE_THROWS_AS(overlay.update_layer(id, make_layer(16, 8, blue, 255)), std::invalid_argument);
+        REQUIRE_THROWS_AS(overlay.update_layer(id + 1, update), std::out_of_range);
+
+        overlay.move_layer(id, 32, 32);
+        const video_frame_t moved = process(overlay, input);
+        REQUIRE(std::memcmp(at(moved, 0, 4 * 4, 4), at(input, 0, 4 * 4, 4), 4) == 0);
+        REQUIRE(std::memcmp(at(moved, 0, 36 * 4, 36), "\xFF\x00\x00\xFF", 4) == 0);
+
+        // no layer. the input is shared
+        overlay.remove_layer(id);
+        REQUIRE(overlay.layer_count() == 0);
+        REQUIRE(process(overlay, input).planes[0].data == input.planes[0].data);
+    }
+    SECTION("in place") {
+        const video_frame_t input = make_noise_frame({pixel_format_t::nv12, 160, 90}, 5);
+        const video_frame_t copy = make_noise_frame({pixel_format_t::nv12, 160, 90}, 5);
+        REQUIRE(overlay.set_input_format(input.format) == transform_result_t::ok);
+        (void)overlay.add_layer(make_layer(48, 24, blue, 200), 100, 10);
+        const video_frame_t expected = process(overlay, copy);
+        overlay.set_in_place(true);
+        const video_frame_t output = process(overlay, input);
+        REQUIRE(output.planes[0].data == input.planes[0].data);
+        REQUIRE(same_pixels(output, expected));
+    }
+    SECTION("invalid arguments") {
+        REQUIRE(overlay.set_input_format({pixel_format_t::i420, 64, 64}) == transform_result_t::invalid_format);
+        const video_frame_t rgb = make_noise_frame({pixel_format_t::rgb32, 8, 8}, 5);
+        REQUIRE_THROWS_AS(overlay.add_layer(rgb, 0, 0), std::invalid_argument);
+        REQUIRE_THROWS_AS(overlay.remove_layer(1), std::out_of_range);
+    }
+}
@@ -0,0 +1,107 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "pyramid.hpp"
+#include "test_frames.hpp"
+
+namespace {
+
+video_frame_t make_frame(const video_format_t& format) {
+    video_frame_t frame = make_noise_frame(format, 5);
+    frame.timestamp = 1000;
+    frame.duration = 333;
+    return frame;
+}
+
+/// @brief The box of `halve_row` for each sample
+bool is_half_of(const video_frame_t& src, const video_frame_t& dst) {
+    for (uint32_t i = 0; i < get_plane_count(src.format.pixel); ++i) {
+        const uint32_t channels = src.format.pixel == pixel_format_t::nv12 ? (i ? 2 : 1)
+                                  : src.format.pixel == pixel_format_t::i420 ? 1
+                                                                               : 4;
+        const plane_extent_t from = get_plane_extent(src.format, i);
+        const plane_extent_t to = get_plane_extent(dst.format, i);
+        const uint32_t width = from.row_bytes / channels;
+        auto sample = [&](uint32_t x, uint32_t y, uint32_t c) -> uint32_t {
+            x = std::min(x, width - 1), y = std::min(y, from.rows - 1);
+            return src.planes[i].data[y * src.planes[i].stride + x * channels + c];
+        };
+        auto average = [](uint32_t a, uint32_t b) { return (a + b + 1) / 2; };
+        for (uint32_t y = 0; y < to.rows; ++y)
+            for (uint32_t x = 0; x < to.row_bytes / channels; ++x)
+                for (uint32_t c = 0; c < channels; ++c) {
+                    const uint32_t expected =
+                        average(average(sample(2 * x, 2 * y, c), sample(2 * x, 2 * y + 1, c)),
+                                average(sample(2 * x + 1, 2 * y, c), sample(2 * x + 1, 2 * y + 1, c)));
+                    if (dst.planes[i].data[y * dst.planes[i].stride + x * channels + c] != expected)
+                        return false;
+                }
+    }
+    return true;
+}
+
+} // namespace
+
+TEST_CASE("pyramid_generator_t", "[pyramid]") {
+    SECTION("octaves of the previous level") {
+        const auto pixel = GENERATE(pixel_format_t::nv12, pixel_format_t::i420, pixel_format_t::rgb32);
+        const auto width = GENERATE(256u, 333u);
+        const video_format_t format{pixel, width, 91};
+        const video_frame_t frame = make_frame(format);
+        pyramid_generator_t pyramid{3};
+        std::vector<video_frame_t> levels{};
+        pyramid.generate(frame, levels);
+        REQUIRE(levels.size() == 3);
+        for (uint32_t i = 0; i < 3; ++i) {
+            REQUIRE(levels[i].format == get_octave_format(format, i + 1));
+            REQUIRE(levels[i].timestamp == frame.timestamp);
+            REQUIRE(levels[i].duration == frame.duration);
+            REQUIRE(is_half_of(i ? levels[i - 1] : frame, levels[i]));
+        }
+        REQUIRE(levels[2].format.width == (width + 7) / 8);
+        REQUIRE(levels[2].format.height == 12);
+    }
+    SECTION("pooled outputs") {
+        pyramid_generator_t pyramid{2, 2};
+        std::vector<video_frame_t> levels{};
+        const video_frame_t frame = make_frame({pixel_format_t::nv12, 64, 64});
+        for (int i = 0; i < 4; ++i)
+            pyramid.generate(frame, levels); // the last outputs go back to the pools first
+        REQUIRE(pyramid.stats(1).allocated == 1);
+        REQUIRE(pyramid.stats(1).reused == 3);
+        const std::vector<video_frame_t> kept = levels;
+        pyramid.generate(frame, levels);
+        REQUIRE(pyramid.stats(2).allocated == 2);
+        REQUIRE(levels[1].planes[0].data != kept[1].planes[0].data);
+        REQUIRE_THROWS_AS(pyramid.stats(0), std::out_of_range);
+
+        // the new size resets the pools
+        const video_frame_t larger = make_frame({pixel_format_t::nv12, 128, 72});
+        pyramid.generate(larger, levels);
+        REQUIRE(levels[1].format.width == 32);
+        REQUIRE(levels[1].format.height == 18);
+        REQUIRE(is_half_of(larger, levels[0]));
+        REQUIRE(is_half_of(levels[0], levels[1]));
+    }
+    SECTION("down to 1 pixel") {
+        pyramid_generator_t pyramid{8};
+        std::vector<video_frame_t> levels{};
+        const video_frame_t frame = make_frame({pixel_format_t::i420, 40, 6});
+        pyramid.generate(frame, levels);
+        REQUIRE(levels.back().format.width == 1);
+        REQUIRE(levels.back().format.height == 1);
+        for (uint32_t i = 1; i < 8; ++i)
+            REQUIRE(is_half_of(levels[i - 1], levels[i]));
+    }
+    SECTION("unsupported") {
+        REQUIRE_THROWS_AS(pyramid_generator_t{0}, std::invalid_argument);
+        REQUIRE_THROWS_AS(pyramid_generator_t{9}, std::invalid_argument);
+        pyramid_generator_t pyramid{1};
+        std::vector<video_frame_t> levels{};
+        video_frame_t compressed{};
+        compressed.format = {pixel_format_t::h264, 64, 64};
+        REQUIRE_THROWS_AS(pyramid.generate(compressed, levels), std::invalid_argument);
+    }
+}
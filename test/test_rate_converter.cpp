@@ -0,0 +1,164 @@
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <vector>
+
+#include "rate_converter.hpp"
+#include "video_pipeline.hpp"
+
+namespace {
+
+/// @brief `process_input` and take the outputs like `video_transform_driver_t`
+void process(cpu_rate_converter_t& rate, const video_frame_t& input, std::vector<video_frame_t>& outputs) {
+    REQUIRE(rate.process_input(input) == transform_result_t::ok);
+    video_frame_t output{};
+    while (rate.process_output(output) == transform_result_t::ok)
+        outputs.emplace_back(output);
+}
+
+void drain(cpu_rate_converter_t& rate, std::vector<video_frame_t>& outputs) {
+    rate.drain();
+    video_frame_t output{};
+    while (rate.process_output(output) == transform_result_t::ok)
+        outputs.emplace_back(output);
+}
+
+/// @brief Index of the input which is nearest to the `timestamp`. The earlier one for a tie
+size_t find_nearest(const std::vector<video_frame_t>& inputs, int64_t timestamp) {
+    size_t nearest = 0;
+    for (size_t i = 1; i < inputs.size(); ++i)
+        if (std::abs(inputs[i].timestamp - timestamp) < std::abs(inputs[nearest].timestamp - timestamp))
+            nearest = i;
+    return nearest;
+}
+
+} // namespace
+
+TEST_CASE("cpu_rate_converter_t", "[rate_converter]") {
+    const video_format_t format{pixel_format_t::nv12, 64, 48, 60, 1};
+    frame_pool_t pool{format};
+    cpu_rate_converter_t rate{};
+    REQUIRE(rate.set_frame_rate(15, 1) == transform_result_t::not_ready);
+    REQUIRE(rate.set_input_format(format) == transform_result_t::ok);
+    std::vector<video_frame_t> inputs{};
+    std::vector<video_frame_t> outputs{};
+
+    SECTION("60 to 15 fps") {
+        REQUIRE(rate.set_frame_rate(15, 1) == transform_result_t::ok);
+        REQUIRE(rate.get_output_format().fps_num == 15);
+        for (int64_t i = 0; i < 60; ++i) {
+            video_frame_t& input = inputs.emplace_back(pool.acquire());
+            input.timestamp = 1000 + i * 10'000'000 / 60;
+            input.duration = 10'000'000 / 60;
+            process(rate, input, outputs);
+        }
+        drain(rate, outputs);
+        REQUIRE(outputs.size() == 15);
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            REQUIRE(outputs[i].timestamp == 1000 + static_cast<int64_t>(i) * 10'000'000 / 15);
+            REQUIRE(outputs[i].duration == 666'666);
+            // the nearest input. the pixels are shared
+            REQUIRE(outputs[i].planes[0].data == inputs[4 * i].planes[0].data);
+        }
+        REQUIRE(rate.dropped_count() == 45);
+        REQUIRE(rate.repeated_count() == 0);
+    }
+    SECTION("15 to 30 fps repeats by reference") {
+        REQUIRE(rate.set_frame_rate(30, 1) == transform_result_t::ok);
+        for (int64_t i = 0; i < 4; ++i) {
+            video_frame_t& input = inputs.emplace_back(pool.acquire());
+            input.timestamp = i * 10'000'000 / 15;
+            input.duration = 666'666;
+            input.flags = i == 0 ? frame_flag_keyframe : 0u;
+            process(rate, input, outputs);
+        }
+        drain(rate, outputs);
+        REQUIRE(outputs.size() == 8);
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            REQUIRE(outputs[i].timestamp == static_cast<int64_t>(i) * 10'000'000 / 30);
+            REQUIRE(outputs[i].storage == inputs[find_nearest(inputs, outputs[i].timestamp)].storage);
+        }
+        REQUIRE(outputs[0].flags == frame_flag_keyframe);
+        REQUIRE(rate.repeated_count() == 4);
+        REQUIRE(rate.dropped_count() == 0);
+    }
+    SECTION("variable rate input") {
+        REQUIRE(rate.set_frame_rate(30, 1) == transform_result_t::ok);
+        // jitter, then the camera stalls for 0.5 second
+        const int64_t timestamps[]{0, 300'000, 700'000, 1'000'000, 1'330'000, 6'330'000, 6'700'000};
+        for (int64_t timestamp : timestamps) {
+            video_frame_t& input = inputs.emplace_back(pool.acquire());
+            input.timestamp = timestamp;
+            process(rate, input, outputs);
+        }
+        drain(rate, outputs);
+        REQUIRE(outputs.size() == 21);
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            REQUIRE(outputs[i].timestamp == static_cast<int64_t>(i) * 10'000'000 / 30);
+            REQUIRE(outputs[i].planes[0].data == inputs[find_nearest(inputs, outputs[i].timestamp)].planes[0].data);
+        }
+    }
+    SECTION("timestamp goes back") {
+        REQUIRE(rate.set_frame_rate(30, 1) == transform_result_t::ok);
+        for (int64_t timestamp : {5'000'000, 5'333'333, 0, 333'333}) {
+            video_frame_t& input = inputs.emplace_back(pool.acquire());
+            input.timestamp = timestamp;
+            process(rate, input, outputs);
+        }
+        drain(rate, outputs);
+        REQUIRE(outputs.size() == 4);
+        REQUIRE(outputs[1].timestamp == 5'333'333);
+        REQUIRE(outputs[2].timestamp == 0);
+        REQUIRE(outputs[3].timestamp == 333'333);
+    }
+    SECTION("large terms of the frame rate") {
+        // 1 fps. `slot * 10'000'000 * fps_den` is more than INT64_MAX after the slot 307
+        REQUIRE(rate.set_frame_rate(3'000'000'000, 3'000'000'000) == transform_result_t::ok);
+        for (int64_t timestamp : {int64_t{0}, 7'000'000'000}) {
+            video_frame_t& input = inputs.emplace_back(pool.acquire());
+            input.timestamp = timestamp;
+            process(rate, input, outputs);
+        }
+        REQUIRE(outputs.size() == 351);
+        for (size_t i = 0; i < outputs.size(); ++i)
+            REQUIRE(outputs[i].timestamp == static_cast<int64_t>(i) * 10'000'000);
+    }
+    SECTION("no frame rate passes the inputs") {
+        REQUIRE(rate.set_frame_rate(0, 1) == transform_result_t::ok);
+        for (int64_t timestamp : {0, 10, 20}) {
+            video_frame_t& input = inputs.emplace_back(pool.acquire());
+            input.timestamp = timestamp;
+            process(rate, input, outputs);
+        }
+        REQUIRE(outputs.size() == 3);
+        REQUIRE(outputs[2].timestamp == 20);
+    }
+    SECTION("drops before the expensive stages") {
+        auto shared = std::make_shared<cpu_rate_converter_t>();
+        REQUIRE(shared->set_input_format(format) == transform_result_t::ok);
+        REQUIRE(shared->set_frame_rate(15, 1) == transform_result_t::ok);
+        auto converter = std::make_shared<cpu_converter_t>();
+        REQUIRE(converter->set_input_format(format) == transform_result_t::ok);
+        REQUIRE(converter->set_output_format({pixel_format_t::rgb32, 64, 48, 15, 1}) == transform_result_t::ok);
+        video_pipeline_t pipeline{};
+        pipeline.add(shared, "cpu_rate_converter_t");
+        pipeline.add(converter, "cpu_converter_t");
+        size_t count = 0;
+        REQUIRE(pipeline.start([&count](const video_frame_t& frame) {
+            if (frame.format.pixel != pixel_format_t::rgb32)
+                return transform_result_t::invalid_format;
+            ++count;
+            return transform_result_t::ok;
+        }) == transform_result_t::ok);
+        for (int64_t i = 0; i < 120; ++i) {
+            video_frame_t input = pool.acquire();
+            input.timestamp = i * 10'000'000 / 60;
+            input.duration = 10'000'000 / 60;
+            REQUIRE(pipeline.push(input));
+        }
+        REQUIRE(pipeline.finish() == transform_result_t::ok);
+        REQUIRE(count == 30);
+        REQUIRE(pipeline.stage(1).input_count() == 30);
+        REQUIRE(shared->dropped_count() == 90);
+    }
+}
@@ -0,0 +1,141 @@
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <vector>
+
+#include "reorder_buffer.hpp"
+#include "video_pipeline.hpp"
+
+namespace {
+
+/// @brief Frames of decode order with the timestamps of `pts * 1000`. The decode timestamps are `index * 1000`
+std::vector<video_frame_t> make_frames(const std::vector<int64_t>& pts) {
+    std::vector<video_frame_t> frames{};
+    for (size_t i = 0; i < pts.size(); ++i) {
+        video_frame_t frame{};
+        frame.format = video_format_t{pixel_format_t::i420, 16, 16};
+        frame.timestamp = static_cast<int64_t>(i) * 1000;
+        frame.duration = 1;
+        frame.flags = pts[i] == 0 ? frame_flag_keyframe : 0u;
+        frames.emplace_back(frame);
+    }
+    return frames;
+}
+
+/// @brief Push all frames with `pts * 1000 - dts` as their offsets and collect the outputs
+std::vector<video_frame_t> reorder(reorder_buffer_t& buffer, const std::vector<int64_t>& pts) {
+    std::vector<video_frame_t> outputs{};
+    video_frame_t output{};
+    const auto frames = make_frames(pts);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        REQUIRE(buffer.push(frames[i], pts[i] * 1000 - frames[i].timestamp));
+        while (buffer.pop(output))
+            outputs.emplace_back(output);
+        REQUIRE(buffer.size() < buffer.capacity());
+    }
+    buffer.drain();
+    while (buffer.pop(output))
+        outputs.emplace_back(output);
+    REQUIRE(buffer.size() == 0);
+    return outputs;
+}
+
+} // namespace
+
+TEST_CASE("reorder_buffer_t", "[reorder]") {
+    SECTION("B frames") {
+        reorder_buffer_t buffer{1}; // P3 precedes B1 and B2
+        const auto outputs = reorder(buffer, {0, 3, 1, 2, 6, 4, 5});
+        REQUIRE(outputs.size() == 7);
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            REQUIRE(outputs[i].timestamp == static_cast<int64_t>(i) * 1000);
+            // the last one keeps its own duration
+            REQUIRE(outputs[i].duration == (i + 1 < outputs.size() ? 1000 : 1));
+        }
+        REQUIRE(outputs[0].keyframe());
+    }
+    SECTION("B pyramid") {
+        reorder_buffer_t buffer{2}; // P4 and B2 precede b1
+        const auto outputs = reorder(buffer, {0, 4, 2, 1, 3, 8, 6, 5, 7});
+        REQUIRE(outputs.size() == 9);
+        for (size_t i = 0; i < outputs.size(); ++i)
+            REQUIRE(outputs[i].timestamp == static_cast<int64_t>(i) * 1000);
+    }
+    SECTION("no reorder") {
+        reorder_buffer_t buffer{0};
+        const auto frames = make_frames({0, 1, 2});
+        video_frame_t output{};
+        REQUIRE(buffer.push(frames[0], 0));
+        REQUIRE_FALSE(buffer.pop(output)); // the duration is not known yet
+        REQUIRE(buffer.push(frames[1], 0));
+        REQUIRE(buffer.pop(output));
+        REQUIRE(output.timestamp == 0);
+        REQUIRE(output.duration == 1000);
+        REQUIRE_FALSE(buffer.pop(output));
+    }
+    SECTION("full") {
+        reorder_buffer_t buffer{1};
+        const auto frames = make_frames({0, 2, 1});
+        REQUIRE(buffer.push(frames[0]));
+        REQUIRE(buffer.push(frames[1]));
+        REQUIRE_FALSE(buffer.push(frames[2]));
+        video_frame_t output{};
+        REQUIRE_FALSE(buffer.pop(output)); // moved to the last one
+        REQUIRE(buffer.push(frames[2]));
+    }
+    SECTION("drain and continue") {
+        reorder_buffer_t buffer{1};
+        REQUIRE(reorder(buffer, {0, 2, 1}).size() == 3);
+        REQUIRE(reorder(buffer, {0, 2, 1}).size() == 3);
+    }
+    SECTION("clear") {
+        reorder_buffer_t buffer{1};
+        const auto frames = make_frames({0, 2, 1});
+        for (const auto& frame : frames) {
+            REQUIRE(buffer.push(frame));
+            video_frame_t output{};
+            while (buffer.pop(output))
+                continue;
+        }
+        REQUIRE(buffer.size() > 0);
+        buffer.clear();
+        REQUIRE(buffer.size() == 0);
+    }
+}
+
+TEST_CASE("reorder_transform_t", "[reorder]") {
+    SECTION("driver") {
+        auto transform = std::make_shared<reorder_transform_t>(1);
+        REQUIRE(transform->set_output_format(video_format_t{pixel_format_t::i420, 16, 16}) ==
+                transform_result_t::not_ready);
+        REQUIRE(transform->set_input_format(video_format_t{pixel_format_t::i420, 16, 16}) == transform_result_t::ok);
+        REQUIRE(transform->set_output_format(video_format_t{pixel_format_t::nv12, 16, 16}) ==
+                transform_result_t::invalid_format);
+        REQUIRE(transform->set_output_format(video_format_t{pixel_format_t::i420, 16, 16}) == transform_result_t::ok);
+
+        // decoded frames with the presentation timestamps in decode order
+        auto frames = make_frames({0, 3, 1, 2});
+        for (size_t i = 0; i < frames.size(); ++i)
+            frames[i].timestamp = std::vector<int64_t>{0, 3000, 1000, 2000}[i];
+        std::vector<int64_t> timestamps{};
+        video_transform_driver_t driver{transform, "reorder_transform_t"};
+        const video_transform_driver_t::emit_t emit = [&timestamps](const video_frame_t& frame) {
+            timestamps.emplace_back(frame.timestamp);
+            return transform_result_t::ok;
+        };
+        for (const auto& frame : frames)
+            REQUIRE(driver.process(frame, emit) == transform_result_t::ok);
+        REQUIRE(driver.drain(emit) == transform_result_t::ok);
+        REQUIRE(timestamps == std::vector<int64_t>{0, 1000, 2000, 3000});
+    }
+    SECTION("make_reorder_transform") {
+        const uint8_t header[]{0x01, 0x4d, 0x00};
+        REQUIRE_THROWS_AS(make_reorder_transform(header, sizeof(header)), std::invalid_argument);
+        // avcC of x264, Main profile with B frames
+        const uint8_t avcc[]{0x01, 0x4d, 0x40, 0x0a, 0xff, 0xe1, 0x00, 0x17, 0x67, 0x4d, 0x40, 0x0a, 0xe9, 0x9a,
+                             0xf2, 0xcb, 0x08, 0x00, 0x00, 0x03, 0x00, 0x08, 0x00, 0x00, 0x03, 0x01, 0x90, 0x78,
+                             0x91, 0x29, 0xc0, 0x01, 0x00, 0x05, 0x68, 0xea, 0xe3, 0xcb, 0x20};
+        const auto transform = make_reorder_transform(avcc, sizeof(avcc));
+        REQUIRE(transform->set_input_format(video_format_t{pixel_format_t::i420, 40, 24}) == transform_result_t::ok);
+    }
+}
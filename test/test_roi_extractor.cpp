@@ -0,0 +1,66 @@
+#include <catch2/catch.hpp>
+
+#include <stdexcept>
+
+#include "roi_extractor.hpp"
+#include "test_frames.hpp"
+
+namespace {
+
+video_frame_t make_frame(pixel_format_t pixel, uint32_t width, uint32_t height) {
+    video_frame_t frame = make_noise_frame({pixel, width, height}, 11);
+    frame.timestamp = 4000;
+    return frame;
+}
+
+} // namespace
+
+TEST_CASE("roi_extractor_t", "[roi]") {
+    const std::vector<video_rect_t> regions{
+        {0, 0, 320, 180},     {10, 20, 64, 64},  {100, 33, 17, 150}, {250, 150, 200, 200}, // clipped
+        {101, 101, 64, 31},   {0, 170, 320, 10}, {5, 5, 1, 1},       {40, 60, 96, 48},
+    };
+
+    SECTION("same as crop_frame and scale_frame") {
+        const auto pixel = GENERATE(pixel_format_t::i420, pixel_format_t::nv12, pixel_format_t::rgb32);
+        const auto num_threads = GENERATE(1u, 4u);
+        const video_frame_t frame = make_frame(pixel, 320, 180);
+        roi_extractor_t extractor{num_threads};
+        const roi_batch_t batch = extractor.extract(frame, regions.data(), regions.size(), 48, 32);
+        REQUIRE(batch.frame.format.width == 48);
+        REQUIRE(batch.frame.format.height == 32 * regions.size());
+        REQUIRE(batch.frame.timestamp == frame.timestamp);
+        REQUIRE(batch.crops.size() == regions.size());
+        for (size_t i = 0; i < regions.size(); ++i) {
+            const video_frame_t& crop = batch.crops[i];
+            REQUIRE(crop.storage == batch.frame.storage);
+            REQUIRE(crop.planes[0].data == batch.frame.planes[0].data + i * 32 * batch.frame.planes[0].stride);
+            video_frame_t expected = allocate_frame(crop.format);
+            scale_frame(crop_frame(frame, regions[i]), expected);
+            REQUIRE(same_pixels(crop, expected));
+        }
+    }
+    SECTION("reused for the next frame") {
+        roi_extractor_t extractor{2};
+        const video_frame_t small = make_frame(pixel_format_t::nv12, 64, 64);
+        const roi_batch_t first = extractor.extract(small, regions.data() + 1, 1, 16, 16);
+        const video_frame_t large = make_frame(pixel_format_t::nv12, 320, 180);
+        const roi_batch_t second = extractor.extract(large, regions.data(), 3, 16, 16);
+        REQUIRE(first.crops.size() == 1);
+        REQUIRE(second.crops.size() == 3);
+        video_frame_t expected = allocate_frame({pixel_format_t::nv12, 16, 16});
+        scale_frame(crop_frame(small, regions[1]), expected);
+        REQUIRE(same_pixels(first.crops[0], expected));
+        scale_frame(crop_frame(large, regions[2]), expected);
+        REQUIRE(same_pixels(second.crops[2], expected));
+    }
+    SECTION("unsupported") {
+        roi_extractor_t extractor{};
+        const video_frame_t frame = make_frame(pixel_format_t::i420, 64, 64);
+        REQUIRE(extractor.extract(frame, regions.data(), 0, 16, 16).crops.empty());
+        REQUIRE_THROWS_AS(extractor.extract(frame, regions.data(), 1, 15, 16), std::invalid_argument);
+        const video_rect_t outside{64, 0, 8, 8};
+        REQUIRE_THROWS_AS(extractor.extract(frame, &outside, 1, 16, 16), std::invalid_argument);
+        REQUIRE_THROWS_AS(extractor.extract(video_frame_t{}, regions.data(), 1, 16, 16), std::invalid_argument);
+    }
+}
@@ -0,0 +1,166 @@
+#include <catch2/catch.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "tensor_converter.hpp"
+#include "video_kernels.hpp"
+
+namespace {
+
+/// @brief Smooth colors. The chroma changes slowly, so the order of the resize and the conversion doesn't matter much
+video_frame_t make_frame(pixel_format_t pixel, uint32_t width, uint32_t height) {
+    video_frame_t rgb = allocate_frame({pixel_format_t::rgb32, width, height});
+    for (uint32_t y = 0; y < height; ++y) {
+        uint8_t* row = rgb.planes[0].data + static_cast<size_t>(y) * rgb.planes[0].stride;
+        for (uint32_t x = 0; x < width; ++x) {
+            row[4 * x + 0] = static_cast<uint8_t>(40 + 160 * x / width);
+            row[4 * x + 1] = static_cast<uint8_t>(200 - 150 * y / height);
+            row[4 * x + 2] = static_cast<uint8_t>(60 + 100 * (x + y) / (width + height));
+            row[4 * x + 3] = 0xFF;
+        }
+    }
+    if (pixel == pixel_format_t::rgb32)
+        return rgb;
+    video_frame_t frame = allocate_frame({pixel, width, height});
+    convert_frame(rgb, frame);
+    return frame;
+}
+
+/// @brief The reference of 2 passes. `convert_frame` then `scale_frame` to RGB32
+std::vector<float> make_reference(const video_frame_t& frame, const tensor_options_t& options) {
+    video_frame_t rgb = allocate_frame({pixel_format_t::rgb32, frame.format.width, frame.format.height});
+    convert_frame(frame, rgb);
+    video_frame_t scaled = allocate_frame({pixel_format_t::rgb32, options.width, options.height});
+    scale_frame(rgb, scaled);
+    std::vector<float> tensor(3 * options.width * options.height);
+    for (uint32_t c = 0; c < 3; ++c)
+        for (uint32_t y = 0; y < options.height; ++y)
+            for (uint32_t x = 0; x < options.width; ++x) {
+                const uint8_t value = scaled.planes[0].data[y * scaled.planes[0].stride + 4 * x + 2 - c];
+                tensor[(c * options.height + y) * options.width + x] =
+                    (value / 255.0f - options.mean[c]) / options.std[c];
+            }
+    return tensor;
+}
+
+float from_half(uint16_t half) {
+    const int exponent = (half >> 10) & 0x1F;
+    const int mantissa = half & 0x3FF;
+    const float value = exponent ? std::ldexp(1.0f + mantissa / 1024.0f, exponent - 15)
+                                 : std::ldexp(mantissa / 1024.0f, -14);
+    return half & 0x8000 ? -value : value;
+}
+
+} // namespace
+
+TEST_CASE("tensor_converter_t", "[tensor]") {
+    tensor_options_t options{};
+    options.width = 96;
+    options.height = 64;
+    options.mean[0] = 0.485f, options.mean[1] = 0.456f, options.mean[2] = 0.406f;
+    options.std[0] = 0.229f, options.std[1] = 0.224f, options.std[2] = 0.225f;
+
+    SECTION("same as 2 passes") {
+        const auto pixel = GENERATE(pixel_format_t::rgb32, pixel_format_t::i420, pixel_format_t::nv12);
+        const auto width = GENERATE(96u, 321u);
+        const video_frame_t frame = make_frame(pixel, width, width * 2 / 3 + 1);
+        tensor_converter_t converter{options};
+        std::vector<float> tensor(converter.count());
+        REQUIRE(converter.size_bytes() == tensor.size() * sizeof(float));
+        converter.convert(frame, tensor.data());
+        const std::vector<float> reference = make_reference(frame, options);
+        for (size_t i = 0; i < tensor.size(); ++i) {
+            // 5 steps of the 8 bit samples. the 2 passes round twice and take the nearest chroma
+            const float tolerance = 5.0f / 255 / options.std[i / (options.width * options.height)];
+            REQUIRE(std::abs(tensor[i] - reference[i]) <= tolerance);
+        }
+    }
+    SECTION("exact without resize") {
+        const video_frame_t frame = make_frame(pixel_format_t::rgb32, 96, 64);
+        tensor_converter_t converter{options};
+        std::vector<float> tensor(converter.count());
+        converter.convert(frame, tensor.data());
+        const std::vector<float> reference = make_reference(frame, options);
+        for (size_t i = 0; i < tensor.size(); ++i)
+            REQUIRE(tensor[i] == Approx(reference[i]).margin(1e-5));
+    }
+    SECTION("layouts and types") {
+        const video_frame_t frame = make_frame(pixel_format_t::nv12, 200, 100);
+        tensor_converter_t chw{options};
+        std::vector<float> planar(chw.count());
+        chw.convert(frame, planar.data());
+
+        options.layout = tensor_layout_t::hwc;
+        tensor_converter_t hwc{options};
+        std::vector<float> interleaved(hwc.count());
+        hwc.convert(frame, interleaved.data());
+
+        options.type = tensor_type_t::float16;
+        options.bgr = true;
+        std::swap(options.mean[0], options.mean[2]);
+        std::swap(options.std[0], options.std[2]);
+        tensor_converter_t half{options};
+        REQUIRE(half.size_bytes() == half.count() * 2);
+        std::vector<uint16_t> halves(half.count());
+        half.convert(frame, halves.data());
+
+        const uint32_t area = options.width * options.height;
+        for (uint32_t i = 0; i < area; ++i) {
+            for (uint32_t c = 0; c < 3; ++c) {
+                const float value = planar[c * area + i];
+                REQUIRE(interleaved[3 * i + c] == value);
+                REQUIRE(std::abs(from_half(halves[3 * i + 2 - c]) - value) <= std::abs(value) / 1024 + 1e-6f);
+            }
+        }
+    }
+    SECTION("letterbox") {
+        options.letterbox = true;
+        options.fill[0] = options.fill[1] = options.fill[2] = 114;
+        const video_frame_t frame = make_frame(pixel_format_t::i420, 320, 90);
+        const video_rect_t region = get_tensor_region(frame.format, options);
+        REQUIRE(region.x == 0);
+        REQUIRE(region.width == 96);
+        REQUIRE(region.height == 27);
+        REQUIRE(region.y == 18);
+        tensor_converter_t converter{options};
+        std::vector<float> tensor(converter.count());
+        converter.convert(frame, tensor.data());
+        for (uint32_t c = 0; c < 3; ++c) {
+            const float fill = (114 / 255.0f - options.mean[c]) / options.std[c];
+            for (uint32_t y = 0; y < options.height; ++y) {
+                const float value = tensor[(c * options.height + y) * options.width + 10];
+                if (y < region.y || y >= region.y + region.height)
+                    REQUIRE(value == Approx(fill));
+                else
+                    REQUIRE(value != Approx(fill).margin(1e-3));
+            }
+        }
+    }
+    SECTION("batch") {
+        const video_frame_t frames[3]{make_frame(pixel_format_t::nv12, 128, 72),
+                                      make_frame(pixel_format_t::rgb32, 64, 64),
+                                      make_frame(pixel_format_t::nv12, 128, 72)};
+        tensor_converter_t converter{options};
+        std::vector<float> batch(converter.count() * 3);
+        converter.convert(frames, 3, batch.data());
+        for (size_t n = 0; n < 3; ++n) {
+            std::vector<float> single(converter.count());
+            converter.convert(frames[n], single.data());
+            REQUIRE(std::equal(single.begin(), single.end(), batch.begin() + n * converter.count()));
+        }
+    }
+    SECTION("unsupported") {
+        tensor_converter_t converter{options};
+        std::vector<float> tensor(converter.count());
+        video_frame_t compressed{};
+        compressed.format = {pixel_format_t::h264, 96, 64};
+        REQUIRE_THROWS_AS(converter.convert(compressed, tensor.data()), std::invalid_argument);
+        options.std[1] = 0;
+        REQUIRE_THROWS_AS(tensor_converter_t{options}, std::invalid_argument);
+        options.std[1] = 1;
+        options.width = 0;
+        REQUIRE_THROWS_AS(tensor_converter_t{options}, std::invalid_argument);
+    }
+}
@@ -0,0 +1,149 @@
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+#include "thumbnail.hpp"
+
+namespace {
+
+/// @brief Holds the outputs until the drain like a decoder with the reorder delay. Counts the non-key inputs
+class delayed_decoder_t final : public video_transform_t {
+    video_format_t output_format{pixel_format_t::nv12, 64, 36, 30, 1};
+    std::vector<video_frame_t> pending{};
+    bool draining = false;
+
+  public:
+    size_t num_delta = 0;
+
+  public:
+    transform_result_t set_input_format(const video_format_t&) noexcept override {
+        return transform_result_t::ok;
+    }
+    transform_result_t set_output_format(const video_format_t&) noexcept override {
+        return transform_result_t::ok;
+    }
+    video_format_t get_input_format() const noexcept override {
+        return video_format_t{pixel_format_t::h264, 64, 36, 30, 1};
+    }
+    video_format_t get_output_format() const noexcept override {
+        return output_format;
+    }
+
+    transform_result_t process_input(const video_frame_t& input) noexcept override {
+        num_delta += input.keyframe() == false;
+        video_frame_t output = allocate_frame(output_format);
+        output.timestamp = input.timestamp;
+        pending.emplace_back(std::move(output));
+        draining = false;
+        return transform_result_t::ok;
+    }
+    transform_result_t process_output(video_frame_t& output) noexcept override {
+        if (draining == false || pending.empty())
+            return transform_result_t::need_more_input;
+        output = std::move(pending.front());
+        pending.erase(pending.begin());
+        return transform_result_t::ok;
+    }
+    void drain() noexcept override {
+        draining = true;
+    }
+    void flush() noexcept override {
+        pending.clear();
+    }
+};
+
+/// @brief 10 seconds. A keyframe for each second
+std::vector<video_frame_t> make_stream() {
+    std::vector<video_frame_t> frames{};
+    for (int64_t i = 0; i < 300; ++i) {
+        video_frame_t frame{};
+        frame.format = {pixel_format_t::h264, 64, 36, 30, 1};
+        frame.timestamp = i * 10'000'000 / 30;
+        frame.flags = i % 30 == 0 ? frame_flag_keyframe : 0u;
+        frames.emplace_back(frame);
+    }
+    return frames;
+}
+
+} // namespace
+
+TEST_CASE("fit_size", "[thumbnail]") {
+    const video_format_t hd{pixel_format_t::nv12, 1920, 1080};
+    REQUIRE(fit_size(hd, 160, 160).width == 160);
+    REQUIRE(fit_size(hd, 160, 160).height == 90);
+    REQUIRE(fit_size(hd, 0, 45).width == 80);
+    REQUIRE(fit_size(hd, 0, 45).height == 44); // even
+    REQUIRE(fit_size(hd, 3840, 0) == hd);
+    REQUIRE(fit_size(hd, 0, 0) == hd);
+}
+
+TEST_CASE("thumbnail_decoder_t", "[thumbnail]") {
+    auto decoder = std::make_shared<delayed_decoder_t>();
+    const auto frames = make_stream();
+
+    SECTION("keyframes only") {
+        thumbnail_decoder_t thumbnails{decoder};
+        std::vector<int64_t> timestamps{};
+        for (const auto& frame : frames)
+            REQUIRE(thumbnails.process(frame, [&timestamps](const video_frame_t& output) {
+                timestamps.emplace_back(output.timestamp);
+                return transform_result_t::ok;
+            }) == transform_result_t::ok);
+        // each keyframe comes out before the next one. no wait for the reorder
+        REQUIRE(timestamps.size() == 10);
+        REQUIRE(timestamps[3] == 30'000'000);
+        REQUIRE(decoder->num_delta == 0);
+        REQUIRE(thumbnails.decoded_count() == 10);
+        REQUIRE(thumbnails.skipped_count() == 290);
+    }
+
+    SECTION("interval and size") {
+        thumbnail_decoder_t thumbnails{decoder, 25'000'000, 32, 32};
+        std::vector<video_frame_t> outputs{};
+        for (const auto& frame : frames) {
+            if (frame.timestamp < thumbnails.next_position())
+                continue; // the reader would seek here
+            REQUIRE(thumbnails.process(frame, [&outputs](const video_frame_t& output) {
+                outputs.emplace_back(output);
+                return transform_result_t::ok;
+            }) == transform_result_t::ok);
+        }
+        REQUIRE(outputs.size() == 4); // 0, 3, 6, 9 seconds
+        REQUIRE(outputs[1].timestamp == 30'000'000);
+        for (const auto& output : outputs) {
+            REQUIRE(output.format.width == 32);
+            REQUIRE(output.format.height == 18);
+        }
+        REQUIRE(thumbnails.next_position() == 90'000'000 + 25'000'000);
+    }
+
+    SECTION("seek with the interval 0") {
+        thumbnail_decoder_t thumbnails{decoder};
+        // the first keyframe at or after the position, like `read_keyframe`
+        const auto seek = [&frames](int64_t position) -> const video_frame_t* {
+            for (const auto& frame : frames)
+                if (frame.keyframe() && frame.timestamp >= position)
+                    return &frame;
+            return nullptr;
+        };
+        std::vector<int64_t> timestamps{};
+        for (auto frame = seek(thumbnails.next_position()); frame && timestamps.size() <= frames.size();
+             frame = seek(thumbnails.next_position())) {
+            const int64_t position = thumbnails.next_position();
+            REQUIRE(thumbnails.process(*frame, [&timestamps](const video_frame_t& output) {
+                timestamps.emplace_back(output.timestamp);
+                return transform_result_t::ok;
+            }) == transform_result_t::ok);
+            REQUIRE(thumbnails.next_position() > position);
+        }
+        REQUIRE(timestamps.size() == 10);
+        REQUIRE(timestamps.back() == 90'000'000);
+        REQUIRE(thumbnails.skipped_count() == 0);
+    }
+
+    SECTION("sink failure") {
+        thumbnail_decoder_t thumbnails{decoder};
+        REQUIRE(thumbnails.process(frames[0], [](const video_frame_t&) { return transform_result_t::aborted; }) ==
+                transform_result_t::aborted);
+    }
+}
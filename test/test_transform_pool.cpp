@@ -0,0 +1,115 @@
+#include <catch2/catch.hpp>
+
+#include <string>
+
+#include "transform_pool.hpp"
+#include "video_transform.hpp"
+
+namespace {
+
+using converter_pool_t = transform_pool_t<std::string, std::shared_ptr<cpu_converter_t>>;
+
+std::shared_ptr<cpu_converter_t> make_converter(pixel_format_t input, pixel_format_t output) {
+    auto converter = std::make_shared<cpu_converter_t>();
+    REQUIRE(converter->set_input_format(video_format_t{input, 32, 16}) == transform_result_t::ok);
+    REQUIRE(converter->set_output_format(video_format_t{output, 32, 16}) == transform_result_t::ok);
+    return converter;
+}
+
+bool reset_converter(std::shared_ptr<cpu_converter_t>& converter) {
+    converter->flush();
+    return true;
+}
+
+} // namespace
+
+TEST_CASE("transform_pool_t", "[transform_pool]") {
+    size_t num_created = 0;
+    auto create = [&num_created]() {
+        ++num_created;
+        return make_converter(pixel_format_t::nv12, pixel_format_t::rgb32);
+    };
+
+    SECTION("reuse without negotiation") {
+        converter_pool_t pool{reset_converter};
+        cpu_converter_t* first = nullptr;
+        {
+            auto lease = pool.acquire("nv12/rgb32", create);
+            REQUIRE(lease);
+            first = lease.get().get();
+            // leave an input. the flush discards it
+            REQUIRE(lease.get()->process_input(allocate_frame({pixel_format_t::nv12, 32, 16})) ==
+                    transform_result_t::ok);
+        }
+        REQUIRE(pool.stats().idle == 1);
+        auto lease = pool.acquire("nv12/rgb32", create);
+        REQUIRE(lease.get().get() == first);
+        REQUIRE(num_created == 1);
+        REQUIRE(lease.get()->get_output_format().pixel == pixel_format_t::rgb32);
+        video_frame_t output{};
+        REQUIRE(lease.get()->process_output(output) == transform_result_t::need_more_input);
+
+        const auto stats = pool.stats();
+        REQUIRE(stats.hits == 1);
+        REQUIRE(stats.misses == 1);
+        REQUIRE(stats.hit_rate() == Approx(0.5));
+    }
+
+    SECTION("keys are separated") {
+        converter_pool_t pool{reset_converter};
+        pool.acquire("nv12/rgb32", create).release();
+        auto lease = pool.acquire("i420/rgb32", [&num_created]() {
+            ++num_created;
+            return make_converter(pixel_format_t::i420, pixel_format_t::rgb32);
+        });
+        REQUIRE(lease.get()->get_input_format().pixel == pixel_format_t::i420);
+        REQUIRE(num_created == 2);
+        REQUIRE(pool.stats().idle == 1);
+    }
+
+    SECTION("max idle") {
+        converter_pool_t pool{reset_converter, 2};
+        {
+            auto l0 = pool.acquire("nv12/rgb32", create);
+            auto l1 = pool.acquire("nv12/rgb32", create);
+            auto l2 = pool.acquire("nv12/rgb32", create);
+        }
+        const auto stats = pool.stats();
+        REQUIRE(stats.idle == 2);
+        REQUIRE(stats.discarded == 1);
+    }
+
+    SECTION("failed reset is not reused") {
+        converter_pool_t pool{[](std::shared_ptr<cpu_converter_t>&) { return false; }};
+        pool.acquire("nv12/rgb32", create).release();
+        REQUIRE(pool.stats().idle == 0);
+        auto lease = pool.acquire("nv12/rgb32", create);
+        lease.discard();
+        REQUIRE(lease.get() == nullptr);
+        REQUIRE(pool.stats().discarded == 2);
+        REQUIRE(num_created == 2);
+    }
+
+    SECTION("idle eviction") {
+        converter_pool_t pool{reset_converter};
+        pool.acquire("nv12/rgb32", create).release();
+        const auto now = converter_pool_t::clock_t::now();
+        REQUIRE(pool.evict(std::chrono::seconds{30}, now) == 0);
+        REQUIRE(pool.evict(std::chrono::seconds{30}, now + std::chrono::seconds{31}) == 1);
+        const auto stats = pool.stats();
+        REQUIRE(stats.idle == 0);
+        REQUIRE(stats.evicted == 1);
+    }
+
+    SECTION("lease outlives the pool") {
+        std::weak_ptr<cpu_converter_t> weak{};
+        converter_pool_t::lease_t lease{};
+        {
+            converter_pool_t pool{reset_converter};
+            lease = pool.acquire("nv12/rgb32", create);
+            weak = lease.get();
+        }
+        lease.release();
+        REQUIRE(weak.expired());
+    }
+}
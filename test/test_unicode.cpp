@@ -0,0 +1,148 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cwchar>
+#include <spdlog/spdlog.h>
+#include <system_error>
+
+#include "unicode.hpp"
+
+namespace {
+
+constexpr bool wide_is_utf16 = sizeof(wchar_t) == 2;
+
+/// @brief The previous `wcrtomb` based implementation. Kept as a baseline of the benchmark
+std::string legacy_w2mb(std::wstring_view in) noexcept(false) {
+    std::string out{};
+    out.reserve(MB_CUR_MAX * in.length());
+    std::mbstate_t state{};
+    for (wchar_t wc : in) {
+        char mb[8]{};
+        const size_t len = std::wcrtomb(mb, wc, &state);
+        if (len == static_cast<size_t>(-1))
+            throw std::system_error{errno, std::system_category(), "wcrtomb"};
+        out += std::string_view{mb, len};
+    }
+    return out;
+}
+
+/// @brief The previous `mbrtowc` based implementation. Kept as a baseline of the benchmark
+std::wstring legacy_mb2w(std::string_view in) noexcept(false) {
+    std::wstring out{};
+    out.reserve(in.length());
+    const char* ptr = in.data();
+    const char* const end = in.data() + in.length();
+    std::mbstate_t state{};
+    wchar_t wc{};
+    while (size_t len = std::mbrtowc(&wc, ptr, static_cast<size_t>(end - ptr), &state)) {
+        if (len == static_cast<size_t>(-1))
+            throw std::system_error{errno, std::system_category(), "mbrtowc"};
+        if (len == static_cast<size_t>(-2))
+            break;
+        out.push_back(wc);
+        ptr += len;
+    }
+    return out;
+}
+
+template <typename Fn>
+auto measure(size_t repeat, Fn&& fn) -> std::chrono::nanoseconds {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeat; ++i)
+        fn();
+    return std::chrono::steady_clock::now() - start;
+}
+
+} // namespace
+
+TEST_CASE("w2mb", "[unicode]") {
+    SECTION("ascii") {
+        REQUIRE(w2mb(L"") == "");
+        REQUIRE(w2mb(L"C:\\Windows\\System32\\mfplat.dll") == "C:\\Windows\\System32\\mfplat.dll");
+    }
+    SECTION("multibyte") {
+        // U+00E9, U+D55C, U+1F600(surrogate pair in UTF-16)
+        REQUIRE(w2mb(L"\u00E9\uD55C\U0001F600") == "\xC3\xA9\xED\x95\x9C\xF0\x9F\x98\x80");
+    }
+    SECTION("multibyte after the vector width") {
+        // the SIMD loop stops at the block with the non-ASCII code unit
+        for (size_t offset = 0; offset < 40; ++offset) {
+            const std::wstring wide = std::wstring(offset, L'a') + L"\uD55C" + std::wstring(40 - offset, L'b');
+            const std::string narrow = std::string(offset, 'a') + "\xED\x95\x9C" + std::string(40 - offset, 'b');
+            REQUIRE(w2mb(wide) == narrow);
+        }
+    }
+    SECTION("unpaired surrogate") {
+        const wchar_t high[]{static_cast<wchar_t>(0xD83D), L'a', 0};
+        REQUIRE_THROWS_AS(w2mb(high), std::system_error);
+        const wchar_t low[]{L'a', static_cast<wchar_t>(0xDE00), 0};
+        REQUIRE_THROWS_AS(w2mb(low), std::system_error);
+        const wchar_t last[]{L'a', static_cast<wchar_t>(0xD83D), 0};
+        REQUIRE_THROWS_AS(w2mb(last), std::system_error);
+    }
+    SECTION("out of range") {
+        if constexpr (wide_is_utf16 == false) {
+            const wchar_t wide[]{static_cast<wchar_t>(0x110000), 0};
+            REQUIRE_THROWS_AS(w2mb(wide), std::system_error);
+        }
+    }
+}
+
+TEST_CASE("mb2w", "[unicode]") {
+    SECTION("multibyte") {
+        REQUIRE(mb2w("\xC3\xA9\xED\x95\x9C\xF0\x9F\x98\x80") == L"\u00E9\uD55C\U0001F600");
+    }
+    SECTION("multibyte after the vector width") {
+        for (size_t offset = 0; offset < 40; ++offset) {
+            const std::string narrow = std::string(offset, 'a') + "\xF0\x9F\x98\x80" + std::string(40 - offset, 'b');
+            const std::wstring wide = std::wstring(offset, L'a') + L"\U0001F600" + std::wstring(40 - offset, L'b');
+            REQUIRE(mb2w(narrow) == wide);
+        }
+    }
+    SECTION("incomplete") {
+        // the last sequence is truncated. it will be ignored
+        REQUIRE(mb2w("media foundation\xE2\x82") == L"media foundation");
+    }
+    SECTION("malformed") {
+        REQUIRE_THROWS_AS(mb2w("\xC0\x80"), std::system_error);         // overlong
+        REQUIRE_THROWS_AS(mb2w("\xE0\x80\x80"), std::system_error);     // overlong
+        REQUIRE_THROWS_AS(mb2w("\xED\xA0\x80"), std::system_error);     // surrogate
+        REQUIRE_THROWS_AS(mb2w("\xF4\x90\x80\x80"), std::system_error); // above U+10FFFF
+        REQUIRE_THROWS_AS(mb2w("\x80"), std::system_error);             // continuation
+        REQUIRE_THROWS_AS(mb2w("\xF8\x88\x80\x80\x80"), std::system_error);
+        REQUIRE_THROWS_AS(mb2w("\xE2\x82" "a"), std::system_error); // truncated in the middle
+    }
+}
+
+TEST_CASE("w2mb and mb2w round trip", "[unicode]") {
+    std::string text = "0123456789 abcdefghijklmnopqrstuvwxyz \xED\x95\x9C\xEA\xB8\x80 \xF0\x9F\x98\x80 ";
+    for (auto i = 0; i < 6; ++i)
+        text += text;
+    const std::wstring wide = mb2w(text);
+    REQUIRE(wide.size() == (wide_is_utf16 ? 44u : 43u) << 6);
+    REQUIRE(w2mb(wide) == text);
+}
+
+/// @note `hresult_error` messages and file paths are mostly ASCII. Not in the default run. Run `[benchmark]` with an
+///       optimized build
+TEST_CASE("w2mb and mb2w speed", "[.][benchmark][unicode]") {
+    std::wstring wide = L"The parameter is incorrect. C:\\Users\\Public\\Videos\\test-sample-0.mp4 ";
+    for (auto i = 0; i < 4; ++i)
+        wide += wide;
+    const std::string narrow = w2mb(wide);
+    REQUIRE(legacy_w2mb(wide) == narrow);
+    REQUIRE(legacy_mb2w(narrow) == wide);
+
+    constexpr size_t repeat = 2000;
+    const auto t0 = measure(repeat, [&wide]() { return legacy_w2mb(wide); });
+    const auto t1 = measure(repeat, [&wide]() { return w2mb(wide); });
+    const auto t2 = measure(repeat, [&narrow]() { return legacy_mb2w(narrow); });
+    const auto t3 = measure(repeat, [&narrow]() { return mb2w(narrow); });
+    spdlog::info("w2mb: {} ns -> {} ns ({:.1f}x)", t0.count() / repeat, t1.count() / repeat,
+                 static_cast<double>(t0.count()) / t1.count());
+    spdlog::info("mb2w: {} ns -> {} ns ({:.1f}x)", t2.count() / repeat, t3.count() / repeat,
+                 static_cast<double>(t2.count()) / t3.count());
+    constexpr auto min_gain = 10;
+    REQUIRE(t0.count() > min_gain * t1.count());
+    REQUIRE(t2.count() > min_gain * t3.count());
+}
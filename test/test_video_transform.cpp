@@ -0,0 +1,614 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "video_pipeline.hpp"
+#include "video_transform.hpp"
+
+namespace {
+
+/// @brief Gradient which is smooth enough for the chroma subsampling
+void fill_gradient(video_frame_t& frame) {
+    const auto& format = frame.format;
+    if (format.pixel == pixel_format_t::rgb32 || format.pixel == pixel_format_t::argb32) {
+        for (uint32_t y = 0; y < format.height; ++y) {
+            uint8_t* row = frame.planes[0].data + y * frame.planes[0].stride;
+            for (uint32_t x = 0; x < format.width; ++x) {
+                row[4 * x + 0] = static_cast<uint8_t>(64 + x % 128);
+                row[4 * x + 1] = static_cast<uint8_t>(64 + y % 128);
+                row[4 * x + 2] = static_cast<uint8_t>(96 + (x + y) / 2 % 128);
+                row[4 * x + 3] = 0xFF;
+            }
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < get_plane_count(format.pixel); ++i) {
+        const plane_extent_t extent = get_plane_extent(format, i);
+        for (uint32_t y = 0; y < extent.rows; ++y)
+            for (uint32_t x = 0; x < extent.row_bytes; ++x)
+                frame.planes[i].data[y * frame.planes[i].stride + x] =
+                    static_cast<uint8_t>(i ? 100 + x % 50 : 16 + (x + y) % 200);
+    }
+}
+
+/// @brief Passes the frames after the `delay`. An overloaded stage
+class slow_transform_t final : public cpu_transform_t {
+    const std::chrono::milliseconds delay;
+
+  public:
+    explicit slow_transform_t(std::chrono::milliseconds _delay) : delay{_delay} {
+    }
+
+  protected:
+    video_format_t derive(const video_format_t& input) const noexcept override {
+        return input;
+    }
+    bool verify(const video_format_t& input, const video_format_t& output) const noexcept override {
+        return input.same_layout(output);
+    }
+    video_frame_t run(const video_frame_t& input) noexcept(false) override {
+        std::this_thread::sleep_for(delay);
+        return input;
+    }
+};
+
+/// @brief Passes the frames, but can't skip any of them. Like a decoder with the references
+class reference_transform_t final : public cpu_transform_t {
+  public:
+    bool is_skippable(const video_frame_t&) noexcept override {
+        return false;
+    }
+
+  protected:
+    video_format_t derive(const video_format_t& input) const noexcept override {
+        return input;
+    }
+    bool verify(const video_format_t& input, const video_format_t& output) const noexcept override {
+        return input.same_layout(output);
+    }
+    video_frame_t run(const video_frame_t& input) noexcept(false) override {
+        return input;
+    }
+};
+
+uint8_t* pixel_at(const video_frame_t& frame, uint32_t x, uint32_t y) {
+    return frame.planes[0].data + y * frame.planes[0].stride + x * 4;
+}
+
+} // namespace
+
+TEST_CASE("allocate_frame", "[video_frame]") {
+    const video_format_t format{pixel_format_t::nv12, 33, 17};
+    video_frame_t frame = allocate_frame(format);
+    REQUIRE(frame);
+    REQUIRE(get_plane_extent(format, 1).row_bytes == 34);
+    REQUIRE(get_plane_extent(format, 1).rows == 9);
+    for (uint32_t i = 0; i < 2; ++i) {
+        REQUIRE(reinterpret_cast<uintptr_t>(frame.planes[i].data) % 64 == 0);
+        REQUIRE(frame.planes[i].stride % 64 == 0);
+    }
+    REQUIRE(frame.planes[2].data == nullptr);
+    REQUIRE_THROWS_AS(allocate_frame(video_format_t{pixel_format_t::h264, 16, 16}), std::invalid_argument);
+}
+
+TEST_CASE("frame_pool_t", "[video_frame]") {
+    const video_format_t format{pixel_format_t::i420, 64, 32};
+    SECTION("reuse") {
+        frame_pool_t pool{format, 2};
+        uint8_t* first = nullptr;
+        {
+            video_frame_t frame = pool.acquire();
+            first = frame.planes[0].data;
+            video_frame_t copy = frame; // shares the buffer
+            frame = {};
+            REQUIRE(pool.stats().idle == 0);
+        }
+        REQUIRE(pool.stats().idle == 1);
+        video_frame_t frame = pool.acquire();
+        REQUIRE(frame.planes[0].data == first);
+        REQUIRE(pool.stats().allocated == 1);
+        REQUIRE(pool.stats().reused == 1);
+    }
+    SECTION("max idle") {
+        frame_pool_t pool{format, 1};
+        {
+            video_frame_t a = pool.acquire(), b = pool.acquire();
+        }
+        REQUIRE(pool.stats().allocated == 2);
+        REQUIRE(pool.stats().idle == 1);
+    }
+    SECTION("reset") {
+        frame_pool_t pool{format};
+        video_frame_t frame = pool.acquire();
+        pool.reset(video_format_t{pixel_format_t::i420, 128, 64});
+        frame = {}; // the old size is not returned
+        REQUIRE(pool.stats().idle == 0);
+        REQUIRE(pool.acquire().format.width == 128);
+    }
+    SECTION("outlive") {
+        video_frame_t frame{};
+        {
+            frame_pool_t pool{format};
+            frame = pool.acquire();
+        }
+        fill_gradient(frame);
+    }
+}
+
+TEST_CASE("convert_frame", "[video_kernels]") {
+    const uint32_t width = 64, height = 48;
+    SECTION("limited range") {
+        video_frame_t nv12 = allocate_frame({pixel_format_t::nv12, 2, 2});
+        video_frame_t rgb32 = allocate_frame({pixel_format_t::rgb32, 2, 2});
+        nv12.planes[0].data[0] = 235;
+        nv12.planes[0].data[1] = 16;
+        nv12.planes[0].data[nv12.planes[0].stride] = 235;
+        nv12.planes[0].data[nv12.planes[0].stride + 1] = 16;
+        nv12.planes[1].data[0] = nv12.planes[1].data[1] = 128;
+        convert_frame(nv12, rgb32);
+        REQUIRE(pixel_at(rgb32, 0, 0)[0] == 255);
+        REQUIRE(pixel_at(rgb32, 0, 0)[1] == 255);
+        REQUIRE(pixel_at(rgb32, 0, 0)[2] == 255);
+        REQUIRE(pixel_at(rgb32, 1, 1)[0] == 0);
+        REQUIRE(pixel_at(rgb32, 1, 1)[3] == 255);
+    }
+    SECTION("round trip") {
+        for (auto pixel : {pixel_format_t::nv12, pixel_format_t::i420}) {
+            video_frame_t source = allocate_frame({pixel_format_t::rgb32, width, height});
+            video_frame_t yuv = allocate_frame({pixel, width, height});
+            video_frame_t result = allocate_frame({pixel_format_t::argb32, width, height});
+            fill_gradient(source);
+            convert_frame(source, yuv);
+            convert_frame(yuv, result);
+            for (uint32_t y = 0; y < height; ++y)
+                for (uint32_t x = 0; x < width; ++x)
+                    for (uint32_t c = 0; c < 3; ++c)
+                        REQUIRE(std::abs(pixel_at(source, x, y)[c] - pixel_at(result, x, y)[c]) <= 6);
+        }
+    }
+    SECTION("nv12 to i420") {
+        video_frame_t nv12 = allocate_frame({pixel_format_t::nv12, width, height});
+        video_frame_t i420 = allocate_frame({pixel_format_t::i420, width, height});
+        video_frame_t back = allocate_frame({pixel_format_t::nv12, width, height});
+        fill_gradient(nv12);
+        convert_frame(nv12, i420);
+        REQUIRE(i420.planes[1].data[1] == nv12.planes[1].data[2]);
+        REQUIRE(i420.planes[2].data[1] == nv12.planes[1].data[3]);
+        convert_frame(i420, back);
+        for (uint32_t y = 0; y < height / 2; ++y)
+            REQUIRE(std::equal(nv12.planes[1].data + y * nv12.planes[1].stride,
+                               nv12.planes[1].data + y * nv12.planes[1].stride + width,
+                               back.planes[1].data + y * back.planes[1].stride));
+    }
+}
+
+TEST_CASE("crop_frame", "[video_kernels]") {
+    video_frame_t frame = allocate_frame({pixel_format_t::nv12, 64, 32});
+    fill_gradient(frame);
+    video_frame_t view = crop_frame(frame, {11, 5, 20, 10});
+    // the origin is rounded down to even. the region is extended to keep the right/bottom edge
+    REQUIRE(view.format.width == 21);
+    REQUIRE(view.format.height == 11);
+    REQUIRE(view.storage == frame.storage);
+    REQUIRE(view.planes[0].data == frame.planes[0].data + 4 * frame.planes[0].stride + 10);
+    REQUIRE(view.planes[1].data == frame.planes[1].data + 2 * frame.planes[1].stride + 10);
+    REQUIRE(crop_frame(frame, {60, 30, 100, 100}).format.width == 4);
+    REQUIRE_THROWS_AS(crop_frame(frame, {64, 0, 1, 1}), std::invalid_argument);
+}
+
+TEST_CASE("scale_frame", "[video_kernels]") {
+    video_frame_t source = allocate_frame({pixel_format_t::i420, 64, 64});
+    for (uint32_t i = 0; i < 3; ++i)
+        for (uint32_t y = 0; y < get_plane_extent(source.format, i).rows; ++y)
+            std::fill_n(source.planes[i].data + y * source.planes[i].stride,
+                        get_plane_extent(source.format, i).row_bytes, static_cast<uint8_t>(40 + i));
+    for (auto size : {std::pair{32u, 32u}, std::pair{100u, 30u}}) {
+        video_frame_t output = allocate_frame({pixel_format_t::i420, size.first, size.second});
+        scale_frame(source, output);
+        for (uint32_t i = 0; i < 3; ++i) {
+            const plane_extent_t extent = get_plane_extent(output.format, i);
+            for (uint32_t y = 0; y < extent.rows; ++y)
+                for (uint32_t x = 0; x < extent.row_bytes; ++x)
+                    REQUIRE(output.planes[i].data[y * output.planes[i].stride + x] == 40 + i);
+        }
+    }
+    SECTION("halve") {
+        video_frame_t rgb = allocate_frame({pixel_format_t::rgb32, 4, 1});
+        const uint8_t values[4]{0, 100, 200, 250};
+        for (uint32_t x = 0; x < 4; ++x)
+            std::fill_n(pixel_at(rgb, x, 0), 4, values[x]);
+        video_frame_t half = allocate_frame({pixel_format_t::rgb32, 2, 1});
+        scale_frame(rgb, half);
+        REQUIRE(pixel_at(half, 0, 0)[0] == 50);
+        REQUIRE(pixel_at(half, 1, 0)[0] == 225);
+    }
+}
+
+TEST_CASE("scale_row", "[video_kernels]") {
+    uint32_t seed = 7;
+    const auto next_random = [&seed]() { return static_cast<uint8_t>((seed = seed * 1664525 + 1013904223) >> 24); };
+    for (uint32_t channels : {1u, 2u, 4u}) {
+        for (auto size : {std::pair{64u, 37u}, std::pair{37u, 100u}, std::pair{1920u, 640u}, std::pair{5u, 5u}}) {
+            // exactly the bytes of the row. the SIMD path must not read after it
+            std::vector<uint8_t> row0(size.first * channels), row1(size.first * channels);
+            std::generate(row0.begin(), row0.end(), next_random);
+            std::generate(row1.begin(), row1.end(), next_random);
+            scale_filter_t filter{};
+            make_scale_filter(size.first, size.second, filter);
+            for (uint32_t weight : {0u, 1u, 128u, 255u}) {
+                std::vector<uint8_t> output(size.second * channels);
+                scale_row(row0.data(), row1.data(), weight, filter, channels, output.data());
+                for (uint32_t x = 0; x < size.second; ++x) {
+                    const uint32_t wx = filter.weights[x];
+                    const uint32_t left = filter.indices[x] * channels;
+                    const uint32_t right = wx ? left + channels : left;
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        const uint32_t top = row0[left + c] * (256 - wx) + row0[right + c] * wx;
+                        const uint32_t bottom = row1[left + c] * (256 - wx) + row1[right + c] * wx;
+                        REQUIRE(output[x * channels + c] == (top * (256 - weight) + bottom * weight + (1 << 15)) >> 16);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("rotate_frame", "[video_kernels]") {
+    video_frame_t source = allocate_frame({pixel_format_t::rgb32, 3, 2});
+    for (uint32_t y = 0; y < 2; ++y)
+        for (uint32_t x = 0; x < 3; ++x)
+            pixel_at(source, x, y)[0] = static_cast<uint8_t>(y * 3 + x);
+    // 0 1 2      3 0
+    // 3 4 5  ->  4 1
+    //            5 2
+    video_frame_t rotated = allocate_frame(rotate_format(source.format, video_rotation_t::clockwise_90));
+    REQUIRE(rotated.format.width == 2);
+    rotate_frame(source, rotated, video_rotation_t::clockwise_90, mirror_none);
+    REQUIRE(pixel_at(rotated, 0, 0)[0] == 3);
+    REQUIRE(pixel_at(rotated, 1, 0)[0] == 0);
+    REQUIRE(pixel_at(rotated, 1, 2)[0] == 2);
+
+    video_frame_t mirrored = allocate_frame(source.format);
+    rotate_frame(source, mirrored, video_rotation_t::none, mirror_horizontal);
+    REQUIRE(pixel_at(mirrored, 0, 0)[0] == 2);
+    rotate_frame(source, mirrored, video_rotation_t::clockwise_180, mirror_none);
+    REQUIRE(pixel_at(mirrored, 0, 0)[0] == 5);
+
+    SECTION("nv12 round trip") {
+        video_frame_t nv12 = allocate_frame({pixel_format_t::nv12, 64, 32});
+        fill_gradient(nv12);
+        video_frame_t temp = allocate_frame(rotate_format(nv12.format, video_rotation_t::clockwise_90));
+        video_frame_t back = allocate_frame(nv12.format);
+        rotate_frame(nv12, temp, video_rotation_t::clockwise_90, mirror_none);
+        rotate_frame(temp, back, video_rotation_t::clockwise_270, mirror_none);
+        for (uint32_t i = 0; i < 2; ++i)
+            for (uint32_t y = 0; y < get_plane_extent(nv12.format, i).rows; ++y)
+                REQUIRE(std::equal(nv12.planes[i].data + y * nv12.planes[i].stride,
+                                   nv12.planes[i].data + y * nv12.planes[i].stride + 64,
+                                   back.planes[i].data + y * back.planes[i].stride));
+    }
+}
+
+TEST_CASE("cpu_transform_t", "[video_transform]") {
+    const video_format_t input{pixel_format_t::nv12, 64, 48, 30, 1};
+    SECTION("contract") {
+        cpu_converter_t converter{};
+        video_frame_t output{};
+        REQUIRE(converter.process_input(allocate_frame(input)) == transform_result_t::not_ready);
+        REQUIRE(converter.set_output_format(input) == transform_result_t::not_ready);
+        REQUIRE(converter.set_input_format(input) == transform_result_t::ok);
+        REQUIRE(converter.set_output_format({pixel_format_t::rgb32, 32, 48}) == transform_result_t::invalid_format);
+        REQUIRE(converter.set_output_format({pixel_format_t::rgb32, 64, 48, 30, 1}) == transform_result_t::ok);
+        REQUIRE(converter.process_output(output) == transform_result_t::need_more_input);
+
+        video_frame_t frame = allocate_frame(input);
+        fill_gradient(frame);
+        frame.timestamp = 333'333;
+        frame.flags = frame_flag_keyframe;
+        REQUIRE(converter.process_input(frame) == transform_result_t::ok);
+        REQUIRE(converter.process_input(frame) == transform_result_t::not_accepting);
+        REQUIRE(converter.process_output(output) == transform_result_t::ok);
+        REQUIRE(output.format == video_format_t{pixel_format_t::rgb32, 64, 48, 30, 1});
+        REQUIRE(output.timestamp == 333'333);
+        REQUIRE(output.keyframe());
+        REQUIRE(converter.process_output(output) == transform_result_t::need_more_input);
+        REQUIRE(converter.process_input(allocate_frame({pixel_format_t::i420, 64, 48})) ==
+                transform_result_t::invalid_format);
+    }
+    SECTION("settings before input") {
+        cpu_scaler_t scaler{};
+        REQUIRE(scaler.set_size(32, 24) == transform_result_t::ok);
+        REQUIRE(scaler.set_input_format(input) == transform_result_t::ok);
+        REQUIRE(scaler.get_output_format() == video_format_t{pixel_format_t::nv12, 32, 24, 30, 1});
+        cpu_rotator_t rotator{};
+        REQUIRE(rotator.set_input_format(input) == transform_result_t::ok);
+        REQUIRE(rotator.set_mirror_rotation(mirror_none, video_rotation_t::clockwise_270) == transform_result_t::ok);
+        REQUIRE(rotator.get_output_format().width == 48);
+    }
+    SECTION("crop shares the input") {
+        cpu_cropper_t cropper{};
+        REQUIRE(cropper.set_input_format(input) == transform_result_t::ok);
+        REQUIRE(cropper.set_region({16, 8, 32, 32}) == transform_result_t::ok);
+        REQUIRE(cropper.get_output_format().width == 32);
+        video_frame_t frame = allocate_frame(input), output{};
+        REQUIRE(cropper.process_input(frame) == transform_result_t::ok);
+        REQUIRE(cropper.process_output(output) == transform_result_t::ok);
+        REQUIRE(output.storage == frame.storage);
+    }
+}
+
+TEST_CASE("video_transform_driver_t", "[video_pipeline]") {
+    SECTION("stream change in place") {
+        auto converter = std::make_shared<cpu_converter_t>();
+        auto scaler = std::make_shared<cpu_scaler_t>();
+        REQUIRE(converter->set_input_format({pixel_format_t::nv12, 128, 96}) == transform_result_t::ok);
+        REQUIRE(converter->set_output_format({pixel_format_t::rgb32, 128, 96}) == transform_result_t::ok);
+        REQUIRE(scaler->set_input_format(converter->get_output_format()) == transform_result_t::ok);
+        REQUIRE(scaler->set_size(64, 64) == transform_result_t::ok);
+        video_transform_driver_t first{converter, "cpu_converter_t"};
+        video_transform_driver_t second{scaler, "cpu_scaler_t"};
+
+        std::vector<video_format_t> formats{};
+        const video_transform_driver_t::emit_t sink = [&formats](const video_frame_t& frame) {
+            formats.emplace_back(frame.format);
+            return transform_result_t::ok;
+        };
+        const video_transform_driver_t::emit_t emit = [&second, &sink](const video_frame_t& frame) {
+            return second.process(frame, sink);
+        };
+        // the size changes like an adaptive bitrate switch. the stages follow the frames
+        for (uint32_t width : {128, 64, 64, 128}) {
+            video_frame_t frame = allocate_frame({pixel_format_t::nv12, width, width * 3 / 4});
+            fill_gradient(frame);
+            REQUIRE(first.process(frame, emit) == transform_result_t::ok);
+            REQUIRE(converter->get_output_format().width == width);
+            REQUIRE(scaler->get_input_format().width == width);
+        }
+        REQUIRE(first.drain(emit) == transform_result_t::ok);
+        REQUIRE(second.drain(sink) == transform_result_t::ok);
+        REQUIRE(formats.size() == 4);
+        for (const auto& format : formats)
+            REQUIRE(format.same_layout({pixel_format_t::rgb32, 64, 64}));
+    }
+}
+
+TEST_CASE("video_pipeline_t", "[video_pipeline]") {
+    const video_format_t input{pixel_format_t::nv12, 128, 96, 30, 1};
+    auto converter = std::make_shared<cpu_converter_t>();
+    auto cropper = std::make_shared<cpu_cropper_t>();
+    auto scaler = std::make_shared<cpu_scaler_t>();
+    auto rotator = std::make_shared<cpu_rotator_t>();
+    REQUIRE(converter->set_input_format(input) == transform_result_t::ok);
+    REQUIRE(converter->set_output_format({pixel_format_t::rgb32, 128, 96, 30, 1}) == transform_result_t::ok);
+    REQUIRE(cropper->set_input_format(converter->get_output_format()) == transform_result_t::ok);
+    REQUIRE(cropper->set_region({0, 0, 96, 96}) == transform_result_t::ok);
+    REQUIRE(scaler->set_input_format(cropper->get_output_format()) == transform_result_t::ok);
+    REQUIRE(scaler->set_size(64, 64) == transform_result_t::ok);
+    REQUIRE(rotator->set_input_format(scaler->get_output_format()) == transform_result_t::ok);
+    REQUIRE(rotator->set_mirror_rotation(mirror_vertical, video_rotation_t::clockwise_90) == transform_result_t::ok);
+
+    video_pipeline_t pipeline{2};
+    pipeline.add(converter, "cpu_converter_t");
+    pipeline.add(cropper, "cpu_cropper_t");
+    pipeline.add(scaler, "cpu_scaler_t");
+    pipeline.add(rotator, "cpu_rotator_t");
+    std::vector<int64_t> timestamps{};
+    REQUIRE(pipeline.start([&timestamps](const video_frame_t& frame) {
+        if (frame.format.width != 64 || frame.format.pixel != pixel_format_t::rgb32)
+            return transform_result_t::invalid_format;
+        timestamps.emplace_back(frame.timestamp);
+        return transform_result_t::ok;
+    }) == transform_result_t::ok);
+    frame_pool_t pool{input};
+    for (int64_t i = 0; i < 30; ++i) {
+        video_frame_t frame = pool.acquire();
+        fill_gradient(frame);
+        frame.timestamp = i * 333'333;
+        REQUIRE(pipeline.push(frame));
+    }
+    REQUIRE(pipeline.finish() == transform_result_t::ok);
+    REQUIRE(timestamps.size() == 30);
+    REQUIRE(std::is_sorted(timestamps.begin(), timestamps.end()));
+    for (size_t i = 0; i < pipeline.size(); ++i)
+        REQUIRE(pipeline.stage(i).output_count() == 30);
+
+    SECTION("sink failure stops the stages") {
+        video_pipeline_t failing{1};
+        failing.add(std::make_shared<cpu_converter_t>(), "cpu_converter_t");
+        REQUIRE(failing.stage(0).get().set_input_format(input) == transform_result_t::ok);
+        REQUIRE(failing.start([](const video_frame_t&) { return transform_result_t::failed; }) ==
+                transform_result_t::ok);
+        for (int i = 0; i < 10; ++i)
+            if (failing.push(pool.acquire()) == false)
+                break;
+        REQUIRE(failing.finish() == transform_result_t::failed);
+    }
+}
+
+TEST_CASE("video_pipeline_t max latency", "[video_pipeline]") {
+    using namespace std::chrono;
+    const video_format_t format{pixel_format_t::i420, 64, 48, 100, 1};
+    frame_pool_t pool{format};
+    // 100 fps into a stage of 50 fps. the latency grows by 10 ms for each frame without QoS
+    auto slow = std::make_shared<slow_transform_t>(milliseconds{20});
+    REQUIRE(slow->set_input_format(format) == transform_result_t::ok);
+    video_pipeline_t pipeline{2};
+    pipeline.set_max_latency(500'000); // 50 ms
+    pipeline.add(slow, "slow_transform_t");
+    std::mutex mtx{};
+    steady_clock::time_point origin{};
+    std::vector<milliseconds> delays{}; // from the time of the frame to the sink
+    REQUIRE(pipeline.start([&](const video_frame_t& frame) {
+        std::lock_guard lck{mtx};
+        const auto due = origin + microseconds{frame.timestamp / 10};
+        delays.emplace_back(duration_cast<milliseconds>(steady_clock::now() - due));
+        return transform_result_t::ok;
+    }) == transform_result_t::ok);
+    REQUIRE_THROWS_AS(pipeline.set_max_latency(0), std::logic_error);
+    {
+        std::lock_guard lck{mtx};
+        origin = steady_clock::now();
+    }
+    for (int64_t i = 0; i < 60; ++i) {
+        video_frame_t frame = pool.acquire();
+        frame.timestamp = i * 100'000;
+        REQUIRE(pipeline.push(frame));
+        std::this_thread::sleep_until(origin + milliseconds{10 * (i + 1)});
+    }
+    REQUIRE(pipeline.finish() == transform_result_t::ok);
+    const video_transform_driver_t& stage = pipeline.stage(0);
+    REQUIRE(stage.skipped_count() > 0);
+    REQUIRE(stage.late_count() == stage.skipped_count()); // the uncompressed frames can be skipped
+    REQUIRE(delays.size() + stage.skipped_count() == 60);
+    // the latency, the frame in the stage and the margin of the scheduler. 600 ms for the last frame without QoS
+    REQUIRE(*std::max_element(delays.begin(), delays.end()) < milliseconds{150});
+}
+
+TEST_CASE("video_transform_driver_t resync", "[video_pipeline]") {
+    const video_format_t format{pixel_format_t::i420, 64, 48, 100, 1};
+    auto reference = std::make_shared<reference_transform_t>();
+    REQUIRE(reference->set_input_format(format) == transform_result_t::ok);
+    video_transform_driver_t driver{reference, "reference_transform_t"};
+    std::vector<int64_t> timestamps{};
+    const video_transform_driver_t::emit_t sink = [&timestamps](const video_frame_t& frame) {
+        timestamps.emplace_back(frame.timestamp);
+        return transform_result_t::ok;
+    };
+    frame_pool_t pool{format};
+    auto make = [&pool](int64_t timestamp, bool keyframe) {
+        video_frame_t frame = pool.acquire();
+        frame.timestamp = timestamp;
+        frame.flags = keyframe ? frame_flag_keyframe : 0u;
+        return frame;
+    };
+    // late, but the references can't be skipped
+    const video_frame_t reference_frame = make(0, false);
+    REQUIRE(driver.drop_late(reference_frame, false) == false);
+    REQUIRE(driver.process(reference_frame, sink) == transform_result_t::ok);
+    // stale. flush and wait for the next keyframe
+    REQUIRE(driver.drop_late(make(1, false), true));
+    REQUIRE(driver.drop_late(make(2, false), false));
+    // the next keyframe is still late, but not stale. it must be decoded to end the resync
+    const video_frame_t keyframe = make(3, true);
+    REQUIRE(driver.drop_late(keyframe, false) == false);
+    REQUIRE(driver.process(keyframe, sink) == transform_result_t::ok);
+    REQUIRE(driver.process(make(4, false), sink) == transform_result_t::ok);
+    REQUIRE(driver.drain(sink) == transform_result_t::ok);
+    REQUIRE(timestamps == std::vector<int64_t>{0, 3, 4});
+    REQUIRE(driver.late_count() == 4);
+    REQUIRE(driver.skipped_count() == 2);
+}
+
+TEST_CASE("video_fanout_t", "[video_pipeline]") {
+    const video_format_t input{pixel_format_t::nv12, 128, 96, 30, 1};
+    auto converter = std::make_shared<cpu_converter_t>();
+    REQUIRE(converter->set_input_format(input) == transform_result_t::ok);
+    REQUIRE(converter->set_output_format({pixel_format_t::i420, 128, 96, 30, 1}) == transform_result_t::ok);
+    auto make_scaler = [](uint32_t width, uint32_t height) {
+        auto scaler = std::make_shared<cpu_scaler_t>();
+        REQUIRE(scaler->set_input_format({pixel_format_t::i420, 128, 96, 30, 1}) == transform_result_t::ok);
+        REQUIRE(scaler->set_size(width, height) == transform_result_t::ok);
+        return scaler;
+    };
+    frame_pool_t pool{input};
+
+    SECTION("the trunk runs once for the branches") {
+        video_fanout_t fanout{2};
+        fanout.trunk().add(converter, "cpu_converter_t");
+        fanout.add_branch().add(make_scaler(64, 48), "cpu_scaler_t");
+        fanout.add_branch(4).add(make_scaler(32, 24), "cpu_scaler_t");
+        fanout.add_branch(); // the outputs of the trunk as they are
+        std::vector<int64_t> timestamps[2]{};
+        auto expect = [&timestamps](size_t index, uint32_t width) -> video_fanout_t::sink_t {
+            return [&timestamps, index, width](const video_frame_t& frame) {
+                if (frame.format.width != width)
+                    return transform_result_t::invalid_format;
+                timestamps[index].emplace_back(frame.timestamp);
+                return transform_result_t::ok;
+            };
+        };
+        std::vector<video_frame_t> originals{};
+        REQUIRE(fanout.start({expect(0, 64), expect(1, 32), [&originals](const video_frame_t& frame) {
+                                  originals.emplace_back(frame);
+                                  return transform_result_t::ok;
+                              }}) == transform_result_t::ok);
+        REQUIRE_THROWS_AS(fanout.add_branch(), std::logic_error);
+        for (int64_t i = 0; i < 20; ++i) {
+            video_frame_t frame = pool.acquire();
+            fill_gradient(frame);
+            frame.timestamp = i * 333'333;
+            REQUIRE(fanout.push(frame));
+        }
+        REQUIRE(fanout.finish() == transform_result_t::ok);
+        REQUIRE(fanout.trunk().stage(0).input_count() == 20);
+        for (const auto& received : timestamps) {
+            REQUIRE(received.size() == 20);
+            REQUIRE(std::is_sorted(received.begin(), received.end()));
+        }
+        REQUIRE(originals.size() == 20);
+        REQUIRE(originals[0].format.pixel == pixel_format_t::i420);
+        REQUIRE(fanout.branch(0).stage(0).output_count() == 20);
+        REQUIRE(fanout.branch(1).stage(0).output_count() == 20);
+    }
+    SECTION("a slow branch holds its own queue") {
+        video_fanout_t fanout{1};
+        fanout.trunk().add(converter, "cpu_converter_t");
+        fanout.add_branch().add(make_scaler(64, 48), "cpu_scaler_t");
+        fanout.add_branch(8).add(make_scaler(32, 24), "cpu_scaler_t");
+        std::mutex mtx{};
+        std::condition_variable cv{};
+        bool released = false;
+        size_t fast = 0;
+        size_t slow = 0;
+        REQUIRE(fanout.start({[&](const video_frame_t&) {
+                                  std::lock_guard lck{mtx};
+                                  ++fast;
+                                  cv.notify_all();
+                                  return transform_result_t::ok;
+                              },
+                              [&](const video_frame_t&) {
+                                  std::unique_lock lck{mtx};
+                                  cv.wait(lck, [&released]() { return released; });
+                                  ++slow;
+                                  return transform_result_t::ok;
+                              }}) == transform_result_t::ok);
+        std::thread producer{[&fanout, &pool]() {
+            for (int64_t i = 0; i < 8; ++i) {
+                video_frame_t frame = pool.acquire();
+                frame.timestamp = i;
+                if (fanout.push(frame) == false)
+                    break;
+            }
+        }};
+        {
+            // the queues of the slow branch take the frames. the fast one doesn't wait for it
+            std::unique_lock lck{mtx};
+            REQUIRE(cv.wait_for(lck, std::chrono::seconds{10}, [&fast]() { return fast >= 6; }));
+            REQUIRE(slow == 0);
+            released = true;
+        }
+        cv.notify_all();
+        producer.join();
+        REQUIRE(fanout.finish() == transform_result_t::ok);
+        REQUIRE(fast == 8);
+        REQUIRE(slow == 8);
+    }
+    SECTION("failure of a branch") {
+        video_fanout_t fanout{1};
+        fanout.trunk().add(converter, "cpu_converter_t");
+        fanout.add_branch().add(make_scaler(64, 48), "cpu_scaler_t");
+        fanout.add_branch().add(make_scaler(32, 24), "cpu_scaler_t");
+        REQUIRE(fanout.start({nullptr, [](const video_frame_t&) { return transform_result_t::failed; }}) ==
+                transform_result_t::ok);
+        for (int i = 0; i < 10; ++i)
+            if (fanout.push(pool.acquire()) == false)
+                break;
+        REQUIRE(fanout.finish() == transform_result_t::failed);
+    }
+}
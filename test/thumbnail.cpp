@@ -0,0 +1,87 @@
+#include "thumbnail.hpp"
+
+#include <algorithm>
+
+video_format_t fit_size(const video_format_t& format, uint32_t max_width, uint32_t max_height) noexcept {
+    video_format_t result = format;
+    if (format.width == 0 || format.height == 0)
+        return result;
+    const uint64_t w = max_width ? max_width : format.width;
+    const uint64_t h = max_height ? max_height : format.height;
+    if (w >= format.width && h >= format.height)
+        return result;
+    // compare w / width and h / height without the division
+    if (w * format.height <= h * format.width) {
+        result.width = static_cast<uint32_t>(w);
+        result.height = static_cast<uint32_t>(w * format.height / format.width);
+    } else {
+        result.width = static_cast<uint32_t>(h * format.width / format.height);
+        result.height = static_cast<uint32_t>(h);
+    }
+    result.width = std::max<uint32_t>(result.width & ~1u, 2);
+    result.height = std::max<uint32_t>(result.height & ~1u, 2);
+    return result;
+}
+
+thumbnail_decoder_t::thumbnail_decoder_t(std::shared_ptr<video_transform_t> _decoder, int64_t _interval,
+                                         uint32_t _max_width, uint32_t _max_height) noexcept(false)
+    : decoder{std::move(_decoder), "thumbnail_decoder_t"}, interval{_interval}, max_width{_max_width},
+      max_height{_max_height} {
+    if (max_width || max_height)
+        scaler = std::make_unique<cpu_scaler_t>();
+}
+
+bool thumbnail_decoder_t::accept(const video_frame_t& input) const noexcept {
+    if (input.keyframe() == false)
+        return false;
+    return input.timestamp >= next_position();
+}
+
+int64_t thumbnail_decoder_t::next_position() const noexcept {
+    // past the last one even for the interval 0. a seek to `last` returns the same keyframe again
+    return decoded ? last + std::max<int64_t>(interval, 1) : 0;
+}
+
+size_t thumbnail_decoder_t::decoded_count() const noexcept {
+    return decoder.input_count();
+}
+
+size_t thumbnail_decoder_t::skipped_count() const noexcept {
+    return num_skipped;
+}
+
+transform_result_t thumbnail_decoder_t::process(const video_frame_t& input, const emit_t& emit) noexcept {
+    if (accept(input) == false) {
+        ++num_skipped;
+        return transform_result_t::ok;
+    }
+    const emit_t forward = [this, &emit](const video_frame_t& frame) { return scale(frame, emit); };
+    video_frame_t keyframe = input;
+    keyframe.flags |= frame_flag_discontinuity;
+    if (auto result = decoder.process(keyframe, forward); result != transform_result_t::ok)
+        return result;
+    // the outputs waiting for the reorder come out now. the next input doesn't refer to this one
+    if (auto result = decoder.drain(forward); result != transform_result_t::ok)
+        return result;
+    last = input.timestamp;
+    decoded = true;
+    return transform_result_t::ok;
+}
+
+transform_result_t thumbnail_decoder_t::scale(const video_frame_t& frame, const emit_t& emit) noexcept {
+    if (scaler == nullptr)
+        return emit ? emit(frame) : transform_result_t::ok;
+    if (scaler->get_input_format().same_layout(frame.format) == false) {
+        if (auto result = scaler->set_input_format(frame.format); result != transform_result_t::ok)
+            return result;
+        const video_format_t output = fit_size(frame.format, max_width, max_height);
+        if (auto result = scaler->set_size(output.width, output.height); result != transform_result_t::ok)
+            return result;
+    }
+    if (auto result = scaler->process_input(frame); result != transform_result_t::ok)
+        return result;
+    video_frame_t output{};
+    if (auto result = scaler->process_output(output); result != transform_result_t::ok)
+        return result;
+    return emit ? emit(output) : transform_result_t::ok;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <memory>
+
+#include "video_pipeline.hpp"
+
+/// @brief The largest size in `max_width` x `max_height` with the aspect ratio of the `format`. Even numbers
+/// @note 0 for no limit
+[[nodiscard]] video_format_t fit_size(const video_format_t& format, uint32_t max_width,
+                                      uint32_t max_height) noexcept;
+
+/**
+ * @brief Decodes only the keyframes for the thumbnails and the scene index.
+ *        Each keyframe is decoded alone and drained, so the decoder never waits for the skipped references.
+ *        The outputs can be scaled down with `cpu_scaler_t`
+ *
+ * @code
+ * thumbnail_decoder_t thumbnails{decoder, 10'000'000, 160, 90}; // 1 per 10 seconds, 160x90 at most
+ * while (read_keyframe(reader, stream, thumbnails.next_position(), format, frame) == S_OK)
+ *     if (auto ec = thumbnails.process(frame, save); ec != transform_result_t::ok)
+ *         return ec;
+ * @endcode
+ *
+ * @note The reader should seek to `next_position` rather than read the samples between the keyframes.
+ *       With `h264_decoder_t`, use `h264_decoder_t::configure_thumbnail` too
+ */
+class thumbnail_decoder_t final {
+  public:
+    using emit_t = video_transform_driver_t::emit_t;
+
+  private:
+    video_transform_driver_t decoder;
+    std::unique_ptr<cpu_scaler_t> scaler{};
+    const int64_t interval;
+    const uint32_t max_width;
+    const uint32_t max_height;
+    int64_t last = 0;
+    bool decoded = false;
+    size_t num_skipped = 0;
+
+  public:
+    /**
+     * @param decoder a decoder with the input/output formats configured
+     * @param interval minimum distance of the thumbnails. unit 100-nanosecond. 0 for all keyframes
+     * @param max_width 0 to keep the decoded size
+     */
+    explicit thumbnail_decoder_t(std::shared_ptr<video_transform_t> decoder, int64_t interval = 0,
+                                 uint32_t max_width = 0, uint32_t max_height = 0) noexcept(false);
+    thumbnail_decoder_t(const thumbnail_decoder_t&) = delete;
+    thumbnail_decoder_t(thumbnail_decoder_t&&) = delete;
+    thumbnail_decoder_t& operator=(const thumbnail_decoder_t&) = delete;
+    thumbnail_decoder_t& operator=(thumbnail_decoder_t&&) = delete;
+    ~thumbnail_decoder_t() noexcept = default;
+
+    /// @return true if the `input` makes a thumbnail. The keyframes within the `interval` are skipped
+    [[nodiscard]] bool accept(const video_frame_t& input) const noexcept;
+    /// @brief Decode the `input` if accepted. Otherwise it is skipped and counted
+    [[nodiscard]] transform_result_t process(const video_frame_t& input, const emit_t& emit) noexcept;
+
+    /// @brief Where the reader can seek for the next thumbnail. After the last one, so the loop moves forward
+    [[nodiscard]] int64_t next_position() const noexcept;
+    [[nodiscard]] size_t decoded_count() const noexcept;
+    [[nodiscard]] size_t skipped_count() const noexcept;
+
+  private:
+    transform_result_t scale(const video_frame_t& frame, const emit_t& emit) noexcept;
+};
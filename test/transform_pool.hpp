@@ -0,0 +1,218 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Keeps the configured transforms for reuse, like `frame_pool_t` does for the buffers.
+ *        The `Key` describes what the item is configured for. For example, CLSID and the negotiated types.
+ *        A `lease_t` gives its item back when it is destroyed. `reset` (flush) runs before the item becomes idle,
+ *        so the next `acquire` of the same key can use it without negotiation.
+ *        The leases can outlive the pool. Then their items are released
+ *
+ * @code
+ * transform_pool_t<std::string, std::shared_ptr<video_transform_t>> pool{reset};
+ * auto lease = pool.acquire("nv12/rgb32", create);
+ * use(lease.get());
+ * @endcode
+ */
+template <typename Key, typename T>
+class transform_pool_t final {
+  public:
+    using clock_t = std::chrono::steady_clock;
+    /// @return false to discard the item. For example, the flush failed
+    using reset_t = std::function<bool(T&)>;
+
+    struct stats_t final {
+        size_t hits = 0;      // `acquire` served from the idle items
+        size_t misses = 0;    // `acquire` created a new one
+        size_t discarded = 0; // `reset` failed or too many idle items
+        size_t evicted = 0;   // removed by `evict`
+        size_t idle = 0;
+
+      public:
+        [[nodiscard]] double hit_rate() const noexcept {
+            const size_t total = hits + misses;
+            return total ? static_cast<double>(hits) / total : 0.0;
+        }
+    };
+
+  private:
+    struct idle_t final {
+        T item;
+        clock_t::time_point since;
+    };
+
+    struct shared_state_t final {
+        std::mutex mtx{};
+        std::map<Key, std::vector<idle_t>> items{};
+        const reset_t reset;
+        const size_t max_idle;
+        stats_t stats{};
+
+      public:
+        shared_state_t(reset_t _reset, size_t _max_idle) noexcept : reset{std::move(_reset)}, max_idle{_max_idle} {
+        }
+
+        void give_back(Key&& key, T&& item) noexcept {
+            bool usable = false;
+            try {
+                usable = reset ? reset(item) : true;
+            } catch (...) {
+                usable = false;
+            }
+            {
+                std::lock_guard lck{mtx};
+                if (usable)
+                    if (auto& idle = items[key]; idle.size() < max_idle) {
+                        idle.emplace_back(idle_t{std::move(item), clock_t::now()});
+                        ++stats.idle;
+                        return;
+                    }
+                ++stats.discarded;
+            }
+            // `item` is released here, out of the lock
+        }
+    };
+
+    std::shared_ptr<shared_state_t> state;
+
+  public:
+    /// @brief Owner of an item while it is in use
+    class lease_t final {
+        std::weak_ptr<shared_state_t> pool{};
+        Key key{};
+        T item{};
+        bool leased = false;
+
+      public:
+        lease_t() noexcept = default;
+        lease_t(std::weak_ptr<shared_state_t> _pool, Key _key, T _item) noexcept
+            : pool{std::move(_pool)}, key{std::move(_key)}, item{std::move(_item)}, leased{true} {
+        }
+        lease_t(const lease_t&) = delete;
+        lease_t(lease_t&& rhs) noexcept
+            : pool{std::move(rhs.pool)}, key{std::move(rhs.key)}, item{std::move(rhs.item)},
+              leased{std::exchange(rhs.leased, false)} {
+        }
+        lease_t& operator=(const lease_t&) = delete;
+        lease_t& operator=(lease_t&& rhs) noexcept {
+            if (this != &rhs) {
+                release();
+                pool = std::move(rhs.pool);
+                key = std::move(rhs.key);
+                item = std::move(rhs.item);
+                leased = std::exchange(rhs.leased, false);
+            }
+            return *this;
+        }
+        ~lease_t() noexcept {
+            release();
+        }
+
+        [[nodiscard]] T& get() noexcept {
+            return item;
+        }
+        [[nodiscard]] const Key& get_key() const noexcept {
+            return key;
+        }
+        explicit operator bool() const noexcept {
+            return leased;
+        }
+
+        /// @brief Give the item back to the pool now
+        void release() noexcept {
+            if (leased == false)
+                return;
+            leased = false;
+            if (auto shared = pool.lock())
+                shared->give_back(std::move(key), std::move(item));
+            item = T{};
+        }
+        /// @brief Don't give the item back. Use when its state is unknown. For example, after a failure
+        void discard() noexcept {
+            if (leased == false)
+                return;
+            leased = false;
+            item = T{};
+            if (auto shared = pool.lock()) {
+                std::lock_guard lck{shared->mtx};
+                ++shared->stats.discarded;
+            }
+        }
+    };
+
+  public:
+    /// @param max_idle items kept for each key. The others are released
+    explicit transform_pool_t(reset_t reset, size_t max_idle = 4) noexcept(false)
+        : state{std::make_shared<shared_state_t>(std::move(reset), max_idle)} {
+    }
+    transform_pool_t(const transform_pool_t&) = delete;
+    transform_pool_t(transform_pool_t&&) = delete;
+    transform_pool_t& operator=(const transform_pool_t&) = delete;
+    transform_pool_t& operator=(transform_pool_t&&) = delete;
+    ~transform_pool_t() noexcept = default;
+
+    /**
+     * @brief The most recently returned item of the `key`. `create` makes a new one if there is no idle item
+     * @param create `T()`. Configures the item for the `key`. Called out of the lock
+     */
+    template <typename Create>
+    [[nodiscard]] lease_t acquire(const Key& key, Create&& create) noexcept(false) {
+        {
+            std::lock_guard lck{state->mtx};
+            if (auto it = state->items.find(key); it != state->items.end() && it->second.empty() == false) {
+                T item = std::move(it->second.back().item);
+                it->second.pop_back();
+                --state->stats.idle;
+                ++state->stats.hits;
+                return lease_t{state, key, std::move(item)};
+            }
+            ++state->stats.misses;
+        }
+        return lease_t{state, key, create()};
+    }
+
+    /// @brief Release the items which are idle longer than `max_age`
+    /// @return count of the released items
+    size_t evict(clock_t::duration max_age, clock_t::time_point now = clock_t::now()) noexcept {
+        std::vector<T> expired{};
+        std::lock_guard lck{state->mtx};
+        for (auto it = state->items.begin(); it != state->items.end();) {
+            auto& idle = it->second;
+            for (auto i = idle.begin(); i != idle.end();) {
+                if (now - i->since < max_age) {
+                    ++i;
+                    continue;
+                }
+                try {
+                    expired.emplace_back(std::move(i->item));
+                } catch (const std::bad_alloc&) {
+                    // release in the lock
+                }
+                i = idle.erase(i);
+            }
+            it = idle.empty() ? state->items.erase(it) : std::next(it);
+        }
+        const size_t count = state->stats.idle;
+        state->stats.idle = 0;
+        for (const auto& [key, idle] : state->items)
+            state->stats.idle += idle.size();
+        state->stats.evicted += count - state->stats.idle;
+        return count - state->stats.idle;
+    }
+
+    /// @brief Release all idle items
+    size_t clear() noexcept {
+        return evict(clock_t::duration::zero());
+    }
+
+    [[nodiscard]] stats_t stats() const noexcept {
+        std::lock_guard lck{state->mtx};
+        return state->stats;
+    }
+};
@@ -0,0 +1,298 @@
+#include "unicode.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+
+#include "simd.hpp"
+
+namespace {
+
+/// @note sizeof(wchar_t) is 2 on Windows(UTF-16) and 4 on the others(UTF-32)
+constexpr bool wide_is_utf16 = sizeof(wchar_t) == 2;
+
+[[noreturn]] void throw_illegal_sequence(const char* fname) noexcept(false) {
+    throw std::system_error{std::make_error_code(std::errc::illegal_byte_sequence), fname};
+}
+
+bool is_high_surrogate(uint32_t u) noexcept {
+    return (u & 0xFC00) == 0xD800;
+}
+bool is_low_surrogate(uint32_t u) noexcept {
+    return (u & 0xFC00) == 0xDC00;
+}
+
+/// @return count of leading ASCII code units in `[ptr, ptr + count)`. Multiple of the vector width
+size_t skip_ascii(const wchar_t* ptr, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MEDIA0_SSE2)
+    if constexpr (wide_is_utf16) {
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(-0x80)), _mm_setzero_si128())) !=
+                0xFFFF)
+                break;
+        }
+    } else {
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, _mm_set1_epi32(-0x80)), _mm_setzero_si128())) !=
+                0xFFFF)
+                break;
+        }
+    }
+#elif defined(MEDIA0_NEON)
+    if constexpr (wide_is_utf16) {
+        for (; i + 8 <= count; i += 8)
+            if (vmaxvq_u16(vld1q_u16(reinterpret_cast<const uint16_t*>(ptr + i))) >= 0x80)
+                break;
+    } else {
+        for (; i + 4 <= count; i += 4)
+            if (vmaxvq_u32(vld1q_u32(reinterpret_cast<const uint32_t*>(ptr + i))) >= 0x80)
+                break;
+    }
+#endif
+    return i;
+}
+
+/// @return count of leading ASCII bytes in `[ptr, ptr + count)`. Multiple of the vector width
+size_t skip_ascii(const char* ptr, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MEDIA0_SSE2)
+    for (; i + 16 <= count; i += 16)
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + i))) != 0)
+            break;
+#elif defined(MEDIA0_NEON)
+    for (; i + 16 <= count; i += 16)
+        if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(ptr + i))) >= 0x80)
+            break;
+#endif
+    return i;
+}
+
+/// @brief narrow the ASCII block which was accepted by `skip_ascii`
+void copy_ascii(const wchar_t* src, size_t count, char* dst) noexcept {
+    size_t i = 0;
+#if defined(MEDIA0_SSE2)
+    if constexpr (wide_is_utf16) {
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(v, v));
+        }
+    } else {
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            v = _mm_packs_epi32(v, v); // values are below 0x80. saturation won't happen
+            v = _mm_packus_epi16(v, v);
+            int32_t word = _mm_cvtsi128_si32(v);
+            std::memcpy(dst + i, &word, 4);
+        }
+    }
+#elif defined(MEDIA0_NEON)
+    if constexpr (wide_is_utf16) {
+        for (; i + 8 <= count; i += 8)
+            vst1_u8(reinterpret_cast<uint8_t*>(dst + i), vmovn_u16(vld1q_u16(reinterpret_cast<const uint16_t*>(src + i))));
+    } else {
+        for (; i + 8 <= count; i += 8) {
+            uint16x4_t lo = vmovn_u32(vld1q_u32(reinterpret_cast<const uint32_t*>(src + i)));
+            uint16x4_t hi = vmovn_u32(vld1q_u32(reinterpret_cast<const uint32_t*>(src + i + 4)));
+            vst1_u8(reinterpret_cast<uint8_t*>(dst + i), vmovn_u16(vcombine_u16(lo, hi)));
+        }
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = static_cast<char>(src[i]);
+}
+
+/// @brief widen the ASCII block which was accepted by `skip_ascii`
+void copy_ascii(const char* src, size_t count, wchar_t* dst) noexcept {
+    size_t i = 0;
+#if defined(MEDIA0_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        if constexpr (wide_is_utf16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), hi);
+        } else {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 12), _mm_unpackhi_epi16(hi, zero));
+        }
+    }
+#elif defined(MEDIA0_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(src + i));
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+        if constexpr (wide_is_utf16) {
+            vst1q_u16(reinterpret_cast<uint16_t*>(dst + i), lo);
+            vst1q_u16(reinterpret_cast<uint16_t*>(dst + i + 8), hi);
+        } else {
+            auto* out = reinterpret_cast<uint32_t*>(dst + i);
+            vst1q_u32(out + 0, vmovl_u16(vget_low_u16(lo)));
+            vst1q_u32(out + 4, vmovl_u16(vget_high_u16(lo)));
+            vst1q_u32(out + 8, vmovl_u16(vget_low_u16(hi)));
+            vst1q_u32(out + 12, vmovl_u16(vget_high_u16(hi)));
+        }
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = static_cast<wchar_t>(static_cast<unsigned char>(src[i]));
+}
+
+/// @brief read one code point from the wide input. Unpaired surrogates are rejected
+/// @return count of consumed code units
+size_t read_code_point(const wchar_t* ptr, const wchar_t* end, uint32_t& cp) noexcept(false) {
+    cp = static_cast<uint32_t>(ptr[0]);
+    if constexpr (wide_is_utf16) {
+        if (is_low_surrogate(cp))
+            throw_illegal_sequence("w2mb");
+        if (is_high_surrogate(cp)) {
+            if (ptr + 1 == end || is_low_surrogate(static_cast<uint32_t>(ptr[1])) == false)
+                throw_illegal_sequence("w2mb");
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (static_cast<uint32_t>(ptr[1]) - 0xDC00);
+            return 2;
+        }
+    } else {
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+            throw_illegal_sequence("w2mb");
+    }
+    return 1;
+}
+
+size_t utf8_width(uint32_t cp) noexcept {
+    if (cp < 0x80)
+        return 1;
+    if (cp < 0x800)
+        return 2;
+    if (cp < 0x10000)
+        return 3;
+    return 4;
+}
+
+/// @brief read one code point from the UTF-8 input with validation(overlong, surrogate, range)
+/// @return count of consumed bytes. 0 if the sequence is valid but incomplete
+size_t read_code_point(const unsigned char* ptr, const unsigned char* end, uint32_t& cp) noexcept(false) {
+    const uint32_t lead = ptr[0];
+    size_t len = 0;
+    uint32_t min = 0;
+    if (lead < 0x80) {
+        cp = lead;
+        return 1;
+    } else if ((lead & 0xE0) == 0xC0) {
+        len = 2, min = 0x80, cp = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+        len = 3, min = 0x800, cp = lead & 0x0F;
+    } else if ((lead & 0xF8) == 0xF0) {
+        len = 4, min = 0x10000, cp = lead & 0x07;
+    } else {
+        throw_illegal_sequence("mb2w");
+    }
+    const size_t available = static_cast<size_t>(end - ptr);
+    for (size_t i = 1; i < len; ++i) {
+        if (i == available)
+            return 0;
+        if ((ptr[i] & 0xC0) != 0x80)
+            throw_illegal_sequence("mb2w");
+        cp = (cp << 6) | (ptr[i] & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        throw_illegal_sequence("mb2w");
+    return len;
+}
+
+} // namespace
+
+std::string w2mb(std::wstring_view in) noexcept(false) {
+    const wchar_t* const begin = in.data();
+    const wchar_t* const end = begin + in.length();
+    size_t length = 0;
+    for (const wchar_t* ptr = begin; ptr != end;) {
+        if (size_t count = skip_ascii(ptr, static_cast<size_t>(end - ptr)); count) {
+            length += count;
+            ptr += count;
+            continue;
+        }
+        uint32_t cp = 0;
+        ptr += read_code_point(ptr, end, cp);
+        length += utf8_width(cp);
+    }
+    std::string out(length, '\0');
+    char* dst = out.data();
+    for (const wchar_t* ptr = begin; ptr != end;) {
+        if (size_t count = skip_ascii(ptr, static_cast<size_t>(end - ptr)); count) {
+            copy_ascii(ptr, count, dst);
+            dst += count;
+            ptr += count;
+            continue;
+        }
+        uint32_t cp = 0;
+        ptr += read_code_point(ptr, end, cp);
+        switch (utf8_width(cp)) {
+        case 1:
+            *dst++ = static_cast<char>(cp);
+            break;
+        case 2:
+            *dst++ = static_cast<char>(0xC0 | (cp >> 6));
+            *dst++ = static_cast<char>(0x80 | (cp & 0x3F));
+            break;
+        case 3:
+            *dst++ = static_cast<char>(0xE0 | (cp >> 12));
+            *dst++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            *dst++ = static_cast<char>(0x80 | (cp & 0x3F));
+            break;
+        default:
+            *dst++ = static_cast<char>(0xF0 | (cp >> 18));
+            *dst++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            *dst++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            *dst++ = static_cast<char>(0x80 | (cp & 0x3F));
+            break;
+        }
+    }
+    return out;
+}
+
+std::wstring mb2w(std::string_view in) noexcept(false) {
+    const auto* const begin = reinterpret_cast<const unsigned char*>(in.data());
+    const auto* end = begin + in.length();
+    size_t length = 0;
+    for (const unsigned char* ptr = begin; ptr != end;) {
+        if (size_t count = skip_ascii(reinterpret_cast<const char*>(ptr), static_cast<size_t>(end - ptr)); count) {
+            length += count;
+            ptr += count;
+            continue;
+        }
+        uint32_t cp = 0;
+        size_t len = read_code_point(ptr, end, cp);
+        if (len == 0) { // valid but incomplete
+            end = ptr;  // nothing to do more
+            break;
+        }
+        ptr += len;
+        length += (wide_is_utf16 && cp >= 0x10000) ? 2 : 1;
+    }
+    std::wstring out(length, L'\0');
+    wchar_t* dst = out.data();
+    for (const unsigned char* ptr = begin; ptr != end;) {
+        if (size_t count = skip_ascii(reinterpret_cast<const char*>(ptr), static_cast<size_t>(end - ptr)); count) {
+            copy_ascii(reinterpret_cast<const char*>(ptr), count, dst);
+            dst += count;
+            ptr += count;
+            continue;
+        }
+        uint32_t cp = 0;
+        ptr += read_code_point(ptr, end, cp);
+        if (wide_is_utf16 && cp >= 0x10000) {
+            cp -= 0x10000;
+            *dst++ = static_cast<wchar_t>(0xD800 + (cp >> 10));
+            *dst++ = static_cast<wchar_t>(0xDC00 + (cp & 0x3FF));
+            continue;
+        }
+        *dst++ = static_cast<wchar_t>(cp);
+    }
+    return out;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Locale independent UTF-16(UTF-32 for 4 byte `wchar_t`) to UTF-8 conversion
+ * @details The first pass validates the input and computes the exact output length.
+ *          The second pass encodes into the pre-sized string. ASCII blocks are narrowed with SIMD
+ * @throws std::system_error `std::errc::illegal_byte_sequence` for unpaired surrogates
+ */
+[[nodiscard]] std::string w2mb(std::wstring_view in) noexcept(false);
+
+/**
+ * @brief Locale independent UTF-8 to UTF-16(UTF-32 for 4 byte `wchar_t`) conversion
+ * @details Same 2 pass strategy with `w2mb`. ASCII blocks are widened with SIMD.
+ *          Incomplete sequence at the end of the input is ignored.
+ * @throws std::system_error `std::errc::illegal_byte_sequence` for malformed/overlong sequences
+ */
+[[nodiscard]] std::wstring mb2w(std::string_view in) noexcept(false);
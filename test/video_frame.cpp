@@ -0,0 +1,249 @@
+#include "video_frame.hpp"
+
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr size_t row_alignment = 64;
+
+constexpr uint32_t align_up(uint32_t value, uint32_t alignment) noexcept {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/// @brief Placement of the planes in one buffer
+struct frame_layout_t final {
+    size_t size = 0; // including the padding for the alignment of the base
+    size_t offsets[3]{};
+    uint32_t strides[3]{};
+
+  public:
+    explicit frame_layout_t(const video_format_t& format) noexcept(false) {
+        if (format.width == 0 || format.height == 0 || is_compressed(format.pixel) ||
+            get_plane_count(format.pixel) == 0)
+            throw std::invalid_argument{"unsupported video_format_t"};
+        size_t offset = 0;
+        for (uint32_t i = 0; i < get_plane_count(format.pixel); ++i) {
+            const plane_extent_t extent = get_plane_extent(format, i);
+            strides[i] = align_up(extent.row_bytes, row_alignment);
+            offsets[i] = offset;
+            offset += static_cast<size_t>(strides[i]) * extent.rows;
+        }
+        size = offset + row_alignment - 1;
+    }
+
+    void assign(video_frame_t& frame, uint8_t* block) const noexcept {
+        const auto address = reinterpret_cast<uintptr_t>(block);
+        uint8_t* base = block + (row_alignment - address % row_alignment) % row_alignment;
+        for (uint32_t i = 0; i < 3; ++i)
+            frame.planes[i] = strides[i] ? video_plane_t{base + offsets[i], strides[i]} : video_plane_t{};
+    }
+};
+
+} // namespace
+
+const char* to_string(pixel_format_t pixel) noexcept {
+    switch (pixel) {
+    case pixel_format_t::nv12:
+        return "NV12";
+    case pixel_format_t::i420:
+        return "I420";
+    case pixel_format_t::rgb32:
+        return "RGB32";
+    case pixel_format_t::argb32:
+        return "ARGB32";
+    case pixel_format_t::h264:
+        return "H264";
+    default:
+        return "unknown";
+    }
+}
+
+bool is_compressed(pixel_format_t pixel) noexcept {
+    return pixel == pixel_format_t::h264;
+}
+
+uint32_t get_plane_count(pixel_format_t pixel) noexcept {
+    switch (pixel) {
+    case pixel_format_t::nv12:
+        return 2;
+    case pixel_format_t::i420:
+        return 3;
+    case pixel_format_t::rgb32:
+    case pixel_format_t::argb32:
+    case pixel_format_t::h264:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+bool video_format_t::operator==(const video_format_t& rhs) const noexcept {
+    return same_layout(rhs) && fps_num == rhs.fps_num && fps_den == rhs.fps_den;
+}
+
+bool video_format_t::operator!=(const video_format_t& rhs) const noexcept {
+    return !(*this == rhs);
+}
+
+bool video_format_t::same_layout(const video_format_t& rhs) const noexcept {
+    return pixel == rhs.pixel && width == rhs.width && height == rhs.height;
+}
+
+/// @note The chroma planes of the odd sizes are rounded up
+plane_extent_t get_plane_extent(const video_format_t& format, uint32_t index) noexcept {
+    const uint32_t half_width = (format.width + 1) / 2;
+    const uint32_t half_height = (format.height + 1) / 2;
+    switch (format.pixel) {
+    case pixel_format_t::nv12:
+        if (index == 0)
+            return {format.width, format.height};
+        if (index == 1)
+            return {half_width * 2, half_height};
+        break;
+    case pixel_format_t::i420:
+        if (index == 0)
+            return {format.width, format.height};
+        if (index < 3)
+            return {half_width, half_height};
+        break;
+    case pixel_format_t::rgb32:
+    case pixel_format_t::argb32:
+        if (index == 0)
+            return {format.width * 4, format.height};
+        break;
+    default:
+        break;
+    }
+    return {};
+}
+
+video_frame_t::operator bool() const noexcept {
+    return planes[0].data != nullptr;
+}
+
+bool video_frame_t::keyframe() const noexcept {
+    return flags & frame_flag_keyframe;
+}
+
+size_t video_frame_t::size_bytes() const noexcept {
+    if (is_compressed(format.pixel))
+        return planes[0].stride;
+    size_t size = 0;
+    for (uint32_t i = 0; i < get_plane_count(format.pixel); ++i)
+        size += static_cast<size_t>(planes[i].stride) * get_plane_extent(format, i).rows;
+    return size;
+}
+
+video_frame_t allocate_frame(const video_format_t& format) noexcept(false) {
+    const frame_layout_t layout{format};
+    std::shared_ptr<uint8_t[]> block{new uint8_t[layout.size]};
+    video_frame_t frame{};
+    frame.format = format;
+    layout.assign(frame, block.get());
+    frame.storage = std::move(block);
+    return frame;
+}
+
+void copy_frame(const video_frame_t& src, video_frame_t& dst) noexcept(false) {
+    if (src.format.same_layout(dst.format) == false)
+        throw std::invalid_argument{"copy_frame: different layout"};
+    if (is_compressed(src.format.pixel))
+        throw std::invalid_argument{"copy_frame: compressed format"};
+    for (uint32_t i = 0; i < get_plane_count(src.format.pixel); ++i) {
+        const plane_extent_t extent = get_plane_extent(src.format, i);
+        const video_plane_t& from = src.planes[i];
+        video_plane_t& to = dst.planes[i];
+        for (uint32_t y = 0; y < extent.rows; ++y)
+            std::memcpy(to.data + static_cast<size_t>(y) * to.stride, from.data + static_cast<size_t>(y) * from.stride,
+                        extent.row_bytes);
+    }
+    dst.format = src.format;
+    dst.timestamp = src.timestamp;
+    dst.duration = src.duration;
+    dst.flags = src.flags;
+}
+
+struct frame_pool_t::shared_state_t final {
+    mutable std::mutex mtx{};
+    video_format_t format;
+    frame_layout_t layout;
+    const size_t max_idle;
+    std::vector<uint8_t*> idle{};
+    uint64_t generation = 0; // changes when the size of the buffer changes
+    size_t allocated = 0;
+    size_t reused = 0;
+
+  public:
+    shared_state_t(const video_format_t& _format, size_t _max_idle) noexcept(false)
+        : format{_format}, layout{_format}, max_idle{_max_idle} {
+        idle.reserve(max_idle);
+    }
+    ~shared_state_t() noexcept {
+        for (uint8_t* block : idle)
+            delete[] block;
+    }
+};
+
+frame_pool_t::frame_pool_t(const video_format_t& format, size_t max_idle) noexcept(false)
+    : state{std::make_shared<shared_state_t>(format, max_idle)} {
+}
+
+video_frame_t frame_pool_t::acquire() noexcept(false) {
+    uint8_t* block = nullptr;
+    video_frame_t frame{};
+    uint64_t generation = 0;
+    {
+        std::lock_guard lck{state->mtx};
+        if (state->idle.empty() == false) {
+            block = state->idle.back();
+            state->idle.pop_back();
+            ++state->reused;
+        } else {
+            block = new uint8_t[state->layout.size];
+            ++state->allocated;
+        }
+        frame.format = state->format;
+        state->layout.assign(frame, block);
+        generation = state->generation;
+    }
+    // return to the pool if it is alive and the size is not changed
+    frame.storage = std::shared_ptr<uint8_t>{
+        block, [weak = std::weak_ptr<shared_state_t>{state}, generation](uint8_t* block) noexcept {
+            if (auto pool = weak.lock()) {
+                std::lock_guard lck{pool->mtx};
+                if (pool->generation == generation && pool->idle.size() < pool->max_idle) {
+                    pool->idle.emplace_back(block);
+                    return;
+                }
+            }
+            delete[] block;
+        }};
+    return frame;
+}
+
+void frame_pool_t::reset(const video_format_t& format) noexcept(false) {
+    const frame_layout_t layout{format};
+    std::lock_guard lck{state->mtx};
+    state->format = format;
+    const bool resized = layout.size != state->layout.size;
+    state->layout = layout;
+    if (resized == false)
+        return; // the idle buffers fit. the planes are re-assigned on `acquire`
+    ++state->generation;
+    for (uint8_t* block : state->idle)
+        delete[] block;
+    state->idle.clear();
+}
+
+video_format_t frame_pool_t::format() const noexcept {
+    std::lock_guard lck{state->mtx};
+    return state->format;
+}
+
+frame_pool_t::stats_t frame_pool_t::stats() const noexcept {
+    std::lock_guard lck{state->mtx};
+    return {state->allocated, state->reused, state->idle.size()};
+}
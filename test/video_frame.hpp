@@ -0,0 +1,131 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief Pixel layouts of the portable transforms. Memory order follows the Media Foundation subtypes
+ * @see https://docs.microsoft.com/en-us/windows/win32/medfound/video-subtype-guids
+ * @see https://docs.microsoft.com/en-us/windows/win32/medfound/recommended-8-bit-yuv-formats-for-video-rendering
+ */
+enum class pixel_format_t : uint32_t {
+    unknown = 0,
+    nv12 = 1,   // MFVideoFormat_NV12. Y plane + interleaved UV plane
+    i420 = 2,   // MFVideoFormat_I420. Y, U, V planes
+    rgb32 = 3,  // MFVideoFormat_RGB32. B,G,R,X in memory
+    argb32 = 4, // MFVideoFormat_ARGB32. B,G,R,A in memory
+    h264 = 5,   // MFVideoFormat_H264. compressed. `planes[0]` holds the bytes
+};
+
+[[nodiscard]] const char* to_string(pixel_format_t pixel) noexcept;
+[[nodiscard]] bool is_compressed(pixel_format_t pixel) noexcept;
+[[nodiscard]] uint32_t get_plane_count(pixel_format_t pixel) noexcept;
+
+/// @brief Counterpart of `MF_MT_FRAME_SIZE`, `MF_MT_FRAME_RATE`
+struct video_format_t final {
+    pixel_format_t pixel = pixel_format_t::unknown;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t fps_num = 0; // 0 if unknown
+    uint32_t fps_den = 1;
+
+  public:
+    [[nodiscard]] bool operator==(const video_format_t& rhs) const noexcept;
+    [[nodiscard]] bool operator!=(const video_format_t& rhs) const noexcept;
+    /// @brief Same layout of the pixels. The frame rate is ignored
+    [[nodiscard]] bool same_layout(const video_format_t& rhs) const noexcept;
+};
+
+/// @brief Bytes of one row and count of rows of the plane. `{0, 0}` for the missing planes
+struct plane_extent_t final {
+    uint32_t row_bytes = 0;
+    uint32_t rows = 0;
+};
+[[nodiscard]] plane_extent_t get_plane_extent(const video_format_t& format, uint32_t index) noexcept;
+
+/// @brief Region in pixels. Counterpart of `MFVideoArea`
+struct video_rect_t final {
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+struct video_plane_t final {
+    uint8_t* data = nullptr;
+    uint32_t stride = 0; // for the compressed formats, length of the `data`
+};
+
+enum video_frame_flags_t : uint32_t {
+    frame_flag_keyframe = 1 << 0,      // MFSampleExtension_CleanPoint
+    frame_flag_discontinuity = 1 << 1, // MFSampleExtension_Discontinuity
+    frame_flag_interlaced = 1 << 2,    // MFSampleExtension_Interlaced
+    frame_flag_bottom_first = 1 << 3,  // MFSampleExtension_BottomFieldFirst
+};
+
+/**
+ * @brief Portable counterpart of `IMFSample` with one buffer.
+ *        Copies share the pixels. The `storage` keeps the planes alive
+ * @note The planes are writable only by the producer. Consumers must treat shared frames as read-only
+ */
+struct video_frame_t final {
+    video_format_t format{};
+    video_plane_t planes[3]{};
+    int64_t timestamp = 0; // unit 100-nanosecond. same as `IMFSample::GetSampleTime`
+    int64_t duration = 0;
+    uint32_t flags = 0; // `video_frame_flags_t`
+    std::shared_ptr<void> storage{};
+    /// @brief Backend specific object which is kept alive by `storage`. `IMFSample*` for the MF backend
+    void* native = nullptr;
+    const void* native_type = nullptr;
+
+  public:
+    [[nodiscard]] explicit operator bool() const noexcept;
+    [[nodiscard]] bool keyframe() const noexcept;
+    [[nodiscard]] size_t size_bytes() const noexcept;
+};
+
+/**
+ * @brief Allocate one buffer for all planes. Each row is aligned to 64 bytes
+ * @throws std::invalid_argument the format is unknown or empty
+ */
+video_frame_t allocate_frame(const video_format_t& format) noexcept(false);
+
+/// @brief Copy pixels of the same layout. The timestamps and flags are copied too
+void copy_frame(const video_frame_t& src, video_frame_t& dst) noexcept(false);
+
+/**
+ * @brief Recycles the buffers of one format, like `IMFVideoSampleAllocatorEx`.
+ *        The buffer goes back to the pool when the last copy of the frame is released.
+ *        The frames can outlive the pool
+ */
+class frame_pool_t final {
+  public:
+    struct stats_t final {
+        size_t allocated = 0; // buffers created by the pool
+        size_t reused = 0;    // `acquire` served from the idle buffers
+        size_t idle = 0;
+    };
+
+  private:
+    struct shared_state_t;
+    std::shared_ptr<shared_state_t> state;
+
+  public:
+    /// @param max_idle buffers kept when the frames are released. The others are freed
+    explicit frame_pool_t(const video_format_t& format, size_t max_idle = 8) noexcept(false);
+    frame_pool_t(const frame_pool_t&) = delete;
+    frame_pool_t(frame_pool_t&&) = delete;
+    frame_pool_t& operator=(const frame_pool_t&) = delete;
+    frame_pool_t& operator=(frame_pool_t&&) = delete;
+    ~frame_pool_t() noexcept = default;
+
+    /// @note the frame is not cleared
+    [[nodiscard]] video_frame_t acquire() noexcept(false);
+
+    /// @brief Change the format. The idle buffers are freed if the size doesn't fit
+    void reset(const video_format_t& format) noexcept(false);
+
+    [[nodiscard]] video_format_t format() const noexcept;
+    [[nodiscard]] stats_t stats() const noexcept;
+};
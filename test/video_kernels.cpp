@@ -0,0 +1,444 @@
+#include "video_kernels.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+bool is_yuv(pixel_format_t pixel) noexcept {
+    return pixel == pixel_format_t::nv12 || pixel == pixel_format_t::i420;
+}
+
+bool is_rgb(pixel_format_t pixel) noexcept {
+    return pixel == pixel_format_t::rgb32 || pixel == pixel_format_t::argb32;
+}
+
+uint8_t clamp_u8(int32_t value) noexcept {
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+/// @brief Chroma access for both NV12 and I420. `step` is the distance of the samples in a row
+template <typename T>
+struct chroma_view_t final {
+    T* u;
+    T* v;
+    uint32_t stride;
+    uint32_t step;
+
+  public:
+    template <typename Frame>
+    explicit chroma_view_t(Frame& frame) noexcept
+        : u{frame.planes[1].data}, v{frame.format.pixel == pixel_format_t::nv12 ? frame.planes[1].data + 1
+                                                                                : frame.planes[2].data},
+          stride{frame.planes[1].stride}, step{frame.format.pixel == pixel_format_t::nv12 ? 2u : 1u} {
+    }
+};
+
+void copy_plane(const uint8_t* src, uint32_t src_stride, uint8_t* dst, uint32_t dst_stride, uint32_t row_bytes,
+                uint32_t rows) noexcept {
+    for (uint32_t y = 0; y < rows; ++y)
+        std::memcpy(dst + static_cast<size_t>(y) * dst_stride, src + static_cast<size_t>(y) * src_stride, row_bytes);
+}
+
+void convert_yuv_to_yuv(const video_frame_t& src, video_frame_t& dst) noexcept {
+    copy_plane(src.planes[0].data, src.planes[0].stride, dst.planes[0].data, dst.planes[0].stride, src.format.width,
+               src.format.height);
+    const chroma_view_t<const uint8_t> from{src};
+    const chroma_view_t<uint8_t> to{dst};
+    const plane_extent_t extent = get_plane_extent(src.format, 1);
+    const uint32_t width = src.format.pixel == pixel_format_t::nv12 ? extent.row_bytes / 2 : extent.row_bytes;
+    for (uint32_t y = 0; y < extent.rows; ++y) {
+        const size_t src_offset = static_cast<size_t>(y) * from.stride;
+        const size_t dst_offset = static_cast<size_t>(y) * to.stride;
+        for (uint32_t x = 0; x < width; ++x) {
+            to.u[dst_offset + x * to.step] = from.u[src_offset + x * from.step];
+            to.v[dst_offset + x * to.step] = from.v[src_offset + x * from.step];
+        }
+    }
+}
+
+void convert_yuv_to_rgb(const video_frame_t& src, video_frame_t& dst) noexcept {
+    const chroma_view_t<const uint8_t> chroma{src};
+    for (uint32_t y = 0; y < src.format.height; ++y) {
+        const uint8_t* luma = src.planes[0].data + static_cast<size_t>(y) * src.planes[0].stride;
+        const size_t chroma_offset = static_cast<size_t>(y / 2) * chroma.stride;
+        uint8_t* out = dst.planes[0].data + static_cast<size_t>(y) * dst.planes[0].stride;
+        for (uint32_t x = 0; x < src.format.width; ++x, out += 4) {
+            const int32_t c = 298 * (luma[x] - 16);
+            const int32_t d = chroma.u[chroma_offset + (x / 2) * chroma.step] - 128;
+            const int32_t e = chroma.v[chroma_offset + (x / 2) * chroma.step] - 128;
+            out[0] = clamp_u8((c + 516 * d + 128) >> 8);
+            out[1] = clamp_u8((c - 100 * d - 208 * e + 128) >> 8);
+            out[2] = clamp_u8((c + 409 * e + 128) >> 8);
+            out[3] = 0xFF;
+        }
+    }
+}
+
+void convert_rgb_to_yuv(const video_frame_t& src, video_frame_t& dst) noexcept {
+    const uint32_t width = src.format.width;
+    const uint32_t height = src.format.height;
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* in = src.planes[0].data + static_cast<size_t>(y) * src.planes[0].stride;
+        uint8_t* luma = dst.planes[0].data + static_cast<size_t>(y) * dst.planes[0].stride;
+        for (uint32_t x = 0; x < width; ++x, in += 4)
+            luma[x] = static_cast<uint8_t>(((66 * in[2] + 129 * in[1] + 25 * in[0] + 128) >> 8) + 16);
+    }
+    // average of 2x2 block. the last row/column is repeated for the odd sizes
+    const chroma_view_t<uint8_t> chroma{dst};
+    for (uint32_t y = 0; y < (height + 1) / 2; ++y) {
+        const uint8_t* row0 = src.planes[0].data + static_cast<size_t>(2 * y) * src.planes[0].stride;
+        const uint8_t* row1 =
+            src.planes[0].data + static_cast<size_t>(std::min(2 * y + 1, height - 1)) * src.planes[0].stride;
+        const size_t offset = static_cast<size_t>(y) * chroma.stride;
+        for (uint32_t x = 0; x < (width + 1) / 2; ++x) {
+            const uint32_t x0 = 2 * x * 4;
+            const uint32_t x1 = std::min(2 * x + 1, width - 1) * 4;
+            int32_t bgr[3]{};
+            for (uint32_t c = 0; c < 3; ++c)
+                bgr[c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4;
+            chroma.u[offset + x * chroma.step] =
+                static_cast<uint8_t>(((-38 * bgr[2] - 74 * bgr[1] + 112 * bgr[0] + 128) >> 8) + 128);
+            chroma.v[offset + x * chroma.step] =
+                static_cast<uint8_t>(((112 * bgr[2] - 94 * bgr[1] - 18 * bgr[0] + 128) >> 8) + 128);
+        }
+    }
+}
+
+void convert_rgb_to_rgb(const video_frame_t& src, video_frame_t& dst) noexcept {
+    copy_plane(src.planes[0].data, src.planes[0].stride, dst.planes[0].data, dst.planes[0].stride,
+               src.format.width * 4, src.format.height);
+    if (dst.format.pixel != pixel_format_t::argb32 || src.format.pixel == pixel_format_t::argb32)
+        return;
+    for (uint32_t y = 0; y < dst.format.height; ++y) {
+        uint8_t* out = dst.planes[0].data + static_cast<size_t>(y) * dst.planes[0].stride;
+        for (uint32_t x = 0; x < dst.format.width; ++x)
+            out[4 * x + 3] = 0xFF; // the X of RGB32 is undefined
+    }
+}
+
+} // namespace
+
+void convert_frame(const video_frame_t& src, video_frame_t& dst) noexcept(false) {
+    if (src.format.width != dst.format.width || src.format.height != dst.format.height)
+        throw std::invalid_argument{"convert_frame: different size"};
+    const pixel_format_t from = src.format.pixel;
+    const pixel_format_t to = dst.format.pixel;
+    if (is_yuv(from) && is_yuv(to))
+        return convert_yuv_to_yuv(src, dst);
+    if (is_yuv(from) && is_rgb(to))
+        return convert_yuv_to_rgb(src, dst);
+    if (is_rgb(from) && is_yuv(to))
+        return convert_rgb_to_yuv(src, dst);
+    if (is_rgb(from) && is_rgb(to))
+        return convert_rgb_to_rgb(src, dst);
+    throw std::invalid_argument{"convert_frame: unsupported format"};
+}
+
+void make_scale_filter(uint32_t src_length, uint32_t dst_length, scale_filter_t& filter) noexcept(false) {
+    filter.indices.resize(dst_length);
+    filter.weights.resize(dst_length);
+    for (uint32_t i = 0; i < dst_length; ++i) {
+        int64_t position = ((2 * static_cast<int64_t>(i) + 1) * src_length << 16) / (2 * dst_length) - (1 << 15);
+        if (position < 0)
+            position = 0;
+        uint32_t index = static_cast<uint32_t>(position >> 16);
+        uint32_t weight = static_cast<uint32_t>(position >> 8) & 0xFF;
+        if (index >= src_length - 1) {
+            index = src_length - 1;
+            weight = 0;
+        }
+        filter.indices[i] = index;
+        filter.weights[i] = weight;
+    }
+}
+
+namespace {
+
+/// @brief The pairs of the samples around the dst pixels `x`... in the row. 4 output bytes, 8 bytes of the samples
+uint64_t gather_pairs(const uint8_t* row, const uint32_t* indices, uint32_t channels) noexcept {
+    uint64_t bytes = 0;
+    switch (channels) {
+    case 1: // L R | L R | L R | L R
+        for (uint32_t i = 0; i < 4; ++i) {
+            uint16_t pair = 0;
+            std::memcpy(&pair, row + indices[i], sizeof(pair));
+            bytes |= static_cast<uint64_t>(pair) << (16 * i);
+        }
+        break;
+    case 2: // UL VL UR VR | UL VL UR VR
+        for (uint32_t i = 0; i < 2; ++i) {
+            uint32_t pair = 0;
+            std::memcpy(&pair, row + 2 * indices[i], sizeof(pair));
+            bytes |= static_cast<uint64_t>(pair) << (32 * i);
+        }
+        break;
+    default: // L0 L1 L2 L3 R0 R1 R2 R3
+        std::memcpy(&bytes, row + 4 * indices[0], sizeof(bytes));
+        break;
+    }
+    return bytes;
+}
+
+#if defined(MEDIA0_SSE2)
+/**
+ * @brief 4 outputs of `scale_row` in 32 bit lanes. The sum of the 4 taps has no intermediate rounding,
+ *        so the vertical pass goes first in 16 bit and the horizontal one uses `_mm_madd_epi16` with 0x8000 bias
+ */
+__m128i scale_pairs(const uint8_t* row0, const uint8_t* row1, const uint32_t* indices, const uint32_t* weights,
+                    uint32_t channels, __m128i top_weight, __m128i bottom_weight) noexcept {
+    const auto widen = [channels, indices](const uint8_t* row) {
+        const uint64_t bytes = gather_pairs(row, indices, channels);
+        return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&bytes)), _mm_setzero_si128());
+    };
+    const __m128i top = widen(row0);
+    const __m128i bottom = widen(row1);
+    __m128i pairs = _mm_add_epi16(_mm_mullo_epi16(top, top_weight), _mm_mullo_epi16(bottom, bottom_weight));
+    __m128i next{};
+    switch (channels) {
+    case 1:
+        next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights));
+        break;
+    case 2:
+        pairs = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pairs, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        next = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights));
+        next = _mm_unpacklo_epi32(next, next);
+        break;
+    default:
+        pairs = _mm_unpacklo_epi16(pairs, _mm_srli_si128(pairs, 8));
+        next = _mm_set1_epi32(static_cast<int32_t>(weights[0]));
+        break;
+    }
+    // (256 - w, w) in each 32 bit lane. the samples are biased by -0x8000 to fit in the signed multiply
+    const __m128i horizontal = _mm_or_si128(_mm_slli_epi32(next, 16), _mm_sub_epi32(_mm_set1_epi32(256), next));
+    const __m128i sum = _mm_madd_epi16(_mm_xor_si128(pairs, _mm_set1_epi16(static_cast<short>(0x8000))), horizontal);
+    return _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32((0x8000 << 8) + (1 << 15))), 16);
+}
+#elif defined(MEDIA0_NEON)
+/// @brief 4 outputs of `scale_row`. The vertical pass in 16 bit, then the horizontal one in 32 bit
+uint8x8_t scale_pairs(const uint8_t* row0, const uint8_t* row1, const uint32_t* indices, const uint32_t* weights,
+                      uint32_t channels, uint16_t top_weight, uint16_t bottom_weight) noexcept {
+    const uint16x8_t top = vmovl_u8(vcreate_u8(gather_pairs(row0, indices, channels)));
+    const uint16x8_t bottom = vmovl_u8(vcreate_u8(gather_pairs(row1, indices, channels)));
+    const uint16x8_t pairs = vmlaq_n_u16(vmulq_n_u16(top, top_weight), bottom, bottom_weight);
+    uint16x4_t left{}, right{}, next{};
+    switch (channels) {
+    case 1: {
+        const uint16x4x2_t split = vuzp_u16(vget_low_u16(pairs), vget_high_u16(pairs));
+        left = split.val[0], right = split.val[1];
+        next = vmovn_u32(vld1q_u32(weights));
+        break;
+    }
+    case 2: {
+        const uint32x2x2_t split =
+            vuzp_u32(vreinterpret_u32_u16(vget_low_u16(pairs)), vreinterpret_u32_u16(vget_high_u16(pairs)));
+        left = vreinterpret_u16_u32(split.val[0]), right = vreinterpret_u16_u32(split.val[1]);
+        const uint16x4_t two = vmovn_u32(vcombine_u32(vld1_u32(weights), vld1_u32(weights)));
+        next = vzip_u16(two, two).val[0];
+        break;
+    }
+    default:
+        left = vget_low_u16(pairs), right = vget_high_u16(pairs);
+        next = vdup_n_u16(static_cast<uint16_t>(weights[0]));
+        break;
+    }
+    const uint32x4_t sum = vmlal_u16(vmull_u16(left, vsub_u16(vdup_n_u16(256), next)), right, next);
+    return vmovn_u16(vcombine_u16(vrshrn_n_u32(sum, 16), vdup_n_u16(0)));
+}
+#endif
+
+} // namespace
+
+void scale_row(const uint8_t* row0, const uint8_t* row1, uint32_t weight, const scale_filter_t& filter,
+               uint32_t channels, uint8_t* dst) noexcept {
+    size_t x = 0;
+#if defined(MEDIA0_SSE2) || defined(MEDIA0_NEON)
+    // the next sample of the last index may be out of the row. it is read only if the weight says so
+    const uint32_t last = filter.indices.empty() ? 0 : filter.indices.back() + (filter.weights.back() ? 1 : 0);
+    size_t count = filter.indices.size();
+    while (count && filter.indices[count - 1] + 1 > last)
+        --count;
+    const uint32_t* indices = filter.indices.data();
+    const uint32_t* weights = filter.weights.data();
+    const bool packed = channels == 1 || channels == 2 || channels == 4;
+    const size_t step = packed ? 16 / channels : 0; // dst pixels of 16 output bytes
+#endif
+#if defined(MEDIA0_SSE2)
+    const __m128i top_weight = _mm_set1_epi16(static_cast<short>(256 - weight));
+    const __m128i bottom_weight = _mm_set1_epi16(static_cast<short>(weight));
+    for (; packed && x + step <= count; x += step) {
+        __m128i lanes[4]{};
+        for (size_t i = 0; i < 4; ++i)
+            lanes[i] = scale_pairs(row0, row1, indices + x + i * step / 4, weights + x + i * step / 4, channels,
+                                   top_weight, bottom_weight);
+        const __m128i words = _mm_packs_epi32(lanes[0], lanes[1]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * channels),
+                         _mm_packus_epi16(words, _mm_packs_epi32(lanes[2], lanes[3])));
+    }
+#elif defined(MEDIA0_NEON)
+    const uint16_t top_weight = static_cast<uint16_t>(256 - weight);
+    const uint16_t bottom_weight = static_cast<uint16_t>(weight);
+    for (; packed && x + step <= count; x += step) {
+        for (size_t i = 0; i < 4; ++i) {
+            const uint8x8_t out = scale_pairs(row0, row1, indices + x + i * step / 4, weights + x + i * step / 4,
+                                              channels, top_weight, bottom_weight);
+            const uint32_t word = vget_lane_u32(vreinterpret_u32_u8(out), 0);
+            std::memcpy(dst + x * channels + 4 * i, &word, sizeof(word));
+        }
+    }
+#endif
+    for (; x < filter.indices.size(); ++x) {
+        const uint32_t wx = filter.weights[x];
+        const uint32_t left = filter.indices[x] * channels;
+        const uint32_t right = wx ? left + channels : left;
+        for (uint32_t c = 0; c < channels; ++c) {
+            const uint32_t top = row0[left + c] * (256 - wx) + row0[right + c] * wx;
+            const uint32_t bottom = row1[left + c] * (256 - wx) + row1[right + c] * wx;
+            dst[x * channels + c] = static_cast<uint8_t>((top * (256 - weight) + bottom * weight + (1 << 15)) >> 16);
+        }
+    }
+}
+
+void scale_plane(const uint8_t* src, uint32_t src_stride, uint32_t src_width, uint32_t src_height, uint8_t* dst,
+                 uint32_t dst_stride, uint32_t dst_width, uint32_t dst_height, uint32_t channels) noexcept(false) {
+    if (src_width == 0 || src_height == 0 || dst_width == 0 || dst_height == 0)
+        return;
+    scale_filter_t fx{}, fy{};
+    make_scale_filter(src_width, dst_width, fx);
+    make_scale_filter(src_height, dst_height, fy);
+    for (uint32_t y = 0; y < dst_height; ++y) {
+        const uint8_t* row0 = src + static_cast<size_t>(fy.indices[y]) * src_stride;
+        const uint8_t* row1 = fy.weights[y] ? row0 + src_stride : row0;
+        scale_row(row0, row1, fy.weights[y], fx, channels, dst + static_cast<size_t>(y) * dst_stride);
+    }
+}
+
+void scale_frame(const video_frame_t& src, video_frame_t& dst) noexcept(false) {
+    if (src.format.pixel != dst.format.pixel || is_compressed(src.format.pixel))
+        throw std::invalid_argument{"scale_frame: unsupported format"};
+    for (uint32_t i = 0; i < get_plane_count(src.format.pixel); ++i) {
+        const uint32_t channels =
+            is_rgb(src.format.pixel) ? 4 : (i > 0 && src.format.pixel == pixel_format_t::nv12 ? 2 : 1);
+        const plane_extent_t from = get_plane_extent(src.format, i);
+        const plane_extent_t to = get_plane_extent(dst.format, i);
+        scale_plane(src.planes[i].data, src.planes[i].stride, from.row_bytes / channels, from.rows, dst.planes[i].data,
+                    dst.planes[i].stride, to.row_bytes / channels, to.rows, channels);
+    }
+}
+
+video_format_t rotate_format(const video_format_t& format, video_rotation_t rotation) noexcept {
+    video_format_t result = format;
+    if (rotation == video_rotation_t::clockwise_90 || rotation == video_rotation_t::clockwise_270)
+        std::swap(result.width, result.height);
+    return result;
+}
+
+namespace {
+
+/// @brief Walk the destination in 32x32 tiles so both sides stay in the cache
+template <typename T>
+void rotate_plane(const uint8_t* src, uint32_t src_stride, uint32_t width, uint32_t height, uint8_t* dst,
+                  uint32_t dst_stride, video_rotation_t rotation, uint32_t mirror) noexcept {
+    const bool swapped = rotation == video_rotation_t::clockwise_90 || rotation == video_rotation_t::clockwise_270;
+    const uint32_t dst_width = swapped ? height : width;
+    const uint32_t dst_height = swapped ? width : height;
+    constexpr uint32_t tile = 32;
+    for (uint32_t ty = 0; ty < dst_height; ty += tile) {
+        for (uint32_t tx = 0; tx < dst_width; tx += tile) {
+            for (uint32_t y = ty; y < std::min(ty + tile, dst_height); ++y) {
+                T* out = reinterpret_cast<T*>(dst + static_cast<size_t>(y) * dst_stride);
+                for (uint32_t x = tx; x < std::min(tx + tile, dst_width); ++x) {
+                    uint32_t sx = x, sy = y;
+                    switch (rotation) {
+                    case video_rotation_t::clockwise_90:
+                        sx = y, sy = height - 1 - x;
+                        break;
+                    case video_rotation_t::clockwise_180:
+                        sx = width - 1 - x, sy = height - 1 - y;
+                        break;
+                    case video_rotation_t::clockwise_270:
+                        sx = width - 1 - y, sy = x;
+                        break;
+                    default:
+                        break;
+                    }
+                    if (mirror & mirror_horizontal)
+                        sx = width - 1 - sx;
+                    if (mirror & mirror_vertical)
+                        sy = height - 1 - sy;
+                    const uint8_t* from = src + static_cast<size_t>(sy) * src_stride + sx * sizeof(T);
+                    std::memcpy(out + x, from, sizeof(T));
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+void rotate_frame(const video_frame_t& src, video_frame_t& dst, video_rotation_t rotation,
+                  uint32_t mirror) noexcept(false) {
+    if (src.format.pixel != dst.format.pixel || is_compressed(src.format.pixel) ||
+        rotate_format(src.format, rotation).same_layout(dst.format) == false)
+        throw std::invalid_argument{"rotate_frame: unexpected format"};
+    for (uint32_t i = 0; i < get_plane_count(src.format.pixel); ++i) {
+        const plane_extent_t extent = get_plane_extent(src.format, i);
+        const video_plane_t& from = src.planes[i];
+        const video_plane_t& to = dst.planes[i];
+        if (is_rgb(src.format.pixel))
+            rotate_plane<uint32_t>(from.data, from.stride, extent.row_bytes / 4, extent.rows, to.data, to.stride,
+                                   rotation, mirror);
+        else if (i > 0 && src.format.pixel == pixel_format_t::nv12)
+            rotate_plane<uint16_t>(from.data, from.stride, extent.row_bytes / 2, extent.rows, to.data, to.stride,
+                                   rotation, mirror);
+        else
+            rotate_plane<uint8_t>(from.data, from.stride, extent.row_bytes, extent.rows, to.data, to.stride, rotation,
+                                  mirror);
+    }
+}
+
+video_rect_t clip_region(const video_format_t& format, video_rect_t region) noexcept {
+    if (is_yuv(format.pixel)) {
+        region.width += region.x & 1;
+        region.height += region.y & 1;
+        region.x &= ~1u;
+        region.y &= ~1u;
+    }
+    if (region.x >= format.width || region.y >= format.height)
+        return {};
+    region.width = std::min(region.width, format.width - region.x);
+    region.height = std::min(region.height, format.height - region.y);
+    if (region.width == 0 || region.height == 0)
+        return {};
+    return region;
+}
+
+video_frame_t crop_frame(const video_frame_t& src, video_rect_t region) noexcept(false) {
+    if (is_compressed(src.format.pixel) || get_plane_count(src.format.pixel) == 0)
+        throw std::invalid_argument{"crop_frame: unsupported format"};
+    region = clip_region(src.format, region);
+    if (region.width == 0)
+        throw std::invalid_argument{"crop_frame: empty region"};
+
+    video_frame_t view = src;
+    view.format.width = region.width;
+    view.format.height = region.height;
+    switch (src.format.pixel) {
+    case pixel_format_t::nv12:
+        view.planes[0].data += static_cast<size_t>(region.y) * src.planes[0].stride + region.x;
+        view.planes[1].data += static_cast<size_t>(region.y / 2) * src.planes[1].stride + region.x;
+        break;
+    case pixel_format_t::i420:
+        view.planes[0].data += static_cast<size_t>(region.y) * src.planes[0].stride + region.x;
+        view.planes[1].data += static_cast<size_t>(region.y / 2) * src.planes[1].stride + region.x / 2;
+        view.planes[2].data += static_cast<size_t>(region.y / 2) * src.planes[2].stride + region.x / 2;
+        break;
+    default:
+        view.planes[0].data += static_cast<size_t>(region.y) * src.planes[0].stride + region.x * 4;
+        break;
+    }
+    return view;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+
+#include "video_frame.hpp"
+
+/**
+ * @brief CPU kernels of the portable transforms. The frames must be allocated by the caller
+ * @note YUV <-> RGB uses BT.601 limited range, the default of `CLSID_CColorConvertDMO`
+ */
+
+/// @brief `src` and `dst` must have the same size. Any pair of the uncompressed formats
+void convert_frame(const video_frame_t& src, video_frame_t& dst) noexcept(false);
+
+/**
+ * @brief Bilinear resampling of one plane. `channels` bytes per pixel are interleaved.
+ *        1 for the Y/U/V planes, 2 for the UV plane of NV12, 4 for RGB32
+ */
+void scale_plane(const uint8_t* src, uint32_t src_stride, uint32_t src_width, uint32_t src_height, uint8_t* dst,
+                 uint32_t dst_stride, uint32_t dst_width, uint32_t dst_height, uint32_t channels) noexcept(false);
+
+/// @brief Bilinear filter of `scale_plane`. Source index and 8 bit weight of the next sample, aligned at the centers
+struct scale_filter_t final {
+    std::vector<uint32_t> indices{};
+    std::vector<uint32_t> weights{}; // the next sample is read only if the weight is not 0
+};
+
+/// @note `src_length` and `dst_length` must not be 0
+void make_scale_filter(uint32_t src_length, uint32_t dst_length, scale_filter_t& filter) noexcept(false);
+
+/// @brief One row of `scale_plane`. `row1` is the next row of `row0` or the same if the `weight` is 0
+void scale_row(const uint8_t* row0, const uint8_t* row1, uint32_t weight, const scale_filter_t& filter,
+               uint32_t channels, uint8_t* dst) noexcept;
+
+/// @brief `src` and `dst` must have the same pixel format
+void scale_frame(const video_frame_t& src, video_frame_t& dst) noexcept(false);
+
+/// @see MF_VIDEO_PROCESSOR_ROTATION
+enum class video_rotation_t : uint32_t {
+    none = 0,
+    clockwise_90 = 90,
+    clockwise_180 = 180,
+    clockwise_270 = 270,
+};
+
+/// @see MF_VIDEO_PROCESSOR_MIRROR
+enum video_mirror_t : uint32_t {
+    mirror_none = 0,
+    mirror_horizontal = 1,
+    mirror_vertical = 2,
+};
+
+/// @return the size after the rotation
+[[nodiscard]] video_format_t rotate_format(const video_format_t& format, video_rotation_t rotation) noexcept;
+
+/// @brief Mirror then rotate. `dst` must have the size of `rotate_format`
+void rotate_frame(const video_frame_t& src, video_frame_t& dst, video_rotation_t rotation,
+                  uint32_t mirror) noexcept(false);
+
+/// @brief Clip by the frame. For the YUV formats the origin is rounded down to even. `{}` if empty
+[[nodiscard]] video_rect_t clip_region(const video_format_t& format, video_rect_t region) noexcept;
+
+/**
+ * @brief View of the region. The planes are shared with `src`, no copy
+ * @see clip_region
+ * @throws std::invalid_argument the clipped region is empty
+ */
+[[nodiscard]] video_frame_t crop_frame(const video_frame_t& src, video_rect_t region) noexcept(false);
@@ -0,0 +1,417 @@
+#include "video_pipeline.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "event_trace.hpp"
+
+namespace {
+
+/// @brief `native_type` of the frame which carries the seek through the queues. The `timestamp` is the target
+constexpr char seek_marker = 0;
+
+/// @brief The steady clock in the unit of the timestamps
+int64_t get_clock() noexcept {
+    using duration_t = std::chrono::duration<int64_t, std::ratio<1, 10'000'000>>;
+    return std::chrono::duration_cast<duration_t>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+video_transform_driver_t::video_transform_driver_t(std::shared_ptr<video_transform_t> _transform,
+                                                   std::string_view name) noexcept(false)
+    : transform{std::move(_transform)}, track{trace_register_track(name)} {
+    if (transform == nullptr)
+        throw std::invalid_argument{"video_transform_driver_t: nullptr"};
+}
+
+video_transform_t& video_transform_driver_t::get() const noexcept {
+    return *transform;
+}
+
+size_t video_transform_driver_t::input_count() const noexcept {
+    return num_input.load(std::memory_order_relaxed);
+}
+
+size_t video_transform_driver_t::output_count() const noexcept {
+    return num_output.load(std::memory_order_relaxed);
+}
+
+size_t video_transform_driver_t::discarded_count() const noexcept {
+    return num_discarded.load(std::memory_order_relaxed);
+}
+
+size_t video_transform_driver_t::late_count() const noexcept {
+    return num_late.load(std::memory_order_relaxed);
+}
+
+size_t video_transform_driver_t::skipped_count() const noexcept {
+    return num_skipped.load(std::memory_order_relaxed);
+}
+
+transform_result_t video_transform_driver_t::pull(const emit_t& emit, bool draining) noexcept {
+    while (true) {
+        video_frame_t output{};
+        switch (auto result = transform->process_output(output)) {
+        case transform_result_t::ok:
+            if (discard_until != INT64_MIN) {
+                // the frames between the sync sample and the seek target. the duration may be unknown
+                if (output.timestamp + std::max<int64_t>(output.duration, 1) <= discard_until) {
+                    ++num_discarded;
+                    continue;
+                }
+                discard_until = INT64_MIN;
+            }
+            ++num_output;
+            trace_emit(trace_event_t::output_produced, track, 0, output.timestamp);
+            if (auto ec = emit ? emit(output) : transform_result_t::ok; ec != transform_result_t::ok)
+                return ec;
+            continue;
+        case transform_result_t::need_more_input:
+            trace_emit(draining ? trace_event_t::drain_end : trace_event_t::need_more_input, track, 0, 0);
+            return transform_result_t::ok;
+        case transform_result_t::stream_change:
+            // the outputs carry their format. the next stage follows them in `renegotiate`
+            trace_emit(trace_event_t::stream_change, track, 0, 0);
+            continue;
+        default:
+            trace_emit(trace_event_t::failed, track, 0, 0, static_cast<uint32_t>(result));
+            return result;
+        }
+    }
+}
+
+/**
+ * @brief The input has a new size. The outputs of the old size go first, then the transform follows the input.
+ *        The settings of the output are kept. The transforms which reset the output get the old one with the new size
+ */
+transform_result_t video_transform_driver_t::renegotiate(const video_format_t& format, const emit_t& emit) noexcept {
+    transform->drain();
+    if (auto ec = pull(emit, true); ec != transform_result_t::ok)
+        return ec;
+    const video_format_t previous = transform->get_output_format();
+    if (auto result = transform->set_input_format(format); result != transform_result_t::ok)
+        return result;
+    if (transform->get_output_format().pixel == pixel_format_t::unknown) {
+        video_format_t output = previous;
+        output.width = format.width;
+        output.height = format.height;
+        if (auto result = transform->set_output_format(output); result != transform_result_t::ok)
+            return result;
+    }
+    trace_emit(trace_event_t::stream_change, track, 0, 0);
+    return transform_result_t::ok;
+}
+
+transform_result_t video_transform_driver_t::process(const video_frame_t& input, const emit_t& emit) noexcept {
+    if (resync) {
+        if (input.keyframe() == false) {
+            ++num_skipped;
+            return transform_result_t::ok;
+        }
+        resync = false;
+    }
+    // the compressed inputs change in band. the decoders handle it
+    if (const video_format_t current = transform->get_input_format();
+        is_uncompressed(current) && is_uncompressed(input.format) && input.format.same_layout(current) == false)
+        if (auto ec = renegotiate(input.format, emit); ec != transform_result_t::ok)
+            return ec;
+    auto result = transform->process_input(input);
+    if (result == transform_result_t::not_accepting) {
+        // the outputs must be taken before the next input
+        if (auto ec = pull(emit, false); ec != transform_result_t::ok)
+            return ec;
+        result = transform->process_input(input);
+    }
+    if (result != transform_result_t::ok) {
+        trace_emit(trace_event_t::failed, track, 0, input.timestamp, static_cast<uint32_t>(result));
+        return result;
+    }
+    ++num_input;
+    trace_emit(trace_event_t::input_accepted, track, 0, input.timestamp);
+    return pull(emit, false);
+}
+
+transform_result_t video_transform_driver_t::drain(const emit_t& emit) noexcept {
+    transform->drain();
+    trace_emit(trace_event_t::drain_begin, track, 0, 0);
+    return pull(emit, true);
+}
+
+void video_transform_driver_t::flush(int64_t target) noexcept {
+    transform->flush();
+    discard_until = target;
+    resync = false;
+}
+
+bool video_transform_driver_t::drop_late(const video_frame_t& input, bool stale) noexcept {
+    ++num_late;
+    if (resync) {
+        // the keyframe ends the resync in `process`. it is kept even if late
+        if (input.keyframe())
+            return false;
+    } else if (transform->is_skippable(input) == false) {
+        if (stale == false || input.keyframe())
+            return false;
+        // the references are too late. start again from the next keyframe
+        transform->flush();
+        resync = true;
+    }
+    ++num_skipped;
+    trace_emit(trace_event_t::input_skipped, track, 0, input.timestamp, 0);
+    return true;
+}
+
+video_pipeline_t::video_pipeline_t(size_t _capacity) noexcept : capacity{_capacity ? _capacity : 1} {
+}
+
+video_pipeline_t::~video_pipeline_t() noexcept {
+    if (workers.empty())
+        return;
+    fail(transform_result_t::aborted);
+    for (auto& worker : workers)
+        worker.join();
+}
+
+video_transform_driver_t& video_pipeline_t::add(std::shared_ptr<video_transform_t> transform,
+                                                std::string_view name) noexcept(false) {
+    if (workers.empty() == false)
+        throw std::logic_error{"video_pipeline_t: already started"};
+    return *stages.emplace_back(std::make_unique<video_transform_driver_t>(std::move(transform), name));
+}
+
+size_t video_pipeline_t::size() const noexcept {
+    return stages.size();
+}
+
+video_transform_driver_t& video_pipeline_t::stage(size_t index) const noexcept(false) {
+    return *stages.at(index);
+}
+
+transform_result_t video_pipeline_t::start(sink_t sink) noexcept {
+    if (stages.empty() || workers.empty() == false)
+        return transform_result_t::not_ready;
+    try {
+        for (size_t i = 0; i < stages.size(); ++i)
+            queues.emplace_back(std::make_unique<queue_t>(capacity));
+        for (size_t i = 0; i < stages.size(); ++i)
+            workers.emplace_back(&video_pipeline_t::run, this, i, sink);
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "video_pipeline_t", ex.what());
+        fail(transform_result_t::failed);
+        return transform_result_t::failed;
+    }
+    return transform_result_t::ok;
+}
+
+void video_pipeline_t::set_max_latency(int64_t latency) noexcept(false) {
+    if (workers.empty() == false)
+        throw std::logic_error{"video_pipeline_t: already started"};
+    max_latency = std::max<int64_t>(latency, 0);
+}
+
+int64_t video_pipeline_t::get_lateness(const video_frame_t& frame) const noexcept {
+    if (max_latency == 0 || clock_started.load(std::memory_order_acquire) == false)
+        return 0;
+    const int64_t deadline = clock_origin.load(std::memory_order_relaxed) +
+                             (frame.timestamp - timestamp_origin.load(std::memory_order_relaxed)) + max_latency;
+    return get_clock() - deadline;
+}
+
+bool video_pipeline_t::push(video_frame_t frame) noexcept(false) {
+    if (queues.empty())
+        throw std::logic_error{"video_pipeline_t: not started"};
+    if (max_latency && clock_started.load(std::memory_order_relaxed) == false) {
+        timestamp_origin.store(frame.timestamp, std::memory_order_relaxed);
+        clock_origin.store(get_clock(), std::memory_order_relaxed);
+        clock_started.store(true, std::memory_order_release);
+    }
+    return queues.front()->push(std::move(frame));
+}
+
+transform_result_t video_pipeline_t::seek(int64_t target) noexcept(false) {
+    if (queues.empty())
+        throw std::logic_error{"video_pipeline_t: not started"};
+    // the frames before the marker are discarded stage by stage. see `flush`
+    video_frame_t marker{};
+    marker.timestamp = target;
+    marker.native_type = &seek_marker;
+    std::unique_lock lck{seek_mtx};
+    const uint64_t ticket = ++seeks_requested;
+    lck.unlock();
+    clock_started.store(false); // the next push is the new origin
+    queues.front()->clear();
+    if (queues.front()->push(marker) == false)
+        return error.load();
+    lck.lock();
+    seek_done.wait(lck, [this, ticket]() {
+        return seeks_completed >= ticket || error.load() != transform_result_t::ok;
+    });
+    return error.load();
+}
+
+/// @brief The marker reached the stage. Flush it and pass the marker to the next queue without the older frames
+transform_result_t video_pipeline_t::flush(size_t index, const video_frame_t& marker) noexcept(false) {
+    stages[index]->flush(marker.timestamp);
+    if (index + 1 < queues.size()) {
+        queues[index + 1]->clear();
+        return queues[index + 1]->push(marker) ? transform_result_t::ok : transform_result_t::aborted;
+    }
+    {
+        std::lock_guard lck{seek_mtx};
+        ++seeks_completed;
+    }
+    seek_done.notify_all();
+    return transform_result_t::ok;
+}
+
+transform_result_t video_pipeline_t::finish() noexcept {
+    if (queues.empty())
+        return transform_result_t::not_ready;
+    queues.front()->close();
+    for (auto& worker : workers)
+        worker.join();
+    workers.clear();
+    return error.load();
+}
+
+void video_pipeline_t::fail(transform_result_t result) noexcept {
+    transform_result_t expected = transform_result_t::ok;
+    error.compare_exchange_strong(expected, result);
+    for (auto& queue : queues)
+        queue->abort();
+    {
+        std::lock_guard lck{seek_mtx}; // wakes `seek`
+    }
+    seek_done.notify_all();
+}
+
+void video_pipeline_t::run(size_t index, sink_t sink) noexcept {
+    video_transform_driver_t& driver = *stages[index];
+    queue_t& input = *queues[index];
+    queue_t* output = index + 1 < queues.size() ? queues[index + 1].get() : nullptr;
+    const video_transform_driver_t::emit_t emit = [output, &sink](const video_frame_t& frame) {
+        if (output == nullptr)
+            return sink ? sink(frame) : transform_result_t::ok;
+        return output->push(frame) ? transform_result_t::ok : transform_result_t::aborted;
+    };
+    transform_result_t result = transform_result_t::ok;
+    try {
+        video_frame_t frame{};
+        while (result == transform_result_t::ok && input.pop(frame)) {
+            const int64_t lateness = get_lateness(frame);
+            if (frame.native_type == &seek_marker)
+                result = flush(index, frame);
+            else if (lateness <= 0 || driver.drop_late(frame, lateness > max_latency) == false)
+                result = driver.process(frame, emit);
+            frame = {};
+        }
+        // the input was closed by the previous stage. check the reason
+        if (result == transform_result_t::ok && error.load() == transform_result_t::ok)
+            result = driver.drain(emit);
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "video_pipeline_t", ex.what());
+        result = transform_result_t::failed;
+    }
+    if (result != transform_result_t::ok) {
+        if (result != transform_result_t::aborted)
+            spdlog::error("{}: {} {}", "video_pipeline_t", index, to_string(result));
+        fail(result);
+    }
+    if (output)
+        output->close();
+}
+
+video_fanout_t::video_fanout_t(size_t _capacity) noexcept : capacity{_capacity ? _capacity : 1}, root{capacity} {
+}
+
+video_pipeline_t& video_fanout_t::trunk() noexcept {
+    return root;
+}
+
+video_pipeline_t& video_fanout_t::add_branch(size_t _capacity) noexcept(false) {
+    if (started)
+        throw std::logic_error{"video_fanout_t: already started"};
+    return *branches.emplace_back(std::make_unique<video_pipeline_t>(_capacity ? _capacity : capacity));
+}
+
+size_t video_fanout_t::branch_count() const noexcept {
+    return branches.size();
+}
+
+video_pipeline_t& video_fanout_t::branch(size_t index) const noexcept(false) {
+    return *branches.at(index);
+}
+
+transform_result_t video_fanout_t::start(std::vector<sink_t> sinks) noexcept {
+    if (started || branches.empty() || sinks.size() != branches.size())
+        return transform_result_t::not_ready;
+    try {
+        direct_sinks.resize(branches.size());
+        for (size_t i = 0; i < branches.size(); ++i) {
+            if (branches[i]->size() == 0) {
+                direct_sinks[i] = std::move(sinks[i]);
+                continue;
+            }
+            if (auto result = branches[i]->start(std::move(sinks[i])); result != transform_result_t::ok)
+                return result;
+        }
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "video_fanout_t", ex.what());
+        return transform_result_t::failed;
+    }
+    started = true;
+    return root.start([this](const video_frame_t& frame) { return emit(frame); });
+}
+
+/// @brief On the last worker of the trunk. The copies share the pixels
+transform_result_t video_fanout_t::emit(const video_frame_t& frame) noexcept {
+    for (size_t i = 0; i < branches.size(); ++i) {
+        transform_result_t result = transform_result_t::ok;
+        try {
+            if (branches[i]->size() == 0)
+                result = direct_sinks[i] ? direct_sinks[i](frame) : transform_result_t::ok;
+            else if (branches[i]->push(frame) == false)
+                result = transform_result_t::aborted;
+        } catch (const std::exception& ex) {
+            spdlog::error("{}: {}", "video_fanout_t", ex.what());
+            result = transform_result_t::failed;
+        }
+        if (result != transform_result_t::ok)
+            return result;
+    }
+    return transform_result_t::ok;
+}
+
+bool video_fanout_t::push(video_frame_t frame) noexcept(false) {
+    return root.push(std::move(frame));
+}
+
+transform_result_t video_fanout_t::seek(int64_t target) noexcept(false) {
+    // the trunk stops pushing to the branches when its seek returns
+    if (auto result = root.seek(target); result != transform_result_t::ok)
+        return result;
+    for (auto& branch : branches)
+        if (branch->size())
+            if (auto result = branch->seek(target); result != transform_result_t::ok)
+                return result;
+    return transform_result_t::ok;
+}
+
+transform_result_t video_fanout_t::finish() noexcept {
+    if (started == false)
+        return transform_result_t::not_ready;
+    transform_result_t result = root.finish();
+    for (auto& branch : branches) {
+        if (branch->size() == 0)
+            continue;
+        // the trunk is aborted by a failed branch. report the reason of the branch
+        if (auto ec = branch->finish(); ec != transform_result_t::ok)
+            if (result == transform_result_t::ok || result == transform_result_t::aborted)
+                result = ec;
+    }
+    return result;
+}
@@ -0,0 +1,217 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "pipeline.hpp"
+#include "video_transform.hpp"
+
+/**
+ * @brief Drives a `video_transform_t` like `mf_transform_driver_t` does for `IMFTransform`.
+ *        ProcessInput, ProcessOutput until need_more_input, drain
+ * @note The formats must be configured before the first `process`
+ */
+class video_transform_driver_t final {
+  public:
+    using emit_t = std::function<transform_result_t(const video_frame_t&)>;
+
+  private:
+    std::shared_ptr<video_transform_t> transform;
+    uint16_t track = 0;
+    std::atomic<size_t> num_input{0};
+    std::atomic<size_t> num_output{0};
+    std::atomic<size_t> num_discarded{0};
+    std::atomic<size_t> num_late{0};
+    std::atomic<size_t> num_skipped{0};
+    int64_t discard_until = INT64_MIN; // the outputs which end before this are not emitted
+    bool resync = false;               // the inputs before the next keyframe are skipped
+
+  public:
+    video_transform_driver_t(std::shared_ptr<video_transform_t> transform, std::string_view name) noexcept(false);
+    video_transform_driver_t(const video_transform_driver_t&) = delete;
+    video_transform_driver_t(video_transform_driver_t&&) = delete;
+    video_transform_driver_t& operator=(const video_transform_driver_t&) = delete;
+    video_transform_driver_t& operator=(video_transform_driver_t&&) = delete;
+    ~video_transform_driver_t() noexcept = default;
+
+    /// @brief `process_input` and forward all available outputs to `emit`
+    [[nodiscard]] transform_result_t process(const video_frame_t& input, const emit_t& emit) noexcept;
+    /// @brief `drain` and forward the leftovers to `emit`
+    [[nodiscard]] transform_result_t drain(const emit_t& emit) noexcept;
+    /**
+     * @brief `flush` the transform for a seek. The transform and its buffers are kept
+     * @param target the outputs before it are discarded without `emit`. The frames from the sync sample to the target
+     */
+    void flush(int64_t target = INT64_MIN) noexcept;
+    /**
+     * @brief QoS. The `input` missed its deadline. Drop it if the transform can skip it
+     * @param stale too late even for the references. The transform is flushed and the inputs are skipped until
+     *              the next keyframe, like the seek of a decoder
+     * @return true if the input is dropped. Otherwise `process` it
+     */
+    bool drop_late(const video_frame_t& input, bool stale) noexcept;
+
+    [[nodiscard]] video_transform_t& get() const noexcept;
+    [[nodiscard]] size_t input_count() const noexcept;
+    [[nodiscard]] size_t output_count() const noexcept;
+    /// @brief The outputs discarded after `flush`
+    [[nodiscard]] size_t discarded_count() const noexcept;
+    /// @brief The inputs which missed their deadline. Some of them are processed if they can't be skipped
+    [[nodiscard]] size_t late_count() const noexcept;
+    /// @brief The inputs dropped by QoS
+    [[nodiscard]] size_t skipped_count() const noexcept;
+
+  private:
+    transform_result_t pull(const emit_t& emit, bool draining) noexcept;
+    transform_result_t renegotiate(const video_format_t& format, const emit_t& emit) noexcept;
+};
+
+/**
+ * @brief Portable version of `mf_pipeline_t`. Each stage runs on its own thread with a bounded queue in front of it.
+ *        The frames are passed by reference count
+ * @code
+ * video_pipeline_t pipeline{};
+ * pipeline.add(converter, "cpu_converter_t");
+ * pipeline.add(scaler, "cpu_scaler_t");
+ * pipeline.start(sink);
+ * for (auto& frame : frames)
+ *     if (pipeline.push(frame) == false)
+ *         break;
+ * transform_result_t result = pipeline.finish();
+ * @endcode
+ */
+class video_pipeline_t final {
+  public:
+    using sink_t = std::function<transform_result_t(const video_frame_t&)>;
+    using queue_t = bounded_queue_t<video_frame_t>;
+
+  private:
+    const size_t capacity;
+    std::vector<std::unique_ptr<video_transform_driver_t>> stages{};
+    std::vector<std::unique_ptr<queue_t>> queues{}; // `queues[i]` is the input of `stages[i]`
+    std::vector<std::thread> workers{};
+    std::atomic<transform_result_t> error{transform_result_t::ok};
+    std::mutex seek_mtx{};
+    std::condition_variable seek_done{};
+    uint64_t seeks_requested = 0;
+    uint64_t seeks_completed = 0; // the marker passed the last stage
+    int64_t max_latency = 0;      // QoS. 0 if disabled
+    std::atomic<bool> clock_started{false};
+    std::atomic<int64_t> clock_origin{0}; // the steady clock at the first push
+    std::atomic<int64_t> timestamp_origin{0};
+
+  public:
+    /// @param capacity length of the queue between the stages
+    explicit video_pipeline_t(size_t capacity = 4) noexcept;
+    video_pipeline_t(const video_pipeline_t&) = delete;
+    video_pipeline_t(video_pipeline_t&&) = delete;
+    video_pipeline_t& operator=(const video_pipeline_t&) = delete;
+    video_pipeline_t& operator=(video_pipeline_t&&) = delete;
+    /// @note aborts the running stages
+    ~video_pipeline_t() noexcept;
+
+    /// @throws std::logic_error the pipeline is started
+    video_transform_driver_t& add(std::shared_ptr<video_transform_t> transform, std::string_view name) noexcept(false);
+    [[nodiscard]] size_t size() const noexcept;
+    [[nodiscard]] video_transform_driver_t& stage(size_t index) const noexcept(false);
+
+    /// @param sink receives the outputs of the last stage. can be `nullptr`
+    [[nodiscard]] transform_result_t start(sink_t sink) noexcept;
+    /**
+     * @brief QoS for the live sources. The frame is due `latency` after the first push plus the distance of the
+     *        timestamps. Each stage drops its late inputs which the transform can skip, so the decoder skips the
+     *        pictures which are not referenced and the other stages skip any frame. An input later than twice of it
+     *        makes the stage wait for the next keyframe. The counts are in `late_count` and `skipped_count` of the
+     *        stages
+     * @param latency unit 100-nanosecond. 0 to disable
+     * @note The clock starts again after `seek`
+     * @throws std::logic_error the pipeline is started
+     */
+    void set_max_latency(int64_t latency) noexcept(false);
+    /// @return false if a stage failed. see `finish` for the reason
+    bool push(video_frame_t frame) noexcept(false);
+    /**
+     * @brief Discard the frames in flight and flush each stage in order. The transforms and the pools are kept warm.
+     *        Push from the sync sample at or before the `target` next. The first stage discards its outputs before
+     *        the `target`, so the later stages don't convert or scale them
+     * @note Call from the thread of `push`. Returns when all stages are flushed. The sink may receive the frames
+     *       which were in the last stage before it returns
+     * @return the first error of the stages
+     */
+    [[nodiscard]] transform_result_t seek(int64_t target) noexcept(false);
+    /// @brief Drain the stages in order and wait for the workers
+    /// @return the first error of the stages
+    [[nodiscard]] transform_result_t finish() noexcept;
+
+  private:
+    /// @return how late the frame is. Not positive if it is in time or QoS is disabled
+    [[nodiscard]] int64_t get_lateness(const video_frame_t& frame) const noexcept;
+    void run(size_t index, sink_t sink) noexcept;
+    transform_result_t flush(size_t index, const video_frame_t& marker) noexcept(false);
+    void fail(transform_result_t result) noexcept;
+};
+
+/**
+ * @brief One trunk (the decoder) feeding several branches (the renditions). The outputs of the trunk are shared with
+ *        every branch by reference count, so the decode runs once for any count of branches.
+ *        Each branch is a `video_pipeline_t` with its own queues and workers. A slow branch fills its own queues
+ *        while the others keep running. The trunk waits only when that branch is full
+ * @code
+ * video_fanout_t fanout{};
+ * fanout.trunk().add(decoder, "cpu_h264_decoder_t");
+ * fanout.add_branch().add(scaler_720p, "cpu_scaler_t");
+ * fanout.add_branch(8).add(scaler_360p, "cpu_scaler_t"); // longer queues for a slow branch
+ * fanout.start({sink_720p, sink_360p});
+ * @endcode
+ * @note A branch without stages gives the outputs of the trunk to its sink on the worker of the trunk
+ */
+class video_fanout_t final {
+  public:
+    using sink_t = video_pipeline_t::sink_t;
+
+  private:
+    const size_t capacity;
+    // the trunk pushes to the branches. it is destroyed first
+    std::vector<std::unique_ptr<video_pipeline_t>> branches{};
+    std::vector<sink_t> direct_sinks{}; // of the branches without stages
+    video_pipeline_t root;
+    bool started = false;
+
+  public:
+    /// @param capacity length of the queues of the trunk and the default of the branches
+    explicit video_fanout_t(size_t capacity = 4) noexcept;
+    video_fanout_t(const video_fanout_t&) = delete;
+    video_fanout_t(video_fanout_t&&) = delete;
+    video_fanout_t& operator=(const video_fanout_t&) = delete;
+    video_fanout_t& operator=(video_fanout_t&&) = delete;
+    /// @note aborts the running stages
+    ~video_fanout_t() noexcept = default;
+
+    [[nodiscard]] video_pipeline_t& trunk() noexcept;
+    /**
+     * @param capacity length of the queues of the branch. 0 for the one of the trunk
+     * @throws std::logic_error the fanout is started
+     */
+    video_pipeline_t& add_branch(size_t capacity = 0) noexcept(false);
+    [[nodiscard]] size_t branch_count() const noexcept;
+    [[nodiscard]] video_pipeline_t& branch(size_t index) const noexcept(false);
+
+    /// @param sinks one for each branch. can be `nullptr`
+    [[nodiscard]] transform_result_t start(std::vector<sink_t> sinks) noexcept;
+    /// @return false if a stage failed. see `finish` for the reason
+    bool push(video_frame_t frame) noexcept(false);
+    /// @brief `video_pipeline_t::seek` of the trunk, then of the branches
+    [[nodiscard]] transform_result_t seek(int64_t target) noexcept(false);
+    /// @brief Drain the trunk, then the branches
+    /// @return the first error. The failure of a branch is reported rather than the abort of the trunk
+    [[nodiscard]] transform_result_t finish() noexcept;
+
+  private:
+    transform_result_t emit(const video_frame_t& frame) noexcept;
+};
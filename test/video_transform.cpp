@@ -0,0 +1,223 @@
+#include "video_transform.hpp"
+
+#include <spdlog/spdlog.h>
+
+const char* to_string(transform_result_t result) noexcept {
+    switch (result) {
+    case transform_result_t::ok:
+        return "ok";
+    case transform_result_t::need_more_input:
+        return "need_more_input";
+    case transform_result_t::stream_change:
+        return "stream_change";
+    case transform_result_t::not_accepting:
+        return "not_accepting";
+    case transform_result_t::invalid_format:
+        return "invalid_format";
+    case transform_result_t::not_ready:
+        return "not_ready";
+    case transform_result_t::aborted:
+        return "aborted";
+    default:
+        return "failed";
+    }
+}
+
+bool is_uncompressed(const video_format_t& format) noexcept {
+    return format.width && format.height && get_plane_count(format.pixel) && is_compressed(format.pixel) == false;
+}
+
+bool video_transform_t::is_skippable(const video_frame_t& input) noexcept {
+    return is_compressed(input.format.pixel) == false;
+}
+
+transform_result_t cpu_transform_t::set_input_format(const video_format_t& format) noexcept {
+    if (is_uncompressed(format) == false)
+        return transform_result_t::invalid_format;
+    input_format = format;
+    pending = {};
+    return update();
+}
+
+transform_result_t cpu_transform_t::set_output_format(const video_format_t& format) noexcept {
+    if (is_uncompressed(input_format) == false)
+        return transform_result_t::not_ready;
+    if (is_uncompressed(format) == false || verify(input_format, format) == false)
+        return transform_result_t::invalid_format;
+    output_format = format;
+    resize_pool();
+    return transform_result_t::ok;
+}
+
+transform_result_t cpu_transform_t::update() noexcept {
+    if (is_uncompressed(input_format) == false)
+        return transform_result_t::ok; // keep the settings until the input is known
+    const video_format_t format = derive(input_format);
+    if (is_uncompressed(format) == false || verify(input_format, format) == false)
+        return transform_result_t::invalid_format;
+    output_format = format;
+    resize_pool();
+    return transform_result_t::ok;
+}
+
+void cpu_transform_t::resize_pool() noexcept {
+    if (pool == nullptr || pool->format().same_layout(output_format))
+        return;
+    try {
+        pool->reset(output_format);
+    } catch (const std::exception& ex) {
+        spdlog::warn("{}: {}", "cpu_transform_t", ex.what());
+        pool = nullptr; // `acquire` makes a new one
+    }
+}
+
+video_format_t cpu_transform_t::get_input_format() const noexcept {
+    return input_format;
+}
+
+video_format_t cpu_transform_t::get_output_format() const noexcept {
+    return output_format;
+}
+
+transform_result_t cpu_transform_t::process_input(const video_frame_t& input) noexcept {
+    if (is_uncompressed(input_format) == false || is_uncompressed(output_format) == false)
+        return transform_result_t::not_ready;
+    if (pending)
+        return transform_result_t::not_accepting;
+    if (input.format.same_layout(input_format) == false)
+        return transform_result_t::invalid_format;
+    pending = input;
+    return transform_result_t::ok;
+}
+
+transform_result_t cpu_transform_t::process_output(video_frame_t& output) noexcept {
+    if (!pending)
+        return transform_result_t::need_more_input;
+    try {
+        output = run(pending);
+    } catch (const std::exception& ex) {
+        spdlog::error("{}: {}", "cpu_transform_t", ex.what());
+        pending = {};
+        return transform_result_t::failed;
+    }
+    output.format.fps_num = output_format.fps_num;
+    output.format.fps_den = output_format.fps_den;
+    output.timestamp = pending.timestamp;
+    output.duration = pending.duration;
+    output.flags = pending.flags;
+    output.native = nullptr; // the backend object doesn't describe the new pixels
+    output.native_type = nullptr;
+    pending = {};
+    return transform_result_t::ok;
+}
+
+void cpu_transform_t::drain() noexcept {
+    // no latency. the pending input is returned by the next `process_output`
+}
+
+void cpu_transform_t::flush() noexcept {
+    pending = {};
+}
+
+video_frame_t cpu_transform_t::acquire() noexcept(false) {
+    if (pool == nullptr)
+        pool = std::make_unique<frame_pool_t>(output_format);
+    return pool->acquire();
+}
+
+video_format_t cpu_converter_t::derive(const video_format_t& input) const noexcept {
+    video_format_t format = input;
+    if (output_format.pixel != pixel_format_t::unknown)
+        format.pixel = output_format.pixel;
+    return format;
+}
+
+bool cpu_converter_t::verify(const video_format_t& input, const video_format_t& output) const noexcept {
+    return input.width == output.width && input.height == output.height;
+}
+
+video_frame_t cpu_converter_t::run(const video_frame_t& input) noexcept(false) {
+    if (input.format.pixel == output_format.pixel)
+        return input; // nothing to convert. share the pixels
+    video_frame_t output = acquire();
+    convert_frame(input, output);
+    return output;
+}
+
+transform_result_t cpu_cropper_t::set_region(const video_rect_t& _region) noexcept {
+    region = _region;
+    return update();
+}
+
+video_format_t cpu_cropper_t::derive(const video_format_t& input) const noexcept {
+    video_format_t format = input;
+    if (const video_rect_t clipped = clip_region(input, region); clipped.width) {
+        format.width = clipped.width;
+        format.height = clipped.height;
+    }
+    return format;
+}
+
+bool cpu_cropper_t::verify(const video_format_t& input, const video_format_t& output) const noexcept {
+    return derive(input).same_layout(output);
+}
+
+video_frame_t cpu_cropper_t::run(const video_frame_t& input) noexcept(false) {
+    if (region.width == 0 || region.height == 0)
+        return input;
+    return crop_frame(input, region);
+}
+
+transform_result_t cpu_scaler_t::set_size(uint32_t _width, uint32_t _height) noexcept {
+    if (_width == 0 || _height == 0)
+        return transform_result_t::invalid_format;
+    width = _width;
+    height = _height;
+    return update();
+}
+
+video_format_t cpu_scaler_t::derive(const video_format_t& input) const noexcept {
+    video_format_t format = input;
+    if (width && height) {
+        format.width = width;
+        format.height = height;
+    } else if (output_format.width && output_format.height) {
+        format.width = output_format.width; // from `set_output_format`
+        format.height = output_format.height;
+    }
+    return format;
+}
+
+bool cpu_scaler_t::verify(const video_format_t& input, const video_format_t& output) const noexcept {
+    return input.pixel == output.pixel;
+}
+
+video_frame_t cpu_scaler_t::run(const video_frame_t& input) noexcept(false) {
+    if (input.format.same_layout(output_format))
+        return input;
+    video_frame_t output = acquire();
+    scale_frame(input, output);
+    return output;
+}
+
+transform_result_t cpu_rotator_t::set_mirror_rotation(uint32_t _mirror, video_rotation_t _rotation) noexcept {
+    mirror = _mirror;
+    rotation = _rotation;
+    return update();
+}
+
+video_format_t cpu_rotator_t::derive(const video_format_t& input) const noexcept {
+    return rotate_format(input, rotation);
+}
+
+bool cpu_rotator_t::verify(const video_format_t& input, const video_format_t& output) const noexcept {
+    return rotate_format(input, rotation).same_layout(output);
+}
+
+video_frame_t cpu_rotator_t::run(const video_frame_t& input) noexcept(false) {
+    if (rotation == video_rotation_t::none && mirror == mirror_none)
+        return input;
+    video_frame_t output = acquire();
+    rotate_frame(input, output, rotation, mirror);
+    return output;
+}
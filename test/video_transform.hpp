@@ -0,0 +1,165 @@
+#pragma once
+#include <memory>
+
+#include "video_frame.hpp"
+#include "video_kernels.hpp"
+
+/**
+ * @brief Results of the portable transforms. Each one matches a return of `IMFTransform`
+ * @see https://docs.microsoft.com/en-us/windows/win32/medfound/basic-mft-processing-model
+ */
+enum class transform_result_t : uint32_t {
+    ok = 0,
+    need_more_input = 1, // MF_E_TRANSFORM_NEED_MORE_INPUT
+    stream_change = 2,   // MF_E_TRANSFORM_STREAM_CHANGE. `get_output_format` returns the new one
+    not_accepting = 3,   // MF_E_NOTACCEPTING. call `process_output` until `need_more_input`
+    invalid_format = 4,  // MF_E_INVALIDMEDIATYPE
+    not_ready = 5,       // MF_E_TRANSFORM_TYPE_NOT_SET
+    failed = 6,          // the backend error. see the log
+    aborted = 7,         // E_ABORT. the consumer stopped the processing
+};
+
+[[nodiscard]] const char* to_string(transform_result_t result) noexcept;
+
+/// @brief The pixels and the size are known
+[[nodiscard]] bool is_uncompressed(const video_format_t& format) noexcept;
+
+/**
+ * @brief Platform neutral transform with the input/output/drain contract of `IMFTransform`.
+ *        One input stream and one output stream.
+ *
+ * @code
+ * transform.set_input_format(input_format);
+ * transform.set_output_format(output_format);
+ * for (auto& input : inputs) {
+ *     transform.process_input(input);
+ *     video_frame_t output{};
+ *     while (transform.process_output(output) == transform_result_t::ok)
+ *         consume(output);
+ * }
+ * transform.drain();
+ * // process_output until need_more_input
+ * @endcode
+ *
+ * @note The implementations provide the output frames (MFT_OUTPUT_STREAM_PROVIDES_SAMPLES)
+ *       so they can be shared without copy
+ */
+class video_transform_t {
+  public:
+    virtual ~video_transform_t() noexcept = default;
+
+    /// @brief `SetInputType`
+    [[nodiscard]] virtual transform_result_t set_input_format(const video_format_t& format) noexcept = 0;
+    /// @brief `SetOutputType`. Some fields may be adjusted. Use `get_output_format` for the result
+    [[nodiscard]] virtual transform_result_t set_output_format(const video_format_t& format) noexcept = 0;
+    [[nodiscard]] virtual video_format_t get_input_format() const noexcept = 0;
+    [[nodiscard]] virtual video_format_t get_output_format() const noexcept = 0;
+
+    /// @brief `ProcessInput`. The frame may be retained until the matching output is produced
+    [[nodiscard]] virtual transform_result_t process_input(const video_frame_t& input) noexcept = 0;
+    /// @brief `ProcessOutput`
+    [[nodiscard]] virtual transform_result_t process_output(video_frame_t& output) noexcept = 0;
+
+    /// @brief `MFT_MESSAGE_COMMAND_DRAIN`. The leftovers are returned by `process_output`
+    virtual void drain() noexcept = 0;
+    /// @brief `MFT_MESSAGE_COMMAND_FLUSH`. Discard the retained inputs
+    virtual void flush() noexcept = 0;
+
+    /**
+     * @brief QoS. The late `input` can be dropped without breaking the next outputs
+     * @note true for the uncompressed inputs. The decoders tell the pictures which are not referenced
+     */
+    [[nodiscard]] virtual bool is_skippable(const video_frame_t& input) noexcept;
+};
+
+/**
+ * @brief Base of the synchronous 1:1 CPU transforms. Holds one input like the MFTs with a single input buffer.
+ *        The outputs come from the `frame_pool_t` of the output format
+ */
+class cpu_transform_t : public video_transform_t {
+  protected:
+    video_format_t input_format{};
+    video_format_t output_format{};
+    video_frame_t pending{};
+    std::unique_ptr<frame_pool_t> pool{};
+
+  public:
+    cpu_transform_t() noexcept = default;
+    cpu_transform_t(const cpu_transform_t&) = delete;
+    cpu_transform_t(cpu_transform_t&&) = delete;
+    cpu_transform_t& operator=(const cpu_transform_t&) = delete;
+    cpu_transform_t& operator=(cpu_transform_t&&) = delete;
+
+    transform_result_t set_input_format(const video_format_t& format) noexcept override;
+    transform_result_t set_output_format(const video_format_t& format) noexcept override;
+    video_format_t get_input_format() const noexcept override;
+    video_format_t get_output_format() const noexcept override;
+
+    transform_result_t process_input(const video_frame_t& input) noexcept override;
+    transform_result_t process_output(video_frame_t& output) noexcept override;
+    void drain() noexcept override;
+    void flush() noexcept override;
+
+  protected:
+    /// @return the output format for the `input` which keeps the current settings
+    [[nodiscard]] virtual video_format_t derive(const video_format_t& input) const noexcept = 0;
+    [[nodiscard]] virtual bool verify(const video_format_t& input, const video_format_t& output) const noexcept = 0;
+    /// @note may return a view of the `input`
+    [[nodiscard]] virtual video_frame_t run(const video_frame_t& input) noexcept(false) = 0;
+
+    /// @brief A pooled frame of the output format
+    [[nodiscard]] video_frame_t acquire() noexcept(false);
+    /// @brief Apply `derive` after the settings are changed
+    transform_result_t update() noexcept;
+    /// @brief Keep the pool while the layout of the output is the same. The idle buffers are reused if they fit
+    void resize_pool() noexcept;
+};
+
+/// @brief CPU version of `color_converter_t`. The size is not changed
+class cpu_converter_t final : public cpu_transform_t {
+  protected:
+    video_format_t derive(const video_format_t& input) const noexcept override;
+    bool verify(const video_format_t& input, const video_format_t& output) const noexcept override;
+    video_frame_t run(const video_frame_t& input) noexcept(false) override;
+};
+
+/// @brief CPU version of `sample_cropper_t`. The outputs share the pixels of the inputs
+class cpu_cropper_t final : public cpu_transform_t {
+    video_rect_t region{};
+
+  public:
+    [[nodiscard]] transform_result_t set_region(const video_rect_t& region) noexcept;
+
+  protected:
+    video_format_t derive(const video_format_t& input) const noexcept override;
+    bool verify(const video_format_t& input, const video_format_t& output) const noexcept override;
+    video_frame_t run(const video_frame_t& input) noexcept(false) override;
+};
+
+/// @brief CPU version of `sample_processor_t::set_scale`. Bilinear filter
+class cpu_scaler_t final : public cpu_transform_t {
+    uint32_t width = 0; // 0 if not set
+    uint32_t height = 0;
+
+  public:
+    [[nodiscard]] transform_result_t set_size(uint32_t width, uint32_t height) noexcept;
+
+  protected:
+    video_format_t derive(const video_format_t& input) const noexcept override;
+    bool verify(const video_format_t& input, const video_format_t& output) const noexcept override;
+    video_frame_t run(const video_frame_t& input) noexcept(false) override;
+};
+
+/// @brief CPU version of `sample_processor_t::set_mirror_rotation`
+class cpu_rotator_t final : public cpu_transform_t {
+    video_rotation_t rotation = video_rotation_t::none;
+    uint32_t mirror = mirror_none;
+
+  public:
+    [[nodiscard]] transform_result_t set_mirror_rotation(uint32_t mirror, video_rotation_t rotation) noexcept;
+
+  protected:
+    video_format_t derive(const video_format_t& input) const noexcept override;
+    bool verify(const video_format_t& input, const video_format_t& output) const noexcept override;
+    video_frame_t run(const video_frame_t& input) noexcept(false) override;
+};